@@ -29,9 +29,7 @@
 #include "bulk_operate.h"
 #include "bulk_operate_ext.h"
 #include "generic_type.h"
-#ifdef ENABLE_TRILINOS
 #include "eigensolver/eigensolver.h"
-#endif
 
 #include "rutils.h"
 #include "fmr_utils.h"
@@ -1260,7 +1258,6 @@ T get_scalar(SEXP val)
 		return REAL(val)[0];
 }
 
-#ifdef ENABLE_TRILINOS
 class R_spm_function: public eigen::spm_function
 {
 	Rcpp::Function fun;
@@ -1388,7 +1385,6 @@ RcppExport SEXP R_FM_eigen(SEXP pfunc, SEXP pextra, SEXP psym, SEXP poptions,
 	ret["options"] = options;
 	return ret;
 }
-#endif
 
 RcppExport SEXP R_FM_scale(SEXP pmat, SEXP pvec, SEXP pbyrow)
 {
@@ -24,6 +24,7 @@
 #include "graph.h"
 #include "FG_vector.h"
 #include "graph_file_header.h"
+#include "graph_delta.h"
 
 namespace safs
 {
@@ -46,6 +47,8 @@ class FG_graph
 	std::string index_file;
 	std::shared_ptr<in_mem_graph> graph_data;
 	std::shared_ptr<vertex_index> index_data;
+	// The updates that haven't been compacted into the graph yet.
+	graph_delta_store::ptr delta_store;
 	config_map::ptr configs;
 
 	// In this case, the graph file is kept in SAFS and the index is read to
@@ -112,6 +115,27 @@ public:
 
 	std::shared_ptr<vertex_index> get_index_data() const;
 
+	/**
+	 * \brief Get the updates on the graph that are merged into
+	 *        the adjacency lists of vertices when they are read.
+	 * \return The delta store. It's NULL if the graph has no updates.
+	 */
+	graph_delta_store::ptr get_delta_store() const {
+		return delta_store;
+	}
+
+	/**
+	 * \brief Create a graph object that shares the graph data with
+	 *        this graph and sees the updates in the delta store.
+	 * \param store The updates applied to the graph.
+	 * \return The new graph object.
+	 */
+	ptr attach_delta(graph_delta_store::ptr store) const {
+		FG_graph *g = new FG_graph(*this);
+		g->delta_store = store;
+		return ptr(g);
+	}
+
 	graph_engine::ptr create_engine(graph_index::ptr index);
 
 	/**
@@ -159,6 +183,21 @@ FG_vector<vertex_id_t>::ptr compute_cc(FG_graph::ptr fg);
 */
 FG_vector<vertex_id_t>::ptr compute_wcc(FG_graph::ptr fg);
 
+/**
+  * \brief Update the weakly connectected components of a graph after
+  *        a batch of edge updates. Only the vertices affected by
+  *        the updates are recomputed.
+  *
+  * \param fg The FlashGraph graph object with the updates applied.
+  * \param prev_comps The components computed before the updates.
+  * \param updates The edge updates applied since `prev_comps' was computed.
+  * \return A vector with a component ID for each vertex in the graph.
+  *
+*/
+FG_vector<vertex_id_t>::ptr compute_incremental_wcc(FG_graph::ptr fg,
+		FG_vector<vertex_id_t>::ptr prev_comps,
+		const std::vector<edge_update> &updates);
+
 /**
   * \brief Compute all weakly connectected components of a graph synchronously.
   * The reason of having this implementation is to understand the performance
@@ -215,6 +254,53 @@ FG_vector<size_t>::ptr compute_directed_triangles_fast(FG_graph::ptr fg,
 */
 FG_vector<size_t>::ptr compute_undirected_triangles(FG_graph::ptr fg);
 
+/**
+  * \brief The estimate of the triangles in an undirected graph.
+  */
+struct triangle_estimate
+{
+	/** The estimated number of triangles. */
+	double num_triangles;
+	/** The estimated global clustering coefficient. */
+	double clustering_coeff;
+	/** The clustering coefficient is within `error` of the estimate
+	 *  with the probability of `confidence`. The number of triangles is
+	 *  within `error * num_wedges / 3`. */
+	double error;
+	double confidence;
+	/** The number of paths of length two in the graph. */
+	size_t num_wedges;
+	/** The number of sampled wedges. */
+	size_t num_samples;
+};
+
+/**
+  * \brief Estimate the number of triangles and the global clustering
+  *        coefficient of an undirected graph with wedge sampling.
+  *        Only the vertices with sampled wedges and the endpoints of
+  *        the wedges are read from the graph.
+  * \param fg The FlashGraph graph object for which you want to compute.
+  * \param error The additive error of the clustering coefficient. The number
+  *        of samples grows with 1 / error^2, so it trades accuracy for runtime.
+  * \param confidence The probability that the estimate is within the error.
+  * \return The estimate. It's empty for a directed graph.
+  */
+triangle_estimate estimate_triangles(FG_graph::ptr fg, double error = 0.01,
+		double confidence = 0.99);
+
+/**
+  * \brief Estimate the local clustering coefficient of each vertex in
+  *        an undirected graph with wedge sampling. The estimate of
+  *        a vertex with at most `max_samples` wedges is exact.
+  * \param fg The FlashGraph graph object for which you want to compute.
+  * \param max_samples The maximal number of wedges sampled at a vertex.
+  *        The estimate of a vertex is within sqrt(ln(2 / delta) / (2 * max_samples))
+  *        with the probability of 1 - delta.
+  * \return A vector with the local clustering coefficient of each vertex.
+  */
+FG_vector<float>::ptr estimate_local_clustering(FG_graph::ptr fg,
+		size_t max_samples = 64);
+
 /**
   * \brief Compute the per-vertex local Scan Statistic 
   * \param fg The FlashGraph graph object for which you want to compute.
@@ -253,13 +339,37 @@ size_t estimate_diameter(FG_graph::ptr fg, int num_bfs, bool directed);
   * \param fg The FlashGraph graph object for which you want to compute.
   * \param num_iters The maximum number of iterations for PageRank.
   * \param damping_factor The damping factor. Originally .85.
+  * \param tolerance A vertex doesn't activate its neighbors if its
+  *        PageRank changes less than this.
   *
   * \return A vector with an entry for each vertex in the graph's
   *         PageRank value.
   *
 */
 FG_vector<float>::ptr compute_pagerank(FG_graph::ptr fg, int num_iters,
-		float damping_factor);
+		float damping_factor, float tolerance = 1.0E-2);
+
+/**
+  * \brief Update the PageRank of a graph after a batch of edge updates.
+  *       It starts from the PageRank computed before the updates and
+  *       only activates the vertices whose in-edges or in-neighbors'
+  *       out-degree are changed by the updates.
+  *
+  * \param fg The FlashGraph graph object with the updates applied.
+  * \param prev_pr The PageRank computed before the updates.
+  * \param updates The edge updates applied since `prev_pr' was computed.
+  * \param num_iters The maximum number of iterations for PageRank.
+  * \param damping_factor The damping factor. Originally .85.
+  * \param tolerance A vertex doesn't activate its neighbors if its
+  *        PageRank changes less than this.
+  *
+  * \return A vector with an entry for each vertex in the graph's
+  *         PageRank value.
+  *
+*/
+FG_vector<float>::ptr compute_incremental_pagerank(FG_graph::ptr fg,
+		FG_vector<float>::ptr prev_pr, const std::vector<edge_update> &updates,
+		int num_iters, float damping_factor, float tolerance = 1.0E-2);
 
 /**
   * \brief Compute the PageRank of a graph using the push method
@@ -269,13 +379,15 @@ FG_vector<float>::ptr compute_pagerank(FG_graph::ptr fg, int num_iters,
   * \param fg The FlashGraph graph object for which you want to compute.
   * \param num_iters The maximum number of iterations for PageRank.
   * \param damping_factor The damping factor. Originally .85.
+  * \param tolerance A vertex doesn't activate its neighbors if its
+  *        PageRank changes less than this.
   *
   * \return A vector with an entry for each vertex in the graph's
   *         PageRank value.
   *
 */
 FG_vector<float>::ptr compute_pagerank2(FG_graph::ptr, int num_iters,
-		float damping_factor);
+		float damping_factor, float tolerance = 1.0E-2);
 
 FG_vector<float>::ptr compute_sstsg(FG_graph::ptr fg, time_t start_time,
 		time_t interval, int num_intervals);
@@ -375,5 +487,31 @@ FG_vector<float>::ptr compute_transitivity(FG_graph::ptr fg);
  * \param levels The number of levels of the hierarchy to do.
  */
 void compute_louvain(FG_graph::ptr fg, const uint32_t levels);
+
+/**
+ * \brief Detect communities with label propagation. In each iteration,
+ *        every active vertex adopts the label that is the most frequent
+ *        among its neighbors. The edges of a directed graph are
+ *        considered as undirected.
+ * \param fg The FlashGraph graph object for which you want to compute.
+ * \param max_iters The maximal number of iterations.
+ * \return A vector with the community label of each vertex.
+ */
+FG_vector<vertex_id_t>::ptr compute_label_propagation(FG_graph::ptr fg,
+		int max_iters = 20);
+
+/**
+ * \brief Detect communities with the multi-level Louvain method. Vertices
+ *        move between communities in parallel at each level, and then
+ *        each community is coarsened into a vertex of the graph of the next
+ *        level. The coarsened graphs are stored in SAFS under temporary
+ *        names if it's initialized and are removed when it completes.
+ * \param fg The FlashGraph graph object for which you want to compute.
+ * \param max_levels The maximal number of levels.
+ * \param max_iters The maximal number of iterations in a level.
+ * \return A vector with the community ID of each vertex.
+ */
+FG_vector<vertex_id_t>::ptr compute_parallel_louvain(FG_graph::ptr fg,
+		int max_levels = 10, int max_iters = 20);
 }
 #endif
@@ -0,0 +1,787 @@
+/*
+ * Copyright 2014 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of FlashGraph.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <set>
+#include <unordered_map>
+
+#include <boost/foreach.hpp>
+#include <boost/format.hpp>
+
+#include "log.h"
+#include "common.h"
+#include "io_interface.h"
+#include "safs_file.h"
+#include "safs_exception.h"
+
+#include "dynamic_graph.h"
+#include "graph_engine.h"
+#include "graph.h"
+#include "in_mem_storage.h"
+#include "vertex_index_constructor.h"
+
+using namespace safs;
+
+namespace fg
+{
+
+/********************** Compact deltas into a graph ***************************/
+
+namespace {
+
+class compact_vertex: public compute_vertex
+{
+public:
+	compact_vertex(vertex_id_t id): compute_vertex(id) {
+	}
+
+	void run(vertex_program &prog) {
+		vertex_id_t id = prog.get_vertex_id(*this);
+		request_vertices(&id, 1);
+	}
+
+	void run(vertex_program &prog, const page_vertex &vertex);
+
+	void run_on_message(vertex_program &prog, const vertex_message &msg) {
+	}
+};
+
+/*
+ * Each vertex program collects the merged adjacency lists of the vertices
+ * processed by its thread.
+ */
+class compact_vertex_program: public vertex_program_impl<compact_vertex>
+{
+	graph_type type;
+	in_mem_subgraph::ptr subg;
+public:
+	typedef std::shared_ptr<compact_vertex_program> ptr;
+
+	static ptr cast2(vertex_program::ptr prog) {
+		return std::static_pointer_cast<compact_vertex_program,
+			   vertex_program>(prog);
+	}
+
+	compact_vertex_program(graph_type type) {
+		this->type = type;
+		subg = in_mem_subgraph::create(type, false);
+	}
+
+	void add_vertex(const page_vertex &vertex);
+
+	void merge2(in_mem_subgraph::ptr &g) const {
+		g->merge(subg);
+	}
+};
+
+class compact_vertex_program_creater: public vertex_program_creater
+{
+	graph_type type;
+public:
+	compact_vertex_program_creater(graph_type type) {
+		this->type = type;
+	}
+
+	vertex_program::ptr create() const {
+		return vertex_program::ptr(new compact_vertex_program(type));
+	}
+};
+
+void compact_vertex::run(vertex_program &prog, const page_vertex &vertex)
+{
+	((compact_vertex_program &) prog).add_vertex(vertex);
+}
+
+void compact_vertex_program::add_vertex(const page_vertex &vertex)
+{
+	if (type == UNDIRECTED) {
+		in_mem_undirected_vertex<> in_v(vertex.get_id(), false);
+		page_byte_array::seq_const_iterator<vertex_id_t> it
+			= vertex.get_neigh_seq_it(edge_type::BOTH_EDGES);
+		while (it.has_next())
+			in_v.add_edge(edge<empty_data>(vertex.get_id(), it.next()));
+		subg->add_vertex(in_v);
+	}
+	else if (type == DIRECTED) {
+		in_mem_directed_vertex<> in_v(vertex.get_id(), false);
+		page_byte_array::seq_const_iterator<vertex_id_t> it
+			= vertex.get_neigh_seq_it(edge_type::OUT_EDGE);
+		while (it.has_next())
+			in_v.add_out_edge(edge<empty_data>(vertex.get_id(), it.next()));
+		it = vertex.get_neigh_seq_it(edge_type::IN_EDGE);
+		while (it.has_next())
+			in_v.add_in_edge(edge<empty_data>(it.next(), vertex.get_id()));
+		subg->add_vertex(in_v);
+	}
+	else
+		ABORT_MSG("compact a vertex on a wrong type");
+}
+
+/*
+ * Read the merged adjacency lists of the vertices with the graph engine.
+ */
+in_mem_subgraph::ptr read_merged(graph_engine::ptr graph,
+		const std::vector<vertex_id_t> &ids)
+{
+	graph_type type = graph->get_graph_header().get_graph_type();
+	graph->start(ids.data(), ids.size(), vertex_initializer::ptr(),
+			vertex_program_creater::ptr(new compact_vertex_program_creater(type)));
+	graph->wait4complete();
+
+	in_mem_subgraph::ptr subg = in_mem_subgraph::create(type, false);
+	std::vector<vertex_program::ptr> vprogs;
+	graph->get_vertex_programs(vprogs);
+	BOOST_FOREACH(vertex_program::ptr vprog, vprogs)
+		compact_vertex_program::cast2(vprog)->merge2(subg);
+	return subg;
+}
+
+/*
+ * This writes data to a SAFS file sequentially from an offset. The data
+ * is buffered and written in pages. When the writer doesn't start at
+ * a page boundary, its first page is shared with the data before it.
+ * The writer keeps the page in `head', and the writer of the data before
+ * it writes the page when it's closed.
+ */
+class safs_seq_writer
+{
+	static const size_t BUF_SIZE = 16 * 1024 * 1024;
+
+	file_io_factory::shared_ptr factory;
+	io_interface::ptr io;
+	char *buf;
+	// The location of the buffer in the file. It's aligned to pages.
+	off_t buf_off;
+	// The number of bytes in the buffer, including the bytes before
+	// the start of the writer in the first page.
+	size_t buf_bytes;
+	char *head;
+	// The location of the shared first page. It's -1 if the writer
+	// starts at a page boundary.
+	off_t head_off;
+	std::vector<char> vbuf;
+
+	void write(char *data, off_t off, size_t size);
+	void flush_pages();
+public:
+	safs_seq_writer(file_io_factory::shared_ptr factory, off_t start);
+
+	~safs_seq_writer() {
+		free(buf);
+		free(head);
+	}
+
+	off_t get_offset() const {
+		return buf_off + buf_bytes;
+	}
+
+	void append(const char *data, size_t size);
+	void append_vertex(const in_mem_vertex &v, edge_type type);
+	/*
+	 * Write the remaining data. If the last page is shared with the writer
+	 * after it, the rest of the page comes from that writer, so that
+	 * writer has to be closed first.
+	 */
+	void close(const safs_seq_writer *next = NULL);
+};
+
+safs_seq_writer::safs_seq_writer(file_io_factory::shared_ptr factory,
+		off_t start)
+{
+	this->factory = factory;
+	io = create_io(factory, thread::get_curr_thread());
+	buf = NULL;
+	head = NULL;
+	if (posix_memalign((void **) &buf, PAGE_SIZE, BUF_SIZE) != 0
+			|| posix_memalign((void **) &head, PAGE_SIZE, PAGE_SIZE) != 0) {
+		free(buf);
+		free(head);
+		throw oom_exception("can't allocate memory for writing a graph");
+	}
+	memset(head, 0, PAGE_SIZE);
+	buf_off = ROUND(start, PAGE_SIZE);
+	buf_bytes = start - buf_off;
+	memset(buf, 0, buf_bytes);
+	head_off = buf_bytes > 0 ? buf_off : -1;
+}
+
+void safs_seq_writer::write(char *data, off_t off, size_t size)
+{
+	data_loc_t loc(factory->get_file_id(), off);
+	io_request req(data, loc, size, WRITE);
+	io->access(&req, 1);
+	io->wait4complete(1);
+}
+
+void safs_seq_writer::flush_pages()
+{
+	size_t size = ROUND(buf_bytes, PAGE_SIZE);
+	if (size == 0)
+		return;
+	char *data = buf;
+	off_t off = buf_off;
+	if (off == head_off) {
+		memcpy(head, buf, PAGE_SIZE);
+		data += PAGE_SIZE;
+		off += PAGE_SIZE;
+	}
+	if (off < buf_off + (off_t) size)
+		write(data, off, buf_off + size - off);
+	memmove(buf, buf + size, buf_bytes - size);
+	buf_off += size;
+	buf_bytes -= size;
+}
+
+void safs_seq_writer::append(const char *data, size_t size)
+{
+	while (size > 0) {
+		size_t num = std::min(size, BUF_SIZE - buf_bytes);
+		memcpy(buf + buf_bytes, data, num);
+		buf_bytes += num;
+		data += num;
+		size -= num;
+		if (buf_bytes == BUF_SIZE)
+			flush_pages();
+	}
+}
+
+void safs_seq_writer::append_vertex(const in_mem_vertex &v, edge_type type)
+{
+	size_t size = v.get_serialize_size(type);
+	vbuf.resize(size);
+	ext_mem_undirected_vertex::serialize(v, vbuf.data(), size, type);
+	append(vbuf.data(), size);
+}
+
+void safs_seq_writer::close(const safs_seq_writer *next)
+{
+	flush_pages();
+	if (buf_bytes == 0)
+		return;
+	if (next && next->head_off == buf_off)
+		memcpy(buf + buf_bytes, next->head + buf_bytes,
+				PAGE_SIZE - buf_bytes);
+	else
+		memset(buf + buf_bytes, 0, PAGE_SIZE - buf_bytes);
+	// The writer before this one writes the shared page.
+	if (buf_off == head_off)
+		memcpy(head, buf, PAGE_SIZE);
+	else
+		write(buf, buf_off, PAGE_SIZE);
+	buf_off += PAGE_SIZE;
+	buf_bytes = 0;
+}
+
+}
+
+void compact_graph(FG_graph::ptr base, graph_delta_store::ptr store,
+		const std::string &adj_file, const std::string &index_file,
+		size_t range_num_edges)
+{
+	const size_t MAX_RANGE_NUM_VERTICES = 1024 * 1024;
+	FG_graph::ptr fg = base->attach_delta(store);
+	graph_index::ptr index = NUMA_graph_index<compact_vertex>::create(
+			fg->get_graph_header());
+	graph_engine::ptr graph = fg->create_engine(index);
+	graph_type type = graph->get_graph_header().get_graph_type();
+	bool directed = graph->get_graph_header().is_directed_graph();
+	size_t num_vertices = graph->get_num_vertices();
+
+	struct timeval start, end;
+	gettimeofday(&start, NULL);
+	/*
+	 * The in-edge lists of all vertices are stored before the out-edge
+	 * lists, so we need the number of edges of every vertex before we can
+	 * write anything. Only the vertices with updates have to be read
+	 * for this. The other vertices get their number of edges from the index.
+	 * The deltas of an undirected graph only have in-edges.
+	 */
+	std::vector<vertex_id_t> ids;
+	store->get_vertices(IN_EDGE, ids);
+	if (directed) {
+		store->get_vertices(OUT_EDGE, ids);
+		std::sort(ids.begin(), ids.end());
+		ids.resize(std::unique(ids.begin(), ids.end()) - ids.begin());
+	}
+	std::unordered_map<vertex_id_t, std::pair<vsize_t, vsize_t> > delta_degs;
+	for (size_t i = 0; i < ids.size(); i += MAX_RANGE_NUM_VERTICES) {
+		std::vector<vertex_id_t> range(ids.begin() + i, ids.begin()
+				+ std::min(ids.size(), i + MAX_RANGE_NUM_VERTICES));
+		in_mem_subgraph::ptr subg = read_merged(graph, range);
+		BOOST_FOREACH(vertex_id_t id, range) {
+			const in_mem_vertex &v = subg->get_vertex(id);
+			delta_degs[id] = std::pair<vsize_t, vsize_t>(
+					v.get_num_edges(IN_EDGE), v.get_num_edges(OUT_EDGE));
+		}
+	}
+	ids.clear();
+	size_t in_size = graph_header::get_header_size();
+	size_t out_size = 0;
+	size_t num_edges = 0;
+	for (vertex_id_t id = 0; id < num_vertices; id++) {
+		vsize_t num_in, num_out;
+		auto it = delta_degs.find(id);
+		if (it != delta_degs.end()) {
+			num_in = it->second.first;
+			num_out = it->second.second;
+		}
+		else {
+			num_in = graph->get_num_edges(id, IN_EDGE);
+			num_out = graph->get_num_edges(id, OUT_EDGE);
+		}
+		in_size += ext_mem_undirected_vertex::num_edges2vsize(num_in, 0);
+		if (directed)
+			out_size += ext_mem_undirected_vertex::num_edges2vsize(num_out, 0);
+		num_edges += num_in;
+	}
+	// An undirected edge is in the edge lists of both of its vertices.
+	if (!directed)
+		num_edges /= 2;
+	delta_degs.clear();
+
+	safs_file f(get_sys_RAID_conf(), adj_file);
+	if (!f.create_file(ROUNDUP(in_size + out_size, PAGE_SIZE)))
+		throw io_exception(std::string("can't create ") + adj_file);
+	file_io_factory::shared_ptr factory = create_io_factory(adj_file,
+			REMOTE_ACCESS);
+	graph_header header(type, num_vertices, num_edges, 0);
+	safs_seq_writer in_writer(factory, 0);
+	in_writer.append((const char *) &header, graph_header::get_header_size());
+	std::unique_ptr<safs_seq_writer> out_writer;
+	if (directed)
+		out_writer = std::unique_ptr<safs_seq_writer>(
+				new safs_seq_writer(factory, in_size));
+
+	/*
+	 * We read the merged edge lists of a range of vertices at a time and
+	 * write them in the order of vertex ID. A range has about
+	 * `range_num_edges' edges in the base graph, so only the index of
+	 * the new graph is kept in memory.
+	 */
+	vertex_index_construct::ptr index_cons
+		= vertex_index_construct::create_compressed(directed, 0);
+	for (vertex_id_t id = 0; id < num_vertices; ) {
+		std::vector<vertex_id_t> range;
+		size_t num_range_edges = 0;
+		for (; id < num_vertices && num_range_edges < range_num_edges
+				&& range.size() < MAX_RANGE_NUM_VERTICES; id++) {
+			range.push_back(id);
+			num_range_edges += graph->get_num_edges(id);
+		}
+		in_mem_subgraph::ptr subg = read_merged(graph, range);
+		BOOST_FOREACH(vertex_id_t vid, range) {
+			const in_mem_vertex &v = subg->get_vertex(vid);
+			index_cons->add_vertex(v);
+			in_writer.append_vertex(v, IN_EDGE);
+			if (directed)
+				out_writer->append_vertex(v, OUT_EDGE);
+		}
+	}
+	assert((size_t) in_writer.get_offset() == in_size);
+	if (out_writer) {
+		assert((size_t) out_writer->get_offset() == in_size + out_size);
+		out_writer->close();
+	}
+	in_writer.close(out_writer.get());
+	graph.reset();
+
+	index_cons->dump(header, true)->safs_dump(index_file);
+	gettimeofday(&end, NULL);
+	BOOST_LOG_TRIVIAL(info) << boost::format(
+			"compacting %1% updates to %2% takes %3% seconds")
+		% store->get_num_updates() % adj_file % time_diff(start, end);
+}
+
+/************************ Implementation of dynamic graph *********************/
+
+namespace {
+
+void delete_safs_file(const std::string &name)
+{
+	safs_file f(get_sys_RAID_conf(), name);
+	if (f.exist())
+		f.delete_file();
+}
+
+/*
+ * Parse the generation in a file name of the form <prefix><gen><suffix>.
+ */
+bool parse_gen(const std::string &str, const std::string &prefix,
+		const std::string &suffix, size_t &gen)
+{
+	if (str.size() <= prefix.size() + suffix.size()
+			|| str.compare(0, prefix.size(), prefix) != 0
+			|| str.compare(str.size() - suffix.size(), suffix.size(),
+				suffix) != 0)
+		return false;
+	std::string num = str.substr(prefix.size(),
+			str.size() - prefix.size() - suffix.size());
+	for (size_t i = 0; i < num.size(); i++)
+		if (!isdigit(num[i]))
+			return false;
+	gen = atol(num.c_str());
+	return true;
+}
+
+std::atomic<size_t> num_tmp_graphs(0);
+
+}
+
+/*
+ * The files of a compacted graph in SAFS. A snapshot keeps the files of its
+ * base graph, so the files of a retired base graph are deleted when
+ * the last snapshot on it is destroyed.
+ */
+class dynamic_graph::graph_files
+{
+	std::string name;
+	std::atomic<bool> retired;
+public:
+	typedef std::shared_ptr<graph_files> ptr;
+
+	graph_files(const std::string &name): retired(false) {
+		this->name = name;
+	}
+
+	~graph_files() {
+		// The index is deleted first, so the graph isn't recovered
+		// if the adjacency lists are partially deleted.
+		if (retired) {
+			delete_safs_file(name + ".index");
+			delete_safs_file(name + ".adj");
+		}
+	}
+
+	void retire() {
+		retired = true;
+	}
+};
+
+class dynamic_graph::compact_task: public thread_task
+{
+	dynamic_graph &graph;
+	FG_graph::ptr base;
+	std::vector<graph_delta::ptr> deltas;
+public:
+	compact_task(dynamic_graph &_graph, FG_graph::ptr base,
+			const std::vector<graph_delta::ptr> &deltas): graph(_graph) {
+		this->base = base;
+		this->deltas = deltas;
+	}
+
+	void run() {
+		try {
+			graph.compact_frozen(base, deltas);
+		} catch (std::exception &e) {
+			graph.fail_compaction(e.what());
+		}
+	}
+};
+
+dynamic_graph::dynamic_graph(FG_graph::ptr base, const std::string &log_prefix,
+		size_t log_capacity, size_t compact_threshold)
+{
+	this->base = base;
+	this->log_prefix = log_prefix;
+	this->log_capacity = log_capacity;
+	this->compact_threshold = compact_threshold;
+	// Without logs, the compacted graphs only live as long as
+	// the dynamic graph.
+	if (log_prefix.empty())
+		base_prefix = boost::str(boost::format("dynamic-graph-%1%-%2%")
+				% getpid() % num_tmp_graphs++);
+	else
+		base_prefix = log_prefix;
+	num_generations = 0;
+	base_gen = 0;
+	compacting = false;
+	num_compactions = 0;
+	pthread_mutex_init(&lock, NULL);
+	pthread_cond_init(&cond, NULL);
+	if (!log_prefix.empty())
+		recover();
+	active = new_delta();
+	compact_thread = std::unique_ptr<task_thread>(new task_thread(
+				"delta-compact", 0));
+	compact_thread->start();
+	// Compact the recovered deltas in the background.
+	pthread_mutex_lock(&lock);
+	freeze_active();
+	pthread_mutex_unlock(&lock);
+}
+
+dynamic_graph::~dynamic_graph()
+{
+	compact_thread->wait4complete();
+	compact_thread.reset();
+	if (log_prefix.empty() && base_files)
+		base_files->retire();
+	pthread_mutex_destroy(&lock);
+	pthread_cond_destroy(&cond);
+}
+
+std::string dynamic_graph::get_log_name(size_t gen) const
+{
+	return log_prefix + "-" + itoa(gen);
+}
+
+std::string dynamic_graph::get_base_name(size_t gen) const
+{
+	return base_prefix + "-base" + itoa(gen);
+}
+
+void dynamic_graph::recover()
+{
+	std::set<std::string> files;
+	get_all_safs_files(files);
+	std::string prefix = log_prefix + "-";
+	std::vector<size_t> log_gens;
+	BOOST_FOREACH(const std::string &file, files) {
+		size_t gen;
+		if (parse_gen(file, prefix, "", gen))
+			log_gens.push_back(gen);
+		else if (parse_gen(file, prefix + "base", ".index", gen))
+			base_gen = std::max(base_gen, gen);
+	}
+
+	// Only keep the latest compacted graph.
+	std::string base_name;
+	if (base_gen > 0) {
+		base_name = get_base_name(base_gen);
+		base = FG_graph::create(base_name + ".adj", base_name + ".index",
+				base->get_configs());
+		base_files = graph_files::ptr(new graph_files(base_name));
+	}
+	BOOST_FOREACH(const std::string &file, files) {
+		size_t gen;
+		if ((parse_gen(file, prefix + "base", ".adj", gen)
+					|| parse_gen(file, prefix + "base", ".index", gen)
+					|| parse_gen(file, prefix + "base", ".index.tmp", gen))
+				&& (gen != base_gen || file == base_name + ".index.tmp"))
+			delete_safs_file(file);
+	}
+
+	// The deltas before `base_gen' are in the compacted graph, but their
+	// logs may not be deleted before the last run ended.
+	std::sort(log_gens.begin(), log_gens.end());
+	num_generations = base_gen;
+	BOOST_FOREACH(size_t gen, log_gens) {
+		if (gen < base_gen) {
+			delete_safs_file(get_log_name(gen));
+			continue;
+		}
+		if (gen != num_generations)
+			throw io_exception(boost::str(boost::format(
+							"the delta log %1% is missing")
+						% get_log_name(num_generations)));
+		frozen.push_back(graph_delta::load(base->get_graph_header(),
+					get_log_name(gen)));
+		num_generations++;
+	}
+	BOOST_LOG_TRIVIAL(info) << boost::format(
+			"recover the dynamic graph %1% with %2% deltas after generation %3%")
+		% log_prefix % frozen.size() % base_gen;
+}
+
+graph_delta::ptr dynamic_graph::new_delta()
+{
+	std::string log_file;
+	if (!log_prefix.empty())
+		log_file = get_log_name(num_generations);
+	num_generations++;
+	return graph_delta::create(base->get_graph_header(), log_file,
+			log_capacity);
+}
+
+void dynamic_graph::freeze_active()
+{
+	if (active->get_num_updates() > 0) {
+		frozen.push_back(active);
+		active = new_delta();
+	}
+	if (!compacting && !frozen.empty()) {
+		compacting = true;
+		compact_thread->add_task(new compact_task(*this, base, frozen));
+	}
+}
+
+void dynamic_graph::compact_frozen(FG_graph::ptr base,
+		const std::vector<graph_delta::ptr> &deltas)
+{
+	// Only one compaction runs at a time, so no one else changes the base.
+	size_t new_gen = base_gen + deltas.size();
+	std::string name = get_base_name(new_gen);
+	std::string adj_file = name + ".adj";
+	std::string index_file = name + ".index";
+	std::string tmp_file = index_file + ".tmp";
+	// Remove the files left by a compaction that didn't complete.
+	delete_safs_file(adj_file);
+	delete_safs_file(tmp_file);
+	FG_graph::ptr new_base;
+	try {
+		// The index is written to a temporary file and renamed at the end,
+		// so a graph in SAFS is complete if its index exists.
+		compact_graph(base, graph_delta_store::create(deltas), adj_file,
+				tmp_file);
+		safs_file f(get_sys_RAID_conf(), tmp_file);
+		if (!f.rename(index_file))
+			throw io_exception(std::string("can't rename ") + tmp_file);
+		new_base = FG_graph::create(adj_file, index_file, base->get_configs());
+	} catch (std::exception &e) {
+		delete_safs_file(adj_file);
+		delete_safs_file(tmp_file);
+		delete_safs_file(index_file);
+		throw;
+	}
+	graph_files::ptr new_files(new graph_files(name));
+	// The compacted graph is in SAFS, so we don't need the logs.
+	BOOST_FOREACH(graph_delta::ptr delta, deltas)
+		delta->delete_log();
+
+	pthread_mutex_lock(&lock);
+	// The deltas compacted in this run are the oldest frozen deltas.
+	assert(frozen.size() >= deltas.size());
+	for (size_t i = 0; i < deltas.size(); i++)
+		assert(frozen[i] == deltas[i]);
+	frozen.erase(frozen.begin(), frozen.begin() + deltas.size());
+	this->base = new_base;
+	base_gen = new_gen;
+	graph_files::ptr old_files = base_files;
+	base_files = new_files;
+	compacting = false;
+	num_compactions++;
+	// More deltas may be frozen while we were compacting.
+	if (!frozen.empty()) {
+		compacting = true;
+		compact_thread->add_task(new compact_task(*this, this->base, frozen));
+	}
+	pthread_cond_broadcast(&cond);
+	pthread_mutex_unlock(&lock);
+
+	// The old base graph is deleted from SAFS after the snapshots
+	// on it are destroyed.
+	if (old_files)
+		old_files->retire();
+}
+
+void dynamic_graph::fail_compaction(const std::string &err)
+{
+	BOOST_LOG_TRIVIAL(error) << "can't compact the dynamic graph: " << err;
+	pthread_mutex_lock(&lock);
+	compacting = false;
+	compact_error = err;
+	pthread_cond_broadcast(&cond);
+	pthread_mutex_unlock(&lock);
+}
+
+void dynamic_graph::apply_updates(const edge_update updates[], size_t num)
+{
+	pthread_mutex_lock(&lock);
+	try {
+		if (!active->apply(updates, num)) {
+			// The log of the active delta is full.
+			freeze_active();
+			if (!active->apply(updates, num))
+				throw invalid_arg_exception(boost::str(boost::format(
+								"%1% updates can't fit in a delta log") % num));
+		}
+	} catch (std::exception &e) {
+		pthread_mutex_unlock(&lock);
+		throw;
+	}
+	if (compact_threshold > 0 && count_updates() >= compact_threshold
+			&& !compacting)
+		freeze_active();
+	pthread_mutex_unlock(&lock);
+}
+
+void dynamic_graph::add_edges(
+		const std::vector<std::pair<vertex_id_t, vertex_id_t> > &edges)
+{
+	std::vector<edge_update> updates(edges.size());
+	for (size_t i = 0; i < edges.size(); i++)
+		updates[i] = edge_update(edges[i].first, edges[i].second, EDGE_INSERT);
+	apply_updates(updates.data(), updates.size());
+}
+
+void dynamic_graph::delete_edges(
+		const std::vector<std::pair<vertex_id_t, vertex_id_t> > &edges)
+{
+	std::vector<edge_update> updates(edges.size());
+	for (size_t i = 0; i < edges.size(); i++)
+		updates[i] = edge_update(edges[i].first, edges[i].second, EDGE_DELETE);
+	apply_updates(updates.data(), updates.size());
+}
+
+FG_graph::ptr dynamic_graph::get_graph()
+{
+	pthread_mutex_lock(&lock);
+	std::vector<graph_delta::ptr> deltas = frozen;
+	deltas.push_back(active);
+	FG_graph::ptr fg = base->attach_delta(graph_delta_store::create(deltas));
+	graph_files::ptr files = base_files;
+	pthread_mutex_unlock(&lock);
+	if (files == NULL)
+		return fg;
+	// The snapshot keeps the files of its base graph in SAFS.
+	return FG_graph::ptr(fg.get(), [fg, files](FG_graph *) {});
+}
+
+void dynamic_graph::compact(bool wait)
+{
+	pthread_mutex_lock(&lock);
+	// The deltas left by a failed compaction are compacted again.
+	compact_error.clear();
+	freeze_active();
+	while (wait && compact_error.empty() && (compacting || !frozen.empty()))
+		pthread_cond_wait(&cond, &lock);
+	std::string err = compact_error;
+	pthread_mutex_unlock(&lock);
+	if (wait && !err.empty())
+		throw io_exception(err);
+}
+
+size_t dynamic_graph::count_updates() const
+{
+	size_t num = active->get_num_updates();
+	for (size_t i = 0; i < frozen.size(); i++)
+		num += frozen[i]->get_num_updates();
+	return num;
+}
+
+size_t dynamic_graph::get_num_updates()
+{
+	pthread_mutex_lock(&lock);
+	size_t num = count_updates();
+	pthread_mutex_unlock(&lock);
+	return num;
+}
+
+size_t dynamic_graph::get_num_compactions()
+{
+	pthread_mutex_lock(&lock);
+	size_t num = num_compactions;
+	pthread_mutex_unlock(&lock);
+	return num;
+}
+
+}
@@ -0,0 +1,175 @@
+#ifndef __DYNAMIC_GRAPH_H__
+#define __DYNAMIC_GRAPH_H__
+
+/*
+ * Copyright 2014 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of FlashGraph.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "thread.h"
+
+#include "FGlib.h"
+#include "graph_delta.h"
+
+namespace fg
+{
+
+/*
+ * The number of edges in the base graph read by one pass of the graph
+ * engine when the graph is compacted.
+ */
+const size_t COMPACT_RANGE_NUM_EDGES = 16 * 1024 * 1024;
+
+/*
+ * Merge all updates in the delta store into the base graph and write
+ * the new graph to SAFS. The new graph has the same vertices as the base
+ * graph. The adjacency lists are read and written in ranges of vertices
+ * with `range_num_edges' edges in the base graph, so the new graph
+ * doesn't have to fit in memory.
+ */
+void compact_graph(FG_graph::ptr base, graph_delta_store::ptr store,
+		const std::string &adj_file, const std::string &index_file,
+		size_t range_num_edges = COMPACT_RANGE_NUM_EDGES);
+
+/*
+ * This is a graph that accepts edge insertions and deletions while it's
+ * being computed on. The updates are kept in deltas on top of a base graph.
+ * The latest delta accepts new updates and the older deltas are frozen.
+ * When the number of updates in the deltas reaches a threshold or the log
+ * of the latest delta is full, the latest delta is frozen and all frozen
+ * deltas are compacted into the base graph in a background thread.
+ *
+ * `get_graph' returns a snapshot of the graph. A snapshot isn't affected
+ * by the updates applied after it's taken, except the updates in the latest
+ * delta, which is shared by the snapshot and the dynamic graph.
+ *
+ * The deltas are compacted into a new graph in SAFS. If the deltas have
+ * logs, the logs of the compacted deltas are deleted after the new graph
+ * is written, so the graph can be recovered from SAFS when a dynamic graph
+ * is created with the same log prefix. Otherwise, the compacted graphs
+ * are deleted when the dynamic graph and its snapshots are destroyed.
+ */
+class dynamic_graph
+{
+	class compact_task;
+	class graph_files;
+
+	FG_graph::ptr base;
+	std::string log_prefix;
+	size_t log_capacity;
+	size_t compact_threshold;
+	// The number of deltas that have been created.
+	size_t num_generations;
+	// The deltas created before it have been compacted into the base graph.
+	size_t base_gen;
+	// The prefix of the names of the compacted graphs in SAFS.
+	std::string base_prefix;
+	// The files of the base graph in SAFS. It's NULL if the base graph
+	// isn't created by the dynamic graph.
+	std::shared_ptr<graph_files> base_files;
+
+	// The lock protects the base graph and the deltas.
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	std::vector<graph_delta::ptr> frozen;
+	graph_delta::ptr active;
+	bool compacting;
+	size_t num_compactions;
+	// The error of the last compaction if it failed.
+	std::string compact_error;
+
+	std::unique_ptr<task_thread> compact_thread;
+
+	dynamic_graph(FG_graph::ptr base, const std::string &log_prefix,
+			size_t log_capacity, size_t compact_threshold);
+
+	std::string get_log_name(size_t gen) const;
+	std::string get_base_name(size_t gen) const;
+	/*
+	 * Load the latest compacted graph and replay the logs of the deltas
+	 * that haven't been compacted.
+	 */
+	void recover();
+	graph_delta::ptr new_delta();
+	/*
+	 * Freeze the active delta and start compacting the frozen deltas
+	 * if there isn't a compaction running.
+	 * The caller needs to hold the lock.
+	 */
+	void freeze_active();
+	void compact_frozen(FG_graph::ptr base,
+			const std::vector<graph_delta::ptr> &deltas);
+	/*
+	 * The compaction failed. The frozen deltas are kept, so they are
+	 * compacted again when the next delta is frozen.
+	 */
+	void fail_compaction(const std::string &err);
+	void apply_updates(const edge_update updates[], size_t num);
+	// The caller needs to hold the lock.
+	size_t count_updates() const;
+public:
+	typedef std::shared_ptr<dynamic_graph> ptr;
+
+	/*
+	 * If `log_prefix' isn't empty, each delta logs its updates to a SAFS
+	 * file named with the prefix, and each log can store `log_capacity'
+	 * updates. Deltas are compacted when they have `compact_threshold'
+	 * updates in total. If `compact_threshold' is 0, deltas are only
+	 * compacted when a log is full or `compact' is invoked.
+	 * If SAFS has the files of a dynamic graph with the same prefix,
+	 * the graph is recovered from them and the compacted graph in SAFS
+	 * replaces `base'.
+	 */
+	static ptr create(FG_graph::ptr base, const std::string &log_prefix = "",
+			size_t log_capacity = 0, size_t compact_threshold = 0) {
+		return ptr(new dynamic_graph(base, log_prefix, log_capacity,
+					compact_threshold));
+	}
+
+	~dynamic_graph();
+
+	void add_edges(const std::vector<std::pair<vertex_id_t, vertex_id_t> > &edges);
+	void delete_edges(const std::vector<std::pair<vertex_id_t, vertex_id_t> > &edges);
+	void apply(const std::vector<edge_update> &updates) {
+		apply_updates(updates.data(), updates.size());
+	}
+
+	/*
+	 * Get a snapshot of the graph with all updates applied.
+	 */
+	FG_graph::ptr get_graph();
+
+	/*
+	 * Compact all deltas into the base graph. If `wait' is true,
+	 * it waits until all deltas are compacted, and it throws
+	 * io_exception if a compaction fails.
+	 */
+	void compact(bool wait = true);
+
+	size_t get_num_updates();
+	size_t get_num_compactions();
+};
+
+}
+
+#endif
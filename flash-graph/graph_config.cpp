@@ -43,6 +43,7 @@ void graph_config::print_help()
 	printf("\tpreload: preload the graph data to the page cache\n");
 	printf("\tindex_file_weight: the weight for the graph index file\n");
 	printf("\tin_mem_graph: indicate whether to load the entire graph to memory in advance\n");
+	printf("\tin_mem_csr: access the in-mem graph directly without SAFS (ignored if num_vparts > 1)\n");
 	printf("\tnum_vparts: the number of vertical partitions\n");
 	printf("\tmin_vpart_degree: the min degree of a vertex to perform vertical partitioning\n");
 	printf("\tserial_run: run the user code on a vertex in serial\n");
@@ -61,6 +62,7 @@ void graph_config::print()
 	BOOST_LOG_TRIVIAL(info) << "\tpreload: " << _preload;
 	BOOST_LOG_TRIVIAL(info) << "\tindex_file_weight: " << index_file_weight;
 	BOOST_LOG_TRIVIAL(info) << "\tin_mem_graph: " << _in_mem_graph;
+	BOOST_LOG_TRIVIAL(info) << "\tin_mem_csr: " << _in_mem_csr;
 	BOOST_LOG_TRIVIAL(info) << "\tnum_vparts: " << num_vparts;
 	BOOST_LOG_TRIVIAL(info) << "\tmin_vpart_degree: " << min_vpart_degree;
 	BOOST_LOG_TRIVIAL(info) << "\tserial_run: " << serial_run;
@@ -71,12 +73,10 @@ void graph_config::init(config_map::ptr map)
 {
 	if (map->has_option("threads"))
 		map->read_option_int("threads", num_threads);
-#ifdef USE_HWLOC
 	else {
 		num_threads = cpus.get_num_cores();
 		num_threads = 1 << (int) ceil(log2(num_threads));
 	}
-#endif
 	BOOST_LOG_TRIVIAL(info) << boost::format(
 			"FlashGraph runs on %1% threads and %2% nodes")
 		% num_threads % safs::params.get_num_nodes();
@@ -90,6 +90,7 @@ void graph_config::init(config_map::ptr map)
 	map->read_option_bool("preload", _preload);
 	map->read_option_int("index_file_weight", index_file_weight);
 	map->read_option_bool("in_mem_graph", _in_mem_graph);
+	map->read_option_bool("in_mem_csr", _in_mem_csr);
 	map->read_option_int("num_vparts", num_vparts);
 	map->read_option_int("min_vpart_degree", min_vpart_degree);
 	map->read_option_bool("serial_run", serial_run);
@@ -43,6 +43,7 @@ class graph_config
 	bool _preload;
 	int index_file_weight;
 	bool _in_mem_graph;
+	bool _in_mem_csr;
 	int num_vparts;
 	int min_vpart_degree;
 	bool serial_run;
@@ -61,6 +62,7 @@ public:
 		_preload = false;
 		index_file_weight = 10;
 		_in_mem_graph = false;
+		_in_mem_csr = false;
 		num_vparts = 1;
 		min_vpart_degree = std::numeric_limits<int>::max();
 		serial_run = false;
@@ -162,6 +164,17 @@ public:
 		return _in_mem_graph;
 	}
 
+	/**
+	 * \brief Determine whether to access the in-mem graph data directly.
+	 * In this mode, the graph engine constructs the adjacency lists of
+	 * vertices from the in-mem graph data without going through SAFS.
+	 * It only takes effect when the graph data is loaded to memory.
+	 * \return true if the graph engine accesses the in-mem graph directly.
+	 */
+	bool use_in_mem_csr() const {
+		return _in_mem_csr;
+	}
+
 	/**
 	 * \brief Determine whether to run the user code on a vertex in serial.
 	 * \return true if the graph engine runs the user code on a vertex in serial.
@@ -0,0 +1,558 @@
+/*
+ * Copyright 2014 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of FlashGraph.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <malloc.h>
+
+#include <algorithm>
+
+#include <boost/format.hpp>
+
+#include "log.h"
+#include "io_interface.h"
+#include "safs_file.h"
+#include "comm_exception.h"
+#include "safs_exception.h"
+
+#include "graph_delta.h"
+
+using namespace safs;
+
+namespace fg
+{
+
+/*
+ * The format of an update in the delta log.
+ * A log entry with op == 0 marks the end of the log.
+ */
+struct delta_log_entry
+{
+	vertex_id_t from;
+	vertex_id_t to;
+	uint32_t op;
+	uint32_t reserved;
+};
+
+/*
+ * This appends updates to a preallocated file in SAFS.
+ * An append returns after its updates are written to SAFS. The updates
+ * are written in pages, so the last partial page is rewritten when
+ * more updates are appended.
+ */
+class delta_log
+{
+	static const size_t LOG_BUF_SIZE = 1024 * 1024;
+	static const size_t ENTRIES_PER_PAGE = PAGE_SIZE / sizeof(delta_log_entry);
+
+	std::string file_name;
+	file_io_factory::shared_ptr factory;
+	size_t capacity;
+	// The number of entries in the log.
+	size_t num_entries;
+	// The location in the file where the buffer starts. It's page aligned.
+	off_t buf_start;
+	delta_log_entry *buf;
+	size_t buf_cap;
+	pthread_mutex_t lock;
+
+	size_t get_num_buf_entries() const {
+		return num_entries - buf_start / sizeof(delta_log_entry);
+	}
+
+	void write_buf();
+
+	delta_log(const std::string &file_name, size_t capacity) {
+		this->file_name = file_name;
+		this->capacity = capacity;
+		num_entries = 0;
+		buf_start = 0;
+		buf_cap = LOG_BUF_SIZE / sizeof(delta_log_entry);
+		buf = (delta_log_entry *) valloc(LOG_BUF_SIZE);
+		memset(buf, 0, LOG_BUF_SIZE);
+		pthread_mutex_init(&lock, NULL);
+	}
+public:
+	typedef std::shared_ptr<delta_log> ptr;
+
+	static ptr create(const std::string &file_name, size_t capacity);
+	static ptr open(const std::string &file_name,
+			std::vector<edge_update> &updates);
+
+	~delta_log() {
+		free(buf);
+		pthread_mutex_destroy(&lock);
+	}
+
+	/*
+	 * It returns false if the log doesn't have enough space
+	 * for the updates.
+	 */
+	bool append(const edge_update updates[], size_t num);
+	void delete_file();
+};
+
+delta_log::ptr delta_log::create(const std::string &file_name,
+		size_t capacity)
+{
+	size_t file_size = ROUNDUP(capacity * sizeof(delta_log_entry), PAGE_SIZE);
+	safs_file f(get_sys_RAID_conf(), file_name);
+	if (f.exist())
+		throw io_exception(file_name + " already exists");
+	if (!f.create_file(file_size))
+		throw io_exception(std::string("can't create delta log ") + file_name);
+
+	delta_log::ptr log(new delta_log(file_name, file_size
+				/ sizeof(delta_log_entry)));
+	log->factory = create_io_factory(file_name, REMOTE_ACCESS);
+	if (log->factory == NULL)
+		throw io_exception(std::string("can't create io factory for ")
+				+ file_name);
+	// Clear the first page, so a crash before the first append
+	// leaves an empty log.
+	log->write_buf();
+	return log;
+}
+
+delta_log::ptr delta_log::open(const std::string &file_name,
+		std::vector<edge_update> &updates)
+{
+	file_io_factory::shared_ptr factory = create_io_factory(file_name,
+			REMOTE_ACCESS);
+	if (factory == NULL)
+		throw io_exception(std::string("can't create io factory for ")
+				+ file_name);
+	size_t file_size = factory->get_file_size();
+	delta_log::ptr log(new delta_log(file_name,
+				file_size / sizeof(delta_log_entry)));
+	log->factory = factory;
+
+	io_interface::ptr io = create_io(factory, thread::get_curr_thread());
+	bool end = false;
+	for (off_t off = 0; (size_t) off < file_size && !end;
+			off += LOG_BUF_SIZE) {
+		size_t size = std::min(LOG_BUF_SIZE, file_size - off);
+		data_loc_t loc(factory->get_file_id(), off);
+		io_request req((char *) log->buf, loc, size, READ);
+		io->access(&req, 1);
+		io->wait4complete(1);
+		size_t num = size / sizeof(delta_log_entry);
+		for (size_t i = 0; i < num; i++) {
+			if (log->buf[i].op == 0) {
+				end = true;
+				break;
+			}
+			updates.push_back(edge_update(log->buf[i].from, log->buf[i].to,
+						(delta_op_t) log->buf[i].op));
+		}
+	}
+	// Keep the last partial page in the buffer, so we can append updates
+	// to the log.
+	log->num_entries = updates.size();
+	log->buf_start = ROUND(updates.size(), ENTRIES_PER_PAGE)
+		* sizeof(delta_log_entry);
+	memset(log->buf, 0, LOG_BUF_SIZE);
+	for (size_t i = log->buf_start / sizeof(delta_log_entry);
+			i < updates.size(); i++) {
+		delta_log_entry &e = log->buf[i % ENTRIES_PER_PAGE];
+		e.from = updates[i].from;
+		e.to = updates[i].to;
+		e.op = updates[i].op;
+	}
+	return log;
+}
+
+void delta_log::write_buf()
+{
+	size_t num_buf_entries = get_num_buf_entries();
+	size_t size = ROUNDUP(std::max(num_buf_entries, 1UL)
+			* sizeof(delta_log_entry), PAGE_SIZE);
+	io_interface::ptr io = create_io(factory, thread::get_curr_thread());
+	data_loc_t loc(factory->get_file_id(), buf_start);
+	io_request req((char *) buf, loc, size, WRITE);
+	io->access(&req, 1);
+	io->wait4complete(1);
+
+	// Move the last partial page to the beginning of the buffer.
+	size_t num_full_pages = num_buf_entries / ENTRIES_PER_PAGE;
+	if (num_full_pages > 0) {
+		size_t num_remain = num_buf_entries % ENTRIES_PER_PAGE;
+		memmove(buf, buf + num_full_pages * ENTRIES_PER_PAGE,
+				num_remain * sizeof(delta_log_entry));
+		memset(buf + num_remain, 0,
+				(buf_cap - num_remain) * sizeof(delta_log_entry));
+		buf_start += num_full_pages * PAGE_SIZE;
+	}
+}
+
+bool delta_log::append(const edge_update updates[], size_t num)
+{
+	pthread_mutex_lock(&lock);
+	if (num_entries + num > capacity) {
+		pthread_mutex_unlock(&lock);
+		return false;
+	}
+	for (size_t i = 0; i < num; i++) {
+		if (get_num_buf_entries() == buf_cap)
+			write_buf();
+		delta_log_entry &e = buf[get_num_buf_entries()];
+		e.from = updates[i].from;
+		e.to = updates[i].to;
+		e.op = updates[i].op;
+		num_entries++;
+	}
+	// The updates have to be in SAFS before they're applied in memory.
+	write_buf();
+	pthread_mutex_unlock(&lock);
+	return true;
+}
+
+void delta_log::delete_file()
+{
+	factory = file_io_factory::shared_ptr();
+	safs_file f(get_sys_RAID_conf(), file_name);
+	if (f.exist())
+		f.delete_file();
+}
+
+graph_delta::graph_delta(const graph_header &header)
+{
+	if (header.has_edge_data())
+		throw unsupported_exception(
+				"graph delta doesn't support graphs with edge data");
+	directed = header.is_directed_graph();
+	num_vertices = header.get_num_vertices();
+	parts = std::unique_ptr<partition[]>(new partition[NUM_PARTS]);
+	num_updates = 0;
+	pthread_mutex_init(&apply_lock, NULL);
+}
+
+graph_delta::~graph_delta()
+{
+	pthread_mutex_destroy(&apply_lock);
+}
+
+graph_delta::ptr graph_delta::create(const graph_header &header,
+		const std::string &log_file, size_t log_capacity)
+{
+	graph_delta::ptr delta(new graph_delta(header));
+	if (!log_file.empty())
+		delta->log = delta_log::create(log_file, log_capacity);
+	return delta;
+}
+
+graph_delta::ptr graph_delta::load(const graph_header &header,
+		const std::string &log_file)
+{
+	graph_delta::ptr delta(new graph_delta(header));
+	std::vector<edge_update> updates;
+	delta->log = delta_log::open(log_file, updates);
+	for (size_t i = 0; i < updates.size(); i++)
+		delta->apply_in_mem(updates[i]);
+	delta->num_updates = updates.size();
+	BOOST_LOG_TRIVIAL(info) << boost::format(
+			"recover %1% updates from delta log %2%")
+		% updates.size() % log_file;
+	return delta;
+}
+
+static inline bool remove_sorted(std::vector<vertex_id_t> &vec, vertex_id_t id)
+{
+	auto it = std::lower_bound(vec.begin(), vec.end(), id);
+	if (it != vec.end() && *it == id) {
+		vec.erase(it);
+		return true;
+	}
+	return false;
+}
+
+static inline void insert_sorted(std::vector<vertex_id_t> &vec, vertex_id_t id)
+{
+	auto it = std::lower_bound(vec.begin(), vec.end(), id);
+	if (it == vec.end() || *it != id)
+		vec.insert(it, id);
+}
+
+void graph_delta::add_neighbor(vertex_id_t id, edge_type type,
+		vertex_id_t neigh, delta_op_t op)
+{
+	int slot = get_slot(type);
+	partition &part = get_part(id);
+	pthread_spin_lock(&part.lock);
+	vertex_delta &d = part.vertices[id];
+	if (op == EDGE_INSERT) {
+		remove_sorted(d.removed[slot], neigh);
+		insert_sorted(d.added[slot], neigh);
+	}
+	else {
+		remove_sorted(d.added[slot], neigh);
+		insert_sorted(d.removed[slot], neigh);
+	}
+	pthread_spin_unlock(&part.lock);
+}
+
+void graph_delta::apply_in_mem(const edge_update &update)
+{
+	if (directed) {
+		add_neighbor(update.from, OUT_EDGE, update.to, update.op);
+		add_neighbor(update.to, IN_EDGE, update.from, update.op);
+	}
+	else {
+		add_neighbor(update.from, IN_EDGE, update.to, update.op);
+		if (update.from != update.to)
+			add_neighbor(update.to, IN_EDGE, update.from, update.op);
+	}
+}
+
+bool graph_delta::apply(const edge_update updates[], size_t num)
+{
+	for (size_t i = 0; i < num; i++) {
+		if (updates[i].from >= num_vertices || updates[i].to >= num_vertices)
+			throw invalid_arg_exception(boost::str(boost::format(
+							"edge (%1%, %2%) is out of the graph")
+						% updates[i].from % updates[i].to));
+		if (updates[i].op != EDGE_INSERT && updates[i].op != EDGE_DELETE)
+			throw invalid_arg_exception("unknown edge update");
+	}
+
+	// The log and the in-memory delta have to see the updates
+	// in the same order, so a batch is logged and applied in memory
+	// before another batch can be logged.
+	pthread_mutex_lock(&apply_lock);
+	if (log && !log->append(updates, num)) {
+		pthread_mutex_unlock(&apply_lock);
+		return false;
+	}
+	for (size_t i = 0; i < num; i++)
+		apply_in_mem(updates[i]);
+	num_updates += num;
+	pthread_mutex_unlock(&apply_lock);
+	return true;
+}
+
+void graph_delta::delete_log()
+{
+	if (log) {
+		log->delete_file();
+		log = delta_log::ptr();
+	}
+}
+
+size_t graph_delta::get_num_vertices() const
+{
+	size_t ret = 0;
+	for (int i = 0; i < NUM_PARTS; i++) {
+		pthread_spin_lock(&parts[i].lock);
+		ret += parts[i].vertices.size();
+		pthread_spin_unlock(&parts[i].lock);
+	}
+	return ret;
+}
+
+bool graph_delta::has_delta(vertex_id_t id) const
+{
+	partition &part = get_part(id);
+	pthread_spin_lock(&part.lock);
+	bool ret = part.vertices.find(id) != part.vertices.end();
+	pthread_spin_unlock(&part.lock);
+	return ret;
+}
+
+bool graph_delta::get_delta(vertex_id_t id, edge_type type,
+		std::vector<vertex_id_t> &added,
+		std::vector<vertex_id_t> &removed) const
+{
+	int slot = get_slot(type);
+	partition &part = get_part(id);
+	pthread_spin_lock(&part.lock);
+	vdelta_map_t::const_iterator it = part.vertices.find(id);
+	if (it == part.vertices.end()) {
+		pthread_spin_unlock(&part.lock);
+		return false;
+	}
+	added = it->second.added[slot];
+	removed = it->second.removed[slot];
+	pthread_spin_unlock(&part.lock);
+	return !added.empty() || !removed.empty();
+}
+
+void graph_delta::get_vertices(std::vector<vertex_id_t> &ids) const
+{
+	for (int i = 0; i < NUM_PARTS; i++) {
+		pthread_spin_lock(&parts[i].lock);
+		for (vdelta_map_t::const_iterator it = parts[i].vertices.begin();
+				it != parts[i].vertices.end(); it++)
+			ids.push_back(it->first);
+		pthread_spin_unlock(&parts[i].lock);
+	}
+	std::sort(ids.begin(), ids.end());
+}
+
+void graph_delta::get_vertices(edge_type type,
+		std::vector<vertex_id_t> &ids) const
+{
+	int slot = get_slot(type);
+	for (int i = 0; i < NUM_PARTS; i++) {
+		pthread_spin_lock(&parts[i].lock);
+		for (vdelta_map_t::const_iterator it = parts[i].vertices.begin();
+				it != parts[i].vertices.end(); it++)
+			if (!it->second.added[slot].empty()
+					|| !it->second.removed[slot].empty())
+				ids.push_back(it->first);
+		pthread_spin_unlock(&parts[i].lock);
+	}
+	std::sort(ids.begin(), ids.end());
+}
+
+size_t graph_delta_store::get_num_updates() const
+{
+	size_t ret = 0;
+	for (size_t i = 0; i < deltas.size(); i++)
+		ret += deltas[i]->get_num_updates();
+	return ret;
+}
+
+void graph_delta_store::get_vertices(edge_type type,
+		std::vector<vertex_id_t> &ids) const
+{
+	for (size_t i = 0; i < deltas.size(); i++)
+		deltas[i]->get_vertices(type, ids);
+	std::sort(ids.begin(), ids.end());
+	ids.resize(std::unique(ids.begin(), ids.end()) - ids.begin());
+}
+
+void graph_delta_store::merge(vertex_id_t id, edge_type type,
+		std::vector<vertex_id_t> &neighs) const
+{
+	std::vector<vertex_id_t> added;
+	std::vector<vertex_id_t> removed;
+	std::vector<vertex_id_t> res;
+	for (size_t i = 0; i < deltas.size(); i++) {
+		if (!deltas[i]->get_delta(id, type, added, removed))
+			continue;
+
+		// Both lists are sorted and a neighbor can't be in both of them.
+		res.clear();
+		res.reserve(neighs.size() + added.size());
+		auto rit = removed.begin();
+		auto ait = added.begin();
+		for (auto it = neighs.begin(); it != neighs.end(); it++) {
+			vertex_id_t v = *it;
+			while (rit != removed.end() && *rit < v)
+				rit++;
+			if (rit != removed.end() && *rit == v)
+				continue;
+			while (ait != added.end() && *ait < v)
+				res.push_back(*ait++);
+			// The edge already exists in the base graph.
+			if (ait != added.end() && *ait == v)
+				ait++;
+			res.push_back(v);
+		}
+		res.insert(res.end(), ait, added.end());
+		neighs.swap(res);
+	}
+}
+
+/*
+ * This byte array stores a merged vertex in contiguous memory.
+ */
+class delta_page_vertex::mem_byte_array: public page_byte_array
+{
+	std::vector<char> data;
+public:
+	mem_byte_array(size_t size): data(size) {
+	}
+
+	char *get_raw_arr() {
+		return data.data();
+	}
+
+	virtual void lock() {
+	}
+
+	virtual void unlock() {
+	}
+
+	virtual size_t get_size() const {
+		return data.size();
+	}
+
+	virtual page_byte_array *clone() {
+		return NULL;
+	}
+
+	virtual off_t get_offset() const {
+		return 0;
+	}
+
+	virtual off_t get_offset_in_first_page() const {
+		return 0;
+	}
+
+	virtual const char *get_page(int idx) const {
+		return data.data() + idx * PAGE_SIZE;
+	}
+};
+
+delta_page_vertex::mem_byte_array *delta_page_vertex::merge_part(
+		const page_vertex &vertex, edge_type type,
+		const graph_delta_store &store)
+{
+	size_t num_edges = vertex.get_num_edges(type);
+	std::vector<vertex_id_t> neighs(num_edges);
+	if (num_edges > 0)
+		vertex.read_edges(type, neighs.data(), num_edges);
+	store.merge(vertex.get_id(), type, neighs);
+
+	mem_byte_array *arr = new mem_byte_array(
+			ext_mem_undirected_vertex::num_edges2vsize(neighs.size(), 0));
+	ext_mem_undirected_vertex *v = new (arr->get_raw_arr())
+		ext_mem_undirected_vertex(vertex.get_id(), neighs.size(), 0);
+	for (size_t i = 0; i < neighs.size(); i++)
+		v->set_neighbor(i, neighs[i]);
+	return arr;
+}
+
+delta_page_vertex::delta_page_vertex(const page_vertex &vertex,
+		const graph_delta_store &store)
+{
+	if (vertex.is_directed()) {
+		const page_directed_vertex &dv = (const page_directed_vertex &) vertex;
+		if (dv.has_in_part())
+			in_arr.reset(merge_part(vertex, IN_EDGE, store));
+		if (dv.has_out_part())
+			out_arr.reset(merge_part(vertex, OUT_EDGE, store));
+
+		if (in_arr && out_arr)
+			directed_v.reset(new page_directed_vertex(*in_arr, *out_arr));
+		else if (in_arr)
+			directed_v.reset(new page_directed_vertex(*in_arr, true));
+		else
+			directed_v.reset(new page_directed_vertex(*out_arr, false));
+	}
+	else {
+		in_arr.reset(merge_part(vertex, IN_EDGE, store));
+		undirected_v.reset(new page_undirected_vertex(*in_arr));
+	}
+}
+
+delta_page_vertex::~delta_page_vertex()
+{
+}
+
+}
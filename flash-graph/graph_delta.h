@@ -0,0 +1,286 @@
+#ifndef __GRAPH_DELTA_H__
+#define __GRAPH_DELTA_H__
+
+/*
+ * Copyright 2014 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of FlashGraph.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "vertex.h"
+#include "graph_file_header.h"
+
+namespace fg
+{
+
+/*
+ * The operations that can be applied to an edge in a delta.
+ * The values are persisted in the delta log, so they can't be changed.
+ */
+enum delta_op_t
+{
+	EDGE_INSERT = 1,
+	EDGE_DELETE = 2,
+};
+
+/*
+ * An update on a single edge. In a directed graph, the edge goes from
+ * `from' to `to'. In an undirected graph, the order doesn't matter.
+ */
+struct edge_update
+{
+	vertex_id_t from;
+	vertex_id_t to;
+	delta_op_t op;
+
+	edge_update() {
+		from = INVALID_VERTEX_ID;
+		to = INVALID_VERTEX_ID;
+		op = EDGE_INSERT;
+	}
+
+	edge_update(vertex_id_t from, vertex_id_t to, delta_op_t op) {
+		this->from = from;
+		this->to = to;
+		this->op = op;
+	}
+};
+
+class delta_log;
+
+/*
+ * This keeps the edge insertions and deletions on a graph since the last
+ * compaction. The updates are indexed by vertex, so we can merge them into
+ * the adjacency list of a vertex when it's read from SAFS.
+ * If a delta has a log file, every update is appended to the log in SAFS
+ * before it's applied in memory, so the delta can be recovered with `load'.
+ *
+ * A delta uses the set semantics: the adjacency list of a vertex after
+ * merging is (base - removed) + added.
+ */
+class graph_delta
+{
+	/*
+	 * The updates on a vertex. The neighbor lists are sorted.
+	 * For an undirected vertex, we only use the first slot.
+	 */
+	struct vertex_delta
+	{
+		std::vector<vertex_id_t> added[2];
+		std::vector<vertex_id_t> removed[2];
+	};
+	typedef std::unordered_map<vertex_id_t, vertex_delta> vdelta_map_t;
+
+	struct partition
+	{
+		pthread_spinlock_t lock;
+		vdelta_map_t vertices;
+
+		partition() {
+			pthread_spin_init(&lock, PTHREAD_PROCESS_PRIVATE);
+		}
+
+		~partition() {
+			pthread_spin_destroy(&lock);
+		}
+	};
+
+	static const int NUM_PARTS_LOG = 6;
+	static const int NUM_PARTS = 1 << NUM_PARTS_LOG;
+
+	bool directed;
+	size_t num_vertices;
+	std::unique_ptr<partition[]> parts;
+	std::atomic<size_t> num_updates;
+	std::shared_ptr<delta_log> log;
+	// Batches are logged and applied in memory under this lock,
+	// so they're applied in the order they're in the log.
+	pthread_mutex_t apply_lock;
+
+	graph_delta(const graph_header &header);
+
+	partition &get_part(vertex_id_t id) const {
+		// Vertices are clustered by ID in the graph, so we use the low bits
+		// to spread the updates among partitions.
+		return parts[id & (NUM_PARTS - 1)];
+	}
+
+	static int get_slot(edge_type type) {
+		return type == OUT_EDGE ? 1 : 0;
+	}
+
+	void add_neighbor(vertex_id_t id, edge_type type, vertex_id_t neigh,
+			delta_op_t op);
+	void apply_in_mem(const edge_update &update);
+public:
+	typedef std::shared_ptr<graph_delta> ptr;
+
+	/*
+	 * Create an empty delta for a graph. If `log_file' isn't empty,
+	 * a SAFS file that can store `log_capacity' updates is created for
+	 * logging the updates.
+	 */
+	static ptr create(const graph_header &header,
+			const std::string &log_file = "", size_t log_capacity = 0);
+	/*
+	 * Recover a delta by replaying the updates in a log file in SAFS.
+	 */
+	static ptr load(const graph_header &header, const std::string &log_file);
+
+	~graph_delta();
+
+	bool is_directed() const {
+		return directed;
+	}
+
+	/*
+	 * Apply the updates to the delta. If the delta has a log, the updates
+	 * are written to the log in SAFS first, so it's better to apply updates
+	 * in batches. It returns false if the log is full and the updates
+	 * aren't applied. In this case, the delta should be compacted into
+	 * the base graph.
+	 */
+	bool apply(const edge_update updates[], size_t num);
+
+	size_t get_num_updates() const {
+		return num_updates;
+	}
+
+	size_t get_num_vertices() const;
+	bool has_delta(vertex_id_t id) const;
+
+	/*
+	 * Get the neighbors added to and removed from a vertex.
+	 * It returns false if the vertex doesn't have updates of the edge type.
+	 */
+	bool get_delta(vertex_id_t id, edge_type type,
+			std::vector<vertex_id_t> &added,
+			std::vector<vertex_id_t> &removed) const;
+
+	/*
+	 * Get the IDs of all vertices with updates.
+	 */
+	void get_vertices(std::vector<vertex_id_t> &ids) const;
+	/*
+	 * Get the IDs of the vertices with updates on the edges of the type.
+	 */
+	void get_vertices(edge_type type, std::vector<vertex_id_t> &ids) const;
+
+	/*
+	 * Delete the log file in SAFS after the delta is compacted.
+	 */
+	void delete_log();
+};
+
+/*
+ * This is a read-only view of a sequence of deltas that are applied
+ * to a base graph in order. The graph engine merges the updates
+ * in the deltas into the adjacency lists it reads from the base graph.
+ */
+class graph_delta_store
+{
+	std::vector<graph_delta::ptr> deltas;
+
+	graph_delta_store(const std::vector<graph_delta::ptr> &deltas) {
+		this->deltas = deltas;
+	}
+public:
+	typedef std::shared_ptr<graph_delta_store> ptr;
+
+	static ptr create(const std::vector<graph_delta::ptr> &deltas) {
+		return ptr(new graph_delta_store(deltas));
+	}
+
+	static ptr create(graph_delta::ptr delta) {
+		return ptr(new graph_delta_store(std::vector<graph_delta::ptr>(1,
+						delta)));
+	}
+
+	const std::vector<graph_delta::ptr> &get_deltas() const {
+		return deltas;
+	}
+
+	bool has_delta(vertex_id_t id) const {
+		for (size_t i = 0; i < deltas.size(); i++)
+			if (deltas[i]->has_delta(id))
+				return true;
+		return false;
+	}
+
+	size_t get_num_updates() const;
+
+	/*
+	 * Get the IDs of the vertices whose adjacency list of the edge type
+	 * is changed by any of the deltas. The IDs are sorted and unique.
+	 */
+	void get_vertices(edge_type type, std::vector<vertex_id_t> &ids) const;
+
+	/*
+	 * Merge the updates of a vertex into its sorted neighbor list.
+	 * `neighs' contains the neighbor list from the base graph and gets
+	 * the merged neighbor list.
+	 */
+	void merge(vertex_id_t id, edge_type type,
+			std::vector<vertex_id_t> &neighs) const;
+};
+
+/*
+ * This constructs a page vertex whose adjacency lists are the adjacency
+ * lists of a page vertex from the base graph merged with the updates
+ * in the delta store. Only the parts of a directed vertex that exist in
+ * the original page vertex are merged.
+ *
+ * The merged vertex doesn't have edge data. The vertex header in the graph
+ * index isn't updated by deltas, so `request_vertex_headers' still returns
+ * the number of edges in the base graph.
+ */
+class delta_page_vertex
+{
+	class mem_byte_array;
+
+	std::unique_ptr<mem_byte_array> in_arr;
+	std::unique_ptr<mem_byte_array> out_arr;
+	// page_vertex doesn't have a virtual destructor, so we keep the merged
+	// vertex in its own type.
+	std::unique_ptr<page_directed_vertex> directed_v;
+	std::unique_ptr<page_undirected_vertex> undirected_v;
+
+	static mem_byte_array *merge_part(const page_vertex &vertex,
+			edge_type type, const graph_delta_store &store);
+public:
+	delta_page_vertex(const page_vertex &vertex,
+			const graph_delta_store &store);
+	~delta_page_vertex();
+
+	const page_vertex &get_vertex() const {
+		if (directed_v)
+			return *directed_v;
+		else
+			return *undirected_v;
+	}
+};
+
+}
+
+#endif
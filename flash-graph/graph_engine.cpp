@@ -31,6 +31,7 @@
 #include "vertex_request.h"
 #include "vertex_index_reader.h"
 #include "in_mem_storage.h"
+#include "in_mem_csr.h"
 #include "FGlib.h"
 
 using namespace safs;
@@ -232,7 +233,10 @@ void compute_vertex::request_vertices(vertex_id_t ids[], size_t num)
 	vertex_id_t id = curr->get_vertex_program(false).get_vertex_id(*this);
 	curr->request_on_vertex(id);
 	if (request_self(ids, num, id)) {
-		if (curr->get_graph().is_directed()) {
+		csr_vertex_reader *csr_reader = curr->get_csr_reader();
+		if (csr_reader)
+			csr_reader->request_vertex(ids[0]);
+		else if (curr->get_graph().is_directed()) {
 			directed_vertex_request req(ids[0], BOTH_EDGES);
 			curr->get_index_reader().request_vertex(req);
 		}
@@ -267,8 +271,13 @@ void compute_directed_vertex::request_partial_vertices(
 	vertex_id_t id = curr->get_vertex_program(false).get_vertex_id(*this);
 	curr->request_on_vertex(id);
 	if (request_self(reqs, num, id)) {
-		for (size_t i = 0; i < num; i++)
-			curr->get_index_reader().request_vertex(reqs[i]);
+		csr_vertex_reader *csr_reader = curr->get_csr_reader();
+		for (size_t i = 0; i < num; i++) {
+			if (csr_reader)
+				csr_reader->request_vertex(reqs[i]);
+			else
+				curr->get_index_reader().request_vertex(reqs[i]);
+		}
 	}
 	else {
 		compute_vertex_pointer curr_vertex = curr->get_curr_vertex();
@@ -548,6 +557,9 @@ void graph_engine::init(graph_index::ptr index)
 	index->init(num_threads, num_nodes);
 
 	max_processing_vertices = graph_conf.get_max_processing_vertices();
+	no_cache = false;
+	max_num_iters = INT_MAX;
+	prefetch_type = edge_type::NONE;
 	is_complete = false;
 	this->vertices = index;
 
@@ -595,8 +607,20 @@ graph_engine::graph_engine(FG_graph &graph, graph_index::ptr index)
 
 	// Init graph data.
 	graph_factory = graph.get_graph_io_factory(GLOBAL_CACHE_ACCESS);
+	delta_store = graph.get_delta_store();
 	// Construct the in-memory compressed vertex index.
 	vindex = in_mem_query_vertex_index::create(graph.get_index_data(), true);
+	graph_data = graph.get_graph_data();
+	// The CSR reader only serves the requests of whole vertices, so it
+	// can't run with vertical partitioning.
+	if (graph_data && graph_conf.use_in_mem_csr()
+			&& graph_conf.get_num_vparts() > 1)
+		BOOST_LOG_TRIVIAL(warning)
+			<< "in_mem_csr doesn't support vertical partitioning, access the in-mem graph with SAFS";
+	else if (graph_data && graph_conf.use_in_mem_csr()) {
+		csr = in_mem_csr::create(*graph_data, vindex);
+		BOOST_LOG_TRIVIAL(info) << "access the in-mem graph directly";
+	}
 
 	header = graph.get_graph_header();
 	header.verify();
@@ -796,6 +820,38 @@ bool graph_engine::progress_next_level()
 	return is_complete;
 }
 
+void graph_engine::prefetch_neighbor_state(const page_vertex &vertex) const
+{
+	if (prefetch_states.empty())
+		return;
+
+	// The state of many neighbors can't stay in the CPU cache anyway,
+	// so we only prefetch the state of the first neighbors.
+	const size_t MAX_PREFETCH_NEIGHS = 256;
+	std::vector<edge_type> types;
+	if (!vertex.is_directed())
+		types.push_back(BOTH_EDGES);
+	else {
+		const page_directed_vertex &dvertex
+			= (const page_directed_vertex &) vertex;
+		if ((prefetch_type == IN_EDGE || prefetch_type == BOTH_EDGES)
+				&& dvertex.has_in_part())
+			types.push_back(IN_EDGE);
+		if ((prefetch_type == OUT_EDGE || prefetch_type == BOTH_EDGES)
+				&& dvertex.has_out_part())
+			types.push_back(OUT_EDGE);
+	}
+	for (size_t i = 0; i < types.size(); i++) {
+		edge_seq_iterator it = vertex.get_neigh_seq_it(types[i], 0,
+				MAX_PREFETCH_NEIGHS);
+		while (it.has_next()) {
+			vertex_id_t id = it.next();
+			for (size_t j = 0; j < prefetch_states.size(); j++)
+				prefetch_states[j]->prefetch(id);
+		}
+	}
+}
+
 void graph_engine::wait4complete()
 {
 	for (unsigned i = 0; i < worker_threads.size(); i++) {
@@ -323,6 +323,24 @@ public:
 class worker_thread;
 class in_mem_graph;
 class FG_graph;
+class graph_delta_store;
+class in_mem_csr;
+template<class T> class vertex_column;
+
+/**
+ * \brief The per-vertex state that the graph engine can prefetch for
+ *        the neighbors of a vertex. `vertex_column' implements it.
+ */
+class vertex_state_base
+{
+public:
+	typedef std::shared_ptr<const vertex_state_base> const_ptr;
+
+	virtual ~vertex_state_base() {
+	}
+
+	virtual void prefetch(vertex_id_t id) const = 0;
+};
 
 /**
  * \brief This is the class that coordinates how & where algorithms are run.
@@ -340,6 +358,11 @@ class graph_engine
 	graph_index::ptr vertices;
 	in_mem_query_vertex_index::ptr vindex;
 	std::shared_ptr<in_mem_graph> graph_data;
+	// The updates merged into the adjacency lists read from the graph.
+	std::shared_ptr<graph_delta_store> delta_store;
+	// The adjacency lists of vertices are read from here directly if
+	// the engine accesses the in-mem graph without SAFS.
+	std::shared_ptr<in_mem_csr> csr;
 	vertex_scheduler::ptr scheduler;
 
 	// The number of activated vertices that haven't been processed
@@ -360,6 +383,16 @@ class graph_engine
 	trace_logger::ptr logger;
 	std::shared_ptr<safs::file_io_factory> graph_factory;
 	int max_processing_vertices;
+	// Whether the adjacency lists are read in a one-pass scan.
+	bool no_cache;
+	// Vertices don't run after the engine has run this many iterations.
+	int max_num_iters;
+	// If it isn't NULL, an activated vertex only runs if its flag is set.
+	std::shared_ptr<vertex_column<bool> > run_flags;
+	// The state of the neighbors prefetched before a vertex gets its own
+	// adjacency list.
+	edge_type prefetch_type;
+	std::vector<vertex_state_base::const_ptr> prefetch_states;
 
 	// The time when the current iteration starts.
 	struct timeval start_time, iter_start;
@@ -595,6 +628,11 @@ public:
 	int get_num_threads() const {
 		return worker_threads.size();
 	}
+
+    /**\internal */
+	int get_num_nodes() const {
+		return num_nodes;
+	}
     
     /**\internal */
 	worker_thread *get_thread(int idx) const {
@@ -635,10 +673,93 @@ public:
 		return max_processing_vertices;
 	}
 
+	/**
+	 * \brief Tell the page cache that the adjacency lists are read in
+	 *        a scan and are unlikely to be read again soon, so they don't
+	 *        evict the pages that are accessed more frequently.
+	 *        It's only meant for a one-pass scan of the graph and only
+	 *        takes effect when cache admission is enabled in SAFS.
+	 *        Algorithms that read the graph in every iteration shouldn't
+	 *        use it.
+	 * \param no_cache whether to use the hint.
+	 */
+	void set_no_cache(bool no_cache) {
+		this->no_cache = no_cache;
+	}
+
+	bool is_no_cache() const {
+		return no_cache;
+	}
+
+	/**
+	 * \brief Stop running vertices after some iterations. The vertices
+	 *        activated in the later iterations complete without running.
+	 * \param max The max number of iterations.
+	 */
+	void set_max_num_iters(int max) {
+		max_num_iters = max;
+	}
+
+	int get_max_num_iters() const {
+		return max_num_iters;
+	}
+
+	/**
+	 * \brief Only run the activated vertices whose flags are set in
+	 *        the column. The engine clears the flag of a vertex before
+	 *        it runs the vertex, so the user code sets the flag again
+	 *        if the vertex needs to run in a later iteration.
+	 *        The other vertices complete without running.
+	 * \param flags The flags of the vertices. If it's NULL, all activated
+	 *        vertices run.
+	 */
+	void set_run_flags(std::shared_ptr<vertex_column<bool> > flags) {
+		run_flags = flags;
+	}
+
+	/** \internal */
+	const std::shared_ptr<vertex_column<bool> > &get_run_flags() const {
+		return run_flags;
+	}
+
+	/**
+	 * \brief Prefetch the state of the neighbors of a vertex to the CPU
+	 *        cache before the vertex gets its own adjacency list.
+	 *        When the graph is in memory, the engine prefetches the state
+	 *        for the vertices a few requests ahead of the one it runs.
+	 *        Otherwise, it prefetches the state for a vertex once its
+	 *        adjacency list is read from SAFS.
+	 * \param type The type of the edges to the neighbors.
+	 * \param states The state of the neighbors. If it's empty, nothing
+	 *        is prefetched.
+	 */
+	void set_neighbor_prefetch(edge_type type,
+			const std::vector<vertex_state_base::const_ptr> &states) {
+		prefetch_type = type;
+		prefetch_states = states;
+	}
+
+	/** \internal */
+	bool has_neighbor_prefetch() const {
+		return !prefetch_states.empty();
+	}
+
+	/** \internal */
+	void prefetch_neighbor_state(const page_vertex &vertex) const;
+
 	const graph_index &get_graph_index() const {
 		return *vertices;
 	}
 
+	const std::shared_ptr<graph_delta_store> &get_delta_store() const {
+		return delta_store;
+	}
+
+	/** \internal */
+	const std::shared_ptr<in_mem_csr> &get_in_mem_csr() const {
+		return csr;
+	}
+
 	size_t get_in_part_size() const {
 		return out_part_off;
 	}
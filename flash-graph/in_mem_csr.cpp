@@ -0,0 +1,213 @@
+/*
+ * Copyright 2014 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of FlashGraph.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "in_mem_io.h"
+
+#include "in_mem_csr.h"
+#include "in_mem_storage.h"
+#include "vertex_compute.h"
+#include "worker_thread.h"
+#include "graph_engine.h"
+
+using namespace safs;
+
+namespace fg
+{
+
+in_mem_csr::in_mem_csr(const in_mem_graph &_graph,
+		in_mem_query_vertex_index::ptr index): graph(_graph)
+{
+	// The vertices in a block are located with one lookup in the compressed
+	// index and the offsets of the following vertices are accumulated.
+	const size_t BLOCK_SIZE = 4096;
+
+	directed = index->is_directed();
+	if (directed) {
+		in_mem_cdirected_vertex_index::ptr cindex
+			= in_mem_cdirected_vertex_index::cast(index);
+		num_vertices = cindex->get_num_vertices();
+		in_offs.resize(num_vertices + 1);
+		out_offs.resize(num_vertices + 1);
+		size_t num_blocks = (num_vertices + BLOCK_SIZE - 1) / BLOCK_SIZE;
+#pragma omp parallel for
+		for (size_t i = 0; i < num_blocks; i++) {
+			vertex_id_t start = i * BLOCK_SIZE;
+			vertex_id_t end = std::min(start + BLOCK_SIZE, num_vertices);
+			directed_vertex_entry e = cindex->get_vertex(start);
+			off_t in_off = e.get_in_off();
+			off_t out_off = e.get_out_off();
+			for (vertex_id_t id = start; id < end; id++) {
+				in_offs[id] = in_off;
+				out_offs[id] = out_off;
+				in_off += cindex->get_in_size(id);
+				out_off += cindex->get_out_size(id);
+			}
+			if (end == num_vertices) {
+				in_offs[end] = in_off;
+				out_offs[end] = out_off;
+			}
+		}
+	}
+	else {
+		in_mem_cundirected_vertex_index::ptr cindex
+			= in_mem_cundirected_vertex_index::cast(index);
+		num_vertices = cindex->get_num_vertices();
+		in_offs.resize(num_vertices + 1);
+		size_t num_blocks = (num_vertices + BLOCK_SIZE - 1) / BLOCK_SIZE;
+#pragma omp parallel for
+		for (size_t i = 0; i < num_blocks; i++) {
+			vertex_id_t start = i * BLOCK_SIZE;
+			vertex_id_t end = std::min(start + BLOCK_SIZE, num_vertices);
+			off_t off = cindex->get_vertex(start).get_off();
+			for (vertex_id_t id = start; id < end; id++) {
+				in_offs[id] = off;
+				off += cindex->get_size(id);
+			}
+			if (end == num_vertices)
+				in_offs[end] = off;
+		}
+	}
+	if (num_vertices > 0) {
+		off_t end = directed ? out_offs[num_vertices] : in_offs[num_vertices];
+		assert((size_t) end <= graph.get_size());
+	}
+}
+
+void in_mem_csr::get_data(off_t off, size_t size, csr_byte_array &arr) const
+{
+	NUMA_buffer::cdata_info info = graph.get_data().get_data(off, size);
+	assert(info.first);
+	if (info.second >= size)
+		arr.init(info.first, size, off);
+	else {
+		// The adjacency list is stored across chunks, so we have to copy it.
+		char *buf = arr.init_buf(size, off);
+		graph.get_data().copy_to(buf, size, off);
+	}
+}
+
+void csr_vertex_reader::request_vertices(const directed_vertex_request vreqs[],
+		size_t num, directed_vertex_compute &compute)
+{
+	for (size_t i = 0; i < num; i++)
+		reqs.push_back(vertex_req(vreqs[i], &compute, false));
+}
+
+void csr_vertex_reader::run_on_vertex(const vertex_req &req,
+		const page_vertex &pg_v, int num_parts)
+{
+	if (req.compute) {
+		req.compute->run_on_vertex(pg_v, num_parts);
+		return;
+	}
+
+	// A vertex requests its own adjacency list. We don't support part
+	// vertex compute here, same as the merged vertex computes.
+	graph_engine &graph = t.get_graph();
+	compute_vertex_pointer v(&graph.get_vertex(pg_v.get_id()));
+	t.start_run_vertex(v);
+	run_vprog(t.get_vertex_program(false), *v, pg_v, graph);
+	bool issued_reqs = t.finish_run_vertex(v);
+	if (!issued_reqs)
+		t.complete_vertex(v);
+}
+
+/*
+ * Prefetch the state of the neighbors of the vertex in a request.
+ * We ignore the updates in the delta store here, because most of
+ * the neighbors are in the base graph.
+ */
+void csr_vertex_reader::prefetch_request(const vertex_req &req)
+{
+	if (req.num_edges)
+		return;
+
+	vertex_id_t id = req.req.get_id();
+	const graph_engine &graph = t.get_graph();
+	if (!csr.is_directed()) {
+		csr.get_vertex(id, IN_EDGE, prefetch_in_arr);
+		graph.prefetch_neighbor_state(page_undirected_vertex(prefetch_in_arr));
+	}
+	else if (req.req.get_type() == BOTH_EDGES) {
+		csr.get_vertex(id, IN_EDGE, prefetch_in_arr);
+		csr.get_vertex(id, OUT_EDGE, prefetch_out_arr);
+		graph.prefetch_neighbor_state(page_directed_vertex(prefetch_in_arr,
+					prefetch_out_arr));
+	}
+	else {
+		csr.get_vertex(id, req.req.get_type(), prefetch_in_arr);
+		graph.prefetch_neighbor_state(page_directed_vertex(prefetch_in_arr,
+					req.req.get_type() == IN_EDGE));
+	}
+}
+
+void csr_vertex_reader::process_request(const vertex_req &req)
+{
+	vertex_id_t id = req.req.get_id();
+	if (req.num_edges) {
+		if (csr.is_directed())
+			((directed_vertex_compute *) req.compute)->run_on_vertex_size(id,
+					csr.get_size(id, IN_EDGE), csr.get_size(id, OUT_EDGE));
+		else
+			req.compute->run_on_vertex_size(id, csr.get_size(id, IN_EDGE));
+	}
+	else if (!csr.is_directed()) {
+		csr.get_vertex(id, IN_EDGE, in_arr);
+		page_undirected_vertex pg_v(in_arr);
+		run_on_vertex(req, pg_v, 1);
+	}
+	else if (req.req.get_type() == BOTH_EDGES) {
+		csr.get_vertex(id, IN_EDGE, in_arr);
+		csr.get_vertex(id, OUT_EDGE, out_arr);
+		page_directed_vertex pg_v(in_arr, out_arr);
+		run_on_vertex(req, pg_v, 2);
+	}
+	else {
+		assert(req.req.get_type() == IN_EDGE
+				|| req.req.get_type() == OUT_EDGE);
+		bool in_part = req.req.get_type() == IN_EDGE;
+		csr.get_vertex(id, req.req.get_type(), in_arr);
+		page_directed_vertex pg_v(in_arr, in_part);
+		run_on_vertex(req, pg_v, 1);
+	}
+}
+
+size_t csr_vertex_reader::process_requests()
+{
+	// While a vertex runs, we prefetch the state of the neighbors of
+	// the vertices a few requests ahead, so the state is in the CPU cache
+	// by the time those vertices run.
+	const size_t PREFETCH_DIST = 4;
+	bool prefetch = t.get_graph().has_neighbor_prefetch();
+	size_t num_prefetched = 0;
+	size_t num = 0;
+	// The user code may issue more requests when we serve a request.
+	// They are appended to the vector, so we copy the request out first.
+	for (; num < reqs.size(); num++) {
+		for (; prefetch && num_prefetched < std::min(reqs.size(),
+					num + PREFETCH_DIST); num_prefetched++)
+			prefetch_request(reqs[num_prefetched]);
+		vertex_req req = reqs[num];
+		process_request(req);
+	}
+	reqs.clear();
+	return num;
+}
+
+}
@@ -0,0 +1,252 @@
+#ifndef __IN_MEM_CSR_H__
+#define __IN_MEM_CSR_H__
+
+/*
+ * Copyright 2014 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of FlashGraph.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <memory>
+#include <vector>
+
+#include "cache.h"
+
+#include "vertex.h"
+#include "vertex_index.h"
+#include "vertex_request.h"
+
+namespace fg
+{
+
+class in_mem_graph;
+class vertex_compute;
+class directed_vertex_compute;
+class worker_thread;
+
+/*
+ * This byte array points to the adjacency list of a vertex in the in-memory
+ * graph. It emulates the pages of SAFS on top of the memory, so a page
+ * vertex can be constructed on it without copying the adjacency list.
+ */
+class csr_byte_array: public safs::page_byte_array
+{
+	const char *data;
+	size_t size;
+	off_t off;
+	// The graph data is split into chunks. If an adjacency list is stored
+	// across chunks, it's copied to this buffer.
+	std::vector<char> buf;
+public:
+	csr_byte_array() {
+		data = NULL;
+		size = 0;
+		off = 0;
+	}
+
+	void init(const char *data, size_t size, off_t off) {
+		this->data = data;
+		this->size = size;
+		this->off = off;
+	}
+
+	/*
+	 * The data in the buffer has the same offset in a page as in the graph
+	 * file, so the elements in the array are aligned in the same way as
+	 * in the pages of SAFS.
+	 */
+	char *init_buf(size_t size, off_t off) {
+		buf.resize(size + safs::PAGE_SIZE * 2);
+		char *start = (char *) ROUNDUP_PAGE(buf.data());
+		init(start + off % safs::PAGE_SIZE, size, off);
+		return start + off % safs::PAGE_SIZE;
+	}
+
+	virtual void lock() {
+	}
+
+	virtual void unlock() {
+	}
+
+	virtual size_t get_size() const {
+		return size;
+	}
+
+	virtual page_byte_array *clone() {
+		return NULL;
+	}
+
+	virtual off_t get_offset() const {
+		return off;
+	}
+
+	virtual off_t get_offset_in_first_page() const {
+		return ((long) data) % safs::PAGE_SIZE;
+	}
+
+	virtual const char *get_page(int idx) const {
+		return (const char *) ROUND_PAGE(data) + idx * safs::PAGE_SIZE;
+	}
+};
+
+/*
+ * This provides direct access to the adjacency lists of an in-memory graph.
+ * It keeps the location of every vertex in flat offset arrays, so the
+ * adjacency list of a vertex is located with a single lookup instead of
+ * going through the vertex index reader and the in-memory I/O of SAFS.
+ */
+class in_mem_csr
+{
+	const in_mem_graph &graph;
+	bool directed;
+	size_t num_vertices;
+	// In an undirected graph, we only use the first array.
+	// The arrays have one more element than the number of vertices,
+	// so the size of a part of a vertex is the difference of two offsets.
+	std::vector<off_t> in_offs;
+	std::vector<off_t> out_offs;
+
+	in_mem_csr(const in_mem_graph &_graph,
+			in_mem_query_vertex_index::ptr index);
+
+	void get_data(off_t off, size_t size, csr_byte_array &arr) const;
+public:
+	typedef std::shared_ptr<in_mem_csr> ptr;
+
+	/*
+	 * The graph data has to stay in memory while the CSR is being used.
+	 */
+	static ptr create(const in_mem_graph &graph,
+			in_mem_query_vertex_index::ptr index) {
+		return ptr(new in_mem_csr(graph, index));
+	}
+
+	bool is_directed() const {
+		return directed;
+	}
+
+	size_t get_num_vertices() const {
+		return num_vertices;
+	}
+
+	size_t get_size(vertex_id_t id, edge_type type) const {
+		const std::vector<off_t> &offs = type == OUT_EDGE ? out_offs : in_offs;
+		return offs[id + 1] - offs[id];
+	}
+
+	/*
+	 * Get a part of a vertex. In an undirected graph, the edge type is
+	 * ignored. In a directed graph, it has to be either IN_EDGE or OUT_EDGE.
+	 */
+	void get_vertex(vertex_id_t id, edge_type type, csr_byte_array &arr) const {
+		const std::vector<off_t> &offs = type == OUT_EDGE ? out_offs : in_offs;
+		get_data(offs[id], offs[id + 1] - offs[id], arr);
+	}
+};
+
+/*
+ * This serves the requests of the vertices processed by a worker thread
+ * from the in-memory CSR. It replaces the vertex index reader and SAFS
+ * when the graph engine accesses the in-memory graph directly.
+ *
+ * The requests are buffered and served after the user code that issues
+ * them returns, so a vertex program sees the same order of calls as
+ * it does on SAFS. The user code is invoked on the requested adjacency
+ * lists directly, so we don't need to create vertex computes for
+ * the requests of vertices on their own adjacency lists.
+ */
+class csr_vertex_reader
+{
+	struct vertex_req
+	{
+		directed_vertex_request req;
+		// If the compute is NULL, the vertex requests its own adjacency list.
+		vertex_compute *compute;
+		// Request the number of edges instead of the adjacency list.
+		bool num_edges;
+
+		vertex_req(const directed_vertex_request &req, vertex_compute *compute,
+				bool num_edges): req(req) {
+			this->compute = compute;
+			this->num_edges = num_edges;
+		}
+	};
+
+	worker_thread &t;
+	const in_mem_csr &csr;
+	std::vector<vertex_req> reqs;
+	csr_byte_array in_arr;
+	csr_byte_array out_arr;
+	// The adjacency lists of the vertex whose neighbors we prefetch.
+	csr_byte_array prefetch_in_arr;
+	csr_byte_array prefetch_out_arr;
+
+	void prefetch_request(const vertex_req &req);
+	void process_request(const vertex_req &req);
+	void run_on_vertex(const vertex_req &req, const page_vertex &pg_v,
+			int num_parts);
+public:
+	csr_vertex_reader(worker_thread &_t, const in_mem_csr &_csr): t(_t), csr(
+			_csr) {
+	}
+
+	/*
+	 * Request the adjacency list of the vertex itself.
+	 */
+	void request_vertex(vertex_id_t id) {
+		reqs.push_back(vertex_req(directed_vertex_request(id, BOTH_EDGES),
+					NULL, false));
+	}
+
+	void request_vertex(const directed_vertex_request &req) {
+		reqs.push_back(vertex_req(req, NULL, false));
+	}
+
+	/*
+	 * Request the adjacency lists of other vertices.
+	 */
+	void request_vertices(const vertex_id_t ids[], size_t num,
+			vertex_compute &compute) {
+		for (size_t i = 0; i < num; i++)
+			reqs.push_back(vertex_req(directed_vertex_request(ids[i],
+							BOTH_EDGES), &compute, false));
+	}
+
+	void request_vertices(const directed_vertex_request vreqs[], size_t num,
+			directed_vertex_compute &compute);
+
+	void request_num_edges(const vertex_id_t ids[], size_t num,
+			vertex_compute &compute) {
+		for (size_t i = 0; i < num; i++)
+			reqs.push_back(vertex_req(directed_vertex_request(ids[i],
+							BOTH_EDGES), &compute, true));
+	}
+
+	/*
+	 * Serve all buffered requests, including the ones issued while
+	 * the requests are being served.
+	 * It returns the number of served requests.
+	 */
+	size_t process_requests();
+
+	size_t get_num_pending_tasks() const {
+		return reqs.size();
+	}
+};
+
+}
+
+#endif
@@ -113,4 +113,9 @@ void in_mem_graph::dump(const std::string &file) const
 	graph_data->dump(file);
 }
 
+void in_mem_graph::dump_safs(const std::string &file) const
+{
+	graph_data->dump_safs(file);
+}
+
 }
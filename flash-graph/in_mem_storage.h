@@ -68,6 +68,22 @@ public:
 	static ptr load_safs_graph(const std::string &graph_file);
 
 	void dump(const std::string &file) const;
+	/*
+	 * Write the graph to a new file in SAFS.
+	 */
+	void dump_safs(const std::string &file) const;
+
+	/*
+	 * The graph data isn't stored in contiguous memory. It's split into
+	 * chunks and the chunks are distributed to NUMA nodes.
+	 */
+	const safs::NUMA_buffer &get_data() const {
+		return *graph_data;
+	}
+
+	size_t get_size() const {
+		return graph_size;
+	}
 
 	std::shared_ptr<safs::file_io_factory> create_io_factory() const;
 };
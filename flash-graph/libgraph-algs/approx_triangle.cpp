@@ -0,0 +1,485 @@
+/*
+ * Copyright 2014 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of FlashGraph.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+
+#include <random>
+#include <vector>
+#include <algorithm>
+
+#include <boost/foreach.hpp>
+#include <boost/format.hpp>
+
+#include "concurrency.h"
+
+#include "graph_engine.h"
+#include "vertex_state.h"
+#include "FGlib.h"
+
+using namespace fg;
+
+namespace {
+
+/*
+ * We estimate the number of triangles with wedge sampling. A wedge is
+ * a path of length two. The fraction of closed wedges is the global
+ * clustering coefficient, and each triangle closes three wedges.
+ * A vertex samples wedges centered at itself and only requests
+ * the adjacency lists of the endpoints of the sampled wedges.
+ */
+
+// Estimate the global clustering coefficient. The number of wedges sampled
+// at a vertex is stored in `sample_col'. Otherwise, every vertex samples
+// up to `max_local_samples' wedges to estimate its local clustering
+// coefficient, which is stored in `cc_col'.
+bool global_estimate;
+vertex_column<uint32_t>::ptr sample_col;
+size_t max_local_samples;
+vertex_column<float>::ptr cc_col;
+unsigned sample_seed;
+
+size_t get_num_wedges(size_t degree)
+{
+	return degree < 2 ? 0 : degree * (degree - 1) / 2;
+}
+
+/*
+ * The two endpoints of a sampled wedge. We request the adjacency list of
+ * the first endpoint and search for the second endpoint in it.
+ */
+typedef std::pair<vertex_id_t, vertex_id_t> wedge_t;
+
+struct wedge_first_less
+{
+	bool operator()(const wedge_t &w1, const wedge_t &w2) const {
+		return w1.first < w2.first;
+	}
+};
+
+struct wedge_data
+{
+	std::vector<wedge_t> wedges;
+	size_t num_sampled;
+	size_t num_closed;
+	size_t num_pending;
+
+	wedge_data() {
+		num_sampled = 0;
+		num_closed = 0;
+		num_pending = 0;
+	}
+};
+
+class approx_triangle_vertex: public compute_vertex
+{
+	// It only exists while the vertex is waiting for the adjacency lists
+	// of the sampled wedges.
+	wedge_data *data;
+
+	void run_on_itself(vertex_program &prog, const page_vertex &vertex);
+	void run_on_neighbor(vertex_program &prog, const page_vertex &vertex);
+	void complete(vertex_program &prog);
+public:
+	approx_triangle_vertex(vertex_id_t id): compute_vertex(id) {
+		data = NULL;
+	}
+
+	void run(vertex_program &prog) {
+		vertex_id_t id = prog.get_vertex_id(*this);
+		if (get_num_wedges(prog.get_num_edges(id)) == 0) {
+			if (!global_estimate)
+				cc_col->get(prog, *this) = 0;
+			return;
+		}
+		request_vertices(&id, 1);
+	}
+
+	void run(vertex_program &prog, const page_vertex &vertex) {
+		if (vertex.get_id() == prog.get_vertex_id(*this))
+			run_on_itself(prog, vertex);
+		else
+			run_on_neighbor(prog, vertex);
+	}
+
+	void run_on_message(vertex_program &prog, const vertex_message &msg) {
+	}
+};
+
+class approx_triangle_vertex_program: public vertex_program_impl<approx_triangle_vertex>
+{
+	std::mt19937_64 gen;
+	std::vector<vertex_id_t> edges;
+	std::vector<vertex_id_t> reqs;
+	size_t num_sampled;
+	size_t num_closed;
+public:
+	typedef std::shared_ptr<approx_triangle_vertex_program> ptr;
+
+	static ptr cast2(vertex_program::ptr prog) {
+		return std::static_pointer_cast<approx_triangle_vertex_program,
+			   vertex_program>(prog);
+	}
+
+	approx_triangle_vertex_program() {
+		num_sampled = 0;
+		num_closed = 0;
+	}
+
+	/*
+	 * The random sequence of a vertex only depends on the seed and
+	 * the vertex ID, so the samples don't depend on how vertices are
+	 * scheduled to threads.
+	 */
+	std::mt19937_64 &get_gen(vertex_id_t id) {
+		gen.seed((((uint64_t) sample_seed) << 32) | id);
+		return gen;
+	}
+
+	std::vector<vertex_id_t> &get_edge_buf() {
+		return edges;
+	}
+
+	std::vector<vertex_id_t> &get_req_buf() {
+		return reqs;
+	}
+
+	void add_result(size_t num_sampled, size_t num_closed) {
+		this->num_sampled += num_sampled;
+		this->num_closed += num_closed;
+	}
+
+	size_t get_num_sampled() const {
+		return num_sampled;
+	}
+
+	size_t get_num_closed() const {
+		return num_closed;
+	}
+};
+
+class approx_triangle_vertex_program_creater: public vertex_program_creater
+{
+public:
+	vertex_program::ptr create() const {
+		return vertex_program::ptr(new approx_triangle_vertex_program());
+	}
+};
+
+void approx_triangle_vertex::run_on_itself(vertex_program &prog,
+		const page_vertex &vertex)
+{
+	approx_triangle_vertex_program &tprog
+		= (approx_triangle_vertex_program &) prog;
+	vertex_id_t id = prog.get_vertex_id(*this);
+	std::vector<vertex_id_t> &edges = tprog.get_edge_buf();
+	edges.resize(vertex.get_num_edges(edge_type::OUT_EDGE));
+	vertex.read_edges(edge_type::OUT_EDGE, edges.data(), edges.size());
+	size_t num_wedges = get_num_wedges(edges.size());
+	if (num_wedges == 0)
+		return;
+
+	assert(data == NULL);
+	data = new wedge_data();
+	size_t num_samples;
+	if (global_estimate)
+		num_samples = sample_col->get(prog, *this);
+	else
+		num_samples = std::min(num_wedges, max_local_samples);
+
+	// If a vertex has few wedges, we check all of them, so the local
+	// clustering coefficient of a low-degree vertex is exact.
+	if (!global_estimate && num_wedges <= max_local_samples) {
+		for (size_t i = 0; i < edges.size(); i++)
+			for (size_t j = i + 1; j < edges.size(); j++)
+				data->wedges.push_back(wedge_t(edges[i], edges[j]));
+	}
+	else {
+		std::uniform_int_distribution<size_t> dist(0, edges.size() - 1);
+		std::mt19937_64 &gen = tprog.get_gen(id);
+		for (size_t k = 0; k < num_samples; k++) {
+			size_t i = dist(gen);
+			size_t j = dist(gen);
+			while (j == i)
+				j = dist(gen);
+			data->wedges.push_back(wedge_t(edges[i], edges[j]));
+		}
+	}
+
+	// A wedge with a self-loop or a duplicated edge is counted as open.
+	data->num_sampled = data->wedges.size();
+	size_t num = 0;
+	for (size_t i = 0; i < data->wedges.size(); i++) {
+		wedge_t w = data->wedges[i];
+		if (w.first == w.second || w.first == id || w.second == id)
+			continue;
+		// We request the adjacency list of the endpoint with fewer edges.
+		if (prog.get_num_edges(w.first) > prog.get_num_edges(w.second))
+			std::swap(w.first, w.second);
+		data->wedges[num++] = w;
+	}
+	data->wedges.resize(num);
+	std::sort(data->wedges.begin(), data->wedges.end());
+
+	std::vector<vertex_id_t> &reqs = tprog.get_req_buf();
+	reqs.clear();
+	for (size_t i = 0; i < data->wedges.size(); i++)
+		if (reqs.empty() || reqs.back() != data->wedges[i].first)
+			reqs.push_back(data->wedges[i].first);
+	data->num_pending = reqs.size();
+	if (reqs.empty())
+		complete(prog);
+	else
+		request_vertices(reqs.data(), reqs.size());
+}
+
+void approx_triangle_vertex::run_on_neighbor(vertex_program &prog,
+		const page_vertex &vertex)
+{
+	assert(data);
+	std::pair<std::vector<wedge_t>::const_iterator,
+		std::vector<wedge_t>::const_iterator> range = std::equal_range(
+				data->wedges.cbegin(), data->wedges.cend(),
+				wedge_t(vertex.get_id(), 0), wedge_first_less());
+	edge_iterator begin = vertex.get_neigh_begin(edge_type::OUT_EDGE);
+	edge_iterator end = vertex.get_neigh_end(edge_type::OUT_EDGE);
+	for (std::vector<wedge_t>::const_iterator it = range.first;
+			it != range.second; it++) {
+		if (std::binary_search(begin, end, it->second))
+			data->num_closed++;
+	}
+	data->num_pending--;
+	if (data->num_pending == 0)
+		complete(prog);
+}
+
+void approx_triangle_vertex::complete(vertex_program &prog)
+{
+	((approx_triangle_vertex_program &) prog).add_result(data->num_sampled,
+			data->num_closed);
+	if (!global_estimate)
+		cc_col->get(prog, *this) = ((float) data->num_closed) / data->num_sampled;
+	delete data;
+	data = NULL;
+}
+
+/*
+ * Assign the samples to the vertices. Each wedge in the graph is sampled
+ * with the same probability, so a vertex gets samples in proportion to
+ * the number of wedges centered at it.
+ */
+class sample_assigner
+{
+	// Vertices are processed in blocks. This is the number of wedges
+	// before each block.
+	std::vector<size_t> block_offs;
+	size_t block_size;
+	size_t num_vertices;
+	graph_engine &graph;
+public:
+	sample_assigner(graph_engine &_graph, size_t block_size): graph(_graph) {
+		this->block_size = block_size;
+		num_vertices = graph.get_num_vertices();
+		size_t num_blocks = ceil(((double) num_vertices) / block_size);
+		block_offs.resize(num_blocks + 1);
+		block_offs[0] = 0;
+#pragma omp parallel for
+		for (size_t i = 0; i < num_blocks; i++) {
+			size_t end = std::min((i + 1) * block_size, num_vertices);
+			size_t num_wedges = 0;
+			for (size_t id = i * block_size; id < end; id++)
+				num_wedges += get_num_wedges(graph.get_num_edges(id,
+							edge_type::OUT_EDGE));
+			block_offs[i + 1] = num_wedges;
+		}
+		for (size_t i = 0; i < num_blocks; i++)
+			block_offs[i + 1] += block_offs[i];
+	}
+
+	size_t get_total_wedges() const {
+		return block_offs.back();
+	}
+
+	/*
+	 * The positions of the samples are sorted. It returns the vertices
+	 * that get samples.
+	 */
+	void assign(const std::vector<size_t> &poss, std::vector<vertex_id_t> &ids) {
+		size_t num_blocks = block_offs.size() - 1;
+		std::vector<std::vector<vertex_id_t> > block_ids(num_blocks);
+#pragma omp parallel for
+		for (size_t i = 0; i < num_blocks; i++) {
+			std::vector<size_t>::const_iterator it = std::lower_bound(
+					poss.begin(), poss.end(), block_offs[i]);
+			std::vector<size_t>::const_iterator end = std::lower_bound(it,
+					poss.end(), block_offs[i + 1]);
+			size_t off = block_offs[i];
+			size_t id_end = std::min((i + 1) * block_size, num_vertices);
+			for (size_t id = i * block_size; id < id_end && it != end; id++) {
+				off += get_num_wedges(graph.get_num_edges(id,
+							edge_type::OUT_EDGE));
+				uint32_t num = 0;
+				for (; it != end && *it < off; it++)
+					num++;
+				if (num > 0) {
+					sample_col->get(id) = num;
+					block_ids[i].push_back(id);
+				}
+			}
+		}
+		ids.clear();
+		for (size_t i = 0; i < num_blocks; i++)
+			ids.insert(ids.end(), block_ids[i].begin(), block_ids[i].end());
+	}
+};
+
+void run_sampling(graph_engine::ptr graph, const std::vector<vertex_id_t> &ids,
+		size_t &num_sampled, size_t &num_closed)
+{
+	if (ids.empty())
+		graph->start_all(vertex_initializer::ptr(), vertex_program_creater::ptr(
+					new approx_triangle_vertex_program_creater()));
+	else
+		graph->start(ids.data(), ids.size(), vertex_initializer::ptr(),
+				vertex_program_creater::ptr(
+					new approx_triangle_vertex_program_creater()));
+	graph->wait4complete();
+
+	std::vector<vertex_program::ptr> progs;
+	graph->get_vertex_programs(progs);
+	num_sampled = 0;
+	num_closed = 0;
+	BOOST_FOREACH(vertex_program::ptr vprog, progs) {
+		approx_triangle_vertex_program::ptr tprog
+			= approx_triangle_vertex_program::cast2(vprog);
+		num_sampled += tprog->get_num_sampled();
+		num_closed += tprog->get_num_closed();
+	}
+}
+
+}
+
+namespace fg
+{
+
+triangle_estimate estimate_triangles(FG_graph::ptr fg, double error,
+		double confidence)
+{
+	triangle_estimate est;
+	memset(&est, 0, sizeof(est));
+	if (fg->get_graph_header().is_directed_graph()) {
+		BOOST_LOG_TRIVIAL(error)
+			<< "This algorithm estimates triangles in an undirected graph";
+		return est;
+	}
+	if (error <= 0 || confidence <= 0 || confidence >= 1)
+		throw invalid_arg_exception(
+				"the error has to be positive and the confidence has to be in (0, 1)");
+
+	BOOST_LOG_TRIVIAL(info) << "triangle estimation starts";
+	graph_index::ptr index = NUMA_graph_index<approx_triangle_vertex>::create(
+			fg->get_graph_header());
+	graph_engine::ptr graph = fg->create_engine(index);
+
+	struct timeval start, end;
+	gettimeofday(&start, NULL);
+	global_estimate = true;
+	// The random generators are seeded with random(), so the estimate
+	// is reproducible with srandom().
+	sample_seed = random();
+	sample_col = vertex_column<uint32_t>::create(*graph, 0);
+	sample_assigner assigner(*graph, 4096);
+	size_t num_wedges = assigner.get_total_wedges();
+
+	// By the Hoeffding bound, the fraction of closed wedges in this many
+	// samples is within `error' of the clustering coefficient with
+	// the probability of `confidence'.
+	size_t num_samples = ceil(log(2 / (1 - confidence)) / (2 * error * error));
+	std::vector<size_t> poss;
+	if (num_wedges > 0) {
+		poss.resize(num_samples);
+		std::mt19937_64 gen(random());
+		std::uniform_int_distribution<size_t> dist(0, num_wedges - 1);
+		for (size_t i = 0; i < num_samples; i++)
+			poss[i] = dist(gen);
+		std::sort(poss.begin(), poss.end());
+	}
+	std::vector<vertex_id_t> ids;
+	assigner.assign(poss, ids);
+
+	size_t num_sampled = 0;
+	size_t num_closed = 0;
+	if (!ids.empty())
+		run_sampling(graph, ids, num_sampled, num_closed);
+	assert(num_sampled == poss.size());
+	sample_col.reset();
+	gettimeofday(&end, NULL);
+
+	est.num_wedges = num_wedges;
+	est.num_samples = num_sampled;
+	est.confidence = confidence;
+	est.error = error;
+	if (num_sampled > 0) {
+		est.clustering_coeff = ((double) num_closed) / num_sampled;
+		est.num_triangles = est.clustering_coeff * num_wedges / 3;
+	}
+	BOOST_LOG_TRIVIAL(info) << boost::format(
+			"It takes %1% seconds to sample %2% wedges at %3% vertices")
+		% time_diff(start, end) % num_sampled % ids.size();
+	BOOST_LOG_TRIVIAL(info) << boost::format(
+			"There are about %1% (+-%2%) triangles, clustering coefficient: %3%")
+		% est.num_triangles % (error * num_wedges / 3) % est.clustering_coeff;
+	return est;
+}
+
+FG_vector<float>::ptr estimate_local_clustering(FG_graph::ptr fg,
+		size_t max_samples)
+{
+	if (fg->get_graph_header().is_directed_graph()) {
+		BOOST_LOG_TRIVIAL(error)
+			<< "This algorithm estimates triangles in an undirected graph";
+		return FG_vector<float>::ptr();
+	}
+	if (max_samples == 0)
+		throw invalid_arg_exception("the number of samples has to be positive");
+
+	BOOST_LOG_TRIVIAL(info) << "local clustering coefficient estimation starts";
+	graph_index::ptr index = NUMA_graph_index<approx_triangle_vertex>::create(
+			fg->get_graph_header());
+	graph_engine::ptr graph = fg->create_engine(index);
+
+	struct timeval start, end;
+	gettimeofday(&start, NULL);
+	global_estimate = false;
+	max_local_samples = max_samples;
+	sample_seed = random();
+	cc_col = vertex_column<float>::create(*graph, 0);
+	size_t num_sampled = 0;
+	size_t num_closed = 0;
+	run_sampling(graph, std::vector<vertex_id_t>(), num_sampled, num_closed);
+	gettimeofday(&end, NULL);
+	BOOST_LOG_TRIVIAL(info) << boost::format(
+			"It takes %1% seconds to sample %2% wedges, %3% of them are closed")
+		% time_diff(start, end) % num_sampled % num_closed;
+
+	FG_vector<float>::ptr ret = cc_col->to_vector();
+	cc_col.reset();
+	return ret;
+}
+
+}
@@ -26,6 +26,7 @@
 
 #include "graph_engine.h"
 #include "graph_config.h"
+#include "vertex_state.h"
 #include "FGlib.h"
 
 using namespace safs;
@@ -35,28 +36,29 @@ namespace
 {
 
 edge_type traverse_edge = edge_type::OUT_EDGE;
+// The visited flags of vertices are stored in a column, so the vertex
+// objects don't have state.
+vertex_column<bool>::ptr visited_col;
 
 /*
  * Vertex program for BFS on a directed graph.
  */
 class bfs_dvertex: public compute_directed_vertex
 {
-	bool visited;
 public:
 	bfs_dvertex(vertex_id_t id): compute_directed_vertex(id) {
-		visited = false;
 	}
 
-	bool has_visited() const {
-		return visited;
+	bool has_visited(const vertex_program &prog) const {
+		return visited_col->get(prog, *this);
 	}
 
-	void set_visited(bool visited) {
-		this->visited = visited;
+	void set_visited(const vertex_program &prog, bool visited) {
+		visited_col->get(prog, *this) = visited;
 	}
 
 	void run(vertex_program &prog) {
-		if (!has_visited()) {
+		if (!has_visited(prog)) {
 			directed_vertex_request req(prog.get_vertex_id(*this),
 					traverse_edge);
 			request_partial_vertices(&req, 1);
@@ -71,8 +73,8 @@ public:
 
 void bfs_dvertex::run(vertex_program &prog, const page_vertex &vertex)
 {
-	assert(!has_visited());
-	set_visited(true);
+	assert(!has_visited(prog));
+	set_visited(prog, true);
 
 	int num_dests = vertex.get_num_edges(traverse_edge);
 	if (num_dests == 0)
@@ -99,18 +101,16 @@ void bfs_dvertex::run(vertex_program &prog, const page_vertex &vertex)
  */
 class bfs_uvertex: public compute_vertex
 {
-	bool visited;
 public:
 	bfs_uvertex(vertex_id_t id): compute_vertex(id) {
-		visited = false;
 	}
 
-	bool has_visited() const {
-		return visited;
+	bool has_visited(const vertex_program &prog) const {
+		return visited_col->get(prog, *this);
 	}
 
 	void run(vertex_program &prog) {
-		if (!has_visited()) {
+		if (!has_visited(prog)) {
 			vertex_id_t id = prog.get_vertex_id(*this);
 			request_vertices(&id, 1);
 		}
@@ -124,8 +124,8 @@ public:
 
 void bfs_uvertex::run(vertex_program &prog, const page_vertex &vertex)
 {
-	assert(!has_visited());
-	visited = true;
+	assert(!has_visited(prog));
+	visited_col->get(prog, *this) = true;
 
 	int num_dests = vertex.get_num_edges(edge_type::BOTH_EDGES);
 	if (num_dests == 0)
@@ -143,35 +143,6 @@ void bfs_uvertex::run(vertex_program &prog, const page_vertex &vertex)
 #endif
 }
 
-template<class vertex_type>
-class count_vertex_query: public vertex_query
-{
-	size_t num_visited;
-public:
-	count_vertex_query() {
-		num_visited = 0;
-	}
-
-	virtual void run(graph_engine &graph, compute_vertex &v) {
-		vertex_type &bfs_v = (vertex_type &) v;
-		if (bfs_v.has_visited())
-			num_visited++;
-	}
-
-	virtual void merge(graph_engine &graph, vertex_query::ptr q) {
-		count_vertex_query *cvq = (count_vertex_query *) q.get();
-		num_visited += cvq->num_visited;
-	}
-
-	virtual ptr clone() {
-		return vertex_query::ptr(new count_vertex_query());
-	}
-
-	size_t get_num_visited() const {
-		return num_visited;
-	}
-};
-
 }
 
 size_t bfs(FG_graph::ptr fg, vertex_id_t start_vertex, edge_type traverse_e)
@@ -185,6 +156,7 @@ size_t bfs(FG_graph::ptr fg, vertex_id_t start_vertex, edge_type traverse_e)
 	graph_engine::ptr graph = fg->create_engine(index);
 
 	traverse_edge = traverse_e;
+	visited_col = vertex_column<bool>::create(*graph, false);
 	printf("BFS starts\n");
 #ifdef PROFILER
 	if (!graph_conf.get_prof_file().empty())
@@ -194,18 +166,8 @@ size_t bfs(FG_graph::ptr fg, vertex_id_t start_vertex, edge_type traverse_e)
 	graph->start(&start_vertex, 1);
 	graph->wait4complete();
 
-	size_t num_visited;
-	vertex_query::ptr cvq;
-	if (directed) {
-		cvq = vertex_query::ptr(new count_vertex_query<bfs_dvertex>());
-		graph->query_on_all(cvq);
-		num_visited = ((count_vertex_query<bfs_dvertex> *) cvq.get())->get_num_visited();
-	}
-	else {
-		cvq = vertex_query::ptr(new count_vertex_query<bfs_uvertex>());
-		graph->query_on_all(cvq);
-		num_visited = ((count_vertex_query<bfs_uvertex> *) cvq.get())->get_num_visited();
-	}
+	size_t num_visited = visited_col->count(true);
+	visited_col.reset();
 
 #ifdef PROFILER
 	if (!graph_conf.get_prof_file().empty())
@@ -0,0 +1,720 @@
+/*
+ * Copyright 2014 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of FlashGraph.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <limits>
+#include <vector>
+#include <algorithm>
+
+#include <boost/foreach.hpp>
+#include <boost/format.hpp>
+
+#include "io_interface.h"
+#include "safs_file.h"
+#include "concurrency.h"
+
+#include "graph_engine.h"
+#include "graph_config.h"
+#include "graph.h"
+#include "in_mem_storage.h"
+#include "vertex_index.h"
+#include "vertex_state.h"
+#include "FGlib.h"
+
+using namespace fg;
+
+namespace {
+
+enum community_stage_t
+{
+	LABEL_PROP,
+	// Compute the weighted degree of vertices in a coarsened graph.
+	DEGREE,
+	// Move vertices to the neighbor communities that increase
+	// the modularity most.
+	MOVE,
+	// Collect the edges between communities for the coarsened graph.
+	COARSEN,
+};
+
+community_stage_t stage;
+int max_num_iters;
+// The graph of the first level is unweighted. In a coarsened graph,
+// the weight of an edge is stored in the edge data.
+bool weighted;
+bool directed;
+
+// The community of a vertex. A community is identified by one of
+// the vertices in the graph of the current level.
+vertex_column<vertex_id_t>::ptr comm_col;
+// The weighted degree of a vertex.
+vertex_column<long>::ptr degree_col;
+// The total degree and the number of vertices of a community.
+vertex_column<atomic_number<long> >::ptr tot_col;
+vertex_column<atomic_number<long> >::ptr size_col;
+// The sum of the weighted degree of all vertices.
+double total_weight;
+// This maps a community to a vertex in the coarsened graph.
+std::vector<vertex_id_t> comm_map;
+
+typedef std::pair<vertex_id_t, long> neighbor_t;
+
+struct coarse_edge
+{
+	vertex_id_t from;
+	vertex_id_t to;
+	long weight;
+
+	coarse_edge(vertex_id_t from, vertex_id_t to, long weight) {
+		this->from = from;
+		this->to = to;
+		this->weight = weight;
+	}
+
+	bool operator<(const coarse_edge &e) const {
+		if (from != e.from)
+			return from < e.from;
+		else
+			return to < e.to;
+	}
+};
+
+/*
+ * Sort the edges and merge the weights of the edges that connect
+ * the same pair of communities.
+ */
+void merge_edges(std::vector<coarse_edge> &edges)
+{
+	if (edges.empty())
+		return;
+	std::sort(edges.begin(), edges.end());
+	size_t num = 1;
+	for (size_t i = 1; i < edges.size(); i++) {
+		coarse_edge &last = edges[num - 1];
+		if (last.from == edges[i].from && last.to == edges[i].to)
+			last.weight += edges[i].weight;
+		else
+			edges[num++] = edges[i];
+	}
+	edges.resize(num, coarse_edge(0, 0, 0));
+}
+
+bool neigh_less(const neighbor_t &n1, const neighbor_t &n2)
+{
+	return n1.first < n2.first;
+}
+
+/*
+ * Sort the neighbors and merge the weights of the same neighbor.
+ */
+void merge_neighbors(std::vector<neighbor_t> &neighs)
+{
+	if (neighs.empty())
+		return;
+	std::sort(neighs.begin(), neighs.end(), neigh_less);
+	size_t num = 1;
+	for (size_t i = 1; i < neighs.size(); i++) {
+		if (neighs[num - 1].first == neighs[i].first)
+			neighs[num - 1].second += neighs[i].second;
+		else
+			neighs[num++] = neighs[i];
+	}
+	neighs.resize(num);
+}
+
+void add_neighbors(const page_vertex &vertex, edge_type type,
+		std::vector<neighbor_t> &neighs)
+{
+	edge_seq_iterator it = vertex.get_neigh_seq_it(type);
+	if (!weighted) {
+		while (it.has_next())
+			neighs.push_back(neighbor_t(it.next(), 1));
+		return;
+	}
+
+	// A coarsened graph is always undirected.
+	assert(!directed);
+	safs::page_byte_array::seq_const_iterator<edge_count> data_it
+		= ((const page_undirected_vertex &) vertex).get_data_seq_it<edge_count>();
+	while (it.has_next())
+		neighs.push_back(neighbor_t(it.next(), data_it.next().get_count()));
+}
+
+/*
+ * Get the neighbors of a vertex and the weights of the edges.
+ * The edges in a directed graph are considered as undirected.
+ */
+void get_neighbors(const page_vertex &vertex, std::vector<neighbor_t> &neighs)
+{
+	neighs.clear();
+	if (directed) {
+		add_neighbors(vertex, IN_EDGE, neighs);
+		add_neighbors(vertex, OUT_EDGE, neighs);
+	}
+	else
+		add_neighbors(vertex, OUT_EDGE, neighs);
+}
+
+void activate_neighbors(vertex_program &prog, const page_vertex &vertex)
+{
+	if (directed) {
+		edge_seq_iterator it = vertex.get_neigh_seq_it(IN_EDGE);
+		prog.activate_vertices(it);
+		it = vertex.get_neigh_seq_it(OUT_EDGE);
+		prog.activate_vertices(it);
+	}
+	else {
+		edge_seq_iterator it = vertex.get_neigh_seq_it(OUT_EDGE);
+		prog.activate_vertices(it);
+	}
+}
+
+class community_vertex: public compute_vertex
+{
+	void run_label_prop(vertex_program &prog, const page_vertex &vertex);
+	void run_degree(vertex_program &prog, const page_vertex &vertex);
+	void run_move(vertex_program &prog, const page_vertex &vertex);
+	void run_coarsen(vertex_program &prog, const page_vertex &vertex);
+public:
+	community_vertex(vertex_id_t id): compute_vertex(id) {
+	}
+
+	void run(vertex_program &prog) {
+		vertex_id_t id = prog.get_vertex_id(*this);
+		request_vertices(&id, 1);
+	}
+
+	void run(vertex_program &prog, const page_vertex &vertex) {
+		switch (stage) {
+			case LABEL_PROP:
+				run_label_prop(prog, vertex);
+				break;
+			case DEGREE:
+				run_degree(prog, vertex);
+				break;
+			case MOVE:
+				run_move(prog, vertex);
+				break;
+			case COARSEN:
+				run_coarsen(prog, vertex);
+				break;
+			default:
+				ABORT_MSG("wrong community stage");
+		}
+	}
+
+	void run_on_message(vertex_program &prog, const vertex_message &msg) {
+	}
+};
+
+class community_vertex_program: public vertex_program_impl<community_vertex>
+{
+	// The thread-local buffer for the neighbors of a vertex.
+	std::vector<neighbor_t> neighs;
+	size_t num_moves;
+	long weight_sum;
+	// The edges between communities collected in the COARSEN stage.
+	std::vector<coarse_edge> edges;
+	// The number of edges after the last merge.
+	size_t num_merged_edges;
+public:
+	typedef std::shared_ptr<community_vertex_program> ptr;
+
+	static ptr cast2(vertex_program::ptr prog) {
+		return std::static_pointer_cast<community_vertex_program,
+			   vertex_program>(prog);
+	}
+
+	community_vertex_program() {
+		num_moves = 0;
+		weight_sum = 0;
+		num_merged_edges = 0;
+	}
+
+	std::vector<neighbor_t> &get_neigh_buf() {
+		return neighs;
+	}
+
+	void inc_moves() {
+		num_moves++;
+	}
+
+	size_t get_num_moves() const {
+		return num_moves;
+	}
+
+	void add_weight(long weight) {
+		weight_sum += weight;
+	}
+
+	long get_weight_sum() const {
+		return weight_sum;
+	}
+
+	void add_edges(vertex_id_t from, const std::vector<neighbor_t> &neighs) {
+		for (size_t i = 0; i < neighs.size(); i++)
+			edges.push_back(coarse_edge(from, neighs[i].first,
+						neighs[i].second));
+		// The vertices of a community are usually processed by the same
+		// thread, so merging the edges periodically keeps the buffer small.
+		if (edges.size() >= std::max(num_merged_edges * 2, 1024UL * 1024)) {
+			merge_edges(edges);
+			num_merged_edges = edges.size();
+		}
+	}
+
+	std::vector<coarse_edge> &get_edges() {
+		return edges;
+	}
+};
+
+class community_vertex_program_creater: public vertex_program_creater
+{
+public:
+	vertex_program::ptr create() const {
+		return vertex_program::ptr(new community_vertex_program());
+	}
+};
+
+void community_vertex::run_label_prop(vertex_program &prog,
+		const page_vertex &vertex)
+{
+	vertex_id_t id = prog.get_vertex_id(*this);
+	std::vector<neighbor_t> &neighs
+		= ((community_vertex_program &) prog).get_neigh_buf();
+	get_neighbors(vertex, neighs);
+	size_t num = 0;
+	for (size_t i = 0; i < neighs.size(); i++) {
+		if (neighs[i].first != id)
+			neighs[num++] = neighbor_t(comm_col->get(neighs[i].first),
+					neighs[i].second);
+	}
+	neighs.resize(num);
+	if (neighs.empty())
+		return;
+	merge_neighbors(neighs);
+
+	// Adopt the most frequent label among the neighbors. If there is a tie,
+	// keep the current label if it's one of them. Otherwise, choose the
+	// smallest one, so the result doesn't depend on the order of edges.
+	vertex_id_t &label = comm_col->get(prog, *this);
+	vertex_id_t best = neighs[0].first;
+	long best_weight = neighs[0].second;
+	for (size_t i = 1; i < neighs.size(); i++) {
+		if (neighs[i].second > best_weight || (neighs[i].second == best_weight
+					&& neighs[i].first == label)) {
+			best = neighs[i].first;
+			best_weight = neighs[i].second;
+		}
+	}
+	if (best == label)
+		return;
+
+	label = best;
+	((community_vertex_program &) prog).inc_moves();
+	if (prog.get_graph().get_curr_level() + 1
+			< prog.get_graph().get_max_num_iters())
+		activate_neighbors(prog, vertex);
+}
+
+void community_vertex::run_degree(vertex_program &prog,
+		const page_vertex &vertex)
+{
+	std::vector<neighbor_t> &neighs
+		= ((community_vertex_program &) prog).get_neigh_buf();
+	get_neighbors(vertex, neighs);
+	long degree = 0;
+	for (size_t i = 0; i < neighs.size(); i++)
+		degree += neighs[i].second;
+	degree_col->get(prog, *this) = degree;
+}
+
+void community_vertex::run_move(vertex_program &prog,
+		const page_vertex &vertex)
+{
+	long degree = degree_col->get(prog, *this);
+	if (degree == 0)
+		return;
+
+	vertex_id_t id = prog.get_vertex_id(*this);
+	std::vector<neighbor_t> &neighs
+		= ((community_vertex_program &) prog).get_neigh_buf();
+	get_neighbors(vertex, neighs);
+	// The self-loop moves with the vertex, so it doesn't affect the gain.
+	size_t num = 0;
+	for (size_t i = 0; i < neighs.size(); i++) {
+		if (neighs[i].first != id)
+			neighs[num++] = neighbor_t(comm_col->get(neighs[i].first),
+					neighs[i].second);
+	}
+	neighs.resize(num);
+	merge_neighbors(neighs);
+
+	vertex_id_t &comm = comm_col->get(prog, *this);
+	vertex_id_t curr = comm;
+	long curr_weight = 0;
+	for (size_t i = 0; i < neighs.size(); i++) {
+		if (neighs[i].first == curr) {
+			curr_weight = neighs[i].second;
+			break;
+		}
+	}
+
+	// The modularity gain of moving the vertex to community c is
+	// proportional to k_i,c - tot_c * k_i / 2m. The vertex itself is
+	// removed from its current community first.
+	double scale = degree / total_weight;
+	double best_gain = curr_weight
+		- (tot_col->get(curr).get() - degree) * scale;
+	vertex_id_t best = curr;
+	for (size_t i = 0; i < neighs.size(); i++) {
+		vertex_id_t c = neighs[i].first;
+		if (c == curr)
+			continue;
+		double gain = neighs[i].second - tot_col->get(c).get() * scale;
+		if (gain > best_gain) {
+			best = c;
+			best_gain = gain;
+		}
+	}
+	if (best == curr)
+		return;
+	// Two vertices that are alone in their communities may move to each
+	// other's community at the same time. We only allow a singleton to
+	// join another singleton with a smaller ID to break the cycle.
+	if (size_col->get(curr).get() == 1 && size_col->get(best).get() == 1
+			&& best > curr)
+		return;
+
+	tot_col->get(curr).dec(degree);
+	tot_col->get(best).inc(degree);
+	size_col->get(curr).dec(1);
+	size_col->get(best).inc(1);
+	comm = best;
+	((community_vertex_program &) prog).inc_moves();
+	if (prog.get_graph().get_curr_level() + 1
+			< prog.get_graph().get_max_num_iters())
+		activate_neighbors(prog, vertex);
+}
+
+void community_vertex::run_coarsen(vertex_program &prog,
+		const page_vertex &vertex)
+{
+	community_vertex_program &cprog = (community_vertex_program &) prog;
+	vertex_id_t comm = comm_map[comm_col->get(prog, *this)];
+	std::vector<neighbor_t> &neighs = cprog.get_neigh_buf();
+	get_neighbors(vertex, neighs);
+	for (size_t i = 0; i < neighs.size(); i++)
+		neighs[i].first = comm_map[comm_col->get(neighs[i].first)];
+	merge_neighbors(neighs);
+	// The edges inside a community become a self-loop in the coarsened
+	// graph. They are counted from both ends of the edges, in the same way
+	// as the degree of vertices.
+	for (size_t i = 0; i < neighs.size(); i++) {
+		if (neighs[i].first == comm)
+			cprog.add_weight(neighs[i].second);
+	}
+	cprog.add_edges(comm, neighs);
+}
+
+class init_own_id
+{
+public:
+	void operator()(vertex_id_t id, vertex_id_t &comm) {
+		comm = id;
+	}
+};
+
+class init_degree
+{
+	graph_engine &graph;
+	edge_type type;
+public:
+	init_degree(graph_engine &_graph): graph(_graph) {
+		type = graph.is_directed() ? BOTH_EDGES : OUT_EDGE;
+	}
+
+	void operator()(vertex_id_t id, long &degree) {
+		degree = graph.get_num_edges(id, type);
+	}
+};
+
+class init_comm_degree
+{
+public:
+	void operator()(vertex_id_t id, atomic_number<long> &tot) {
+		tot = atomic_number<long>(degree_col->get(id));
+	}
+};
+
+void run_stage(graph_engine::ptr graph, community_stage_t stage,
+		std::vector<vertex_program::ptr> &progs)
+{
+	::stage = stage;
+	// Label propagation and moving vertices are performed for
+	// at most `max_num_iters' iterations.
+	if (stage == LABEL_PROP || stage == MOVE)
+		graph->set_max_num_iters(max_num_iters);
+	else
+		graph->set_max_num_iters(std::numeric_limits<int>::max());
+	graph->start_all(vertex_initializer::ptr(), vertex_program_creater::ptr(
+				new community_vertex_program_creater()));
+	graph->wait4complete();
+	progs.clear();
+	graph->get_vertex_programs(progs);
+}
+
+size_t get_num_moves(const std::vector<vertex_program::ptr> &progs)
+{
+	size_t num_moves = 0;
+	BOOST_FOREACH(vertex_program::ptr vprog, progs)
+		num_moves += community_vertex_program::cast2(vprog)->get_num_moves();
+	return num_moves;
+}
+
+/*
+ * Construct the coarsened graph. Each community becomes a vertex and
+ * the edges between two communities are merged into a weighted edge.
+ */
+in_mem_subgraph::ptr build_coarse_graph(
+		const std::vector<vertex_program::ptr> &progs, size_t num_comms)
+{
+	std::vector<coarse_edge> edges;
+	BOOST_FOREACH(vertex_program::ptr vprog, progs) {
+		std::vector<coarse_edge> &local
+			= community_vertex_program::cast2(vprog)->get_edges();
+		merge_edges(local);
+		edges.insert(edges.end(), local.begin(), local.end());
+		local = std::vector<coarse_edge>();
+	}
+	merge_edges(edges);
+
+	in_mem_subgraph::ptr subg = in_mem_undirected_subgraph<edge_count>::create(
+			true);
+	size_t idx = 0;
+	for (vertex_id_t comm = 0; comm < num_comms; comm++) {
+		in_mem_undirected_vertex<edge_count> v(comm, true);
+		for (; idx < edges.size() && edges[idx].from == comm; idx++) {
+			if (edges[idx].weight > std::numeric_limits<uint32_t>::max())
+				throw unsupported_exception(
+						"the edge weight in a coarsened graph overflows");
+			v.add_edge(edge<edge_count>(comm, edges[idx].to,
+						edge_count(edges[idx].weight)));
+		}
+		subg->add_vertex(v);
+	}
+	assert(idx == edges.size());
+	return subg;
+}
+
+/*
+ * Write the coarsened graph to SAFS and open it as a semi-external graph.
+ * The files get unique temporary names, so we never touch the files of
+ * other graphs. The caller deletes the files when the graph isn't used.
+ * If SAFS isn't available, the coarsened graph stays in memory.
+ */
+FG_graph::ptr store_coarse_graph(in_mem_subgraph::ptr subg,
+		const std::string &name, config_map::ptr configs,
+		std::vector<std::string> &safs_files)
+{
+	std::pair<in_mem_graph::ptr, vertex_index::ptr> ret
+		= subg->serialize(name, false);
+	if (!safs::is_safs_init())
+		return FG_graph::create(ret.first, ret.second, name, configs);
+
+	const size_t MAX_TRIES = 10;
+	std::string adj_file;
+	std::string index_file;
+	size_t i;
+	for (i = 0; i < MAX_TRIES; i++) {
+		std::string tmp_name = name + "-" + gen_rand_name(8);
+		adj_file = tmp_name + ".adj";
+		index_file = tmp_name + ".index";
+		safs::safs_file adj_f(safs::get_sys_RAID_conf(), adj_file);
+		safs::safs_file index_f(safs::get_sys_RAID_conf(), index_file);
+		if (!adj_f.exist() && !index_f.exist())
+			break;
+	}
+	if (i == MAX_TRIES)
+		throw safs::io_exception(
+				"can't create a temp name for the coarsened graph");
+
+	ret.first->dump_safs(adj_file);
+	safs_files.push_back(adj_file);
+	ret.second->safs_dump(index_file);
+	safs_files.push_back(index_file);
+	return FG_graph::create(adj_file, index_file, configs);
+}
+
+}
+
+namespace fg
+{
+
+FG_vector<vertex_id_t>::ptr compute_label_propagation(FG_graph::ptr fg,
+		int max_iters)
+{
+	graph_index::ptr index = NUMA_graph_index<community_vertex>::create(
+			fg->get_graph_header());
+	graph_engine::ptr graph = fg->create_engine(index);
+	directed = graph->is_directed();
+	weighted = false;
+	max_num_iters = max_iters;
+
+	BOOST_LOG_TRIVIAL(info) << "label propagation starts";
+	struct timeval start, end;
+	gettimeofday(&start, NULL);
+
+	comm_col = vertex_column<vertex_id_t>::create(*graph);
+	comm_col->for_each(init_own_id());
+	std::vector<vertex_program::ptr> progs;
+	run_stage(graph, LABEL_PROP, progs);
+
+	gettimeofday(&end, NULL);
+	BOOST_LOG_TRIVIAL(info) << boost::format(
+			"label propagation takes %1% seconds in %2% iterations and changes labels %3% times")
+		% time_diff(start, end) % graph->get_curr_level() % get_num_moves(progs);
+
+	FG_vector<vertex_id_t>::ptr ret = comm_col->to_vector();
+	comm_col.reset();
+	return ret;
+}
+
+FG_vector<vertex_id_t>::ptr compute_parallel_louvain(FG_graph::ptr fg,
+		int max_levels, int max_iters)
+{
+	max_num_iters = max_iters;
+	size_t num_orig_vertices = fg->get_graph_header().get_num_vertices();
+	// The community of the original vertices.
+	FG_vector<vertex_id_t>::ptr membership = FG_vector<vertex_id_t>::create(
+			num_orig_vertices);
+	vertex_id_t *members = membership->get_data();
+#pragma omp parallel for
+	for (size_t i = 0; i < num_orig_vertices; i++)
+		members[i] = i;
+
+	BOOST_LOG_TRIVIAL(info) << "parallel Louvain starts";
+	struct timeval start, end;
+	gettimeofday(&start, NULL);
+
+	FG_graph::ptr level_fg = fg;
+	std::vector<std::string> safs_files;
+	for (int level = 0; level < max_levels; level++) {
+		graph_index::ptr index = NUMA_graph_index<community_vertex>::create(
+				level_fg->get_graph_header());
+		graph_engine::ptr graph = level_fg->create_engine(index);
+		directed = graph->is_directed();
+		weighted = level > 0;
+		size_t num_vertices = graph->get_num_vertices();
+		std::vector<vertex_program::ptr> progs;
+
+		degree_col = vertex_column<long>::create(*graph, 0);
+		if (weighted)
+			run_stage(graph, DEGREE, progs);
+		else
+			degree_col->for_each(init_degree(*graph));
+		long weight = 0;
+#pragma omp parallel for reduction(+:weight)
+		for (size_t i = 0; i < num_vertices; i++)
+			weight += degree_col->get(i);
+		total_weight = weight;
+		if (weight == 0)
+			break;
+
+		comm_col = vertex_column<vertex_id_t>::create(*graph);
+		comm_col->for_each(init_own_id());
+		tot_col = vertex_column<atomic_number<long> >::create(*graph);
+		tot_col->for_each(init_comm_degree());
+		size_col = vertex_column<atomic_number<long> >::create(*graph,
+				atomic_number<long>(1));
+		run_stage(graph, MOVE, progs);
+		size_t num_moves = get_num_moves(progs);
+		BOOST_LOG_TRIVIAL(info) << boost::format(
+				"level %1%: %2% vertices, %3% moves in %4% iterations")
+			% level % num_vertices % num_moves % graph->get_curr_level();
+		if (num_moves == 0)
+			break;
+
+		// Number the communities contiguously.
+		FG_vector<vertex_id_t>::ptr comms = comm_col->to_vector();
+		comm_map.assign(num_vertices, INVALID_VERTEX_ID);
+		for (size_t i = 0; i < num_vertices; i++)
+			comm_map[comms->get(i)] = 0;
+		size_t num_comms = 0;
+		for (size_t i = 0; i < num_vertices; i++)
+			if (comm_map[i] != INVALID_VERTEX_ID)
+				comm_map[i] = num_comms++;
+#pragma omp parallel for
+		for (size_t i = 0; i < num_orig_vertices; i++)
+			members[i] = comm_map[comms->get(members[i])];
+		if (level + 1 == max_levels)
+			break;
+
+		run_stage(graph, COARSEN, progs);
+		long internal = 0;
+		BOOST_FOREACH(vertex_program::ptr vprog, progs)
+			internal += community_vertex_program::cast2(vprog)->get_weight_sum();
+		double tot_sq = 0;
+#pragma omp parallel for reduction(+:tot_sq)
+		for (size_t i = 0; i < num_vertices; i++) {
+			if (comm_map[i] != INVALID_VERTEX_ID) {
+				double tot = tot_col->get(i).get() / total_weight;
+				tot_sq += tot * tot;
+			}
+		}
+		BOOST_LOG_TRIVIAL(info) << boost::format(
+				"level %1%: %2% communities, modularity: %3%")
+			% level % num_comms % (internal / total_weight - tot_sq);
+
+		in_mem_subgraph::ptr subg = build_coarse_graph(progs, num_comms);
+		// Release the engine of this level before we open the coarsened
+		// graph.
+		progs.clear();
+		comm_col.reset();
+		degree_col.reset();
+		tot_col.reset();
+		size_col.reset();
+		graph.reset();
+		std::vector<std::string> prev_files = safs_files;
+		safs_files.clear();
+		level_fg = store_coarse_graph(subg, boost::str(boost::format(
+							"louvain-level%1%") % (level + 1)),
+				fg->get_configs(), safs_files);
+		BOOST_FOREACH(const std::string &file, prev_files) {
+			safs::safs_file f(safs::get_sys_RAID_conf(), file);
+			f.delete_file();
+		}
+	}
+	comm_col.reset();
+	degree_col.reset();
+	tot_col.reset();
+	size_col.reset();
+	comm_map = std::vector<vertex_id_t>();
+	level_fg.reset();
+	BOOST_FOREACH(const std::string &file, safs_files) {
+		safs::safs_file f(safs::get_sys_RAID_conf(), file);
+		f.delete_file();
+	}
+
+	gettimeofday(&end, NULL);
+	BOOST_LOG_TRIVIAL(info) << boost::format("parallel Louvain takes %1% seconds")
+		% time_diff(start, end);
+	return membership;
+}
+
+}
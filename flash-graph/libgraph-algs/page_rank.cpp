@@ -21,9 +21,13 @@
 #endif
 
 #include <limits>
+#include <algorithm>
+
+#include <boost/foreach.hpp>
 
 #include "graph_engine.h"
 #include "graph_config.h"
+#include "vertex_state.h"
 #include "FGlib.h"
 
 using namespace fg;
@@ -32,40 +36,28 @@ namespace {
 
 float DAMPING_FACTOR = 0.85;
 float TOLERANCE = 1.0E-2; 
-int max_num_iters = INT_MAX;
 
 /*
- * pgrank_vertex needs to be initialized first.
- * Therefore, it has two stages.
+ * pgrank_vertex keeps its state in vertex columns. The columns need to be
+ * created for the graph engine before the algorithm starts.
  * pgrank_vertex2 doesn't need this process.
  */
 enum pr_stage_t
 {
-	INIT,
 	RUN,
+	// Recompute the out-degree of the vertices whose out-edges are updated.
+	DEGREE,
 };
 pr_stage_t pr_stage;
 
+// The pagerank of the current iteration.
+vertex_column<float>::ptr pr_col;
+vertex_column<vsize_t>::ptr out_degree_col;
+
 class pgrank_vertex: public compute_directed_vertex
 {
-  float curr_itr_pr; // Current iteration's page rank
-  vsize_t num_out_edges;
-
 public:
   pgrank_vertex(vertex_id_t id): compute_directed_vertex(id) {
-    this->curr_itr_pr = 1 - DAMPING_FACTOR; // Must be this
-  }
-
-  vsize_t get_num_out_edges() const {
-	  return num_out_edges;
-  }
-
-  float get_curr_itr_pr() const{
-    return curr_itr_pr;
-  }
-
-  float get_result() const {
-	  return get_curr_itr_pr();
   }
 
   void run(vertex_program &prog);
@@ -75,43 +67,95 @@ public:
 	void run_on_message(vertex_program &,
 /* Only serves to activate on the next iteration */
 			const vertex_message &msg) { }; 
-
-	void run_on_vertex_header(vertex_program &prog, const vertex_header &header) {
-		assert(prog.get_vertex_id(*this) == header.get_id());
-		directed_vertex_header &dheader = (directed_vertex_header &) header;
-		this->num_out_edges = dheader.get_num_out_edges();
-	}
 };
 
 void pgrank_vertex::run(vertex_program &prog)
 {
 	vertex_id_t id = prog.get_vertex_id(*this);
-	if (pr_stage == pr_stage_t::INIT) {
-		request_vertex_headers(&id, 1);
+	if (pr_stage == pr_stage_t::RUN)
+		request_vertices(&id, 1); // put my edgelist in page cache
+	else if (pr_stage == pr_stage_t::DEGREE) {
+		directed_vertex_request req(id, edge_type::OUT_EDGE);
+		request_partial_vertices(&req, 1);
+	}
+};
+
+/*
+ * This collects the out-neighbors of the vertices whose out-degree
+ * changes. Their pagerank needs to be recomputed.
+ * The degree of all vertices with updated out-edges is refreshed, but only
+ * the ones in `changed' have a different degree from the last run.
+ */
+class pgrank_degree_vertex_program: public vertex_program_impl<pgrank_vertex>
+{
+	const std::vector<vertex_id_t> &changed;
+	std::vector<vertex_id_t> affected;
+public:
+	typedef std::shared_ptr<pgrank_degree_vertex_program> ptr;
+
+	static ptr cast2(vertex_program::ptr prog) {
+		return std::static_pointer_cast<pgrank_degree_vertex_program,
+			   vertex_program>(prog);
 	}
-	else if (pr_stage == pr_stage_t::RUN) {
-		// We perform pagerank for at most `max_num_iters' iterations.
-		if (prog.get_graph().get_curr_level() >= max_num_iters)
+
+	pgrank_degree_vertex_program(
+			const std::vector<vertex_id_t> &_changed): changed(_changed) {
+	}
+
+	void add_affected(vertex_id_t id, edge_seq_iterator &it) {
+		if (!std::binary_search(changed.begin(), changed.end(), id))
 			return;
-		request_vertices(&id, 1); // put my edgelist in page cache
+		while (it.has_next())
+			affected.push_back(it.next());
+	}
+
+	const std::vector<vertex_id_t> &get_affected() const {
+		return affected;
+	}
+};
+
+class pgrank_degree_vertex_program_creater: public vertex_program_creater
+{
+	const std::vector<vertex_id_t> &changed;
+public:
+	pgrank_degree_vertex_program_creater(
+			const std::vector<vertex_id_t> &_changed): changed(_changed) {
+	}
+
+	vertex_program::ptr create() const {
+		return vertex_program::ptr(new pgrank_degree_vertex_program(changed));
 	}
 };
 
 void pgrank_vertex::run(vertex_program &prog, const page_vertex &vertex) {
+  if (pr_stage == pr_stage_t::DEGREE) {
+    vsize_t num_out_edges = vertex.get_num_edges(OUT_EDGE);
+    out_degree_col->get(prog, *this) = num_out_edges;
+    edge_seq_iterator it = vertex.get_neigh_seq_it(OUT_EDGE, 0, num_out_edges);
+    ((pgrank_degree_vertex_program &) prog).add_affected(vertex.get_id(), it);
+    return;
+  }
+
   // Gather
+  // The state of in-neighbors is read from the columns. The graph engine
+  // has prefetched it (see `set_pagerank_schedule').
   float accum = 0;
-  edge_iterator end_it = vertex.get_neigh_end(IN_EDGE);
-  
-  for (edge_iterator it = vertex.get_neigh_begin(IN_EDGE); it != end_it; ++it) {
-    vertex_id_t id = *it;
-    pgrank_vertex& v = (pgrank_vertex&) prog.get_graph().get_vertex(id);
+  int num_in = vertex.get_num_edges(IN_EDGE);
+  edge_seq_iterator in_it = vertex.get_neigh_seq_it(IN_EDGE, 0, num_in);
+  while (in_it.has_next()) {
+    vertex_id_t id = in_it.next();
+    // The degree of an in-neighbor should include this vertex, but we
+    // don't trust it blindly to avoid dividing by zero.
+    vsize_t out_degree = out_degree_col->get(id);
     // Notice I want this iteration's pagerank
-    accum += (v.get_curr_itr_pr()/v.get_num_out_edges()); 
+    if (out_degree > 0)
+      accum += (pr_col->get(id)/out_degree);
   }   
 
   // Apply
   float last_change = 0;
-  if (vertex.get_num_edges(IN_EDGE) > 0) {
+  if (num_in > 0) {
+    float &curr_itr_pr = pr_col->get(prog, *this);
     float new_pr = ((1 - DAMPING_FACTOR)) + (DAMPING_FACTOR*(accum));
     last_change = new_pr - curr_itr_pr;
     curr_itr_pr = new_pr;
@@ -127,6 +171,85 @@ void pgrank_vertex::run(vertex_program &prog, const page_vertex &vertex) {
   }
 }
 
+/*
+ * The out-degree of vertices is read from the in-memory vertex index.
+ * The index doesn't include the updates in the delta store, so
+ * `refresh_out_degree' needs to fix the degree of the updated vertices.
+ */
+class init_out_degree
+{
+	graph_engine &graph;
+public:
+	init_out_degree(graph_engine &_graph): graph(_graph) {
+	}
+
+	void operator()(vertex_id_t id, vsize_t &degree) const {
+		degree = graph.get_num_edges(id, OUT_EDGE);
+	}
+};
+
+/*
+ * Get the degree of the vertices whose out-edges are changed in the delta
+ * store from their merged out-edges, as well as the degree of the vertices
+ * in `changed', which must be sorted. It returns the out-neighbors of
+ * the vertices in `changed'.
+ */
+std::vector<vertex_id_t> refresh_out_degree(graph_engine::ptr graph,
+		const std::vector<vertex_id_t> &changed)
+{
+	std::vector<vertex_id_t> ids;
+	if (graph->get_delta_store())
+		graph->get_delta_store()->get_vertices(OUT_EDGE, ids);
+	ids.insert(ids.end(), changed.begin(), changed.end());
+	std::sort(ids.begin(), ids.end());
+	ids.resize(std::unique(ids.begin(), ids.end()) - ids.begin());
+
+	std::vector<vertex_id_t> affected;
+	if (ids.empty())
+		return affected;
+	pr_stage = pr_stage_t::DEGREE;
+	graph->start(ids.data(), ids.size(), vertex_initializer::ptr(),
+			vertex_program_creater::ptr(
+				new pgrank_degree_vertex_program_creater(changed)));
+	graph->wait4complete();
+
+	std::vector<vertex_program::ptr> vprogs;
+	graph->get_vertex_programs(vprogs);
+	BOOST_FOREACH(vertex_program::ptr vprog, vprogs) {
+		const std::vector<vertex_id_t> &prog_affected
+			= pgrank_degree_vertex_program::cast2(vprog)->get_affected();
+		affected.insert(affected.end(), prog_affected.begin(),
+				prog_affected.end());
+	}
+	return affected;
+}
+
+/*
+ * The graph engine runs pagerank for at most `num_iters' iterations and
+ * prefetches the state of the in-neighbors of a vertex before it gathers.
+ */
+void set_pagerank_schedule(graph_engine::ptr graph, int num_iters)
+{
+	graph->set_max_num_iters(num_iters);
+	std::vector<vertex_state_base::const_ptr> states;
+	states.push_back(pr_col);
+	states.push_back(out_degree_col);
+	graph->set_neighbor_prefetch(IN_EDGE, states);
+}
+
+class copy_prev_pagerank
+{
+	FG_vector<float>::ptr prev_pr;
+public:
+	copy_prev_pagerank(FG_vector<float>::ptr prev_pr) {
+		this->prev_pr = prev_pr;
+	}
+
+	void operator()(vertex_id_t id, float &pr) const {
+		pr = prev_pr->get(id);
+	}
+};
+
 class pr_message: public vertex_message
 {
 	float delta;
@@ -156,9 +279,6 @@ public:
 	}
 
 	void run(vertex_program &prog) { 
-		// We perform pagerank for at most `max_num_iters' iterations.
-		if (prog.get_graph().get_curr_level() >= max_num_iters)
-			return;
 		directed_vertex_request req(prog.get_vertex_id(*this),
 				edge_type::OUT_EDGE);
 		request_partial_vertices(&req, 1);
@@ -197,7 +317,7 @@ namespace fg
 {
 
 FG_vector<float>::ptr compute_pagerank(FG_graph::ptr fg, int num_iters,
-		float damping_factor)
+		float damping_factor, float tolerance)
 {
 	bool directed = fg->get_graph_header().is_directed_graph();
 	if (!directed) {
@@ -212,14 +332,14 @@ FG_vector<float>::ptr compute_pagerank(FG_graph::ptr fg, int num_iters,
 			<< "Damping factor must be between 0 and 1 inclusive";
 		exit(-1);
 	}
+	TOLERANCE = tolerance;
 
 	graph_index::ptr index = NUMA_graph_index<pgrank_vertex>::create(
 			fg->get_graph_header());
 	graph_engine::ptr graph = fg->create_engine(index);
-	max_num_iters = num_iters;
 	BOOST_LOG_TRIVIAL(info)
 		<< boost::format("Pagerank (at maximal %1% iterations) starting")
-		% max_num_iters;
+		% num_iters;
 	BOOST_LOG_TRIVIAL(info) << "prof_file: " << graph_conf.get_prof_file();
 #ifdef PROFILER
 	if (!graph_conf.get_prof_file().empty())
@@ -228,18 +348,19 @@ FG_vector<float>::ptr compute_pagerank(FG_graph::ptr fg, int num_iters,
 
 	struct timeval start, end;
 	gettimeofday(&start, NULL);
-	pr_stage = pr_stage_t::INIT;
-	graph->start_all(); 
-	graph->wait4complete();
+	pr_col = vertex_column<float>::create(*graph, 1 - DAMPING_FACTOR);
+	out_degree_col = vertex_column<vsize_t>::create(*graph);
+	out_degree_col->for_each(init_out_degree(*graph));
+	refresh_out_degree(graph, std::vector<vertex_id_t>());
+	set_pagerank_schedule(graph, num_iters);
 	pr_stage = pr_stage_t::RUN;
 	graph->start_all(); 
 	graph->wait4complete();
 	gettimeofday(&end, NULL);
 
-	FG_vector<float>::ptr ret = FG_vector<float>::create(
-			graph->get_num_vertices());
-	graph->query_on_all(vertex_query::ptr(
-				new save_query<float, pgrank_vertex>(ret)));
+	FG_vector<float>::ptr ret = pr_col->to_vector();
+	pr_col.reset();
+	out_degree_col.reset();
 
 #ifdef PROFILER
 	if (!graph_conf.get_prof_file().empty())
@@ -252,8 +373,82 @@ FG_vector<float>::ptr compute_pagerank(FG_graph::ptr fg, int num_iters,
 	return ret;
 }
 
+FG_vector<float>::ptr compute_incremental_pagerank(FG_graph::ptr fg,
+		FG_vector<float>::ptr prev_pr, const std::vector<edge_update> &updates,
+		int num_iters, float damping_factor, float tolerance)
+{
+	bool directed = fg->get_graph_header().is_directed_graph();
+	if (!directed) {
+		BOOST_LOG_TRIVIAL(error)
+			<< "This algorithm works on a directed graph";
+		return FG_vector<float>::ptr();
+	}
+	if (prev_pr->get_size() != fg->get_graph_header().get_num_vertices()) {
+		BOOST_LOG_TRIVIAL(error)
+			<< "The previous pagerank doesn't match the graph";
+		return FG_vector<float>::ptr();
+	}
+
+	DAMPING_FACTOR = damping_factor;
+	if (DAMPING_FACTOR < 0 || DAMPING_FACTOR > 1) {
+		BOOST_LOG_TRIVIAL(fatal)
+			<< "Damping factor must be between 0 and 1 inclusive";
+		exit(-1);
+	}
+	TOLERANCE = tolerance;
+
+	graph_index::ptr index = NUMA_graph_index<pgrank_vertex>::create(
+			fg->get_graph_header());
+	graph_engine::ptr graph = fg->create_engine(index);
+
+	// The sources of the updated edges change their out-degree, and
+	// the targets change their in-edges.
+	std::vector<vertex_id_t> sources(updates.size());
+	std::vector<vertex_id_t> start_vertices(updates.size());
+	for (size_t i = 0; i < updates.size(); i++) {
+		sources[i] = updates[i].from;
+		start_vertices[i] = updates[i].to;
+	}
+	std::sort(sources.begin(), sources.end());
+	sources.resize(std::unique(sources.begin(), sources.end())
+			- sources.begin());
+	BOOST_LOG_TRIVIAL(info)
+		<< boost::format("Incremental pagerank on %1% updates starting")
+		% updates.size();
+
+	struct timeval start, end;
+	gettimeofday(&start, NULL);
+	pr_col = vertex_column<float>::create(*graph);
+	pr_col->for_each(copy_prev_pagerank(prev_pr));
+	out_degree_col = vertex_column<vsize_t>::create(*graph);
+	out_degree_col->for_each(init_out_degree(*graph));
+	// The sources of this batch change their degree, so the pagerank of
+	// their out-neighbors needs to be recomputed.
+	std::vector<vertex_id_t> affected = refresh_out_degree(graph, sources);
+	start_vertices.insert(start_vertices.end(), affected.begin(),
+			affected.end());
+	std::sort(start_vertices.begin(), start_vertices.end());
+	start_vertices.resize(std::unique(start_vertices.begin(),
+				start_vertices.end()) - start_vertices.begin());
+
+	set_pagerank_schedule(graph, num_iters);
+	pr_stage = pr_stage_t::RUN;
+	graph->start(start_vertices.data(), start_vertices.size());
+	graph->wait4complete();
+	gettimeofday(&end, NULL);
+
+	FG_vector<float>::ptr ret = pr_col->to_vector();
+	pr_col.reset();
+	out_degree_col.reset();
+
+	BOOST_LOG_TRIVIAL(info)
+		<< boost::format("It takes %1% seconds in total")
+		% time_diff(start, end);
+	return ret;
+}
+
 FG_vector<float>::ptr compute_pagerank2(FG_graph::ptr fg, int num_iters,
-		float damping_factor)
+		float damping_factor, float tolerance)
 {
 	bool directed = fg->get_graph_header().is_directed_graph();
 	if (!directed) {
@@ -268,14 +463,16 @@ FG_vector<float>::ptr compute_pagerank2(FG_graph::ptr fg, int num_iters,
 			<< "Damping factor must be between 0 and 1 inclusive";
 		exit(-1);
 	}
+	TOLERANCE = tolerance;
 
 	graph_index::ptr index = NUMA_graph_index<pgrank_vertex2>::create(
 			fg->get_graph_header());
 	graph_engine::ptr graph = fg->create_engine(index);
-	max_num_iters = num_iters;
+	// We perform pagerank for at most `num_iters' iterations.
+	graph->set_max_num_iters(num_iters);
 	BOOST_LOG_TRIVIAL(info)
 		<< boost::format("Pagerank (at maximal %1% iterations) starting")
-		% max_num_iters;
+		% num_iters;
 	BOOST_LOG_TRIVIAL(info) << "prof_file: " << graph_conf.get_prof_file();
 #ifdef PROFILER
 	if (!graph_conf.get_prof_file().empty())
@@ -22,9 +22,11 @@
 
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 
 #include "graph_engine.h"
 #include "graph_config.h"
+#include "vertex_state.h"
 #include "FG_vector.h"
 #include "FGlib.h"
 #include "ts_graph.h"
@@ -47,51 +49,123 @@ public:
 	}
 };
 
+/*
+ * The state of wcc_vertex is stored in vertex columns, which need to be
+ * created before the graph engine starts.
+ */
+vertex_column<vertex_id_t>::ptr comp_col;
+vertex_column<bool>::ptr updated_col;
+vertex_column<bool>::ptr empty_col;
+
+class init_own_id
+{
+public:
+	void operator()(vertex_id_t id, vertex_id_t &comp_id) const {
+		comp_id = id;
+	}
+};
+
+void create_wcc_columns(graph_engine &graph)
+{
+	comp_col = vertex_column<vertex_id_t>::create(graph);
+	// Each vertex starts with its own ID as the component ID.
+	comp_col->for_each(init_own_id());
+	updated_col = vertex_column<bool>::create(graph, true);
+	empty_col = vertex_column<bool>::create(graph, true);
+	// A vertex only reads its edges after its component ID is updated.
+	graph.set_run_flags(updated_col);
+}
+
+/*
+ * Empty vertices don't belong to any component.
+ */
+class clear_empty_comp
+{
+	FG_vector<vertex_id_t>::ptr comps;
+public:
+	clear_empty_comp(FG_vector<vertex_id_t>::ptr comps) {
+		this->comps = comps;
+	}
+
+	void operator()(vertex_id_t id, bool &empty) const {
+		if (empty)
+			comps->set(id, INVALID_VERTEX_ID);
+	}
+};
+
+FG_vector<vertex_id_t>::ptr get_wcc_result()
+{
+	FG_vector<vertex_id_t>::ptr vec = comp_col->to_vector();
+	empty_col->for_each(clear_empty_comp(vec));
+	comp_col.reset();
+	updated_col.reset();
+	empty_col.reset();
+	return vec;
+}
+
 class wcc_vertex: public compute_directed_vertex
 {
-protected:
-	bool empty;
-private:
-	bool updated;
-	vertex_id_t component_id;
 public:
 	wcc_vertex(vertex_id_t id): compute_directed_vertex(id) {
-		component_id = id;
-		updated = true;
-		empty = true;
 	}
 
-	bool is_empty(graph_engine &graph) const {
-		return empty;
+	vertex_id_t get_component_id(const vertex_program &prog) const {
+		return comp_col->get(prog, *this);
 	}
 
-	vertex_id_t get_component_id() const {
-		return component_id;
+	void set_empty(const vertex_program &prog, bool empty) {
+		empty_col->get(prog, *this) = empty;
 	}
 
+	/*
+	 * The graph engine only runs the vertex if its component ID is updated.
+	 */
 	void run(vertex_program &prog) {
-		if (updated) {
-			vertex_id_t id = prog.get_vertex_id(*this);
-			request_vertices(&id, 1);
-			updated = false;
-		}
+		vertex_id_t id = prog.get_vertex_id(*this);
+		request_vertices(&id, 1);
 	}
 
 	void run(vertex_program &prog, const page_vertex &vertex);
 
-	void run_on_message(vertex_program &, const vertex_message &msg1) {
+	void run_on_message(vertex_program &prog, const vertex_message &msg1) {
 		component_message &msg = (component_message &) msg1;
+		vertex_id_t &component_id = comp_col->get(prog, *this);
 		if (msg.get_id() < component_id) {
-			updated = true;
+			updated_col->get(prog, *this) = true;
 			component_id = msg.get_id();
 		}
 	}
+};
 
-	vertex_id_t get_result() const {
-		if (!empty)
-			return get_component_id();
+/*
+ * This initializes vertices with the components computed before the updates.
+ * The vertices in the components that may be split by edge deletions
+ * restart from their own IDs.
+ */
+class incremental_wcc_initializer
+{
+	FG_vector<vertex_id_t>::ptr prev_comps;
+	const std::vector<bool> &reset;
+	const std::vector<bool> &activated;
+public:
+	incremental_wcc_initializer(FG_vector<vertex_id_t>::ptr prev_comps,
+			const std::vector<bool> &_reset,
+			const std::vector<bool> &_activated): reset(_reset),
+			activated(_activated) {
+		this->prev_comps = prev_comps;
+	}
+
+	void operator()(vertex_id_t id, vertex_id_t &comp_id) const {
+		vertex_id_t prev_id = prev_comps->get(id);
+		bool empty = prev_id == INVALID_VERTEX_ID;
+		if (empty || reset[id])
+			comp_id = id;
 		else
-			return INVALID_VERTEX_ID;
+			comp_id = prev_id;
+		// A vertex that isn't updated doesn't read its edges when it's
+		// activated.
+		updated_col->get(id) = reset[id] || activated[id];
+		empty_col->get(id) = empty;
 	}
 };
 
@@ -162,11 +236,11 @@ size_t get_unique_neighbors(edge_seq_iterator &it1, edge_seq_iterator &it2,
 void wcc_vertex::run(vertex_program &prog, const page_vertex &vertex)
 {
 	const size_t BUF_SIZE = 512 * 1024 / sizeof(vertex_id_t) - 1;
-	component_message msg(component_id);
+	component_message msg(get_component_id(prog));
 	const page_directed_vertex &dvertex = (const page_directed_vertex &) vertex;
 	assert(dvertex.has_in_part());
 	assert(dvertex.has_out_part());
-	empty = (vertex.get_num_edges(BOTH_EDGES) == 0);
+	set_empty(prog, vertex.get_num_edges(BOTH_EDGES) == 0);
 	wcc_vertex_program<wcc_vertex> &wcc_vprog
 		= (wcc_vertex_program<wcc_vertex> &) prog;
 	std::vector<vertex_id_t> &buf = wcc_vprog.get_buf();
@@ -390,8 +464,8 @@ void ts_wcc_vertex::run(vertex_program &prog, const page_vertex &vertex)
 			wcc_vprog.get_start_time(), wcc_vprog.get_time_interval());
 	edge_seq_iterator out_it = get_ts_iterator(dvertex, edge_type::OUT_EDGE,
 			wcc_vprog.get_start_time(), wcc_vprog.get_time_interval());
-	empty = !in_it.has_next() && !out_it.has_next();
-	component_message msg(get_component_id());
+	set_empty(prog, !in_it.has_next() && !out_it.has_next());
+	component_message msg(get_component_id(prog));
 	prog.multicast_msg(in_it, msg);
 	prog.multicast_msg(out_it, msg);
 }
@@ -470,6 +544,7 @@ FG_vector<vertex_id_t>::ptr compute_wcc(FG_graph::ptr fg)
 
 	struct timeval start, end;
 	gettimeofday(&start, NULL);
+	create_wcc_columns(*graph);
 	graph->start_all(vertex_initializer::ptr(),
 			vertex_program_creater::ptr(new wcc_vertex_program_creater<wcc_vertex>()));
 	graph->wait4complete();
@@ -483,10 +558,77 @@ FG_vector<vertex_id_t>::ptr compute_wcc(FG_graph::ptr fg)
 		ProfilerStop();
 #endif
 
-	FG_vector<vertex_id_t>::ptr vec = FG_vector<vertex_id_t>::create(graph);
-	graph->query_on_all(vertex_query::ptr(
-				new save_query<vertex_id_t, wcc_vertex>(vec)));
-	return vec;
+	return get_wcc_result();
+}
+
+FG_vector<vertex_id_t>::ptr compute_incremental_wcc(FG_graph::ptr fg,
+		FG_vector<vertex_id_t>::ptr prev_comps,
+		const std::vector<edge_update> &updates)
+{
+	bool directed = fg->get_graph_header().is_directed_graph();
+	if (!directed) {
+		BOOST_LOG_TRIVIAL(error)
+			<< "This algorithm works on a directed graph";
+		return FG_vector<vertex_id_t>::ptr();
+	}
+
+	size_t num_vertices = fg->get_graph_header().get_num_vertices();
+	if (prev_comps->get_size() != num_vertices) {
+		BOOST_LOG_TRIVIAL(error)
+			<< "The previous components don't match the graph";
+		return FG_vector<vertex_id_t>::ptr();
+	}
+
+	// An edge insertion can only merge components, so we only need to
+	// activate the endpoints. An edge deletion may split a component, so
+	// all vertices in the component have to recompute their component.
+	std::vector<bool> activated(num_vertices);
+	std::unordered_set<vertex_id_t> split_comps;
+	for (size_t i = 0; i < updates.size(); i++) {
+		activated[updates[i].from] = true;
+		activated[updates[i].to] = true;
+		if (updates[i].op == EDGE_DELETE) {
+			vertex_id_t comp_id = prev_comps->get(updates[i].from);
+			if (comp_id != INVALID_VERTEX_ID)
+				split_comps.insert(comp_id);
+			comp_id = prev_comps->get(updates[i].to);
+			if (comp_id != INVALID_VERTEX_ID)
+				split_comps.insert(comp_id);
+		}
+	}
+	std::vector<bool> reset(num_vertices);
+	std::vector<vertex_id_t> start_vertices;
+	for (vertex_id_t id = 0; id < num_vertices; id++) {
+		vertex_id_t comp_id = prev_comps->get(id);
+		if (comp_id != INVALID_VERTEX_ID
+				&& split_comps.find(comp_id) != split_comps.end())
+			reset[id] = true;
+		if (reset[id] || activated[id])
+			start_vertices.push_back(id);
+	}
+
+	graph_index::ptr index = NUMA_graph_index<wcc_vertex>::create(
+			fg->get_graph_header());
+	graph_engine::ptr graph = fg->create_engine(index);
+	BOOST_LOG_TRIVIAL(info) << boost::format(
+			"incremental weakly connected components starts on %1% vertices")
+		% start_vertices.size();
+
+	struct timeval start, end;
+	gettimeofday(&start, NULL);
+	create_wcc_columns(*graph);
+	comp_col->for_each(incremental_wcc_initializer(prev_comps, reset,
+				activated));
+	graph->start(start_vertices.data(), start_vertices.size(),
+			vertex_initializer::ptr(), vertex_program_creater::ptr(
+				new wcc_vertex_program_creater<wcc_vertex>()));
+	graph->wait4complete();
+	gettimeofday(&end, NULL);
+	BOOST_LOG_TRIVIAL(info)
+		<< boost::format("incremental WCC takes %1% seconds in total")
+		% time_diff(start, end);
+
+	return get_wcc_result();
 }
 
 FG_vector<vertex_id_t>::ptr compute_sync_wcc(FG_graph::ptr fg)
@@ -558,6 +700,7 @@ FG_vector<vertex_id_t>::ptr compute_ts_wcc(FG_graph::ptr fg,
 
 	struct timeval start, end;
 	gettimeofday(&start, NULL);
+	create_wcc_columns(*graph);
 	graph->start_all(vertex_initializer::ptr(), vertex_program_creater::ptr(
 				new ts_wcc_vertex_program_creater(start_time, time_interval)));
 	graph->wait4complete();
@@ -571,10 +714,7 @@ FG_vector<vertex_id_t>::ptr compute_ts_wcc(FG_graph::ptr fg,
 		ProfilerStop();
 #endif
 
-	FG_vector<vertex_id_t>::ptr vec = FG_vector<vertex_id_t>::create(graph);
-	graph->query_on_all(vertex_query::ptr(
-				new save_query<vertex_id_t, wcc_vertex>(vec)));
-	return vec;
+	return get_wcc_result();
 }
 
 }
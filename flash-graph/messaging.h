@@ -180,12 +180,16 @@ public:
 	}
 };
 
-class msg_queue: public thread_safe_FIFO_queue<message>
+/**
+ * The message queue of a worker thread. Messages are sent by all worker
+ * threads, but only the owner thread fetches messages from it.
+ */
+class msg_queue: public mpsc_msg_queue<message>
 {
 public:
 	msg_queue(int node_id, const std::string _name, int init_size,
-			int max_size): thread_safe_FIFO_queue<message>(_name,
-				node_id, init_size, max_size) {
+			int max_size): mpsc_msg_queue<message>(_name, node_id, init_size,
+				max_size) {
 	}
 
 	static msg_queue *create(int node_id, const std::string name,
@@ -196,26 +200,6 @@ public:
 	static void destroy(msg_queue *q) {
 		delete q;
 	}
-
-	/**
-	 * This method needs to be used with caution.
-	 * It may change the behavior of other threads if they also access
-	 * the queue, so it's better to use it when no other threads are
-	 * using it.
-	 * It is also a heavy operation.
-	 */
-	int get_num_objs() {
-		int num = thread_safe_FIFO_queue<message>::get_num_entries();
-		stack_array<message> msgs(num);
-		int ret = thread_safe_FIFO_queue<message>::fetch(msgs.data(), num);
-		int num_objs = 0;
-		for (int i = 0; i < ret; i++) {
-			num_objs += msgs[i].get_num_objs();
-		}
-		BOOST_VERIFY(ret == thread_safe_FIFO_queue<message>::add(
-					msgs.data(), ret));
-		return num_objs;
-	}
 };
 
 class simple_msg_sender
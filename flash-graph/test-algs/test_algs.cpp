@@ -77,6 +77,91 @@ void run_triangle(FG_graph::ptr graph, int argc, char *argv[])
 		printf("There are %ld triangles\n", triangles->sum());
 }
 
+/*
+ * Estimate triangles with sampling. With `-v', we also run the exact
+ * implementation and report the error of the estimate.
+ */
+void run_approx_triangle(FG_graph::ptr graph, int argc, char *argv[])
+{
+	int opt;
+	int num_opts = 0;
+	double error = 0.01;
+	double confidence = 0.99;
+	size_t max_samples = 0;
+	bool validate = false;
+
+	while ((opt = getopt(argc, argv, "e:c:l:v")) != -1) {
+		num_opts++;
+		switch (opt) {
+			case 'e':
+				error = atof(optarg);
+				num_opts++;
+				break;
+			case 'c':
+				confidence = atof(optarg);
+				num_opts++;
+				break;
+			case 'l':
+				max_samples = atol(optarg);
+				num_opts++;
+				break;
+			case 'v':
+				validate = true;
+				break;
+			default:
+				print_usage();
+				abort();
+		}
+	}
+
+	if (max_samples == 0) {
+		triangle_estimate est = estimate_triangles(graph, error, confidence);
+		printf("There are about %.0lf (+-%.0lf) triangles, clustering coefficient: %lf\n",
+				est.num_triangles, est.error * est.num_wedges / 3,
+				est.clustering_coeff);
+		printf("%ld of %ld wedges are sampled\n", est.num_samples,
+				est.num_wedges);
+		if (!validate || est.num_wedges == 0)
+			return;
+
+		FG_vector<size_t>::ptr triangles = compute_undirected_triangles(graph);
+		// Each triangle is counted by its three vertices.
+		double num_triangles = triangles->sum() / 3.0;
+		double cc = num_triangles * 3 / est.num_wedges;
+		printf("There are %.0lf triangles, clustering coefficient: %lf\n",
+				num_triangles, cc);
+		printf("The error of the clustering coefficient is %lf (%s the bound %lf)\n",
+				fabs(est.clustering_coeff - cc),
+				fabs(est.clustering_coeff - cc) <= est.error ? "within" : "out of",
+				est.error);
+		return;
+	}
+
+	FG_vector<float>::ptr ccs = estimate_local_clustering(graph, max_samples);
+	if (ccs == NULL)
+		return;
+	printf("The average local clustering coefficient is about %f\n",
+			ccs->sum<double>() / ccs->get_size());
+	if (!validate)
+		return;
+
+	FG_vector<size_t>::ptr triangles = compute_undirected_triangles(graph);
+	FG_vector<vsize_t>::ptr degrees = get_degree(graph, edge_type::OUT_EDGE);
+	double max_err = 0;
+	double err_sum = 0;
+	for (size_t i = 0; i < ccs->get_size(); i++) {
+		size_t deg = degrees->get(i);
+		double cc = 0;
+		if (deg >= 2)
+			cc = triangles->get(i) / (deg * (deg - 1) / 2.0);
+		double err = fabs(cc - ccs->get(i));
+		max_err = std::max(max_err, err);
+		err_sum += err;
+	}
+	printf("The average error is %lf, the max error is %lf\n",
+			err_sum / ccs->get_size(), max_err);
+}
+
 void run_local_scan(FG_graph::ptr graph, int argc, char *argv[])
 {
 	int opt;
@@ -683,6 +768,94 @@ void run_louvain(FG_graph::ptr graph, int argc, char* argv[])
 	compute_louvain(graph, levels);
 }
 
+/*
+ * Write the community of each vertex to a file.
+ */
+void print_comms(FG_vector<vertex_id_t>::ptr comms,
+		const std::string &output_file)
+{
+	if (!output_file.empty()) {
+		FILE *f = fopen(output_file.c_str(), "w");
+		if (f == NULL) {
+			perror("fopen");
+			return;
+		}
+		for (size_t i = 0; i < comms->get_size(); i++)
+			fprintf(f, "%ld %d\n", i, comms->get(i));
+		fclose(f);
+	}
+	count_map<vertex_id_t> map;
+	comms->count_unique(map);
+	std::pair<vertex_id_t, size_t> max_comm = map.get_max_count();
+	printf("There are %ld communities, and the largest one has %ld vertices\n",
+			map.get_size(), max_comm.second);
+}
+
+void run_label_prop(FG_graph::ptr graph, int argc, char* argv[])
+{
+	int opt;
+	int num_opts = 0;
+	int max_iters = 20;
+	std::string output_file;
+
+	while ((opt = getopt(argc, argv, "i:o:")) != -1) {
+		num_opts++;
+		switch (opt) {
+			case 'i':
+				max_iters = atoi(optarg);
+				num_opts++;
+				break;
+			case 'o':
+				output_file = optarg;
+				num_opts++;
+				break;
+			default:
+				print_usage();
+				abort();
+		}
+	}
+
+	FG_vector<vertex_id_t>::ptr comms = compute_label_propagation(graph,
+			max_iters);
+	if (comms)
+		print_comms(comms, output_file);
+}
+
+void run_parallel_louvain(FG_graph::ptr graph, int argc, char* argv[])
+{
+	int opt;
+	int num_opts = 0;
+	int max_levels = 10;
+	int max_iters = 20;
+	std::string output_file;
+
+	while ((opt = getopt(argc, argv, "l:i:o:")) != -1) {
+		num_opts++;
+		switch (opt) {
+			case 'l':
+				max_levels = atoi(optarg);
+				num_opts++;
+				break;
+			case 'i':
+				max_iters = atoi(optarg);
+				num_opts++;
+				break;
+			case 'o':
+				output_file = optarg;
+				num_opts++;
+				break;
+			default:
+				print_usage();
+				abort();
+		}
+	}
+
+	FG_vector<vertex_id_t>::ptr comms = compute_parallel_louvain(graph,
+			max_levels, max_iters);
+	if (comms)
+		print_comms(comms, output_file);
+}
+
 void run_sem_kmeans(FG_graph::ptr graph, int argc, char *argv[])
 {
 	int opt;
@@ -721,6 +894,7 @@ void run_sem_kmeans(FG_graph::ptr graph, int argc, char *argv[])
 std::string supported_algs[] = {
 	"cycle_triangle",
 	"triangle",
+	"approx_triangle",
 	"local_scan",
 	"topK_scan",
 	"wcc",
@@ -736,6 +910,8 @@ std::string supported_algs[] = {
 	"bfs",
 	"spmv",
 	"louvain",
+	"label_prop",
+	"parallel_louvain",
     "sem_kmeans"
 };
 int num_supported = sizeof(supported_algs) / sizeof(supported_algs[0]);
@@ -783,6 +959,12 @@ void print_usage()
 	fprintf(stderr, "cycle_triangle\n");
 	fprintf(stderr, "-f: run the fast implementation\n");
 	fprintf(stderr, "\n");
+	fprintf(stderr, "approx_triangle\n");
+	fprintf(stderr, "-e error: the error of the clustering coefficient\n");
+	fprintf(stderr, "-c confidence: the confidence of the error bound\n");
+	fprintf(stderr, "-l samples: estimate local clustering coefficient with the max number of samples per vertex\n");
+	fprintf(stderr, "-v: validate the estimate with the exact triangle counting\n");
+	fprintf(stderr, "\n");
 	fprintf(stderr, "wcc\n");
 	fprintf(stderr, "-s: run wcc synchronously\n");
 	fprintf(stderr, "\n");
@@ -800,6 +982,15 @@ void print_usage()
 	fprintf(stderr, "louvain\n");
 	fprintf(stderr, "-l: how many levels in the hierarchy to compute\n");
 	fprintf(stderr, "\n");
+	fprintf(stderr, "label_prop\n");
+	fprintf(stderr, "-i num: the maximum number of iterations\n");
+	fprintf(stderr, "-o output: the output file\n");
+	fprintf(stderr, "\n");
+	fprintf(stderr, "parallel_louvain\n");
+	fprintf(stderr, "-l num: the maximum number of levels\n");
+	fprintf(stderr, "-i num: the maximum number of iterations in a level\n");
+	fprintf(stderr, "-o output: the output file\n");
+	fprintf(stderr, "\n");
 	fprintf(stderr, "sem_kmeans\n");
 	fprintf(stderr, "-k: the number of clusters to use\n");
 	fprintf(stderr, "-i: max number of iterations\n");
@@ -852,6 +1043,9 @@ int main(int argc, char *argv[])
 	else if (alg == "triangle") {
 		run_triangle(graph, argc, argv);
 	}
+	else if (alg == "approx_triangle") {
+		run_approx_triangle(graph, argc, argv);
+	}
 	else if (alg == "local_scan") {
 		run_local_scan(graph, argc, argv);
 	}
@@ -899,6 +1093,12 @@ int main(int argc, char *argv[])
 	}
 	else if (alg == "louvain") {
 		run_louvain(graph, argc, argv);
+	}
+	else if (alg == "label_prop") {
+		run_label_prop(graph, argc, argv);
+	}
+	else if (alg == "parallel_louvain") {
+		run_parallel_louvain(graph, argc, argv);
 	} else if (alg == "sem_kmeans") {
 		run_sem_kmeans(graph, argc, argv);
 	}
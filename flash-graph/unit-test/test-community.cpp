@@ -0,0 +1,187 @@
+/*
+ * Copyright 2015 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of FlashGraph.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <set>
+
+#include <boost/foreach.hpp>
+
+#define BOOST_TEST_MODULE community
+#include <boost/test/included/unit_test.hpp>
+
+#include "safs_file.h"
+
+#include "graph_engine.h"
+#include "graph.h"
+#include "in_mem_storage.h"
+#include "FGlib.h"
+
+using namespace fg;
+
+// Louvain stores the coarsened graphs in SAFS.
+static const std::string conf_file = "conf/run_test.txt";
+
+const size_t num_cliques = 20;
+
+/*
+ * The cliques have different sizes and there aren't edges between
+ * cliques, so each clique is a community.
+ */
+static size_t get_clique_size(size_t clique)
+{
+	return 5 + clique % 7;
+}
+
+static FG_graph::ptr create_cliques(bool directed, config_map::ptr configs,
+		std::vector<size_t> &clique_ids)
+{
+	clique_ids.clear();
+	for (size_t i = 0; i < num_cliques; i++)
+		clique_ids.insert(clique_ids.end(), get_clique_size(i), i);
+
+	graph_type type = directed ? graph_type::DIRECTED : graph_type::UNDIRECTED;
+	in_mem_subgraph::ptr subg = in_mem_subgraph::create(type, false);
+	vertex_id_t start = 0;
+	for (size_t i = 0; i < num_cliques; i++) {
+		vertex_id_t end = start + get_clique_size(i);
+		for (vertex_id_t id = start; id < end; id++) {
+			if (directed) {
+				// The edges only go from a smaller vertex to a larger one.
+				in_mem_directed_vertex<> v(id, false);
+				for (vertex_id_t neigh = start; neigh < id; neigh++)
+					v.add_in_edge(edge<empty_data>(neigh, id));
+				for (vertex_id_t neigh = id + 1; neigh < end; neigh++)
+					v.add_out_edge(edge<empty_data>(id, neigh));
+				subg->add_vertex(v);
+			}
+			else {
+				in_mem_undirected_vertex<> v(id, false);
+				for (vertex_id_t neigh = start; neigh < end; neigh++)
+					if (neigh != id)
+						v.add_edge(edge<empty_data>(id, neigh));
+				subg->add_vertex(v);
+			}
+		}
+		start = end;
+	}
+	std::pair<in_mem_graph::ptr, vertex_index::ptr> ret
+		= subg->serialize("cliques", false);
+	return FG_graph::create(ret.first, ret.second, "cliques", configs);
+}
+
+/*
+ * The vertices in a clique have the same label and different cliques
+ * have different labels.
+ */
+static void check_comms(FG_vector<vertex_id_t>::ptr comms,
+		const std::vector<size_t> &clique_ids)
+{
+	BOOST_REQUIRE(comms->get_size() == clique_ids.size());
+	std::set<vertex_id_t> labels;
+	for (size_t i = 0; i < clique_ids.size(); i++) {
+		if (i == 0 || clique_ids[i] != clique_ids[i - 1])
+			labels.insert(comms->get(i));
+		else
+			BOOST_CHECK(comms->get(i) == comms->get(i - 1));
+	}
+	BOOST_CHECK(labels.size() == num_cliques);
+}
+
+static void test_label_prop(bool directed)
+{
+	std::vector<size_t> clique_ids;
+	FG_graph::ptr fg = create_cliques(directed,
+			config_map::create(conf_file), clique_ids);
+	check_comms(compute_label_propagation(fg), clique_ids);
+
+	// The graph engine stops label propagation before the first iteration,
+	// so every vertex keeps its own label.
+	FG_vector<vertex_id_t>::ptr labels = compute_label_propagation(fg, 0);
+	for (vertex_id_t id = 0; id < clique_ids.size(); id++)
+		BOOST_CHECK(labels->get(id) == id);
+}
+
+static std::set<std::string> get_louvain_files()
+{
+	std::set<std::string> files;
+	safs::get_all_safs_files(files);
+	std::set<std::string> ret;
+	BOOST_FOREACH(const std::string &file, files) {
+		if (file.compare(0, 7, "louvain") == 0)
+			ret.insert(file);
+	}
+	return ret;
+}
+
+/*
+ * Louvain must not touch the files of other graphs in SAFS and it removes
+ * the coarsened graphs when it completes.
+ */
+static void test_louvain(bool directed)
+{
+	const std::string other_file = "louvain-level1.adj";
+	safs::safs_file f(safs::get_sys_RAID_conf(), other_file);
+	if (!f.exist())
+		BOOST_REQUIRE(f.create_file(4096));
+	std::set<std::string> files = get_louvain_files();
+
+	std::vector<size_t> clique_ids;
+	FG_graph::ptr fg = create_cliques(directed,
+			config_map::create(conf_file), clique_ids);
+	check_comms(compute_parallel_louvain(fg), clique_ids);
+	BOOST_CHECK(f.exist());
+	BOOST_CHECK(get_louvain_files() == files);
+	f.delete_file();
+}
+
+struct flash_graph_fixture
+{
+	flash_graph_fixture() {
+		graph_engine::init_flash_graph(config_map::create(conf_file));
+	}
+
+	~flash_graph_fixture() {
+		graph_engine::destroy_flash_graph();
+	}
+};
+
+BOOST_GLOBAL_FIXTURE(flash_graph_fixture);
+
+BOOST_AUTO_TEST_SUITE (community_test)
+
+BOOST_AUTO_TEST_CASE (test_label_prop_directed)
+{
+	test_label_prop(true);
+}
+
+BOOST_AUTO_TEST_CASE (test_label_prop_undirected)
+{
+	test_label_prop(false);
+}
+
+BOOST_AUTO_TEST_CASE (test_louvain_directed)
+{
+	test_louvain(true);
+}
+
+BOOST_AUTO_TEST_CASE (test_louvain_undirected)
+{
+	test_louvain(false);
+}
+
+BOOST_AUTO_TEST_SUITE_END( )
@@ -0,0 +1,714 @@
+#include <atomic>
+#include <set>
+#include <map>
+#include <thread>
+
+#include <boost/foreach.hpp>
+
+#define BOOST_TEST_MODULE graph_delta
+#include <boost/test/included/unit_test.hpp>
+
+#include "RAID_config.h"
+#include "safs_file.h"
+
+#include "graph_delta.h"
+#include "dynamic_graph.h"
+#include "graph_engine.h"
+#include "graph.h"
+#include "in_mem_storage.h"
+
+using namespace fg;
+
+// The tests with logs need SAFS.
+static const std::string conf_file = "conf/run_test.txt";
+
+const size_t num_vertices = 1000;
+
+typedef std::map<vertex_id_t, std::set<vertex_id_t> > adj_map_t;
+
+/*
+ * The base graph is a ring, so every vertex has neighbors.
+ */
+static std::vector<vertex_id_t> get_base_neighbors(vertex_id_t id)
+{
+	std::vector<vertex_id_t> neighs;
+	neighs.push_back((id + num_vertices - 1) % num_vertices);
+	neighs.push_back((id + 1) % num_vertices);
+	std::sort(neighs.begin(), neighs.end());
+	return neighs;
+}
+
+static void init_adj(adj_map_t &adj)
+{
+	for (vertex_id_t id = 0; id < num_vertices; id++) {
+		std::vector<vertex_id_t> neighs = get_base_neighbors(id);
+		adj[id].insert(neighs.begin(), neighs.end());
+	}
+}
+
+static graph_header get_header(bool directed)
+{
+	return graph_header(directed ? graph_type::DIRECTED : graph_type::UNDIRECTED,
+			num_vertices, num_vertices, 0);
+}
+
+/*
+ * Generate random updates and apply them to the adjacency lists.
+ */
+static std::vector<edge_update> gen_updates(adj_map_t &adj, bool directed,
+		size_t num)
+{
+	std::vector<edge_update> updates;
+	for (size_t i = 0; i < num; i++) {
+		vertex_id_t from = random() % num_vertices;
+		vertex_id_t to = random() % num_vertices;
+		delta_op_t op = random() % 2 ? EDGE_INSERT : EDGE_DELETE;
+		updates.push_back(edge_update(from, to, op));
+		if (op == EDGE_INSERT) {
+			adj[from].insert(to);
+			if (!directed)
+				adj[to].insert(from);
+		}
+		else {
+			adj[from].erase(to);
+			if (!directed)
+				adj[to].erase(from);
+		}
+	}
+	return updates;
+}
+
+static std::vector<edge_update> apply_updates(
+		std::vector<graph_delta::ptr> &deltas, adj_map_t &adj, bool directed,
+		size_t num)
+{
+	graph_delta::ptr delta = graph_delta::create(get_header(directed));
+	std::vector<edge_update> updates = gen_updates(adj, directed, num);
+	BOOST_CHECK(delta->apply(updates.data(), updates.size()));
+	BOOST_CHECK(delta->get_num_updates() == num);
+	deltas.push_back(delta);
+	return updates;
+}
+
+static void test_merge(bool directed)
+{
+	adj_map_t adj;
+	init_adj(adj);
+
+	std::vector<graph_delta::ptr> deltas;
+	std::vector<vertex_id_t> sources;
+	for (int i = 0; i < 5; i++) {
+		std::vector<edge_update> updates = apply_updates(deltas, adj,
+				directed, 2000);
+		for (size_t j = 0; j < updates.size(); j++)
+			sources.push_back(updates[j].from);
+	}
+	graph_delta_store::ptr store = graph_delta_store::create(deltas);
+
+	// In a directed graph, the sources of the updates have their out-edges
+	// changed.
+	if (directed) {
+		std::sort(sources.begin(), sources.end());
+		sources.resize(std::unique(sources.begin(), sources.end())
+				- sources.begin());
+		std::vector<vertex_id_t> ids;
+		store->get_vertices(OUT_EDGE, ids);
+		BOOST_CHECK(ids == sources);
+	}
+
+	edge_type type = directed ? OUT_EDGE : IN_EDGE;
+	for (vertex_id_t id = 0; id < num_vertices; id++) {
+		std::vector<vertex_id_t> neighs = get_base_neighbors(id);
+		store->merge(id, type, neighs);
+		BOOST_CHECK(std::is_sorted(neighs.begin(), neighs.end()));
+		BOOST_CHECK(neighs.size() == adj[id].size());
+		BOOST_CHECK(std::equal(neighs.begin(), neighs.end(), adj[id].begin()));
+	}
+}
+
+static void delete_safs_file(const std::string &name)
+{
+	safs::safs_file f(safs::get_sys_RAID_conf(), name);
+	if (f.exist())
+		f.delete_file();
+}
+
+static void check_same_delta(const graph_delta &d1, const graph_delta &d2)
+{
+	BOOST_CHECK(d1.get_num_updates() == d2.get_num_updates());
+	BOOST_CHECK(d1.get_num_vertices() == d2.get_num_vertices());
+	edge_type types[] = {IN_EDGE, OUT_EDGE};
+	for (vertex_id_t id = 0; id < num_vertices; id++) {
+		for (int i = 0; i < 2; i++) {
+			std::vector<vertex_id_t> added1, removed1, added2, removed2;
+			bool ret1 = d1.get_delta(id, types[i], added1, removed1);
+			bool ret2 = d2.get_delta(id, types[i], added2, removed2);
+			BOOST_CHECK(ret1 == ret2);
+			BOOST_CHECK(added1 == added2);
+			BOOST_CHECK(removed1 == removed2);
+		}
+	}
+}
+
+/*
+ * The updates are in the log once they're applied, so a delta loaded
+ * from the log is the same as the original one. We can continue to
+ * append updates to a loaded delta.
+ */
+static void test_log(bool directed)
+{
+	const std::string log_file = "test-delta.log";
+	delete_safs_file(log_file);
+	graph_header header = get_header(directed);
+	adj_map_t adj;
+	// The batches don't end at page boundaries.
+	graph_delta::ptr delta = graph_delta::create(header, log_file, 10000);
+	for (int i = 0; i < 5; i++) {
+		std::vector<edge_update> updates = gen_updates(adj, directed, 777);
+		BOOST_CHECK(delta->apply(updates.data(), updates.size()));
+	}
+	graph_delta::ptr loaded = graph_delta::load(header, log_file);
+	check_same_delta(*delta, *loaded);
+
+	std::vector<edge_update> updates = gen_updates(adj, directed, 333);
+	BOOST_CHECK(loaded->apply(updates.data(), updates.size()));
+	BOOST_CHECK(delta->apply(updates.data(), updates.size()));
+	loaded = graph_delta::load(header, log_file);
+	check_same_delta(*delta, *loaded);
+
+	// The log is full. The updates aren't applied.
+	size_t num_updates = delta->get_num_updates();
+	updates = gen_updates(adj, directed, 10000);
+	BOOST_CHECK(!delta->apply(updates.data(), updates.size()));
+	BOOST_CHECK(delta->get_num_updates() == num_updates);
+	loaded = graph_delta::load(header, log_file);
+	BOOST_CHECK(loaded->get_num_updates() == num_updates);
+
+	loaded.reset();
+	delta->delete_log();
+	BOOST_CHECK(!safs::exist_safs_file(log_file));
+}
+
+/*
+ * Threads insert and delete the same edges concurrently. The delta
+ * loaded from the log has to end up in the same state as the delta
+ * in memory.
+ */
+static void test_concurrent_log(bool directed)
+{
+	const std::string log_file = "test-delta.log";
+	const int num_threads = 4;
+	const int num_batches = 50;
+	delete_safs_file(log_file);
+	graph_header header = get_header(directed);
+	graph_delta::ptr delta = graph_delta::create(header, log_file,
+			num_threads * num_batches * 10);
+	// Boost.Test checks aren't thread-safe, so the threads count the failures.
+	std::atomic<int> num_fails(0);
+	std::vector<std::thread> threads;
+	for (int i = 0; i < num_threads; i++) {
+		threads.push_back(std::thread([delta, i, num_batches, &num_fails]() {
+				delta_op_t op = i % 2 ? EDGE_INSERT : EDGE_DELETE;
+				for (int j = 0; j < num_batches; j++) {
+					std::vector<edge_update> updates;
+					for (vertex_id_t id = 0; id < 10; id++)
+						updates.push_back(edge_update(id, id + 1, op));
+					if (!delta->apply(updates.data(), updates.size()))
+						num_fails++;
+				}
+			}));
+	}
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+	BOOST_CHECK(num_fails == 0);
+	graph_delta::ptr loaded = graph_delta::load(header, log_file);
+	check_same_delta(*delta, *loaded);
+	loaded.reset();
+	delta->delete_log();
+}
+
+/*
+ * The base graph is a ring and the graph is stored in memory.
+ */
+static FG_graph::ptr create_ring(bool directed, config_map::ptr configs)
+{
+	graph_type type = directed ? graph_type::DIRECTED : graph_type::UNDIRECTED;
+	in_mem_subgraph::ptr subg = in_mem_subgraph::create(type, false);
+	for (vertex_id_t id = 0; id < num_vertices; id++) {
+		std::vector<vertex_id_t> neighs = get_base_neighbors(id);
+		if (directed) {
+			in_mem_directed_vertex<> v(id, false);
+			for (size_t i = 0; i < neighs.size(); i++) {
+				v.add_in_edge(edge<empty_data>(neighs[i], id));
+				v.add_out_edge(edge<empty_data>(id, neighs[i]));
+			}
+			subg->add_vertex(v);
+		}
+		else {
+			in_mem_undirected_vertex<> v(id, false);
+			for (size_t i = 0; i < neighs.size(); i++)
+				v.add_edge(edge<empty_data>(id, neighs[i]));
+			subg->add_vertex(v);
+		}
+	}
+	std::pair<in_mem_graph::ptr, vertex_index::ptr> ret
+		= subg->serialize("ring", false);
+	return FG_graph::create(ret.first, ret.second, "ring", configs);
+}
+
+static std::vector<std::vector<vertex_id_t> > collected;
+static std::vector<std::vector<vertex_id_t> > collected_in;
+
+/*
+ * This collects the neighbor lists read by the graph engine.
+ */
+class collect_vertex: public compute_vertex
+{
+public:
+	collect_vertex(vertex_id_t id): compute_vertex(id) {
+	}
+
+	void run(vertex_program &prog) {
+		vertex_id_t id = prog.get_vertex_id(*this);
+		request_vertices(&id, 1);
+	}
+
+	void run(vertex_program &prog, const page_vertex &vertex) {
+		edge_type type = vertex.is_directed() ? OUT_EDGE : BOTH_EDGES;
+		std::vector<vertex_id_t> &neighs = collected[vertex.get_id()];
+		safs::page_byte_array::seq_const_iterator<vertex_id_t> it
+			= vertex.get_neigh_seq_it(type);
+		while (it.has_next())
+			neighs.push_back(it.next());
+		if (vertex.is_directed()) {
+			std::vector<vertex_id_t> &in_neighs = collected_in[vertex.get_id()];
+			it = vertex.get_neigh_seq_it(IN_EDGE);
+			while (it.has_next())
+				in_neighs.push_back(it.next());
+		}
+	}
+
+	void run_on_message(vertex_program &prog, const vertex_message &msg) {
+	}
+};
+
+static void check_graph(FG_graph::ptr fg, adj_map_t &adj)
+{
+	collected.clear();
+	collected.resize(num_vertices);
+	collected_in.clear();
+	collected_in.resize(num_vertices);
+	graph_index::ptr index = NUMA_graph_index<collect_vertex>::create(
+			fg->get_graph_header());
+	graph_engine::ptr graph = fg->create_engine(index);
+	graph->start_all();
+	graph->wait4complete();
+	for (vertex_id_t id = 0; id < num_vertices; id++) {
+		BOOST_CHECK(collected[id].size() == adj[id].size());
+		BOOST_CHECK(std::equal(collected[id].begin(), collected[id].end(),
+					adj[id].begin()));
+	}
+	if (!fg->get_graph_header().is_directed_graph())
+		return;
+	adj_map_t in_adj;
+	for (vertex_id_t id = 0; id < num_vertices; id++)
+		BOOST_FOREACH(vertex_id_t neigh, adj[id])
+			in_adj[neigh].insert(id);
+	for (vertex_id_t id = 0; id < num_vertices; id++) {
+		BOOST_CHECK(collected_in[id].size() == in_adj[id].size());
+		BOOST_CHECK(std::equal(collected_in[id].begin(),
+					collected_in[id].end(), in_adj[id].begin()));
+	}
+}
+
+/*
+ * The compacted graph is written in ranges of vertices. Small ranges
+ * make it write many ranges.
+ */
+static void test_compact(bool directed, size_t range_num_edges)
+{
+	// SAFS keeps the file ID of a name, so the page cache may keep
+	// the pages of a deleted file. Every compacted graph gets its own name.
+	const std::string name = std::string(directed ? "test-compact-d" : "test-compact-u")
+		+ itoa(range_num_edges);
+	const std::string adj_file = name + ".adj";
+	const std::string index_file = name + ".index";
+	config_map::ptr configs = config_map::create(conf_file);
+	adj_map_t adj;
+	init_adj(adj);
+	std::vector<graph_delta::ptr> deltas;
+	for (int i = 0; i < 3; i++)
+		apply_updates(deltas, adj, directed, 2000);
+
+	compact_graph(create_ring(directed, configs),
+			graph_delta_store::create(deltas), adj_file, index_file,
+			range_num_edges);
+	FG_graph::ptr fg = FG_graph::create(adj_file, index_file, configs);
+	BOOST_CHECK(fg->get_graph_header().get_num_vertices() == num_vertices);
+	if (directed) {
+		size_t num_edges = 0;
+		for (vertex_id_t id = 0; id < num_vertices; id++)
+			num_edges += adj[id].size();
+		BOOST_CHECK(fg->get_graph_header().get_num_edges() == num_edges);
+	}
+	check_graph(fg, adj);
+	fg.reset();
+	delete_safs_file(adj_file);
+	delete_safs_file(index_file);
+}
+
+/*
+ * The compacted graph is written to SAFS and replaces the logs.
+ * A dynamic graph created with the same prefix recovers the compacted
+ * graph and the updates in the logs.
+ */
+static void test_dynamic_graph(bool directed)
+{
+	// SAFS keeps the file ID of a name, so the page cache may keep
+	// the pages of the graphs deleted by the other test.
+	const std::string prefix = directed ? "test-dgraph-d" : "test-dgraph-u";
+	config_map::ptr configs = config_map::create(conf_file);
+	FG_graph::ptr ring = create_ring(directed, configs);
+	adj_map_t adj;
+	init_adj(adj);
+
+	dynamic_graph::ptr dg = dynamic_graph::create(ring, prefix, 100000);
+	for (int i = 0; i < 3; i++)
+		dg->apply(gen_updates(adj, directed, 2000));
+	check_graph(dg->get_graph(), adj);
+	dg->compact();
+	BOOST_CHECK(dg->get_num_compactions() == 1);
+	BOOST_CHECK(dg->get_num_updates() == 0);
+	BOOST_CHECK(safs::exist_safs_file(prefix + "-base1.adj"));
+	BOOST_CHECK(safs::exist_safs_file(prefix + "-base1.index"));
+	BOOST_CHECK(!safs::exist_safs_file(prefix + "-0"));
+	check_graph(dg->get_graph(), adj);
+
+	// These updates are only in the log.
+	dg->apply(gen_updates(adj, directed, 2000));
+	dg.reset();
+	dg = dynamic_graph::create(ring, prefix, 100000);
+	check_graph(dg->get_graph(), adj);
+	FG_graph::ptr snapshot = dg->get_graph();
+	dg->compact();
+	BOOST_CHECK(safs::exist_safs_file(prefix + "-base2.index"));
+	BOOST_CHECK(!safs::exist_safs_file(prefix + "-1"));
+	check_graph(dg->get_graph(), adj);
+	// The snapshot still reads the old base graph.
+	BOOST_CHECK(safs::exist_safs_file(prefix + "-base1.index"));
+	check_graph(snapshot, adj);
+	snapshot.reset();
+
+	// Nothing is left after the last log is replayed.
+	dg.reset();
+	BOOST_CHECK(!safs::exist_safs_file(prefix + "-base1.index"));
+	BOOST_CHECK(!safs::exist_safs_file(prefix + "-base1.adj"));
+	dg = dynamic_graph::create(ring, prefix, 100000);
+	BOOST_CHECK(dg->get_num_updates() == 0);
+	check_graph(dg->get_graph(), adj);
+	dg.reset();
+
+	std::set<std::string> files;
+	safs::get_all_safs_files(files);
+	BOOST_FOREACH(const std::string &file, files) {
+		if (file.compare(0, prefix.size(), prefix) == 0)
+			delete_safs_file(file);
+	}
+}
+
+/*
+ * A directory that isn't a SAFS file blocks renaming the index of
+ * a compacted graph, so the compaction fails. The deltas are kept and
+ * compacted by the next compaction.
+ */
+static void test_compact_failure()
+{
+	const std::string prefix = "test-dgraph-fail";
+	config_map::ptr configs = config_map::create(conf_file);
+	FG_graph::ptr ring = create_ring(true, configs);
+	adj_map_t adj;
+	init_adj(adj);
+
+	dynamic_graph::ptr dg = dynamic_graph::create(ring, prefix, 100000);
+	dg->apply(gen_updates(adj, true, 2000));
+	size_t num_updates = dg->get_num_updates();
+	// The directory isn't a SAFS file because it has two files.
+	const safs::RAID_config &conf = safs::get_sys_RAID_conf();
+	std::vector<std::string> blockers;
+	for (int i = 0; i < conf.get_num_disks(); i++) {
+		std::string dir = conf.get_disk(i).get_file_name() + "/" + prefix
+			+ "-base1.index";
+		BOOST_REQUIRE(safs::native_dir(dir).create_dir(true));
+		BOOST_REQUIRE(safs::native_file(dir + "/a").create_file(0));
+		BOOST_REQUIRE(safs::native_file(dir + "/b").create_file(0));
+		blockers.push_back(dir);
+	}
+	BOOST_CHECK_THROW(dg->compact(), safs::io_exception);
+	BOOST_CHECK(dg->get_num_compactions() == 0);
+	BOOST_CHECK(dg->get_num_updates() == num_updates);
+	BOOST_CHECK(!safs::exist_safs_file(prefix + "-base1.adj"));
+	BOOST_CHECK(!safs::exist_safs_file(prefix + "-base1.index.tmp"));
+	BOOST_CHECK(safs::exist_safs_file(prefix + "-0"));
+	check_graph(dg->get_graph(), adj);
+
+	// The next compaction includes the deltas of the failed one.
+	dg->apply(gen_updates(adj, true, 2000));
+	dg->compact();
+	BOOST_CHECK(dg->get_num_compactions() == 1);
+	BOOST_CHECK(dg->get_num_updates() == 0);
+	BOOST_CHECK(safs::exist_safs_file(prefix + "-base2.index"));
+	BOOST_CHECK(!safs::exist_safs_file(prefix + "-0"));
+	check_graph(dg->get_graph(), adj);
+	dg.reset();
+
+	BOOST_FOREACH(const std::string &dir, blockers)
+		safs::native_dir(dir).delete_dir(true);
+	std::set<std::string> files;
+	safs::get_all_safs_files(files);
+	BOOST_FOREACH(const std::string &file, files) {
+		if (file.compare(0, prefix.size(), prefix) == 0)
+			delete_safs_file(file);
+	}
+}
+
+static float max_pagerank_diff(FG_vector<float>::ptr pr1,
+		FG_vector<float>::ptr pr2)
+{
+	float max_diff = 0;
+	for (vertex_id_t id = 0; id < num_vertices; id++)
+		max_diff = std::max(max_diff, std::fabs(pr1->get(id) - pr2->get(id)));
+	return max_diff;
+}
+
+/*
+ * Incremental pagerank runs on batches of updates that haven't been
+ * compacted, so the out-degree of the sources in the earlier batches has
+ * to come from the deltas as well.
+ */
+static void test_incremental_pagerank()
+{
+	// The default tolerance stops propagating small changes, which limits
+	// how close the incremental PageRank can get to a full recomputation.
+	const int num_iters = 100;
+	const float damping = 0.85;
+	const float tolerance = 1.0E-6;
+	FG_graph::ptr ring = create_ring(true, config_map::create(conf_file));
+	adj_map_t adj;
+	init_adj(adj);
+
+	dynamic_graph::ptr dg = dynamic_graph::create(ring);
+	FG_vector<float>::ptr pr = compute_pagerank(dg->get_graph(), num_iters,
+			damping, tolerance);
+	for (int i = 0; i < 3; i++) {
+		std::vector<edge_update> updates = gen_updates(adj, true, 300);
+		dg->apply(updates);
+		pr = compute_incremental_pagerank(dg->get_graph(), pr, updates,
+				num_iters, damping, tolerance);
+	}
+	BOOST_CHECK(dg->get_num_compactions() == 0);
+	FG_vector<float>::ptr full_pr = compute_pagerank(dg->get_graph(),
+			num_iters, damping, tolerance);
+
+	dg->compact();
+	FG_vector<float>::ptr compact_pr = compute_pagerank(dg->get_graph(),
+			num_iters, damping, tolerance);
+	BOOST_CHECK(max_pagerank_diff(full_pr, compact_pr) < 1.0E-4);
+	BOOST_CHECK(max_pagerank_diff(pr, compact_pr) < 1.0E-3);
+}
+
+static vertex_id_t find_root(std::vector<vertex_id_t> &roots, vertex_id_t id)
+{
+	while (roots[id] != id) {
+		roots[id] = roots[roots[id]];
+		id = roots[id];
+	}
+	return id;
+}
+
+/*
+ * Check the components against the weakly connected components of
+ * the adjacency lists. A vertex without edges doesn't belong to any
+ * component.
+ */
+static void check_wcc(FG_vector<vertex_id_t>::ptr comps, adj_map_t &adj)
+{
+	std::vector<vertex_id_t> roots(num_vertices);
+	std::vector<bool> empty(num_vertices, true);
+	for (vertex_id_t id = 0; id < num_vertices; id++)
+		roots[id] = id;
+	BOOST_FOREACH(const adj_map_t::value_type &v, adj) {
+		BOOST_FOREACH(vertex_id_t neigh, v.second) {
+			empty[v.first] = false;
+			empty[neigh] = false;
+			roots[find_root(roots, v.first)] = find_root(roots, neigh);
+		}
+	}
+
+	std::map<vertex_id_t, vertex_id_t> root2comp;
+	std::map<vertex_id_t, vertex_id_t> comp2root;
+	for (vertex_id_t id = 0; id < num_vertices; id++) {
+		vertex_id_t comp_id = comps->get(id);
+		if (empty[id]) {
+			BOOST_CHECK(comp_id == INVALID_VERTEX_ID);
+			continue;
+		}
+		BOOST_REQUIRE(comp_id < num_vertices);
+		vertex_id_t root = find_root(roots, id);
+		// The component ID is the ID of a vertex in the component.
+		BOOST_CHECK(find_root(roots, comp_id) == root);
+		if (root2comp.find(root) == root2comp.end())
+			root2comp[root] = comp_id;
+		if (comp2root.find(comp_id) == comp2root.end())
+			comp2root[comp_id] = root;
+		BOOST_CHECK(root2comp[root] == comp_id);
+		BOOST_CHECK(comp2root[comp_id] == root);
+	}
+}
+
+static void delete_undirected(std::vector<edge_update> &updates,
+		adj_map_t &adj, vertex_id_t v1, vertex_id_t v2)
+{
+	updates.push_back(edge_update(v1, v2, EDGE_DELETE));
+	updates.push_back(edge_update(v2, v1, EDGE_DELETE));
+	adj[v1].erase(v2);
+	adj[v2].erase(v1);
+}
+
+/*
+ * Apply a batch of updates, which have been applied to the adjacency lists,
+ * and update the components incrementally.
+ */
+static FG_vector<vertex_id_t>::ptr update_wcc(dynamic_graph::ptr dg,
+		FG_vector<vertex_id_t>::ptr comps,
+		const std::vector<edge_update> &updates, adj_map_t &adj)
+{
+	dg->apply(updates);
+	comps = compute_incremental_wcc(dg->get_graph(), comps, updates);
+	check_wcc(comps, adj);
+	check_wcc(compute_wcc(dg->get_graph()), adj);
+	return comps;
+}
+
+/*
+ * Cut the ring into arcs, merge some of them again and isolate a vertex.
+ * Deletions force a whole component to recompute, so each batch checks
+ * both the split and the merged components.
+ */
+static void test_incremental_wcc()
+{
+	FG_graph::ptr ring = create_ring(true, config_map::create(conf_file));
+	adj_map_t adj;
+	init_adj(adj);
+
+	dynamic_graph::ptr dg = dynamic_graph::create(ring);
+	FG_vector<vertex_id_t>::ptr comps = compute_wcc(dg->get_graph());
+	check_wcc(comps, adj);
+
+	// Split the ring into two arcs.
+	std::vector<edge_update> updates;
+	delete_undirected(updates, adj, 100, 101);
+	delete_undirected(updates, adj, 400, 401);
+	comps = update_wcc(dg, comps, updates, adj);
+
+	// Split the larger arc and merge one half with the smaller arc.
+	updates.clear();
+	delete_undirected(updates, adj, 700, 701);
+	updates.push_back(edge_update(200, 800, EDGE_INSERT));
+	adj[200].insert(800);
+	comps = update_wcc(dg, comps, updates, adj);
+
+	// Isolate a vertex, which splits an arc again.
+	updates.clear();
+	std::set<vertex_id_t> neighs = adj[500];
+	BOOST_FOREACH(vertex_id_t neigh, neighs)
+		delete_undirected(updates, adj, 500, neigh);
+	comps = update_wcc(dg, comps, updates, adj);
+
+	// Random updates on top of the deterministic ones.
+	for (int i = 0; i < 3; i++)
+		comps = update_wcc(dg, comps, gen_updates(adj, true, 50), adj);
+}
+
+struct flash_graph_fixture
+{
+	flash_graph_fixture() {
+		graph_engine::init_flash_graph(config_map::create(conf_file));
+	}
+
+	~flash_graph_fixture() {
+		graph_engine::destroy_flash_graph();
+	}
+};
+
+BOOST_GLOBAL_FIXTURE(flash_graph_fixture);
+
+BOOST_AUTO_TEST_SUITE (graph_delta_test)
+
+BOOST_AUTO_TEST_CASE (test_directed)
+{
+	test_merge(true);
+}
+
+BOOST_AUTO_TEST_CASE (test_undirected)
+{
+	test_merge(false);
+}
+
+BOOST_AUTO_TEST_CASE (test_log_directed)
+{
+	test_log(true);
+}
+
+BOOST_AUTO_TEST_CASE (test_log_undirected)
+{
+	test_log(false);
+}
+
+BOOST_AUTO_TEST_CASE (test_concurrent_log_directed)
+{
+	test_concurrent_log(true);
+}
+
+BOOST_AUTO_TEST_CASE (test_concurrent_log_undirected)
+{
+	test_concurrent_log(false);
+}
+
+BOOST_AUTO_TEST_CASE (test_compact_directed)
+{
+	test_compact(true, COMPACT_RANGE_NUM_EDGES);
+	test_compact(true, 100);
+}
+
+BOOST_AUTO_TEST_CASE (test_compact_undirected)
+{
+	test_compact(false, COMPACT_RANGE_NUM_EDGES);
+	test_compact(false, 100);
+}
+
+BOOST_AUTO_TEST_CASE (test_dynamic_directed)
+{
+	test_dynamic_graph(true);
+}
+
+BOOST_AUTO_TEST_CASE (test_dynamic_undirected)
+{
+	test_dynamic_graph(false);
+}
+
+BOOST_AUTO_TEST_CASE (test_compact_fail)
+{
+	test_compact_failure();
+}
+
+BOOST_AUTO_TEST_CASE (test_incremental_pr)
+{
+	test_incremental_pagerank();
+}
+
+BOOST_AUTO_TEST_CASE (test_incremental_cc)
+{
+	test_incremental_wcc();
+}
+
+BOOST_AUTO_TEST_SUITE_END( )
@@ -0,0 +1,434 @@
+/*
+ * Copyright 2015 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of FlashGraph.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+#include <set>
+#include <map>
+
+#include <boost/foreach.hpp>
+
+#define BOOST_TEST_MODULE in_mem_csr
+#include <boost/test/included/unit_test.hpp>
+
+#include "graph_engine.h"
+#include "graph.h"
+#include "in_mem_storage.h"
+#include "FGlib.h"
+
+using namespace fg;
+
+static const std::string conf_file = "conf/run_test.txt";
+
+const size_t num_vertices = 3000;
+// The hub has more edges than a page can hold.
+const vertex_id_t hub = 17;
+
+typedef std::map<vertex_id_t, std::set<vertex_id_t> > adj_map_t;
+
+/*
+ * Generate a random graph. Some vertices don't have edges and the hub
+ * connects to half of the vertices. In a directed graph, `out' has
+ * the out-edges and `in' has the in-edges. In an undirected graph,
+ * `in' has all edges.
+ */
+static void gen_graph(bool directed, adj_map_t &in, adj_map_t &out)
+{
+	in.clear();
+	out.clear();
+	for (size_t i = 0; i < num_vertices * 5; i++) {
+		vertex_id_t from = random() % num_vertices;
+		vertex_id_t to = random() % num_vertices;
+		// The vertices whose ids are multiples of 10 don't have edges.
+		if (from % 10 == 0 || to % 10 == 0)
+			continue;
+		out[from].insert(to);
+		in[to].insert(from);
+	}
+	for (vertex_id_t id = 1; id < num_vertices; id += 2) {
+		if (id % 10 == 0 || id == hub)
+			continue;
+		out[hub].insert(id);
+		in[id].insert(hub);
+	}
+	if (!directed) {
+		for (adj_map_t::const_iterator it = out.begin(); it != out.end(); it++)
+			in[it->first].insert(it->second.begin(), it->second.end());
+		out.clear();
+	}
+}
+
+static FG_graph::ptr create_graph(bool directed, adj_map_t &in, adj_map_t &out)
+{
+	graph_type type = directed ? graph_type::DIRECTED : graph_type::UNDIRECTED;
+	in_mem_subgraph::ptr subg = in_mem_subgraph::create(type, false);
+	for (vertex_id_t id = 0; id < num_vertices; id++) {
+		if (directed) {
+			in_mem_directed_vertex<> v(id, false);
+			BOOST_FOREACH(vertex_id_t neigh, in[id])
+				v.add_in_edge(edge<empty_data>(neigh, id));
+			BOOST_FOREACH(vertex_id_t neigh, out[id])
+				v.add_out_edge(edge<empty_data>(id, neigh));
+			subg->add_vertex(v);
+		}
+		else {
+			in_mem_undirected_vertex<> v(id, false);
+			BOOST_FOREACH(vertex_id_t neigh, in[id])
+				v.add_edge(edge<empty_data>(id, neigh));
+			subg->add_vertex(v);
+		}
+	}
+	std::pair<in_mem_graph::ptr, vertex_index::ptr> ret
+		= subg->serialize("csr-test", false);
+	return FG_graph::create(ret.first, ret.second, "csr-test",
+			config_map::create(conf_file));
+}
+
+/*
+ * What a vertex sees. In an undirected graph, only `in' is used.
+ */
+struct vertex_result
+{
+	std::vector<vertex_id_t> in;
+	std::vector<vertex_id_t> out;
+	// The checksums of the adjacency lists and the headers of
+	// the neighbors. They don't depend on the order in which the neighbors
+	// are served.
+	size_t neigh_sum;
+	size_t num_neighs;
+	size_t header_sum;
+	size_t num_headers;
+
+	vertex_result() {
+		neigh_sum = 0;
+		num_neighs = 0;
+		header_sum = 0;
+		num_headers = 0;
+	}
+
+	bool operator==(const vertex_result &res) const {
+		return in == res.in && out == res.out && neigh_sum == res.neigh_sum
+			&& num_neighs == res.num_neighs && header_sum == res.header_sum
+			&& num_headers == res.num_headers;
+	}
+};
+
+static std::vector<vertex_result> results;
+static bool directed_graph;
+
+static void get_neighs(const page_vertex &vertex, edge_type type,
+		std::vector<vertex_id_t> &neighs)
+{
+	safs::page_byte_array::seq_const_iterator<vertex_id_t> it
+		= vertex.get_neigh_seq_it(type);
+	while (it.has_next())
+		neighs.push_back(it.next());
+}
+
+static size_t get_checksum(const page_vertex &vertex, edge_type type)
+{
+	size_t sum = vertex.get_id();
+	safs::page_byte_array::seq_const_iterator<vertex_id_t> it
+		= vertex.get_neigh_seq_it(type);
+	while (it.has_next())
+		sum = sum * 31 + it.next();
+	return sum * (type + 1);
+}
+
+/*
+ * A vertex reads its own adjacency list first. Then, it reads the other
+ * direction of the adjacency lists of its neighbors and the headers of
+ * its neighbors.
+ */
+class csr_test_vertex: public compute_directed_vertex
+{
+	bool has_self;
+public:
+	csr_test_vertex(vertex_id_t id): compute_directed_vertex(id) {
+		has_self = false;
+	}
+
+	void run(vertex_program &prog) {
+		vertex_id_t id = prog.get_vertex_id(*this);
+		request_vertices(&id, 1);
+	}
+
+	void run(vertex_program &prog, const page_vertex &vertex) {
+		vertex_id_t id = prog.get_vertex_id(*this);
+		vertex_result &res = results[id];
+		if (has_self) {
+			if (vertex.is_directed()) {
+				edge_type type = vertex.get_num_edges(IN_EDGE) > 0
+					? IN_EDGE : OUT_EDGE;
+				res.neigh_sum += get_checksum(vertex, type);
+			}
+			else
+				res.neigh_sum += get_checksum(vertex, BOTH_EDGES);
+			res.num_neighs++;
+			return;
+		}
+
+		has_self = true;
+		assert(vertex.get_id() == id);
+		std::vector<vertex_id_t> neighs;
+		if (vertex.is_directed()) {
+			get_neighs(vertex, IN_EDGE, res.in);
+			get_neighs(vertex, OUT_EDGE, res.out);
+			std::vector<directed_vertex_request> reqs;
+			for (size_t i = 0; i < res.out.size(); i++)
+				reqs.push_back(directed_vertex_request(res.out[i], IN_EDGE));
+			for (size_t i = 0; i < res.in.size(); i++)
+				reqs.push_back(directed_vertex_request(res.in[i], OUT_EDGE));
+			if (!reqs.empty())
+				request_partial_vertices(reqs.data(), reqs.size());
+			neighs = res.in;
+			neighs.insert(neighs.end(), res.out.begin(), res.out.end());
+		}
+		else {
+			get_neighs(vertex, BOTH_EDGES, res.in);
+			neighs = res.in;
+			if (!neighs.empty())
+				request_vertices(neighs.data(), neighs.size());
+		}
+		if (!neighs.empty())
+			request_vertex_headers(neighs.data(), neighs.size());
+	}
+
+	void run_on_vertex_header(vertex_program &prog,
+			const vertex_header &header) {
+		vertex_result &res = results[prog.get_vertex_id(*this)];
+		size_t sum = header.get_id();
+		if (directed_graph) {
+			const directed_vertex_header &dheader
+				= (const directed_vertex_header &) header;
+			sum = sum * 31 + dheader.get_num_in_edges();
+			sum = sum * 31 + dheader.get_num_out_edges();
+		}
+		else
+			sum = sum * 31 + header.get_num_edges();
+		res.header_sum += sum;
+		res.num_headers++;
+	}
+
+	void run_on_message(vertex_program &prog, const vertex_message &msg) {
+	}
+};
+
+/*
+ * This records the vertices whose state the graph engine prefetches.
+ */
+class prefetch_recorder: public vertex_state_base
+{
+	mutable std::vector<std::atomic<bool> > prefetched;
+public:
+	prefetch_recorder(): prefetched(num_vertices) {
+		for (size_t i = 0; i < prefetched.size(); i++)
+			prefetched[i] = false;
+	}
+
+	virtual void prefetch(vertex_id_t id) const {
+		prefetched[id] = true;
+	}
+
+	std::set<vertex_id_t> get_prefetched() const {
+		std::set<vertex_id_t> ids;
+		for (vertex_id_t id = 0; id < num_vertices; id++)
+			if (prefetched[id])
+				ids.insert(id);
+		return ids;
+	}
+};
+
+/*
+ * The graph engine accesses the in-mem graph directly if `csr' is true.
+ * Otherwise, it reads the graph with the in-mem I/O of SAFS.
+ * If `prefetch' is set, the engine prefetches it for the neighbors.
+ */
+static std::vector<vertex_result> run_graph(FG_graph::ptr fg, bool csr,
+		std::shared_ptr<prefetch_recorder> prefetch = NULL)
+{
+	config_map::ptr configs = config_map::create(conf_file);
+	if (csr)
+		configs->add_options("in_mem_csr=");
+	graph_conf = graph_config();
+	graph_conf.init(configs);
+
+	results.clear();
+	results.resize(num_vertices);
+	graph_index::ptr index = NUMA_graph_index<csr_test_vertex>::create(
+			fg->get_graph_header());
+	graph_engine::ptr graph = fg->create_engine(index);
+	BOOST_REQUIRE((graph->get_in_mem_csr() != NULL) == csr);
+	if (prefetch)
+		graph->set_neighbor_prefetch(BOTH_EDGES,
+				std::vector<vertex_state_base::const_ptr>(1, prefetch));
+	graph->start_all();
+	graph->wait4complete();
+	return results;
+}
+
+static void check_adj(const std::vector<vertex_id_t> &neighs,
+		const std::set<vertex_id_t> &expected)
+{
+	BOOST_CHECK(neighs.size() == expected.size());
+	BOOST_CHECK(std::equal(neighs.begin(), neighs.end(), expected.begin()));
+}
+
+static void test_csr(bool directed)
+{
+	adj_map_t in, out;
+	directed_graph = directed;
+	gen_graph(directed, in, out);
+	FG_graph::ptr fg = create_graph(directed, in, out);
+
+	// We run the engine on SAFS first and then on the CSR, and then in
+	// the reverse order, so the state left by one mode doesn't affect
+	// the other.
+	std::vector<vertex_result> io_res = run_graph(fg, false);
+	std::vector<vertex_result> csr_res = run_graph(fg, true);
+	std::vector<vertex_result> csr_res2 = run_graph(fg, true);
+	std::vector<vertex_result> io_res2 = run_graph(fg, false);
+	graph_conf = graph_config();
+	graph_conf.init(config_map::create(conf_file));
+
+	size_t tot_neighs = 0;
+	for (vertex_id_t id = 0; id < num_vertices; id++) {
+		check_adj(io_res[id].in, in[id]);
+		check_adj(io_res[id].out, out[id]);
+		size_t num_neighs = in[id].size() + out[id].size();
+		BOOST_CHECK(io_res[id].num_neighs == num_neighs);
+		BOOST_CHECK(io_res[id].num_headers == num_neighs);
+		tot_neighs += num_neighs;
+
+		BOOST_CHECK(csr_res[id] == io_res[id]);
+		BOOST_CHECK(csr_res2[id] == io_res[id]);
+		BOOST_CHECK(io_res2[id] == io_res[id]);
+	}
+	BOOST_CHECK(tot_neighs > 0);
+	BOOST_CHECK(in[hub].size() + out[hub].size() > safs::PAGE_SIZE
+			/ sizeof(vertex_id_t));
+}
+
+/*
+ * The engine prefetches the state of the first neighbors in each direction
+ * before a vertex runs. The CSR reader prefetches it a few requests ahead,
+ * so both modes should prefetch the same vertices and the vertices should
+ * see the same graph.
+ */
+static void test_csr_prefetch(bool directed)
+{
+	// graph_engine::prefetch_neighbor_state only prefetches these.
+	const size_t MAX_PREFETCH_NEIGHS = 256;
+	adj_map_t in, out;
+	directed_graph = directed;
+	gen_graph(directed, in, out);
+	FG_graph::ptr fg = create_graph(directed, in, out);
+
+	std::set<vertex_id_t> expected;
+	for (int i = 0; i < 2; i++) {
+		adj_map_t &adj = i == 0 ? in : out;
+		BOOST_FOREACH(const adj_map_t::value_type &v, adj) {
+			std::set<vertex_id_t>::const_iterator it = v.second.begin();
+			for (size_t j = 0; j < MAX_PREFETCH_NEIGHS
+					&& it != v.second.end(); j++, it++)
+				expected.insert(*it);
+		}
+	}
+
+	std::vector<vertex_result> io_res = run_graph(fg, false);
+	std::shared_ptr<prefetch_recorder> io_prefetch(new prefetch_recorder());
+	std::vector<vertex_result> io_res2 = run_graph(fg, false, io_prefetch);
+	std::shared_ptr<prefetch_recorder> csr_prefetch(new prefetch_recorder());
+	std::vector<vertex_result> csr_res = run_graph(fg, true, csr_prefetch);
+	graph_conf = graph_config();
+	graph_conf.init(config_map::create(conf_file));
+
+	BOOST_CHECK(io_prefetch->get_prefetched() == expected);
+	BOOST_CHECK(csr_prefetch->get_prefetched() == expected);
+	for (vertex_id_t id = 0; id < num_vertices; id++) {
+		BOOST_CHECK(io_res2[id] == io_res[id]);
+		BOOST_CHECK(csr_res[id] == io_res[id]);
+	}
+}
+
+/*
+ * The CSR doesn't support vertical partitioning, so the graph engine
+ * reads the graph with the in-mem I/O of SAFS instead.
+ */
+static void test_csr_vparts()
+{
+	adj_map_t in, out;
+	directed_graph = true;
+	gen_graph(true, in, out);
+	FG_graph::ptr fg = create_graph(true, in, out);
+
+	config_map::ptr configs = config_map::create(conf_file);
+	configs->add_options("in_mem_csr= num_vparts=2");
+	graph_conf = graph_config();
+	graph_conf.init(configs);
+	graph_index::ptr index = NUMA_graph_index<csr_test_vertex>::create(
+			fg->get_graph_header());
+	graph_engine::ptr graph = fg->create_engine(index);
+	BOOST_CHECK(graph->get_in_mem_csr() == NULL);
+	graph.reset();
+
+	graph_conf = graph_config();
+	graph_conf.init(config_map::create(conf_file));
+}
+
+struct flash_graph_fixture
+{
+	flash_graph_fixture() {
+		graph_engine::init_flash_graph(config_map::create(conf_file));
+	}
+
+	~flash_graph_fixture() {
+		graph_engine::destroy_flash_graph();
+	}
+};
+
+BOOST_GLOBAL_FIXTURE(flash_graph_fixture);
+
+BOOST_AUTO_TEST_SUITE (in_mem_csr_test)
+
+BOOST_AUTO_TEST_CASE (test_csr_directed)
+{
+	test_csr(true);
+}
+
+BOOST_AUTO_TEST_CASE (test_csr_undirected)
+{
+	test_csr(false);
+}
+
+BOOST_AUTO_TEST_CASE (test_csr_prefetch_directed)
+{
+	test_csr_prefetch(true);
+}
+
+BOOST_AUTO_TEST_CASE (test_csr_prefetch_undirected)
+{
+	test_csr_prefetch(false);
+}
+
+BOOST_AUTO_TEST_CASE (test_csr_vparts_rejected)
+{
+	test_csr_vparts();
+}
+
+BOOST_AUTO_TEST_SUITE_END( )
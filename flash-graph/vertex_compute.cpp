@@ -20,12 +20,34 @@
 #include "graph_engine.h"
 #include "worker_thread.h"
 #include "vertex_index_reader.h"
+#include "graph_delta.h"
+#include "in_mem_csr.h"
 
 using namespace safs;
 
 namespace fg
 {
 
+void run_vprog(vertex_program &vprog, compute_vertex &v,
+		const page_vertex &pg_v, const graph_engine &graph)
+{
+	// The CSR reader prefetches the neighbor state ahead of the runs
+	// when the graph is in memory.
+	bool prefetch = graph.get_in_mem_csr() == NULL;
+	const std::shared_ptr<graph_delta_store> &store = graph.get_delta_store();
+	if (store == NULL || !store->has_delta(pg_v.get_id())) {
+		if (prefetch)
+			graph.prefetch_neighbor_state(pg_v);
+		vprog.run(v, pg_v);
+	}
+	else {
+		delta_page_vertex merged(pg_v, *store);
+		if (prefetch)
+			graph.prefetch_neighbor_state(merged.get_vertex());
+		vprog.run(v, merged.get_vertex());
+	}
+}
+
 request_range vertex_compute::get_next_request()
 {
 	// Get the next vertex.
@@ -59,13 +81,21 @@ void vertex_compute::finish_run()
 void vertex_compute::request_vertices(vertex_id_t ids[], size_t num)
 {
 	num_requested += num;
-	issue_thread->get_index_reader().request_vertices(ids, num, *this);
+	csr_vertex_reader *csr_reader = issue_thread->get_csr_reader();
+	if (csr_reader)
+		csr_reader->request_vertices(ids, num, *this);
+	else
+		issue_thread->get_index_reader().request_vertices(ids, num, *this);
 }
 
 void vertex_compute::request_num_edges(vertex_id_t ids[], size_t num)
 {
 	num_edge_requests += num;
-	issue_thread->get_index_reader().request_num_edges(ids, num, *this);
+	csr_vertex_reader *csr_reader = issue_thread->get_csr_reader();
+	if (csr_reader)
+		csr_reader->request_num_edges(ids, num, *this);
+	else
+		issue_thread->get_index_reader().request_num_edges(ids, num, *this);
 }
 
 void vertex_compute::run_on_vertex_size(vertex_id_t id, vsize_t size)
@@ -100,14 +130,28 @@ void vertex_compute::run(page_byte_array &array)
 	num_complete_fetched++;
 	start_run();
 	page_undirected_vertex pg_v(array);
-	issue_thread->get_vertex_program(v.is_part()).run(*v, pg_v);
+	run_vprog(issue_thread->get_vertex_program(v.is_part()), *v,
+			pg_v, *graph);
+	finish_run();
+}
+
+void vertex_compute::run_on_vertex(const page_vertex &pg_v, int num_parts)
+{
+	// The vertex is passed to the vertex compute without I/O, so it's
+	// issued and fetched at the same time.
+	num_issued += num_parts;
+	num_complete_fetched += num_parts;
+	start_run();
+	run_vprog(issue_thread->get_vertex_program(v.is_part()), *v,
+			pg_v, *graph);
 	finish_run();
 }
 
 void directed_vertex_compute::run_on_page_vertex(page_directed_vertex &pg_v)
 {
 	start_run();
-	issue_thread->get_vertex_program(v.is_part()).run(*v, pg_v);
+	run_vprog(issue_thread->get_vertex_program(v.is_part()), *v,
+			pg_v, *graph);
 	finish_run();
 }
 
@@ -175,7 +219,11 @@ void directed_vertex_compute::request_partial_vertices(
 		else
 			num_requested++;
 	}
-	issue_thread->get_index_reader().request_vertices(reqs, num, *this);
+	csr_vertex_reader *csr_reader = issue_thread->get_csr_reader();
+	if (csr_reader)
+		csr_reader->request_vertices(reqs, num, *this);
+	else
+		issue_thread->get_index_reader().request_vertices(reqs, num, *this);
 }
 
 void directed_vertex_compute::run_on_vertex_size(vertex_id_t id,
@@ -216,8 +264,12 @@ void directed_vertex_compute::issue_io_request(const ext_mem_vertex_info &in_inf
 void directed_vertex_compute::request_num_edges(vertex_id_t ids[], size_t num)
 {
 	num_edge_requests += num;
-	issue_thread->get_index_reader().request_num_directed_edges(ids,
-			num, *this);
+	csr_vertex_reader *csr_reader = issue_thread->get_csr_reader();
+	if (csr_reader)
+		csr_reader->request_num_edges(ids, num, *this);
+	else
+		issue_thread->get_index_reader().request_num_directed_edges(ids,
+				num, *this);
 }
 
 void merged_vertex_compute::start_run(compute_vertex_pointer v)
@@ -252,7 +304,7 @@ void merged_undirected_vertex_compute::run(page_byte_array &array)
 		assert(pg_v.get_id() == id);
 		compute_vertex_pointer v(&get_graph().get_vertex(pg_v.get_id()));
 		start_run(v);
-		curr_vprog.run(*v, pg_v);
+		run_vprog(curr_vprog, *v, pg_v, get_graph());
 		finish_run(v);
 		off += pg_v.get_size();
 	}
@@ -274,7 +326,7 @@ void merged_directed_vertex_compute::run_on_array(page_byte_array &array)
 		assert(pg_v.get_id() == id);
 		compute_vertex_pointer v(&get_graph().get_vertex(pg_v.get_id()));
 		start_run(v);
-		curr_vprog.run(*v, pg_v);
+		run_vprog(curr_vprog, *v, pg_v, get_graph());
 		finish_run(v);
 		if (in_part)
 			off += pg_v.get_in_size();
@@ -299,7 +351,7 @@ void merged_directed_vertex_compute::run_on_arrays(page_byte_array &in_arr,
 		assert(pg_v.get_id() == id);
 		compute_vertex_pointer v(&get_graph().get_vertex(pg_v.get_id()));
 		start_run(v);
-		curr_vprog.run(*v, pg_v);
+		run_vprog(curr_vprog, *v, pg_v, get_graph());
 		finish_run(v);
 		in_off += pg_v.get_in_size();
 		out_off += pg_v.get_out_size();
@@ -377,7 +429,7 @@ void sparse_undirected_vertex_compute::run(page_byte_array &arr)
 			assert(pg_v.get_id() == id);
 			compute_vertex_pointer v(&get_graph().get_vertex(pg_v.get_id()));
 			start_run(v);
-			curr_vprog.run(*v, pg_v);
+			run_vprog(curr_vprog, *v, pg_v, get_graph());
 			finish_run(v);
 			off += pg_v.get_size();
 		}
@@ -402,7 +454,7 @@ void sparse_directed_vertex_compute::run_on_array(page_byte_array &arr)
 			assert(pg_v.get_id() == id);
 			compute_vertex_pointer v(&get_graph().get_vertex(pg_v.get_id()));
 			start_run(v);
-			curr_vprog.run(*v, pg_v);
+			run_vprog(curr_vprog, *v, pg_v, get_graph());
 			finish_run(v);
 			if (in_part)
 				off += pg_v.get_in_size();
@@ -437,7 +489,7 @@ void sparse_directed_vertex_compute::run_on_arrays(page_byte_array &in_arr,
 			assert(pg_v.get_id() == id);
 			compute_vertex_pointer v(&get_graph().get_vertex(pg_v.get_id()));
 			start_run(v);
-			curr_vprog.run(*v, pg_v);
+			run_vprog(curr_vprog, *v, pg_v, get_graph());
 			finish_run(v);
 			in_off += pg_v.get_in_size();
 			out_off += pg_v.get_out_size();
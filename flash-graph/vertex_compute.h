@@ -144,6 +144,13 @@ public:
 
 	virtual void run(safs::page_byte_array &);
 
+	/*
+	 * This is invoked when the requested vertex is read from the in-memory
+	 * graph directly. `num_parts' is the number of parts of the vertex
+	 * the page vertex contains.
+	 */
+	void run_on_vertex(const page_vertex &pg_v, int num_parts);
+
 	virtual bool has_completed() {
 		// If the user compute has got all requested data and it has
 		// no more requests to issue, we can consider the user compute
@@ -208,6 +215,14 @@ public:
 	}
 };
 
+/*
+ * Run the vertex program on a page vertex read from the graph.
+ * If the graph has updates that haven't been compacted, the updates of
+ * the vertex are merged into its adjacency lists first.
+ */
+void run_vprog(vertex_program &vprog, compute_vertex &v,
+		const page_vertex &pg_v, const graph_engine &graph);
+
 class directed_vertex_compute: public vertex_compute
 {
 	typedef std::unordered_map<vertex_id_t, safs::page_byte_array *> combine_map_t;
@@ -17,11 +17,14 @@
  * limitations under the License.
  */
 
+#include <math.h>
+
 #include <boost/format.hpp>
 
 #include "log.h"
 #include "io_interface.h"
 #include "safs_file.h"
+#include "in_mem_io.h"
 
 #include "vertex_compute.h"
 #include "vertex_index.h"
@@ -114,6 +117,17 @@ vertex_index::ptr vertex_index::load(const std::string &index_file)
 	return idx;
 }
 
+void vertex_index::safs_dump(const std::string &file) const
+{
+	// SAFS requires the memory for I/O to be aligned to pages, so we copy
+	// the index to a page-aligned buffer first.
+	size_t size = get_index_size();
+	NUMA_buffer::ptr buf = NUMA_buffer::create(size, NUMA_mapper(1,
+				(size_t) ceil(log2(std::max(size, (size_t) PAGE_SIZE)))));
+	buf->copy_from((const char *) this, size, 0);
+	buf->dump_safs(file);
+}
+
 vertex_index::ptr vertex_index::safs_load(const std::string &index_file)
 {
 	const int INDEX_HEADER_SIZE = PAGE_SIZE * 2;
@@ -115,6 +115,11 @@ public:
 		return h.data.compressed;
 	}
 
+	/*
+	 * Write the vertex index to a new file in SAFS.
+	 */
+	void safs_dump(const std::string &file) const;
+
 	void dump(const std::string &file) const {
 		FILE *f = fopen(file.c_str(), "w");
 		if (f == NULL) {
@@ -282,6 +282,20 @@ vertex_id_t vertex_program::get_vertex_id(const compute_vertex &v) const
 	return id;
 }
 
+local_vid_t vertex_program::get_local_id(const compute_vertex &v,
+		int &part_id) const
+{
+	part_id = t->get_worker_id();
+	local_vid_t local_id = graph->get_graph_index().get_local_id(part_id, v);
+	if (local_id.id == INVALID_VERTEX_ID) {
+		part_id = t->get_stolen_vertex_part(v);
+		assert(part_id >= 0);
+		local_id = graph->get_graph_index().get_local_id(part_id, v);
+		assert(local_id.id != INVALID_VERTEX_ID);
+	}
+	return local_id;
+}
+
 vertex_id_t vertex_program::get_vertex_id(compute_vertex_pointer v) const
 {
 	// The current thread is usually the owner thread of the compute vertex.
@@ -228,6 +228,11 @@ public:
 
 	vertex_id_t get_vertex_id(compute_vertex_pointer v) const;
 	vertex_id_t get_vertex_id(const compute_vertex &v) const;
+	/*
+	 * Get the location of a vertex in the graph index.
+	 * The vertex may be owned by another thread due to load balancing.
+	 */
+	local_vid_t get_local_id(const compute_vertex &v, int &part_id) const;
 	vsize_t get_num_edges(vertex_id_t id) const;
 	int get_partition_id() const {
 		return part_id;
@@ -0,0 +1,226 @@
+#ifndef __VERTEX_STATE_H__
+#define __VERTEX_STATE_H__
+
+/*
+ * Copyright 2014 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of FlashGraph.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <numa.h>
+
+#include <memory>
+#include <vector>
+
+#include "comm_exception.h"
+
+#include "graph_engine.h"
+#include "partitioner.h"
+#include "FG_vector.h"
+
+namespace fg
+{
+
+/**
+ * \brief A column of per-vertex state stored as a structure of arrays.
+ *
+ * Instead of keeping all state of a vertex in its `compute_vertex` object,
+ * an algorithm can declare a column for each field of the vertex state.
+ * A column is split in the same way as the vertices are partitioned among
+ * the worker threads, and each partition is allocated on the NUMA node of
+ * the thread that owns the partition. An algorithm that touches a single
+ * field of many vertices, e.g., the visited flag in BFS or the PageRank of
+ * in-neighbors, only brings the field into the CPU cache.
+ *
+ * The vertex type used with columns should keep as little state as possible,
+ * so the vertex array in the graph index stays small as well.
+ *
+ * A column can be passed to `graph_engine::set_neighbor_prefetch', so
+ * the graph engine prefetches the state of the neighbors of a vertex
+ * before the vertex runs on its adjacency list.
+ */
+template<class T>
+class vertex_column: public vertex_state_base
+{
+	struct partition
+	{
+		T *data;
+		size_t size;
+	};
+
+	const graph_partitioner &partitioner;
+	size_t num_vertices;
+	std::vector<partition> parts;
+
+	vertex_column(graph_engine &graph): partitioner(
+			*graph.get_partitioner()) {
+		num_vertices = graph.get_num_vertices();
+		int num_parts = partitioner.get_num_partitions();
+		int num_nodes = graph.get_num_nodes();
+		parts.resize(num_parts);
+		for (int i = 0; i < num_parts; i++) {
+			parts[i].size = partitioner.get_part_size(i, num_vertices);
+			parts[i].data = NULL;
+			if (parts[i].size == 0)
+				continue;
+			// A partition is processed by the worker thread with the same ID,
+			// which runs on node `i % num_nodes'.
+			parts[i].data = (T *) numa_alloc_onnode(sizeof(T) * parts[i].size,
+					i % num_nodes);
+			if (parts[i].data == NULL)
+				throw oom_exception("can't allocate a vertex column");
+		}
+	}
+public:
+	typedef std::shared_ptr<vertex_column<T> > ptr;
+
+	/**
+	 * \brief Create a column for all vertices in the graph and initialize
+	 *        all elements with the same value.
+	 * \param graph The graph engine that runs the algorithm.
+	 * \param init_val The initial value of the elements.
+	 */
+	static ptr create(graph_engine &graph, const T &init_val = T()) {
+		ptr col(new vertex_column<T>(graph));
+		col->fill(init_val);
+		return col;
+	}
+
+	~vertex_column() {
+		for (size_t i = 0; i < parts.size(); i++)
+			if (parts[i].data)
+				numa_free(parts[i].data, sizeof(T) * parts[i].size);
+	}
+
+	/**
+	 * \brief Get the state of a vertex with its ID.
+	 */
+	T &get(vertex_id_t id) {
+		int part_id;
+		off_t off;
+		partitioner.map2loc(id, part_id, off);
+		return parts[part_id].data[off];
+	}
+
+	const T &get(vertex_id_t id) const {
+		int part_id;
+		off_t off;
+		partitioner.map2loc(id, part_id, off);
+		return parts[part_id].data[off];
+	}
+
+	/**
+	 * \brief Get the state of a vertex run by a vertex program.
+	 *        The state is located by the position of the vertex in
+	 *        the graph index, so we don't need to map its vertex ID.
+	 */
+	T &get(const vertex_program &prog, const compute_vertex &v) {
+		int part_id;
+		local_vid_t local_id = prog.get_local_id(v, part_id);
+		return parts[part_id].data[local_id.id];
+	}
+
+	T &get(int part_id, local_vid_t id) {
+		return parts[part_id].data[id.id];
+	}
+
+	/**
+	 * \brief Issue a prefetch for the state of a vertex.
+	 */
+	virtual void prefetch(vertex_id_t id) const {
+		__builtin_prefetch(&get(id));
+	}
+
+	/**
+	 * \brief Read the state of a set of vertices. The state of
+	 *        the vertices a few steps ahead is prefetched.
+	 */
+	void gather(const vertex_id_t ids[], size_t num, T vals[]) const {
+		const size_t PREFETCH_DIST = 8;
+		size_t i = 0;
+		for (; i < std::min(num, PREFETCH_DIST); i++)
+			__builtin_prefetch(&get(ids[i]));
+		for (i = 0; i + PREFETCH_DIST < num; i++) {
+			__builtin_prefetch(&get(ids[i + PREFETCH_DIST]));
+			vals[i] = get(ids[i]);
+		}
+		for (; i < num; i++)
+			vals[i] = get(ids[i]);
+	}
+
+	/**
+	 * \brief Apply a function to the state of every vertex.
+	 *        The partitions are processed in parallel.
+	 * \param func The function is invoked as `func(vertex_id_t, T &)'.
+	 */
+	template<class Func>
+	void for_each(Func func) {
+#pragma omp parallel for
+		for (size_t i = 0; i < parts.size(); i++) {
+			for (size_t off = 0; off < parts[i].size; off++) {
+				vertex_id_t id;
+				partitioner.loc2map(i, off, id);
+				// The last partition may have a padding vertex.
+				if (id < num_vertices)
+					func(id, parts[i].data[off]);
+			}
+		}
+	}
+
+	void fill(const T &val) {
+#pragma omp parallel for
+		for (size_t i = 0; i < parts.size(); i++)
+			std::fill(parts[i].data, parts[i].data + parts[i].size, val);
+	}
+
+	/**
+	 * \brief Count the vertices whose state equals to the value.
+	 */
+	size_t count(const T &val) const {
+		size_t num = 0;
+#pragma omp parallel for reduction(+:num)
+		for (size_t i = 0; i < parts.size(); i++) {
+			for (size_t off = 0; off < parts[i].size; off++) {
+				vertex_id_t id;
+				partitioner.loc2map(i, off, id);
+				if (id < num_vertices && parts[i].data[off] == val)
+					num++;
+			}
+		}
+		return num;
+	}
+
+	/**
+	 * \brief Copy the column to a vector indexed by vertex ID.
+	 */
+	typename FG_vector<T>::ptr to_vector() const {
+		typename FG_vector<T>::ptr vec = FG_vector<T>::create(num_vertices);
+#pragma omp parallel for
+		for (size_t i = 0; i < parts.size(); i++) {
+			for (size_t off = 0; off < parts[i].size; off++) {
+				vertex_id_t id;
+				partitioner.loc2map(i, off, id);
+				if (id < num_vertices)
+					vec->set(id, parts[i].data[off]);
+			}
+		}
+		return vec;
+	}
+};
+
+}
+
+#endif
@@ -29,6 +29,8 @@
 #include "load_balancer.h"
 #include "steal_state.h"
 #include "vertex_index_reader.h"
+#include "in_mem_csr.h"
+#include "vertex_state.h"
 
 using namespace safs;
 
@@ -344,7 +346,8 @@ worker_thread::worker_thread(graph_engine *graph,
 		int node_id, int worker_id, int num_threads,
 		vertex_scheduler::ptr scheduler,
 		std::shared_ptr<slab_allocator> msg_alloc): thread("worker_thread",
-			node_id), index(graph->get_graph_index())
+			node_id, safs::get_worker_cpus(node_id)),
+	index(graph->get_graph_index())
 {
 	this->scheduler = scheduler;
 	req_on_vertex = false;
@@ -436,6 +439,9 @@ void worker_thread::init()
 				graph->get_graph_header().get_graph_type() == graph_type::DIRECTED,
 				this);
 	}
+	if (graph->get_in_mem_csr())
+		csr_reader = std::unique_ptr<csr_vertex_reader>(new csr_vertex_reader(
+					*this, *graph->get_in_mem_csr()));
 
 	if (!started_vertices.empty()) {
 		assert(curr_activated_vertices->is_empty());
@@ -518,11 +524,27 @@ int worker_thread::process_activated_vertices(int max)
 		graph->process_vertices(num);
 	}
 
+	const std::shared_ptr<vertex_column<bool> > &run_flags
+		= graph->get_run_flags();
+	bool past_max_iters = graph->get_curr_level() >= graph->get_max_num_iters();
 	for (int i = 0; i < num; i++) {
 		compute_vertex_pointer info = process_vertex_buf[i];
+		vertex_program &curr_vprog = get_vertex_program(info.is_part());
+		// The vertices that aren't scheduled to run complete right away.
+		if (past_max_iters) {
+			complete_vertex(info);
+			continue;
+		}
+		if (run_flags && !info.is_part()) {
+			bool &flag = run_flags->get(curr_vprog, *info);
+			if (!flag) {
+				complete_vertex(info);
+				continue;
+			}
+			flag = false;
+		}
 		// We execute the pre-run to determine if the vertex has completed
 		// in the current iteration.
-		vertex_program &curr_vprog = get_vertex_program(info.is_part());
 		start_run_vertex(info);
 		curr_vprog.run(*info);
 		bool issued_reqs = finish_run_vertex(info);
@@ -530,6 +552,10 @@ int worker_thread::process_activated_vertices(int max)
 		// the vertex has completed in this iteration.
 		if (!issued_reqs)
 			complete_vertex(info);
+		// The requests on the in-mem graph are served right away while
+		// the state of the vertex is still in the CPU cache.
+		else if (csr_reader)
+			csr_reader->process_requests();
 	}
 	return num;
 }
@@ -578,7 +604,12 @@ void worker_thread::run()
 					- get_num_vertices_processing());
 			num_visited += num;
 			msg_processor->process_msgs();
+			if (csr_reader)
+				csr_reader->process_requests();
 			index_reader->wait4complete(0);
+			if (graph->is_no_cache())
+				for (size_t i = 0; i < adj_reqs.size(); i++)
+					adj_reqs[i].set_no_cache(true);
 			io->access(adj_reqs.data(), adj_reqs.size());
 			adj_reqs.clear();
 			if (io->num_pending_ios() == 0 && index_reader->get_num_pending_tasks() > 0)
@@ -594,6 +625,7 @@ void worker_thread::run()
 				// other threads in order to balance the load.
 				|| graph->get_num_remaining_vertices() > 0);
 		assert(index_reader->get_num_pending_tasks() == 0);
+		assert(csr_reader == NULL || csr_reader->get_num_pending_tasks() == 0);
 		assert(io->num_pending_ios() == 0);
 		assert(active_computes.size() == 0);
 		assert(curr_activated_vertices->is_empty());
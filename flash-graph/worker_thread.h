@@ -286,6 +286,7 @@ class steal_state_t;
 class message_processor;
 class load_balancer;
 class simple_index_reader;
+class csr_vertex_reader;
 
 class worker_thread: public thread
 {
@@ -303,6 +304,9 @@ class worker_thread: public thread
 	// Vertex program on the vertically partitioned vertices.
 	vertex_program::ptr vpart_vprogram;
 	std::shared_ptr<simple_index_reader> index_reader;
+	// It serves the vertex requests if the graph engine accesses
+	// the in-mem graph directly. Otherwise, it's NULL.
+	std::unique_ptr<csr_vertex_reader> csr_reader;
 
 	// This buffers the I/O requests for adjacency lists.
 	std::vector<safs::io_request> adj_reqs;
@@ -465,6 +469,10 @@ public:
 		return *index_reader;
 	}
 
+	csr_vertex_reader *get_csr_reader() {
+		return csr_reader.get();
+	}
+
 	void issue_io_request(safs::io_request &req) {
 		adj_reqs.push_back(req);
 	}
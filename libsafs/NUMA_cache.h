@@ -61,13 +61,39 @@ public:
 		return caches[idx]->search(pg_id, old_id);
 	}
 
+	virtual page *search(const page_id_t &pg_id, page_id_t &old_id,
+			bool no_cache) {
+		int idx = cache_conf->page2cache(pg_id);
+		return caches[idx]->search(pg_id, old_id, no_cache);
+	}
+
 	virtual page *search(const page_id_t &pg_id) {
 		int idx = cache_conf->page2cache(pg_id);
 		return caches[idx]->search(pg_id);
 	}
 
 	virtual long size() {
-		return cache_conf->get_size();
+		long tot = 0;
+		for (size_t i = 0; i < caches.size(); i++)
+			tot += caches[i]->size();
+		return tot;
+	}
+
+	/*
+	 * Memory is reclaimed from the caches on all nodes evenly.
+	 */
+	virtual long reclaim(long size) {
+		long tot = 0;
+		for (size_t i = 0; i < caches.size() && tot < size; i++)
+			tot += caches[i]->reclaim((size - tot) / (caches.size() - i));
+		return tot;
+	}
+
+	virtual long regrow(long size) {
+		long tot = 0;
+		for (size_t i = 0; i < caches.size() && tot < size; i++)
+			tot += caches[i]->regrow((size - tot) / (caches.size() - i));
+		return tot;
 	}
 
 	// TODO shouldn't I use a different underlying IO for cache
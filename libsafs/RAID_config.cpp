@@ -17,12 +17,19 @@
  * limitations under the License.
  */
 
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <limits.h>
+
+#include <fstream>
+
 #include <boost/format.hpp>
 
 #include "log.h"
 #include "RAID_config.h"
 #include "file_mapper.h"
 #include "native_file.h"
+#include "thread.h"
 
 namespace safs
 {
@@ -131,6 +138,38 @@ std::set<int> RAID_config::get_node_ids() const
 	return node_ids;
 }
 
+/*
+ * Find the NUMA node that the disk of a directory is attached to.
+ * We walk up the device hierarchy of the block device in sysfs until we
+ * find the PCI device, which tells us its NUMA node.
+ * It returns -1 if we can't find the NUMA node, e.g., the directory is
+ * on a software RAID.
+ */
+static int get_disk_node_id(const std::string &path)
+{
+	struct stat st;
+	if (stat(path.c_str(), &st) < 0)
+		return -1;
+	std::string dev_path = str(boost::format("/sys/dev/block/%1%:%2%")
+			% major(st.st_dev) % minor(st.st_dev));
+	char real_path[PATH_MAX];
+	if (realpath(dev_path.c_str(), real_path) == NULL)
+		return -1;
+
+	std::string dir = real_path;
+	while (dir.size() > strlen("/sys/devices")) {
+		std::ifstream in((dir + "/numa_node").c_str());
+		int node_id = -1;
+		if (in.good() && (in >> node_id) && node_id >= 0)
+			return node_id;
+		size_t pos = dir.rfind('/');
+		if (pos == std::string::npos)
+			break;
+		dir = dir.substr(0, pos);
+	}
+	return -1;
+}
+
 static int retrieve_data_files(std::string file_file,
 		std::vector<part_file_info> &data_files)
 {
@@ -153,7 +192,7 @@ static int retrieve_data_files(std::string file_file,
 
 		char *colon = strstr(line, ":");
 		char *name = line;
-		int node_id = 0;
+		int node_id = -1;
 		if (colon) {
 			*colon = 0;
 			std::string node_id_str = line;
@@ -187,6 +226,16 @@ static int retrieve_data_files(std::string file_file,
 			break;
 		}
 
+		// If the NUMA node isn't specified, we use the one that the disk
+		// is attached to, so the I/O thread of the disk runs close to it.
+		if (node_id < 0) {
+			node_id = get_disk_node_id(path_name);
+			if (node_id < 0 || cpus.get_os_node(node_id) == NULL)
+				node_id = 0;
+			BOOST_LOG_TRIVIAL(info) << boost::format(
+					"%1% is attached to NUMA node %2%") % path_name % node_id;
+		}
+
 		data_files.emplace_back(path_name, disk_id, node_id);
 		free(line);
 		line = NULL;
@@ -27,6 +27,7 @@
 #include "file_partition.h"
 #include "slab_allocator.h"
 #include "virt_aio_ctx.h"
+#include "timer.h"
 
 template class blocking_FIFO_queue<safs::thread_callback_s *>;
 
@@ -116,10 +117,18 @@ async_io::async_io(const logical_file_partition &partition,
 	cb_allocator = new callback_allocator(node_id,
 			AIO_DEPTH * sizeof(thread_callback_s));;
 	buf_idx = 0;
-	ctx = new aio_ctx_impl(node_id, AIO_DEPTH);
+	// The virtual AIO emulates SSDs, so we can evaluate the system
+	// without real SSDs.
+	if (params.is_use_virt_aio())
+		ctx = new virt_aio_ctx(NULL, node_id, AIO_DEPTH);
+	else
+		ctx = new aio_ctx_impl(node_id, AIO_DEPTH);
 
 	num_iowait = 0;
 	num_completed_reqs = 0;
+	if (params.is_hybrid_poll())
+		poller = std::unique_ptr<hybrid_poller>(
+				new hybrid_poller(params.get_max_poll_us()));
 	open_flags = flags;
 	if (partition.is_active()) {
 		int file_id = partition.get_file_id();
@@ -211,9 +220,44 @@ struct iocb *async_io::construct_req(io_request &io_req, callback_t cb_func)
 	}
 }
 
+int async_io::wait4complete(int num)
+{
+	if (poller == NULL)
+		return ctx->io_wait(NULL, num);
+
+	int num_completed = 0;
+	int64_t poll_time = poller->get_poll_time();
+	if (poll_time > 0) {
+		struct timespec zero = {0, 0};
+		int64_t start = get_curr_time_us();
+		int64_t curr;
+		do {
+			int ret = ctx->io_wait(&zero, 0);
+			if (ret > 0)
+				num_completed += ret;
+			curr = get_curr_time_us();
+		} while (num_completed < num && curr - start < poll_time);
+		poller->record_completions(num_completed, curr);
+		if (num_completed >= num) {
+			poller->poll_hit(curr - start);
+			return num_completed;
+		}
+		poller->poll_miss(curr - start);
+	}
+
+	poller->wakeup();
+	int ret = ctx->io_wait(NULL, num - num_completed);
+	if (ret > 0) {
+		poller->record_completions(ret, get_curr_time_us());
+		num_completed += ret;
+	}
+	return num_completed;
+}
+
 void async_io::access(io_request *requests, int num, io_status *status)
 {
 	ASSERT_EQ(get_thread(), thread::get_curr_thread());
+	trace_access(requests, num);
 	while (num > 0) {
 		int slot = ctx->max_io_slot();
 		if (slot == 0) {
@@ -222,7 +266,7 @@ void async_io::access(io_request *requests, int num, io_status *status)
 			 * as long as there is a slot available.
 			 */
 			num_iowait++;
-			ctx->io_wait(NULL, 1);
+			wait4complete(1);
 			slot = ctx->max_io_slot();
 		}
 		struct iocb *reqs[slot];
@@ -246,18 +290,20 @@ void async_io::access(io_request *requests, int num, io_status *status)
 
 class aio_complete_thread: public thread
 {
-	thread_safe_FIFO_queue<thread_callback_s *> completed_reqs;
+	static const int FETCH_BUF_SIZE = 1024;
+	// The I/O threads on the node add completed requests to the queue.
+	// If it's full, they process the requests themselves.
+	mpsc_ring_queue<thread_callback_s *> completed_reqs;
 public:
 	aio_complete_thread(int node_id): thread(std::string("aio_complete")
 			+ itoa(node_id), node_id), completed_reqs(
 			std::string("aio_complete_queue-") + itoa(node_id), node_id, 10240) {
 	}
 	void run() {
-		int num = completed_reqs.get_num_entries();
-		thread_callback_s *tcbs[num];
-		int ret = completed_reqs.fetch(tcbs, num);
-		assert(ret == num);
-		process_completed_reqs(tcbs, ret);
+		thread_callback_s *tcbs[FETCH_BUF_SIZE];
+		int ret;
+		while ((ret = completed_reqs.fetch(tcbs, FETCH_BUF_SIZE)) > 0)
+			process_completed_reqs(tcbs, ret);
 	}
 
 	int add_reqs(thread_callback_s *tcbs[], int num) {
@@ -28,6 +28,7 @@
 #include "thread.h"
 #include "container.h"
 #include "io_request.h"
+#include "hybrid_poller.h"
 
 namespace safs
 {
@@ -51,6 +52,8 @@ class async_io: public io_interface
 
 	int num_iowait;
 	int num_completed_reqs;
+	// It's only used in the hybrid polling mode.
+	std::unique_ptr<hybrid_poller> poller;
 
 	class io_ref
 	{
@@ -138,9 +141,11 @@ public:
 	}
 
 	virtual void notify_completion(io_request *reqs[], int num);
-	int wait4complete(int num) {
-		return ctx->io_wait(NULL, num);
-	}
+	/*
+	 * In the hybrid polling mode, we poll the AIO context for a while
+	 * before we block.
+	 */
+	int wait4complete(int num);
 	virtual int get_max_num_pending_ios() const {
 		return AIO_DEPTH;
 	}
@@ -155,6 +160,13 @@ public:
 		return num_completed_reqs;
 	}
 
+	/*
+	 * It returns NULL if we don't use the hybrid polling mode.
+	 */
+	const hybrid_poller *get_poller() const {
+		return poller.get();
+	}
+
 	virtual void flush_requests();
 
 	// These two interfaces allow users to open and close more files.
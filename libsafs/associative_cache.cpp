@@ -32,6 +32,21 @@ namespace safs
 {
 
 const long default_init_cache_size = 128 * 1024 * 1024;
+// The max number of pages added to the cache by expand() at a time
+// when it grows back.
+const int GROW_NPAGES = 4096;
+
+static inline uint64_t get_sketch_key(const page_id_t &pg_id)
+{
+	return (((uint64_t) pg_id.get_file_id()) << 48)
+		^ (pg_id.get_offset() / PAGE_SIZE);
+}
+
+static inline bool same_page(const page_id_t &pg_id, const page *pg)
+{
+	return pg->get_offset() == pg_id.get_offset()
+		&& pg->get_file_id() == pg_id.get_file_id();
+}
 
 template<class T>
 void page_cell<T>::set_pages(char *pages[], int num, int node_id)
@@ -112,7 +127,9 @@ void page_cell<T>::steal_pages(T pages[], int &npages)
 template<class T>
 void page_cell<T>::sanity_check() const
 {
-	assert(params.get_SA_min_cell_size() <= num_pages);
+	// A cell may have fewer pages than the min cell size after memory
+	// is reclaimed from the cache.
+	assert(CELL_RECLAIM_MIN_NUM_PAGES <= num_pages);
 	int num_used_pages = 0;
 	for (int i = 0; i < CELL_SIZE; i++)
 		if (buf[i].get_data())
@@ -169,7 +186,7 @@ void hash_cell::add_pages(char *pages[], int num)
 
 int hash_cell::add_pages_to_min(char *pages[], int num)
 {
-	int num_required = CELL_MIN_NUM_PAGES - buf.get_num_pages();
+	int num_required = params.get_SA_min_cell_size() - buf.get_num_pages();
 	if (num_required > 0) {
 		num_required = min(num_required, num);
 		buf.add_pages(pages, num_required, table->get_node_id());
@@ -281,19 +298,46 @@ void hash_cell::rehash(hash_cell *expanded)
 	pthread_spin_unlock(&_lock);
 }
 
+/*
+ * A page can be stolen if nobody uses it and its data doesn't need to be
+ * written back.
+ */
+static inline bool can_steal(const thread_safe_page *pg)
+{
+	return pg->get_ref() == 0 && !pg->is_dirty() && !pg->is_old_dirty()
+		&& !pg->is_io_pending() && !pg->is_prepare_writeback();
+}
+
 void hash_cell::steal_pages(char *pages[], int &npages)
 {
+	pthread_spin_lock(&_lock);
+	thread_safe_page *stolen_pointers[CELL_SIZE];
 	int num_stolen = 0;
-	while (num_stolen < npages) {
-		thread_safe_page *pg = get_empty_page();
-		if (pg == NULL)
-			break;
-		assert(!pg->is_dirty());
-		pages[num_stolen++] = (char *) pg->get_data();
-		*pg = thread_safe_page();
+	// We steal the empty pages first and then the clean pages.
+	for (unsigned int i = 0; i < buf.get_num_pages()
+			&& num_stolen < npages; i++) {
+		thread_safe_page *pg = buf.get_page(i);
+		if (!pg->initialized() && can_steal(pg))
+			stolen_pointers[num_stolen++] = pg;
+	}
+	for (unsigned int i = 0; i < buf.get_num_pages()
+			&& num_stolen < npages; i++) {
+		thread_safe_page *pg = buf.get_page(i);
+		if (pg->initialized() && can_steal(pg))
+			stolen_pointers[num_stolen++] = pg;
+	}
+	// We can't steal pages while iterating them.
+	for (int i = 0; i < num_stolen; i++) {
+		thread_safe_page *pg = stolen_pointers[i];
+		if (same_page(probation_id, pg))
+			probation_id = page_id_t();
+		pages[i] = (char *) pg->get_data();
 		buf.steal_page(pg, false);
+		*pg = thread_safe_page();
 	}
-	buf.rebuild_map();
+	if (num_stolen > 0)
+		buf.rebuild_map();
+	pthread_spin_unlock(&_lock);
 	npages = num_stolen;
 }
 
@@ -319,30 +363,99 @@ page *hash_cell::search(const page_id_t &pg_id)
 	return ret;
 }
 
+/*
+ * This is the admission policy of TinyLFU. A missed page can evict a page
+ * in the cell only if it's accessed more frequently than the page to be
+ * evicted. We don't know which page the eviction policy will choose without
+ * changing its state, so we compare with the least frequently accessed page
+ * that can be evicted. The page in the probation slot doesn't count
+ * because the rejected page will be stored there.
+ * This function has to be called with lock held.
+ */
+bool hash_cell::admit(const page_id_t &pg_id,
+		const thread_safe_page *probation, const frequency_sketch &sketch) const
+{
+	int min_freq = -1;
+	for (unsigned int i = 0; i < buf.get_num_pages(); i++) {
+		const thread_safe_page *pg = buf.get_page(i);
+		if (pg == probation || pg->get_ref() > 0)
+			continue;
+		// There is still an empty page.
+		if (pg->get_offset() == -1)
+			return true;
+		int freq = sketch.estimate(get_sketch_key(page_id_t(pg->get_file_id(),
+						pg->get_offset())));
+		if (min_freq < 0 || freq < min_freq)
+			min_freq = freq;
+	}
+	return min_freq < 0 || sketch.estimate(get_sketch_key(pg_id)) > min_freq;
+}
+
 /**
  * search for a page with the offset.
  * If the page doesn't exist, return an empty page.
  */
-page *hash_cell::search(const page_id_t &pg_id, page_id_t &old_id)
+page *hash_cell::search(const page_id_t &pg_id, page_id_t &old_id,
+		bool no_cache)
 {
 	thread_safe_page *ret = NULL;
+	thread_safe_page *probation = NULL;
+	thread_safe_page *empty = NULL;
 	pthread_spin_lock(&_lock);
 	num_accesses++;
 
 	for (unsigned int i = 0; i < buf.get_num_pages(); i++) {
-		if (buf.get_page(i)->get_offset() == pg_id.get_offset()
-				&& buf.get_page(i)->get_file_id() == pg_id.get_file_id()) {
-			ret = buf.get_page(i);
+		thread_safe_page *pg = buf.get_page(i);
+		if (same_page(pg_id, pg)) {
+			ret = pg;
 			break;
 		}
+		if (probation_id.get_offset() != -1 && same_page(probation_id, pg))
+			probation = pg;
+		if (empty == NULL && !pg->initialized() && pg->get_ref() == 0)
+			empty = pg;
 	}
+	frequency_sketch *sketch = table->get_sketch();
+	if (sketch && !no_cache)
+		sketch->record(get_sketch_key(pg_id));
 	if (ret == NULL) {
 		num_evictions++;
-		ret = get_empty_page();
+		// The no-cache hint only takes effect with cache admission. Otherwise,
+		// the page is cached like any other page.
+		bool reject = sketch && (no_cache || !admit(pg_id, probation, *sketch));
+		bool evicted_by_policy = false;
+		// A page that isn't worth caching doesn't need to evict any page
+		// if there is still an empty page.
+		if (reject && empty) {
+			ret = empty;
+			reject = false;
+		}
+		// The rejected page reuses the page in the probation slot if
+		// the page can be evicted.
+		else if (reject && probation && probation->get_ref() == 0
+				&& !probation->is_dirty() && !probation->is_old_dirty()) {
+			ret = probation;
+			num_rejects++;
+		}
+		else {
+			ret = get_empty_page();
+			evicted_by_policy = true;
+		}
 		if (ret == NULL) {
 			pthread_spin_unlock(&_lock);
 			return NULL;
 		}
+		// The page isn't chosen by the eviction policy, so we have to
+		// update the state of the policy as if the page were evicted.
+		if (!evicted_by_policy) {
+			ret->reset_hits();
+			policy.access_page(ret, buf);
+		}
+		if (reject)
+			probation_id = pg_id;
+		// The page in the probation slot is evicted.
+		else if (same_page(probation_id, ret))
+			probation_id = page_id_t();
 		// We need to clear flags here.
 		ret->set_data_ready(false);
 		assert(!ret->is_io_pending());
@@ -379,8 +492,13 @@ page *hash_cell::search(const page_id_t &pg_id, page_id_t &old_id)
 			ret->set_hits(shadow_pg.get_hits());
 #endif
 	}
-	else
+	else {
 		policy.access_page(ret, buf);
+		// The page in the probation slot is accessed again, so it becomes
+		// a normal page.
+		if (!no_cache && same_page(probation_id, ret))
+			probation_id = page_id_t();
+	}
 	/* it's possible that the data in the page isn't ready */
 	ret->inc_ref();
 	if (ret->get_hits() == 0xff) {
@@ -707,80 +825,161 @@ associative_cache::~associative_cache()
 	memory_manager::destroy(manager);
 }
 
-bool associative_cache::shrink(int npages, char *pages[])
+int associative_cache::shrink(int npages, char *pages[])
 {
 	if (flags.set_flag(TABLE_EXPANDING)) {
 		/*
 		 * if the flag has been set before,
 		 * it means another thread is expanding the table,
 		 */
-		return false;
+		return 0;
 	}
 
 	/* starting from this point, only one thred can be here. */
 
 	int pg_idx = 0;
-	int orig_ncells = get_num_cells();
 	while (pg_idx < npages) {
-		// The cell table isn't in the stage of splitting.
-		if (split == 0) {
-			hash_cell *cell = get_cell(expand_cell_idx);
-			while (height >= params.get_SA_min_cell_size()) {
-				int num = max(0, cell->get_num_pages() - height);
-				num = min(npages - pg_idx, num);
-				if (num > 0) {
-					cell->steal_pages(&pages[pg_idx], num);
-					pg_idx += num;
-				}
-
-				if (expand_cell_idx <= 0) {
-					height--;
-					expand_cell_idx = orig_ncells;
-				}
-				expand_cell_idx--;
-				cell = get_cell(expand_cell_idx);
+		int orig_ncells = get_num_cells();
+		/*
+		 * The cells in the expanded table are kept at the min cell size,
+		 * so they can be merged. Once the table can't be merged any more,
+		 * we take the pages in the cells down to the reclaim limit.
+		 */
+		int min_height = params.get_SA_min_cell_size();
+		if (level == 0 && split == 0)
+			min_height = min(min_height, CELL_RECLAIM_MIN_NUM_PAGES);
+		hash_cell *cell = get_cell(expand_cell_idx);
+		while (height >= min_height && pg_idx < npages) {
+			int num = max(0, cell->get_num_pages() - height);
+			num = min(npages - pg_idx, num);
+			if (num > 0) {
+				// We may get fewer pages if some of them are in use or dirty.
+				cell->steal_pages(&pages[pg_idx], num);
+				pg_idx += num;
 			}
-			if (pg_idx == npages) {
-				cache_npages.dec(npages);
-				flags.clear_flag(TABLE_EXPANDING);
-				return true;
+
+			if (expand_cell_idx <= 0) {
+				height--;
+				expand_cell_idx = orig_ncells;
 			}
+			expand_cell_idx--;
+			cell = get_cell(expand_cell_idx);
 		}
+		if (pg_idx == npages)
+			break;
 
 		/* From here, we shrink the cell table. */
 
+		// We can't shrink the table while it's in the middle of splitting.
+		if (level == 0 || split > 0)
+			break;
 		// When the thread is within in the while loop, other threads can
 		// hardly access the cells in the table.
-		if (level == 0)
-			break;
 		int num_half = (1 << level) * init_ncells / 2;
-		table_lock.write_lock();
-		if (split == 0) {
-			split = num_half - 1;
-			level--;
+		/*
+		 * A low cell and a high cell are merged into one, so they can't
+		 * have more than CELL_SIZE pages together. We steal the extra
+		 * pages from the high cells first. If we can't steal all of them,
+		 * we give the pages back and don't shrink the table.
+		 */
+		int num_extra = 0;
+		for (int i = 0; i < num_half; i++)
+			num_extra += max(0, get_cell(i)->get_num_pages()
+					+ get_cell(i + num_half)->get_num_pages() - CELL_SIZE);
+		if (num_extra > npages - pg_idx)
+			break;
+		std::vector<int> num_stolen(num_half);
+		int start_idx = pg_idx;
+		bool mergeable = true;
+		for (int i = 0; i < num_half && mergeable; i++) {
+			hash_cell *high_cell = get_cell(i + num_half);
+			int num_req = get_cell(i)->get_num_pages()
+				+ high_cell->get_num_pages() - CELL_SIZE;
+			if (num_req <= 0)
+				continue;
+			int num = num_req;
+			high_cell->steal_pages(&pages[pg_idx], num);
+			pg_idx += num;
+			num_stolen[i] = num;
+			if (num < num_req)
+				mergeable = false;
 		}
+		if (!mergeable) {
+			pg_idx = start_idx;
+			for (int i = 0; i < num_half; i++) {
+				if (num_stolen[i] > 0)
+					get_cell(i + num_half)->add_pages(&pages[pg_idx],
+							num_stolen[i]);
+				pg_idx += num_stolen[i];
+			}
+			pg_idx = start_idx;
+			break;
+		}
+
+		// The cells below `split' still use the hash function of
+		// the original level.
+		table_lock.write_lock();
+		split = num_half;
+		level--;
 		table_lock.write_unlock();
 		while (split > 0) {
-			hash_cell *high_cell = get_cell(split + num_half);
-			hash_cell *cell = get_cell(split);
-			// At this point, the high cell and the low cell together
-			// should have no more than CELL_MIN_NUM_PAGES pages.
-			cell->merge(high_cell);
+			hash_cell *high_cell = get_cell(split - 1 + num_half);
+			hash_cell *cell = get_cell(split - 1);
+			// Other threads can't see the change until we update `split'.
 			table_lock.write_lock();
+			cell->merge(high_cell);
 			split--;
 			table_lock.write_unlock();
 		}
-		int orig_narrays = (1 << level);
 		// It's impossible to access the arrays after `narrays' now.
-		int narrays = orig_narrays / 2;
-		for (int i = narrays; i < orig_narrays; i++) {
+		int narrays = (1 << level);
+		for (int i = narrays; i < narrays * 2; i++) {
 			hash_cell::destroy_array(cells_table[i], init_ncells);
 			cells_table[i] = NULL;
 		}
+		// The merged cells may have up to CELL_SIZE pages.
+		height = CELL_SIZE;
+		expand_cell_idx = get_num_cells() - 1;
 	}
 	flags.clear_flag(TABLE_EXPANDING);
-	cache_npages.dec(npages);
-	return true;
+	cache_npages.dec(pg_idx);
+	return pg_idx;
+}
+
+long associative_cache::reclaim(long size)
+{
+	// shrink() can only merge cells in the expanded table, so the cells
+	// of the initial table keep at least the reclaim limit.
+	int min_npages = init_ncells * CELL_RECLAIM_MIN_NUM_PAGES;
+	int npages = min<long>(size / PAGE_SIZE, cache_npages.get() - min_npages);
+	if (npages <= 0)
+		return 0;
+
+	std::vector<char *> pages(npages);
+	// The pages that are in use or dirty can't be stolen, so we may get
+	// fewer pages than requested.
+	int num_stolen = shrink(npages, pages.data());
+	if (num_stolen > 0) {
+		manager->release_pages(num_stolen, pages.data());
+		num_reclaimed_pages.inc(num_stolen);
+	}
+	return ((long) num_stolen) * PAGE_SIZE;
+}
+
+long associative_cache::regrow(long size)
+{
+	int npages = min<long>(size / PAGE_SIZE, num_reclaimed_pages.get());
+	int num_added = 0;
+	// expand() keeps the page array on the stack, so we expand the cache
+	// a small batch at a time.
+	while (num_added < npages) {
+		int ret = expand(min(npages - num_added, GROW_NPAGES));
+		if (ret == 0)
+			break;
+		num_added += ret;
+	}
+	num_reclaimed_pages.dec(num_added);
+	return ((long) num_added) * PAGE_SIZE;
 }
 
 /**
@@ -880,9 +1079,10 @@ next_cell:
 			 */
 
 			/* Add pages to the cell without enough pages. */
-			int num_required = max(expanded_cell->get_num_pages()
-				- params.get_SA_min_cell_size(), 0);
-			num_required += max(cell->get_num_pages() - params.get_SA_min_cell_size(), 0);
+			int num_required = max(params.get_SA_min_cell_size()
+					- (int) expanded_cell->get_num_pages(), 0);
+			num_required += max(params.get_SA_min_cell_size()
+					- (int) cell->get_num_pages(), 0);
 			if (num_required <= npages - pg_idx) {
 				/* 
 				 * Actually only one cell requires more pages, the other
@@ -917,11 +1117,16 @@ next_cell:
 	if (pg_idx < npages)
 		manager->free_pages(npages - pg_idx, &pages[pg_idx]);
 	flags.clear_flag(TABLE_EXPANDING);
-	cache_npages.inc(npages);
-	return npages - pg_idx;
+	cache_npages.inc(pg_idx);
+	return pg_idx;
 }
 
 page *associative_cache::search(const page_id_t &pg_id, page_id_t &old_id) {
+	return search(pg_id, old_id, false);
+}
+
+page *associative_cache::search(const page_id_t &pg_id, page_id_t &old_id,
+		bool no_cache) {
 	/*
 	 * search might change the structure of the cell,
 	 * and cause the cell table to expand.
@@ -930,7 +1135,7 @@ page *associative_cache::search(const page_id_t &pg_id, page_id_t &old_id) {
 	 * for the cell.
 	 */
 	do {
-		page *p = get_cell_offset(pg_id)->search(pg_id, old_id);
+		page *p = get_cell_offset(pg_id)->search(pg_id, old_id, no_cache);
 #ifdef DEBUG
 		if (p->is_old_dirty())
 			num_dirty_pages.dec(1);
@@ -1015,6 +1220,11 @@ associative_cache::associative_cache(long cache_size, long max_cache_size,
 	}
 
 	cells_table.push_back(cells);
+	cache_npages.inc(init_ncells * min_cell_size);
+
+	if (params.is_cache_admission())
+		sketch = std::unique_ptr<frequency_sketch>(
+				new frequency_sketch(max_npages));
 
 	int max_ncells = max_npages / min_cell_size;
 	for (int i = 1; i < max_ncells / init_ncells; i++)
@@ -1612,6 +1822,14 @@ int associative_cache::get_num_dirty_pages() const
 	return num;
 }
 
+long associative_cache::get_num_rejects() const
+{
+	long num = 0;
+	for (int i = 0; i < get_num_cells(); i++)
+		num += get_cell(i)->get_num_rejects();
+	return num;
+}
+
 int associative_cache::flush_dirty_pages(page_filter *filter, int max_num)
 {
 	if (_flusher)
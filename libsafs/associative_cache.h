@@ -34,6 +34,7 @@
 #include "safs_exception.h"
 #include "comm_exception.h"
 #include "compute_stat.h"
+#include "frequency_sketch.h"
 
 namespace safs
 {
@@ -246,10 +247,21 @@ class hash_cell
 	clock_shadow_cell shadow;
 #endif
 
+	/*
+	 * The page that keeps the last page rejected by the admission policy.
+	 * The next rejected page reuses it, so the pages that are accessed once
+	 * don't evict other pages in the cell. It's invalid if there isn't
+	 * such a page.
+	 */
+	page_id_t probation_id;
+
 	long num_accesses;
 	long num_evictions;
+	long num_rejects;
 
 	thread_safe_page *get_empty_page();
+	bool admit(const page_id_t &pg_id, const thread_safe_page *probation,
+			const frequency_sketch &sketch) const;
 
 	void init() {
 		table = NULL;
@@ -257,6 +269,7 @@ class hash_cell
 		pthread_spin_init(&_lock, PTHREAD_PROCESS_PRIVATE);
 		num_accesses = 0;
 		num_evictions = 0;
+		num_rejects = 0;
 	}
 
 	hash_cell() {
@@ -290,7 +303,8 @@ public:
 
 	void rebalance(hash_cell *cell);
 
-	page *search(const page_id_t &pg_id, page_id_t &old_id);
+	page *search(const page_id_t &pg_id, page_id_t &old_id,
+			bool no_cache = false);
 	page *search(const page_id_t &pg_id);
 
 	bool contain(thread_safe_page *pg) const {
@@ -308,8 +322,9 @@ public:
 	 */
 	void merge(hash_cell *cell);
 	/**
-	 * Steal pages from the cell, possibly the one to be evicted
-	 * by the eviction policy. The page can't be referenced and dirty.
+	 * Steal up to `npages' pages from the cell. The pages that are
+	 * referenced, dirty or being written back are skipped, so `npages'
+	 * returns the number of pages actually stolen.
 	 */
 	void steal_pages(char *pages[], int &npages);
 
@@ -373,6 +388,10 @@ public:
 		return num_evictions;
 	}
 
+	long get_num_rejects() const {
+		return num_rejects;
+	}
+
 	void print_cell();
 };
 
@@ -396,6 +415,9 @@ class associative_cache: public page_cache
 	// The number of pages in the cache.
 	// Cells may have different numbers of pages.
 	atomic_integer cache_npages;
+	// The number of pages reclaimed from the cache. The cache can
+	// grow back by this many pages.
+	atomic_integer num_reclaimed_pages;
 	int offset_factor;
 	
 	seq_lock table_lock;
@@ -415,6 +437,10 @@ class associative_cache: public page_cache
 	std::unique_ptr<dirty_page_flusher> _flusher;
 	pthread_mutex_t init_mutex;
 
+	// It estimates the access frequency of pages for the admission policy.
+	// It's NULL if the admission policy isn't used.
+	std::unique_ptr<frequency_sketch> sketch;
+
 	associative_cache(long cache_size, long max_cache_size, int node_id,
 			int offset_factor, int _max_num_pending_flush,
 			bool expandable = false);
@@ -449,6 +475,14 @@ public:
 		return node_id;
 	}
 
+	const frequency_sketch *get_sketch() const {
+		return sketch.get();
+	}
+
+	frequency_sketch *get_sketch() {
+		return sketch.get();
+	}
+
 	/* the hash function used for the current level. */
 	int hash(const page_id_t &pg_id) {
 		// The offset of pages in this cache may all be a multiple of
@@ -484,6 +518,7 @@ public:
 	 * maintaining eviction policy.
 	 */
 	page *search(const page_id_t &pg_id, page_id_t &old_id);
+	page *search(const page_id_t &pg_id, page_id_t &old_id, bool no_cache);
 	/**
 	 * This method just searches for the specified page, nothing more.
 	 * So if the request isn't issued from the workload, and we don't need
@@ -497,7 +532,9 @@ public:
 	 * of pages that the cache has been expanded.
 	 */
 	int expand(int npages);
-	bool shrink(int npages, char *pages[]);
+	int shrink(int npages, char *pages[]);
+	virtual long reclaim(long size);
+	virtual long regrow(long size);
 
 	void print_cell(off_t off) {
 		get_cell(off)->print_cell();
@@ -557,6 +594,7 @@ public:
 	virtual void sanity_check() const;
 
 	int get_num_dirty_pages() const;
+	long get_num_rejects() const;
 
 	virtual void init(std::shared_ptr<io_interface> underlying);
 
@@ -568,6 +606,9 @@ public:
 		printf("\tmax pending flushes: %ld, avg: %ld, remaining pending: %d\n",
 				recorded_max_num_pending.get(), (long) avg_num_pending.get(),
 				num_pending_flush.get());
+		if (sketch)
+			printf("\trejected pages: %ld, sketch agings: %ld\n",
+					get_num_rejects(), sketch->get_num_agings());
 #ifdef DETAILED_STATISTICS
 		for (int i = 0; i < get_num_cells(); i++)
 			printf("cell %d: %ld accesses, %ld evictions\n", i,
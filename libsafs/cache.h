@@ -411,6 +411,14 @@ public:
 	 * saved in `old_off'.
 	 */
 	virtual page *search(const page_id_t &pg_id, page_id_t &old_id) = 0;
+	/**
+	 * The same as above. If `no_cache' is true, the page is unlikely to be
+	 * accessed again, so the cache shouldn't evict other pages to keep it.
+	 */
+	virtual page *search(const page_id_t &pg_id, page_id_t &old_id,
+			bool no_cache) {
+		return search(pg_id, old_id);
+	}
 	/**
 	 * This method searches for a page with the specified offset.
 	 * If the page doesn't exist, it returns NULL.
@@ -425,8 +433,26 @@ public:
 	/* This method should be called within each thread. */
 	virtual void init(std::shared_ptr<io_interface> underlying) {
 	}
-	virtual bool shrink(int npages, char *pages[]) {
-		return false;
+	/**
+	 * Remove up to `npages' pages from the cache and store them in
+	 * `pages'. It returns the number of pages removed.
+	 */
+	virtual int shrink(int npages, char *pages[]) {
+		return 0;
+	}
+	/**
+	 * Shrink the cache by up to `size' bytes and return the memory
+	 * to the OS. It returns the number of bytes released.
+	 */
+	virtual long reclaim(long size) {
+		return 0;
+	}
+	/**
+	 * Grow the cache by up to `size' bytes with the memory reclaimed
+	 * from it before. It returns the number of bytes added to the cache.
+	 */
+	virtual long regrow(long size) {
+		return 0;
 	}
 	virtual void create_flusher(std::shared_ptr<io_interface> io,
 			page_cache *global_cache) {
@@ -186,6 +186,17 @@ long str2size(std::string str)
 	return atol(str.c_str()) * multiply;
 }
 
+bool str2bool(const std::string &str, bool &value)
+{
+	if (str.empty() || str == "1" || str == "true")
+		value = true;
+	else if (str == "0" || str == "false")
+		value = false;
+	else
+		return false;
+	return true;
+}
+
 int split_string(const std::string &str, char delim,
 		std::vector<std::string> &strs)
 {
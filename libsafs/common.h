@@ -114,6 +114,12 @@ static inline std::string ltoa(long n)
 }
 
 long str2size(std::string str);
+/*
+ * Parse a boolean option. An empty string means the option is given
+ * without a value, which enables it. It returns false if the string
+ * isn't one of true/false/1/0.
+ */
+bool str2bool(const std::string &str, bool &value);
 
 int split_string(const std::string &str, char delim,
 		std::vector<std::string> &strs);
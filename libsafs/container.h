@@ -28,9 +28,11 @@
 #include <limits.h>
 
 #include <string>
+#include <atomic>
 #include <boost/assert.hpp>
 
 #include "common.h"
+#include "parameters.h"
 
 template<class T>
 class queue_interface
@@ -389,6 +391,417 @@ public:
 	}
 };
 
+template<class T, int size>
+class stack_array;
+
+/*
+ * The indices updated by the producers and the consumer of a ring queue
+ * are separated by this many bytes, so they don't share a cache line.
+ * Some CPUs prefetch cache lines in pairs, so it's two cache lines.
+ */
+const int RING_PAD_SIZE = 128;
+
+/*
+ * This is a lock-free bounded FIFO queue with a single producer and
+ * a single consumer. It's used by a pair of dedicated threads.
+ * Both add() and fetch() work on a batch of entries and access
+ * the shared indices only once per batch.
+ */
+template<class T>
+class spsc_ring_queue
+{
+	char pad0[RING_PAD_SIZE];
+	// The location of the next entry to fetch. Only the consumer updates it.
+	std::atomic<long> head;
+	// The consumer's copy of `tail', so it doesn't read `tail' every time.
+	long cached_tail;
+	char pad1[RING_PAD_SIZE - sizeof(std::atomic<long>) - sizeof(long)];
+	// The location of the next entry to add. Only the producer updates it.
+	std::atomic<long> tail;
+	// The producer's copy of `head'.
+	long cached_head;
+	char pad2[RING_PAD_SIZE - sizeof(std::atomic<long>) - sizeof(long)];
+
+	T *buf;
+	int size_mask;
+	int node_id;
+	std::string name;
+
+	spsc_ring_queue(const spsc_ring_queue<T> &q) = delete;
+	spsc_ring_queue<T> &operator=(const spsc_ring_queue<T> &q) = delete;
+public:
+	// The size of the queue has to be 2^n. If it's not, the smallest
+	// number of 2^n is used.
+	spsc_ring_queue(const std::string &name, int node_id, int size) {
+		int log_size = (int) ceil(log2(size));
+		size = 1 << log_size;
+		this->size_mask = size - 1;
+		this->node_id = node_id;
+		this->name = name;
+		buf = new T[size];
+		head = 0;
+		tail = 0;
+		cached_head = 0;
+		cached_tail = 0;
+	}
+
+	~spsc_ring_queue() {
+		delete [] buf;
+	}
+
+	int add(T *entries, int num) {
+		long t = tail.load(std::memory_order_relaxed);
+		if (t - cached_head + num > get_size())
+			cached_head = head.load(std::memory_order_acquire);
+		int num_added = min((long) num, get_size() - (t - cached_head));
+		for (int i = 0; i < num_added; i++)
+			buf[(t + i) & size_mask] = entries[i];
+		if (num_added > 0)
+			tail.store(t + num_added, std::memory_order_release);
+		return num_added;
+	}
+
+	int fetch(T *entries, int num) {
+		long h = head.load(std::memory_order_relaxed);
+		if (cached_tail - h < num)
+			cached_tail = tail.load(std::memory_order_acquire);
+		int num_fetches = min((long) num, cached_tail - h);
+		for (int i = 0; i < num_fetches; i++)
+			entries[i] = buf[(h + i) & size_mask];
+		if (num_fetches > 0)
+			head.store(h + num_fetches, std::memory_order_release);
+		return num_fetches;
+	}
+
+	/*
+	 * The number of entries is accurate only in the producer or
+	 * the consumer thread.
+	 */
+	int get_num_entries() const {
+		return (int) (tail.load(std::memory_order_acquire)
+				- head.load(std::memory_order_acquire));
+	}
+
+	int get_size() const {
+		return size_mask + 1;
+	}
+
+	bool is_empty() const {
+		return get_num_entries() == 0;
+	}
+
+	bool is_full() const {
+		return get_num_entries() >= get_size();
+	}
+
+	int get_node_id() const {
+		return node_id;
+	}
+
+	const std::string &get_name() const {
+		return name;
+	}
+};
+
+/*
+ * This is a lock-free bounded FIFO queue with multiple producers and
+ * a single consumer.
+ * A producer reserves a range of slots for a batch of entries with
+ * a single CAS on `tail' and publishes each entry by setting
+ * the sequence number of its slot, so the consumer never sees
+ * a slot that is still being written.
+ */
+template<class T>
+class mpsc_ring_queue
+{
+	struct slot
+	{
+		// The slot at location `loc' is readable when it's `loc + 1'.
+		std::atomic<long> seq;
+		T val;
+
+		slot() {
+			seq = 0;
+		}
+	};
+
+	char pad0[RING_PAD_SIZE];
+	// The location of the next entry to fetch. Only the consumer updates it.
+	std::atomic<long> head;
+	char pad1[RING_PAD_SIZE - sizeof(std::atomic<long>)];
+	// The location of the next slot to reserve.
+	std::atomic<long> tail;
+	char pad2[RING_PAD_SIZE - sizeof(std::atomic<long>)];
+
+	slot *slots;
+	int size_mask;
+	int node_id;
+	std::string name;
+
+	mpsc_ring_queue(const mpsc_ring_queue<T> &q) = delete;
+	mpsc_ring_queue<T> &operator=(const mpsc_ring_queue<T> &q) = delete;
+public:
+	// The size of the queue has to be 2^n. If it's not, the smallest
+	// number of 2^n is used.
+	mpsc_ring_queue(const std::string &name, int node_id, int size) {
+		int log_size = (int) ceil(log2(size));
+		size = 1 << log_size;
+		this->size_mask = size - 1;
+		this->node_id = node_id;
+		this->name = name;
+		slots = new slot[size];
+		head = 0;
+		tail = 0;
+	}
+
+	~mpsc_ring_queue() {
+		delete [] slots;
+	}
+
+	/*
+	 * It can be invoked by multiple threads. It adds as many entries
+	 * as the free space allows and returns the number of added entries.
+	 */
+	int add(T *entries, int num) {
+		long loc = tail.load(std::memory_order_relaxed);
+		long num_added;
+		do {
+			// A slot can be reused only after the consumer moves `head'
+			// past it.
+			long num_free = get_size()
+				- (loc - head.load(std::memory_order_acquire));
+			num_added = min((long) num, num_free);
+			if (num_added <= 0)
+				return 0;
+		} while (!tail.compare_exchange_weak(loc, loc + num_added,
+					std::memory_order_relaxed));
+		for (long i = 0; i < num_added; i++) {
+			slot &s = slots[(loc + i) & size_mask];
+			s.val = entries[i];
+			s.seq.store(loc + i + 1, std::memory_order_release);
+		}
+		return num_added;
+	}
+
+	/*
+	 * It can only be invoked by the consumer thread. It stops at the first
+	 * slot that has been reserved but not published yet.
+	 */
+	int fetch(T *entries, int num) {
+		long loc = head.load(std::memory_order_relaxed);
+		int num_fetches = 0;
+		while (num_fetches < num) {
+			slot &s = slots[(loc + num_fetches) & size_mask];
+			if (s.seq.load(std::memory_order_acquire) != loc + num_fetches + 1)
+				break;
+			entries[num_fetches++] = s.val;
+		}
+		if (num_fetches > 0)
+			head.store(loc + num_fetches, std::memory_order_release);
+		return num_fetches;
+	}
+
+	/*
+	 * This includes the slots that have been reserved by producers but
+	 * whose entries haven't been published.
+	 */
+	int get_num_entries() const {
+		return (int) (tail.load(std::memory_order_acquire)
+				- head.load(std::memory_order_acquire));
+	}
+
+	int get_size() const {
+		return size_mask + 1;
+	}
+
+	bool is_empty() const {
+		return get_num_entries() == 0;
+	}
+
+	bool is_full() const {
+		return get_num_entries() >= get_size();
+	}
+
+	int get_node_id() const {
+		return node_id;
+	}
+
+	const std::string &get_name() const {
+		return name;
+	}
+};
+
+/*
+ * This is a thread-safe FIFO queue with multiple producers and a single
+ * consumer. Entries go to a lock-free ring first. Only when the ring is
+ * full, they are added to an overflow queue protected by a lock, which
+ * can grow up to `max_size'. Therefore, producers never wait for
+ * the consumer unless the queue reaches its max size.
+ * The entries from the same producer are fetched in the order they are
+ * added.
+ */
+template<class T>
+class mpsc_FIFO_queue
+{
+	static const int ADD_BATCH_SIZE = 32;
+
+	mpsc_ring_queue<T> ring;
+	pthread_spinlock_t overflow_lock;
+	fifo_queue<T> overflow;
+	// Once it's set, producers add entries to the overflow queue
+	// until the consumer drains it.
+	std::atomic<bool> has_overflow;
+	int max_size;
+
+	int add_overflow(T *entries, int num) {
+		int ret = overflow.add(entries, num);
+		int orig_size = overflow.get_size();
+		if (ret < num && orig_size < max_size) {
+			int new_size = orig_size;
+			int min_required_size = overflow.get_num_entries() + num - ret;
+			while (new_size < min_required_size && new_size < max_size)
+				new_size *= 2;
+			overflow.expand_queue(new_size);
+			ret += overflow.add(entries + ret, num - ret);
+		}
+		return ret;
+	}
+public:
+	mpsc_FIFO_queue(const std::string &name, int node_id, int ring_size,
+			int max_size): ring(name, node_id, ring_size), overflow(node_id,
+				1, max_size > ring_size) {
+		this->max_size = max(max_size - ring.get_size(), 1);
+		has_overflow = false;
+		pthread_spin_init(&overflow_lock, PTHREAD_PROCESS_PRIVATE);
+	}
+
+	virtual ~mpsc_FIFO_queue() {
+		pthread_spin_destroy(&overflow_lock);
+	}
+
+	virtual int fetch(T *entries, int num) {
+		int ret = ring.fetch(entries, num);
+		if (ret == num || !has_overflow.load(std::memory_order_acquire))
+			return ret;
+
+		pthread_spin_lock(&overflow_lock);
+		// A producer only adds entries to the overflow queue after all of
+		// its entries in the ring are published, so we have to drain
+		// the ring before the overflow queue to keep the order.
+		ret += ring.fetch(entries + ret, num - ret);
+		if (ret < num && ring.is_empty()) {
+			ret += overflow.fetch(entries + ret, num - ret);
+			if (overflow.is_empty())
+				has_overflow.store(false, std::memory_order_release);
+		}
+		pthread_spin_unlock(&overflow_lock);
+		return ret;
+	}
+
+	virtual int add(T *entries, int num) {
+		int ret = 0;
+		if (!has_overflow.load(std::memory_order_acquire))
+			ret = ring.add(entries, num);
+		if (ret == num)
+			return ret;
+
+		pthread_spin_lock(&overflow_lock);
+		has_overflow.store(true, std::memory_order_release);
+		ret += add_overflow(entries + ret, num - ret);
+		pthread_spin_unlock(&overflow_lock);
+		return ret;
+	}
+
+	/*
+	 * If the queue reaches its max size, the entries that can't be added
+	 * are put back to the end of `queue'.
+	 */
+	virtual int add(fifo_queue<T> *queue) {
+		int num_added = 0;
+		while (!queue->is_empty()) {
+			stack_array<T, ADD_BATCH_SIZE> buf(ADD_BATCH_SIZE);
+			int num = queue->fetch(buf.data(), ADD_BATCH_SIZE);
+			int ret = add(buf.data(), num);
+			num_added += ret;
+			if (ret < num) {
+				queue->add(buf.data() + ret, num - ret);
+				break;
+			}
+		}
+		return num_added;
+	}
+
+	int get_num_entries() {
+		int num = ring.get_num_entries();
+		if (has_overflow.load(std::memory_order_acquire)) {
+			pthread_spin_lock(&overflow_lock);
+			num += overflow.get_num_entries();
+			pthread_spin_unlock(&overflow_lock);
+		}
+		return num;
+	}
+
+	bool is_empty() {
+		return ring.is_empty() && !has_overflow.load(std::memory_order_acquire);
+	}
+
+	const std::string &get_name() const {
+		return ring.get_name();
+	}
+};
+
+/*
+ * The message queue of a thread. It's used by both SAFS and FlashGraph.
+ * Each entry is a message with multiple objects and the queue counts
+ * the objects in the messages. The lock-free ring of the queue holds at
+ * least MSG_RING_SIZE messages.
+ */
+template<class MsgType>
+class mpsc_msg_queue: public mpsc_FIFO_queue<MsgType>
+{
+	// The number of objects in the messages of the queue. It may be
+	// temporarily negative because a message may be fetched before
+	// the producer counts it.
+	std::atomic<long> num_objs;
+public:
+	mpsc_msg_queue(const std::string &name, int node_id, int init_size,
+			int max_size): mpsc_FIFO_queue<MsgType>(name, node_id,
+				max(init_size, safs::MSG_RING_SIZE), max_size) {
+		num_objs = 0;
+	}
+
+	using mpsc_FIFO_queue<MsgType>::add;
+
+	virtual int add(MsgType *msgs, int num) {
+		long num_added_objs = 0;
+		for (int i = 0; i < num; i++)
+			num_added_objs += msgs[i].get_num_objs();
+		int ret = mpsc_FIFO_queue<MsgType>::add(msgs, num);
+		// The messages that aren't added are still in the array.
+		for (int i = ret; i < num; i++)
+			num_added_objs -= msgs[i].get_num_objs();
+		num_objs += num_added_objs;
+		return ret;
+	}
+
+	virtual int fetch(MsgType *msgs, int num) {
+		int ret = mpsc_FIFO_queue<MsgType>::fetch(msgs, num);
+		long num_fetched_objs = 0;
+		for (int i = 0; i < ret; i++)
+			num_fetched_objs += msgs[i].get_num_objs();
+		num_objs -= num_fetched_objs;
+		return ret;
+	}
+
+	/*
+	 * The number of objects in the queue. It's a hint when other
+	 * threads are accessing the queue.
+	 */
+	int get_num_objs() const {
+		return max(num_objs.load(), 0L);
+	}
+};
+
 /*
  * This FIFO queue can block the thread if
  * a thread wants to add more entries when the queue is full;
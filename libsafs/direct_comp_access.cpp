@@ -280,6 +280,7 @@ static void conv_comp_to_basic(io_request &req)
 
 void direct_comp_io::access(io_request *requests, int num, io_status *status)
 {
+	trace_access(requests, num);
 	num_issued_areqs += num;
 	int i;
 	for (i = 0; i < num; i++) {
@@ -252,7 +252,7 @@ int disk_io_thread::process_low_prio_msg(message<io_request> &low_prio_msg)
 }
 
 void disk_io_thread::run_commands(
-		thread_safe_FIFO_queue<disk_io_thread::remote_comm *> &queue)
+		mpsc_FIFO_queue<disk_io_thread::remote_comm *> &queue)
 {
 	const int COMM_BUF_SIZE = 16;
 	remote_comm *commands[COMM_BUF_SIZE];
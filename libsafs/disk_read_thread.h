@@ -126,7 +126,7 @@ class disk_io_thread: public thread
 	std::unordered_set<int> disk_ids;
 	msg_queue<io_request> queue;
 	msg_queue<io_request> low_prio_queue;
-	thread_safe_FIFO_queue<remote_comm *> comm_queue;
+	mpsc_FIFO_queue<remote_comm *> comm_queue;
 	logical_file_partition partition;
 
 	async_io *aio;
@@ -159,7 +159,7 @@ class disk_io_thread: public thread
 	size_t get_all_reqs(msg_queue<io_request> &queue,
 			std::vector<io_request> &reqs);
 
-	void run_commands(thread_safe_FIFO_queue<remote_comm *> &);
+	void run_commands(mpsc_FIFO_queue<remote_comm *> &);
 
 	int execute_remote_comm(remote_comm *comm) {
 		comm_queue.add(&comm, 1);
@@ -241,6 +241,13 @@ public:
 		return num_write_bytes;
 	}
 
+	/*
+	 * It returns NULL if the I/O thread doesn't use the hybrid polling mode.
+	 */
+	const hybrid_poller *get_poller() const {
+		return aio->get_poller();
+	}
+
 	void print_stat() {
 #ifdef STATISTICS
 		printf("\t%ld reads (%ld bytes), %ld writes (%ld bytes) and %d io waits, complete %d reqs and %ld low-prio reqs,\n",
@@ -256,6 +263,8 @@ public:
 		printf("\tremain %d high-prio requests, %d low-prio requests, %ld messages in total\n",
 				get_num_high_prio_reqs(), get_num_low_prio_reqs(), num_msgs);
 #endif
+		if (aio->get_poller())
+			aio->get_poller()->get_stat().print(get_thread_name());
 	}
 
 	void print_state();
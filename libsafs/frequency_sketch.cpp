@@ -0,0 +1,97 @@
+/*
+ * Copyright 2014 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of SAFSlib.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "frequency_sketch.h"
+
+namespace safs
+{
+
+// The sample size is a multiple of the number of items in the cache.
+static const size_t SAMPLE_FACTOR = 10;
+// The number of counters in a row for each item in the cache. There are
+// many more keys than items in a sample, so we need more counters
+// to keep the estimation accurate.
+static const size_t ROW_FACTOR = 4;
+static const size_t MIN_ROW_SIZE = 64;
+
+frequency_sketch::frequency_sketch(size_t num_items)
+{
+	size_t max_items = MIN_ROW_SIZE;
+	while (max_items < num_items)
+		max_items *= 2;
+	row_size = max_items * ROW_FACTOR;
+	sample_size = SAMPLE_FACTOR * max_items;
+	counters = std::unique_ptr<std::atomic<uint8_t>[]>(
+			new std::atomic<uint8_t>[NUM_ROWS * row_size]);
+	for (size_t i = 0; i < NUM_ROWS * row_size; i++)
+		counters[i].store(0, std::memory_order_relaxed);
+	num_records = 0;
+	num_agings = 0;
+}
+
+/*
+ * We use the conservative update: only the smallest counters are
+ * increased, which reduces the overestimation caused by hash collisions.
+ */
+void frequency_sketch::record(uint64_t key)
+{
+	uint64_t h = hash(key);
+	size_t idxs[NUM_ROWS];
+	int min_count = MAX_COUNT;
+	for (int i = 0; i < NUM_ROWS; i++) {
+		idxs[i] = get_idx(h, i);
+		int count = counters[idxs[i]].load(std::memory_order_relaxed);
+		if (count < min_count)
+			min_count = count;
+	}
+	if (min_count < MAX_COUNT) {
+		for (int i = 0; i < NUM_ROWS; i++) {
+			if (counters[idxs[i]].load(std::memory_order_relaxed) == min_count)
+				counters[idxs[i]].store(min_count + 1, std::memory_order_relaxed);
+		}
+	}
+
+	size_t num = num_records.fetch_add(1, std::memory_order_relaxed) + 1;
+	// Only one thread resets the number of records and ages the counters.
+	if (num >= sample_size && num_records.exchange(0) >= sample_size)
+		age();
+}
+
+int frequency_sketch::estimate(uint64_t key) const
+{
+	uint64_t h = hash(key);
+	int min_count = MAX_COUNT;
+	for (int i = 0; i < NUM_ROWS; i++) {
+		int count = counters[get_idx(h, i)].load(std::memory_order_relaxed);
+		if (count < min_count)
+			min_count = count;
+	}
+	return min_count;
+}
+
+void frequency_sketch::age()
+{
+	for (size_t i = 0; i < NUM_ROWS * row_size; i++) {
+		uint8_t count = counters[i].load(std::memory_order_relaxed);
+		counters[i].store(count / 2, std::memory_order_relaxed);
+	}
+	num_agings.fetch_add(1, std::memory_order_relaxed);
+}
+
+}
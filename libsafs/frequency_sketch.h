@@ -0,0 +1,89 @@
+#ifndef __FREQUENCY_SKETCH_H__
+#define __FREQUENCY_SKETCH_H__
+
+/*
+ * Copyright 2014 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of SAFSlib.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+
+namespace safs
+{
+
+/*
+ * This is a count-min sketch that estimates how frequently a key has been
+ * accessed recently. It is used by the page cache to decide whether
+ * a missed page is worth evicting another page (TinyLFU).
+ *
+ * Each counter is stored in a byte, but it saturates at MAX_COUNT (15),
+ * so a counter only needs 4 bits as in TinyLFU. After the number of
+ * recorded accesses reaches the sample size, all counters are halved,
+ * so the estimation reflects the recent accesses.
+ *
+ * Many threads may update the sketch at the same time. We don't use
+ * atomic read-modify-write operations to update counters, so an update may
+ * be lost occasionally, which doesn't matter for an estimation.
+ */
+class frequency_sketch
+{
+	static const int NUM_ROWS = 4;
+	static const int MAX_COUNT = 15;
+
+	std::unique_ptr<std::atomic<uint8_t>[]> counters;
+	// The number of counters in a row. It's a power of 2.
+	size_t row_size;
+	size_t sample_size;
+	std::atomic<size_t> num_records;
+	std::atomic<size_t> num_agings;
+
+	size_t get_idx(uint64_t hash, int row) const {
+		uint32_t h1 = hash;
+		uint32_t h2 = hash >> 32;
+		return row * row_size + ((h1 + row * h2) & (row_size - 1));
+	}
+
+	static uint64_t hash(uint64_t key) {
+		key ^= key >> 33;
+		key *= 0xff51afd7ed558ccdUL;
+		key ^= key >> 33;
+		key *= 0xc4ceb9fe1a85ec53UL;
+		key ^= key >> 33;
+		return key;
+	}
+
+	void age();
+public:
+	/*
+	 * `num_items' is the max number of items in the cache.
+	 */
+	frequency_sketch(size_t num_items);
+
+	void record(uint64_t key);
+	int estimate(uint64_t key) const;
+
+	size_t get_num_agings() const {
+		return num_agings.load(std::memory_order_relaxed);
+	}
+};
+
+}
+
+#endif
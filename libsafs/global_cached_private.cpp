@@ -743,6 +743,13 @@ void global_cached_io::process_disk_completed_requests(io_request requests[],
 		io_request *request = &requests[i];
 		num_underlying_pages.dec(request->get_num_bufs());
 
+		// The request reads data to the user buffer directly.
+		if (request->get_req_type() == io_request::BASIC_REQ) {
+			finalize_partial_request(*request,
+					(original_io_request *) request->get_user_data());
+			continue;
+		}
+
 		if (request->get_num_bufs() > 1) {
 			multibuf_completion(request);
 			continue;
@@ -863,6 +870,7 @@ global_cached_io::global_cached_io(thread *t, io_interface::ptr underlying,
 	num_bytes = 0;
 	num_fast_process = 0;
 	num_evicted_dirty_pages = 0;
+	num_direct_bytes = 0;
 
 	this->underlying = underlying;
 	this->cache_size = cache->size();
@@ -1332,6 +1340,44 @@ void global_cached_io::process_cached_reqs()
 		safs::notify_completion(this, reqp_buf, num_reqs_in_buf);
 }
 
+/*
+ * A large read can bypass the page cache and read the pages that aren't
+ * cached to the user buffer directly. The user buffer has to be aligned
+ * in the same way as the file offset for direct I/O.
+ */
+bool global_cached_io::is_direct_read(const io_request &req) const
+{
+	size_t threshold = params.get_direct_read_threshold();
+	return threshold > 0 && req.get_req_type() == io_request::BASIC_REQ
+		&& req.get_access_method() == READ
+		&& (size_t) req.get_size() >= threshold
+		&& ((long) req.get_buf() - req.get_offset()) % MIN_BLOCK_SIZE == 0;
+}
+
+/*
+ * Read the range of the original request to its buffer directly.
+ * The range is page aligned and within a RAID block.
+ */
+void global_cached_io::issue_direct_read(off_t off, size_t size,
+		original_io_request *orig)
+{
+	char *buf = orig->get_buf() + (off - orig->get_offset());
+	data_loc_t loc(orig->get_file_id(), off);
+	io_request req(buf, loc, size, READ, this, get_node_id());
+	req.set_user_data(orig);
+	if (orig->is_sync())
+		req.set_low_latency(true);
+	num_direct_bytes += size;
+
+	io_status status;
+	num_to_underlying.inc(1);
+	num_underlying_pages.inc(req.get_num_bufs());
+	underlying->access(&req, 1, &status);
+	if (status == IO_FAIL) {
+		abort();
+	}
+}
+
 void global_cached_io::process_user_req(
 		std::vector<thread_safe_page *> &dirty_pages, io_status *status)
 {
@@ -1340,18 +1386,66 @@ void global_cached_io::process_user_req(
 	thread_safe_page *pages[get_block_size()];
 	int num_pages_ready = 0;
 	int num_bytes_completed = 0;
+	const io_request &user_req = processing_req.get_request();
+	bool direct = is_direct_read(user_req);
+	// The range of pages that are read to the user buffer directly.
+	off_t direct_off = 0;
+	size_t direct_size = 0;
 	while (!processing_req.is_empty()) {
-		thread_safe_page *p;
+		thread_safe_page *p = NULL;
 		page_id_t pg_id = processing_req.get_curr_page_id();
 		page_id_t old_id;
-		do {
-			p = (thread_safe_page *) (get_global_cache().search(pg_id, old_id));
+		/*
+		 * For a large read, only the first and the last pages, which may
+		 * be partially covered by the request, go through the page cache.
+		 * If any page in between is cached, we read it from the cache
+		 * because it may be dirty. Otherwise, we don't need to evict
+		 * a page for it.
+		 */
+		if (direct && pg_id.get_offset() >= user_req.get_offset()
+				&& pg_id.get_offset() + PAGE_SIZE
+				<= user_req.get_offset() + user_req.get_size()) {
+			p = (thread_safe_page *) get_global_cache().search(pg_id);
+			if (p == NULL) {
+				if (processing_req.get_orig() == NULL)
+					processing_req.init_orig(req_allocator->alloc_obj(), this);
+				// The cached pages before this page have to be read first.
+				if (pg_idx) {
+					io_request req;
+					processing_req.get_orig()->extract(pages[0]->get_offset(),
+							pg_idx * PAGE_SIZE, req);
+					num_bytes_completed += read(req, pages, pg_idx,
+							processing_req.get_orig());
+					pg_idx = 0;
+				}
+				if (direct_size > 0 && (direct_off + (off_t) direct_size
+							!= pg_id.get_offset() || pg_id.get_offset()
+							% (get_block_size() * PAGE_SIZE) == 0)) {
+					issue_direct_read(direct_off, direct_size,
+							processing_req.get_orig());
+					direct_size = 0;
+				}
+				if (direct_size == 0)
+					direct_off = pg_id.get_offset();
+				direct_size += PAGE_SIZE;
+				processing_req.move_next();
+				num_pg_accesses++;
+				continue;
+			}
+		}
+		if (direct_size > 0) {
+			issue_direct_read(direct_off, direct_size, processing_req.get_orig());
+			direct_size = 0;
+		}
+		while (p == NULL) {
+			p = (thread_safe_page *) (get_global_cache().search(pg_id, old_id,
+						user_req.is_no_cache()));
 			// If the cache can't evict a page, it's probably because
 			// all pages have been referenced. It's likely that we issued
 			// too many requests. Let's stop issuing more requests for now.
 			if (p == NULL)
 				goto end;
-		} while (p == NULL);
+		}
 		processing_req.move_next();
 		num_pg_accesses++;
 
@@ -1465,6 +1559,8 @@ void global_cached_io::process_user_req(
 	}
 
 end:
+	if (direct_size > 0)
+		issue_direct_read(direct_off, direct_size, processing_req.get_orig());
 	/*
 	 * The only reason that pg_idx > 0 is that there is a large read request.
 	 */
@@ -1540,6 +1636,7 @@ void global_cached_io::access(io_request *requests, int num, io_status *status)
 		return;
 
 	ASSERT_EQ(get_thread(), thread::get_curr_thread());
+	trace_access(requests, num);
 
 	bool syncd = false;
 	std::vector<thread_safe_page *> dirty_pages;
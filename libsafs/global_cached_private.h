@@ -143,6 +143,8 @@ class global_cached_io: public io_interface
 	size_t cache_hits;
 	size_t num_fast_process;
 	size_t num_evicted_dirty_pages;
+	// The number of bytes read to user buffers directly.
+	size_t num_direct_bytes;
 
 	// Count the number of async requests.
 	// The number of async requests that have been completed.
@@ -167,6 +169,9 @@ class global_cached_io: public io_interface
 		std::vector<thread_safe_page *> &dirty_pages);
 	int multibuf_completion(io_request *request);
 
+	bool is_direct_read(const io_request &req) const;
+	void issue_direct_read(off_t off, size_t size, original_io_request *orig);
+
 	void wait4req(original_io_request *req);
 
 	int get_num_underlying_reqs() const {
@@ -333,6 +338,9 @@ public:
 	size_t get_num_fast_process() const {
 		return num_fast_process;
 	}
+	size_t get_num_direct_bytes() const {
+		return num_direct_bytes;
+	}
 
 	virtual void print_state() {
 #ifdef STATISTICS
@@ -0,0 +1,76 @@
+/*
+ * Copyright 2014 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of SAFSlib.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+
+#include <boost/format.hpp>
+
+#include "log.h"
+#include "hybrid_poller.h"
+
+namespace safs
+{
+
+// The weight of a new interval in the moving average.
+static const double INTERVAL_WEIGHT = 0.125;
+// We poll at most twice as long as the average interval.
+static const int POLL_FACTOR = 2;
+// An interval is capped, so the average interval drops quickly
+// after the I/O was idle for a long time.
+static const int MAX_INTERVAL_FACTOR = 4;
+
+void poll_stat::print(const std::string &name) const
+{
+	BOOST_LOG_TRIVIAL(info) << boost::format(
+			"%1%: %2% poll hits, %3% poll misses, %4% wakeups, spin %5%us (%6%us wasted)")
+		% name % num_poll_hits % num_poll_misses % num_wakeups % spin_us
+		% wasted_spin_us;
+}
+
+hybrid_poller::hybrid_poller(int max_poll_us): max_poll_us(max_poll_us)
+{
+	// We start with polling, so we can learn the intervals.
+	avg_interval = max_poll_us / POLL_FACTOR;
+	last_completion = -1;
+}
+
+int64_t hybrid_poller::get_poll_time() const
+{
+	if (max_poll_us <= 0 || avg_interval > max_poll_us)
+		return 0;
+	return std::max<int64_t>(1, std::min<int64_t>(max_poll_us,
+				avg_interval * POLL_FACTOR));
+}
+
+void hybrid_poller::record_completions(int num, int64_t curr_us)
+{
+	if (num <= 0)
+		return;
+	// This is the first completion.
+	if (last_completion < 0) {
+		last_completion = curr_us;
+		return;
+	}
+	int64_t interval = std::max<int64_t>(0, std::min(curr_us - last_completion,
+				max_poll_us * MAX_INTERVAL_FACTOR)) / num;
+	avg_interval += (interval - avg_interval) * INTERVAL_WEIGHT;
+	last_completion = curr_us;
+}
+
+}
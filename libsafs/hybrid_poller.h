@@ -0,0 +1,124 @@
+#ifndef __HYBRID_POLLER_H__
+#define __HYBRID_POLLER_H__
+
+/*
+ * Copyright 2014 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of SAFSlib.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <string>
+
+namespace safs
+{
+
+struct poll_stat
+{
+	// The number of polls that found the I/O completions.
+	size_t num_poll_hits;
+	// The number of polls that gave up and blocked.
+	size_t num_poll_misses;
+	// The number of times that a thread blocks for I/O completions.
+	size_t num_wakeups;
+	// The time spent in polling in microseconds.
+	int64_t spin_us;
+	// The time spent in the polls that gave up in microseconds.
+	int64_t wasted_spin_us;
+
+	poll_stat() {
+		num_poll_hits = 0;
+		num_poll_misses = 0;
+		num_wakeups = 0;
+		spin_us = 0;
+		wasted_spin_us = 0;
+	}
+
+	poll_stat &operator+=(const poll_stat &stat) {
+		num_poll_hits += stat.num_poll_hits;
+		num_poll_misses += stat.num_poll_misses;
+		num_wakeups += stat.num_wakeups;
+		spin_us += stat.spin_us;
+		wasted_spin_us += stat.wasted_spin_us;
+		return *this;
+	}
+
+	void print(const std::string &name) const;
+};
+
+/*
+ * This decides how long a thread polls for I/O completions before it
+ * blocks. Polling avoids the wakeup latency, but burns CPU if it takes
+ * long for the next request to complete. We keep a moving average of
+ * the intervals between completions and only poll when we expect
+ * the next completion within the maximal poll time. When the I/O is idle,
+ * the intervals become large and the thread blocks right away.
+ *
+ * It isn't thread-safe. Each thread should have its own poller.
+ */
+class hybrid_poller
+{
+	const int64_t max_poll_us;
+	// The moving average of the intervals between completions
+	// in microseconds.
+	double avg_interval;
+	int64_t last_completion;
+	poll_stat stat;
+public:
+	hybrid_poller(int max_poll_us);
+
+	/*
+	 * How long the thread should poll before it blocks.
+	 * 0 means it should block right away.
+	 */
+	int64_t get_poll_time() const;
+
+	/*
+	 * This is invoked when `num' requests complete.
+	 */
+	void record_completions(int num, int64_t curr_us);
+
+	/*
+	 * A poll that took `spin_us' found the I/O completions.
+	 */
+	void poll_hit(int64_t spin_us) {
+		stat.num_poll_hits++;
+		stat.spin_us += spin_us;
+	}
+
+	/*
+	 * A poll that took `spin_us' gave up and the thread is going to block.
+	 */
+	void poll_miss(int64_t spin_us) {
+		stat.num_poll_misses++;
+		stat.spin_us += spin_us;
+		stat.wasted_spin_us += spin_us;
+	}
+
+	void wakeup() {
+		stat.num_wakeups++;
+	}
+
+	const poll_stat &get_stat() const {
+		return stat;
+	}
+};
+
+}
+
+#endif
@@ -268,6 +268,41 @@ void NUMA_buffer::dump(const std::string &file_name)
 	fclose(f);
 }
 
+void NUMA_buffer::dump_safs(const std::string &file_name)
+{
+	safs_file f(get_sys_RAID_conf(), file_name);
+	if (f.exist())
+		throw io_exception(file_name + " already exists in SAFS");
+	// The length of the buffer is always rounded to pages.
+	if (!f.create_file(get_length()))
+		throw io_exception(std::string("can't create ") + file_name);
+
+	file_io_factory::shared_ptr io_factory = create_io_factory(file_name,
+			REMOTE_ACCESS);
+	if (io_factory == NULL)
+		throw io_exception(std::string("can't create io factory for ")
+				+ file_name);
+	io_interface::ptr io = create_internal_io(io_factory,
+			thread::get_curr_thread());
+	if (io == NULL)
+		throw io_exception(std::string("can't create io instance for ")
+				+ file_name);
+	// The physical buffers are allocated in pages, so we can write data
+	// from the buffers directly.
+	const size_t MAX_IO_SIZE = std::min(256UL * 1024 * 1024,
+			mapper.get_range_size());
+	for (off_t off = 0; (size_t) off < get_length(); ) {
+		data_loc_t loc(io_factory->get_file_id(), off);
+		size_t write_size = std::min(MAX_IO_SIZE, get_length() - off);
+		data_info data = get_data(off, write_size);
+		size_t req_size = std::min(data.second, write_size);
+		io_request req(data.first, loc, req_size, WRITE);
+		io->access(&req, 1);
+		io->wait4complete(1);
+		off += req_size;
+	}
+}
+
 NUMA_buffer::ptr NUMA_buffer::load_safs(const std::string &file_name,
 		const NUMA_mapper &mapper)
 {
@@ -279,7 +314,8 @@ NUMA_buffer::ptr NUMA_buffer::load_safs(const std::string &file_name,
 
 	size_t file_size = io_factory->get_file_size();
 	NUMA_buffer::ptr numa_buf(new NUMA_buffer(file_size, mapper));
-	io_interface::ptr io = create_io(io_factory, thread::get_curr_thread());
+	io_interface::ptr io = create_internal_io(io_factory,
+			thread::get_curr_thread());
 	if (io == NULL)
 		throw io_exception(std::string("can't create io instance for ")
 				+ file_name);
@@ -464,6 +500,7 @@ void in_mem_io::process_computes()
 
 io_status in_mem_io::access(char *buf, off_t off, ssize_t size, int access_method)
 {
+	trace_access(off, size, access_method);
 	if (access_method == READ)
 		data->copy_to(buf, size, off);
 	else
@@ -473,6 +510,7 @@ io_status in_mem_io::access(char *buf, off_t off, ssize_t size, int access_metho
 
 void in_mem_io::access(io_request *requests, int num, io_status *)
 {
+	trace_access(requests, num);
 	for (int i = 0; i < num; i++) {
 		io_request &req = requests[i];
 		if (req.get_req_type() == io_request::USER_COMPUTE) {
@@ -92,6 +92,10 @@ public:
 	void copy_to(char *buf, size_t size, off_t off) const;
 
 	void dump(const std::string &file);
+	/*
+	 * Write the data in the buffer to a new file in SAFS.
+	 */
+	void dump_safs(const std::string &file);
 };
 
 /*
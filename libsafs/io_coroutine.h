@@ -0,0 +1,433 @@
+#ifndef __IO_COROUTINE_H__
+#define __IO_COROUTINE_H__
+
+/*
+ * Copyright 2014 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of SAFSlib.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/*
+ * This is a coroutine layer on top of the asynchronous I/O interface.
+ * A task issues a request with `co_await' and is suspended until
+ * the request completes, so we don't need to write a callback and keep
+ * the state of the computation by ourselves.
+ *
+ *	io_task sum_page(coro_io &io, off_t off, long &sum) {
+ *		std::shared_ptr<char> buf = co_await io.read(
+ *				data_loc_t(io.get_file_id(), off), PAGE_SIZE);
+ *		for (int i = 0; i < PAGE_SIZE; i++)
+ *			sum += buf.get()[i];
+ *	}
+ *
+ *	coro_scheduler sched;
+ *	coro_io io(sched, create_io(factory, thread::get_curr_thread()));
+ *	for (off_t off = 0; off < size; off += PAGE_SIZE)
+ *		sched.spawn(sum_page(io, off, sum));
+ *	sched.run();
+ *
+ * The layer is header-only and requires C++20, so only the code that
+ * uses coroutines needs to be compiled with C++20.
+ */
+
+#if __cplusplus < 202002L || !defined(__cpp_impl_coroutine)
+#error "io_coroutine.h requires C++20 coroutines"
+#endif
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <vector>
+
+#include <boost/format.hpp>
+
+#include "log.h"
+#include "comm_exception.h"
+#include "io_interface.h"
+#include "io_request.h"
+#include "thread.h"
+
+namespace safs
+{
+
+/*
+ * The coroutine type of a task run by coro_scheduler.
+ * A task starts to run after it's spawned in a scheduler.
+ * A task can only wait for I/O requests. It can't wait for another task,
+ * but it can spawn other tasks in the scheduler.
+ */
+class io_task
+{
+public:
+	struct promise_type
+	{
+		std::exception_ptr exception;
+
+		io_task get_return_object() {
+			return io_task(
+					std::coroutine_handle<promise_type>::from_promise(*this));
+		}
+
+		std::suspend_always initial_suspend() noexcept {
+			return std::suspend_always();
+		}
+
+		// The scheduler destroys the coroutine after it's done.
+		std::suspend_always final_suspend() noexcept {
+			return std::suspend_always();
+		}
+
+		void return_void() {
+		}
+
+		void unhandled_exception() {
+			exception = std::current_exception();
+		}
+	};
+
+	typedef std::coroutine_handle<promise_type> handle_t;
+private:
+	handle_t handle;
+
+	explicit io_task(handle_t handle) {
+		this->handle = handle;
+	}
+public:
+	io_task(io_task &&task) {
+		this->handle = task.handle;
+		task.handle = nullptr;
+	}
+
+	io_task(const io_task &) = delete;
+	io_task &operator=(const io_task &) = delete;
+
+	~io_task() {
+		if (handle)
+			handle.destroy();
+	}
+
+	/*
+	 * The scheduler takes the ownership of the coroutine.
+	 */
+	handle_t release() {
+		handle_t ret = handle;
+		handle = nullptr;
+		return ret;
+	}
+};
+
+class coro_io;
+
+/*
+ * An I/O request that a task waits for. It lives in the frame of
+ * the suspended task, so the I/O request keeps a pointer to it as
+ * the user data and the completion finds the task to resume.
+ */
+class io_awaiter
+{
+	coro_io &io;
+	io_request req;
+	// The buffer allocated for a read request.
+	std::shared_ptr<char> buf;
+	io_task::handle_t task;
+public:
+	io_awaiter(coro_io &io, const io_request &req,
+			std::shared_ptr<char> buf = NULL): io(io), req(req) {
+		this->buf = buf;
+		this->req.set_user_data(this);
+	}
+
+	bool await_ready() const noexcept {
+		return false;
+	}
+
+	inline void await_suspend(io_task::handle_t task);
+
+	/*
+	 * It returns the buffer allocated for the request,
+	 * or NULL if the buffer is provided by the user.
+	 */
+	std::shared_ptr<char> await_resume() {
+		return buf;
+	}
+
+	io_request &get_request() {
+		return req;
+	}
+
+	inline void complete();
+};
+
+/*
+ * This runs tasks in a thread. It resumes a task when the request that
+ * the task waits for completes, issues the requests of the tasks to
+ * the I/O instances in batches and waits for their completion with
+ * wait4complete. The tasks and the I/O instances have to be used in
+ * the thread that creates the scheduler.
+ */
+class coro_scheduler
+{
+	thread *t;
+	// The tasks that can run now.
+	std::deque<io_task::handle_t> ready;
+	// The tasks that haven't finished.
+	std::vector<io_task::handle_t> tasks;
+	std::vector<coro_io *> ios;
+	// We wait for the I/O instances in turn.
+	size_t wait_idx;
+
+	inline void finish(io_task::handle_t task);
+	inline void issue_all();
+	inline bool wait();
+public:
+	coro_scheduler() {
+		t = thread::get_curr_thread();
+		wait_idx = 0;
+	}
+
+	inline ~coro_scheduler();
+
+	void spawn(io_task task) {
+		io_task::handle_t handle = task.release();
+		tasks.push_back(handle);
+		ready.push_back(handle);
+	}
+
+	void add_io(coro_io *io) {
+		ios.push_back(io);
+	}
+
+	void make_ready(io_task::handle_t task) {
+		ready.push_back(task);
+	}
+
+	size_t get_num_tasks() const {
+		return tasks.size();
+	}
+
+	/*
+	 * Run until all tasks finish. If a task throws an exception,
+	 * the exception is thrown here.
+	 */
+	inline void run();
+};
+
+/*
+ * An I/O instance used by coroutines. It takes over the callback of
+ * the I/O instance, so the I/O instance can't be used for other
+ * asynchronous requests.
+ */
+class coro_io
+{
+	class coro_callback: public callback
+	{
+	public:
+		virtual int invoke(io_request *reqs[], int num) {
+			for (int i = 0; i < num; i++)
+				((io_awaiter *) reqs[i]->get_user_data())->complete();
+			return 0;
+		}
+	};
+
+	coro_scheduler &sched;
+	io_interface::ptr io;
+	// The requests that haven't been issued.
+	std::deque<io_awaiter *> to_issue;
+	// The number of requests issued but not completed.
+	size_t num_issued;
+
+	static void free_buf(char *buf) {
+		free(buf);
+	}
+public:
+	coro_io(coro_scheduler &sched, io_interface::ptr io): sched(sched) {
+		assert(io->support_aio());
+		this->io = io;
+		num_issued = 0;
+		io->set_callback(callback::ptr(new coro_callback()));
+		sched.add_io(this);
+	}
+
+	io_interface &get_io() {
+		return *io;
+	}
+
+	int get_file_id() const {
+		return io->get_file_id();
+	}
+
+	coro_scheduler &get_scheduler() {
+		return sched;
+	}
+
+	/*
+	 * Read `size' bytes to a buffer allocated by the layer.
+	 * The location and the size should be aligned as required by
+	 * the I/O instance.
+	 */
+	io_awaiter read(const data_loc_t &loc, size_t size) {
+		char *buf = NULL;
+		int ret = posix_memalign((void **) &buf, PAGE_SIZE, size);
+		if (ret != 0)
+			throw oom_exception();
+		return io_awaiter(*this, io_request(buf, loc, size, READ, io.get(),
+					io->get_node_id()), std::shared_ptr<char>(buf, free_buf));
+	}
+
+	io_awaiter read(const data_loc_t &loc, char *buf, size_t size) {
+		return io_awaiter(*this, io_request(buf, loc, size, READ, io.get(),
+					io->get_node_id()));
+	}
+
+	io_awaiter write(const data_loc_t &loc, char *buf, size_t size) {
+		return io_awaiter(*this, io_request(buf, loc, size, WRITE, io.get(),
+					io->get_node_id()));
+	}
+
+	void add_request(io_awaiter *req) {
+		to_issue.push_back(req);
+	}
+
+	void complete_request() {
+		assert(num_issued > 0);
+		num_issued--;
+	}
+
+	bool has_requests() const {
+		return num_issued > 0 || !to_issue.empty();
+	}
+
+	/*
+	 * Issue the requests as long as the I/O instance has free slots.
+	 */
+	void issue() {
+		if (to_issue.empty())
+			return;
+		int num = std::min<int>(to_issue.size(),
+				io->get_remaining_io_slots());
+		// We have to issue a request if no request is in flight.
+		if (num <= 0 && io->num_pending_ios() == 0)
+			num = 1;
+		if (num <= 0)
+			return;
+		std::vector<io_request> reqs(num);
+		for (int i = 0; i < num; i++)
+			reqs[i] = to_issue[i]->get_request();
+		to_issue.erase(to_issue.begin(), to_issue.begin() + num);
+		// The requests may complete inside access(), e.g., on cache hits.
+		num_issued += num;
+		io->access(reqs.data(), num);
+	}
+
+	void wait() {
+		if (num_issued > 0)
+			io->wait4complete(1);
+	}
+};
+
+void io_awaiter::await_suspend(io_task::handle_t task)
+{
+	this->task = task;
+	io.add_request(this);
+}
+
+void io_awaiter::complete()
+{
+	io.complete_request();
+	io.get_scheduler().make_ready(task);
+}
+
+void coro_scheduler::finish(io_task::handle_t task)
+{
+	std::exception_ptr exception = task.promise().exception;
+	for (size_t i = 0; i < tasks.size(); i++) {
+		if (tasks[i] == task) {
+			tasks[i] = tasks.back();
+			tasks.pop_back();
+			break;
+		}
+	}
+	task.destroy();
+	if (exception)
+		std::rethrow_exception(exception);
+}
+
+void coro_scheduler::issue_all()
+{
+	for (size_t i = 0; i < ios.size(); i++)
+		ios[i]->issue();
+}
+
+bool coro_scheduler::wait()
+{
+	for (size_t i = 0; i < ios.size(); i++) {
+		coro_io *io = ios[(wait_idx + i) % ios.size()];
+		if (io->has_requests()) {
+			io->wait();
+			wait_idx = (wait_idx + i + 1) % ios.size();
+			return true;
+		}
+	}
+	return false;
+}
+
+void coro_scheduler::run()
+{
+	assert(thread::get_curr_thread() == t);
+	while (!tasks.empty()) {
+		while (!ready.empty()) {
+			io_task::handle_t task = ready.front();
+			ready.pop_front();
+			task.resume();
+			if (task.done())
+				finish(task);
+		}
+		issue_all();
+		// Some requests may have completed when they were issued.
+		if (!ready.empty())
+			continue;
+		if (!tasks.empty() && !wait()) {
+			BOOST_LOG_TRIVIAL(error) << boost::format(
+					"%1% tasks don't wait for any I/O") % tasks.size();
+			break;
+		}
+	}
+}
+
+coro_scheduler::~coro_scheduler()
+{
+	// The suspended tasks may still wait for I/O. We can only destroy
+	// them after their requests complete.
+	for (size_t i = 0; i < ios.size(); i++) {
+		issue_all();
+		while (ios[i]->has_requests()) {
+			ios[i]->wait();
+			issue_all();
+		}
+	}
+	for (size_t i = 0; i < tasks.size(); i++)
+		tasks[i].destroy();
+}
+
+}
+
+#endif
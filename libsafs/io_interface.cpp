@@ -21,6 +21,7 @@
 #include <signal.h>
 #include <time.h>
 #include <pthread.h>
+#include <unistd.h>
 
 #include <unordered_set>
 #include <unordered_map>
@@ -45,6 +46,9 @@
 #include "safs_file.h"
 #include "safs_exception.h"
 #include "direct_comp_access.h"
+#include "log_structured_io.h"
+#include "io_trace.h"
+#include "mem_governor.h"
 
 namespace safs
 {
@@ -56,6 +60,30 @@ namespace safs
  * As long as all threads call init_io_system() first before using
  * the global data, they will all see the complete global data.
  */
+/*
+ * The page cache gives memory back when other components need memory.
+ */
+class page_cache_consumer: public mem_consumer
+{
+	page_cache::ptr cache;
+public:
+	page_cache_consumer(page_cache::ptr cache) {
+		this->cache = cache;
+	}
+
+	virtual size_t get_mem_usage() const {
+		return cache->size();
+	}
+
+	virtual size_t reclaim(size_t size) {
+		return cache->reclaim(size);
+	}
+
+	virtual size_t regrow(size_t size) {
+		return cache->regrow(size);
+	}
+};
+
 struct global_data_collection
 {
 	// Count the number of times init_io_system is executed successfully.
@@ -71,6 +99,9 @@ struct global_data_collection
 	cache_config::ptr cache_conf;
 	page_cache::ptr global_cache;
 	std::vector<int> io_cpus;
+	// It records the accesses to the I/O instances created by create_io().
+	io_tracer::ptr tracer;
+	std::unique_ptr<page_cache_consumer> cache_consumer;
 #ifdef PART_IO
 	// For part_global_cached_io
 	part_io_process_table *table;
@@ -105,6 +136,20 @@ public:
 		lock.unlock();
 		return *mapper;
 	}
+
+	/*
+	 * A file may be deleted and created again with the same name, and
+	 * its partitions may be placed on different disks. This creates
+	 * a new mapper for the file. Like other mappers, the old one is never
+	 * freed because a factory may still refer to it.
+	 */
+	file_mapper &reload(const std::string &name) {
+		file_mapper *mapper = global_data.raid_conf->create_file_mapper(name);
+		lock.lock();
+		map[name] = mapper;
+		lock.unlock();
+		return *mapper;
+	}
 };
 static file_mapper_set file_mappers;
 
@@ -176,6 +221,22 @@ int get_file_weight(file_id_t file_id)
 		return 1;
 }
 
+// We only bind I/O threads to CPU cores automatically if a NUMA node
+// has at least this many cores for each I/O thread.
+static const size_t MIN_CORES_PER_BOUND_IO_THREAD = 4;
+
+static std::string get_disk_names(const std::vector<int> &disks,
+		const file_mapper *mapper)
+{
+	std::string names;
+	for (size_t i = 0; i < disks.size(); i++) {
+		if (i > 0)
+			names += ",";
+		names += mapper->get_file_name(disks[i]);
+	}
+	return names;
+}
+
 void init_io_system(config_map::ptr configs, bool with_cache)
 {
 #ifdef ENABLE_MEM_TRACE
@@ -193,6 +254,8 @@ void init_io_system(config_map::ptr configs, bool with_cache)
 	
 	params.init(configs->get_options());
 	thread::thread_class_init();
+	if (!params.get_io_trace_file().empty() && global_data.tracer == NULL)
+		global_data.tracer = io_tracer::create(params.get_io_trace_file());
 
 	// The I/O system has been initialized.
 	if (is_safs_init()) {
@@ -253,6 +316,22 @@ void init_io_system(config_map::ptr configs, bool with_cache)
 				it->second.push_back(i);
 			}
 		}
+		// If users don't tell us, we only bind I/O threads to CPU cores
+		// when the nodes with disks have enough cores for other threads.
+		bool bind_io_thread = params.is_bind_io_thread();
+		if (params.is_auto_bind_io_thread()) {
+			bind_io_thread = true;
+			for (auto it = indices.begin(); it != indices.end(); it++) {
+				size_t num_io_threads = params.get_num_io_threads();
+				if (num_io_threads == 0)
+					num_io_threads = it->second.size();
+				const NUMA_node *node = cpus.get_os_node(it->first);
+				if (node == NULL || node->get_num_cores()
+						< num_io_threads * MIN_CORES_PER_BOUND_IO_THREAD)
+					bind_io_thread = false;
+			}
+		}
+		cpus.print();
 		// Iterate over the NUMA nodes with disks.
 		size_t tot_num_threads = 0;
 		for (auto it = indices.begin(); it != indices.end(); it++) {
@@ -269,7 +348,9 @@ void init_io_system(config_map::ptr configs, bool with_cache)
 						"The number of disks should be divisible by #I/O threads\n");
 				exit(-1);
 			}
+			const NUMA_node *node = cpus.get_os_node(it->first);
 			std::vector<disk_io_thread::ptr> ts(num_io_threads);
+			std::string layout;
 			tot_num_threads += num_io_threads;
 			for (size_t i = 0; i < ts.size(); i++) {
 				std::vector<int> disks(it->second.size() / ts.size());
@@ -277,26 +358,34 @@ void init_io_system(config_map::ptr configs, bool with_cache)
 					disks[j] = it->second[i * disks.size() + j];
 				logical_file_partition partition(disks, mapper);
 
-#ifdef USE_HWLOC
-				if (params.is_bind_io_thread()) {
+				if (bind_io_thread && node && i < node->get_num_cores()) {
 					// If we bind an I/O thread to a specific CPU core, the CPU
 					// core will be used by the thread exclusively.
-					const CPU_core &core = cpus.get_node(it->first).get_core(i);
+					// We take the cores from the end of the node, so
+					// the worker threads get a contiguous range of cores.
+					const CPU_core &core = node->get_core(
+							node->get_num_cores() - 1 - i);
 					std::vector<int> units = core.get_units();
 					global_data.io_cpus.insert(global_data.io_cpus.end(),
 							units.begin(), units.end());
 					ts[i] = disk_io_thread::ptr(new disk_io_thread(partition,
 								units[0], it->first, flags));
+					layout += str(boost::format(" %1%->CPU %2%")
+							% get_disk_names(disks, mapper) % units[0]);
 				}
-				else
-#endif
+				else {
 					ts[i] = disk_io_thread::ptr(new disk_io_thread(partition,
 								it->first, flags));
+					layout += str(boost::format(" %1%->node")
+							% get_disk_names(disks, mapper));
+				}
 				for (size_t j = 0; j < disks.size(); j++) {
 					int file_idx = disks[j];
 					global_data.read_threads[file_idx] = ts[i];
 				}
 			}
+			BOOST_LOG_TRIVIAL(info) << boost::format(
+					"I/O threads on NUMA node %1%:%2%") % it->first % layout;
 		}
 		BOOST_LOG_TRIVIAL(info) << boost::format(
 				"SAFS runs on %1% SSDs with %2% I/O threads") % num_files
@@ -336,6 +425,14 @@ void init_io_system(config_map::ptr configs, bool with_cache)
 		global_data.global_cache->init(underlying);
 #endif
 	}
+	mem_governor::get().set_budget(params.get_mem_budget());
+	if (global_data.global_cache && global_data.cache_consumer == NULL) {
+		global_data.cache_consumer = std::unique_ptr<page_cache_consumer>(
+				new page_cache_consumer(global_data.global_cache));
+		mem_governor::get().register_consumer(
+				global_data.cache_consumer.get(), "page cache",
+				global_data.global_cache->size());
+	}
 #ifdef PART_IO
 	if (global_data.table == NULL && with_cache) {
 		if (params.get_num_nodes() > 1)
@@ -381,6 +478,14 @@ void destroy_io_system()
 	global_data.read_threads.clear();
 	global_data.read_thread_set.clear();
 	destroy_aio();
+	// The trace file is closed after all traced I/O instances are destroyed.
+	global_data.tracer.reset();
+	mem_governor::get().print_usage();
+	if (global_data.cache_consumer) {
+		mem_governor::get().unregister_consumer(
+				global_data.cache_consumer.get());
+		global_data.cache_consumer.reset();
+	}
 	BOOST_LOG_TRIVIAL(info)
 		<< boost::format("I/O threads get %1% reads (%2% bytes) and %3% writes (%4% bytes)")
 		% num_reads % num_read_bytes % num_writes % num_write_bytes;
@@ -454,6 +559,9 @@ class remote_io_factory: public file_io_factory
 	// The number of existing IO instances.
 	std::atomic<size_t> num_ios;
 	file_mapper &mapper;
+	// It protects the polling statistics of the destroyed I/O instances.
+	pthread_spinlock_t stat_lock;
+	poll_stat io_poll_stat;
 
 	slab_allocator &get_msg_allocator(int node_id) {
 		if (node_id < 0)
@@ -477,11 +585,21 @@ public:
 	virtual void collect_stat(io_interface &io) {
 		remote_io &rio = (remote_io &) io;
 		tot_accesses += rio.get_num_reqs();
+		if (rio.get_poller()) {
+			pthread_spin_lock(&stat_lock);
+			io_poll_stat += rio.get_poller()->get_stat();
+			pthread_spin_unlock(&stat_lock);
+		}
 	}
 
 	virtual void print_statistics() const {
 		BOOST_LOG_TRIVIAL(info) << boost::format("%1% gets %2% I/O accesses")
 			% mapper.get_name() % tot_accesses.load();
+		if (params.is_hybrid_poll())
+			io_poll_stat.print(mapper.get_name());
+		for (size_t i = 0; i < msg_allocators.size(); i++)
+			msg_allocators[i]->print_stat();
+		unbind_msg_allocator->print_stat();
 	}
 };
 
@@ -492,6 +610,7 @@ class global_cached_io_factory: public file_io_factory
 	std::atomic_ulong tot_pg_accesses;
 	std::atomic_ulong tot_hits;
 	std::atomic_ulong tot_fast_process;
+	std::atomic_ulong tot_direct_bytes;
 
 	page_cache::ptr global_cache;
 	remote_io_factory::shared_ptr remote_factory;
@@ -504,6 +623,7 @@ public:
 		tot_pg_accesses = 0;
 		tot_hits = 0;
 		tot_fast_process = 0;
+		tot_direct_bytes = 0;
 		remote_factory = remote_io_factory::shared_ptr(new remote_io_factory(_mapper));
 	}
 
@@ -523,6 +643,7 @@ public:
 		tot_pg_accesses += gio.get_num_pg_accesses();
 		tot_hits += gio.get_cache_hits();
 		tot_fast_process += gio.get_num_fast_process();
+		tot_direct_bytes += gio.get_num_direct_bytes();
 	}
 
 	virtual void print_statistics() const {
@@ -532,6 +653,10 @@ public:
 		BOOST_LOG_TRIVIAL(info)
 			<< boost::format("There are %1% pages accessed, %2% cache hits, %3% of them are in the fast process")
 			% tot_pg_accesses.load() % tot_hits.load() % tot_fast_process.load();
+		if (tot_direct_bytes.load() > 0)
+			BOOST_LOG_TRIVIAL(info)
+				<< boost::format("%1% bytes are read to user buffers directly")
+				% tot_direct_bytes.load();
 	}
 };
 
@@ -577,6 +702,82 @@ public:
 	}
 };
 
+/*
+ * The I/O instances created by the factory buffer writes in a write log.
+ * The log is stored in a separate SAFS file, which is deleted when
+ * the factory is destroyed. The segments of the log are cleaned by
+ * a thread of the factory.
+ */
+class log_structured_io_factory: public file_io_factory
+{
+	std::atomic_ulong tot_write_bytes;
+	std::atomic_ulong tot_log_writes;
+	std::atomic_ulong tot_read_bytes;
+
+	const std::string log_name;
+	std::unique_ptr<write_log> log;
+	remote_io_factory::shared_ptr file_factory;
+	remote_io_factory::shared_ptr log_factory;
+	std::unique_ptr<log_cleaner> cleaner;
+public:
+	log_structured_io_factory(file_mapper &_mapper, file_mapper &log_mapper,
+			size_t seg_pages, size_t num_segs): file_io_factory(
+				_mapper.get_name()), log_name(log_mapper.get_name()) {
+		tot_write_bytes = 0;
+		tot_log_writes = 0;
+		tot_read_bytes = 0;
+		size_t num_pages = ROUNDUP(get_file_size(), PAGE_SIZE) / PAGE_SIZE;
+		log = std::unique_ptr<write_log>(new write_log(num_pages, seg_pages,
+					num_segs));
+		file_factory = remote_io_factory::shared_ptr(
+				new remote_io_factory(_mapper));
+		log_factory = remote_io_factory::shared_ptr(
+				new remote_io_factory(log_mapper));
+		cleaner = std::unique_ptr<log_cleaner>(new log_cleaner());
+		cleaner->set_io(std::static_pointer_cast<log_structured_io>(
+					create_io(cleaner.get())));
+		cleaner->start();
+	}
+
+	~log_structured_io_factory() {
+		// The cleaner has to destroy its I/O instance before we close
+		// the file and the log.
+		cleaner = NULL;
+		// The I/O threads have to close the log before we delete it.
+		log_factory = NULL;
+		safs_file f(*global_data.raid_conf, log_name);
+		f.delete_file();
+	}
+
+	virtual io_interface::ptr create_io(thread *t);
+
+	virtual void destroy_io(io_interface &io) {
+		// The underlying I/O instances are deleted in the destructor of
+		// log_structured_io.
+	}
+
+	virtual int get_file_id() const {
+		return file_factory->get_file_id();
+	}
+
+	virtual void write_back();
+
+	virtual void collect_stat(io_interface &io) {
+		log_structured_io &lio = (log_structured_io &) io;
+		tot_write_bytes += lio.get_num_write_bytes();
+		tot_log_writes += lio.get_num_log_writes();
+		tot_read_bytes += lio.get_num_read_bytes();
+	}
+
+	virtual void print_statistics() const {
+		BOOST_LOG_TRIVIAL(info)
+			<< boost::format("%1% reads %2% bytes, writes %3% bytes in %4% writes to the log")
+			% get_name() % tot_read_bytes.load() % tot_write_bytes.load()
+			% tot_log_writes.load();
+		log->print_stat();
+	}
+};
+
 #ifdef PART_IO
 class part_global_cached_io_factory: public remote_io_factory
 {
@@ -658,6 +859,7 @@ remote_io_factory::remote_io_factory(file_mapper &_mapper): file_io_factory(
 				IO_MSG_SIZE * sizeof(io_request) * 1024, INT_MAX, -1));
 	tot_accesses = 0;
 	num_ios = 0;
+	pthread_spin_init(&stat_lock, PTHREAD_PROCESS_PRIVATE);
 	int num_files = mapper.get_num_files();
 	assert((int) global_data.read_threads.size() == num_files);
 
@@ -669,6 +871,7 @@ remote_io_factory::remote_io_factory(file_mapper &_mapper): file_io_factory(
 remote_io_factory::~remote_io_factory()
 {
 	assert(num_ios == 0);
+	pthread_spin_destroy(&stat_lock);
 	// If the I/O threads haven't been destroyed.
 	for (auto it = global_data.read_thread_set.begin();
 			it != global_data.read_thread_set.end(); it++)
@@ -696,7 +899,7 @@ void remote_io_factory::destroy_io(io_interface &io)
 
 io_interface::ptr global_cached_io_factory::create_io(thread *t)
 {
-	io_interface::ptr underlying = safs::create_io(remote_factory, t);
+	io_interface::ptr underlying = create_internal_io(remote_factory, t);
 	comp_io_scheduler::ptr scheduler;
 	if (get_sched_creator())
 		scheduler = get_sched_creator()->create(underlying->get_node_id());
@@ -714,12 +917,71 @@ void global_cached_io_factory::destroy_io(io_interface &io)
 
 io_interface::ptr direct_comp_io_factory::create_io(thread *t)
 {
-	io_interface::ptr underlying = safs::create_io(remote_factory, t);
+	io_interface::ptr underlying = create_internal_io(remote_factory, t);
 	direct_comp_io *io = new direct_comp_io(
 			std::static_pointer_cast<remote_io>(underlying));
 	return io_interface::ptr(io);
 }
 
+io_interface::ptr log_structured_io_factory::create_io(thread *t)
+{
+	std::shared_ptr<remote_io> file_io = std::static_pointer_cast<remote_io>(
+			create_internal_io(file_factory, t));
+	std::shared_ptr<remote_io> log_io = std::static_pointer_cast<remote_io>(
+			create_internal_io(log_factory, t));
+	log_structured_io *io = new log_structured_io(*log,
+			log_factory->get_file_id(), file_io, log_io);
+	if (t != cleaner.get())
+		io->set_cleaner(cleaner.get());
+	return io_interface::ptr(io);
+}
+
+void log_structured_io_factory::write_back()
+{
+	thread *t = thread::get_curr_thread();
+	assert(t);
+	io_interface::ptr io = create_io(t);
+	static_cast<log_structured_io &>(*io).write_back_all();
+}
+
+/*
+ * A segment of the log is a stripe in the RAID, so the writes to the log
+ * are evenly distributed to all disks. A small file uses RAID blocks as
+ * segments instead, so the segments kept open by the threads don't make
+ * the log much larger than the file. The log is still written a RAID block
+ * at a time.
+ */
+static file_io_factory *create_log_structured_factory(file_mapper &mapper)
+{
+	// We over-provision the log by 25%, so we always have segments with
+	// few live pages to clean. Each thread writing to the file keeps
+	// a segment open, so we need a segment for each thread on top of it.
+	const size_t OVER_PROVISION = 4;
+	size_t num_threads = sysconf(_SC_NPROCESSORS_CONF);
+	size_t seg_pages = params.get_RAID_block_size()
+		* global_data.raid_conf->get_num_disks();
+	safs_file f(*global_data.raid_conf, mapper.get_name());
+	size_t num_pages = ROUNDUP(f.get_size(), PAGE_SIZE) / PAGE_SIZE;
+	size_t num_data_pages = num_pages + num_pages / OVER_PROVISION;
+	if (num_data_pages < num_threads * seg_pages)
+		seg_pages = params.get_RAID_block_size();
+	size_t num_segs = ROUNDUP(num_data_pages, seg_pages) / seg_pages
+		+ num_threads;
+
+	std::string log_name = mapper.get_name() + ".wlog";
+	safs_file log_file(*global_data.raid_conf, log_name);
+	// The log may be left by a process that crashed.
+	if (log_file.exist())
+		log_file.delete_file();
+	if (!log_file.create_file(num_segs * seg_pages * PAGE_SIZE))
+		throw io_exception(boost::str(boost::format(
+						"can't create the write log %1%") % log_name));
+	// The log of a previous factory of the file may have been placed on
+	// the disks differently.
+	return new log_structured_io_factory(mapper,
+			file_mappers.reload(log_name), seg_pages, num_segs);
+}
+
 void direct_comp_io_factory::destroy_io(io_interface &io)
 {
 	// num_ios is decreased by the underlying remote I/O instance.
@@ -795,6 +1057,9 @@ file_io_factory::shared_ptr create_io_factory(const std::string &file_name,
 		case DIRECT_COMP_ACCESS:
 			factory = new direct_comp_io_factory(mapper);
 			break;
+		case LOG_STRUCTURED_ACCESS:
+			factory = create_log_structured_factory(mapper);
+			break;
 #ifdef PART_IO
 		case PART_GLOBAL_ACCESS:
 			if (global_data.global_cache)
@@ -810,13 +1075,26 @@ file_io_factory::shared_ptr create_io_factory(const std::string &file_name,
 	return file_io_factory::shared_ptr(factory, destroy_io_factory());
 }
 
-io_interface::ptr create_io(file_io_factory::shared_ptr factory, thread *t)
+io_interface::ptr create_internal_io(file_io_factory::shared_ptr factory,
+		thread *t)
 {
 	io_interface::ptr io = factory->create_io(t);
 	io->set_owner(factory);
 	return io;
 }
 
+io_interface::ptr create_io(file_io_factory::shared_ptr factory, thread *t)
+{
+	io_interface::ptr io = create_internal_io(factory, t);
+	if (global_data.tracer) {
+		global_data.tracer->add_file(io->get_file_id(), factory->get_name());
+		io->set_trace_buffer(std::shared_ptr<io_trace_buffer>(
+					new io_trace_buffer(global_data.tracer, t->get_id(),
+						t->get_node_id())));
+	}
+	return io;
+}
+
 void print_io_thread_stat()
 {
 	sleep(1);
@@ -824,6 +1102,7 @@ void print_io_thread_stat()
 		if (t)
 			t->print_stat();
 	}
+	slab_allocator::print_node_stat();
 }
 
 void print_io_summary()
@@ -832,6 +1111,8 @@ void print_io_summary()
 	size_t num_read_bytes = 0;
 	size_t num_writes = 0;
 	size_t num_write_bytes = 0;
+	poll_stat io_poll_stat;
+	bool hybrid_poll = false;
 
 	sleep(1);
 	BOOST_FOREACH(disk_io_thread::ptr t, global_data.read_thread_set) {
@@ -840,10 +1121,16 @@ void print_io_summary()
 			num_read_bytes += t->get_num_read_bytes();
 			num_writes += t->get_num_writes();
 			num_write_bytes += t->get_num_write_bytes();
+			if (t->get_poller()) {
+				io_poll_stat += t->get_poller()->get_stat();
+				hybrid_poll = true;
+			}
 		}
 	}
 	printf("It reads %ld bytes (in %ld reqs) and writes %ld bytes (in %ld reqs)\n",
 			num_read_bytes, num_reads, num_write_bytes, num_writes);
+	if (hybrid_poll)
+		io_poll_stat.print("I/O threads");
 }
 
 ssize_t file_io_factory::get_file_size() const
@@ -859,6 +1146,19 @@ bool is_safs_init()
 
 atomic_integer io_interface::io_counter;
 
+void io_interface::record_trace(const io_request *requests, int num)
+{
+	for (int i = 0; i < num; i++)
+		trace_buf->record(requests[i].get_file_id(),
+				requests[i].get_offset(), requests[i].get_size(),
+				requests[i].get_access_method(), requests[i].is_sync());
+}
+
+void io_interface::record_trace(off_t off, size_t size, int access_method)
+{
+	trace_buf->record(get_file_id(), off, size, access_method, true);
+}
+
 io_interface::~io_interface()
 {
 	if (io_factory) {
@@ -901,20 +1201,30 @@ io_select::ptr create_io_select(const std::vector<io_interface::ptr> &ios)
 		return io_select::ptr();
 
 	// Let's try to find a valid I/O select from the I/O objects.
-	io_select::ptr select;
+	// We prefer the one that can wait for all of the I/O objects.
+	io_select::ptr first;
 	for (size_t i = 0; i < ios.size(); i++) {
-		select = ios[i]->create_io_select();
-		if (select)
-			break;
+		io_select::ptr select = ios[i]->create_io_select();
+		if (select == NULL)
+			continue;
+		size_t num_added = 0;
+		for (size_t j = 0; j < ios.size(); j++)
+			if (select->add_io(ios[j]))
+				num_added++;
+		if (num_added == ios.size())
+			return select;
+		if (first == NULL)
+			first = select;
 	}
 	// If none of the I/O objects can create a valid I/O object, it means
 	// none of them actually need to access data from disks. We only need
 	// to create an empty I/O select.
-	if (select == NULL)
-		select = io_select::ptr(new empty_io_select());
-	for (size_t i = 0; i < ios.size(); i++)
-		select->add_io(ios[i]);
-	return select;
+	if (first == NULL) {
+		first = io_select::ptr(new empty_io_select());
+		for (size_t i = 0; i < ios.size(); i++)
+			first->add_io(ios[i]);
+	}
+	return first;
 }
 
 const std::vector<int> &get_io_cpus()
@@ -922,4 +1232,22 @@ const std::vector<int> &get_io_cpus()
 	return global_data.io_cpus;
 }
 
+std::vector<int> get_worker_cpus(int node_id)
+{
+	// If I/O threads don't use CPU cores exclusively, the worker threads
+	// are bound to NUMA nodes.
+	if (global_data.io_cpus.empty())
+		return std::vector<int>();
+	const NUMA_node *node = cpus.get_os_node(node_id);
+	if (node == NULL)
+		return std::vector<int>();
+
+	std::vector<int> logical_units = node->get_logical_units();
+	std::set<int> cpu_set(logical_units.begin(), logical_units.end());
+	// Remove the logical units where I/O threads run.
+	for (size_t j = 0; j < global_data.io_cpus.size(); j++)
+		cpu_set.erase(global_data.io_cpus[j]);
+	return std::vector<int>(cpu_set.begin(), cpu_set.end());
+}
+
 }
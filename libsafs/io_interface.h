@@ -104,7 +104,7 @@ enum
 };
 
 /**
- * This defines the method of accessing a SAFS file. There are six options.
+ * This defines the method of accessing a SAFS file. There are seven options.
  */
 enum {
 	/*
@@ -139,10 +139,19 @@ enum {
 	 * but without page cache.
 	 */
 	DIRECT_COMP_ACCESS,
+
+	/**
+	 * This method is similar to REMOTE_ACCESS, but it buffers writes
+	 * in a write log, so small random writes become large sequential
+	 * writes. The log only lives in memory, so it should only be used
+	 * for temporary files.
+	 */
+	LOG_STRUCTURED_ACCESS,
 };
 
 class file_io_factory;
 class io_select;
+class io_trace_buffer;
 
 /**
  * This class defines the interface of accessing a SAFS file.
@@ -162,7 +171,11 @@ class io_interface
 	static atomic_integer io_counter;
 	// Keep the I/O factory alive.
 	std::shared_ptr<file_io_factory> io_factory;
+	// It's only used when we trace the accesses to the I/O instance.
+	std::shared_ptr<io_trace_buffer> trace_buf;
 
+	void record_trace(const io_request *requests, int num);
+	void record_trace(off_t off, size_t size, int access_method);
 protected:
 	io_interface(thread *t, const safs_header &header) {
 		this->header = header;
@@ -171,6 +184,20 @@ protected:
 		max_num_pending_ios = params.get_max_num_pending_ios();
 	}
 
+	/*
+	 * The I/O instances invoke these in their access methods, so
+	 * the accesses can be recorded in an I/O trace.
+	 */
+	void trace_access(const io_request *requests, int num) {
+		if (trace_buf)
+			record_trace(requests, num);
+	}
+
+	void trace_access(off_t off, size_t size, int access_method) {
+		if (trace_buf)
+			record_trace(off, size, access_method);
+	}
+
 public:
 	typedef std::shared_ptr<io_interface> ptr;
 
@@ -195,6 +222,13 @@ public:
 		this->io_factory = io_factory;
 	}
 
+	/*
+	 * Record the accesses to the I/O instance in the buffer.
+	 */
+	void set_trace_buffer(std::shared_ptr<io_trace_buffer> trace_buf) {
+		this->trace_buf = trace_buf;
+	}
+
 	/**
 	 * This method get the thread that the I/O instance is associated with.
 	 * \return the thread.
@@ -403,6 +437,13 @@ public:
  * \return an I/O instance.
  */
 io_interface::ptr create_io(std::shared_ptr<file_io_factory> factory, thread *t);
+/*
+ * This creates an I/O instance used inside SAFS, e.g., the underlying I/O
+ * of another I/O instance. Its accesses aren't traced, because they are
+ * traced in the I/O instance that users access.
+ */
+io_interface::ptr create_internal_io(std::shared_ptr<file_io_factory> factory,
+		thread *t);
 
 class comp_io_scheduler;
 
@@ -498,6 +539,15 @@ public:
 	virtual void print_statistics() const {
 	}
 
+	/**
+	 * Some I/O methods don't store data in its location in the file.
+	 * This method writes all data back to the file, so the file can be
+	 * accessed with other I/O methods. No threads should access the file
+	 * when it's invoked.
+	 */
+	virtual void write_back() {
+	}
+
 	/**
 	 * This method gets the size of the file accessed by the I/O factory.
 	 * \return the file size.
@@ -505,6 +555,8 @@ public:
 	ssize_t get_file_size() const;
 
 	friend io_interface::ptr create_io(file_io_factory::shared_ptr factory, thread *t);
+	friend io_interface::ptr create_internal_io(
+			file_io_factory::shared_ptr factory, thread *t);
 	friend class io_interface;
 };
 
@@ -517,8 +569,8 @@ io_select::ptr create_io_select(const std::vector<io_interface::ptr> &ios);
  * This function creates an I/O factory of the specified I/O method.
  * \param file_name the SAFS file accessed by the I/O factory.
  * \param access_option the I/O method of accessing the SAFS file.
- * The I/O method can be one of REMOTE_ACCESS, GLOBAL_CACHE_ACCESS and
- * PART_GLOBAL_ACCESS.
+ * The I/O method can be one of REMOTE_ACCESS, GLOBAL_CACHE_ACCESS,
+ * PART_GLOBAL_ACCESS and LOG_STRUCTURED_ACCESS.
  */
 file_io_factory::shared_ptr create_io_factory(const std::string &file_name,
 		const int access_option);
@@ -554,6 +606,14 @@ const RAID_config &get_sys_RAID_conf();
  */
 const std::vector<int> &get_io_cpus();
 
+/**
+ * Get the CPU cores in a NUMA node where worker threads should run.
+ * They are the cores that aren't used by I/O threads. It returns
+ * an empty vector if I/O threads don't use CPU cores exclusively, so
+ * worker threads should be bound to the NUMA node.
+ */
+std::vector<int> get_worker_cpus(int node_id);
+
 /**
  * \internal
  * This method print the I/O statistic information. It's used for debugging.
@@ -513,6 +513,9 @@ class io_request
 	unsigned int high_prio: 1;
 	unsigned int low_latency: 1;
 	unsigned int discarded: 1;
+	// The data is unlikely to be accessed again, so the page cache
+	// shouldn't evict other pages to keep it.
+	unsigned int no_cache: 1;
 	unsigned int node_id: 8;
 	int file_id;
 
@@ -543,12 +546,14 @@ class io_request
 		high_prio = 1;
 		low_latency = 0;
 		discarded = 0;
+		no_cache = 0;
 	}
 
 	void copy_flags(const io_request &req) {
 		this->sync = req.sync;
 		this->high_prio = req.high_prio;
 		this->low_latency = req.low_latency;
+		this->no_cache = req.no_cache;
 	}
 
 	void set_int_buf_size(size_t size) {
@@ -675,6 +680,7 @@ public:
 		offset = 0;
 		high_prio = 0;
 		sync = 0;
+		no_cache = 0;
 		node_id = MAX_NODE_ID;
 		io = NULL;
 		access_method = 0;
@@ -774,6 +780,21 @@ public:
 		this->low_latency = low_latency;
 	}
 
+	bool is_no_cache() const {
+		return (no_cache & 0x1) == 1;
+	}
+
+	/**
+	 * This is a hint to the page cache that the requested data is unlikely
+	 * to be accessed again, e.g., a large one-pass scan. The page cache
+	 * keeps the data in a page that is evicted first instead of evicting
+	 * the pages that are accessed more frequently.
+	 * \param no_cache whether to use the hint.
+	 */
+	void set_no_cache(bool no_cache) {
+		this->no_cache = no_cache;
+	}
+
 	/*
 	 * The requested data is inside a page on the disk.
 	 */
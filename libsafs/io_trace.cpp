@@ -0,0 +1,214 @@
+/*
+ * Copyright 2014 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of SAFSlib.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+
+#include <boost/assert.hpp>
+#include <boost/format.hpp>
+
+#include "log.h"
+#include "io_trace.h"
+
+namespace safs
+{
+
+static_assert(sizeof(io_trace_record) == 32,
+		"the size of a trace record should be 32 bytes");
+
+// The number of records buffered in an I/O instance.
+static const size_t TRACE_BUF_SIZE = 4096;
+
+static size_t get_name_space(size_t len)
+{
+	return (len + sizeof(io_trace_record) - 1) / sizeof(io_trace_record)
+		* sizeof(io_trace_record);
+}
+
+io_tracer::io_tracer(FILE *f)
+{
+	this->f = f;
+	pthread_mutex_init(&lock, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	num_records = 0;
+}
+
+io_tracer::ptr io_tracer::create(const std::string &file)
+{
+	FILE *f = fopen(file.c_str(), "w");
+	if (f == NULL) {
+		BOOST_LOG_TRIVIAL(error) << boost::format("can't create trace file %1%: %2%")
+			% file % strerror(errno);
+		return ptr();
+	}
+	io_trace_header header;
+	memcpy(header.magic, IO_TRACE_MAGIC, sizeof(header.magic));
+	header.version = IO_TRACE_VERSION;
+	header.record_size = sizeof(io_trace_record);
+	if (fwrite(&header, sizeof(header), 1, f) != 1) {
+		BOOST_LOG_TRIVIAL(error) << boost::format("can't write trace file %1%: %2%")
+			% file % strerror(errno);
+		fclose(f);
+		return ptr();
+	}
+	BOOST_LOG_TRIVIAL(info) << boost::format("trace I/O accesses to %1%") % file;
+	return ptr(new io_tracer(f));
+}
+
+io_tracer::~io_tracer()
+{
+	fclose(f);
+	pthread_mutex_destroy(&lock);
+	BOOST_LOG_TRIVIAL(info) << boost::format("%1% I/O accesses are traced")
+		% num_records;
+}
+
+uint64_t io_tracer::get_curr_time() const
+{
+	struct timespec curr;
+	clock_gettime(CLOCK_MONOTONIC, &curr);
+	return (curr.tv_sec - start.tv_sec) * 1000000000L
+		+ curr.tv_nsec - start.tv_nsec;
+}
+
+void io_tracer::add_file(int file_id, const std::string &name)
+{
+	io_trace_record rec;
+	memset(&rec, 0, sizeof(rec));
+	rec.timestamp = get_curr_time();
+	rec.file_id = file_id;
+	rec.size = name.size();
+	rec.access_method = TRACE_FILE_NAME;
+	std::vector<char> name_buf(get_name_space(name.size()));
+	memcpy(name_buf.data(), name.c_str(), name.size());
+
+	pthread_mutex_lock(&lock);
+	if (files.insert(file_id).second) {
+		BOOST_VERIFY(fwrite(&rec, sizeof(rec), 1, f) == 1);
+		if (!name_buf.empty())
+			BOOST_VERIFY(fwrite(name_buf.data(), name_buf.size(), 1, f) == 1);
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+void io_tracer::write(const std::vector<io_trace_record> &recs)
+{
+	if (recs.empty())
+		return;
+	pthread_mutex_lock(&lock);
+	BOOST_VERIFY(fwrite(recs.data(), sizeof(recs[0]), recs.size(), f)
+			== recs.size());
+	num_records += recs.size();
+	pthread_mutex_unlock(&lock);
+}
+
+io_trace_buffer::io_trace_buffer(io_tracer::ptr tracer, int thread_id,
+		int node_id)
+{
+	this->tracer = tracer;
+	this->thread_id = thread_id;
+	this->node_id = node_id;
+	recs.reserve(TRACE_BUF_SIZE);
+}
+
+void io_trace_buffer::record(int file_id, off_t off, size_t size,
+		int access_method, bool sync)
+{
+	io_trace_record rec;
+	rec.timestamp = tracer->get_curr_time();
+	rec.offset = off;
+	rec.size = size;
+	rec.file_id = file_id;
+	rec.thread_id = thread_id;
+	rec.node_id = node_id;
+	rec.access_method = access_method;
+	rec.flags = sync ? TRACE_SYNC : 0;
+	recs.push_back(rec);
+	if (recs.size() >= TRACE_BUF_SIZE)
+		flush();
+}
+
+void io_trace_buffer::flush()
+{
+	tracer->write(recs);
+	recs.clear();
+}
+
+struct comp_trace_time
+{
+	bool operator()(const io_trace_record &rec1,
+			const io_trace_record &rec2) const {
+		return rec1.timestamp < rec2.timestamp;
+	}
+};
+
+io_trace::ptr io_trace::load(const std::string &file)
+{
+	FILE *f = fopen(file.c_str(), "r");
+	if (f == NULL) {
+		BOOST_LOG_TRIVIAL(error) << boost::format("can't open trace file %1%: %2%")
+			% file % strerror(errno);
+		return ptr();
+	}
+	io_trace_header header;
+	if (fread(&header, sizeof(header), 1, f) != 1
+			|| memcmp(header.magic, IO_TRACE_MAGIC, sizeof(header.magic)) != 0
+			|| header.version != IO_TRACE_VERSION
+			|| header.record_size != sizeof(io_trace_record)) {
+		BOOST_LOG_TRIVIAL(error) << boost::format("%1% isn't a SAFS trace file")
+			% file;
+		fclose(f);
+		return ptr();
+	}
+
+	ptr trace(new io_trace());
+	io_trace_record rec;
+	while (fread(&rec, sizeof(rec), 1, f) == 1) {
+		if (rec.access_method != TRACE_FILE_NAME) {
+			trace->records.push_back(rec);
+			continue;
+		}
+		std::vector<char> name_buf(get_name_space(rec.size));
+		if (!name_buf.empty()
+				&& fread(name_buf.data(), name_buf.size(), 1, f) != 1)
+			break;
+		trace->file_names[rec.file_id] = std::string(name_buf.data(), rec.size);
+	}
+	fclose(f);
+	std::stable_sort(trace->records.begin(), trace->records.end(),
+			comp_trace_time());
+	BOOST_LOG_TRIVIAL(info) << boost::format(
+			"load %1% I/O accesses to %2% files from %3%")
+		% trace->records.size() % trace->file_names.size() % file;
+	return trace;
+}
+
+std::string io_trace::get_file_name(int file_id) const
+{
+	auto it = file_names.find(file_id);
+	if (it == file_names.end())
+		return std::string();
+	else
+		return it->second;
+}
+
+}
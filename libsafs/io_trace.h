@@ -0,0 +1,166 @@
+#ifndef __IO_TRACE_H__
+#define __IO_TRACE_H__
+
+/*
+ * Copyright 2014 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of SAFSlib.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace safs
+{
+
+/*
+ * The binary format of an I/O trace.
+ *
+ * A trace file starts with a header and is followed by fixed-size records.
+ * A record describes an access issued to an I/O instance created by
+ * create_io(). A record with the access method TRACE_FILE_NAME
+ * gives the name of a file in the trace. The name is stored after
+ * the record and is padded to a multiple of the record size.
+ *
+ * Records from different threads are interleaved in the file, so a reader
+ * should sort them by their timestamps.
+ */
+
+const char IO_TRACE_MAGIC[8] = "SAFSTRC";
+const uint32_t IO_TRACE_VERSION = 1;
+const uint8_t TRACE_FILE_NAME = 0xff;
+// The record is issued by a synchronous access.
+const uint8_t TRACE_SYNC = 0x1;
+
+struct io_trace_header
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t record_size;
+};
+
+struct io_trace_record
+{
+	// The time in nanoseconds since the trace started.
+	uint64_t timestamp;
+	int64_t offset;
+	uint32_t size;
+	int32_t file_id;
+	// The id of the thread that issues the access.
+	int32_t thread_id;
+	int16_t node_id;
+	// READ, WRITE or TRACE_FILE_NAME.
+	uint8_t access_method;
+	uint8_t flags;
+};
+
+/*
+ * This writes I/O trace records to a file. It's shared by all threads.
+ */
+class io_tracer
+{
+	FILE *f;
+	pthread_mutex_t lock;
+	struct timespec start;
+	std::set<int> files;
+	size_t num_records;
+
+	io_tracer(FILE *f);
+public:
+	typedef std::shared_ptr<io_tracer> ptr;
+
+	/*
+	 * It returns NULL if the trace file can't be created.
+	 */
+	static ptr create(const std::string &file);
+
+	~io_tracer();
+
+	/*
+	 * The time in nanoseconds since the trace started.
+	 */
+	uint64_t get_curr_time() const;
+
+	/*
+	 * Record the name of a file. It only records a file once.
+	 */
+	void add_file(int file_id, const std::string &name);
+	void write(const std::vector<io_trace_record> &recs);
+};
+
+/*
+ * Each traced I/O instance buffers its records locally and writes them
+ * to the tracer in batches, so threads rarely contend on the trace file.
+ */
+class io_trace_buffer
+{
+	io_tracer::ptr tracer;
+	int thread_id;
+	int node_id;
+	std::vector<io_trace_record> recs;
+public:
+	io_trace_buffer(io_tracer::ptr tracer, int thread_id, int node_id);
+
+	~io_trace_buffer() {
+		flush();
+	}
+
+	void record(int file_id, off_t off, size_t size, int access_method,
+			bool sync);
+	void flush();
+};
+
+/*
+ * An I/O trace loaded from a file.
+ */
+class io_trace
+{
+	// The records are sorted by their timestamps.
+	std::vector<io_trace_record> records;
+	std::map<int, std::string> file_names;
+public:
+	typedef std::shared_ptr<io_trace> ptr;
+
+	/*
+	 * It returns NULL if the file isn't a valid trace file.
+	 */
+	static ptr load(const std::string &file);
+
+	const std::vector<io_trace_record> &get_records() const {
+		return records;
+	}
+
+	size_t get_num_files() const {
+		return file_names.size();
+	}
+
+	/*
+	 * It returns an empty string if the file isn't in the trace.
+	 */
+	std::string get_file_name(int file_id) const;
+};
+
+}
+
+#endif
@@ -0,0 +1,750 @@
+/*
+ * Copyright 2014 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of SAFSlib.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <set>
+
+#include <boost/format.hpp>
+
+#include "log_structured_io.h"
+#include "comm_exception.h"
+#include "remote_access.h"
+#include "safs_exception.h"
+
+namespace safs
+{
+
+// The max number of free segment buffers kept in an I/O instance.
+static const size_t MAX_FREE_BUFS = 4;
+
+/*
+ * This is a request issued to the underlying I/O. It's stored in
+ * the user data of the request.
+ */
+class log_structured_io::sub_request
+{
+public:
+	virtual ~sub_request() {
+	}
+	virtual void complete(log_structured_io &io) = 0;
+};
+
+/*
+ * A part of a user read. It reads data from the file or from the log.
+ */
+class log_structured_io::read_part: public sub_request
+{
+	user_req *req;
+	// The pages in the log we are reading from.
+	off_t log_pg;
+	int num_log_pages;
+public:
+	read_part(user_req *req, off_t log_pg, int num_log_pages) {
+		this->req = req;
+		this->log_pg = log_pg;
+		this->num_log_pages = num_log_pages;
+	}
+
+	virtual void complete(log_structured_io &io) {
+		for (int i = 0; i < num_log_pages; i++)
+			io.log.release_read(log_pg + i);
+		if (--req->num_pending == 0)
+			io.complete_user_req(req);
+	}
+};
+
+/*
+ * A write of the data in a segment to the log.
+ */
+class log_structured_io::log_write: public sub_request
+{
+	open_seg *seg;
+	size_t start;
+	size_t num_pages;
+public:
+	// The user writes that have data in this write.
+	std::vector<user_req *> reqs;
+
+	log_write(open_seg *seg, size_t start, size_t num_pages) {
+		this->seg = seg;
+		this->start = start;
+		this->num_pages = num_pages;
+	}
+
+	virtual void complete(log_structured_io &io) {
+		off_t seg_start = seg->seg * io.log.get_seg_pages();
+		for (size_t i = start; i < start + num_pages; i++)
+			io.log.commit(seg->pages[i], seg_start + i, seg->seqs[i]);
+		seg->num_writing--;
+		for (size_t i = 0; i < reqs.size(); i++) {
+			if (--reqs[i]->num_pending == 0)
+				io.complete_user_req(reqs[i]);
+		}
+		// The segment is full and all data in it has been committed.
+		if (seg != io.curr_seg && seg->num_writing == 0)
+			io.retire_seg(seg);
+	}
+};
+
+/*
+ * The state of cleaning a segment. We first read the live pages from
+ * the segment and then write them back to the file.
+ */
+class log_structured_io::clean_state
+{
+public:
+	int seg;
+	// The data read from the segment. It's indexed by the page
+	// in the segment.
+	char *seg_buf;
+	// The live pages sorted by their locations in the file.
+	char *buf;
+	std::vector<std::pair<off_t, off_t> > pages;
+	int num_pending;
+	bool writing;
+
+	clean_state(int seg) {
+		this->seg = seg;
+		seg_buf = NULL;
+		buf = NULL;
+		num_pending = 0;
+		writing = false;
+	}
+};
+
+class log_structured_io::clean_part: public sub_request
+{
+	clean_state *state;
+	// The range of the live pages written back to the file.
+	size_t start;
+	size_t num_pages;
+public:
+	clean_part(clean_state *state, size_t start, size_t num_pages) {
+		this->state = state;
+		this->start = start;
+		this->num_pages = num_pages;
+	}
+
+	virtual void complete(log_structured_io &io) {
+		if (state->writing) {
+			for (size_t i = start; i < start + num_pages; i++)
+				io.log.commit_clean(state->pages[i].first,
+						state->pages[i].second);
+		}
+		if (--state->num_pending > 0)
+			return;
+		if (state->writing)
+			io.end_clean(state);
+		else
+			io.clean_write_back(state);
+	}
+};
+
+class log_structured_io::sub_callback: public callback
+{
+	log_structured_io &io;
+public:
+	sub_callback(log_structured_io &_io): io(_io) {
+	}
+
+	virtual int invoke(io_request *reqs[], int num) {
+		for (int i = 0; i < num; i++)
+			io.complete_sub_req(*reqs[i]);
+		return 0;
+	}
+};
+
+log_structured_io::log_structured_io(write_log &_log, int log_file_id,
+		std::shared_ptr<remote_io> file_io,
+		std::shared_ptr<remote_io> log_io): io_interface(file_io->get_thread(),
+			file_io->get_header()), log(_log),
+	block_pages(params.get_RAID_block_size()), log_file_id(log_file_id)
+{
+	assert(log.get_seg_pages() % block_pages == 0);
+	this->file_io = file_io;
+	this->log_io = log_io;
+	file_io->set_callback(callback::ptr(new sub_callback(*this)));
+	log_io->set_callback(callback::ptr(new sub_callback(*this)));
+	curr_seg = NULL;
+	cleaning = NULL;
+	cleaner = NULL;
+	num_issued_reqs = 0;
+	num_completed_reqs = 0;
+	num_sub_reqs = 0;
+	num_write_bytes = 0;
+	num_log_writes = 0;
+	num_read_bytes = 0;
+}
+
+log_structured_io::~log_structured_io()
+{
+	cleanup();
+	if (curr_seg) {
+		assert(curr_seg->num_writing == 0);
+		log.seal(curr_seg->seg);
+		free(curr_seg->buf);
+		delete curr_seg;
+	}
+	for (size_t i = 0; i < free_bufs.size(); i++)
+		free(free_bufs[i]);
+}
+
+int log_structured_io::get_file_id() const
+{
+	return file_io->get_file_id();
+}
+
+char *log_structured_io::alloc_buf()
+{
+	if (!free_bufs.empty()) {
+		char *buf = free_bufs.back();
+		free_bufs.pop_back();
+		return buf;
+	}
+	char *buf = NULL;
+	int ret = posix_memalign((void **) &buf, PAGE_SIZE,
+			log.get_seg_pages() * PAGE_SIZE);
+	if (ret)
+		throw oom_exception("can't allocate a buffer for the write log");
+	return buf;
+}
+
+void log_structured_io::free_buf(char *buf)
+{
+	if (free_bufs.size() < MAX_FREE_BUFS)
+		free_bufs.push_back(buf);
+	else
+		free(buf);
+}
+
+bool log_structured_io::open_new_seg()
+{
+	assert(curr_seg == NULL);
+	if (log.need_clean()) {
+		if (cleaner)
+			cleaner->activate();
+		else
+			start_clean(false);
+	}
+	int seg = log.open_seg();
+	if (seg < 0)
+		return false;
+	curr_seg = new open_seg();
+	curr_seg->seg = seg;
+	curr_seg->buf = alloc_buf();
+	curr_seg->num_filled = 0;
+	curr_seg->num_written = 0;
+	curr_seg->num_writing = 0;
+	curr_seg->pages.resize(log.get_seg_pages());
+	curr_seg->seqs.resize(log.get_seg_pages());
+	return true;
+}
+
+void log_structured_io::retire_seg(open_seg *seg)
+{
+	assert(seg->num_writing == 0);
+	log.seal(seg->seg);
+	free_buf(seg->buf);
+	delete seg;
+}
+
+/*
+ * Write the data in the current segment that hasn't been written
+ * to the log.
+ */
+void log_structured_io::write_curr_seg()
+{
+	if (curr_seg == NULL || curr_seg->num_filled == curr_seg->num_written)
+		return;
+
+	open_seg *seg = curr_seg;
+	size_t start = seg->num_written;
+	size_t num_pages = seg->num_filled - start;
+	log_write *write = new log_write(seg, start, num_pages);
+	write->reqs.swap(unwritten_reqs);
+	unwritten_pages.clear();
+	seg->num_written = seg->num_filled;
+	seg->num_writing++;
+	// The segment is full. The last write to the log seals the segment.
+	if (seg->num_filled == log.get_seg_pages())
+		curr_seg = NULL;
+
+	off_t log_pg = seg->seg * log.get_seg_pages() + start;
+	data_loc_t loc(log_file_id, log_pg * PAGE_SIZE);
+	io_request req(seg->buf + start * PAGE_SIZE, loc, num_pages * PAGE_SIZE,
+			WRITE, log_io.get(), get_node_id());
+	req.set_user_data(write);
+	num_sub_reqs++;
+	num_log_writes++;
+	log_io->access(&req, 1);
+}
+
+/*
+ * Copy the data of a user write to the current segment.
+ * It returns false if we run out of free segments before all data
+ * is added. In this case, we continue adding the remaining data later.
+ */
+bool log_structured_io::add_write(user_req *ureq)
+{
+	const io_request &req = ureq->req;
+	off_t end = req.get_offset() + req.get_size();
+	while (ureq->next_off < end) {
+		if (curr_seg == NULL && !open_new_seg())
+			return false;
+
+		off_t pg = ureq->next_off / PAGE_SIZE;
+		size_t slot;
+		// If the page is written again before its data is written to
+		// the log, we overwrite the data in the segment directly.
+		auto it = unwritten_pages.find(pg);
+		bool is_new = it == unwritten_pages.end();
+		if (is_new) {
+			slot = curr_seg->num_filled++;
+			curr_seg->pages[slot] = pg;
+			unwritten_pages.insert(std::pair<off_t, size_t>(pg, slot));
+		}
+		else
+			slot = it->second;
+		// Other I/O instances may write the page to their segments.
+		// The sequence number tells which write is the latest.
+		curr_seg->seqs[slot] = log.get_next_seq();
+		memcpy(curr_seg->buf + slot * PAGE_SIZE,
+				req.get_buf() + (ureq->next_off - req.get_offset()), PAGE_SIZE);
+		if (unwritten_reqs.empty() || unwritten_reqs.back() != ureq) {
+			unwritten_reqs.push_back(ureq);
+			ureq->num_pending++;
+		}
+		ureq->next_off += PAGE_SIZE;
+
+		// We write a RAID block to the log once it's filled.
+		if (is_new && curr_seg->num_filled % block_pages == 0)
+			write_curr_seg();
+	}
+	if (--ureq->num_pending == 0)
+		complete_user_req(ureq);
+	return true;
+}
+
+void log_structured_io::process_blocked_reqs()
+{
+	while (!blocked_reqs.empty()) {
+		if (!add_write(blocked_reqs.front()))
+			break;
+		blocked_reqs.pop_front();
+	}
+}
+
+void log_structured_io::issue_read_part(user_req *ureq, off_t off,
+		off_t phys_off, size_t size, off_t log_pg, int num_log_pages)
+{
+	const io_request &orig = ureq->req;
+	read_part *part = new read_part(ureq, log_pg, num_log_pages);
+	remote_io *io = log_pg >= 0 ? log_io.get() : file_io.get();
+	data_loc_t loc(log_pg >= 0 ? log_file_id : get_file_id(), phys_off);
+	io_request req(orig.get_buf() + (off - orig.get_offset()), loc, size,
+			READ, io, get_node_id());
+	req.set_user_data(part);
+	ureq->num_pending++;
+	num_sub_reqs++;
+	io->access(&req, 1);
+}
+
+/*
+ * We split a read into parts. The data of each part is stored contiguously
+ * in the file or in the log.
+ */
+void log_structured_io::read(const io_request &req)
+{
+	user_req *ureq = new user_req();
+	ureq->req = req;
+	ureq->num_pending = 1;
+	ureq->next_off = req.get_offset() + req.get_size();
+
+	off_t off = req.get_offset();
+	off_t end = req.get_offset() + req.get_size();
+	off_t part_off = off;
+	off_t part_phys = 0;
+	size_t part_size = 0;
+	off_t part_log_pg = -1;
+	int part_log_pages = 0;
+	while (off < end) {
+		off_t pg = off / PAGE_SIZE;
+		off_t next = std::min(end, (off_t) ((pg + 1) * PAGE_SIZE));
+		off_t log_pg = log.lookup(pg);
+		off_t phys = log_pg >= 0 ? log_pg * PAGE_SIZE + off % PAGE_SIZE : off;
+		if (part_size > 0 && (part_log_pg >= 0) == (log_pg >= 0)
+				&& part_phys + (off_t) part_size == phys) {
+			part_size += next - off;
+			if (log_pg >= 0)
+				part_log_pages++;
+		}
+		else {
+			if (part_size > 0)
+				issue_read_part(ureq, part_off, part_phys, part_size,
+						part_log_pg, part_log_pages);
+			part_off = off;
+			part_phys = phys;
+			part_size = next - off;
+			part_log_pg = log_pg;
+			part_log_pages = log_pg >= 0 ? 1 : 0;
+		}
+		off = next;
+	}
+	if (part_size > 0)
+		issue_read_part(ureq, part_off, part_phys, part_size, part_log_pg,
+				part_log_pages);
+	if (--ureq->num_pending == 0)
+		complete_user_req(ureq);
+}
+
+void log_structured_io::complete_user_req(user_req *ureq)
+{
+	num_completed_reqs++;
+	if (have_callback()) {
+		io_request *req = &ureq->req;
+		get_callback().invoke(&req, 1);
+	}
+	delete ureq;
+}
+
+void log_structured_io::complete_sub_req(const io_request &req)
+{
+	num_sub_reqs--;
+	sub_request *sub = (sub_request *) req.get_user_data();
+	sub->complete(*this);
+	delete sub;
+}
+
+void log_structured_io::access(io_request *requests, int num,
+		io_status *status)
+{
+	trace_access(requests, num);
+	for (int i = 0; i < num; i++) {
+		io_request &req = requests[i];
+		if (req.get_io() == NULL) {
+			req.set_io(this);
+			req.set_node_id(this->get_node_id());
+		}
+		if (req.get_req_type() != io_request::BASIC_REQ
+				|| req.get_num_bufs() != 1)
+			throw io_exception(
+					"log-structured I/O only supports requests with a single buffer");
+
+		num_issued_reqs++;
+		if (req.get_access_method() == READ) {
+			num_read_bytes += req.get_size();
+			read(req);
+			continue;
+		}
+
+		if (req.get_offset() % PAGE_SIZE > 0 || req.get_size() % PAGE_SIZE > 0)
+			throw io_exception((boost::format(
+							"The write to the log isn't aligned to pages. offset: %1%, size: %2%")
+						% req.get_offset() % req.get_size()).str());
+		num_write_bytes += req.get_size();
+		user_req *ureq = new user_req();
+		ureq->req = req;
+		ureq->num_pending = 1;
+		ureq->next_off = req.get_offset();
+		// The writes have to be added to the log in order.
+		if (!blocked_reqs.empty() || !add_write(ureq))
+			blocked_reqs.push_back(ureq);
+	}
+}
+
+void log_structured_io::start_clean(bool all)
+{
+	if (cleaning)
+		return;
+	int seg = log.start_clean(all);
+	if (seg < 0)
+		return;
+
+	clean_state *state = new clean_state(seg);
+	log.get_live_pages(seg, state->pages);
+	if (state->pages.empty()) {
+		log.end_clean(seg);
+		delete state;
+		return;
+	}
+	cleaning = state;
+	state->seg_buf = alloc_buf();
+	state->buf = alloc_buf();
+
+	// We read the live pages in the order of their locations in the log.
+	std::vector<off_t> log_pages(state->pages.size());
+	for (size_t i = 0; i < state->pages.size(); i++)
+		log_pages[i] = state->pages[i].second;
+	std::sort(log_pages.begin(), log_pages.end());
+	off_t seg_start = seg * log.get_seg_pages();
+	std::vector<io_request> reqs;
+	for (size_t i = 0; i < log_pages.size();) {
+		size_t j = i + 1;
+		while (j < log_pages.size() && log_pages[j] == log_pages[j - 1] + 1)
+			j++;
+		data_loc_t loc(log_file_id, log_pages[i] * PAGE_SIZE);
+		io_request req(state->seg_buf + (log_pages[i] - seg_start) * PAGE_SIZE,
+				loc, (j - i) * PAGE_SIZE, READ, log_io.get(), get_node_id());
+		req.set_user_data(new clean_part(state, 0, 0));
+		reqs.push_back(req);
+		i = j;
+	}
+	state->num_pending = reqs.size();
+	num_sub_reqs += reqs.size();
+	log_io->access(reqs.data(), reqs.size());
+}
+
+/*
+ * Write the live pages of the segment back to the file. The pages that
+ * are contiguous in the file are written together.
+ */
+void log_structured_io::clean_write_back(clean_state *state)
+{
+	state->writing = true;
+	off_t seg_start = state->seg * log.get_seg_pages();
+	for (size_t i = 0; i < state->pages.size(); i++)
+		memcpy(state->buf + i * PAGE_SIZE, state->seg_buf
+				+ (state->pages[i].second - seg_start) * PAGE_SIZE, PAGE_SIZE);
+
+	std::vector<io_request> reqs;
+	for (size_t i = 0; i < state->pages.size();) {
+		size_t j = i + 1;
+		while (j < state->pages.size()
+				&& state->pages[j].first == state->pages[j - 1].first + 1)
+			j++;
+		data_loc_t loc(get_file_id(), state->pages[i].first * PAGE_SIZE);
+		io_request req(state->buf + i * PAGE_SIZE, loc, (j - i) * PAGE_SIZE,
+				WRITE, file_io.get(), get_node_id());
+		req.set_user_data(new clean_part(state, i, j - i));
+		reqs.push_back(req);
+		i = j;
+	}
+	state->num_pending = reqs.size();
+	num_sub_reqs += reqs.size();
+	file_io->access(reqs.data(), reqs.size());
+}
+
+void log_structured_io::end_clean(clean_state *state)
+{
+	assert(state == cleaning);
+	log.end_clean(state->seg);
+	free_buf(state->seg_buf);
+	free_buf(state->buf);
+	delete state;
+	cleaning = NULL;
+}
+
+int log_structured_io::poll(bool write_partial)
+{
+	size_t prev_completed = num_completed_reqs;
+	// Some segments may have been freed.
+	process_blocked_reqs();
+	if (write_partial)
+		write_curr_seg();
+	file_io->flush_requests();
+	log_io->flush_requests();
+	file_io->process_all_completed_requests();
+	log_io->process_all_completed_requests();
+	return num_completed_reqs - prev_completed;
+}
+
+bool log_structured_io::wait_underlying() const
+{
+	return num_sub_reqs > 0;
+}
+
+void log_structured_io::flush_requests()
+{
+	process_blocked_reqs();
+	file_io->flush_requests();
+	log_io->flush_requests();
+}
+
+int log_structured_io::wait4complete(int num_to_complete)
+{
+	num_to_complete = min(num_to_complete, num_pending_ios());
+	int num_completed = poll(num_to_complete > 0);
+	while (num_completed < num_to_complete) {
+		if (wait_underlying()) {
+			if (!params.is_busy_wait())
+				get_thread()->wait();
+		}
+		// The blocked writes wait for other threads to free segments.
+		else
+			sched_yield();
+		num_completed += poll(true);
+	}
+	return num_completed;
+}
+
+void log_structured_io::cleanup()
+{
+	while (num_pending_ios() > 0 || wait_underlying()) {
+		if (poll(true) > 0)
+			continue;
+		if (wait_underlying()) {
+			if (!params.is_busy_wait())
+				get_thread()->wait();
+		}
+		else
+			sched_yield();
+	}
+}
+
+/*
+ * Wait for the segment cleaned by this I/O instance.
+ */
+void log_structured_io::wait_clean()
+{
+	while (cleaning) {
+		poll(false);
+		// The completed reads issue the writes to the file, which
+		// have to be sent before we wait.
+		flush_requests();
+		if (cleaning && !params.is_busy_wait())
+			get_thread()->wait();
+	}
+}
+
+void log_structured_io::clean()
+{
+	while (log.need_clean()) {
+		start_clean(false);
+		// There aren't sealed segments with live pages, or another
+		// I/O instance is writing back the log.
+		if (cleaning == NULL)
+			break;
+		wait_clean();
+	}
+}
+
+void log_structured_io::write_back_all()
+{
+	// All writes have to be committed before we write the log back.
+	cleanup();
+	while (true) {
+		start_clean(true);
+		if (cleaning == NULL) {
+			// Another I/O instance is still cleaning a segment.
+			if (log.is_cleaning()) {
+				sched_yield();
+				continue;
+			}
+			break;
+		}
+		wait_clean();
+	}
+}
+
+namespace
+{
+
+/*
+ * This waits for log-structured I/O instances. It can also wait for
+ * remote I/O instances, so we can access temporary files and other files
+ * in the same thread.
+ */
+class log_io_select: public io_select
+{
+	std::vector<std::shared_ptr<log_structured_io> > ios;
+	std::vector<remote_io::ptr> remote_ios;
+	std::set<io_interface *> io_set;
+
+	int poll(bool write_partial);
+public:
+	virtual bool add_io(io_interface::ptr io);
+	virtual int num_pending_ios() const;
+	virtual int wait4complete(int num_to_complete);
+};
+
+bool log_io_select::add_io(io_interface::ptr io)
+{
+	if (io_set.find(io.get()) != io_set.end())
+		return true;
+
+	std::shared_ptr<log_structured_io> lio
+		= std::dynamic_pointer_cast<log_structured_io>(io);
+	remote_io::ptr rio = std::dynamic_pointer_cast<remote_io>(io);
+	if (lio)
+		ios.push_back(lio);
+	else if (rio)
+		remote_ios.push_back(rio);
+	else
+		return false;
+	io_set.insert(io.get());
+	return true;
+}
+
+int log_io_select::num_pending_ios() const
+{
+	int num_pending = 0;
+	for (size_t i = 0; i < ios.size(); i++)
+		num_pending += ios[i]->num_pending_ios();
+	for (size_t i = 0; i < remote_ios.size(); i++)
+		num_pending += remote_ios[i]->num_pending_ios();
+	return num_pending;
+}
+
+int log_io_select::poll(bool write_partial)
+{
+	int num_complete = 0;
+	for (size_t i = 0; i < ios.size(); i++)
+		num_complete += ios[i]->poll(write_partial);
+	for (size_t i = 0; i < remote_ios.size(); i++) {
+		remote_ios[i]->flush_requests();
+		num_complete += remote_ios[i]->process_all_completed_requests();
+	}
+	return num_complete;
+}
+
+int log_io_select::wait4complete(int num_to_complete)
+{
+	thread *curr = thread::get_curr_thread();
+	num_to_complete = min(num_pending_ios(), num_to_complete);
+
+	int num_complete = poll(num_to_complete > 0);
+	while (num_complete < num_to_complete) {
+		bool wait = false;
+		for (size_t i = 0; i < ios.size(); i++)
+			wait = wait || ios[i]->wait_underlying();
+		for (size_t i = 0; i < remote_ios.size(); i++)
+			wait = wait || remote_ios[i]->num_pending_ios() > 0;
+		if (wait) {
+			if (!params.is_busy_wait())
+				curr->wait();
+		}
+		else
+			sched_yield();
+		num_complete += poll(true);
+	}
+	return num_complete;
+}
+
+}
+
+io_select::ptr log_structured_io::create_io_select() const
+{
+	return io_select::ptr(new log_io_select());
+}
+
+}
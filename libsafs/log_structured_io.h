@@ -0,0 +1,240 @@
+#ifndef __LOG_STRUCTURED_IO_H__
+#define __LOG_STRUCTURED_IO_H__
+
+/*
+ * Copyright 2014 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of SAFSlib.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+#include "io_interface.h"
+#include "thread.h"
+#include "write_log.h"
+
+namespace safs
+{
+
+class remote_io;
+
+/*
+ * This I/O instance buffers writes to a file in a write log.
+ * It accesses the file and the log with remote I/O.
+ *
+ * Each I/O instance copies the written pages to the segment it opens and
+ * writes a RAID block to the log once the block is filled, so the SSDs
+ * only see large sequential writes. A write request is completed when
+ * all of its pages are committed to the log. When a user waits for
+ * requests, we write the partially filled block to the log as well.
+ * A read request is split into the parts in the file and the parts
+ * in the log. When the log runs low on free segments, the writers wake up
+ * the cleaner thread instead of cleaning segments themselves.
+ *
+ * Write requests have to be aligned to pages.
+ */
+class log_structured_io: public io_interface
+{
+	class sub_request;
+	class read_part;
+	class log_write;
+	class clean_part;
+	class clean_state;
+	class sub_callback;
+
+	struct user_req {
+		io_request req;
+		// The number of sub requests that haven't been completed.
+		// It has one more reference while we are adding the request.
+		int num_pending;
+		// The offset of the data that hasn't been added to the log.
+		off_t next_off;
+	};
+
+	/*
+	 * The segment opened by the I/O instance.
+	 */
+	struct open_seg {
+		int seg;
+		char *buf;
+		size_t num_filled;
+		size_t num_written;
+		// The number of writes to the log in flight.
+		int num_writing;
+		// The page in the file for each page in the segment.
+		std::vector<off_t> pages;
+		// The sequence number of the write for each page in the segment.
+		std::vector<size_t> seqs;
+	};
+
+	write_log &log;
+	const size_t block_pages;
+	const int log_file_id;
+	std::shared_ptr<remote_io> file_io;
+	std::shared_ptr<remote_io> log_io;
+	callback::ptr cb;
+
+	open_seg *curr_seg;
+	std::vector<char *> free_bufs;
+	// The pages in the part of the current segment that hasn't been
+	// written to the log. We can overwrite these pages directly.
+	std::unordered_map<off_t, size_t> unwritten_pages;
+	// The user writes with data in the unwritten part of the segment.
+	std::vector<user_req *> unwritten_reqs;
+	// The user writes waiting for a free segment.
+	std::deque<user_req *> blocked_reqs;
+	clean_state *cleaning;
+	// The thread that cleans segments in the background.
+	thread *cleaner;
+
+	size_t num_issued_reqs;
+	size_t num_completed_reqs;
+	// The number of requests to the underlying I/O in flight.
+	size_t num_sub_reqs;
+
+	size_t num_write_bytes;
+	size_t num_log_writes;
+	size_t num_read_bytes;
+
+	char *alloc_buf();
+	void free_buf(char *buf);
+	bool open_new_seg();
+	void retire_seg(open_seg *seg);
+	void write_curr_seg();
+	bool add_write(user_req *req);
+	void process_blocked_reqs();
+	void read(const io_request &req);
+	void complete_user_req(user_req *req);
+	void issue_read_part(user_req *req, off_t off, off_t phys_off,
+			size_t size, off_t log_pg, int num_log_pages);
+
+	void start_clean(bool all);
+	void clean_write_back(clean_state *state);
+	void end_clean(clean_state *state);
+	void wait_clean();
+
+	void complete_sub_req(const io_request &req);
+public:
+	log_structured_io(write_log &log, int log_file_id,
+			std::shared_ptr<remote_io> file_io,
+			std::shared_ptr<remote_io> log_io);
+	~log_structured_io();
+
+	void set_cleaner(thread *cleaner) {
+		this->cleaner = cleaner;
+	}
+
+	/*
+	 * This cleans segments until the log has enough free segments.
+	 * It runs in the cleaner thread.
+	 */
+	void clean();
+	/*
+	 * This writes all pages in the log back to the file. No other threads
+	 * should access the file at the same time.
+	 */
+	void write_back_all();
+
+	/*
+	 * This issues buffered requests and processes completed requests.
+	 * If `write_partial' is true, we write the partially filled block
+	 * to the log, so the pending writes can complete.
+	 * It returns the number of completed user requests.
+	 */
+	int poll(bool write_partial);
+	/*
+	 * Test if this I/O instance waits for the underlying I/O.
+	 * If not, the pending writes wait for other threads to free segments.
+	 */
+	bool wait_underlying() const;
+
+	virtual int get_file_id() const;
+	virtual void cleanup();
+	virtual bool support_aio() {
+		return true;
+	}
+
+	virtual bool set_callback(callback::ptr cb) {
+		this->cb = cb;
+		return true;
+	}
+
+	virtual bool have_callback() const {
+		return cb != NULL;
+	}
+
+	virtual callback &get_callback() {
+		return *cb;
+	}
+
+	virtual void access(io_request *requests, int num,
+			io_status *status = NULL);
+	virtual void flush_requests();
+	virtual int wait4complete(int num);
+	virtual int num_pending_ios() const {
+		return num_issued_reqs - num_completed_reqs;
+	}
+	virtual std::shared_ptr<io_select> create_io_select() const;
+
+	size_t get_num_write_bytes() const {
+		return num_write_bytes;
+	}
+
+	size_t get_num_log_writes() const {
+		return num_log_writes;
+	}
+
+	size_t get_num_read_bytes() const {
+		return num_read_bytes;
+	}
+};
+
+/*
+ * This thread cleans the segments of a write log in the background, so
+ * the writers don't have to wait for the live pages to be written back
+ * to the file.
+ */
+class log_cleaner: public thread
+{
+	std::shared_ptr<log_structured_io> io;
+public:
+	log_cleaner(): thread("log_cleaner", -1) {
+	}
+
+	~log_cleaner() {
+		// The I/O instance is destroyed in the thread.
+		stop();
+		join();
+	}
+
+	void set_io(std::shared_ptr<log_structured_io> io) {
+		this->io = io;
+	}
+
+	virtual void run() {
+		io->clean();
+	}
+
+	virtual void cleanup() {
+		io = NULL;
+	}
+};
+
+}
+
+#endif
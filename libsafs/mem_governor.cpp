@@ -0,0 +1,243 @@
+/*
+ * Copyright 2014 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of SAFSlib.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <vector>
+
+#include <boost/format.hpp>
+
+#include "log.h"
+#include "mem_governor.h"
+#include "mem_tracker.h"
+
+namespace safs
+{
+
+mem_governor::mem_governor()
+{
+	budget = 0;
+	tot_granted = 0;
+	pthread_mutex_init(&lock, NULL);
+}
+
+mem_governor::~mem_governor()
+{
+	pthread_mutex_destroy(&lock);
+}
+
+mem_governor &mem_governor::get()
+{
+	static mem_governor governor;
+	return governor;
+}
+
+void mem_governor::set_budget(size_t budget)
+{
+	pthread_mutex_lock(&lock);
+	this->budget = budget;
+	regrow_locked();
+	pthread_mutex_unlock(&lock);
+}
+
+size_t mem_governor::get_budget() const
+{
+	pthread_mutex_lock(&lock);
+	size_t ret = budget;
+	pthread_mutex_unlock(&lock);
+	return ret;
+}
+
+size_t mem_governor::get_tot_granted() const
+{
+	pthread_mutex_lock(&lock);
+	size_t ret = tot_granted;
+	pthread_mutex_unlock(&lock);
+	return ret;
+}
+
+void mem_governor::register_consumer(mem_consumer *consumer,
+		const std::string &name, size_t init_size)
+{
+	consumer_info info;
+	info.name = name;
+	info.granted = init_size;
+	info.max_granted = init_size;
+	info.reclaimed = 0;
+	info.lost = 0;
+	pthread_mutex_lock(&lock);
+	bool ret = consumers.insert(std::pair<mem_consumer *, consumer_info>(
+				consumer, info)).second;
+	if (ret)
+		tot_granted += init_size;
+	bool over_budget = init_size > 0 && budget > 0 && tot_granted > budget;
+	pthread_mutex_unlock(&lock);
+	if (!ret)
+		BOOST_LOG_TRIVIAL(error) << boost::format(
+				"%1% has registered with the memory governor") % name;
+	else if (over_budget)
+		BOOST_LOG_TRIVIAL(warning) << boost::format(
+				"%1% takes %2% bytes and exceeds the memory budget")
+			% name % init_size;
+}
+
+void mem_governor::unregister_consumer(mem_consumer *consumer)
+{
+	pthread_mutex_lock(&lock);
+	auto it = consumers.find(consumer);
+	if (it != consumers.end()) {
+		tot_granted -= it->second.granted;
+		consumers.erase(it);
+		regrow_locked();
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+struct comp_granted
+{
+	bool operator()(const std::pair<size_t, mem_consumer *> &c1,
+			const std::pair<size_t, mem_consumer *> &c2) const {
+		return c1.first > c2.first;
+	}
+};
+
+size_t mem_governor::reclaim_locked(mem_consumer *requester, size_t size)
+{
+	std::vector<std::pair<size_t, mem_consumer *> > victims;
+	for (auto it = consumers.begin(); it != consumers.end(); it++)
+		if (it->first != requester && it->second.granted > 0)
+			victims.push_back(std::pair<size_t, mem_consumer *>(
+						it->second.granted, it->first));
+	std::sort(victims.begin(), victims.end(), comp_granted());
+
+	size_t tot_reclaimed = 0;
+	for (size_t i = 0; i < victims.size() && tot_reclaimed < size; i++) {
+		consumer_info &info = consumers[victims[i].second];
+		size_t ret = victims[i].second->reclaim(
+				std::min(size - tot_reclaimed, info.granted));
+		ret = std::min(ret, info.granted);
+		if (ret > 0) {
+			info.granted -= ret;
+			info.reclaimed += ret;
+			info.lost += ret;
+			tot_granted -= ret;
+			tot_reclaimed += ret;
+			BOOST_LOG_TRIVIAL(info) << boost::format(
+					"reclaim %1% bytes from %2%") % ret % info.name;
+		}
+	}
+	return tot_reclaimed;
+}
+
+void mem_governor::regrow_locked()
+{
+	for (auto it = consumers.begin(); it != consumers.end(); it++) {
+		consumer_info &info = it->second;
+		if (info.lost == 0)
+			continue;
+		size_t size = info.lost;
+		if (budget > 0) {
+			if (tot_granted >= budget)
+				break;
+			size = std::min(size, budget - tot_granted);
+		}
+		size_t ret = std::min(it->first->regrow(size), size);
+		if (ret > 0) {
+			info.lost -= ret;
+			info.granted += ret;
+			info.max_granted = std::max(info.max_granted, info.granted);
+			tot_granted += ret;
+			BOOST_LOG_TRIVIAL(info) << boost::format(
+					"give %1% bytes back to %2%") % ret % info.name;
+		}
+	}
+}
+
+bool mem_governor::acquire(mem_consumer *consumer, size_t size, bool force)
+{
+	pthread_mutex_lock(&lock);
+	auto it = consumers.find(consumer);
+	if (it == consumers.end()) {
+		pthread_mutex_unlock(&lock);
+		BOOST_LOG_TRIVIAL(error)
+			<< "acquire memory for an unregistered component";
+		return false;
+	}
+	if (budget > 0 && tot_granted + size > budget)
+		reclaim_locked(consumer, tot_granted + size - budget);
+	bool ret = budget == 0 || tot_granted + size <= budget;
+	consumer_info &info = it->second;
+	std::string name = info.name;
+	if (ret || force) {
+		info.granted += size;
+		info.max_granted = std::max(info.max_granted, info.granted);
+		tot_granted += size;
+	}
+	pthread_mutex_unlock(&lock);
+	if (!ret && force)
+		BOOST_LOG_TRIVIAL(warning) << boost::format(
+				"%1% takes %2% bytes and exceeds the memory budget")
+			% name % size;
+	return ret || force;
+}
+
+void mem_governor::release(mem_consumer *consumer, size_t size)
+{
+	pthread_mutex_lock(&lock);
+	auto it = consumers.find(consumer);
+	if (it != consumers.end()) {
+		size = std::min(size, it->second.granted);
+		it->second.granted -= size;
+		tot_granted -= size;
+		regrow_locked();
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+void mem_governor::print_usage() const
+{
+	pthread_mutex_lock(&lock);
+	BOOST_LOG_TRIVIAL(info) << boost::format(
+			"memory governor: budget: %1% bytes, granted: %2% bytes")
+		% budget % tot_granted;
+	for (auto it = consumers.begin(); it != consumers.end(); it++)
+		BOOST_LOG_TRIVIAL(info) << boost::format(
+				"\t%1%: granted %2% bytes (max %3%), used %4% bytes, reclaimed %5% bytes")
+			% it->second.name % it->second.granted % it->second.max_granted
+			% it->first->get_mem_usage() % it->second.reclaimed;
+	pthread_mutex_unlock(&lock);
+#ifdef ENABLE_MEM_TRACE
+	BOOST_LOG_TRIVIAL(info) << boost::format(
+			"\tallocated with new: %1% bytes (max %2%)")
+		% get_alloc_bytes() % get_max_alloc_bytes();
+#endif
+}
+
+mem_grant::mem_grant(const std::string &name, size_t size)
+{
+	this->size = size;
+	mem_governor::get().register_consumer(this, name);
+	mem_governor::get().acquire(this, size, true);
+}
+
+mem_grant::~mem_grant()
+{
+	mem_governor::get().unregister_consumer(this);
+}
+
+}
@@ -0,0 +1,161 @@
+#ifndef __MEM_GOVERNOR_H__
+#define __MEM_GOVERNOR_H__
+
+/*
+ * Copyright 2014 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of SAFSlib.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include <map>
+#include <string>
+
+namespace safs
+{
+
+/*
+ * A component that uses a large amount of memory, such as the page cache
+ * or the buffers of a sort. It gets a memory budget from the governor.
+ */
+class mem_consumer
+{
+public:
+	virtual ~mem_consumer() {
+	}
+
+	/*
+	 * The amount of memory actually used by the component in bytes.
+	 */
+	virtual size_t get_mem_usage() const = 0;
+
+	/*
+	 * The governor asks the component to give back `size' bytes.
+	 * It returns the number of bytes actually released.
+	 * It's invoked with the governor locked, so the component shouldn't
+	 * call the governor here.
+	 */
+	virtual size_t reclaim(size_t size) {
+		return 0;
+	}
+
+	/*
+	 * The governor gives back up to `size' bytes of the memory reclaimed
+	 * from the component when other components release memory.
+	 * It returns the number of bytes the component takes back.
+	 * It's also invoked with the governor locked.
+	 */
+	virtual size_t regrow(size_t size) {
+		return 0;
+	}
+};
+
+/*
+ * This manages a process-wide memory budget shared by the components that
+ * use a large amount of memory. A component registers with the governor
+ * and acquires memory before using it. If the budget isn't enough,
+ * the governor reclaims memory from the other components, starting from
+ * the one with the largest grant.
+ *
+ * A budget of 0 means that the memory isn't limited. The governor still
+ * tracks the memory used by each component.
+ */
+class mem_governor
+{
+	struct consumer_info
+	{
+		std::string name;
+		// The memory granted to the component.
+		size_t granted;
+		// The max memory granted to the component.
+		size_t max_granted;
+		// The memory reclaimed from the component.
+		size_t reclaimed;
+		// The reclaimed memory that hasn't been given back.
+		size_t lost;
+	};
+
+	size_t budget;
+	size_t tot_granted;
+	std::map<mem_consumer *, consumer_info> consumers;
+	mutable pthread_mutex_t lock;
+
+	mem_governor();
+
+	size_t reclaim_locked(mem_consumer *requester, size_t size);
+	void regrow_locked();
+public:
+	static mem_governor &get();
+
+	~mem_governor();
+
+	void set_budget(size_t budget);
+	size_t get_budget() const;
+	size_t get_tot_granted() const;
+
+	/*
+	 * A component registers with the memory that it has already used.
+	 */
+	void register_consumer(mem_consumer *consumer, const std::string &name,
+			size_t init_size = 0);
+	/*
+	 * The memory granted to the component is returned to the governor
+	 * and given back to the components that lost memory to reclaim.
+	 */
+	void unregister_consumer(mem_consumer *consumer);
+
+	/*
+	 * Acquire `size' bytes for the component. If the budget doesn't have
+	 * enough memory even after reclaiming memory from the other components,
+	 * it fails unless `force' is true. A forced grant may exceed the budget.
+	 */
+	bool acquire(mem_consumer *consumer, size_t size, bool force = false);
+	/*
+	 * Release `size' bytes granted to the component. The released memory
+	 * is given back to the components that lost memory to reclaim.
+	 */
+	void release(mem_consumer *consumer, size_t size);
+
+	/*
+	 * Print the memory granted to and used by each component.
+	 */
+	void print_usage() const;
+};
+
+/*
+ * This holds memory acquired from the governor for a temporary task,
+ * e.g., the buffers of a sort. The memory is released when the object
+ * is destroyed. The task needs the memory to run, so it may exceed
+ * the budget.
+ */
+class mem_grant: public mem_consumer
+{
+	size_t size;
+public:
+	mem_grant(const std::string &name, size_t size);
+	~mem_grant();
+
+	virtual size_t get_mem_usage() const {
+		return size;
+	}
+};
+
+}
+
+#endif
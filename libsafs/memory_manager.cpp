@@ -17,6 +17,10 @@
  * limitations under the License.
  */
 
+#include <sys/mman.h>
+
+#include <algorithm>
+
 #include "memory_manager.h"
 
 namespace safs
@@ -31,6 +35,7 @@ memory_manager::memory_manager(
 			INCREASE_SIZE <= max_size ? INCREASE_SIZE : max_size,
 			// We don't initialize pages but we pin pages.
 			max_size, node_id, false, true) {
+	pthread_spin_init(&released_lock, PTHREAD_PROCESS_PRIVATE);
 }
 
 /**
@@ -40,6 +45,15 @@ memory_manager::memory_manager(
  */
 bool memory_manager::get_free_pages(int npages,
 		char **pages, page_cache *request_cache) {
+	pthread_spin_lock(&released_lock);
+	if ((size_t) npages <= released_pages.size()) {
+		std::copy(released_pages.end() - npages, released_pages.end(), pages);
+		released_pages.resize(released_pages.size() - npages);
+		pthread_spin_unlock(&released_lock);
+		return true;
+	}
+	pthread_spin_unlock(&released_lock);
+
 	int ret = slab_allocator::alloc(pages, npages);
 	/* 
 	 * slab_allocator allocates either all required number of 
@@ -68,18 +82,39 @@ bool memory_manager::get_free_pages(int npages,
 		if (num_shrink < npages)
 			num_shrink = npages;
 		char *buf[num_shrink];
-		if (!cache->shrink(num_shrink, buf)) {
+		int num_shrunk = cache->shrink(num_shrink, buf);
+		if (num_shrunk == 0) {
 			return false;
 		}
-		slab_allocator::free(buf, num_shrink);
-		/* now it's guaranteed that we have enough free pages. */
+		slab_allocator::free(buf, num_shrunk);
+		/* The cache may not be able to give up enough pages. */
 		ret = slab_allocator::alloc(pages, npages);
 	}
-	return true;
+	return ret > 0;
 }
 
 void memory_manager::free_pages(int npages, char **pages) {
 	slab_allocator::free(pages, npages);
 }
 
+void memory_manager::release_pages(int npages, char **pages) {
+	// We can't put the pages back to the slab allocator, which writes
+	// its list links in free pages, so we keep them here.
+	std::vector<char *> sorted(pages, pages + npages);
+	std::sort(sorted.begin(), sorted.end());
+	// Return the contiguous pages to the OS together.
+	for (size_t i = 0; i < sorted.size();) {
+		size_t j = i + 1;
+		while (j < sorted.size() && sorted[j] == sorted[j - 1] + PAGE_SIZE)
+			j++;
+		size_t size = (j - i) * PAGE_SIZE;
+		munlock(sorted[i], size);
+		madvise(sorted[i], size, MADV_DONTNEED);
+		i = j;
+	}
+	pthread_spin_lock(&released_lock);
+	released_pages.insert(released_pages.end(), sorted.begin(), sorted.end());
+	pthread_spin_unlock(&released_lock);
+}
+
 }
@@ -35,10 +35,15 @@ namespace safs
 class memory_manager: public slab_allocator
 {
 	std::vector<page_cache *> caches;
+	// The pages whose physical memory has been returned to the OS.
+	// They are reused before we allocate pages from the slab allocator.
+	std::vector<char *> released_pages;
+	pthread_spinlock_t released_lock;
 
 	memory_manager(long max_size, int node_id);
 
 	~memory_manager() {
+		pthread_spin_destroy(&released_lock);
 		// TODO
 	}
 public:
@@ -61,6 +66,14 @@ public:
 
 	bool get_free_pages(int npages, char **pages, page_cache *cache);
 	void free_pages(int npages, char **pages);
+	/*
+	 * The pages are freed and their physical memory is returned to the OS.
+	 */
+	void release_pages(int npages, char **pages);
+
+	long get_num_released_pages() const {
+		return released_pages.size();
+	}
 
 	long average_cache_size() {
 		return get_max_size() / caches.size();
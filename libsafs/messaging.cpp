@@ -113,8 +113,8 @@ template class thread_safe_msg_sender<safs::io_reply>;
  * these are to force to instantiate the templates
  * for io_request and io_reply.
  */
-template class thread_safe_FIFO_queue<safs::message<safs::io_request> >;
-template class thread_safe_FIFO_queue<safs::message<safs::io_reply> >;
+template class mpsc_FIFO_queue<safs::message<safs::io_request> >;
+template class mpsc_FIFO_queue<safs::message<safs::io_reply> >;
 template class blocking_FIFO_queue<safs::message<safs::io_request> >;
 template class blocking_FIFO_queue<safs::message<safs::io_reply> >;
 template class safs::message<safs::io_request>;
@@ -338,14 +338,18 @@ public:
 	}
 };
 
+/*
+ * The message queue has multiple producers and a single consumer.
+ * Only the thread that owns the queue can fetch messages from it.
+ */
 template<class T>
-class msg_queue: public thread_safe_FIFO_queue<message<T> >
+class msg_queue: public mpsc_msg_queue<message<T> >
 {
 	// TODO I may need to make sure all messages are compatible with the flag.
 	bool accept_inline;
 public:
 	msg_queue(int node_id, const std::string _name, int init_size, int max_size,
-			bool accept_inline): thread_safe_FIFO_queue<message<T> >(_name,
+			bool accept_inline): mpsc_msg_queue<message<T> >(_name,
 				node_id, init_size, max_size) {
 		this->accept_inline = accept_inline;
 	}
@@ -363,26 +367,6 @@ public:
 	bool is_accept_inline() const {
 		return accept_inline;
 	}
-
-	/*
-	 * This method needs to be used with caution.
-	 * It may change the behavior of other threads if they also access
-	 * the queue, so it's better to use it when no other threads are
-	 * using it.
-	 * It is also a heavy operation.
-	 */
-	int get_num_objs() {
-		int num = thread_safe_FIFO_queue<message<T> >::get_num_entries();
-		stack_array<message<T> > msgs(num);
-		int ret = thread_safe_FIFO_queue<message<T> >::fetch(msgs.data(), num);
-		int num_objs = 0;
-		for (int i = 0; i < ret; i++) {
-			num_objs += msgs[i].get_num_objs();
-		}
-		BOOST_VERIFY(ret == thread_safe_FIFO_queue<message<T> >::add(
-					msgs.data(), ret));
-		return num_objs;
-	}
 };
 
 template<class T>
@@ -73,7 +73,14 @@ sys_parameters::sys_parameters()
 	busy_wait = false;
 	// The number of I/O threads will be determined based on the number of SSDs.
 	num_io_threads = 0;
-	bind_io_thread = false;
+	bind_io_thread = -1;
+	cache_admission = false;
+	direct_read_threshold = 0;
+	temp_write_log = false;
+	hybrid_poll = false;
+	max_poll_us = 50;
+	virt_ssd_model = "naive";
+	mem_budget = 0;
 }
 
 void sys_parameters::init(const std::map<std::string, std::string> &configs)
@@ -156,10 +163,8 @@ void sys_parameters::init(const std::map<std::string, std::string> &configs)
 	if (it != configs.end()) {
 		num_nodes = str2size(it->second);
 	}
-#ifdef USE_HWLOC
 	else
 		num_nodes = cpus.get_num_nodes();
-#endif
 	BOOST_LOG_TRIVIAL(info) << boost::format("SAFS runs on %1% NUMA nodes")
 		% num_nodes;
 
@@ -200,7 +205,52 @@ void sys_parameters::init(const std::map<std::string, std::string> &configs)
 
 	it = configs.find("bind_io_thread");
 	if (it != configs.end()) {
-		bind_io_thread = true;
+		bool bind;
+		if (str2bool(it->second, bind))
+			bind_io_thread = bind;
+		else
+			BOOST_LOG_TRIVIAL(error) << "bind_io_thread should be true/false/1/0, not "
+				<< it->second;
+	}
+
+	it = configs.find("cache_admission");
+	if (it != configs.end()) {
+		cache_admission = true;
+	}
+
+	it = configs.find("direct_read_threshold");
+	if (it != configs.end()) {
+		direct_read_threshold = str2size(it->second);
+	}
+
+	it = configs.find("temp_write_log");
+	if (it != configs.end()) {
+		temp_write_log = true;
+	}
+
+	it = configs.find("hybrid_poll");
+	if (it != configs.end()) {
+		hybrid_poll = true;
+	}
+
+	it = configs.find("max_poll_us");
+	if (it != configs.end()) {
+		max_poll_us = atoi(it->second.c_str());
+	}
+
+	it = configs.find("io_trace_file");
+	if (it != configs.end()) {
+		io_trace_file = it->second;
+	}
+
+	it = configs.find("virt_ssd_model");
+	if (it != configs.end()) {
+		virt_ssd_model = it->second;
+	}
+
+	it = configs.find("mem_budget");
+	if (it != configs.end()) {
+		mem_budget = str2size(it->second);
 	}
 }
 
@@ -228,6 +278,14 @@ void sys_parameters::print()
 	BOOST_LOG_TRIVIAL(info) << "\tbusy_wait: " << busy_wait;
 	BOOST_LOG_TRIVIAL(info) << "\tnum_io_threads: " << num_io_threads;
 	BOOST_LOG_TRIVIAL(info) << "\tbind_io_thread: " << bind_io_thread;
+	BOOST_LOG_TRIVIAL(info) << "\tcache_admission: " << cache_admission;
+	BOOST_LOG_TRIVIAL(info) << "\tdirect_read_threshold: " << direct_read_threshold;
+	BOOST_LOG_TRIVIAL(info) << "\ttemp_write_log: " << temp_write_log;
+	BOOST_LOG_TRIVIAL(info) << "\thybrid_poll: " << hybrid_poll;
+	BOOST_LOG_TRIVIAL(info) << "\tmax_poll_us: " << max_poll_us;
+	BOOST_LOG_TRIVIAL(info) << "\tio_trace_file: " << io_trace_file;
+	BOOST_LOG_TRIVIAL(info) << "\tvirt_ssd_model: " << virt_ssd_model;
+	BOOST_LOG_TRIVIAL(info) << "\tmem_budget: " << mem_budget;
 }
 
 void sys_parameters::print_help()
@@ -271,7 +329,23 @@ void sys_parameters::print_help()
 		<< std::endl;
 	std::cout << "\tnum_io_threads: the number of threads per NUMA node for I/O processing."
 		<< std::endl;
-	std::cout << "\tbind_io_thread: determine whether to bind an I/O thread to a CPU core and use the core exclusivly."
+	std::cout << "\tbind_io_thread: determine whether to bind an I/O thread to a CPU core and use the core exclusivly. It accepts true/false/1/0. By default, it's decided by the number of CPU cores in the NUMA nodes with SSDs."
+		<< std::endl;
+	std::cout << "\tcache_admission: only let a missed page evict a page in the page cache if it's accessed more frequently."
+		<< std::endl;
+	std::cout << "\tdirect_read_threshold: x(k, K, m, M, g, G). A read to the page cache of at least this size reads uncached pages to the user buffer directly."
+		<< std::endl;
+	std::cout << "\ttemp_write_log: buffer writes to temporary files in a write log, so small random writes become large sequential writes."
+		<< std::endl;
+	std::cout << "\thybrid_poll: I/O threads and remote I/O poll for I/O completion for a while before they block."
+		<< std::endl;
+	std::cout << "\tmax_poll_us: the maximal time in microseconds to poll for I/O completion in the hybrid mode."
+		<< std::endl;
+	std::cout << "\tio_trace_file: record the accesses to I/O instances in a binary trace file."
+		<< std::endl;
+	std::cout << "\tvirt_ssd_model: the performance model of virtual AIO: naive (random delay) or linear (deterministic delay)."
+		<< std::endl;
+	std::cout << "\tmem_budget: x(k, K, m, M, g, G). the memory shared by the page cache and large buffers such as sort buffers. The page cache shrinks when other components need memory."
 		<< std::endl;
 }
 
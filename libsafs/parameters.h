@@ -58,8 +58,29 @@ class sys_parameters
 	// The number of I/O threads per NUMA node.
 	int num_io_threads;
 	// Bind a I/O thread to a specific CPU core and ensure no other threads
-	// to use this core.
-	bool bind_io_thread;
+	// to use this core. -1 means SAFS decides it based on the CPU topology.
+	int bind_io_thread;
+	// Use a frequency sketch to decide whether a missed page can evict
+	// another page in the page cache.
+	bool cache_admission;
+	// A read request to the page cache at least as large as this threshold
+	// reads the pages that aren't cached to the user buffer directly.
+	// 0 disables it.
+	long direct_read_threshold;
+	// Temporary files buffer writes in a write log.
+	bool temp_write_log;
+	// Threads poll for I/O completions for a while before they block.
+	// How long they poll depends on the intervals between completions.
+	bool hybrid_poll;
+	// The maximal time (in microseconds) a thread polls before it blocks.
+	int max_poll_us;
+	// Record the accesses to the I/O instances in the trace file.
+	std::string io_trace_file;
+	// The performance model of the virtual SSDs: naive or linear.
+	std::string virt_ssd_model;
+	// The memory shared by the page cache and other large buffers.
+	// 0 means that the memory isn't limited.
+	long mem_budget;
 public:
 	sys_parameters();
 
@@ -151,7 +172,43 @@ public:
 	}
 
 	bool is_bind_io_thread() const {
-		return bind_io_thread;
+		return bind_io_thread > 0;
+	}
+
+	bool is_auto_bind_io_thread() const {
+		return bind_io_thread < 0;
+	}
+
+	bool is_cache_admission() const {
+		return cache_admission;
+	}
+
+	long get_direct_read_threshold() const {
+		return direct_read_threshold;
+	}
+
+	bool is_temp_write_log() const {
+		return temp_write_log;
+	}
+
+	bool is_hybrid_poll() const {
+		return hybrid_poll;
+	}
+
+	int get_max_poll_us() const {
+		return max_poll_us;
+	}
+
+	const std::string &get_io_trace_file() const {
+		return io_trace_file;
+	}
+
+	const std::string &get_virt_ssd_model() const {
+		return virt_ssd_model;
+	}
+
+	long get_mem_budget() const {
+		return mem_budget;
 	}
 };
 
@@ -169,6 +226,12 @@ extern sys_parameters params;
  * It's in the number of I/O messages.
  */
 const int IO_QUEUE_SIZE = 10;
+/**
+ * The min size of the lock-free ring in a message queue.
+ * It's in the number of messages. Messages overflow to a locked queue
+ * only when the ring is full.
+ */
+const int MSG_RING_SIZE = 256;
 const int MAX_FETCH_REQS = 3;
 const int AIO_COMPLETE_BUF_SIZE = 8;
 
@@ -195,6 +258,11 @@ const int NUM_EMBEDDED_IOVECS = 1;
 
 const int CELL_SIZE = 16;
 const int CELL_MIN_NUM_PAGES = 8;
+/**
+ * The min number of pages left in a cell of the SA-cache when memory is
+ * reclaimed from the cache.
+ */
+const int CELL_RECLAIM_MIN_NUM_PAGES = 4;
 
 const int MAX_NUM_DIRTY_CELLS_IN_QUEUE = 1000;
 const int DIRTY_PAGES_THRESHOLD = 1;
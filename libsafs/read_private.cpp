@@ -49,6 +49,7 @@ buffered_io::buffered_io(const logical_file_partition &partition_, thread *t,
 
 io_status buffered_io::access(char *buf, off_t offset, ssize_t size, int access_method) {
 	ASSERT_EQ(get_thread(), thread::get_curr_thread());
+	trace_access(offset, size, access_method);
 	int fd;
 	if (fds.size() == 1)
 		fd = fds[0];
@@ -24,6 +24,7 @@
 #include "slab_allocator.h"
 #include "disk_read_thread.h"
 #include "file_mapper.h"
+#include "timer.h"
 
 namespace safs
 {
@@ -97,6 +98,10 @@ remote_io::remote_io(const std::vector<disk_io_thread::ptr> &remotes,
 	}
 	cb = NULL;
 	this->block_mapper = mapper;
+	// Busy waiting always polls, so we don't need the hybrid mode.
+	if (params.is_hybrid_poll() && !params.is_busy_wait())
+		poller = std::unique_ptr<hybrid_poller>(
+				new hybrid_poller(params.get_max_poll_us()));
 }
 
 remote_io::~remote_io()
@@ -162,6 +167,7 @@ void remote_io::access(io_request *requests, int num,
 		io_status *status)
 {
 	ASSERT_EQ(get_thread(), thread::get_curr_thread());
+	trace_access(requests, num);
 	num_issued_reqs.inc(num);
 
 	bool syncd = false;
@@ -400,6 +406,36 @@ int remote_io::get_file_id() const
 	return block_mapper->get_file_id();
 }
 
+/*
+ * We poll for completed requests until there are at most `max_pending'
+ * pending requests. If it doesn't happen within the poll time, we block
+ * until I/O threads wake us up.
+ */
+void remote_io::hybrid_wait(int max_pending)
+{
+	int64_t poll_time = poller->get_poll_time();
+	if (poll_time > 0) {
+		int num_completed = 0;
+		int64_t start = get_curr_time_us();
+		int64_t curr;
+		do {
+			num_completed += process_all_completed_requests();
+			curr = get_curr_time_us();
+		} while (num_pending_ios() > max_pending && curr - start < poll_time);
+		poller->record_completions(num_completed, curr);
+		if (num_pending_ios() <= max_pending) {
+			poller->poll_hit(curr - start);
+			return;
+		}
+		poller->poll_miss(curr - start);
+	}
+
+	poller->wakeup();
+	get_thread()->wait();
+	poller->record_completions(process_all_completed_requests(),
+			get_curr_time_us());
+}
+
 /**
  * We wait for at least the specified number of requests to complete.
  */
@@ -411,7 +447,9 @@ int remote_io::wait4complete(int num_to_complete)
 
 	process_all_completed_requests();
 	while (pending - num_pending_ios() < num_to_complete) {
-		if (!params.is_busy_wait())
+		if (poller)
+			hybrid_wait(pending - num_to_complete);
+		else if (!params.is_busy_wait())
 			get_thread()->wait();
 		process_all_completed_requests();
 	}
@@ -436,7 +474,25 @@ class remote_io_select: public io_select
 	// an IO interface is destroyed.
 	std::vector<remote_io::ptr> ios;
 	std::set<remote_io::ptr> io_set;
+	// It's only used in the hybrid polling mode.
+	std::unique_ptr<hybrid_poller> poller;
+
+	int process_all_completed_requests() {
+		int num_complete = 0;
+		for (size_t i = 0; i < ios.size(); i++) {
+			ios[i]->flush_requests();
+			num_complete += ios[i]->process_all_completed_requests();
+		}
+		return num_complete;
+	}
+	int hybrid_wait(int num_to_complete);
 public:
+	remote_io_select() {
+		if (params.is_hybrid_poll() && !params.is_busy_wait())
+			poller = std::unique_ptr<hybrid_poller>(
+					new hybrid_poller(params.get_max_poll_us()));
+	}
+
 	virtual bool add_io(io_interface::ptr io);
 	virtual int num_pending_ios() const;
 	virtual int wait4complete(int num_to_complete);
@@ -480,16 +536,47 @@ int remote_io_select::wait4complete(int num_to_complete)
 	// If we need to process more I/O requests, we need to wait until
 	// I/O threads wake us up.
 	while (num_complete < num_to_complete) {
+		if (poller) {
+			num_complete += hybrid_wait(num_to_complete - num_complete);
+			continue;
+		}
 		if (!params.is_busy_wait())
 			curr->wait();
-		for (size_t i = 0; i < ios.size(); i++) {
-			ios[i]->flush_requests();
-			num_complete += ios[i]->process_all_completed_requests();
-		}
+		num_complete += process_all_completed_requests();
 	}
 	return num_complete;
 }
 
+/*
+ * This is the same as remote_io::hybrid_wait, but we poll all I/O instances.
+ * It returns the number of completed requests.
+ */
+int remote_io_select::hybrid_wait(int num_to_complete)
+{
+	int num_complete = 0;
+	int64_t poll_time = poller->get_poll_time();
+	if (poll_time > 0) {
+		int64_t start = get_curr_time_us();
+		int64_t curr;
+		do {
+			num_complete += process_all_completed_requests();
+			curr = get_curr_time_us();
+		} while (num_complete < num_to_complete && curr - start < poll_time);
+		poller->record_completions(num_complete, curr);
+		if (num_complete >= num_to_complete) {
+			poller->poll_hit(curr - start);
+			return num_complete;
+		}
+		poller->poll_miss(curr - start);
+	}
+
+	poller->wakeup();
+	thread::get_curr_thread()->wait();
+	int num = process_all_completed_requests();
+	poller->record_completions(num, get_curr_time_us());
+	return num_complete + num;
+}
+
 io_select::ptr remote_io::create_io_select() const
 {
 	return io_select::ptr(new remote_io_select());
@@ -23,6 +23,7 @@
 #include "slab_allocator.h"
 #include "io_interface.h"
 #include "container.h"
+#include "hybrid_poller.h"
 
 namespace safs
 {
@@ -49,11 +50,15 @@ class remote_io: public io_interface
 	std::vector<std::shared_ptr<disk_io_thread> > io_threads;
 	callback::ptr cb;
 	file_mapper *block_mapper;
-	thread_safe_FIFO_queue<io_request> complete_queue;
+	mpsc_FIFO_queue<io_request> complete_queue;
 	slab_allocator &msg_allocator;
 
 	atomic_integer num_completed_reqs;
 	atomic_integer num_issued_reqs;
+	// It's only used in the hybrid polling mode.
+	std::unique_ptr<hybrid_poller> poller;
+
+	void hybrid_wait(int max_pending);
 public:
 	typedef std::shared_ptr<remote_io> ptr;
 
@@ -108,6 +113,13 @@ public:
 		return num_issued_reqs.get();
 	}
 
+	/*
+	 * It returns NULL if we don't use the hybrid polling mode.
+	 */
+	const hybrid_poller *get_poller() const {
+		return poller.get();
+	}
+
 	virtual io_select::ptr create_io_select() const;
 };
 
@@ -18,25 +18,98 @@
  */
 
 #include <numa.h>
+#include <sched.h>
 #include <sys/mman.h>
 
+#include <atomic>
+
+#include <boost/format.hpp>
+
+#include "log.h"
 #include "slab_allocator.h"
 
 static atomic_number<size_t> tot_slab_size;
 
+// The memory that has been allocated by slab allocators on each NUMA node.
+static const int MAX_SLAB_NODES = 64;
+static atomic_number<size_t> node_slab_sizes[MAX_SLAB_NODES];
+
+static inline void inc_stat(std::atomic<size_t> &counter)
+{
+	// A counter is only updated by its owner thread, so we don't need
+	// an atomic read-modify-write operation.
+	counter.store(counter.load(std::memory_order_relaxed) + 1,
+			std::memory_order_relaxed);
+}
+
+/*
+ * The per-thread cache of an allocator. It follows the magazine layer of
+ * the Solaris slab allocator: a thread serves allocations and frees from
+ * two magazines and only accesses the shared list when both magazines
+ * are empty (for allocation) or full (for free), so a thread moves
+ * a magazine of objects each time it takes the lock.
+ *
+ * If the allocator tracks the owner of objects, an object freed by
+ * a thread other than the one that allocated it is returned to
+ * the owner thread through a lock-free list. This happens a lot in SAFS,
+ * e.g., the I/O requests issued by application threads are freed
+ * by I/O threads when they complete.
+ */
+struct slab_allocator::thread_cache
+{
+	// The objects freed by other threads. Many threads push objects
+	// to the list with CAS and the owner thread takes the whole list with
+	// an exchange, so there isn't ABA problem.
+	std::atomic<linked_obj *> remote_frees;
+	char pad[RING_PAD_SIZE];
+
+	magazine loaded;
+	magazine prev;
+
+	// The statistics of the thread.
+	std::atomic<size_t> num_allocs;
+	// The number of allocations served without accessing the shared list.
+	std::atomic<size_t> num_hits;
+	std::atomic<size_t> num_frees;
+	// The number of objects this thread returns to other threads.
+	std::atomic<size_t> num_remote_frees;
+
+	thread_cache(int mag_size): loaded(mag_size), prev(mag_size) {
+		remote_frees = NULL;
+		num_allocs = 0;
+		num_hits = 0;
+		num_frees = 0;
+		num_remote_frees = 0;
+	}
+
+	void push_remote(linked_obj *obj) {
+		linked_obj *head = remote_frees.load(std::memory_order_relaxed);
+		do {
+			obj->set_next(head);
+		} while (!remote_frees.compare_exchange_weak(head, obj,
+					std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	linked_obj *take_remote() {
+		if (remote_frees.load(std::memory_order_relaxed) == NULL)
+			return NULL;
+		return remote_frees.exchange(NULL, std::memory_order_acquire);
+	}
+};
+
 static const int PAGE_SIZE = 4096;
 
 slab_allocator::slab_allocator(const std::string &name, int _obj_size,
 		long _increase_size, long _max_size, int _node_id,
 		// We allow pages to be pinned when allocated.
-		bool init, bool pinned, int _local_buf_size, bool _thread_safe): obj_size(
+		bool init, bool pinned, int _local_buf_size, bool _thread_safe,
+		bool _track_owner): obj_size(
 			_obj_size), increase_size(ROUNDUP(_increase_size, PAGE_SIZE)),
 		max_size(_max_size), node_id(_node_id),
 		// If we don't want it to be thread safe, there is no reason to keep
 		// a local buffer.
 		local_buf_size(_thread_safe ? _local_buf_size : 0),
-		thread_safe(_thread_safe), per_thread_queues("per-thread-queue-queue",
-				_node_id, 1000)
+		thread_safe(_thread_safe), track_owner(_thread_safe && _track_owner)
 #ifdef MEMCHECK
 		   , allocator(obj_size)
 #endif
@@ -53,20 +126,82 @@ slab_allocator::slab_allocator(const std::string &name, int _obj_size,
 	}
 }
 
+slab_allocator::thread_cache *slab_allocator::create_local_buf()
+{
+	// Each thread caches at most `local_buf_size' objects.
+	thread_cache *cache = new thread_cache(max(local_buf_size / 2, 1));
+	pthread_spin_lock(&lock);
+	thread_caches.push_back(cache);
+	pthread_spin_unlock(&lock);
+	pthread_setspecific(local_buf_key, cache);
+	return cache;
+}
+
+/*
+ * Return a linked list of objects to the shared list.
+ */
+void slab_allocator::free_list(linked_obj *objs)
+{
+	linked_obj_list tmp_list;
+	while (objs != NULL) {
+		linked_obj *next = objs->get_next();
+		*objs = linked_obj();
+		tmp_list.add(objs);
+		objs = next;
+	}
+	if (thread_safe)
+		pthread_spin_lock(&lock);
+	list.add_list(&tmp_list);
+	if (thread_safe)
+		pthread_spin_unlock(&lock);
+}
+
+/*
+ * Move the objects freed to all threads back to the shared list.
+ * It's called when the allocator reaches its max size, so the objects
+ * returned to idle threads can still be used. The caller holds the lock.
+ */
+size_t slab_allocator::reclaim_remote_frees()
+{
+	size_t num = 0;
+	for (size_t i = 0; i < thread_caches.size(); i++) {
+		linked_obj *objs = thread_caches[i]->take_remote();
+		while (objs != NULL) {
+			linked_obj *next = objs->get_next();
+			*objs = linked_obj();
+			list.add(objs);
+			objs = next;
+			num++;
+		}
+	}
+	return num;
+}
+
 void slab_allocator::free(char *obj)
 {
 	if (local_buf_size == 0) {
 		slab_allocator::free(&obj, 1);
+		return;
 	}
-	else {
-		fifo_queue<char *> *local_buf_refs = get_local_buf();
-		if (local_buf_refs->is_full()) {
-			char *objs[local_buf_size];
-			int num = local_buf_refs->fetch(objs, local_buf_size);
-			slab_allocator::free(objs, num);
+
+	thread_cache *cache = get_local_buf();
+	if (track_owner) {
+		thread_cache *owner = (thread_cache *) ((linked_obj *) obj)->get_owner();
+		if (owner && owner != cache) {
+			owner->push_remote((linked_obj *) obj);
+			inc_stat(cache->num_remote_frees);
+			return;
+		}
+	}
+	inc_stat(cache->num_frees);
+	if (cache->loaded.is_full()) {
+		if (cache->prev.is_full()) {
+			slab_allocator::free(cache->prev.get_objs(), cache->prev.get_num());
+			cache->prev.set_num(0);
 		}
-		local_buf_refs->push_back(obj);
+		cache->loaded.swap(cache->prev);
 	}
+	cache->loaded.push(obj);
 }
 
 char *slab_allocator::alloc()
@@ -79,17 +214,39 @@ char *slab_allocator::alloc()
 		else
 			return obj;
 	}
+
+	thread_cache *cache = get_local_buf();
+	inc_stat(cache->num_allocs);
+	if (cache->loaded.is_empty() && !cache->prev.is_empty())
+		cache->loaded.swap(cache->prev);
+	if (!cache->loaded.is_empty())
+		inc_stat(cache->num_hits);
 	else {
-		fifo_queue<char *> *local_buf_refs = get_local_buf();
-		if (local_buf_refs->is_empty()) {
-			char *objs[local_buf_size];
-			int num = alloc(objs, local_buf_size);
-			if (num == 0)
-				return NULL;
-			BOOST_VERIFY(local_buf_refs->add(objs, num) == num);
+		// The objects freed by other threads were allocated by this thread,
+		// so they are on the right NUMA node and are likely still in
+		// the CPU cache.
+		linked_obj *objs = cache->take_remote();
+		if (objs)
+			inc_stat(cache->num_hits);
+		while (objs != NULL && !cache->loaded.is_full()) {
+			linked_obj *next = objs->get_next();
+			cache->loaded.push((char *) objs);
+			objs = next;
 		}
-		return local_buf_refs->pop_front();
+		if (objs)
+			free_list(objs);
+	}
+	if (cache->loaded.is_empty()) {
+		int num = alloc(cache->loaded.get_objs(),
+				cache->loaded.get_capacity());
+		if (num == 0)
+			return NULL;
+		cache->loaded.set_num(num);
 	}
+	char *obj = cache->loaded.pop();
+	if (track_owner)
+		((linked_obj *) obj)->set_owner(cache);
+	return obj;
 }
 
 int slab_allocator::alloc(char **objs, int nobjs) {
@@ -111,7 +268,11 @@ int slab_allocator::alloc(char **objs, int nobjs) {
 			pthread_spin_unlock(&lock);
 		while (o != NULL) {
 			objs[num++] = (char *) o;
-			o = o->get_next();
+			linked_obj *next = o->get_next();
+			// The object isn't allocated from a thread cache.
+			if (track_owner)
+				o->set_owner(NULL);
+			o = next;
 		}
 		if (num == nobjs)
 			break;
@@ -128,11 +289,16 @@ int slab_allocator::alloc(char **objs, int nobjs) {
 			if (thread_safe)
 				pthread_spin_unlock(&lock);
 			char *objs;
-			if (node_id == -1)
+			int alloc_node = node_id;
+			if (node_id == -1) {
 				objs = (char *) numa_alloc_local(increase_size);
+				alloc_node = numa_node_of_cpu(sched_getcpu());
+			}
 			else
 				objs = (char *) numa_alloc_onnode(increase_size, node_id);
 			assert(objs);
+			if (alloc_node >= 0 && alloc_node < MAX_SLAB_NODES)
+				node_slab_sizes[alloc_node].inc(increase_size);
 #ifdef USE_IOAT
 			if (pinned) {
 				int ret = mlock(objs, increase_size);
@@ -159,8 +325,11 @@ int slab_allocator::alloc(char **objs, int nobjs) {
 				pthread_spin_unlock(&lock);
 		}
 		else {
+			size_t num_reclaimed = reclaim_remote_frees();
 			if (thread_safe)
 				pthread_spin_unlock(&lock);
+			if (num_reclaimed > 0)
+				continue;
 			// If we can't allocate all objects, then free all objects that
 			// have been allocated, and return 0.
 			free(objs, num);
@@ -194,13 +363,9 @@ slab_allocator::~slab_allocator()
 	}
 	pthread_spin_destroy(&lock);
 
-	// Destroy all the per-thread queues.
-	fifo_queue<char *> *queues[128];
-	while (!per_thread_queues.is_empty()) {
-		int ret = per_thread_queues.fetch(queues, 128);
-		for (int i = 0; i < ret; i++)
-			fifo_queue<char *>::destroy(queues[i]);
-	}
+	// Destroy all the per-thread caches.
+	for (size_t i = 0; i < thread_caches.size(); i++)
+		delete thread_caches[i];
 }
 
 void slab_allocator::free(char **objs, int nobjs) {
@@ -222,4 +387,39 @@ void slab_allocator::free(char **objs, int nobjs) {
 #endif
 }
 
+void slab_allocator::print_stat() const
+{
+	size_t num_allocs = 0;
+	size_t num_hits = 0;
+	size_t num_frees = 0;
+	size_t num_remote_frees = 0;
+	pthread_spin_lock(&lock);
+	for (size_t i = 0; i < thread_caches.size(); i++) {
+		num_allocs += thread_caches[i]->num_allocs.load();
+		num_hits += thread_caches[i]->num_hits.load();
+		num_frees += thread_caches[i]->num_frees.load();
+		num_remote_frees += thread_caches[i]->num_remote_frees.load();
+	}
+	size_t num_threads = thread_caches.size();
+	pthread_spin_unlock(&lock);
+
+	BOOST_LOG_TRIVIAL(info) << boost::format(
+			"%1% on node %2% uses %3% bytes, %4% threads")
+		% name % node_id % get_curr_size() % num_threads;
+	if (num_allocs > 0)
+		BOOST_LOG_TRIVIAL(info) << boost::format(
+				"%1%: %2% allocs, hit ratio: %3%, %4% local frees, %5% remote frees")
+			% name % num_allocs % ((double) num_hits / num_allocs) % num_frees
+			% num_remote_frees;
+}
+
+void slab_allocator::print_node_stat()
+{
+	int num_nodes = min(numa_num_configured_nodes(), MAX_SLAB_NODES);
+	for (int i = 0; i < num_nodes; i++)
+		BOOST_LOG_TRIVIAL(info) << boost::format(
+				"slab allocators have allocated %1% bytes on node %2%")
+			% node_slab_sizes[i].get() % i;
+}
+
 atomic_integer slab_allocator::alloc_counter;
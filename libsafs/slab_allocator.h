@@ -53,6 +53,19 @@ public:
 		void set_next(linked_obj *obj) {
 			next = obj;
 		}
+
+		/*
+		 * The header isn't used to link objects when an object is
+		 * allocated, so the allocator can keep the per-thread cache that
+		 * the object is allocated from in it.
+		 */
+		void set_owner(void *owner) {
+			next = (linked_obj *) owner;
+		}
+
+		void *get_owner() const {
+			return next;
+		}
 	};
 
 	class linked_obj_list {
@@ -126,6 +139,69 @@ public:
 	};
 
 private:
+	/*
+	 * A magazine is a small array of objects owned by a thread.
+	 */
+	class magazine
+	{
+		char **objs;
+		int num;
+		int capacity;
+	public:
+		magazine(int capacity) {
+			this->objs = new char *[capacity];
+			this->num = 0;
+			this->capacity = capacity;
+		}
+
+		~magazine() {
+			delete [] objs;
+		}
+
+		bool is_empty() const {
+			return num == 0;
+		}
+
+		bool is_full() const {
+			return num == capacity;
+		}
+
+		int get_num() const {
+			return num;
+		}
+
+		int get_capacity() const {
+			return capacity;
+		}
+
+		char **get_objs() {
+			return objs;
+		}
+
+		void set_num(int num) {
+			assert(num <= capacity);
+			this->num = num;
+		}
+
+		void push(char *obj) {
+			assert(num < capacity);
+			objs[num++] = obj;
+		}
+
+		char *pop() {
+			assert(num > 0);
+			return objs[--num];
+		}
+
+		void swap(magazine &mag) {
+			std::swap(objs, mag.objs);
+			std::swap(num, mag.num);
+			std::swap(capacity, mag.capacity);
+		}
+	};
+
+	struct thread_cache;
+
 	const int obj_size;
 	// the size to increase each time there aren't enough objects
 	const long increase_size;
@@ -134,6 +210,10 @@ private:
 	const int node_id;
 	const int local_buf_size;
 	const bool thread_safe;
+	// Whether the header of an allocated object records the thread cache
+	// that the object is allocated from. Only the allocators that leave
+	// the header unused in allocated objects can do so.
+	const bool track_owner;
 
 	linked_obj_list list;
 	// the current size of memory used by the allocator.
@@ -143,26 +223,28 @@ private:
 
 	std::vector<char *> alloc_bufs;
 
-	pthread_spinlock_t lock;
+	mutable pthread_spinlock_t lock;
 	// The buffers pre-allocated to serve allocation requests
 	// from the local threads.
 	pthread_key_t local_buf_key;
 
-	thread_safe_FIFO_queue<fifo_queue<char *> *> per_thread_queues;
+	// All per-thread caches. It's protected by the lock.
+	std::vector<thread_cache *> thread_caches;
 
 	std::string name;
 	static atomic_integer alloc_counter;
 
-	fifo_queue<char *> *get_local_buf() {
-		fifo_queue<char *> *local_buf_refs
-			= (fifo_queue<char *> *) pthread_getspecific(local_buf_key);
-		if (local_buf_refs == NULL) {
-			local_buf_refs = fifo_queue<char *>::create(node_id, local_buf_size);
-			per_thread_queues.add(&local_buf_refs, 1);
-			pthread_setspecific(local_buf_key, local_buf_refs);
-		}
-		return local_buf_refs;
+	thread_cache *get_local_buf() {
+		thread_cache *cache = (thread_cache *) pthread_getspecific(
+				local_buf_key);
+		if (cache == NULL)
+			cache = create_local_buf();
+		return cache;
 	}
+
+	thread_cache *create_local_buf();
+	void free_list(linked_obj *objs);
+	size_t reclaim_remote_frees();
 #ifdef MEMCHECK
 	aligned_allocator allocator;
 #endif
@@ -170,7 +252,8 @@ public:
 	slab_allocator(const std::string &name, int _obj_size, long _increase_size,
 			// We allow pages to be pinned when allocated.
 			long _max_size, int _node_id, bool init = false, bool pinned = false,
-			int _local_buf_size = SLAB_LOCAL_BUF_SIZE, bool thread_safe = true);
+			int _local_buf_size = SLAB_LOCAL_BUF_SIZE, bool thread_safe = true,
+			bool track_owner = false);
 
 	virtual ~slab_allocator();
 
@@ -207,6 +290,13 @@ public:
 	const std::string &get_name() const {
 		return name;
 	}
+
+	void print_stat() const;
+
+	/*
+	 * Print the memory allocated by all slab allocators on each NUMA node.
+	 */
+	static void print_node_stat();
 };
 
 template<class T>
@@ -259,7 +349,7 @@ public:
 				// won't be modified.
 				): slab_allocator(name, sizeof(T) + sizeof(slab_allocator::linked_obj),
 				increase_size, max_size, node_id, true, false, SLAB_LOCAL_BUF_SIZE,
-				thread_safe) {
+				thread_safe, true) {
 		assert(increase_size <= max_size);
 		this->initiator = std::move(initiator);
 		this->destructor = std::move(destructor);
@@ -269,7 +359,7 @@ public:
 		char *addrs[num];
 		int ret = slab_allocator::alloc(addrs, num);
 		for (int i = 0; i < ret; i++) {
-			objs[i] = (T *) (addrs + sizeof(slab_allocator::linked_obj));
+			objs[i] = (T *) (addrs[i] + sizeof(slab_allocator::linked_obj));
 			initiator->init(objs[i]);
 		}
 		return ret;
@@ -38,6 +38,7 @@ enum {
 	RAND_SEQ_OFFSET,
 	RAND_PERMUTE,
 	HIT_DEFINED,
+	TRACE_WORKLOAD,
 	USER_FILE_WORKLOAD = -1
 };
 
@@ -56,6 +57,11 @@ class test_config
 	int num_repeats;
 	std::string workload_file;
 	bool user_compute;
+	// The SAFS I/O trace to replay.
+	std::string trace_file;
+	// How much faster the trace is replayed than it was recorded.
+	// 0 means the trace is replayed as fast as possible.
+	double trace_speedup;
 public:
 	test_config() {
 		access_option = -1;
@@ -69,6 +75,7 @@ public:
 		read_ratio = -1;
 		num_repeats = 1;
 		user_compute = false;
+		trace_speedup = 1;
 	}
 
 	void init(const std::map<std::string, std::string> &configs);
@@ -122,6 +129,14 @@ public:
 	bool is_user_compute() const {
 		return user_compute;
 	}
+
+	const std::string &get_trace_file() const {
+		return trace_file;
+	}
+
+	double get_trace_speedup() const {
+		return trace_speedup;
+	}
 };
 
 extern test_config config;
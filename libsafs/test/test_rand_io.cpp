@@ -183,6 +183,17 @@ void test_config::init(const std::map<std::string, std::string> &configs)
 		user_compute = true;
 	}
 
+	it = configs.find("trace");
+	if (it != configs.end()) {
+		trace_file = it->second;
+		workload = TRACE_WORKLOAD;
+	}
+
+	it = configs.find("trace_speedup");
+	if (it != configs.end()) {
+		trace_speedup = atof(it->second.c_str());
+	}
+
 #ifdef PROFILER
 	it = configs.find("prof");
 	if (it != configs.end()) {
@@ -205,6 +216,8 @@ void test_config::print()
 	printf("\tbuf_type: %d\n", buf_type);
 	printf("\tsync: %d\n", !use_aio);
 	printf("\tuser_compute: %d\n", user_compute);
+	printf("\ttrace: %s\n", trace_file.c_str());
+	printf("\ttrace_speedup: %f\n", trace_speedup);
 }
 
 void test_config::print_help()
@@ -227,6 +240,8 @@ void test_config::print_help()
 	printf("\thigh_prio: run the test program in a higher OS priority\n");
 	buf_type_map.print("\tbuf types: ");
 	printf("\tsync: whether to use sync or async\n");
+	printf("\ttrace: replay an I/O trace recorded with io_trace_file\n");
+	printf("\ttrace_speedup: how much faster to replay the trace (0 means no pacing)\n");
 	printf("\troot_conf: a config file to specify the root paths of the RAID\n");
 	printf("\tuser_compute: whether to use user_compute\n");
 }
@@ -373,6 +388,19 @@ int main(int argc, char *argv[])
 							(int) (config.get_read_ratio() * 100));
 					break;
 				}
+			case TRACE_WORKLOAD:
+				{
+					static io_trace::ptr trace;
+					if (trace == NULL) {
+						trace = io_trace::load(config.get_trace_file());
+						if (trace == NULL)
+							exit(1);
+					}
+					gen = new trace_workload(*trace, data_files[file_idx],
+							i % nthread_per_file, nthread_per_file,
+							config.get_trace_speedup());
+					break;
+				}
 			default:
 				fprintf(stderr, "unsupported workload\n");
 				exit(1);
@@ -27,12 +27,15 @@
 #include <fcntl.h>
 #include <malloc.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include <string>
 #include <deque>
+#include <vector>
 
 #include "container.h"
 #include "cache.h"
+#include "io_trace.h"
 
 #define CHUNK_SLOTS 1024
 
@@ -479,4 +482,80 @@ public:
 	}
 };
 
+/**
+ * This replays the accesses in an I/O trace recorded by SAFS.
+ * A test thread replays the accesses of the recorded threads mapped to it.
+ * It issues an access no earlier than the recorded time divided by
+ * `speedup', so the replayed workload keeps the pace of the original one.
+ * If `speedup' is 0, it issues the accesses as fast as possible.
+ */
+class trace_workload: public workload_gen
+{
+	std::vector<workload_t> accesses;
+	// The time in nanoseconds when the access was issued in the trace.
+	std::vector<uint64_t> timestamps;
+	size_t curr;
+	double speedup;
+	struct timespec start;
+
+	uint64_t get_elapsed_ns() const {
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		return (now.tv_sec - start.tv_sec) * 1000000000L
+			+ now.tv_nsec - start.tv_nsec;
+	}
+public:
+	/**
+	 * The workload gets the accesses to `file_name' issued by the recorded
+	 * threads whose ids are `thread_idx' modulo `nthreads'. If the trace
+	 * has only one file, all accesses in the trace are to the file.
+	 */
+	trace_workload(const safs::io_trace &trace, const std::string &file_name,
+			int thread_idx, int nthreads, double speedup) {
+		const std::vector<safs::io_trace_record> &recs = trace.get_records();
+		for (size_t i = 0; i < recs.size(); i++) {
+			if (recs[i].thread_id % nthreads != thread_idx)
+				continue;
+			if (trace.get_num_files() > 1
+					&& trace.get_file_name(recs[i].file_id) != file_name)
+				continue;
+			workload_t access;
+			access.off = recs[i].offset;
+			access.size = recs[i].size;
+			access.read = recs[i].access_method == READ;
+			accesses.push_back(access);
+			timestamps.push_back(recs[i].timestamp);
+		}
+		curr = 0;
+		this->speedup = speedup;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+	}
+
+	off_t next_offset() {
+		return next().off;
+	}
+
+	bool has_next() {
+		return curr < accesses.size();
+	}
+
+	virtual const workload_t &next() {
+		if (speedup > 0) {
+			uint64_t issue_time = timestamps[curr] / speedup;
+			uint64_t elapsed = get_elapsed_ns();
+			if (issue_time > elapsed) {
+				uint64_t wait = issue_time - elapsed;
+				struct timespec req = {(time_t) (wait / 1000000000),
+					(long) (wait % 1000000000)};
+				nanosleep(&req, NULL);
+			}
+		}
+		return accesses[curr++];
+	}
+
+	virtual void print_state() {
+		printf("trace workload has %ld works left\n", accesses.size() - curr);
+	}
+};
+
 #endif
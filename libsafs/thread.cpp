@@ -19,11 +19,21 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <unistd.h>
 #include <numa.h>
 #include <pthread.h>
 
+#include <algorithm>
+#include <fstream>
+
+#include <boost/format.hpp>
+
 #include "thread.h"
 #include "common.h"
+#include "log.h"
 
 #ifdef USE_HWLOC
 
@@ -59,6 +69,7 @@ CPU_core::CPU_core(hwloc_obj_t core)
 
 NUMA_node::NUMA_node(hwloc_obj_t node)
 {
+	os_id = node->os_index;
 	std::vector<hwloc_obj_t> hwloc_cores = get_objs_by_type(node,
 			HWLOC_OBJ_CORE);
 	for (size_t i = 0; i < hwloc_cores.size(); i++)
@@ -69,6 +80,7 @@ NUMA_node::NUMA_node(hwloc_obj_t node)
 
 NUMA_node::NUMA_node(hwloc_topology_t topology)
 {
+	os_id = 0;
 	int num_cores = hwloc_get_nbobjs_by_type(topology, HWLOC_OBJ_CORE);
 	assert(num_cores > 0);
 	for (int i = 0; i < num_cores; i++) {
@@ -80,17 +92,7 @@ NUMA_node::NUMA_node(hwloc_topology_t topology)
 	lus.insert(lu_vec.begin(), lu_vec.end());
 }
 
-std::vector<int> NUMA_node::get_logical_units() const
-{
-	std::vector<int> ret;
-	for (size_t i = 0; i < get_num_cores(); i++) {
-		std::vector<int> units = get_core(i).get_units();
-		ret.insert(ret.end(), units.begin(), units.end());
-	}
-	return ret;
-}
-
-CPU_hierarchy::CPU_hierarchy()
+void CPU_hierarchy::init_hwloc()
 {
 	hwloc_topology_t topology;
 	hwloc_topology_init(&topology);
@@ -107,6 +109,154 @@ CPU_hierarchy::CPU_hierarchy()
 		nodes.emplace_back(topology);
 }
 
+#endif
+
+NUMA_node::NUMA_node(int os_id, const std::vector<CPU_core> &cores)
+{
+	this->os_id = os_id;
+	this->cores = cores;
+	std::vector<int> lu_vec = get_logical_units();
+	lus.insert(lu_vec.begin(), lu_vec.end());
+}
+
+std::vector<int> NUMA_node::get_logical_units() const
+{
+	std::vector<int> ret;
+	for (size_t i = 0; i < get_num_cores(); i++) {
+		std::vector<int> units = get_core(i).get_units();
+		ret.insert(ret.end(), units.begin(), units.end());
+	}
+	return ret;
+}
+
+/*
+ * Parse a CPU list in sysfs, e.g., "0-3,8-11".
+ */
+static std::vector<int> parse_cpu_list(const std::string &str)
+{
+	std::vector<int> ret;
+	size_t pos = 0;
+	while (pos < str.size()) {
+		if (!isdigit(str[pos])) {
+			pos++;
+			continue;
+		}
+		size_t end;
+		int first = std::stoi(str.substr(pos), &end);
+		pos += end;
+		int last = first;
+		if (pos < str.size() && str[pos] == '-') {
+			pos++;
+			last = std::stoi(str.substr(pos), &end);
+			pos += end;
+		}
+		for (int i = first; i <= last; i++)
+			ret.push_back(i);
+	}
+	return ret;
+}
+
+static bool read_cpu_list(const std::string &path, std::vector<int> &cpus)
+{
+	std::ifstream in(path.c_str());
+	std::string line;
+	if (!in.good() || !std::getline(in, line))
+		return false;
+	cpus = parse_cpu_list(line);
+	return true;
+}
+
+/*
+ * Group the logical units into CPU cores with the hyperthread siblings
+ * in sysfs. Only the logical units in `lus' are used.
+ */
+static std::vector<CPU_core> get_sysfs_cores(const std::vector<int> &lus)
+{
+	std::set<int> remaining(lus.begin(), lus.end());
+	std::vector<CPU_core> cores;
+	for (size_t i = 0; i < lus.size(); i++) {
+		if (remaining.find(lus[i]) == remaining.end())
+			continue;
+		std::vector<int> siblings;
+		std::string path = str(boost::format(
+					"/sys/devices/system/cpu/cpu%1%/topology/thread_siblings_list")
+				% lus[i]);
+		if (!read_cpu_list(path, siblings))
+			siblings.push_back(lus[i]);
+		std::vector<int> units;
+		for (size_t j = 0; j < siblings.size(); j++) {
+			if (remaining.erase(siblings[j]) > 0)
+				units.push_back(siblings[j]);
+		}
+		// The CPU list in sysfs may not contain the logical unit itself.
+		if (remaining.erase(lus[i]) > 0)
+			units.push_back(lus[i]);
+		std::sort(units.begin(), units.end());
+		cores.emplace_back(units);
+	}
+	return cores;
+}
+
+void CPU_hierarchy::init_sysfs()
+{
+	std::vector<int> online;
+	if (!read_cpu_list("/sys/devices/system/cpu/online", online)
+			|| online.empty()) {
+		online.clear();
+		long num = sysconf(_SC_NPROCESSORS_ONLN);
+		for (long i = 0; i < num; i++)
+			online.push_back(i);
+	}
+	std::set<int> online_set(online.begin(), online.end());
+
+	std::vector<int> node_ids;
+	DIR *dir = opendir("/sys/devices/system/node");
+	if (dir) {
+		struct dirent *entry;
+		while ((entry = readdir(dir)) != NULL) {
+			if (strncmp(entry->d_name, "node", 4) == 0
+					&& isdigit(entry->d_name[4]))
+				node_ids.push_back(atoi(entry->d_name + 4));
+		}
+		closedir(dir);
+	}
+	std::sort(node_ids.begin(), node_ids.end());
+	for (size_t i = 0; i < node_ids.size(); i++) {
+		std::vector<int> node_lus;
+		std::string path = str(boost::format(
+					"/sys/devices/system/node/node%1%/cpulist") % node_ids[i]);
+		if (!read_cpu_list(path, node_lus))
+			continue;
+		std::vector<int> lus;
+		for (size_t j = 0; j < node_lus.size(); j++)
+			if (online_set.find(node_lus[j]) != online_set.end())
+				lus.push_back(node_lus[j]);
+		// We ignore the nodes that only have memory.
+		if (!lus.empty())
+			nodes.emplace_back(node_ids[i], get_sysfs_cores(lus));
+	}
+	// The kernel doesn't support NUMA.
+	if (nodes.empty())
+		nodes.emplace_back(0, get_sysfs_cores(online));
+}
+
+CPU_hierarchy::CPU_hierarchy()
+{
+#ifdef USE_HWLOC
+	init_hwloc();
+#else
+	init_sysfs();
+#endif
+}
+
+const NUMA_node *CPU_hierarchy::get_os_node(int os_id) const
+{
+	for (size_t i = 0; i < nodes.size(); i++)
+		if (nodes[i].get_os_id() == os_id)
+			return &nodes[i];
+	return NULL;
+}
+
 std::vector<int> CPU_hierarchy::lus2node(const std::vector<int> &lus) const
 {
 	std::vector<int> ret(lus.size(), -1);
@@ -122,9 +272,23 @@ std::vector<int> CPU_hierarchy::lus2node(const std::vector<int> &lus) const
 	return ret;
 }
 
-CPU_hierarchy cpus;
+void CPU_hierarchy::print() const
+{
+	for (size_t i = 0; i < nodes.size(); i++) {
+		std::vector<int> lus = nodes[i].get_logical_units();
+		std::string lu_str;
+		for (size_t j = 0; j < lus.size(); j++) {
+			if (j > 0)
+				lu_str += ",";
+			lu_str += itoa(lus[j]);
+		}
+		BOOST_LOG_TRIVIAL(info) << boost::format(
+				"NUMA node %1% has %2% cores: CPU %3%")
+			% nodes[i].get_os_id() % nodes[i].get_num_cores() % lu_str;
+	}
+}
 
-#endif
+CPU_hierarchy cpus;
 
 static void bind2node_id(int node_id)
 {
@@ -180,7 +344,7 @@ void *thread_run(void *arg)
 		cpu_set_t set;
 		CPU_ZERO(&set);
 		for (size_t i = 0; i < cpus.size(); i++)
-			CPU_SET(cpus[i] + 1, &set);
+			CPU_SET(cpus[i], &set);
 		if (sched_setaffinity(t->tid, sizeof(set), &set) == -1)
 			fprintf(stderr, "can't set CPU affinity on thread %d\n", t->tid);
 	}
@@ -230,14 +394,25 @@ thread::thread(std::string name, const std::vector<int> &cpu_affinity,
 	thread_class_init();
 	construct_init();
 
-#ifdef USE_HWLOC
 	std::vector<int> node_ids = cpus.lus2node(cpu_affinity);
-	this->node_id = node_ids.front();
 	for (size_t i = 1; i < cpu_affinity.size(); i++)
-		assert(node_id == node_ids[i]);
-#else
-	this->node_id = 0;
-#endif
+		assert(node_ids.front() == node_ids[i]);
+	if (!node_ids.empty() && node_ids.front() >= 0)
+		this->node_id = cpus.get_node(node_ids.front()).get_os_id();
+	else
+		this->node_id = 0;
+	this->cpu_affinity = cpu_affinity;
+	this->name = name + "-" + itoa(thread_idx);
+	this->blocking = blocking;
+}
+
+thread::thread(std::string name, int node_id,
+		const std::vector<int> &cpu_affinity, bool blocking)
+{
+	thread_class_init();
+	construct_init();
+
+	this->node_id = node_id;
 	this->cpu_affinity = cpu_affinity;
 	this->name = name + "-" + itoa(thread_idx);
 	this->blocking = blocking;
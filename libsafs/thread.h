@@ -65,6 +65,12 @@ public:
 	thread(std::string name, int node_id, bool blocking = true);
 	thread(std::string name, const std::vector<int> &cpu_affinity,
 			bool blocking = true);
+	/*
+	 * The thread is bound to the CPUs in `cpu_affinity' if it isn't empty.
+	 * Otherwise, it's bound to the NUMA node.
+	 */
+	thread(std::string name, int node_id, const std::vector<int> &cpu_affinity,
+			bool blocking = true);
 
 	void set_user_data(void *user_data) {
 		assert(this->user_data == NULL);
@@ -225,13 +231,20 @@ public:
 	}
 };
 
-#ifdef USE_HWLOC
-
+/*
+ * The CPU topology is discovered with hwloc if it's available. Otherwise,
+ * we read it from sysfs.
+ */
 class CPU_core
 {
 	std::vector<int> logical_units;
 public:
+#ifdef USE_HWLOC
 	CPU_core(hwloc_obj_t core);
+#endif
+	CPU_core(const std::vector<int> &logical_units) {
+		this->logical_units = logical_units;
+	}
 
 	const std::vector<int> get_units() const {
 		return logical_units;
@@ -248,13 +261,22 @@ public:
 
 class NUMA_node
 {
+	int os_id;
 	std::vector<CPU_core> cores;
 	std::set<int> lus;
 public:
+#ifdef USE_HWLOC
 	/* This constructor works for the machine without NUMA nodes. */
 	NUMA_node(hwloc_topology_t topology);
 	/* This constructor works for the machine with NUMA nodes. */
 	NUMA_node(hwloc_obj_t node);
+#endif
+	NUMA_node(int os_id, const std::vector<CPU_core> &cores);
+
+	/* The node Id used by the OS. */
+	int get_os_id() const {
+		return os_id;
+	}
 
 	bool contain_lu(int unit) const {
 		return lus.find(unit) != lus.end();
@@ -271,13 +293,18 @@ public:
 	}
 
 	size_t get_num_logical_units() const {
-		return cores.size() * cores.front().get_num_units();
+		return lus.size();
 	}
 };
 
 class CPU_hierarchy
 {
 	std::vector<NUMA_node> nodes;
+
+#ifdef USE_HWLOC
+	void init_hwloc();
+#endif
+	void init_sysfs();
 public:
 	CPU_hierarchy();
 
@@ -289,19 +316,34 @@ public:
 		return nodes.size();
 	}
 
+	/*
+	 * Get the node with the node Id used by the OS.
+	 * It returns NULL if the node doesn't exist or has no CPUs.
+	 */
+	const NUMA_node *get_os_node(int os_id) const;
+
 	size_t get_num_cores() const {
-		return nodes.size() * nodes.front().get_num_cores();
+		size_t num = 0;
+		for (size_t i = 0; i < nodes.size(); i++)
+			num += nodes[i].get_num_cores();
+		return num;
 	}
 
 	size_t get_num_logical_units() const {
-		return nodes.size() * nodes.front().get_num_logical_units();
+		size_t num = 0;
+		for (size_t i = 0; i < nodes.size(); i++)
+			num += nodes[i].get_num_logical_units();
+		return num;
 	}
 
 	std::vector<int> lus2node(const std::vector<int> &lus) const;
+
+	/*
+	 * This prints the CPU cores in each NUMA node.
+	 */
+	void print() const;
 };
 
 extern CPU_hierarchy cpus;
 
 #endif
-
-#endif
@@ -1,5 +1,88 @@
+#include <pthread.h>
+
+#include <set>
+
 #include "slab_allocator.h"
 
+struct test_obj
+{
+	long id;
+	char data[56];
+};
+
+const int NUM_CROSS_OBJS = 100000;
+// The number of objects in flight between the two threads.
+const int NUM_INFLIGHT_OBJS = 500;
+
+/*
+ * The thread frees the objects allocated by the main thread.
+ */
+void *free_objs(void *arg)
+{
+	thread_safe_FIFO_queue<test_obj *> *q = (thread_safe_FIFO_queue<test_obj *> *) arg;
+	obj_allocator<test_obj> *allocator = NULL;
+	int num_frees = 0;
+	while (num_frees < NUM_CROSS_OBJS) {
+		test_obj *objs[64];
+		int num = q->fetch(objs, 64);
+		for (int i = 0; i < num; i++) {
+			// The first object carries the allocator.
+			if (allocator == NULL) {
+				allocator = (obj_allocator<test_obj> *) objs[i]->id;
+				continue;
+			}
+			allocator->free(objs[i]);
+			num_frees++;
+		}
+		if (num == 0)
+			sched_yield();
+	}
+	return NULL;
+}
+
+/*
+ * Objects are allocated in one thread and freed in another. They should
+ * be returned to the allocating thread and reused by it without growing
+ * the allocator.
+ */
+void test_cross_thread_free()
+{
+	obj_allocator<test_obj> allocator("test-cross-free", -1, true, 4096 * 4);
+	thread_safe_FIFO_queue<test_obj *> q("test-queue", -1, NUM_INFLIGHT_OBJS + 1);
+	test_obj *carrier = allocator.alloc_obj();
+	carrier->id = (long) &allocator;
+	BOOST_VERIFY(q.add(&carrier, 1) == 1);
+
+	pthread_t t;
+	pthread_create(&t, NULL, free_objs, &q);
+	for (int i = 0; i < NUM_CROSS_OBJS; i++) {
+		test_obj *obj = allocator.alloc_obj();
+		assert(obj);
+		obj->id = i;
+		while (q.add(&obj, 1) == 0)
+			sched_yield();
+	}
+	pthread_join(t, NULL);
+	allocator.free(carrier);
+
+	// All objects are back to the allocator and they are all different.
+	std::set<test_obj *> objs;
+	for (int i = 0; i < NUM_INFLIGHT_OBJS; i++) {
+		test_obj *obj = allocator.alloc_obj();
+		assert(obj);
+		assert(objs.find(obj) == objs.end());
+		objs.insert(obj);
+	}
+	for (std::set<test_obj *>::iterator it = objs.begin(); it != objs.end(); it++)
+		allocator.free(*it);
+	printf("allocate %d objects in a thread and free them in another, the allocator uses %ld bytes\n",
+			NUM_CROSS_OBJS, allocator.get_curr_size());
+	allocator.print_stat();
+	// The objects freed by the other thread are reused.
+	assert(allocator.get_curr_size() < (long) (sizeof(test_obj)
+				+ sizeof(slab_allocator::linked_obj)) * NUM_CROSS_OBJS / 10);
+}
+
 int main()
 {
 	const int num_objs = 1000;
@@ -41,4 +124,6 @@ int main()
 	}
 	printf("pop 600 objects, there are %d objs in the retuend list\n", num);
 	printf("There are %d objs in list 3\n", list3.get_size());
+
+	test_cross_thread_free();
 }
@@ -0,0 +1,226 @@
+/*
+ * Copyright 2014 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of SAFSlib.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <assert.h>
+
+#include <map>
+#include <string>
+
+#include "frequency_sketch.h"
+#include "associative_cache.h"
+
+using namespace safs;
+
+const int NUM_ITEMS = 1024;
+
+void test_estimate()
+{
+	frequency_sketch sketch(NUM_ITEMS);
+	// Key i is accessed i % 8 times.
+	for (int i = 0; i < NUM_ITEMS; i++)
+		for (int j = 0; j < i % 8; j++)
+			sketch.record(i);
+	int num_over = 0;
+	for (int i = 0; i < NUM_ITEMS; i++) {
+		int est = sketch.estimate(i);
+		// A count-min sketch never underestimates.
+		assert(est >= i % 8);
+		if (est > i % 8)
+			num_over++;
+	}
+	printf("%d of %d keys are overestimated\n", num_over, NUM_ITEMS);
+	assert(num_over < NUM_ITEMS / 10);
+	// The keys that haven't been accessed.
+	int num_nonzero = 0;
+	for (int i = NUM_ITEMS; i < NUM_ITEMS * 2; i++)
+		if (sketch.estimate(i) > 0)
+			num_nonzero++;
+	assert(num_nonzero < NUM_ITEMS / 10);
+}
+
+/*
+ * A hot key should still be more frequent than the keys in a long
+ * one-pass scan, and its count should decay after the scan.
+ */
+void test_aging()
+{
+	frequency_sketch sketch(NUM_ITEMS);
+	for (int i = 0; i < 10; i++)
+		sketch.record(0);
+	int before = sketch.estimate(0);
+	for (long i = 1; i < NUM_ITEMS * 20; i++)
+		sketch.record(i);
+	assert(sketch.get_num_agings() > 0);
+	int after = sketch.estimate(0);
+	printf("the hot key: %d before the scan, %d after the scan, %ld agings\n",
+			before, after, sketch.get_num_agings());
+	assert(after < before);
+	sketch.record(0);
+	assert(sketch.estimate(0) > sketch.estimate(NUM_ITEMS * 20 - 1));
+}
+
+/*
+ * Access a page in the cache and return true if it misses the cache.
+ */
+static bool access_page(page_cache &cache, off_t pg_idx, bool no_cache)
+{
+	page_id_t old_id;
+	page *pg = cache.search(page_id_t(0, pg_idx * PAGE_SIZE), old_id,
+			no_cache);
+	assert(pg);
+	bool miss = !pg->data_ready();
+	pg->set_data_ready(true);
+	pg->dec_ref();
+	return miss;
+}
+
+static int count_cached(page_cache &cache, off_t start, int num)
+{
+	int num_cached = 0;
+	for (off_t i = start; i < start + num; i++) {
+		page *pg = cache.search(page_id_t(0, i * PAGE_SIZE));
+		if (pg) {
+			num_cached++;
+			pg->dec_ref();
+		}
+	}
+	return num_cached;
+}
+
+/*
+ * Scan `num_scan' pages from `scan_start' while the hot pages keep being
+ * accessed. It returns the number of times that the hot pages miss
+ * the cache.
+ */
+static int scan(page_cache &cache, off_t scan_start, int num_scan,
+		int num_hot, bool no_cache)
+{
+	int num_misses = 0;
+	for (int i = 0; i < num_scan; i++) {
+		access_page(cache, scan_start + i, no_cache);
+		if (access_page(cache, i % num_hot, false))
+			num_misses++;
+	}
+	return num_misses;
+}
+
+/*
+ * Check the scanned pages left in the cache. They can only be in
+ * the probation slot, which is reused by every rejected page, so its hits
+ * have to be reset every time.
+ */
+static void check_scanned(page_cache &cache, off_t scan_start, int num_scan)
+{
+	int num_cached = 0;
+	for (off_t i = scan_start; i < scan_start + num_scan; i++) {
+		page *pg = cache.search(page_id_t(0, i * PAGE_SIZE));
+		if (pg) {
+			num_cached++;
+			assert(pg->get_hits() <= 1);
+			pg->dec_ref();
+		}
+	}
+	assert(num_cached <= 1);
+}
+
+/*
+ * Without cache admission, the no-cache hint is ignored, so the pages
+ * read with the hint still replace the pages in a full cache.
+ */
+void test_no_cache_no_admission()
+{
+	assert(!params.is_cache_admission());
+	const int num_pages = params.get_SA_min_cell_size();
+	page_cache::ptr cache = associative_cache::create(num_pages * PAGE_SIZE,
+			num_pages * PAGE_SIZE, 0, 1, 1024);
+	for (int i = 0; i < num_pages; i++)
+		access_page(*cache, i, false);
+	assert(count_cached(*cache, 0, num_pages) == num_pages);
+	// The pages are read twice, so they stay in the cache after the first
+	// pass over them has evicted the old pages.
+	for (int k = 0; k < 2; k++)
+		for (int i = 0; i < num_pages; i++)
+			access_page(*cache, num_pages + i, true);
+	assert(count_cached(*cache, num_pages, num_pages) == num_pages);
+	assert(count_cached(*cache, 0, num_pages) == 0);
+}
+
+/*
+ * A cache with a single cell. The pages in a one-pass scan are rejected
+ * and share the probation slot, so the hot pages rarely miss the cache.
+ */
+void test_admission()
+{
+	std::map<std::string, std::string> configs;
+	configs["cache_admission"] = "";
+	params.init(configs);
+	const int num_pages = params.get_SA_min_cell_size();
+	page_cache::ptr cache = associative_cache::create(num_pages * PAGE_SIZE,
+			num_pages * PAGE_SIZE, 0, 1, 1024);
+	assert(((associative_cache &) *cache).get_num_cells() == 1);
+
+	// The hot pages fill up the cell.
+	for (int k = 0; k < 4; k++)
+		for (int i = 0; i < num_pages; i++)
+			access_page(*cache, i, false);
+	assert(count_cached(*cache, 0, num_pages) == num_pages);
+
+	// Without admission, every access to the hot pages misses the cache
+	// in these scans.
+	const int SCAN_START = 1000;
+	const int NUM_SCAN = 300;
+	int num_misses = scan(*cache, SCAN_START, NUM_SCAN, num_pages, false);
+	printf("hot pages miss the cache %d times in a scan of %d pages\n",
+			num_misses, NUM_SCAN);
+	assert(num_misses < NUM_SCAN / 4);
+	check_scanned(*cache, SCAN_START, NUM_SCAN);
+
+	// The same for a scan with the no-cache hint.
+	num_misses = scan(*cache, SCAN_START * 2, NUM_SCAN, num_pages, true);
+	printf("hot pages miss the cache %d times in a no-cache scan of %d pages\n",
+			num_misses, NUM_SCAN);
+	assert(num_misses < NUM_SCAN / 4);
+	check_scanned(*cache, SCAN_START * 2, NUM_SCAN);
+}
+
+/*
+ * Pages with the no-cache hint are still kept in the empty pages.
+ */
+void test_no_cache_empty()
+{
+	const int num_pages = params.get_SA_min_cell_size();
+	page_cache::ptr cache = associative_cache::create(num_pages * PAGE_SIZE,
+			num_pages * PAGE_SIZE, 0, 1, 1024);
+	for (int i = 0; i < num_pages; i++)
+		access_page(*cache, i, true);
+	assert(count_cached(*cache, 0, num_pages) == num_pages);
+	for (int i = 0; i < num_pages; i++)
+		access_page(*cache, num_pages + i, true);
+	assert(count_cached(*cache, 0, num_pages) == num_pages - 1);
+}
+
+int main()
+{
+	test_estimate();
+	test_aging();
+	test_no_cache_no_admission();
+	test_admission();
+	test_no_cache_empty();
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright 2014 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of SAFSlib.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <assert.h>
+
+#include "hybrid_poller.h"
+
+using namespace safs;
+
+const int MAX_POLL_US = 50;
+
+/*
+ * When requests complete frequently, we poll for a bounded interval.
+ */
+void test_busy()
+{
+	hybrid_poller poller(MAX_POLL_US);
+	int64_t curr = 0;
+	for (int i = 0; i < 100; i++) {
+		curr += 10;
+		poller.record_completions(1, curr);
+	}
+	int64_t poll_time = poller.get_poll_time();
+	printf("poll %ldus when requests complete every 10us\n", poll_time);
+	assert(poll_time > 0 && poll_time <= MAX_POLL_US);
+	assert(poll_time < 30);
+}
+
+/*
+ * When the I/O is idle, we block right away. After requests complete
+ * frequently again, we poll quickly.
+ */
+void test_idle()
+{
+	hybrid_poller poller(MAX_POLL_US);
+	int64_t curr = 0;
+	for (int i = 0; i < 10; i++) {
+		curr += 1000000;
+		poller.record_completions(1, curr);
+	}
+	assert(poller.get_poll_time() == 0);
+	int num = 0;
+	while (poller.get_poll_time() == 0) {
+		curr += 5;
+		poller.record_completions(1, curr);
+		num++;
+	}
+	printf("poll again after %d completions\n", num);
+	assert(num < 20);
+}
+
+void test_stat()
+{
+	hybrid_poller poller(MAX_POLL_US);
+	poller.poll_hit(10);
+	poller.poll_miss(50);
+	poller.wakeup();
+	poll_stat stat;
+	stat += poller.get_stat();
+	stat += poller.get_stat();
+	assert(stat.num_poll_hits == 2);
+	assert(stat.num_poll_misses == 2);
+	assert(stat.num_wakeups == 2);
+	assert(stat.spin_us == 120);
+	assert(stat.wasted_spin_us == 100);
+}
+
+int main()
+{
+	test_busy();
+	test_idle();
+	test_stat();
+}
@@ -1,6 +1,7 @@
 #include "safs_file.h"
 #include "io_interface.h"
 #include "cache.h"
+#include "RAID_config.h"
 
 using namespace safs;
 
@@ -223,6 +224,273 @@ void test_remote_io(const std::string &data_file)
 	printf("remote I/O passed the test.\n");
 }
 
+//////////////////////////////// Test direct read ///////////////////////////////
+
+static const size_t DIRECT_READ_THRESHOLD = 64 * 1024;
+
+/*
+ * The buffers of large reads are shifted from a page-aligned address by
+ * the offset in the page, so they can be read to the user buffers directly.
+ */
+class direct_read_callback: public callback
+{
+	size_t num_completed;
+public:
+	direct_read_callback() {
+		num_completed = 0;
+	}
+
+	size_t get_num_completed() const {
+		return num_completed;
+	}
+
+	virtual int invoke(io_request *reqs[], int num) {
+		for (int i = 0; i < num; i++) {
+			long expected = reqs[i]->get_offset() / sizeof(long);
+			long *vs = (long *) reqs[i]->get_buf();
+			int num_longs = reqs[i]->get_size() / sizeof(long);
+			for (int j = 0; j < num_longs; j++)
+				assert(vs[j] == expected + j);
+			free(reqs[i]->get_buf() - reqs[i]->get_offset() % PAGE_SIZE);
+		}
+		num_completed += num;
+		return 0;
+	}
+};
+
+static void issue_read(io_interface &io, off_t off, size_t size)
+{
+	char *buf = NULL;
+	int ret = posix_memalign((void **) &buf, PAGE_SIZE,
+			ROUNDUP(off % PAGE_SIZE + size, PAGE_SIZE));
+	assert(ret == 0);
+	data_loc_t loc(io.get_file_id(), off);
+	io_request req(buf + off % PAGE_SIZE, loc, size, READ);
+	io.access(&req, 1);
+}
+
+/*
+ * Large reads whose pages are partially in the page cache. Some pages in
+ * each read are cached right before the read, so the read is split into
+ * the cached pages and the direct reads around them, which are also split
+ * at the RAID block boundaries. All of them have to fill the user buffer
+ * and the request should complete exactly once.
+ */
+void test_direct_read(const std::string &data_file)
+{
+	file_io_factory::shared_ptr factory = create_io_factory(data_file,
+			GLOBAL_CACHE_ACCESS);
+	io_interface::ptr io = create_io(factory, thread::get_curr_thread());
+	direct_read_callback *cb = new direct_read_callback();
+	io->set_callback(callback::ptr(cb));
+	size_t num_issued = 0;
+	for (int i = 0; i < 200; i++) {
+		size_t size = DIRECT_READ_THRESHOLD + ROUND(random()
+				% (4 * params.get_RAID_block_size() * PAGE_SIZE), sizeof(long));
+		off_t off = ROUND(random() % (FILE_SIZE - size), sizeof(long));
+
+		// Cache some pages inside the range first.
+		int num_cached = random() % 8;
+		for (int j = 0; j < num_cached; j++) {
+			off_t pg_off = ROUND(off + random() % size, PAGE_SIZE);
+			issue_read(*io, pg_off, sizeof(long));
+			num_issued++;
+		}
+		while (io->num_pending_ios() > 0)
+			io->wait4complete(io->num_pending_ios());
+
+		issue_read(*io, off, size);
+		num_issued++;
+		while (io->num_pending_ios() > 32)
+			io->wait4complete(1);
+	}
+	while (io->num_pending_ios() > 0)
+		io->wait4complete(io->num_pending_ios());
+	assert(cb->get_num_completed() == num_issued);
+	printf("direct read passed the test.\n");
+}
+
+//////////////////////////// Test log-structured IO ////////////////////////////
+
+// The number of times each page has been written by the test.
+static std::vector<int> page_versions;
+
+/*
+ * Each write to a page stores different data in it, so we can tell if
+ * a read gets stale data from the log or from the file.
+ */
+static long get_expected(size_t idx)
+{
+	size_t pg = idx * sizeof(long) / PAGE_SIZE;
+	return idx + page_versions[pg] * (FILE_SIZE / sizeof(long));
+}
+
+class log_callback: public callback
+{
+	size_t num_completed;
+public:
+	log_callback() {
+		num_completed = 0;
+	}
+
+	size_t get_num_completed() const {
+		return num_completed;
+	}
+
+	virtual int invoke(io_request *reqs[], int num) {
+		for (int i = 0; i < num; i++) {
+			if (reqs[i]->get_access_method() == READ) {
+				long *vs = (long *) reqs[i]->get_buf();
+				size_t start = reqs[i]->get_offset() / sizeof(long);
+				int num_longs = reqs[i]->get_size() / sizeof(long);
+				for (int j = 0; j < num_longs; j++)
+					assert(vs[j] == get_expected(start + j));
+			}
+			free(reqs[i]->get_buf());
+		}
+		num_completed += num;
+		return 0;
+	}
+};
+
+static void issue_log_write(io_interface &io, off_t pg, size_t num_pages)
+{
+	char *buf = NULL;
+	int ret = posix_memalign((void **) &buf, PAGE_SIZE, num_pages * PAGE_SIZE);
+	assert(ret == 0);
+	for (size_t i = pg; i < pg + num_pages; i++)
+		page_versions[i]++;
+	long *vs = (long *) buf;
+	size_t start = pg * PAGE_SIZE / sizeof(long);
+	for (size_t i = 0; i < num_pages * PAGE_SIZE / sizeof(long); i++)
+		vs[i] = get_expected(start + i);
+	data_loc_t loc(io.get_file_id(), pg * PAGE_SIZE);
+	io_request req(buf, loc, num_pages * PAGE_SIZE, WRITE);
+	io.access(&req, 1);
+}
+
+static void issue_log_read(io_interface &io, off_t off, size_t size)
+{
+	char *buf = NULL;
+	int ret = posix_memalign((void **) &buf, 512, size);
+	assert(ret == 0);
+	data_loc_t loc(io.get_file_id(), off);
+	io_request req(buf, loc, size, READ);
+	io.access(&req, 1);
+}
+
+/*
+ * We write random pages to the file through the write log and read
+ * random ranges back after the writes complete.
+ * Many writes don't fill a RAID block, so they only complete after
+ * the partially filled block is written to the log. The reads cover
+ * pages in the log and in the file, so they're split into parts.
+ * We write much more data than the log can hold, so the segments are
+ * cleaned while we write. At the end, we write the log back to the file
+ * and read the whole file without the log.
+ */
+void test_log_structured_io(const std::string &data_file)
+{
+	size_t num_pages = FILE_SIZE / PAGE_SIZE;
+	size_t block_pages = params.get_RAID_block_size();
+	page_versions.clear();
+	page_versions.resize(num_pages);
+	file_io_factory::shared_ptr factory = create_io_factory(data_file,
+			LOG_STRUCTURED_ACCESS);
+	{
+		io_interface::ptr io = create_io(factory, thread::get_curr_thread());
+		log_callback *cb = new log_callback();
+		io->set_callback(callback::ptr(cb));
+		// The log is never larger than this.
+		size_t max_log_pages = num_pages * 2 + sysconf(_SC_NPROCESSORS_CONF)
+			* block_pages * get_sys_RAID_conf().get_num_disks();
+		size_t num_written = 0;
+		size_t num_issued = 0;
+		while (num_written < 2 * max_log_pages) {
+			for (int i = 0; i < 16; i++) {
+				size_t n = 1 + random() % (2 * block_pages);
+				off_t pg = random() % (num_pages - n);
+				issue_log_write(*io, pg, n);
+				num_written += n;
+				num_issued++;
+			}
+			while (io->num_pending_ios() > 0)
+				io->wait4complete(io->num_pending_ios());
+
+			for (int i = 0; i < 16; i++) {
+				std::pair<off_t, size_t> p = get_rand_align_req();
+				issue_log_read(*io, p.first, p.second);
+				num_issued++;
+			}
+			while (io->num_pending_ios() > 0)
+				io->wait4complete(io->num_pending_ios());
+		}
+		assert(cb->get_num_completed() == num_issued);
+	}
+
+	factory->write_back();
+	file_io_factory::shared_ptr remote_factory = create_io_factory(data_file,
+			REMOTE_ACCESS);
+	io_interface::ptr io = create_io(remote_factory, thread::get_curr_thread());
+	io->set_callback(callback::ptr(new log_callback()));
+	for (size_t off = 0; off < FILE_SIZE; off += IO_SIZE) {
+		issue_log_read(*io, off, IO_SIZE);
+		while (io->num_pending_ios() > 32)
+			io->wait4complete(1);
+	}
+	while (io->num_pending_ios() > 0)
+		io->wait4complete(io->num_pending_ios());
+	printf("log-structured I/O passed the test.\n");
+}
+
+/*
+ * Two I/O instances write the same page. The first instance opens its
+ * segment before the second one, but it writes the page last, so reads
+ * have to get the data of the first instance.
+ */
+void test_log_write_order(const std::string &data_file)
+{
+	size_t num_pages = FILE_SIZE / PAGE_SIZE;
+	page_versions.clear();
+	page_versions.resize(num_pages);
+	file_io_factory::shared_ptr factory = create_io_factory(data_file,
+			LOG_STRUCTURED_ACCESS);
+	io_interface::ptr io1 = create_io(factory, thread::get_curr_thread());
+	io_interface::ptr io2 = create_io(factory, thread::get_curr_thread());
+	log_callback *cb1 = new log_callback();
+	log_callback *cb2 = new log_callback();
+	io1->set_callback(callback::ptr(cb1));
+	io2->set_callback(callback::ptr(cb2));
+
+	// The first instance opens a segment. The segment isn't filled,
+	// so it stays open.
+	issue_log_write(*io1, 0, 1);
+	io1->wait4complete(1);
+	issue_log_write(*io2, 10, 1);
+	io2->wait4complete(1);
+	issue_log_write(*io1, 10, 1);
+	io1->wait4complete(1);
+
+	issue_log_read(*io1, 10 * PAGE_SIZE, PAGE_SIZE);
+	io1->wait4complete(1);
+	issue_log_read(*io2, 10 * PAGE_SIZE, PAGE_SIZE);
+	io2->wait4complete(1);
+	assert(cb1->get_num_completed() == 3);
+	assert(cb2->get_num_completed() == 2);
+	io1 = NULL;
+	io2 = NULL;
+
+	// The file gets the data of the first instance as well.
+	factory->write_back();
+	file_io_factory::shared_ptr remote_factory = create_io_factory(data_file,
+			REMOTE_ACCESS);
+	io_interface::ptr io = create_io(remote_factory, thread::get_curr_thread());
+	io->set_callback(callback::ptr(new log_callback()));
+	issue_log_read(*io, 10 * PAGE_SIZE, PAGE_SIZE);
+	io->wait4complete(1);
+	printf("log-structured I/O keeps the latest write to a page.\n");
+}
+
 std::string prepare_file()
 {
 	std::string data_file_name = basename(tempnam(".", "test"));;
@@ -255,11 +523,16 @@ int main(int argc, char *argv[])
 
 	std::string conf_file = argv[1];
 	config_map::ptr configs = config_map::create(conf_file);
+	configs->add_options(std::string("direct_read_threshold=")
+			+ itoa(DIRECT_READ_THRESHOLD));
 	init_io_system(configs);
 
 	std::string data_file = prepare_file();
 	test_remote_io(data_file);
 	test_direct_comp(data_file);
+	test_direct_read(data_file);
+	test_log_structured_io(data_file);
+	test_log_write_order(data_file);
 
 	safs_file f(get_sys_RAID_conf(), data_file);
 	f.delete_file();
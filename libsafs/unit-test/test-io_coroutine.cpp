@@ -0,0 +1,221 @@
+/*
+ * Copyright 2014 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of SAFSlib.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include <stdexcept>
+
+#include "io_coroutine.h"
+
+using namespace safs;
+
+const int FILE_NPAGES = 1024;
+
+/*
+ * An asynchronous I/O instance on a file in memory. Requests complete
+ * in the reverse order of issuing, and the requests to the first page
+ * complete right away, as if they hit the page cache.
+ */
+class mock_io: public io_interface
+{
+	char *data;
+	callback::ptr cb;
+	std::vector<io_request> pending;
+	size_t max_pending;
+
+	void complete(io_request &req) {
+		if (req.get_access_method() == READ)
+			memcpy(req.get_buf(), data + req.get_offset(), req.get_size());
+		else
+			memcpy(data + req.get_offset(), req.get_buf(), req.get_size());
+		io_request *reqs[1] = {&req};
+		cb->invoke(reqs, 1);
+	}
+public:
+	mock_io(char *data, int max_pending_ios): io_interface(
+			thread::get_curr_thread(), safs_header()) {
+		this->data = data;
+		set_max_num_pending_ios(max_pending_ios);
+		max_pending = 0;
+	}
+
+	virtual int get_file_id() const {
+		return 0;
+	}
+
+	virtual bool support_aio() {
+		return true;
+	}
+
+	virtual bool set_callback(callback::ptr cb) {
+		this->cb = cb;
+		return true;
+	}
+
+	virtual callback &get_callback() {
+		return *cb;
+	}
+
+	virtual void access(io_request *requests, int num, io_status *status) {
+		for (int i = 0; i < num; i++) {
+			if (requests[i].get_offset() == 0)
+				complete(requests[i]);
+			else
+				pending.push_back(requests[i]);
+		}
+		max_pending = std::max(max_pending, pending.size());
+	}
+
+	virtual void flush_requests() {
+	}
+
+	virtual int wait4complete(int num) {
+		int num_completed = 0;
+		while (!pending.empty() && num_completed < std::max(num, 1)) {
+			io_request req = pending.back();
+			pending.pop_back();
+			complete(req);
+			num_completed++;
+		}
+		return num_completed;
+	}
+
+	virtual int num_pending_ios() const {
+		return pending.size();
+	}
+
+	size_t get_max_pending() const {
+		return max_pending;
+	}
+};
+
+io_task read_pages(coro_io &io, off_t off, long &num_correct)
+{
+	for (int i = 0; i < 2; i++) {
+		off_t page_off = (off + i) % FILE_NPAGES * PAGE_SIZE;
+		std::shared_ptr<char> buf = co_await io.read(
+				data_loc_t(io.get_file_id(), page_off), PAGE_SIZE);
+		if (*(off_t *) buf.get() == page_off)
+			num_correct++;
+	}
+}
+
+io_task write_page(coro_io &io, off_t off, char *buf)
+{
+	*(off_t *) buf = -off;
+	co_await io.write(data_loc_t(io.get_file_id(), off), buf, PAGE_SIZE);
+	std::shared_ptr<char> ret = co_await io.read(
+			data_loc_t(io.get_file_id(), off), buf, PAGE_SIZE);
+	assert(ret == NULL);
+	assert(*(off_t *) buf == -off);
+}
+
+io_task fail_read(coro_io &io)
+{
+	co_await io.read(data_loc_t(io.get_file_id(), PAGE_SIZE), PAGE_SIZE);
+	throw std::runtime_error("fail");
+}
+
+char *create_file()
+{
+	char *data = (char *) malloc(FILE_NPAGES * PAGE_SIZE);
+	for (off_t off = 0; off < FILE_NPAGES * PAGE_SIZE; off += PAGE_SIZE)
+		*(off_t *) (data + off) = off;
+	return data;
+}
+
+void test_read()
+{
+	char *data = create_file();
+	std::shared_ptr<mock_io> mio(new mock_io(data, 16));
+	long num_correct = 0;
+	{
+		coro_scheduler sched;
+		coro_io io(sched, mio);
+		for (int i = 0; i < FILE_NPAGES; i++)
+			sched.spawn(read_pages(io, i, num_correct));
+		assert(sched.get_num_tasks() == FILE_NPAGES);
+		sched.run();
+		assert(sched.get_num_tasks() == 0);
+	}
+	assert(num_correct == FILE_NPAGES * 2);
+	// The number of requests in flight is limited by the I/O instance.
+	assert(mio->get_max_pending() <= 16);
+	free(data);
+}
+
+void test_write()
+{
+	char *data = create_file();
+	std::shared_ptr<mock_io> mio(new mock_io(data, 16));
+	std::vector<char *> bufs(64);
+	{
+		coro_scheduler sched;
+		coro_io io(sched, mio);
+		for (size_t i = 0; i < bufs.size(); i++) {
+			bufs[i] = (char *) malloc(PAGE_SIZE);
+			sched.spawn(write_page(io, (i + 1) * PAGE_SIZE, bufs[i]));
+		}
+		sched.run();
+	}
+	for (size_t i = 0; i < bufs.size(); i++) {
+		off_t off = (i + 1) * PAGE_SIZE;
+		assert(*(off_t *) (data + off) == -off);
+		free(bufs[i]);
+	}
+	free(data);
+}
+
+void test_exception()
+{
+	char *data = create_file();
+	std::shared_ptr<mock_io> mio(new mock_io(data, 16));
+	long num_correct = 0;
+	bool caught = false;
+	{
+		coro_scheduler sched;
+		coro_io io(sched, mio);
+		sched.spawn(fail_read(io));
+		for (int i = 0; i < 100; i++)
+			sched.spawn(read_pages(io, i, num_correct));
+		try {
+			sched.run();
+		} catch (std::runtime_error &e) {
+			caught = true;
+		}
+		// The scheduler still runs the remaining tasks.
+		sched.run();
+		assert(sched.get_num_tasks() == 0);
+	}
+	assert(caught);
+	assert(num_correct == 200);
+	free(data);
+}
+
+int main()
+{
+	thread::thread_class_init();
+	if (thread::get_curr_thread() == NULL)
+		thread::represent_thread(-1);
+	test_read();
+	test_write();
+	test_exception();
+}
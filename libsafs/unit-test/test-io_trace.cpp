@@ -0,0 +1,96 @@
+/*
+ * Copyright 2014 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of SAFSlib.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <assert.h>
+
+#include "common.h"
+#include "io_trace.h"
+
+using namespace safs;
+
+const char *TRACE_FILE = "/tmp/test-io_trace.trc";
+
+void test_record()
+{
+	io_tracer::ptr tracer = io_tracer::create(TRACE_FILE);
+	assert(tracer);
+	tracer->add_file(0, "file0");
+	tracer->add_file(1, "a_long_file_name_that_takes_more_than_one_record");
+	// A file is only recorded once.
+	tracer->add_file(0, "file0");
+	{
+		io_trace_buffer buf0(tracer, 0, 0);
+		io_trace_buffer buf1(tracer, 1, 1);
+		for (int i = 0; i < 10000; i++) {
+			io_trace_buffer &buf = i % 2 ? buf1 : buf0;
+			buf.record(i % 2, i * 4096L, 4096, i % 3 ? READ : WRITE, i % 5 == 0);
+		}
+	}
+	tracer.reset();
+
+	io_trace::ptr trace = io_trace::load(TRACE_FILE);
+	assert(trace);
+	assert(trace->get_num_files() == 2);
+	assert(trace->get_file_name(0) == "file0");
+	assert(trace->get_file_name(1)
+			== "a_long_file_name_that_takes_more_than_one_record");
+	assert(trace->get_file_name(2).empty());
+
+	// The records are sorted by time, so the records of a thread
+	// are in the issue order.
+	const std::vector<io_trace_record> &recs = trace->get_records();
+	assert(recs.size() == 10000);
+	off_t last_off[2] = {-1, -1};
+	for (size_t i = 0; i < recs.size(); i++) {
+		int thread_id = recs[i].thread_id;
+		assert(thread_id == 0 || thread_id == 1);
+		assert(recs[i].offset > last_off[thread_id]);
+		last_off[thread_id] = recs[i].offset;
+
+		long idx = recs[i].offset / 4096;
+		assert(idx % 2 == thread_id);
+		assert(recs[i].size == 4096);
+		assert(recs[i].file_id == thread_id);
+		assert(recs[i].node_id == thread_id);
+		assert(recs[i].access_method == (idx % 3 ? READ : WRITE));
+		assert(recs[i].flags == (idx % 5 == 0 ? TRACE_SYNC : 0));
+		if (i > 0)
+			assert(recs[i].timestamp >= recs[i - 1].timestamp);
+	}
+	unlink(TRACE_FILE);
+}
+
+void test_invalid()
+{
+	FILE *f = fopen(TRACE_FILE, "w");
+	assert(f);
+	fprintf(f, "this isn't a trace file");
+	fclose(f);
+	assert(io_trace::load(TRACE_FILE) == NULL);
+	unlink(TRACE_FILE);
+	assert(io_trace::load(TRACE_FILE) == NULL);
+}
+
+int main()
+{
+	test_record();
+	test_invalid();
+}
@@ -0,0 +1,372 @@
+/*
+ * Copyright 2014 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of SAFSlib.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <assert.h>
+
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "mem_governor.h"
+#include "associative_cache.h"
+#include "cache_config.h"
+
+using namespace safs;
+
+const size_t MB = 1024 * 1024;
+
+/*
+ * A component that can give back all of its memory.
+ */
+class test_consumer: public mem_consumer
+{
+	size_t usage;
+	size_t num_reclaims;
+public:
+	test_consumer(size_t usage) {
+		this->usage = usage;
+		num_reclaims = 0;
+	}
+
+	virtual size_t get_mem_usage() const {
+		return usage;
+	}
+
+	virtual size_t reclaim(size_t size) {
+		size = std::min(size, usage);
+		usage -= size;
+		num_reclaims++;
+		return size;
+	}
+
+	size_t get_num_reclaims() const {
+		return num_reclaims;
+	}
+};
+
+/*
+ * A component that can't give back memory.
+ */
+class pinned_consumer: public mem_consumer
+{
+public:
+	virtual size_t get_mem_usage() const {
+		return 0;
+	}
+};
+
+void test_reclaim()
+{
+	mem_governor &governor = mem_governor::get();
+	governor.set_budget(100 * MB);
+	test_consumer small(20 * MB);
+	test_consumer large(60 * MB);
+	governor.register_consumer(&small, "small", 20 * MB);
+	governor.register_consumer(&large, "large", 60 * MB);
+	assert(governor.get_tot_granted() == 80 * MB);
+
+	// There is enough memory in the budget.
+	pinned_consumer pinned;
+	governor.register_consumer(&pinned, "pinned");
+	assert(governor.acquire(&pinned, 10 * MB));
+	assert(small.get_num_reclaims() == 0);
+	assert(large.get_num_reclaims() == 0);
+
+	// The memory is reclaimed from the largest component first.
+	assert(governor.acquire(&pinned, 30 * MB));
+	assert(large.get_mem_usage() == 40 * MB);
+	assert(small.get_mem_usage() == 20 * MB);
+	assert(governor.get_tot_granted() == 100 * MB);
+
+	// The memory is reclaimed from multiple components.
+	assert(governor.acquire(&pinned, 50 * MB));
+	assert(large.get_mem_usage() == 0);
+	assert(small.get_mem_usage() == 10 * MB);
+	assert(governor.get_tot_granted() == 100 * MB);
+
+	// There isn't enough memory even after reclaiming.
+	assert(!governor.acquire(&pinned, 50 * MB));
+	assert(small.get_mem_usage() == 0);
+	assert(governor.get_tot_granted() == 90 * MB);
+	// A forced grant can exceed the budget.
+	assert(governor.acquire(&pinned, 50 * MB, true));
+	assert(governor.get_tot_granted() == 140 * MB);
+
+	governor.release(&pinned, 50 * MB);
+	assert(governor.get_tot_granted() == 90 * MB);
+	governor.print_usage();
+
+	governor.unregister_consumer(&small);
+	governor.unregister_consumer(&large);
+	governor.unregister_consumer(&pinned);
+	assert(governor.get_tot_granted() == 0);
+}
+
+void test_unlimited()
+{
+	mem_governor &governor = mem_governor::get();
+	governor.set_budget(0);
+	test_consumer consumer(100 * MB);
+	governor.register_consumer(&consumer, "consumer", 100 * MB);
+	{
+		mem_grant grant("grant", 1024 * MB);
+		assert(governor.get_tot_granted() == 1124 * MB);
+		assert(consumer.get_num_reclaims() == 0);
+	}
+	assert(governor.get_tot_granted() == 100 * MB);
+
+	// A temporary grant takes memory from the other components.
+	governor.set_budget(200 * MB);
+	{
+		mem_grant grant("grant", 150 * MB);
+		assert(consumer.get_mem_usage() == 50 * MB);
+		assert(governor.get_tot_granted() == 200 * MB);
+	}
+	governor.unregister_consumer(&consumer);
+	assert(governor.get_tot_granted() == 0);
+}
+
+static void fill_page(page *pg, off_t off)
+{
+	long *data = (long *) pg->get_data();
+	assert(data);
+	for (size_t i = 0; i < PAGE_SIZE / sizeof(long); i++)
+		data[i] = off + i;
+}
+
+static bool check_page(const page *pg, off_t off)
+{
+	const long *data = (const long *) pg->get_data();
+	for (size_t i = 0; i < PAGE_SIZE / sizeof(long); i++)
+		if (data[i] != (long) (off + i))
+			return false;
+	return true;
+}
+
+/*
+ * Fill `npages' pages in the cache from the page `start'.
+ * Every fourth page is dirty and every eighth page is kept referenced
+ * if required.
+ */
+static void fill_cache(page_cache &cache, int start, int npages,
+		std::vector<page *> *kept_pages)
+{
+	for (int i = start; i < start + npages; i++) {
+		off_t off = ((off_t) i) * PAGE_SIZE;
+		page_id_t old_id;
+		thread_safe_page *pg = (thread_safe_page *) cache.search(
+				page_id_t(0, off), old_id);
+		assert(pg);
+		fill_page(pg, off);
+		pg->set_data_ready(true);
+		if (kept_pages && i % 4 == 0)
+			pg->set_dirty(true);
+		if (kept_pages && i % 8 == 1)
+			kept_pages->push_back(pg);
+		else
+			pg->dec_ref();
+	}
+}
+
+/*
+ * Reclaim memory from an associative cache. The cache should give up
+ * the pages added by expanding it and then the pages in its cells down
+ * to the reclaim limit, but it has to keep the dirty pages and the pages
+ * in use with their data.
+ */
+void test_cache_reclaim()
+{
+	page_cache::ptr cache = associative_cache::create(8 * MB, 64 * MB,
+			0, 1, 1024);
+	associative_cache &sa_cache = (associative_cache &) *cache;
+	long init_size = cache->size();
+	assert(sa_cache.get_num_used_pages() == init_size / PAGE_SIZE);
+	int init_ncells = sa_cache.get_num_cells();
+	long min_size = ((long) init_ncells) * CELL_RECLAIM_MIN_NUM_PAGES
+		* PAGE_SIZE;
+	// Expanding the cache by this many pages doubles the cell table.
+	int num_expand = init_ncells * params.get_SA_min_cell_size();
+
+	// All pages are clean, so the cache shrinks to the reclaim limit.
+	assert(sa_cache.expand(num_expand) == num_expand);
+	long orig_size = cache->size();
+	assert(orig_size == init_size + ((long) num_expand) * PAGE_SIZE);
+	fill_cache(*cache, 0, orig_size / PAGE_SIZE, NULL);
+	assert(cache->reclaim(orig_size) == orig_size - min_size);
+	assert(cache->size() == min_size);
+	assert(sa_cache.get_num_cells() == init_ncells);
+	assert(sa_cache.get_num_used_pages() == min_size / PAGE_SIZE);
+	sa_cache.sanity_check();
+
+	// The released pages can be used again. This time, the cells of
+	// the doubled table are also filled up.
+	num_expand += (init_size - min_size) / PAGE_SIZE;
+	num_expand += init_ncells * 2 * (CELL_SIZE - params.get_SA_min_cell_size());
+	assert(sa_cache.expand(num_expand) == num_expand);
+	orig_size = cache->size();
+	assert(orig_size == min_size + ((long) num_expand) * PAGE_SIZE);
+	int npages = orig_size / PAGE_SIZE;
+	std::vector<page *> kept_pages;
+	fill_cache(*cache, npages, npages, &kept_pages);
+
+	long reclaimed = cache->reclaim(orig_size);
+	assert(reclaimed > 0 && reclaimed % PAGE_SIZE == 0);
+	assert(reclaimed < orig_size - min_size);
+	assert(cache->size() == orig_size - reclaimed);
+	assert(sa_cache.get_num_used_pages() == cache->size() / PAGE_SIZE);
+	printf("reclaim %ld bytes from the cache of %ld bytes\n",
+			reclaimed, orig_size);
+
+	// The pages in use are still in the cache.
+	for (size_t i = 0; i < kept_pages.size(); i++) {
+		off_t off = kept_pages[i]->get_offset();
+		assert(cache->search(page_id_t(0, off)) == kept_pages[i]);
+		assert(check_page(kept_pages[i], off));
+		kept_pages[i]->dec_ref();
+		kept_pages[i]->dec_ref();
+	}
+	// So are the dirty pages.
+	for (int i = npages; i < npages * 2; i += 4) {
+		off_t off = ((off_t) i) * PAGE_SIZE;
+		page *pg = cache->search(page_id_t(0, off));
+		if (pg == NULL)
+			continue;
+		assert(pg->is_dirty());
+		assert(check_page(pg, off));
+		pg->dec_ref();
+	}
+	sa_cache.sanity_check();
+}
+
+/*
+ * The page cache of SAFS is created by cache_config, which allocates
+ * all pages in the initial cell table. Reclaiming memory still takes
+ * the pages in the cells down to the reclaim limit.
+ */
+void test_config_cache_reclaim()
+{
+	std::vector<int> node_ids(1, 0);
+	even_cache_config config(32 * MB, ASSOCIATIVE_CACHE, node_ids);
+	page_cache::ptr cache = config.create_cache_on_node(0, 1024);
+	associative_cache &sa_cache = (associative_cache &) *cache;
+	long init_size = cache->size();
+	int ncells = sa_cache.get_num_cells();
+	assert(init_size == ((long) ncells) * params.get_SA_min_cell_size()
+			* PAGE_SIZE);
+	fill_cache(*cache, 0, init_size / PAGE_SIZE, NULL);
+
+	long min_size = ((long) ncells) * CELL_RECLAIM_MIN_NUM_PAGES * PAGE_SIZE;
+	long reclaimed = cache->reclaim(init_size / 2);
+	assert(reclaimed == init_size / 2 / PAGE_SIZE * PAGE_SIZE);
+	assert(cache->size() == init_size - reclaimed);
+	assert(cache->reclaim(init_size) == init_size - reclaimed - min_size);
+	assert(cache->size() == min_size);
+	assert(sa_cache.get_num_cells() == ncells);
+	assert(sa_cache.get_num_used_pages() == min_size / PAGE_SIZE);
+	sa_cache.sanity_check();
+
+	// The cache still works with fewer pages in the cells.
+	fill_cache(*cache, init_size / PAGE_SIZE, init_size / PAGE_SIZE, NULL);
+	sa_cache.sanity_check();
+}
+
+/*
+ * The page cache registered with the governor.
+ */
+class cache_consumer: public mem_consumer
+{
+	page_cache &cache;
+public:
+	cache_consumer(page_cache &_cache): cache(_cache) {
+	}
+
+	virtual size_t get_mem_usage() const {
+		return cache.size();
+	}
+
+	virtual size_t reclaim(size_t size) {
+		return cache.reclaim(size);
+	}
+
+	virtual size_t regrow(size_t size) {
+		return cache.regrow(size);
+	}
+};
+
+/*
+ * A temporary grant shrinks the page cache, and the cache grows back
+ * after the grant is released.
+ */
+void test_cache_regrow()
+{
+	std::vector<int> node_ids(1, 0);
+	even_cache_config config(32 * MB, ASSOCIATIVE_CACHE, node_ids);
+	page_cache::ptr cache = config.create_cache_on_node(0, 1024);
+	associative_cache &sa_cache = (associative_cache &) *cache;
+	long init_size = cache->size();
+	fill_cache(*cache, 0, init_size / PAGE_SIZE, NULL);
+
+	mem_governor &governor = mem_governor::get();
+	governor.set_budget(init_size + 4 * MB);
+	cache_consumer consumer(*cache);
+	governor.register_consumer(&consumer, "page cache", init_size);
+	{
+		mem_grant grant("sort", 12 * MB);
+		assert(cache->size() == init_size - 8 * MB);
+		assert(governor.get_tot_granted() == init_size + 4 * MB);
+		sa_cache.sanity_check();
+
+		// The grant is released partially, and the cache takes back
+		// the released memory.
+		governor.release(&grant, 2 * MB);
+		assert(cache->size() == init_size - 6 * MB);
+		assert(governor.get_tot_granted() == init_size + 4 * MB);
+	}
+	// The cache never grows beyond the memory reclaimed from it.
+	assert(cache->size() == init_size);
+	assert(governor.get_tot_granted() == init_size);
+	assert(sa_cache.get_num_used_pages() == init_size / PAGE_SIZE);
+	assert(cache->regrow(init_size) == 0);
+	sa_cache.sanity_check();
+	fill_cache(*cache, init_size / PAGE_SIZE, init_size / PAGE_SIZE, NULL);
+
+	// The cache grows back when the budget is raised.
+	governor.set_budget(init_size - 8 * MB);
+	{
+		mem_grant grant("sort", 4 * MB);
+		assert(cache->size() == init_size - 12 * MB);
+	}
+	assert(cache->size() == init_size - 8 * MB);
+	governor.set_budget(0);
+	assert(cache->size() == init_size);
+	assert(governor.get_tot_granted() == init_size);
+	sa_cache.sanity_check();
+	governor.unregister_consumer(&consumer);
+}
+
+int main()
+{
+	test_reclaim();
+	test_unlimited();
+	test_cache_reclaim();
+	test_config_cache_reclaim();
+	test_cache_regrow();
+}
@@ -0,0 +1,195 @@
+/*
+ * Copyright 2014 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of SAFSlib.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/time.h>
+
+#include <vector>
+
+#include "container.h"
+
+/*
+ * Test the correctness of the lock-free queues and measure the throughput
+ * of the queues with many producers and a single consumer.
+ */
+
+const int BATCH_SIZE = 16;
+const long NUM_ENTRIES_PER_PRODUCER = 200000;
+
+// An entry contains the producer id in the upper 16 bits and
+// the sequence number of the entry in the producer.
+const int PRODUCER_SHIFT = 48;
+
+template<class QueueType>
+struct producer_arg
+{
+	QueueType *q;
+	long producer_id;
+};
+
+template<class QueueType>
+void *produce(void *arg)
+{
+	producer_arg<QueueType> *parg = (producer_arg<QueueType> *) arg;
+	long buf[BATCH_SIZE];
+	long seq = 0;
+	while (seq < NUM_ENTRIES_PER_PRODUCER) {
+		int num = min((long) BATCH_SIZE, NUM_ENTRIES_PER_PRODUCER - seq);
+		for (int i = 0; i < num; i++)
+			buf[i] = (parg->producer_id << PRODUCER_SHIFT) | (seq + i);
+		int num_added = 0;
+		while (num_added < num) {
+			int ret = parg->q->add(buf + num_added, num - num_added);
+			// The queue is full.
+			if (ret == 0)
+				sched_yield();
+			num_added += ret;
+		}
+		seq += num;
+	}
+	return NULL;
+}
+
+/*
+ * The consumer checks that it gets all entries and the entries from
+ * the same producer are in order.
+ */
+template<class QueueType>
+void consume(QueueType &q, int num_producers)
+{
+	std::vector<long> next_seqs(num_producers);
+	long tot_entries = NUM_ENTRIES_PER_PRODUCER * num_producers;
+	long num_fetches = 0;
+	long buf[BATCH_SIZE * 4];
+	while (num_fetches < tot_entries) {
+		int num = q.fetch(buf, BATCH_SIZE * 4);
+		if (num == 0)
+			sched_yield();
+		for (int i = 0; i < num; i++) {
+			long producer_id = buf[i] >> PRODUCER_SHIFT;
+			long seq = buf[i] & ((1L << PRODUCER_SHIFT) - 1);
+			assert(producer_id < num_producers);
+			assert(next_seqs[producer_id] == seq);
+			next_seqs[producer_id]++;
+		}
+		num_fetches += num;
+	}
+	assert(q.is_empty());
+}
+
+template<class QueueType>
+double run(QueueType &q, int num_producers)
+{
+	struct timeval start, end;
+	std::vector<pthread_t> threads(num_producers);
+	std::vector<producer_arg<QueueType> > args(num_producers);
+	gettimeofday(&start, NULL);
+	for (int i = 0; i < num_producers; i++) {
+		args[i].q = &q;
+		args[i].producer_id = i;
+		pthread_create(&threads[i], NULL, produce<QueueType>, &args[i]);
+	}
+	consume(q, num_producers);
+	for (int i = 0; i < num_producers; i++)
+		pthread_join(threads[i], NULL);
+	gettimeofday(&end, NULL);
+	return time_diff(start, end);
+}
+
+void test_spsc()
+{
+	printf("test SPSC ring queue\n");
+	spsc_ring_queue<long> q("spsc", -1, 1024);
+	double secs = run(q, 1);
+	printf("SPSC: %g entries/s\n", NUM_ENTRIES_PER_PRODUCER / secs);
+}
+
+void test_mpsc(int num_producers)
+{
+	long tot_entries = NUM_ENTRIES_PER_PRODUCER * num_producers;
+
+	thread_safe_FIFO_queue<long> locked_q("locked", -1, 1024, INT_MAX);
+	double locked_secs = run(locked_q, num_producers);
+
+	mpsc_ring_queue<long> ring_q("ring", -1, 1024);
+	double ring_secs = run(ring_q, num_producers);
+
+	// The ring is small, so the overflow queue is used as well.
+	mpsc_FIFO_queue<long> mpsc_q("mpsc", -1, 64, INT_MAX);
+	double mpsc_secs = run(mpsc_q, num_producers);
+
+	printf("%d producers: spinlock: %g entries/s, MPSC ring: %g entries/s, MPSC with overflow: %g entries/s\n",
+			num_producers, tot_entries / locked_secs, tot_entries / ring_secs,
+			tot_entries / mpsc_secs);
+}
+
+struct test_msg
+{
+	int num_objs;
+
+	int get_num_objs() const {
+		return num_objs;
+	}
+};
+
+/*
+ * The message queue counts the objects in the messages, including
+ * the messages in the overflow queue.
+ */
+void test_msg_queue()
+{
+	printf("test the message queue\n");
+	// The ring is larger than the requested size.
+	mpsc_msg_queue<test_msg> q("msg", -1, 16, INT_MAX);
+	int num_msgs = safs::MSG_RING_SIZE * 4;
+	long tot_objs = 0;
+	for (int i = 0; i < num_msgs; i++) {
+		test_msg msg;
+		msg.num_objs = i % 7;
+		int ret = q.add(&msg, 1);
+		assert(ret == 1);
+		tot_objs += msg.num_objs;
+		assert(q.get_num_objs() == tot_objs);
+	}
+	assert(q.get_num_entries() == num_msgs);
+
+	test_msg buf[BATCH_SIZE];
+	int num_fetched = 0;
+	while (!q.is_empty()) {
+		int num = q.fetch(buf, BATCH_SIZE);
+		for (int i = 0; i < num; i++) {
+			assert(buf[i].num_objs == (num_fetched + i) % 7);
+			tot_objs -= buf[i].num_objs;
+		}
+		num_fetched += num;
+		assert(q.get_num_objs() == tot_objs);
+	}
+	assert(num_fetched == num_msgs);
+	assert(tot_objs == 0);
+}
+
+int main()
+{
+	test_msg_queue();
+	test_spsc();
+	int num_producers[] = {1, 8, 16, 32, 64, 96};
+	for (size_t i = 0; i < sizeof(num_producers) / sizeof(int); i++)
+		test_mpsc(num_producers[i]);
+}
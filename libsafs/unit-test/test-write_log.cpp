@@ -0,0 +1,262 @@
+/*
+ * Copyright 2014 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of SAFSlib.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <assert.h>
+
+#include "write_log.h"
+
+using namespace safs;
+
+const size_t NUM_PAGES = 1024;
+const size_t SEG_PAGES = 16;
+const size_t NUM_SEGS = 8;
+
+/*
+ * A later write to the same page wins, even if it's committed first or
+ * it's in a segment opened earlier.
+ */
+void test_commit_order()
+{
+	write_log log(NUM_PAGES, SEG_PAGES, NUM_SEGS);
+	assert(log.lookup(10) == -1);
+	int seg1 = log.open_seg();
+	int seg2 = log.open_seg();
+	off_t log_pg1 = seg1 * SEG_PAGES;
+	off_t log_pg2 = seg2 * SEG_PAGES;
+	size_t seq1 = log.get_next_seq();
+	size_t seq2 = log.get_next_seq();
+	assert(seq1 > 0 && seq2 > seq1);
+	// The later write is in the segment opened first.
+	log.commit(10, log_pg1, seq2);
+	log.commit(10, log_pg2, seq1);
+	off_t ret = log.lookup(10);
+	assert(ret == log_pg1);
+	log.release_read(ret);
+
+	// The second segment doesn't have live pages, so it's freed
+	// once it's sealed.
+	size_t num_free = log.get_num_free_segs();
+	log.seal(seg2);
+	assert(log.get_num_free_segs() == num_free + 1);
+	log.seal(seg1);
+	assert(log.get_num_free_segs() == num_free + 1);
+
+	// The later write is committed last.
+	int seg3 = log.open_seg();
+	size_t seq3 = log.get_next_seq();
+	log.commit(10, seg3 * SEG_PAGES, seq3);
+	ret = log.lookup(10);
+	assert(ret == (off_t) (seg3 * SEG_PAGES));
+	log.release_read(ret);
+	log.seal(seg3);
+	printf("test commit order: OK\n");
+}
+
+/*
+ * A segment can't be freed when someone is reading data from it.
+ */
+void test_readers()
+{
+	write_log log(NUM_PAGES, SEG_PAGES, NUM_SEGS);
+	int seg = log.open_seg();
+	log.commit(1, seg * SEG_PAGES, log.get_next_seq());
+	log.seal(seg);
+	off_t ret = log.lookup(1);
+	assert(ret == (off_t) (seg * SEG_PAGES));
+
+	// Overwrite the page with a newer segment.
+	int seg2 = log.open_seg();
+	log.commit(1, seg2 * SEG_PAGES, log.get_next_seq());
+	size_t num_free = log.get_num_free_segs();
+	log.release_read(ret);
+	assert(log.get_num_free_segs() == num_free + 1);
+	printf("test readers: OK\n");
+}
+
+void test_clean()
+{
+	write_log log(NUM_PAGES, SEG_PAGES, NUM_SEGS);
+	int segs[NUM_SEGS];
+	for (size_t i = 0; i < NUM_SEGS; i++) {
+		segs[i] = log.open_seg();
+		assert(segs[i] >= 0);
+	}
+	assert(log.open_seg() == -1);
+	assert(log.need_clean());
+	// Segment i has i + 1 live pages.
+	for (size_t i = 0; i < NUM_SEGS; i++) {
+		for (size_t j = 0; j <= i; j++)
+			log.commit(i * SEG_PAGES + j, segs[i] * SEG_PAGES + j,
+					log.get_next_seq());
+	}
+	// An open segment can't be cleaned by default.
+	assert(log.start_clean() == -1);
+	for (size_t i = 0; i < NUM_SEGS; i++)
+		log.seal(segs[i]);
+
+	int victim = log.start_clean();
+	assert(victim == segs[0]);
+	std::vector<std::pair<off_t, off_t> > pages;
+	log.get_live_pages(victim, pages);
+	assert(pages.size() == 1);
+	assert(pages[0].first == 0);
+	// We can't clean another segment before the first one is done.
+	assert(log.start_clean() == -1);
+
+	log.commit_clean(pages[0].first, pages[0].second);
+	assert(log.lookup(0) == -1);
+	log.end_clean(victim);
+	assert(log.get_num_free_segs() == 1);
+	// The next victim has the fewest live pages among the rest.
+	int victim2 = log.start_clean();
+	assert(victim2 == segs[1]);
+
+	// A page in the second victim is written again while we clean it.
+	std::vector<std::pair<off_t, off_t> > pages2;
+	log.get_live_pages(victim2, pages2);
+	assert(pages2.size() == 2);
+	int new_seg = log.open_seg();
+	log.commit(pages2[0].first, new_seg * SEG_PAGES, log.get_next_seq());
+	for (size_t i = 0; i < pages2.size(); i++)
+		log.commit_clean(pages2[i].first, pages2[i].second);
+	off_t ret = log.lookup(pages2[0].first);
+	assert(ret == (off_t) (new_seg * SEG_PAGES));
+	log.release_read(ret);
+	assert(log.lookup(pages2[1].first) == -1);
+	log.end_clean(victim2);
+	assert(log.get_num_free_segs() == 1);
+	printf("test clean: OK\n");
+}
+
+/*
+ * We can clean open segments when no one is writing to the log.
+ */
+void test_clean_all()
+{
+	write_log log(NUM_PAGES, SEG_PAGES, NUM_SEGS);
+	int seg = log.open_seg();
+	for (size_t i = 0; i < SEG_PAGES / 2; i++)
+		log.commit(i * 2, seg * SEG_PAGES + i, log.get_next_seq());
+	assert(log.start_clean() == -1);
+	int victim = log.start_clean(true);
+	assert(victim == seg);
+	std::vector<std::pair<off_t, off_t> > pages;
+	log.get_live_pages(victim, pages);
+	assert(pages.size() == SEG_PAGES / 2);
+	for (size_t i = 0; i < pages.size(); i++)
+		log.commit_clean(pages[i].first, pages[i].second);
+	log.end_clean(victim);
+	assert(log.start_clean(true) == -1);
+	// The segment is still open, so we can write more pages to it.
+	log.commit(1, seg * SEG_PAGES + SEG_PAGES / 2, log.get_next_seq());
+	off_t ret = log.lookup(1);
+	assert(ret == (off_t) (seg * SEG_PAGES + SEG_PAGES / 2));
+	log.release_read(ret);
+	printf("test clean all: OK\n");
+}
+
+/*
+ * A page is written to two segments and both segments need cleaning.
+ * The newer segment can't be cleaned while the write-back of the older
+ * data is in flight, so the file always ends up with the newer data.
+ */
+void test_clean_serial()
+{
+	write_log log(NUM_PAGES, SEG_PAGES, NUM_SEGS);
+	int seg1 = log.open_seg();
+	log.commit(5, seg1 * SEG_PAGES, log.get_next_seq());
+	log.commit(6, seg1 * SEG_PAGES + 1, log.get_next_seq());
+	log.seal(seg1);
+
+	int victim = log.start_clean();
+	assert(victim == seg1);
+	assert(log.is_cleaning());
+	std::vector<std::pair<off_t, off_t> > pages;
+	log.get_live_pages(victim, pages);
+	assert(pages.size() == 2);
+
+	// Page 5 is written again while its old data is written back.
+	int seg2 = log.open_seg();
+	log.commit(5, seg2 * SEG_PAGES, log.get_next_seq());
+	log.seal(seg2);
+	assert(log.start_clean() == -1);
+	assert(log.start_clean(true) == -1);
+
+	for (size_t i = 0; i < pages.size(); i++)
+		log.commit_clean(pages[i].first, pages[i].second);
+	log.end_clean(victim);
+	assert(!log.is_cleaning());
+	assert(log.lookup(6) == -1);
+
+	// Only now the newer data of page 5 can be written back.
+	int victim2 = log.start_clean();
+	assert(victim2 == seg2);
+	std::vector<std::pair<off_t, off_t> > pages2;
+	log.get_live_pages(victim2, pages2);
+	assert(pages2.size() == 1);
+	assert(pages2[0].first == 5);
+	log.commit_clean(pages2[0].first, pages2[0].second);
+	log.end_clean(victim2);
+	assert(log.lookup(5) == -1);
+	assert(log.get_num_free_segs() == NUM_SEGS);
+	printf("test clean serial: OK\n");
+}
+
+/*
+ * An older write to a page is committed after the newer data of the page
+ * has been written back to the file. The older data is discarded, so
+ * reads still go to the file.
+ */
+void test_late_commit()
+{
+	write_log log(NUM_PAGES, SEG_PAGES, NUM_SEGS);
+	int seg1 = log.open_seg();
+	int seg2 = log.open_seg();
+	size_t seq1 = log.get_next_seq();
+	size_t seq2 = log.get_next_seq();
+	log.commit(3, seg2 * SEG_PAGES, seq2);
+	log.seal(seg2);
+
+	int victim = log.start_clean();
+	assert(victim == seg2);
+	std::vector<std::pair<off_t, off_t> > pages;
+	log.get_live_pages(victim, pages);
+	assert(pages.size() == 1);
+	log.commit_clean(pages[0].first, pages[0].second);
+	log.end_clean(victim);
+	assert(log.lookup(3) == -1);
+
+	log.commit(3, seg1 * SEG_PAGES, seq1);
+	assert(log.lookup(3) == -1);
+	size_t num_free = log.get_num_free_segs();
+	log.seal(seg1);
+	assert(log.get_num_free_segs() == num_free + 1);
+	printf("test late commit: OK\n");
+}
+
+int main()
+{
+	test_commit_order();
+	test_readers();
+	test_clean();
+	test_clean_all();
+	test_clean_serial();
+	test_late_commit();
+}
@@ -19,6 +19,9 @@
 
 #include <algorithm>
 
+#include <boost/format.hpp>
+
+#include "log.h"
 #include "virt_aio_ctx.h"
 #include "parameters.h"
 #include "io_request.h"
@@ -31,6 +34,12 @@ const int MAX_RAND_READ_DELAY = 100;		// in microseconds
 const int MIN_WRITE_DELAY = 200;
 const int MAX_RAND_WRITE_DELAY = 500;		// in microseconds
 
+// The parameters of the linear model.
+const int LINEAR_READ_LATENCY = 80;		// in microseconds
+const int LINEAR_WRITE_LATENCY = 20;	// in microseconds
+const long LINEAR_READ_BW = 500L * 1024 * 1024;		// bytes per second
+const long LINEAR_WRITE_BW = 400L * 1024 * 1024;	// bytes per second
+
 struct timeval add2timeval(const struct timeval time, long added_delay)
 {
 	struct timeval res = time;
@@ -67,12 +76,40 @@ long naive_ssd_perf_model::get_write_delay(off_t off, size_t size)
 	return rand_delay + MIN_WRITE_DELAY * num_pages;
 }
 
+/*
+ * The delay of a request is a fixed latency plus the time of transferring
+ * the data. It doesn't have any randomness, so the same workload always
+ * gets the same delays. It's useful for comparing cache policies or
+ * I/O schedulers with a replayed trace.
+ */
+class linear_ssd_perf_model: public ssd_perf_model
+{
+public:
+	virtual long get_read_delay(off_t off, size_t size) {
+		return LINEAR_READ_LATENCY + size * 1000000 / LINEAR_READ_BW;
+	}
+
+	virtual long get_write_delay(off_t off, size_t size) {
+		return LINEAR_WRITE_LATENCY + size * 1000000 / LINEAR_WRITE_BW;
+	}
+};
+
+static ssd_perf_model *create_ssd_perf_model(const std::string &name)
+{
+	if (name == "linear")
+		return new linear_ssd_perf_model();
+	if (name != "naive")
+		BOOST_LOG_TRIVIAL(error) << boost::format(
+				"unknown SSD model %1%, use the naive model") % name;
+	return new naive_ssd_perf_model();
+}
+
 virt_aio_ctx::virt_aio_ctx(virt_data *data, int node_id,
 		int max_aio): aio_ctx(node_id, max_aio), pending_reqs(node_id, max_aio)
 {
 	this->max_aio = max_aio;
 	this->data = data;
-	this->model = new naive_ssd_perf_model();
+	this->model = create_ssd_perf_model(params.get_virt_ssd_model());
 
 	read_bytes = 0;
 	write_bytes = 0;
@@ -81,6 +118,11 @@ virt_aio_ctx::virt_aio_ctx(virt_data *data, int node_id,
 	memset(&prev_print_time, 0, sizeof(prev_print_time));
 }
 
+virt_aio_ctx::~virt_aio_ctx()
+{
+	delete model;
+}
+
 struct comp_issued_request
 {
 	bool operator() (const struct req_entry &req1,
@@ -196,7 +238,7 @@ int virt_aio_ctx::io_wait(struct timespec* to, int num)
 			struct iovec *iov = (struct iovec *) iocbs[i]->u.c.buf;
 			int fd = iocbs[i]->aio_fildes;
 			for (int j = 0; j < num_vecs; j++) {
-				if (params.is_verify_content()) {
+				if (data && params.is_verify_content()) {
 					data->create_data(fd, (char *) iov[j].iov_base,
 							iov[j].iov_len, offset);
 					offset += iov[j].iov_len;
@@ -206,7 +248,7 @@ int virt_aio_ctx::io_wait(struct timespec* to, int num)
 			}
 		}
 		else if (iocbs[i]->aio_lio_opcode == IO_CMD_PREAD) {
-			if (params.is_verify_content()) {
+			if (data && params.is_verify_content()) {
 				data->create_data(iocbs[i]->aio_fildes,
 						(char *) iocbs[i]->u.c.buf, iocbs[i]->u.c.nbytes,
 						iocbs[i]->u.c.offset);
@@ -220,7 +262,7 @@ int virt_aio_ctx::io_wait(struct timespec* to, int num)
 			struct iovec *iov = (struct iovec *) iocbs[i]->u.c.buf;
 			int fd = iocbs[i]->aio_fildes;
 			for (int j = 0; j < num_vecs; j++) {
-				if (params.is_verify_content()) {
+				if (data && params.is_verify_content()) {
 					BOOST_VERIFY(data->verify_data(fd, (char *) iov[j].iov_base,
 								iov[j].iov_len, offset));
 					offset += iov[j].iov_len;
@@ -230,7 +272,7 @@ int virt_aio_ctx::io_wait(struct timespec* to, int num)
 			}
 		}
 		else if (iocbs[i]->aio_lio_opcode == IO_CMD_PWRITE) {
-			if (params.is_verify_content()) {
+			if (data && params.is_verify_content()) {
 				assert(data->verify_data(iocbs[i]->aio_fildes,
 							(char *) iocbs[i]->u.c.buf, iocbs[i]->u.c.nbytes,
 							iocbs[i]->u.c.offset));
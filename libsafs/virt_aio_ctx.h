@@ -44,6 +44,9 @@ public:
 class ssd_perf_model
 {
 public:
+	virtual ~ssd_perf_model() {
+	}
+
 	virtual long get_read_delay(off_t off, size_t size) = 0;
 	virtual long get_write_delay(off_t off, size_t size) = 0;
 };
@@ -68,7 +71,11 @@ class virt_aio_ctx: public aio_ctx
 	long write_bytes_ps;	// the bytes to write within a second.
 	struct timeval prev_print_time;
 public:
+	/*
+	 * `data' can be NULL if we don't verify the content.
+	 */
 	virt_aio_ctx(virt_data *data, int node_id, int max_aio);
+	~virt_aio_ctx();
 
 	virtual void submit_io_request(struct iocb* ioq[], int num);
 	virtual int io_wait(struct timespec* to, int num);
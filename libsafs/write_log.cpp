@@ -0,0 +1,256 @@
+/*
+ * Copyright 2014 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of SAFSlib.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+
+#include <algorithm>
+#include <limits>
+
+#include <boost/format.hpp>
+
+#include "log.h"
+#include "write_log.h"
+
+namespace safs
+{
+
+// We start to clean segments when 1/8 of the segments are free.
+static const size_t LOW_WATERMARK_FRACTION = 8;
+static const size_t MIN_LOW_WATERMARK = 2;
+
+write_log::write_log(size_t num_pages, size_t seg_pages,
+		size_t num_segs): num_pages(num_pages), seg_pages(seg_pages),
+	low_watermark(std::max(MIN_LOW_WATERMARK,
+				num_segs / LOW_WATERMARK_FRACTION))
+{
+	pthread_spin_init(&lock, PTHREAD_PROCESS_PRIVATE);
+	remap.resize(num_pages, -1);
+	rev_map.resize(num_segs * seg_pages, -1);
+	last_seqs.resize(num_pages, 0);
+	segs.resize(num_segs);
+	// We prefer to use the segments in the front of the log.
+	for (int i = num_segs - 1; i >= 0; i--) {
+		segs[i].state = FREE;
+		segs[i].prev_state = FREE;
+		segs[i].num_live = 0;
+		segs[i].num_readers = 0;
+		free_segs.push_back(i);
+	}
+	cleaning_seg = -1;
+	seq_counter = 0;
+	num_log_pages = 0;
+	num_cleaned_pages = 0;
+	num_cleanings = 0;
+}
+
+write_log::~write_log()
+{
+	pthread_spin_destroy(&lock);
+}
+
+size_t write_log::get_num_free_segs() const
+{
+	pthread_spin_lock(&lock);
+	size_t ret = free_segs.size();
+	pthread_spin_unlock(&lock);
+	return ret;
+}
+
+bool write_log::need_clean() const
+{
+	return get_num_free_segs() < low_watermark;
+}
+
+int write_log::open_seg()
+{
+	pthread_spin_lock(&lock);
+	if (free_segs.empty()) {
+		pthread_spin_unlock(&lock);
+		return -1;
+	}
+	int seg = free_segs.back();
+	free_segs.pop_back();
+	assert(segs[seg].state == FREE);
+	assert(segs[seg].num_live == 0 && segs[seg].num_readers == 0);
+	segs[seg].state = OPEN;
+	pthread_spin_unlock(&lock);
+	return seg;
+}
+
+/*
+ * The caller needs to hold the lock.
+ */
+void write_log::try_free(int seg)
+{
+	if (segs[seg].state == SEALED && segs[seg].num_live == 0
+			&& segs[seg].num_readers == 0) {
+		segs[seg].state = FREE;
+		free_segs.push_back(seg);
+	}
+}
+
+/*
+ * The caller needs to hold the lock.
+ */
+void write_log::dec_live(off_t log_pg)
+{
+	int seg = get_seg(log_pg);
+	assert(segs[seg].num_live > 0);
+	segs[seg].num_live--;
+	try_free(seg);
+}
+
+void write_log::seal(int seg)
+{
+	pthread_spin_lock(&lock);
+	assert(segs[seg].state == OPEN);
+	segs[seg].state = SEALED;
+	try_free(seg);
+	pthread_spin_unlock(&lock);
+}
+
+void write_log::commit(off_t pg, off_t log_pg, size_t seq)
+{
+	assert((size_t) pg < num_pages);
+	num_log_pages++;
+	pthread_spin_lock(&lock);
+	// If a later write to the page has been committed, the data in
+	// `log_pg' is stale. It doesn't matter if the later write is still
+	// in the log or has been written back to the file.
+	if (seq > last_seqs[pg]) {
+		off_t curr = remap[pg];
+		last_seqs[pg] = seq;
+		rev_map[log_pg] = pg;
+		remap[pg] = log_pg;
+		segs[get_seg(log_pg)].num_live++;
+		if (curr >= 0)
+			dec_live(curr);
+	}
+	pthread_spin_unlock(&lock);
+}
+
+off_t write_log::lookup(off_t pg)
+{
+	assert((size_t) pg < num_pages);
+	pthread_spin_lock(&lock);
+	off_t log_pg = remap[pg];
+	if (log_pg >= 0)
+		segs[get_seg(log_pg)].num_readers++;
+	pthread_spin_unlock(&lock);
+	return log_pg;
+}
+
+void write_log::release_read(off_t log_pg)
+{
+	int seg = get_seg(log_pg);
+	pthread_spin_lock(&lock);
+	assert(segs[seg].num_readers > 0);
+	segs[seg].num_readers--;
+	try_free(seg);
+	pthread_spin_unlock(&lock);
+}
+
+int write_log::start_clean(bool all)
+{
+	int victim = -1;
+	int min_live = std::numeric_limits<int>::max();
+	pthread_spin_lock(&lock);
+	// If a page is written back from two segments at the same time,
+	// the older data may reach the file last.
+	if (cleaning_seg >= 0) {
+		pthread_spin_unlock(&lock);
+		return -1;
+	}
+	for (size_t i = 0; i < segs.size(); i++) {
+		if (segs[i].num_live == 0)
+			continue;
+		if (segs[i].state == SEALED || (all && segs[i].state == OPEN)) {
+			if (segs[i].num_live < min_live) {
+				min_live = segs[i].num_live;
+				victim = i;
+			}
+		}
+	}
+	if (victim >= 0) {
+		segs[victim].prev_state = segs[victim].state;
+		segs[victim].state = CLEANING;
+		cleaning_seg = victim;
+		num_cleanings++;
+	}
+	pthread_spin_unlock(&lock);
+	return victim;
+}
+
+bool write_log::is_cleaning() const
+{
+	pthread_spin_lock(&lock);
+	bool ret = cleaning_seg >= 0;
+	pthread_spin_unlock(&lock);
+	return ret;
+}
+
+void write_log::get_live_pages(int seg,
+		std::vector<std::pair<off_t, off_t> > &pages) const
+{
+	pthread_spin_lock(&lock);
+	assert(segs[seg].state == CLEANING);
+	off_t start = seg * seg_pages;
+	for (off_t log_pg = start; log_pg < (off_t) (start + seg_pages); log_pg++) {
+		off_t pg = rev_map[log_pg];
+		if (pg >= 0 && remap[pg] == log_pg)
+			pages.push_back(std::pair<off_t, off_t>(pg, log_pg));
+	}
+	pthread_spin_unlock(&lock);
+	std::sort(pages.begin(), pages.end());
+}
+
+void write_log::commit_clean(off_t pg, off_t log_pg)
+{
+	pthread_spin_lock(&lock);
+	assert(segs[get_seg(log_pg)].state == CLEANING);
+	// The page may have been written to the log again while we were
+	// writing it back to the file.
+	if (remap[pg] == log_pg) {
+		remap[pg] = -1;
+		segs[get_seg(log_pg)].num_live--;
+		num_cleaned_pages++;
+	}
+	pthread_spin_unlock(&lock);
+}
+
+void write_log::end_clean(int seg)
+{
+	pthread_spin_lock(&lock);
+	assert(segs[seg].state == CLEANING);
+	assert(cleaning_seg == seg);
+	cleaning_seg = -1;
+	segs[seg].state = segs[seg].prev_state;
+	try_free(seg);
+	pthread_spin_unlock(&lock);
+}
+
+void write_log::print_stat() const
+{
+	BOOST_LOG_TRIVIAL(info) << boost::format(
+			"write log: %1% pages written to the log, %2% pages written back in %3% cleanings, %4% free segments out of %5%")
+		% num_log_pages.load() % num_cleaned_pages.load()
+		% num_cleanings.load() % get_num_free_segs() % segs.size();
+}
+
+}
@@ -0,0 +1,191 @@
+#ifndef __WRITE_LOG_H__
+#define __WRITE_LOG_H__
+
+/*
+ * Copyright 2014 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of SAFSlib.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <sys/types.h>
+
+#include <atomic>
+#include <vector>
+
+namespace safs
+{
+
+/*
+ * This keeps the metadata of a write log of a file. Instead of writing
+ * pages to their locations in the file, we append them to a log,
+ * so small random writes become large sequential writes.
+ *
+ * The log is divided into segments. An I/O instance opens a segment and
+ * fills it with the pages written by the thread. Once the data of a page
+ * is written to the log, the page is committed and the remap table points
+ * to the new location of the page. When there are few free segments,
+ * we clean the segment with the fewest live pages by writing its live
+ * pages back to the file. A segment becomes free again when it has no
+ * live pages and no one reads data from it. The I/O instances share
+ * the log, so only one of them can clean a segment at a time.
+ *
+ * Each write to a page gets a sequence number from the log when its data
+ * is copied to a segment. An I/O instance keeps its segment open until
+ * it's filled, so the order of the segments doesn't reflect the order
+ * of the writes. When a page is committed more than once, we keep
+ * the data with the highest sequence number.
+ *
+ * The log only lives in memory, so it can only be used by temporary files
+ * that don't need to survive a restart.
+ *
+ * All methods are thread-safe.
+ */
+class write_log
+{
+public:
+	enum seg_state {
+		FREE,
+		OPEN,
+		SEALED,
+		CLEANING,
+	};
+private:
+	struct segment {
+		seg_state state;
+		// The state of the segment before it's cleaned.
+		seg_state prev_state;
+		int num_live;
+		int num_readers;
+	};
+
+	const size_t num_pages;
+	const size_t seg_pages;
+	// When the number of free segments drops below it, we start to
+	// clean segments.
+	const size_t low_watermark;
+
+	mutable pthread_spinlock_t lock;
+	// A page in the file -> a page in the log.
+	// -1 means the page is in the file.
+	std::vector<off_t> remap;
+	// A page in the log -> a page in the file.
+	std::vector<off_t> rev_map;
+	// The sequence number of the last committed write to a page in
+	// the file. It's kept after the page is written back to the file,
+	// so an older write committed late can't overwrite the page.
+	std::vector<size_t> last_seqs;
+	std::vector<segment> segs;
+	std::vector<int> free_segs;
+	// The segment being cleaned. We clean one segment at a time, so
+	// the write-backs of the same page from different segments can't
+	// reach the file out of order. -1 means no segment is being cleaned.
+	int cleaning_seg;
+
+	std::atomic_ulong seq_counter;
+	std::atomic_ulong num_log_pages;
+	std::atomic_ulong num_cleaned_pages;
+	std::atomic_ulong num_cleanings;
+
+	int get_seg(off_t log_pg) const {
+		return log_pg / seg_pages;
+	}
+
+	void dec_live(off_t log_pg);
+	void try_free(int seg);
+public:
+	write_log(size_t num_pages, size_t seg_pages, size_t num_segs);
+	~write_log();
+
+	size_t get_num_pages() const {
+		return num_pages;
+	}
+
+	size_t get_seg_pages() const {
+		return seg_pages;
+	}
+
+	size_t get_num_segs() const {
+		return segs.size();
+	}
+
+	size_t get_num_free_segs() const;
+	bool need_clean() const;
+
+	/*
+	 * Open a free segment for writing.
+	 * It returns -1 if there aren't free segments.
+	 */
+	int open_seg();
+	/*
+	 * The owner doesn't write data to the segment any more.
+	 * It has to make sure all writes to the segment have been committed.
+	 */
+	void seal(int seg);
+
+	/*
+	 * Get the sequence number of a write to a page. A later write gets
+	 * a larger number. It never returns 0.
+	 */
+	size_t get_next_seq() {
+		return seq_counter.fetch_add(1) + 1;
+	}
+
+	/*
+	 * The data of page `pg' has been written to page `log_pg' in the log.
+	 * `seq' is the sequence number of the write. If the page has been
+	 * committed by a later write, the data in `log_pg' is discarded.
+	 */
+	void commit(off_t pg, off_t log_pg, size_t seq);
+
+	/*
+	 * This looks for the page in the log where the data of page `pg' is.
+	 * If the page is in the log, we hold the segment for reading and
+	 * the caller has to release it with `release_read'.
+	 */
+	off_t lookup(off_t pg);
+	void release_read(off_t log_pg);
+
+	/*
+	 * This picks a segment with the fewest live pages for cleaning.
+	 * By default, it only picks a sealed segment. If `all' is true,
+	 * open segments can be picked as well, which is only safe when
+	 * no one writes to the log.
+	 * Only one segment can be cleaned at a time.
+	 * It returns -1 if there aren't segments to clean or another segment
+	 * is being cleaned.
+	 */
+	int start_clean(bool all = false);
+	bool is_cleaning() const;
+	/*
+	 * Get the live pages in a segment. Each pair contains the page in
+	 * the file and the page in the log. The pairs are sorted by
+	 * the pages in the file.
+	 */
+	void get_live_pages(int seg,
+			std::vector<std::pair<off_t, off_t> > &pages) const;
+	/*
+	 * The data of page `pg' in `log_pg' has been written back to the file.
+	 */
+	void commit_clean(off_t pg, off_t log_pg);
+	void end_clean(int seg);
+
+	void print_stat() const;
+};
+
+}
+
+#endif
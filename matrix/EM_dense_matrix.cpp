@@ -88,7 +88,7 @@ EM_matrix_store::EM_matrix_store(size_t nrow, size_t ncol, matrix_layout_t layou
 	holder = file_holder::create_temp("mat", nrow * ncol * type.get_size(),
 			group);
 	safs::file_io_factory::shared_ptr factory = safs::create_io_factory(
-			holder->get_name(), safs::REMOTE_ACCESS);
+			holder->get_name(), file_holder::get_temp_access_option());
 	ios = io_set::ptr(new io_set(factory));
 
 	// Store the header as the metadata.
@@ -1070,6 +1070,8 @@ bool EM_matrix_store::set_persistent(const std::string &name) const
 		BOOST_LOG_TRIVIAL(error) << "The matrix name already exists";
 		return false;
 	}
+	// The data of the matrix may be in the write log of the temporary file.
+	ios->get_factory()->write_back();
 	return holder->set_persistent(name);
 }
 
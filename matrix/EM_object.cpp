@@ -53,6 +53,16 @@ EM_object::file_holder::ptr EM_object::file_holder::create_temp(
 	return holder;
 }
 
+int EM_object::file_holder::get_temp_access_option()
+{
+	// A temporary file doesn't need to survive a restart, so we can
+	// buffer the writes to it in a write log.
+	if (safs::params.is_temp_write_log())
+		return safs::LOG_STRUCTURED_ACCESS;
+	else
+		return safs::REMOTE_ACCESS;
+}
+
 EM_object::file_holder::ptr EM_object::file_holder::create(
 		const std::string &name)
 {
@@ -47,6 +47,10 @@ public:
 		static ptr create_temp(const std::string &name, size_t num_bytes,
 				safs::safs_file_group::ptr group);
 		static ptr create(const std::string &name);
+		/*
+		 * The I/O method of accessing a temporary file.
+		 */
+		static int get_temp_access_option();
 
 		~file_holder();
 		std::string get_name() const {
@@ -71,6 +75,9 @@ public:
 		~io_set();
 
 		safs::io_interface::ptr create_io();
+		safs::file_io_factory::shared_ptr get_factory() const {
+			return factory;
+		}
 		// This returns the I/O instance for the curr thread.
 		safs::io_interface &get_curr_io() const;
 		// Test if the current thread has an I/O instance for the vector.
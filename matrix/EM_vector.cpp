@@ -21,6 +21,8 @@
 #include <malloc.h>
 
 #include <unordered_map>
+#include <deque>
+#include <limits>
 #include <boost/math/common_factor.hpp>
 #include <boost/format.hpp>
 
@@ -28,6 +30,7 @@
 #include "io_request.h"
 #include "io_interface.h"
 #include "in_mem_io.h"
+#include "mem_governor.h"
 
 #include "EM_vector.h"
 #include "matrix_config.h"
@@ -216,7 +219,7 @@ EM_vec_store::EM_vec_store(size_t length, const scalar_type &type): vec_store(
 	// TODO I should provide an SAFS file group.
 	holder = file_holder::create_temp("vec", length * type.get_size(), NULL);
 	safs::file_io_factory::shared_ptr factory = safs::create_io_factory(
-			holder->get_name(), safs::REMOTE_ACCESS);
+			holder->get_name(), file_holder::get_temp_access_option());
 	ios = io_set::ptr(new io_set(factory));
 }
 
@@ -438,7 +441,7 @@ local_vec_store::ptr EM_vec_store::get_portion_async(off_t orig_start,
 
 std::vector<local_vec_store::ptr> EM_vec_store::get_portion_async(
 		const std::vector<std::pair<off_t, size_t> > &locs,
-		portion_compute::ptr compute) const
+		portion_compute::ptr compute, bool no_cache) const
 {
 	size_t entry_size = get_type().get_size();
 	// TODO fix the bug if `locs' aren't aligned with PAGE_SIZE.
@@ -456,6 +459,7 @@ std::vector<local_vec_store::ptr> EM_vec_store::get_portion_async(
 		safs::data_loc_t loc(io.get_file_id(), off);
 		reqs[i] = safs::io_request(buf->get_raw_arr(), loc,
 				buf->get_length() * buf->get_entry_size(), READ);
+		reqs[i].set_no_cache(no_cache);
 		static_cast<portion_callback &>(io.get_callback()).add(reqs[i], compute);
 
 		if (locs[i].first != start || locs[i].second != size)
@@ -557,8 +561,7 @@ namespace EM_sort_detail
 anchor_prio_queue::anchor_prio_queue(
 		const std::vector<local_buf_vec_store::ptr> &anchor_vals,
 		size_t _sort_buf_size, size_t _anchor_gap_size): sort_buf_size(
-			_sort_buf_size), anchor_gap_size(_anchor_gap_size), queue(
-			anchor_ptr_less(anchor_vals.front()->get_type()))
+			_sort_buf_size), anchor_gap_size(_anchor_gap_size)
 {
 	anchor_bufs.resize(anchor_vals.size());
 	for (size_t i = 0; i < anchor_vals.size(); i++) {
@@ -567,8 +570,14 @@ anchor_prio_queue::anchor_prio_queue(
 		anchor.id = i;
 		anchor.curr_off = 0;
 		anchor_bufs[i] = anchor;
-		queue.push(&anchor_bufs[i]);
 	}
+	// The tree refers to `anchor_bufs', so it can't be resized any more.
+	tree = std::unique_ptr<loser_tree<anchor_less> >(
+			new loser_tree<anchor_less>(anchor_bufs.size(),
+				anchor_less(anchor_vals.front()->get_type(), anchor_bufs)));
+	for (size_t i = 0; i < anchor_bufs.size(); i++)
+		tree->set_active(i, anchor_bufs[i].has_anchor());
+	tree->rebuild();
 }
 
 off_t anchor_prio_queue::get_anchor_off(const anchor_struct &anchor) const
@@ -582,15 +591,15 @@ off_t anchor_prio_queue::get_anchor_off(const anchor_struct &anchor) const
  */
 scalar_variable::ptr anchor_prio_queue::get_min_frontier() const
 {
-	if (queue.empty())
+	if (tree->empty())
 		return scalar_variable::ptr();
 	else {
-		local_buf_vec_store::const_ptr local_anchors = queue.top()->local_anchors;
+		const anchor_struct &anchor = anchor_bufs[tree->top()];
+		local_buf_vec_store::const_ptr local_anchors = anchor.local_anchors;
 		const scalar_type &type = local_anchors->get_type();
 		scalar_variable::ptr var = type.create_scalar();
-		assert((size_t) queue.top()->curr_off < local_anchors->get_length());
-		var->set_raw(local_anchors->get(queue.top()->curr_off),
-				type.get_size());
+		assert(anchor.has_anchor());
+		var->set_raw(local_anchors->get(anchor.curr_off), type.get_size());
 		return var;
 	}
 }
@@ -603,19 +612,20 @@ std::vector<off_t> anchor_prio_queue::pop(size_t size)
 {
 	std::vector<off_t> chunks;
 	long remaining_size = size;
-	while (remaining_size > 0 && !queue.empty()) {
-		anchor_struct *anchor = queue.top();
-		assert((size_t) anchor->curr_off < anchor->local_anchors->get_length());
-		off_t off = get_anchor_off(*anchor);
+	while (remaining_size > 0 && !tree->empty()) {
+		anchor_struct &anchor = anchor_bufs[tree->top()];
+		assert(anchor.has_anchor());
+		off_t off = get_anchor_off(anchor);
 		chunks.push_back(off);
 		remaining_size -= anchor_gap_size;
-		queue.pop();
 
-		// If there are still anchors left in the partition, we should
-		// update it and put it back to the priority.
-		anchor->curr_off++;
-		if (anchor->local_anchors->get_length() > (size_t) anchor->curr_off)
-			queue.push(anchor);
+		// If there are still anchors left in the partition, the partition
+		// plays again with its next anchor.
+		anchor.curr_off++;
+		if (anchor.has_anchor())
+			tree->replay();
+		else
+			tree->pop();
 	}
 	return chunks;
 }
@@ -625,24 +635,17 @@ std::vector<off_t> anchor_prio_queue::fetch_all_first()
 	std::vector<off_t> chunks;
 	for (size_t i = 0; i < anchor_bufs.size(); i++) {
 		anchor_struct &anchor = anchor_bufs[i];
-		if (anchor.local_anchors->get_length() > (size_t) anchor.curr_off) {
+		if (anchor.has_anchor()) {
 			off_t off = get_anchor_off(anchor);
 			chunks.push_back(off);
 			anchor.curr_off++;
 		}
+		tree->set_active(i, anchor.has_anchor());
 	}
 
-	// We have change the anchor structs, now we have reconstruct
-	// the priority queue again.
-	queue = anchor_queue_t(anchor_ptr_less(
-				anchor_bufs.front().local_anchors->get_type()));
-	assert(queue.empty());
-	for (size_t i = 0; i < anchor_bufs.size(); i++) {
-		anchor_struct *anchor = &anchor_bufs[i];
-		if (anchor->local_anchors->get_length() > (size_t) anchor->curr_off)
-			queue.push(anchor);
-	}
-
+	// We have changed all anchor structs, so all matches in the tree
+	// have to be replayed.
+	tree->rebuild();
 	return chunks;
 }
 
@@ -778,6 +781,14 @@ class EM_vec_merge_dispatcher: public task_dispatcher
 	anchor_prio_queue::ptr anchors;
 	size_t sort_buf_size;
 	std::vector<seq_writer> writers;
+	// The merges whose data is being read or hasn't been merged.
+	// They are in the order of being issued.
+	std::deque<EM_vec_merge_compute::ptr> merges;
+	size_t max_merges;
+	// The number of elements read from disks in a merge.
+	size_t pop_size;
+	size_t num_issued;
+	bool issued_all;
 public:
 	EM_vec_merge_dispatcher(const std::vector<EM_vec_store::const_ptr> &from_vecs,
 			const std::vector<EM_vec_store::ptr> &to_vecs,
@@ -787,50 +798,44 @@ public:
 		this->prev_leftovers = prev_leftovers;
 	}
 
-	local_buf_vec_store::const_ptr get_prev_leftover(off_t idx) const {
-		return prev_leftovers[idx];
-	}
-
 	seq_writer &get_merge_writer(int idx) {
 		return writers[idx];
 	}
 
-	const anchor_prio_queue &get_anchors() const {
-		return *anchors;
+	void flush_writers() {
+		for (size_t i = 0; i < writers.size(); i++)
+			writers[i].flush_buffer_data(true);
 	}
 
+	/*
+	 * This is invoked when the data of a merge is ready. We run all merges
+	 * whose data is ready in the order that they are issued.
+	 */
+	void merge_ready();
+
 	virtual bool issue_task();
+	virtual bool can_issue() const {
+		return merges.size() < max_merges;
+	}
 };
 
-EM_vec_merge_compute::EM_vec_merge_compute(
-		const std::vector<local_buf_vec_store::ptr> &prev_leftovers,
-		EM_vec_merge_dispatcher &_dispatcher): dispatcher(_dispatcher)
+EM_vec_merge_compute::EM_vec_merge_compute(scalar_variable::ptr min_val,
+		bool last, EM_vec_merge_dispatcher &_dispatcher): dispatcher(_dispatcher)
 {
-	stores.resize(prev_leftovers.size());
-	for (size_t i = 0; i < prev_leftovers.size(); i++) {
-		// If there is a leftover for a vector from the previous merge,
-		// all vectors should have the same number of leftover elements.
-		if (prev_leftovers[0]) {
-			assert(prev_leftovers[i]);
-			assert(prev_leftovers[0]->get_length()
-					== prev_leftovers[i]->get_length());
-		}
-		if (prev_leftovers[i])
-			this->stores[i].push_back(prev_leftovers[i]);
-	}
+	this->min_val = min_val;
+	this->last = last;
 	num_completed = 0;
+	num_expected = 0;
 }
 
 void EM_vec_merge_compute::set_bufs(const std::vector<merge_set_t> &bufs)
 {
-	assert(bufs.size() == stores.size());
+	stores = bufs;
 	num_expected = 0;
 	for (size_t i = 0; i < bufs.size(); i++) {
 		// If all vectors should have the same number of buffers to merge.
 		assert(bufs[0].size() == bufs[i].size());
 		num_expected += bufs[i].size();
-		this->stores[i].insert(this->stores[i].end(), bufs[i].begin(),
-				bufs[i].end());
 	}
 }
 
@@ -848,228 +853,251 @@ EM_vec_merge_dispatcher::EM_vec_merge_dispatcher(
 	for (size_t i = 0; i < to_vecs.size(); i++)
 		writers.emplace_back(to_vecs[i], 0);
 	prev_leftovers.resize(from_vecs.size());
+	max_merges = std::max(matrix_conf.get_sort_pipeline_depth(), 1);
+
+	// The merges ahead of a merge may not have finished when the merge is
+	// issued, so we don't know how much data they leave. After a merge,
+	// there is at most an anchor gap of data left in each run, so we reserve
+	// the space for it in the sort buffer.
+	size_t anchor_gap_size = anchors->get_anchor_gap_size();
+	size_t num_runs = ceil(((double) from_vecs[0]->get_length()) / sort_buf_size);
+	size_t max_leftover = num_runs * anchor_gap_size;
+	if (sort_buf_size > max_leftover)
+		pop_size = sort_buf_size - max_leftover;
+	else {
+		BOOST_LOG_TRIVIAL(info)
+			<< boost::format("leftover (%1%) may be larger than sort buf size (%2%)")
+			% max_leftover % sort_buf_size;
+		pop_size = anchor_gap_size;
+	}
+	num_issued = 0;
+	issued_all = false;
+}
+
+void EM_vec_merge_dispatcher::merge_ready()
+{
+	while (!merges.empty() && merges.front()->is_ready()) {
+		// The merge may be deleted once it's removed from the queue.
+		EM_vec_merge_compute::ptr merge = merges.front();
+		merges.pop_front();
+		merge->merge(prev_leftovers);
+	}
 }
 
 bool EM_vec_merge_dispatcher::issue_task()
 {
 	typedef std::vector<local_buf_vec_store::const_ptr> merge_set_t;
-	size_t leftover = 0;
-	assert(!prev_leftovers.empty());
+	if (issued_all)
+		return false;
+
 	std::vector<off_t> anchor_locs;
 	size_t anchor_gap_size = anchors->get_anchor_gap_size();
-	if (prev_leftovers[0]) {
-		leftover = prev_leftovers[0]->get_length();
-		if (sort_buf_size <= leftover)
-			BOOST_LOG_TRIVIAL(info)
-				<< boost::format("leftover (%1%) is larger than sort buf size (%2%)")
-				% leftover % sort_buf_size;
-		size_t pop_size;
-		if (sort_buf_size > leftover)
-			pop_size = sort_buf_size - leftover;
-		else
-			pop_size = anchor_gap_size;
-		anchor_locs = anchors->pop(pop_size);
-	}
-	else {
+	if (num_issued == 0) {
 		anchor_locs = anchors->fetch_all_first();
 		size_t fetch_size = anchor_locs.size() * anchor_gap_size;
-		if (fetch_size < sort_buf_size) {
-			std::vector<off_t> more_locs = anchors->pop(
-					sort_buf_size - fetch_size);
+		if (fetch_size < pop_size) {
+			std::vector<off_t> more_locs = anchors->pop(pop_size - fetch_size);
 			anchor_locs.insert(anchor_locs.end(), more_locs.begin(),
 					more_locs.end());
 		}
 	}
-	// If there isn't any data to merge and there isn't leftover from
-	// the previous merge.
-	if (anchor_locs.empty() && prev_leftovers[0] == NULL) {
+	else
+		anchor_locs = anchors->pop(pop_size);
+
+	// If there isn't any data to merge, the vector is empty. We still
+	// need to flush the buffered data.
+	if (anchor_locs.empty()) {
 		assert(anchors->get_min_frontier() == NULL);
-		assert(leftover == 0);
-		// If there is nothing left to merge and there isn't leftover, we still
-		// need to flush the buffered data.
-		for (size_t i = 0; i < writers.size(); i++)
-			writers[i].flush_buffer_data(true);
+		assert(merges.empty());
+		flush_writers();
+		issued_all = true;
 		return false;
 	}
-	else {
-		// Merge the anchors.
-		std::vector<std::pair<off_t, size_t> > data_locs;
-		std::sort(anchor_locs.begin(), anchor_locs.end());
-		for (size_t i = 0; i < anchor_locs.size(); i++) {
-			size_t num_eles = std::min(anchor_gap_size,
+
+	// Merge the anchors.
+	std::vector<std::pair<off_t, size_t> > data_locs;
+	std::sort(anchor_locs.begin(), anchor_locs.end());
+	for (size_t i = 0; i < anchor_locs.size(); i++) {
+		size_t num_eles = std::min(anchor_gap_size,
+				from_vecs[0]->get_length() - anchor_locs[i]);
+		size_t off = anchor_locs[i];
+		// If the anchors are contiguous, we merge them.
+		while (i + 1 < anchor_locs.size()
+				&& (size_t) anchor_locs[i + 1] == anchor_locs[i] + anchor_gap_size) {
+			i++;
+			num_eles += std::min(anchor_gap_size,
 					from_vecs[0]->get_length() - anchor_locs[i]);
-			size_t off = anchor_locs[i];
-			// If the anchors are contiguous, we merge them.
-			while (i + 1 < anchor_locs.size()
-					&& (size_t) anchor_locs[i + 1] == anchor_locs[i] + anchor_gap_size) {
-				i++;
-				num_eles += std::min(anchor_gap_size,
-						from_vecs[0]->get_length() - anchor_locs[i]);
-			}
-			data_locs.push_back(std::pair<off_t, size_t>(off, num_eles));
 		}
+		data_locs.push_back(std::pair<off_t, size_t>(off, num_eles));
+	}
 
-		// In this case, we need to read some data from the disks first and then
-		// merge with the data left from the previous merge.
-		if (!data_locs.empty()) {
-			EM_vec_merge_compute *_compute = new EM_vec_merge_compute(
-					prev_leftovers, *this);
-			portion_compute::ptr compute(_compute);
-			std::vector<merge_set_t> merge_sets(from_vecs.size());
-			for (size_t j = 0; j < from_vecs.size(); j++) {
-				std::vector<local_vec_store::ptr> portions
-					= from_vecs[j]->get_portion_async(data_locs, compute);
-				merge_sets[j].insert(merge_sets[j].end(), portions.begin(),
-						portions.end());
-			}
-			_compute->set_bufs(merge_sets);
-		}
-		// In this case, we don't need to read data from disks any more.
-		// We only need to write the data left from the previous merge.
-		else {
-			for (size_t i = 0; i < writers.size(); i++) {
-				if (prev_leftovers[i])
-					writers[i].append(prev_leftovers[i]);
-				// This is the last write. we should flush everything to disks.
-				writers[i].flush_buffer_data(true);
-				// No more leftover.
-				prev_leftovers[i] = NULL;
-			}
-		}
-		return true;
+	// The merge has to know the smallest value that hasn't been read now
+	// because the following merges may be issued before it runs.
+	scalar_variable::ptr min_val = anchors->get_min_frontier();
+	issued_all = min_val == NULL;
+	EM_vec_merge_compute::ptr compute(new EM_vec_merge_compute(min_val,
+				issued_all, *this));
+	merges.push_back(compute);
+	num_issued++;
+	std::vector<merge_set_t> merge_sets(from_vecs.size());
+	// The sorted runs are read only once in the merge.
+	for (size_t j = 0; j < from_vecs.size(); j++) {
+		std::vector<local_vec_store::ptr> portions
+			= from_vecs[j]->get_portion_async(data_locs, compute, true);
+		merge_sets[j].insert(merge_sets[j].end(), portions.begin(),
+				portions.end());
 	}
+	compute->set_bufs(merge_sets);
+	return true;
 }
 
 void EM_vec_merge_compute::run(char *buf, size_t size)
 {
 	num_completed++;
 	// If all data in the buffers is ready, we should merge all the buffers.
-	if (num_completed == num_expected) {
-		assert(stores.size() > 0);
-		merge_set_t &merge_bufs = stores[0];
-		// Find the min values among the last elements in the buffers.
-		const scalar_type &type = merge_bufs.front()->get_type();
-		scalar_variable::ptr min_val
-			= dispatcher.get_anchors().get_min_frontier();
-
-		// Breaks the local buffers into two parts. The first part is to
-		// merge with others; we have to keep the second part for further
-		// merging.
-		std::vector<std::pair<const char *, const char *> > merge_data;
-		std::vector<std::pair<const char *, const char *> > leftovers;
-		std::vector<size_t> merge_sizes(merge_bufs.size());
-		size_t leftover_size = 0;
-		size_t merge_size = 0;
-		local_buf_vec_store::const_ptr prev_leftover
-			= dispatcher.get_prev_leftover(0);
-		agg_operate::const_ptr find_next = type.get_agg_ops().get_find_next();
-		// We go through all the buffers to be merged and merge elements
-		// that are smaller than `min_val' and keep all elements in the `leftover'
-		// buffer, which have been read from the disks but are larger than
-		// `min_val'.
-		for (size_t i = 0; i < merge_bufs.size(); i++) {
-			size_t entry_size = merge_bufs[i]->get_entry_size();
-			const size_t tot_len = merge_bufs[i]->get_length();
-			const char *start = merge_bufs[i]->get_raw_arr();
-			const char *end = merge_bufs[i]->get_raw_arr()
-				+ tot_len * entry_size;
-			off_t leftover_start;
-			if (min_val != NULL) {
-				leftover_start = type.get_stl_algs().lower_bound(
-						start, end, min_val->get_raw());
-				// lower_bound finds the location so that all elements before
-				// the location have values smaller than `min_val'. Actually,
-				// we can also merge all elements whose value is equal to
+	if (num_completed == num_expected)
+		dispatcher.merge_ready();
+}
+
+void EM_vec_merge_compute::merge(
+		const std::vector<local_buf_vec_store::ptr> &prev_leftovers)
+{
+	assert(is_ready());
+	assert(stores.size() > 0);
+	assert(prev_leftovers.size() == stores.size());
+	for (size_t i = 0; i < stores.size(); i++) {
+		// If there is a leftover for a vector from the previous merge,
+		// all vectors should have the same number of leftover elements.
+		if (prev_leftovers[0]) {
+			assert(prev_leftovers[i]);
+			assert(prev_leftovers[0]->get_length()
+					== prev_leftovers[i]->get_length());
+			stores[i].insert(stores[i].begin(), prev_leftovers[i]);
+		}
+	}
+	merge_set_t &merge_bufs = stores[0];
+	// Find the min values among the last elements in the buffers.
+	const scalar_type &type = merge_bufs.front()->get_type();
+
+	// Breaks the local buffers into two parts. The first part is to
+	// merge with others; we have to keep the second part for further
+	// merging.
+	std::vector<std::pair<const char *, const char *> > merge_data;
+	std::vector<std::pair<const char *, const char *> > leftovers;
+	std::vector<size_t> merge_sizes(merge_bufs.size());
+	size_t leftover_size = 0;
+	size_t merge_size = 0;
+	agg_operate::const_ptr find_next = type.get_agg_ops().get_find_next();
+	// We go through all the buffers to be merged and merge elements
+	// that are smaller than `min_val' and keep all elements in the `leftover'
+	// buffer, which have been read from the disks but are larger than
+	// `min_val'.
+	for (size_t i = 0; i < merge_bufs.size(); i++) {
+		size_t entry_size = merge_bufs[i]->get_entry_size();
+		const size_t tot_len = merge_bufs[i]->get_length();
+		const char *start = merge_bufs[i]->get_raw_arr();
+		const char *end = merge_bufs[i]->get_raw_arr()
+			+ tot_len * entry_size;
+		off_t leftover_start;
+		if (min_val != NULL) {
+			leftover_start = type.get_stl_algs().lower_bound(
+					start, end, min_val->get_raw());
+			// lower_bound finds the location so that all elements before
+			// the location have values smaller than `min_val'. Actually,
+			// we can also merge all elements whose value is equal to
+			// `min_val'.
+			if ((size_t) leftover_start < tot_len && min_val->equals(start
+						+ leftover_start * entry_size)) {
+				size_t rel_loc;
+				find_next->runAgg(tot_len - leftover_start,
+						start + leftover_start * entry_size, NULL, &rel_loc);
+				// There is at least one element with the same value as
 				// `min_val'.
-				if ((size_t) leftover_start < tot_len && min_val->equals(start
-							+ leftover_start * entry_size)) {
-					size_t rel_loc;
-					find_next->runAgg(tot_len - leftover_start,
-							start + leftover_start * entry_size, NULL, &rel_loc);
-					// There is at least one element with the same value as
-					// `min_val'.
-					assert(rel_loc > 0 && rel_loc <= tot_len - leftover_start);
-					leftover_start += rel_loc;
-				}
-				assert((size_t) leftover_start <= tot_len);
+				assert(rel_loc > 0 && rel_loc <= tot_len - leftover_start);
+				leftover_start += rel_loc;
 			}
-			else
-				leftover_start = tot_len;
 			assert((size_t) leftover_start <= tot_len);
-			merge_sizes[i] = leftover_start;
-			merge_size += leftover_start;
-			leftover_size += (tot_len - leftover_start);
+		}
+		else
+			leftover_start = tot_len;
+		assert((size_t) leftover_start <= tot_len);
+		merge_sizes[i] = leftover_start;
+		merge_size += leftover_start;
+		leftover_size += (tot_len - leftover_start);
+		if (leftover_start > 0)
+			merge_data.push_back(std::pair<const char *, const char *>(
+						merge_bufs[i]->get(0),
+						merge_bufs[i]->get(leftover_start)));
+		if (tot_len - leftover_start)
+			leftovers.push_back(std::pair<const char *, const char *>(
+						merge_bufs[i]->get(leftover_start),
+						merge_bufs[i]->get(tot_len)));
+	}
+
+	// Here we rely on OpenMP to merge the data in the buffer in parallel.
+	local_buf_vec_store::ptr merge_res(new local_buf_vec_store(-1,
+				merge_size, type, -1));
+	std::vector<std::pair<int, off_t> > merge_index(merge_size);
+	type.get_sorter().merge_with_index(merge_data,
+			merge_res->get_raw_arr(), merge_size, merge_index);
+	// Write the merge result to disks.
+	dispatcher.get_merge_writer(0).append(merge_res);
+	merge_res = NULL;
+
+	std::vector<std::pair<int, off_t> > leftover_merge_index(leftover_size);
+	std::vector<local_buf_vec_store::ptr> leftover_bufs(stores.size());
+	if (leftover_size > 0) {
+		// Keep the leftover and merge them into a single buffer.
+		local_buf_vec_store::ptr leftover_buf = local_buf_vec_store::ptr(
+				new local_buf_vec_store(-1, leftover_size, type, -1));
+		type.get_sorter().merge_with_index(leftovers,
+				leftover_buf->get_raw_arr(), leftover_size,
+				leftover_merge_index);
+		leftover_bufs[0] = leftover_buf;
+	}
+
+	// Merge the remaining vectors accordingly.
+	for (size_t i = 1; i < stores.size(); i++) {
+		std::vector<std::pair<const char *, const char *> > merge_data;
+		std::vector<std::pair<const char *, const char *> > leftovers;
+
+		merge_set_t &set = stores[i];
+		assert(set.size() == merge_bufs.size());
+		for (size_t i = 0; i < set.size(); i++) {
+			off_t leftover_start = merge_sizes[i];
+			assert(set[i]->get_length() == merge_bufs[i]->get_length());
 			if (leftover_start > 0)
 				merge_data.push_back(std::pair<const char *, const char *>(
-							merge_bufs[i]->get(0),
-							merge_bufs[i]->get(leftover_start)));
-			if (tot_len - leftover_start)
+							set[i]->get(0), set[i]->get(leftover_start)));
+			if (set[i]->get_length() - leftover_start)
 				leftovers.push_back(std::pair<const char *, const char *>(
-							merge_bufs[i]->get(leftover_start),
-							merge_bufs[i]->get(tot_len)));
+							set[i]->get(leftover_start),
+							set[i]->get(set[i]->get_length())));
 		}
 
-		// Here we rely on OpenMP to merge the data in the buffer in parallel.
-		local_buf_vec_store::ptr merge_res(new local_buf_vec_store(-1,
+		// Merge the part that can be merged.
+		const scalar_type &type = set.front()->get_type();
+		merge_res = local_buf_vec_store::ptr(new local_buf_vec_store(-1,
 					merge_size, type, -1));
-		std::vector<std::pair<int, off_t> > merge_index(merge_size);
-		type.get_sorter().merge_with_index(merge_data,
-				merge_res->get_raw_arr(), merge_size, merge_index);
-		// Write the merge result to disks.
-		dispatcher.get_merge_writer(0).append(merge_res);
-		merge_res = NULL;
-
-		std::vector<std::pair<int, off_t> > leftover_merge_index(leftover_size);
-		std::vector<local_buf_vec_store::ptr> leftover_bufs(stores.size());
+		type.get_sorter().merge(merge_data, merge_index,
+				merge_res->get_raw_arr(), merge_size);
+		dispatcher.get_merge_writer(i).append(merge_res);
+
 		if (leftover_size > 0) {
 			// Keep the leftover and merge them into a single buffer.
 			local_buf_vec_store::ptr leftover_buf = local_buf_vec_store::ptr(
 					new local_buf_vec_store(-1, leftover_size, type, -1));
-			type.get_sorter().merge_with_index(leftovers,
-					leftover_buf->get_raw_arr(), leftover_size,
-					leftover_merge_index);
-			leftover_bufs[0] = leftover_buf;
-		}
-
-		// Merge the remaining vectors accordingly.
-		for (size_t i = 1; i < stores.size(); i++) {
-			std::vector<std::pair<const char *, const char *> > merge_data;
-			std::vector<std::pair<const char *, const char *> > leftovers;
-
-			merge_set_t &set = stores[i];
-			assert(set.size() == merge_bufs.size());
-			for (size_t i = 0; i < set.size(); i++) {
-				off_t leftover_start = merge_sizes[i];
-				assert(set[i]->get_length() == merge_bufs[i]->get_length());
-				if (leftover_start > 0)
-					merge_data.push_back(std::pair<const char *, const char *>(
-								set[i]->get(0), set[i]->get(leftover_start)));
-				if (set[i]->get_length() - leftover_start)
-					leftovers.push_back(std::pair<const char *, const char *>(
-								set[i]->get(leftover_start),
-								set[i]->get(set[i]->get_length())));
-			}
-
-			// Merge the part that can be merged.
-			const scalar_type &type = set.front()->get_type();
-			merge_res = local_buf_vec_store::ptr(new local_buf_vec_store(-1,
-						merge_size, type, -1));
-			type.get_sorter().merge(merge_data, merge_index,
-					merge_res->get_raw_arr(), merge_size);
-			dispatcher.get_merge_writer(i).append(merge_res);
-
-			if (leftover_size > 0) {
-				// Keep the leftover and merge them into a single buffer.
-				local_buf_vec_store::ptr leftover_buf = local_buf_vec_store::ptr(
-						new local_buf_vec_store(-1, leftover_size, type, -1));
-				type.get_sorter().merge(leftovers, leftover_merge_index,
-						leftover_buf->get_raw_arr(), leftover_size);
-				leftover_bufs[i] = leftover_buf;
-			}
+			type.get_sorter().merge(leftovers, leftover_merge_index,
+					leftover_buf->get_raw_arr(), leftover_size);
+			leftover_bufs[i] = leftover_buf;
 		}
-
-		dispatcher.set_prev_leftovers(leftover_bufs);
 	}
+
+	dispatcher.set_prev_leftovers(leftover_bufs);
+	// Nothing is left after the last merge, so we should flush everything
+	// to disks.
+	if (last)
+		dispatcher.flush_writers();
 }
 
 /*
@@ -1175,13 +1203,18 @@ std::vector<EM_vec_store::ptr> sort(
 	size_t anchor_gap_size = sizes.second;
 	printf("sort buf size: %ld, anchor gap size: %ld\n", sort_buf_size,
 			anchor_gap_size);
+	size_t tot_entry_size = 0;
 	for (size_t i = 0; i < vecs.size(); i++) {
 		size_t num_sort_bufs
 			= ceil(((double) vecs[i]->get_length()) / sort_buf_size);
 		// We have to make sure the sort buffer can contain a anchor portion
 		// from each partially sorted buffer.
 		assert(num_sort_bufs * anchor_gap_size <= sort_buf_size);
+		tot_entry_size += vecs[i]->get_type().get_size();
 	}
+	// The page cache may need to give memory to the sort buffers in flight.
+	safs::mem_grant sort_mem("sort buffers", sort_buf_size * tot_entry_size
+			* matrix_conf.get_sort_pipeline_depth());
 
 	/*
 	 * Divide the vector into multiple large parts and sort each part in parallel.
@@ -1193,7 +1226,11 @@ std::vector<EM_vec_store::ptr> sort(
 	EM_sort_detail::EM_vec_sort_dispatcher::ptr sort_dispatcher(
 			new EM_sort_detail::EM_vec_sort_dispatcher(vecs, tmp_vecs,
 				sort_buf_size, anchor_gap_size));
-	io_worker_task sort_worker(sort_dispatcher, 1);
+	// Each sort buffer in flight has a read and a write for each vector.
+	// While a buffer is being sorted, the following buffers are being read
+	// and the previous buffers are being written.
+	io_worker_task sort_worker(sort_dispatcher,
+			2 * matrix_conf.get_sort_pipeline_depth() * vecs.size());
 	for (size_t i = 0; i < vecs.size(); i++) {
 		sort_worker.register_EM_obj(const_cast<EM_vec_store *>(vecs[i].get()));
 		sort_worker.register_EM_obj(tmp_vecs[i].get());
@@ -1202,7 +1239,8 @@ std::vector<EM_vec_store::ptr> sort(
 
 	/* Merge all parts.
 	 * Here we assume that one level of merging is enough and we rely on
-	 * OpenMP to parallelize merging.
+	 * OpenMP to parallelize merging. The data of the following merges is
+	 * read while a merge runs.
 	 */
 	std::vector<EM_vec_store::ptr> out_vecs(vecs.size());
 	for (size_t i = 0; i < vecs.size(); i++)
@@ -1214,8 +1252,9 @@ std::vector<EM_vec_store::ptr> sort(
 			new EM_sort_detail::EM_vec_merge_dispatcher(tmp_vecs1, out_vecs,
 				sort_dispatcher->get_sort_summary().get_prio_queue(),
 				sort_buf_size));
-	// TODO let's not use asynchornous I/O for now.
-	io_worker_task merge_worker(merge_dispatcher, 0);
+	// The merge dispatcher limits the number of merges in flight.
+	io_worker_task merge_worker(merge_dispatcher,
+			std::numeric_limits<int>::max());
 	for (size_t i = 0; i < vecs.size(); i++) {
 		merge_worker.register_EM_obj(tmp_vecs[i].get());
 		merge_worker.register_EM_obj(out_vecs[i].get());
@@ -1236,6 +1275,8 @@ void EM_vec_store::sort()
 	// We have to make sure the sort buffer can contain a anchor portion
 	// from each partially sorted buffer.
 	assert(num_sort_bufs * anchor_gap_size <= sort_buf_size);
+	safs::mem_grant sort_mem("sort buffers", sort_buf_size
+			* get_type().get_size() * matrix_conf.get_sort_pipeline_depth());
 
 	/*
 	 * Divide the vector into multiple large parts and sort each part in parallel.
@@ -1247,13 +1288,15 @@ void EM_vec_store::sort()
 	EM_sort_detail::EM_vec_sort_dispatcher::ptr sort_dispatcher(
 			new EM_sort_detail::EM_vec_sort_dispatcher(in_vecs, out_vecs,
 				sort_buf_size, anchor_gap_size));
-	io_worker_task sort_worker(sort_dispatcher, 1);
+	io_worker_task sort_worker(sort_dispatcher,
+			2 * matrix_conf.get_sort_pipeline_depth());
 	sort_worker.register_EM_obj(this);
 	sort_worker.run();
 
 	/* Merge all parts.
 	 * Here we assume that one level of merging is enough and we rely on
-	 * OpenMP to parallelize merging.
+	 * OpenMP to parallelize merging. The data of the following merges is
+	 * read while a merge runs.
 	 */
 	EM_vec_store::ptr tmp = EM_vec_store::create(get_length(), get_type());
 	in_vecs[0] = EM_vec_store::const_ptr(this, empty_free());
@@ -1262,8 +1305,9 @@ void EM_vec_store::sort()
 			new EM_sort_detail::EM_vec_merge_dispatcher(in_vecs, out_vecs,
 				sort_dispatcher->get_sort_summary().get_prio_queue(),
 				sort_buf_size));
-	// TODO let's not use asynchornous I/O for now.
-	io_worker_task merge_worker(merge_dispatcher, 0);
+	// The merge dispatcher limits the number of merges in flight.
+	io_worker_task merge_worker(merge_dispatcher,
+			std::numeric_limits<int>::max());
 	merge_worker.register_EM_obj(this);
 	merge_worker.register_EM_obj(tmp.get());
 	merge_worker.run();
@@ -1461,6 +1505,8 @@ matrix_store::ptr EM_vec_store::conv2mat(size_t nrow, size_t ncol,
 
 bool EM_vec_store::set_persistent(const std::string &name)
 {
+	// The data of the vector may be in the write log of the temporary file.
+	ios->get_factory()->write_back();
 	if (!holder->set_persistent(name))
 		return false;
 	// TODO we have to make sure no other threads are accessing the data
@@ -30,6 +30,7 @@
 #include "local_vec_store.h"
 #include "mem_worker_thread.h"
 #include "EM_object.h"
+#include "loser_tree.h"
 
 namespace fm
 {
@@ -108,9 +109,14 @@ public:
 	 */
 	virtual local_vec_store::ptr get_portion_async(off_t start,
 			size_t size, portion_compute::ptr compute) const;
+	/*
+	 * If `no_cache' is true, the page cache is told that the portions are
+	 * read in a one-pass scan, so they don't evict the pages that are
+	 * accessed more frequently. It only takes effect with cache admission.
+	 */
 	virtual std::vector<local_vec_store::ptr> get_portion_async(
 			const std::vector<std::pair<off_t, size_t> > &locs,
-			portion_compute::ptr compute) const;
+			portion_compute::ptr compute, bool no_cache = false) const;
 	/*
 	 * Write the data in the local buffer to some portion in the vector.
 	 * The location is indicated in the local buffer. However, a user
@@ -140,6 +146,9 @@ namespace EM_sort_detail
 
 /*
  * This priority queue helps to sort data in the ascending order.
+ * There is an entry for each sorted run and the entry points to the next
+ * anchor in the run. The anchors of a run are sorted, so the runs are
+ * selected with a loser tree.
  */
 class anchor_prio_queue
 {
@@ -148,20 +157,28 @@ class anchor_prio_queue
 		local_buf_vec_store::const_ptr local_anchors;
 		int id;
 		off_t curr_off;
+
+		bool has_anchor() const {
+			return local_anchors->get_length() > (size_t) curr_off;
+		}
 	};
 
-	class anchor_ptr_less {
+	class anchor_less {
 		const bulk_operate *gt;
+		const std::vector<anchor_struct> *anchors;
 	public:
-		anchor_ptr_less(const scalar_type &type) {
-			gt = type.get_basic_ops().get_op(basic_ops::op_idx::GT);;
+		anchor_less(const scalar_type &type,
+				const std::vector<anchor_struct> &anchors) {
+			gt = type.get_basic_ops().get_op(basic_ops::op_idx::GT);
+			this->anchors = &anchors;
 		}
 
-		bool operator()(const anchor_struct *anchor1,
-				const anchor_struct *anchor2) const {
+		bool operator()(int idx1, int idx2) const {
+			const anchor_struct &anchor1 = (*anchors)[idx1];
+			const anchor_struct &anchor2 = (*anchors)[idx2];
 			bool ret;
-			gt->runAA(1, anchor1->local_anchors->get(anchor1->curr_off),
-					anchor2->local_anchors->get(anchor2->curr_off), &ret);
+			gt->runAA(1, anchor2.local_anchors->get(anchor2.curr_off),
+					anchor1.local_anchors->get(anchor1.curr_off), &ret);
 			return ret;
 		}
 	};
@@ -169,9 +186,7 @@ class anchor_prio_queue
 	const size_t sort_buf_size;
 	const size_t anchor_gap_size;
 	std::vector<anchor_struct> anchor_bufs;
-	typedef std::priority_queue<anchor_struct *, std::vector<anchor_struct *>,
-			anchor_ptr_less> anchor_queue_t;
-	anchor_queue_t queue;
+	std::unique_ptr<loser_tree<anchor_less> > tree;
 
 	off_t get_anchor_off(const anchor_struct &anchor) const;
 public:
@@ -250,6 +265,9 @@ class EM_vec_merge_dispatcher;
 
 /*
  * This class merges data read from disks and writes it back to disks.
+ * The data of multiple merges can be read at the same time, but
+ * the merges have to run in the order that they are issued because
+ * a merge takes the leftover of the previous merge.
  */
 class EM_vec_merge_compute: public portion_compute
 {
@@ -259,17 +277,30 @@ class EM_vec_merge_compute: public portion_compute
 	typedef std::vector<local_buf_vec_store::const_ptr> merge_set_t;
 	std::vector<merge_set_t> stores;
 	EM_vec_merge_dispatcher &dispatcher;
+	// The minimal value among the data that hasn't been read when
+	// the merge is issued. Only the elements not larger than it can be
+	// merged.
+	scalar_variable::ptr min_val;
 	size_t num_completed;
-	// It's not the same as the number of local buffers in `stores' because
-	// `stores' may contain the buffer with the leftdata from the previous
-	// merge.
+	// The number of local buffers to be read from disks.
 	size_t num_expected;
+	// Indicate whether this is the last merge.
+	bool last;
 public:
-	EM_vec_merge_compute(
-			const std::vector<local_buf_vec_store::ptr> &prev_leftovers,
+	typedef std::shared_ptr<EM_vec_merge_compute> ptr;
+
+	EM_vec_merge_compute(scalar_variable::ptr min_val, bool last,
 			EM_vec_merge_dispatcher &_dispatcher);
 	virtual void run(char *buf, size_t size);
 	void set_bufs(const std::vector<merge_set_t> &bufs);
+
+	bool is_ready() const {
+		return num_completed == num_expected;
+	}
+	/*
+	 * Merge the data with the leftover of the previous merge.
+	 */
+	void merge(const std::vector<local_buf_vec_store::ptr> &prev_leftovers);
 };
 
 /*
@@ -25,8 +25,10 @@
 #include <memory>
 #include <vector>
 #include <cmath>
+#include <type_traits>
 
 #include "generic_type.h"
+#include "simd_kernels.h"
 
 namespace fm
 {
@@ -228,6 +230,152 @@ public:
 	}
 };
 
+/*
+ * The types that have vectorized kernels.
+ */
+template<class T>
+struct simd_type
+{
+	static const bool value = false;
+};
+
+template<>
+struct simd_type<int>
+{
+	static const bool value = true;
+};
+
+template<>
+struct simd_type<long>
+{
+	static const bool value = true;
+};
+
+template<>
+struct simd_type<size_t>
+{
+	static const bool value = true;
+};
+
+template<>
+struct simd_type<float>
+{
+	static const bool value = true;
+};
+
+template<>
+struct simd_type<double>
+{
+	static const bool value = true;
+};
+
+template<class T, bool supported = simd_type<T>::value>
+struct simd_kernel_getter
+{
+	static const simd::kernels<T> *get() {
+		return NULL;
+	}
+};
+
+template<class T>
+struct simd_kernel_getter<T, true>
+{
+	static const simd::kernels<T> *get() {
+		return simd::get_kernels<T>();
+	}
+};
+
+/*
+ * This implements a basic binary operator with the vectorized kernels
+ * when the inputs and the output have the same type and the CPU supports
+ * the kernels. Otherwise, it falls back to bulk_operate_impl.
+ */
+template<class OpType, simd::op_kind kind, class LeftType, class RightType,
+	class ResType>
+class simd_bulk_operate_impl: public bulk_operate_impl<OpType, LeftType,
+	RightType, ResType>
+{
+	typedef bulk_operate_impl<OpType, LeftType, RightType, ResType> base_op;
+
+	static const simd::kernels<ResType> *get_kernels() {
+		if (!std::is_same<LeftType, ResType>::value
+				|| !std::is_same<RightType, ResType>::value)
+			return NULL;
+		return simd_kernel_getter<ResType>::get();
+	}
+public:
+	virtual void runAA(size_t num_eles, const void *left_arr,
+			const void *right_arr, void *output_arr) const {
+		const simd::kernels<ResType> *ks = get_kernels();
+		if (ks && ks->runAA[kind])
+			ks->runAA[kind](num_eles, (const ResType *) left_arr,
+					(const ResType *) right_arr, (ResType *) output_arr);
+		else
+			base_op::runAA(num_eles, left_arr, right_arr, output_arr);
+	}
+
+	virtual void runAE(size_t num_eles, const void *left_arr,
+			const void *right, void *output_arr) const {
+		const simd::kernels<ResType> *ks = get_kernels();
+		if (ks && ks->runAE[kind])
+			ks->runAE[kind](num_eles, (const ResType *) left_arr,
+					*(const ResType *) right, (ResType *) output_arr);
+		else
+			base_op::runAE(num_eles, left_arr, right, output_arr);
+	}
+
+	virtual void runEA(size_t num_eles, const void *left,
+			const void *right_arr, void *output_arr) const {
+		const simd::kernels<ResType> *ks = get_kernels();
+		if (ks && ks->runEA[kind])
+			ks->runEA[kind](num_eles, *(const ResType *) left,
+					(const ResType *) right_arr, (ResType *) output_arr);
+		else
+			base_op::runEA(num_eles, left, right_arr, output_arr);
+	}
+
+	virtual void runAgg(size_t num_eles, const void *left_arr1,
+			const void *orig, void *output) const {
+		const simd::kernels<ResType> *ks = get_kernels();
+		if (ks == NULL || ks->agg[kind] == NULL) {
+			base_op::runAgg(num_eles, left_arr1, orig, output);
+			return;
+		}
+
+		const ResType *left_arr = (const ResType *) left_arr1;
+		if (num_eles == 0)
+			return;
+		if (orig)
+			*(ResType *) output = ks->agg[kind](num_eles, left_arr,
+					*(const ResType *) orig);
+		else
+			*(ResType *) output = ks->agg[kind](num_eles - 1, left_arr + 1,
+					left_arr[0]);
+	}
+};
+
+/*
+ * The unary version of simd_bulk_operate_impl.
+ */
+template<class OpType, simd::uop_kind kind, class InType, class OutType>
+class simd_bulk_uoperate_impl: public bulk_uoperate_impl<OpType, InType,
+	OutType>
+{
+	typedef bulk_uoperate_impl<OpType, InType, OutType> base_op;
+public:
+	virtual void runA(size_t num_eles, const void *in_arr,
+			void *output_arr) const {
+		const simd::kernels<OutType> *ks = NULL;
+		if (std::is_same<InType, OutType>::value)
+			ks = simd_kernel_getter<OutType>::get();
+		if (ks && ks->uop[kind])
+			ks->uop[kind](num_eles, (const OutType *) in_arr,
+					(OutType *) output_arr);
+		else
+			base_op::runA(num_eles, in_arr, output_arr);
+	}
+};
+
 /*
  * This interface defines a collection of basic unary operators.
  */
@@ -359,11 +507,11 @@ class basic_uops_impl: public basic_uops
 		}
 	};
 
-	bulk_uoperate_impl<uop_neg, InType, OutType> neg_op;
+	simd_bulk_uoperate_impl<uop_neg, simd::NEG, InType, OutType> neg_op;
 	bulk_uoperate_impl<uop_sqrt, InType, double> sqrt_op;
-	bulk_uoperate_impl<uop_abs, InType, OutType> abs_op;
+	simd_bulk_uoperate_impl<uop_abs, simd::ABS, InType, OutType> abs_op;
 	bulk_uoperate_impl<uop_not, bool, bool> not_op;
-	bulk_uoperate_impl<sq, InType, OutType> sq_op;
+	simd_bulk_uoperate_impl<sq, simd::SQ, InType, OutType> sq_op;
 	bulk_uoperate_impl<ceil, InType, OutType> ceil_op;
 	bulk_uoperate_impl<floor, InType, OutType> floor_op;
 	bulk_uoperate_impl<round, InType, OutType> round_op;
@@ -575,13 +723,13 @@ class basic_ops_impl: public basic_ops
 		}
 	};
 
-	bulk_operate_impl<add, LeftType, RightType, ResType> add_op;
-	bulk_operate_impl<sub, LeftType, RightType, ResType> sub_op;
-	bulk_operate_impl<multiply<LeftType, RightType, ResType>,
+	simd_bulk_operate_impl<add, simd::ADD, LeftType, RightType, ResType> add_op;
+	simd_bulk_operate_impl<sub, simd::SUB, LeftType, RightType, ResType> sub_op;
+	simd_bulk_operate_impl<multiply<LeftType, RightType, ResType>, simd::MUL,
 		LeftType, RightType, ResType> mul_op;
 	bulk_operate_impl<divide, LeftType, RightType, double> div_op;
-	bulk_operate_impl<min, LeftType, RightType, ResType> min_op;
-	bulk_operate_impl<max, LeftType, RightType, ResType> max_op;
+	simd_bulk_operate_impl<min, simd::MIN, LeftType, RightType, ResType> min_op;
+	simd_bulk_operate_impl<max, simd::MAX, LeftType, RightType, ResType> max_op;
 	bulk_operate_impl<pow, LeftType, RightType, ResType> pow_op;
 	bulk_operate_impl<eq, LeftType, RightType, bool> eq_op;
 	bulk_operate_impl<gt, LeftType, RightType, bool> gt_op;
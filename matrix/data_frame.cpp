@@ -20,6 +20,7 @@
 #include <boost/format.hpp>
 
 #include "log.h"
+#include "mem_governor.h"
 
 #include "matrix_config.h"
 #include "data_frame.h"
@@ -512,6 +513,11 @@ static vector_vector::ptr EM_groupby(
 			break;
 		}
 
+	size_t row_size = 0;
+	for (size_t i = 0; i < sorted_df->get_num_vecs(); i++)
+		row_size += sorted_df->get_vec_ref(i).get_entry_size();
+	safs::mem_grant groupby_mem("groupby buffers", portion_size * row_size);
+
 	EM_df_groupby_dispatcher::ptr groupby_dispatcher(
 			new EM_df_groupby_dispatcher(sorted_df, col_name, out_vv,
 				portion_size, op));
@@ -87,7 +87,18 @@ void matrix_stats_t::print_diff(const matrix_stats_t &orig) const
 		BOOST_LOG_TRIVIAL(info) << "multiply "
 			<< (this->double_multiplies - orig.double_multiplies)
 			<< " double float points";
+	if (this->shared_portion_hits != orig.shared_portion_hits)
+		BOOST_LOG_TRIVIAL(info) << "reuse "
+			<< (this->shared_portion_hits - orig.shared_portion_hits)
+			<< " portions of shared virtual matrices";
 #endif
+	if (this->rpart_bytes != orig.rpart_bytes) {
+		size_t orig_bytes = this->rpart_bytes - orig.rpart_bytes;
+		size_t packed_bytes = this->packed_rpart_bytes - orig.packed_rpart_bytes;
+		BOOST_LOG_TRIVIAL(info) << "pack row parts of sparse blocks from "
+			<< orig_bytes << " bytes to " << packed_bytes << " bytes (ratio: "
+			<< ((double) orig_bytes) / packed_bytes << ")";
+	}
 }
 
 }
@@ -737,6 +748,320 @@ dense_matrix::ptr dense_matrix::multiply(const dense_matrix &mat,
 namespace
 {
 
+/*
+ * Compute R in the QR factorization of a column-major matrix with
+ * Householder reflections. On return, the upper triangle of the first
+ * `ncol' rows stores R and the rest of the matrix is garbage.
+ */
+void householder_R(double *A, size_t nrow, size_t ncol)
+{
+	size_t num_steps = std::min(nrow, ncol);
+	std::vector<double> w(ncol);
+	for (size_t k = 0; k < num_steps; k++) {
+		double *col = A + k * nrow + k;
+		size_t len = nrow - k;
+		double norm = cblas_dnrm2(len, col, 1);
+		if (norm == 0)
+			continue;
+		double alpha = col[0] > 0 ? -norm : norm;
+		// The reflector is v = x - alpha * e1, scaled so that v[0] = 1.
+		double v0 = col[0] - alpha;
+		for (size_t i = 1; i < len; i++)
+			col[i] /= v0;
+		col[0] = 1;
+		double tau = -v0 / alpha;
+		size_t num_rest = ncol - k - 1;
+		if (num_rest > 0) {
+			double *rest = col + nrow;
+			// w = A[k:, k+1:]^T * v; A[k:, k+1:] -= tau * v * w^T
+			cblas_dgemv(CblasColMajor, CblasTrans, len, num_rest, 1, rest,
+					nrow, col, 1, 0, w.data(), 1);
+			cblas_dger(CblasColMajor, len, num_rest, -tau, col, 1, w.data(), 1,
+					rest, nrow);
+		}
+		col[0] = alpha;
+		for (size_t i = 1; i < len; i++)
+			col[i] = 0;
+	}
+	for (size_t j = 0; j < ncol; j++)
+		for (size_t i = j + 1; i < std::min(nrow, ncol); i++)
+			A[j * nrow + i] = 0;
+}
+
+/*
+ * The partial R of the rows processed by a thread. The matrix is
+ * column-major and has (ncol + max #rows in a portion) rows. R is kept
+ * in the first ncol rows, and a new portion is copied below R, so R is
+ * updated with a single QR factorization.
+ */
+struct tsqr_buf
+{
+	std::vector<double> data;
+	size_t nrow;
+	size_t ncol;
+	bool valid;
+
+	tsqr_buf() {
+		nrow = 0;
+		ncol = 0;
+		valid = false;
+	}
+
+	void init(size_t nrow, size_t ncol) {
+		data.resize(nrow * ncol);
+		this->nrow = nrow;
+		this->ncol = ncol;
+		valid = true;
+	}
+
+	double get_R(size_t i, size_t j) const {
+		return data[j * nrow + i];
+	}
+	void set_R(size_t i, size_t j, double v) {
+		data[j * nrow + i] = v;
+	}
+};
+
+/*
+ * Combine two partial Rs: R1 = R of [R1; R2].
+ */
+void merge_R(tsqr_buf &buf1, const tsqr_buf &buf2)
+{
+	if (!buf2.valid)
+		return;
+	size_t ncol = buf2.ncol;
+	if (!buf1.valid)
+		buf1.init(2 * ncol, ncol);
+	std::vector<double> stacked(2 * ncol * ncol);
+	for (size_t j = 0; j < ncol; j++)
+		for (size_t i = 0; i <= j; i++) {
+			stacked[j * 2 * ncol + i] = buf1.get_R(i, j);
+			stacked[j * 2 * ncol + ncol + i] = buf2.get_R(i, j);
+		}
+	householder_R(stacked.data(), 2 * ncol, ncol);
+	for (size_t j = 0; j < ncol; j++)
+		for (size_t i = 0; i < ncol; i++)
+			buf1.set_R(i, j, stacked[j * 2 * ncol + i]);
+}
+
+/*
+ * Reduce the partial Rs in the range with a binary tree.
+ * The result is stored in the first buffer.
+ */
+void reduce_R(std::vector<tsqr_buf> &bufs, size_t start, size_t end)
+{
+	for (size_t step = 1; start + step < end; step *= 2)
+		for (size_t i = start; i + step < end; i += 2 * step)
+			merge_R(bufs[i], bufs[i + step]);
+}
+
+class tsqr_op: public detail::portion_mapply_op
+{
+	std::vector<detail::local_matrix_store::ptr> in_bufs;
+	std::vector<tsqr_buf> &R_bufs;
+public:
+	tsqr_op(size_t num_threads, std::vector<tsqr_buf> &bufs): detail::portion_mapply_op(
+				0, 0, get_scalar_type<double>()), R_bufs(bufs) {
+		in_bufs.resize(num_threads);
+	}
+
+	virtual void run(
+			const std::vector<detail::local_matrix_store::const_ptr> &ins) const;
+
+	virtual detail::portion_mapply_op::const_ptr transpose() const {
+		assert(0);
+		return detail::portion_mapply_op::const_ptr();
+	}
+
+	virtual std::string to_string(
+			const std::vector<detail::matrix_store::const_ptr> &mats) const {
+		assert(mats.size() == 1);
+		return std::string("qr(") + mats[0]->get_name() + ")";
+	}
+};
+
+void tsqr_op::run(
+		const std::vector<detail::local_matrix_store::const_ptr> &ins) const
+{
+	assert(ins.size() == 1);
+	int thread_id = detail::mem_thread_pool::get_curr_thread_id();
+	detail::local_matrix_store::const_ptr in = ins[0];
+	const double *arr = (const double *) in->get_raw_arr();
+	if (arr == NULL || in->store_layout() != matrix_layout_t::L_COL) {
+		if (in_bufs[thread_id] == NULL
+				|| in->get_num_rows() != in_bufs[thread_id]->get_num_rows()
+				|| in->get_num_cols() != in_bufs[thread_id]->get_num_cols())
+			const_cast<tsqr_op *>(this)->in_bufs[thread_id]
+				= detail::local_matrix_store::ptr(
+						new detail::local_buf_col_matrix_store(0, 0,
+							in->get_num_rows(), in->get_num_cols(),
+							in->get_type(), -1));
+		in_bufs[thread_id]->copy_from(*in);
+		arr = (const double *) in_bufs[thread_id]->get_raw_arr();
+	}
+
+	size_t ncol = in->get_num_cols();
+	size_t nrow = ncol + in->get_num_rows();
+	tsqr_buf &buf = R_bufs[thread_id];
+	// The R of the previous portions is kept in the first ncol rows.
+	if (!buf.valid || buf.nrow != nrow) {
+		std::vector<double> R(ncol * ncol);
+		for (size_t j = 0; j < ncol && buf.valid; j++)
+			for (size_t i = 0; i <= j; i++)
+				R[j * ncol + i] = buf.get_R(i, j);
+		buf.init(nrow, ncol);
+		for (size_t j = 0; j < ncol; j++)
+			memcpy(&buf.data[j * nrow], &R[j * ncol], sizeof(double) * ncol);
+	}
+	for (size_t j = 0; j < ncol; j++)
+		memcpy(&buf.data[j * nrow + ncol], arr + j * in->get_num_rows(),
+				sizeof(double) * in->get_num_rows());
+	householder_R(buf.data.data(), nrow, ncol);
+}
+
+/*
+ * This reduces the partial Rs of the threads in a NUMA node.
+ */
+class tsqr_reduce_task: public thread_task
+{
+	std::vector<tsqr_buf> &bufs;
+	size_t start;
+	size_t end;
+public:
+	tsqr_reduce_task(std::vector<tsqr_buf> &_bufs, size_t start,
+			size_t end): bufs(_bufs) {
+		this->start = start;
+		this->end = end;
+	}
+
+	void run() {
+		reduce_R(bufs, start, end);
+	}
+};
+
+/*
+ * If the estimated condition number of R is larger than this, Q = A * R^-1
+ * loses too much orthogonality and we orthogonalize Q again.
+ */
+const double QR_REORTH_COND = 1e4;
+
+/*
+ * The 1-norm of a square matrix.
+ */
+double norm1(const detail::mem_col_matrix_store &mat)
+{
+	double ret = 0;
+	for (size_t j = 0; j < mat.get_num_cols(); j++) {
+		double sum = 0;
+		for (size_t i = 0; i < mat.get_num_rows(); i++)
+			sum += fabs(*(const double *) mat.get(i, j));
+		ret = std::max(ret, sum);
+	}
+	return ret;
+}
+
+}
+
+dense_matrix::ptr dense_matrix::qr(dense_matrix::ptr *Q) const
+{
+	if (is_wide()) {
+		BOOST_LOG_TRIVIAL(error) << "TSQR only works on a tall matrix";
+		return dense_matrix::ptr();
+	}
+	if (get_type() != get_scalar_type<double>()) {
+		dense_matrix::ptr tmp = cast_ele_type(get_scalar_type<double>());
+		return tmp->qr(Q);
+	}
+
+	detail::mem_thread_pool::ptr threads
+		= detail::mem_thread_pool::get_global_mem_threads();
+	size_t num_threads = threads->get_num_threads();
+	size_t num_nodes = threads->get_num_nodes();
+	std::vector<tsqr_buf> bufs(num_threads);
+	std::vector<detail::matrix_store::const_ptr> ins(1, get_raw_store());
+	std::shared_ptr<tsqr_op> op(new tsqr_op(num_threads, bufs));
+	__mapply_portion(ins, op, matrix_layout_t::L_COL);
+
+	// The threads of a NUMA node have contiguous ids. The partial Rs are
+	// reduced in each node first and then across the nodes.
+	size_t nthreads_per_node = num_threads / num_nodes;
+	for (size_t i = 0; i < num_nodes; i++)
+		threads->process_task(i, new tsqr_reduce_task(bufs,
+					i * nthreads_per_node, (i + 1) * nthreads_per_node));
+	threads->wait4complete();
+	for (size_t step = nthreads_per_node; step < num_threads; step *= 2)
+		for (size_t i = 0; i + step < num_threads; i += 2 * step)
+			merge_R(bufs[i], bufs[i + step]);
+
+	size_t ncol = get_num_cols();
+	detail::mem_col_matrix_store::ptr R = detail::mem_col_matrix_store::create(
+			ncol, ncol, get_scalar_type<double>());
+	for (size_t j = 0; j < ncol; j++)
+		for (size_t i = 0; i < ncol; i++)
+			R->set<double>(i, j, i <= j && bufs[0].valid ? bufs[0].get_R(i, j) : 0);
+	// Make the diagonal of R non-negative, so R is unique.
+	for (size_t i = 0; i < ncol; i++) {
+		if (*(const double *) R->get(i, i) >= 0)
+			continue;
+		for (size_t j = i; j < ncol; j++)
+			R->set<double>(i, j, -*(const double *) R->get(i, j));
+	}
+
+	if (Q) {
+		// Q = A * R^-1 doesn't exist if R is singular. The rounding errors
+		// in R grow with the number of rows, so we use the same tolerance
+		// as the numerical rank in LAPACK: max(nrow, ncol) * eps.
+		double max_diag = 0;
+		double min_diag = std::numeric_limits<double>::max();
+		for (size_t i = 0; i < ncol; i++) {
+			max_diag = std::max(max_diag, *(const double *) R->get(i, i));
+			min_diag = std::min(min_diag, *(const double *) R->get(i, i));
+		}
+		if (min_diag <= max_diag * std::max(get_num_rows(), ncol)
+				* std::numeric_limits<double>::epsilon()) {
+			BOOST_LOG_TRIVIAL(error)
+				<< "TSQR: the matrix is rank deficient, can't compute Q";
+			*Q = dense_matrix::ptr();
+			return dense_matrix::create(R);
+		}
+
+		// Q = A * R^-1. It's a virtual matrix, so Q is computed on the fly
+		// when it's used and it's stored only when it's materialized.
+		detail::mem_col_matrix_store::ptr Rinv
+			= detail::mem_col_matrix_store::create(ncol, ncol,
+					get_scalar_type<double>());
+		for (size_t j = 0; j < ncol; j++)
+			for (size_t i = 0; i < ncol; i++)
+				Rinv->set<double>(i, j, i == j ? 1 : 0);
+		cblas_dtrsm(CblasColMajor, CblasLeft, CblasUpper, CblasNoTrans,
+				CblasNonUnit, ncol, ncol, 1, (const double *) R->get_col(0),
+				ncol, (double *) Rinv->get_col(0), ncol);
+		*Q = multiply(*dense_matrix::create(Rinv), matrix_layout_t::L_NONE,
+				true);
+
+		// The loss of orthogonality of A * R^-1 is proportional to
+		// the condition number of A. If A is ill-conditioned, we run TSQR
+		// on Q again: Q = Q2 * R2, so A = Q2 * (R2 * R). Q is well
+		// conditioned, so the second pass doesn't need to repeat this.
+		if (norm1(*R) * norm1(*Rinv) > QR_REORTH_COND) {
+			(*Q)->materialize_self();
+			dense_matrix::ptr Q2;
+			dense_matrix::ptr R2 = (*Q)->qr(&Q2);
+			if (R2 && Q2) {
+				*Q = Q2;
+				dense_matrix::ptr ret = R2->multiply(*dense_matrix::create(R),
+						matrix_layout_t::L_COL, true);
+				ret->materialize_self();
+				return ret;
+			}
+		}
+	}
+	return dense_matrix::create(R);
+}
+
+namespace
+{
+
 class apply_scalar_op: public detail::portion_mapply_op
 {
 	scalar_variable::const_ptr var;
@@ -762,6 +1087,13 @@ public:
 		return (boost::format("apply_scalar(%1%, %2%)") % mats[0]->get_name()
 				% var->get_name()).str();
 	}
+
+	virtual bool get_elem_op(detail::elem_op_desc &desc) const {
+		desc.type = detail::elem_op_desc::SCALAR;
+		desc.bop = op;
+		desc.scalar = var;
+		return true;
+	}
 };
 
 void apply_scalar_op::run(
@@ -1731,6 +2063,9 @@ bool __mapply_portion(
 	}
 	all_in_mem = all_in_mem && out_in_mem;
 
+	// The virtual matrices used by multiple operations in this
+	// materialization are computed once for each portion.
+	shared_mapply_scope shared_scope(mats);
 	if (all_in_mem) {
 		detail::mem_thread_pool::ptr mem_threads
 			= detail::mem_thread_pool::get_global_mem_threads();
@@ -2040,6 +2375,11 @@ public:
 		return op->get_name() + std::string("(") + mats[0]->get_name()
 			+ ", " + mats[1]->get_name() + ")";
 	}
+	virtual bool get_elem_op(detail::elem_op_desc &desc) const {
+		desc.type = detail::elem_op_desc::BINARY;
+		desc.bop = op;
+		return true;
+	}
 };
 
 void mapply2_op::run(const std::vector<detail::local_matrix_store::const_ptr> &ins,
@@ -2100,6 +2440,11 @@ public:
 		assert(mats.size() == 1);
 		return op->get_name() + std::string("(") + mats[0]->get_name() + ")";
 	}
+	virtual bool get_elem_op(detail::elem_op_desc &desc) const {
+		desc.type = detail::elem_op_desc::UNARY;
+		desc.uop = op;
+		return true;
+	}
 };
 
 void sapply_op::run(const std::vector<detail::local_matrix_store::const_ptr> &ins,
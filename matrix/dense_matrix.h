@@ -59,6 +59,28 @@ namespace detail
 
 class local_matrix_store;
 
+/*
+ * This describes an element-wise operation, so a chain of element-wise
+ * operations can be fused and run on the input matrices directly.
+ */
+struct elem_op_desc
+{
+	enum op_type {
+		// A unary operator on the input.
+		UNARY,
+		// A binary operator on two inputs.
+		BINARY,
+		// A binary operator on the input and a scalar.
+		SCALAR,
+	};
+
+	op_type type;
+	bulk_uoperate::const_ptr uop;
+	bulk_operate::const_ptr bop;
+	// The right operand of a SCALAR operation.
+	scalar_variable::const_ptr scalar;
+};
+
 class portion_mapply_op
 {
 	size_t out_num_rows;
@@ -105,6 +127,14 @@ public:
 		return false;
 	}
 
+	/*
+	 * If this is an element-wise operation, it describes the operation,
+	 * so it can be fused with other element-wise operations.
+	 */
+	virtual bool get_elem_op(elem_op_desc &desc) const {
+		return false;
+	}
+
 	size_t get_out_num_rows() const {
 		return out_num_rows;
 	}
@@ -372,6 +402,21 @@ public:
 	dense_matrix::ptr multiply(const dense_matrix &mat,
 			matrix_layout_t out_layout = matrix_layout_t::L_NONE,
 			bool use_blas = false) const;
+	/*
+	 * Compute the QR factorization of a tall-and-skinny matrix with TSQR
+	 * and return R. R is computed in a single pass over the matrix:
+	 * each thread folds the portions it processes into its own R and
+	 * the partial Rs are combined with a reduction tree, first among
+	 * the threads of a NUMA node and then across the nodes.
+	 * If `Q' isn't NULL, it gets the Q factor, which is represented
+	 * implicitly by A * R^-1 as a virtual matrix, so it's only stored if
+	 * it's materialized. The columns of A * R^-1 lose orthogonality in
+	 * proportion to eps * cond(A), so if A is ill-conditioned, Q is
+	 * materialized and orthogonalized with another pass of TSQR.
+	 * If A is numerically rank deficient, R is singular and `Q' is set
+	 * to NULL.
+	 */
+	dense_matrix::ptr qr(dense_matrix::ptr *Q = NULL) const;
 
 	dense_matrix::ptr add(const dense_matrix &mat) const {
 		const bulk_operate &op = get_type().get_basic_ops().get_add();
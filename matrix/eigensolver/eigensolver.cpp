@@ -1,3 +1,4 @@
+#ifdef ENABLE_TRILINOS
 // Include header for block Davidson eigensolver
 #include "AnasaziBlockDavidsonSolMgr.hpp"
 // Include header for LOBPCG eigensolver
@@ -9,6 +10,7 @@
 #include "AnasaziBasicEigenproblem.hpp"
 #include "AnasaziOperator.hpp"
 #include "FM_MultiVector.h"
+#endif
 
 #include "sparse_matrix.h"
 #include "matrix_stats.h"
@@ -36,6 +38,8 @@ extern size_t num_cached_mats;
 }
 }
 
+#ifdef ENABLE_TRILINOS
+
 namespace Anasazi
 {
 
@@ -69,51 +73,22 @@ public:
 
 }
 
+#endif
+
 namespace fm
 {
 
 namespace eigen
 {
 
-eigen_options::eigen_options()
-{
-	tol = 1.0e-8;
-	max_restarts = 100;
-	max_iters = 500;
-	this->nev = 1;
-	this->solver = "KrylovSchur";
-	which="LM";
-	in_mem = true;
-}
-
-bool eigen_options::init(int nev, std::string solver)
-{
-	this->nev = nev;
-	this->solver = solver;
-	if (solver == "KrylovSchur") {
-		block_size = 1;
-		// The KrylovSchur solver wants the number of blocks to be at least 3.
-		num_blocks = std::max(nev * 2, 3);
-	}
-	else if (solver == "Davidson") {
-		block_size = nev;
-		num_blocks = 4;
-	}
-	else if (solver == "LOBPCG") {
-		block_size = 4;
-		num_blocks = 10;
-	}
-	else {
-		BOOST_LOG_TRIVIAL(error) << "Unknown solver: " << solver;
-		return false;
-	}
-
-	return true;
-}
+#ifdef ENABLE_TRILINOS
 
 eigen_res compute_eigen(spm_function *func, bool sym,
 		struct eigen_options &_opts)
 {
+	if (is_native_solver(_opts.solver))
+		return compute_eigen_native(func, sym, _opts);
+
 	using Teuchos::RCP;
 	using Teuchos::rcp;
 
@@ -317,6 +292,25 @@ eigen_res compute_eigen(spm_function *func, bool sym,
 	return res;
 }
 
+#else
+
+eigen_res compute_eigen(spm_function *func, bool sym,
+		struct eigen_options &opts)
+{
+	// Without Trilinos, the block Krylov-Schur solver runs natively.
+	if (!is_native_solver(opts.solver)) {
+		BOOST_LOG_TRIVIAL(warning) << boost::format(
+				"%1% requires Trilinos, use Lanczos instead") % opts.solver;
+		if (!opts.init(opts.nev, "Lanczos")) {
+			delete func;
+			return eigen_res();
+		}
+	}
+	return compute_eigen_native(func, sym, opts);
+}
+
+#endif
+
 }
 
 }
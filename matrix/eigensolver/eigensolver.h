@@ -52,6 +52,15 @@ struct eigen_res
 	fm::dense_matrix::ptr vecs;
 };
 
+/*
+ * The solvers "KrylovSchur", "Davidson" and "LOBPCG" run in Anasazi and
+ * require Trilinos. The native solvers "Lanczos" and "RandSVD" only work
+ * on symmetric matrices:
+ *   Lanczos: block Krylov-Schur (thick-restart block Lanczos).
+ *   RandSVD: randomized subspace iteration. It computes the eigenvalues
+ *   of the largest magnitude, so it computes the SVD of A when
+ *   the operator computes A^T * A.
+ */
 struct eigen_options
 {
 	double tol;
@@ -69,12 +78,23 @@ struct eigen_options
 	bool init(int nev, std::string solver = "KrylovSchur");
 };
 
+bool is_native_solver(const std::string &solver);
+
 /*
+ * If the library is built without Trilinos, the Anasazi solvers are
+ * replaced by Lanczos and `opts' is updated accordingly.
  * `func' will be destroyed by this function.
  */
 eigen_res compute_eigen(spm_function *func, bool sym,
 		struct eigen_options &opts);
 
+/*
+ * This runs the native solvers and doesn't require Trilinos.
+ * `func' will be destroyed by this function.
+ */
+eigen_res compute_eigen_native(spm_function *func, bool sym,
+		struct eigen_options &opts);
+
 }
 
 }
@@ -0,0 +1,526 @@
+/*
+ * Copyright 2015 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of FlashMatrix.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+
+#include <algorithm>
+#include <iomanip>
+
+#include "eigensolver.h"
+#include "block_dense_matrix.h"
+#include "small_dense.h"
+#include "matrix_stats.h"
+
+/*
+ * This file implements the eigensolvers that run directly on
+ * block_multi_vector without Trilinos. All operations on the tall-skinny
+ * matrices are expressed with MvTransMv and gemm, each of which takes
+ * a single pass over its inputs, and all computation on the projected
+ * problem is done in small_mat.
+ */
+
+namespace fm
+{
+
+namespace eigen
+{
+
+extern size_t num_cached_mats;
+
+eigen_options::eigen_options()
+{
+	tol = 1.0e-8;
+	max_restarts = 100;
+	max_iters = 500;
+	this->nev = 1;
+	this->solver = "KrylovSchur";
+	which="LM";
+	in_mem = true;
+}
+
+bool eigen_options::init(int nev, std::string solver)
+{
+	this->nev = nev;
+	this->solver = solver;
+	if (solver == "KrylovSchur") {
+		block_size = 1;
+		// The KrylovSchur solver wants the number of blocks to be at least 3.
+		num_blocks = std::max(nev * 2, 3);
+	}
+	else if (solver == "Davidson") {
+		block_size = nev;
+		num_blocks = 4;
+	}
+	else if (solver == "LOBPCG") {
+		block_size = 4;
+		num_blocks = 10;
+	}
+	else if (solver == "Lanczos") {
+		block_size = std::min(nev, 4);
+		// The subspace keeps at least twice as many vectors as requested.
+		num_blocks = std::max((2 * nev + block_size - 1) / block_size + 1, 4);
+	}
+	else if (solver == "RandSVD") {
+		// Oversampling makes the subspace iteration converge much faster.
+		block_size = nev + std::min(std::max(nev, 4), 10);
+		num_blocks = 1;
+	}
+	else {
+		BOOST_LOG_TRIVIAL(error) << "Unknown solver: " << solver;
+		return false;
+	}
+
+	return true;
+}
+
+bool is_native_solver(const std::string &solver)
+{
+	return solver == "Lanczos" || solver == "RandSVD";
+}
+
+namespace
+{
+
+typedef std::vector<dense_matrix::ptr> block_list;
+
+class ritz_order
+{
+	const std::vector<double> &vals;
+	std::string which;
+public:
+	ritz_order(const std::vector<double> &_vals,
+			const std::string &which): vals(_vals) {
+		this->which = which;
+	}
+
+	bool operator()(size_t i, size_t j) const {
+		if (which == "LA")
+			return vals[i] > vals[j];
+		else if (which == "SA")
+			return vals[i] < vals[j];
+		else if (which == "SM")
+			return fabs(vals[i]) < fabs(vals[j]);
+		else
+			return fabs(vals[i]) > fabs(vals[j]);
+	}
+};
+
+/*
+ * Compute the eigen decomposition of the projected problem and sort
+ * the Ritz values in the order requested by the user.
+ */
+void ritz_pairs(const small_mat &T, const std::string &which,
+		std::vector<double> &vals, small_mat &vecs)
+{
+	// T is symmetric in exact arithmetic.
+	small_mat sym_T = T.add(T.transpose());
+	for (size_t j = 0; j < sym_T.get_num_cols(); j++)
+		for (size_t i = 0; i < sym_T.get_num_rows(); i++)
+			sym_T(i, j) /= 2;
+	std::vector<double> unsorted;
+	small_mat unsorted_vecs;
+	sym_eigen(sym_T, unsorted, unsorted_vecs);
+
+	std::vector<size_t> idxs(unsorted.size());
+	for (size_t i = 0; i < idxs.size(); i++)
+		idxs[i] = i;
+	std::stable_sort(idxs.begin(), idxs.end(), ritz_order(unsorted, which));
+	vals.resize(idxs.size());
+	for (size_t i = 0; i < idxs.size(); i++)
+		vals[i] = unsorted[idxs[i]];
+	vecs = unsorted_vecs.get_cols(idxs);
+}
+
+void materialize_block(dense_matrix::ptr mat)
+{
+	if (mat->is_virtual()) {
+		num_col_writes += mat->get_num_cols();
+		mat->materialize_self();
+	}
+}
+
+block_multi_vector::ptr create_mv(const block_list &blocks, bool in_mem)
+{
+	assert(!blocks.empty());
+	size_t block_size = blocks[0]->get_num_cols();
+	block_multi_vector::ptr mv = block_multi_vector::create(
+			blocks[0]->get_num_rows(), block_size * blocks.size(), block_size,
+			blocks[0]->get_type(), in_mem, false);
+	for (size_t i = 0; i < blocks.size(); i++)
+		mv->set_block(i, blocks[i]);
+	return mv;
+}
+
+/*
+ * Compute A * X for a single block.
+ */
+dense_matrix::ptr apply_op(const spm_function &op, dense_matrix::ptr X,
+		bool in_mem)
+{
+	block_list blocks(1, X);
+	block_multi_vector::ptr mv = create_mv(blocks, in_mem);
+	block_multi_vector::ptr res = block_multi_vector::create(op.get_num_rows(),
+			X->get_num_cols(), X->get_num_cols(), X->get_type(), in_mem, false);
+	bool out_mat_in_mem;
+	if (X->is_in_mem())
+		out_mat_in_mem = true;
+	else
+		out_mat_in_mem = num_cached_mats > 0;
+	block_multi_vector::sparse_matrix_multiply(op, *mv, *res, out_mat_in_mem);
+	return res->get_block(0);
+}
+
+/*
+ * Compute `mv' * B and return the result as a single block.
+ */
+dense_matrix::ptr multiply_small(const block_multi_vector &mv,
+		const small_mat &B, bool in_mem)
+{
+	size_t ncol = B.get_num_cols();
+	block_multi_vector::ptr res = block_multi_vector::create(mv.get_num_rows(),
+			ncol, ncol, mv.get_type(), in_mem, false);
+	scalar_variable_impl<double> alpha(1);
+	scalar_variable_impl<double> beta(0);
+	res = res->gemm(mv, B.conv2store(), alpha, beta);
+	assert(res);
+	dense_matrix::ptr block = res->get_block(0);
+	materialize_block(block);
+	return block;
+}
+
+/*
+ * Find R in G = R^T * R. If the block is numerically rank deficient,
+ * the Gram matrix is shifted slightly so that the factorization still
+ * succeeds. The next orthogonalization pass cleans up the result.
+ */
+small_mat factor_gram(const small_mat &G)
+{
+	small_mat R;
+	if (cholesky(G, R))
+		return R;
+
+	double trace = 0;
+	for (size_t i = 0; i < G.get_num_rows(); i++)
+		trace += fabs(G(i, i));
+	double shift = std::max(trace, 1.0) * 1e-14;
+	while (true) {
+		small_mat shifted = G;
+		for (size_t i = 0; i < G.get_num_rows(); i++)
+			shifted(i, i) += shift;
+		if (cholesky(shifted, R)) {
+			BOOST_LOG_TRIVIAL(info) << boost::format(
+					"shift the Gram matrix by %1% in orthogonalization") % shift;
+			return R;
+		}
+		shift *= 100;
+	}
+}
+
+/*
+ * Orthogonalize W against the orthonormal basis V and itself in a single
+ * pass: the projection and the Gram matrix of W are computed in one
+ * MvTransMv on [V, W], and the orthonormal block is computed in one gemm
+ * on [V, W]. On return, W = V * C + Q * R.
+ */
+dense_matrix::ptr orth_pass(const block_list &V, dense_matrix::ptr W,
+		small_mat &C, small_mat &R, bool in_mem)
+{
+	size_t b = W->get_num_cols();
+	size_t m = V.size() * b;
+	block_list blocks = V;
+	blocks.push_back(W);
+	block_multi_vector::ptr Z = create_mv(blocks, in_mem);
+	block_multi_vector::ptr Wmv = create_mv(block_list(1, W), in_mem);
+	// G = [V, W]^T * W
+	small_mat G = small_mat::create(*Wmv->MvTransMv(*Z));
+	C = G.get_block(0, 0, m, b);
+	small_mat Gww = G.get_block(m, 0, b, b);
+	// The Gram matrix of W - V * C.
+	R = factor_gram(Gww.minus(C.transpose().multiply(C)));
+	small_mat Rinv = inv_upper(R);
+
+	// Q = (W - V * C) * R^-1 = [V, W] * [-C * R^-1; R^-1]
+	small_mat coeffs(m + b, b);
+	small_mat CRinv = C.multiply(Rinv);
+	for (size_t j = 0; j < b; j++)
+		for (size_t i = 0; i < m; i++)
+			coeffs(i, j) = -CRinv(i, j);
+	coeffs.set_block(m, 0, Rinv);
+	return multiply_small(*Z, coeffs, in_mem);
+}
+
+/*
+ * Orthogonalize W against V with two passes of orth_pass, so the result
+ * is orthonormal to working precision. On return, W = V * C + Q * R.
+ */
+dense_matrix::ptr block_orth(const block_list &V, dense_matrix::ptr W,
+		small_mat &C, small_mat &R, bool in_mem)
+{
+	small_mat C1, R1, C2, R2;
+	dense_matrix::ptr Q1 = orth_pass(V, W, C1, R1, in_mem);
+	dense_matrix::ptr Q = orth_pass(V, Q1, C2, R2, in_mem);
+	C = C1.add(C2.multiply(R1));
+	R = R2.multiply(R1);
+	return Q;
+}
+
+eigen_res collect_res(const block_list &V, const small_mat &S,
+		const std::vector<double> &vals, size_t nev, bool in_mem)
+{
+	eigen_res res;
+	res.vals.assign(vals.begin(), vals.begin() + nev);
+	block_multi_vector::ptr Vmv = create_mv(V, in_mem);
+	res.vecs = multiply_small(*Vmv, S.get_block(0, 0, S.get_num_rows(), nev),
+			in_mem);
+	return res;
+}
+
+void print_res(const std::vector<double> &vals, const std::vector<double> &resids)
+{
+	BOOST_LOG_TRIVIAL(error)
+		<< "------------------------------------------------------";
+	BOOST_LOG_TRIVIAL(error) << std::setw(16) << "Eigenvalue"
+		<< std::setw(18) << "Direct Residual";
+	BOOST_LOG_TRIVIAL(error)
+		<< "------------------------------------------------------";
+	// The residual is relative to the eigenvalue unless the eigenvalue is 0.
+	for (size_t i = 0; i < vals.size(); i++)
+		BOOST_LOG_TRIVIAL(error) << std::setw(16) << vals[i]
+			<< std::setw(18) << (vals[i] == 0 ? resids[i]
+					: resids[i] / fabs(vals[i]));
+	BOOST_LOG_TRIVIAL(error) << "#mem read bytes: "
+		<< detail::matrix_stats.get_read_bytes(true);
+	BOOST_LOG_TRIVIAL(error) << "#mem write bytes: "
+		<< detail::matrix_stats.get_write_bytes(true);
+	BOOST_LOG_TRIVIAL(error) << "#EM read bytes: "
+		<< detail::matrix_stats.get_read_bytes(false);
+	BOOST_LOG_TRIVIAL(error) << "#EM write bytes: "
+		<< detail::matrix_stats.get_write_bytes(false);
+}
+
+/*
+ * The block Krylov-Schur method for symmetric matrices, which is a block
+ * Lanczos method with thick restart. It maintains the relation
+ *   A * V = V * T + F * B
+ * where V is the orthonormal basis, T is the projected matrix, F is
+ * the next block of the basis and B has the coupling coefficients of F.
+ */
+eigen_res lanczos(const spm_function &op, const eigen_options &opts)
+{
+	const size_t b = opts.block_size;
+	const size_t nev = opts.nev;
+	const bool in_mem = opts.in_mem;
+	const size_t max_blocks = std::max(opts.num_blocks, 2);
+	if (max_blocks * b < nev + b) {
+		BOOST_LOG_TRIVIAL(error) << boost::format(
+				"The subspace (%1% blocks of %2% vectors) is too small for %3% eigenvalues")
+			% max_blocks % b % nev;
+		return eigen_res();
+	}
+	// The number of blocks kept in a restart.
+	size_t keep_blocks = std::max((nev + b - 1) / b, max_blocks / 2);
+	keep_blocks = std::min(keep_blocks, max_blocks - 1);
+
+	dense_matrix::ptr F = dense_matrix::create_randu<double>(-1, 1,
+			op.get_num_cols(), b, matrix_layout_t::L_COL,
+			matrix_conf.get_num_nodes(), in_mem);
+	small_mat C, R;
+	block_list V;
+	F = block_orth(V, F, C, R, in_mem);
+	small_mat T(0, 0);
+	small_mat B(b, 0);
+
+	for (int restart = 0; restart <= opts.max_restarts; restart++) {
+		// Expand the basis until it's full.
+		while (V.size() < max_blocks) {
+			size_t m = T.get_num_rows();
+			dense_matrix::ptr W = apply_op(op, F, in_mem);
+			V.push_back(F);
+			F = block_orth(V, W, C, R, in_mem);
+
+			small_mat new_T(m + b, m + b);
+			new_T.set_block(0, 0, T);
+			new_T.set_block(m, 0, B);
+			new_T.set_block(0, m, C);
+			T = new_T;
+			B = small_mat(b, m + b);
+			B.set_block(0, m, R);
+		}
+
+		std::vector<double> vals;
+		small_mat S;
+		ritz_pairs(T, opts.which, vals, S);
+		// The residual of a Ritz pair is ||F * B * s||, and F is orthonormal.
+		small_mat BS = B.multiply(S);
+		std::vector<double> resids(vals.size());
+		size_t num_conv = 0;
+		for (size_t i = 0; i < vals.size(); i++) {
+			double sum = 0;
+			for (size_t k = 0; k < b; k++)
+				sum += BS(k, i) * BS(k, i);
+			resids[i] = sqrt(sum);
+			if (i < nev && resids[i] <= opts.tol * fabs(vals[i]))
+				num_conv++;
+		}
+		BOOST_LOG_TRIVIAL(info) << boost::format(
+				"restart %1%: %2% of %3% Ritz values converged")
+			% restart % num_conv % nev;
+		if (num_conv == nev || restart == opts.max_restarts) {
+			if (num_conv < nev)
+				BOOST_LOG_TRIVIAL(error) << "Lanczos eigensolver did not converge.";
+			print_res(std::vector<double>(vals.begin(), vals.begin() + nev),
+					resids);
+			return collect_res(V, S, vals, nev, in_mem);
+		}
+
+		// Thick restart: keep the wanted Ritz vectors. The projected matrix
+		// becomes diagonal and the coupling coefficients are rotated.
+		size_t keep = keep_blocks * b;
+		small_mat S_keep = S.get_block(0, 0, S.get_num_rows(), keep);
+		block_multi_vector::ptr Vmv = create_mv(V, in_mem);
+		block_multi_vector::ptr res = block_multi_vector::create(
+				op.get_num_rows(), keep, b, Vmv->get_type(), in_mem, false);
+		scalar_variable_impl<double> alpha(1);
+		scalar_variable_impl<double> beta(0);
+		res = res->gemm(*Vmv, S_keep.conv2store(), alpha, beta);
+		V.clear();
+		for (size_t i = 0; i < keep_blocks; i++) {
+			dense_matrix::ptr block = res->get_block(i);
+			materialize_block(block);
+			V.push_back(block);
+		}
+		T = small_mat(keep, keep);
+		for (size_t i = 0; i < keep; i++)
+			T(i, i) = vals[i];
+		B = B.multiply(S_keep);
+	}
+	assert(0);
+	return eigen_res();
+}
+
+/*
+ * Randomized subspace iteration for the dominant eigenpairs of
+ * a symmetric operator. For SVD, the operator should compute A^T * A,
+ * so the eigenvalues are the squares of the singular values and
+ * the eigenvectors are the right singular vectors.
+ *
+ * In each iteration, the Rayleigh-Ritz projection, the residuals and
+ * the Gram matrix for the next orthogonalization all come from a single
+ * MvTransMv on [Q, Z], where Z = A * Q.
+ */
+eigen_res rand_svd(const spm_function &op, const eigen_options &opts)
+{
+	const size_t b = opts.block_size;
+	const size_t nev = opts.nev;
+	const bool in_mem = opts.in_mem;
+	if (b < nev) {
+		BOOST_LOG_TRIVIAL(error) << boost::format(
+				"The block size (%1%) is smaller than the number of eigenvalues (%2%)")
+			% b % nev;
+		return eigen_res();
+	}
+	if (opts.which != "LM" && opts.which != "LA") {
+		BOOST_LOG_TRIVIAL(error)
+			<< "RandSVD can only compute the eigenvalues of the largest magnitude";
+		return eigen_res();
+	}
+
+	dense_matrix::ptr Q = dense_matrix::create_randu<double>(-1, 1,
+			op.get_num_cols(), b, matrix_layout_t::L_COL,
+			matrix_conf.get_num_nodes(), in_mem);
+	small_mat C, R;
+	Q = block_orth(block_list(), Q, C, R, in_mem);
+	for (int iter = 0; ; iter++) {
+		dense_matrix::ptr Z = apply_op(op, Q, in_mem);
+		block_list blocks(1, Q);
+		blocks.push_back(Z);
+		block_multi_vector::ptr QZ = create_mv(blocks, in_mem);
+		block_multi_vector::ptr Zmv = create_mv(block_list(1, Z), in_mem);
+		small_mat G = small_mat::create(*Zmv->MvTransMv(*QZ));
+		small_mat T = G.get_block(0, 0, b, b);
+		small_mat Gzz = G.get_block(b, 0, b, b);
+
+		std::vector<double> vals;
+		small_mat S;
+		ritz_pairs(T, opts.which, vals, S);
+		// ||Z * s - theta * Q * s||^2 = s^T * Z^T * Z * s - theta^2
+		small_mat GS = Gzz.multiply(S);
+		std::vector<double> resids(nev);
+		size_t num_conv = 0;
+		for (size_t i = 0; i < nev; i++) {
+			double sum = 0;
+			for (size_t k = 0; k < b; k++)
+				sum += S(k, i) * GS(k, i);
+			resids[i] = sqrt(std::max(sum - vals[i] * vals[i], 0.0));
+			if (resids[i] <= opts.tol * fabs(vals[i]))
+				num_conv++;
+		}
+		BOOST_LOG_TRIVIAL(info) << boost::format(
+				"iteration %1%: %2% of %3% Ritz values converged")
+			% iter % num_conv % nev;
+		if (num_conv == nev || iter + 1 >= opts.max_iters) {
+			if (num_conv < nev)
+				BOOST_LOG_TRIVIAL(error) << "RandSVD eigensolver did not converge.";
+			print_res(std::vector<double>(vals.begin(), vals.begin() + nev),
+					resids);
+			return collect_res(block_list(1, Q), S, vals, nev, in_mem);
+		}
+
+		// The first orthogonalization pass of Z reuses the Gram matrix
+		// computed above, so it only needs a gemm.
+		small_mat R1 = factor_gram(Gzz);
+		Q = multiply_small(*Zmv, inv_upper(R1), in_mem);
+		small_mat R2;
+		Q = orth_pass(block_list(), Q, C, R2, in_mem);
+	}
+}
+
+}
+
+eigen_res compute_eigen_native(spm_function *func, bool sym,
+		struct eigen_options &_opts)
+{
+	std::unique_ptr<spm_function> op(func);
+	struct eigen_options opts = _opts;
+	if (!sym) {
+		BOOST_LOG_TRIVIAL(error)
+			<< "The native eigensolvers only support symmetric matrices";
+		return eigen_res();
+	}
+	if (op->get_num_rows() != op->get_num_cols()) {
+		BOOST_LOG_TRIVIAL(error) << "The matrix isn't square";
+		return eigen_res();
+	}
+	if (opts.block_size == 0)
+		opts.block_size = opts.nev;
+
+	eigen_res res;
+	if (opts.solver == "Lanczos")
+		res = lanczos(*op, opts);
+	else if (opts.solver == "RandSVD")
+		res = rand_svd(*op, opts);
+	else
+		BOOST_LOG_TRIVIAL(error) << "a wrong solver: " << opts.solver;
+	cached_mats.clear();
+	return res;
+}
+
+}
+
+}
@@ -0,0 +1,231 @@
+/*
+ * Copyright 2015 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of FlashMatrix.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+#include <cblas.h>
+
+#include "small_dense.h"
+
+namespace fm
+{
+
+namespace eigen
+{
+
+small_mat small_mat::create(const dense_matrix &mat)
+{
+	assert(mat.get_type() == get_scalar_type<double>());
+	dense_matrix::ptr tmp = mat.clone();
+	if (!tmp->is_in_mem())
+		tmp = tmp->conv_store(true, -1);
+	tmp->materialize_self();
+	const detail::mem_matrix_store &store
+		= dynamic_cast<const detail::mem_matrix_store &>(tmp->get_data());
+	small_mat ret(mat.get_num_rows(), mat.get_num_cols());
+	for (size_t j = 0; j < ret.ncol; j++)
+		for (size_t i = 0; i < ret.nrow; i++)
+			ret(i, j) = store.get<double>(i, j);
+	return ret;
+}
+
+small_mat small_mat::identity(size_t n)
+{
+	small_mat ret(n, n);
+	for (size_t i = 0; i < n; i++)
+		ret(i, i) = 1;
+	return ret;
+}
+
+small_mat small_mat::multiply(const small_mat &m) const
+{
+	assert(ncol == m.nrow);
+	small_mat ret(nrow, m.ncol);
+	if (nrow == 0 || m.ncol == 0 || ncol == 0)
+		return ret;
+	cblas_dgemm(CblasColMajor, CblasNoTrans, CblasNoTrans, nrow, m.ncol, ncol,
+			1, data.data(), nrow, m.data.data(), m.nrow, 0, ret.data.data(),
+			ret.nrow);
+	return ret;
+}
+
+small_mat small_mat::transpose() const
+{
+	small_mat ret(ncol, nrow);
+	for (size_t j = 0; j < ncol; j++)
+		for (size_t i = 0; i < nrow; i++)
+			ret(j, i) = (*this)(i, j);
+	return ret;
+}
+
+small_mat small_mat::add(const small_mat &m) const
+{
+	assert(nrow == m.nrow && ncol == m.ncol);
+	small_mat ret(nrow, ncol);
+	for (size_t i = 0; i < data.size(); i++)
+		ret.data[i] = data[i] + m.data[i];
+	return ret;
+}
+
+small_mat small_mat::minus(const small_mat &m) const
+{
+	assert(nrow == m.nrow && ncol == m.ncol);
+	small_mat ret(nrow, ncol);
+	for (size_t i = 0; i < data.size(); i++)
+		ret.data[i] = data[i] - m.data[i];
+	return ret;
+}
+
+small_mat small_mat::get_block(size_t start_row, size_t start_col,
+		size_t num_rows, size_t num_cols) const
+{
+	assert(start_row + num_rows <= nrow && start_col + num_cols <= ncol);
+	small_mat ret(num_rows, num_cols);
+	for (size_t j = 0; j < num_cols; j++)
+		for (size_t i = 0; i < num_rows; i++)
+			ret(i, j) = (*this)(start_row + i, start_col + j);
+	return ret;
+}
+
+void small_mat::set_block(size_t start_row, size_t start_col,
+		const small_mat &m)
+{
+	assert(start_row + m.nrow <= nrow && start_col + m.ncol <= ncol);
+	for (size_t j = 0; j < m.ncol; j++)
+		for (size_t i = 0; i < m.nrow; i++)
+			(*this)(start_row + i, start_col + j) = m(i, j);
+}
+
+small_mat small_mat::get_cols(const std::vector<size_t> &idxs) const
+{
+	small_mat ret(nrow, idxs.size());
+	for (size_t j = 0; j < idxs.size(); j++)
+		for (size_t i = 0; i < nrow; i++)
+			ret(i, j) = (*this)(i, idxs[j]);
+	return ret;
+}
+
+detail::mem_col_matrix_store::ptr small_mat::conv2store() const
+{
+	detail::mem_col_matrix_store::ptr store
+		= detail::mem_col_matrix_store::create(nrow, ncol,
+				get_scalar_type<double>());
+	for (size_t j = 0; j < ncol; j++)
+		for (size_t i = 0; i < nrow; i++)
+			store->set<double>(i, j, (*this)(i, j));
+	return store;
+}
+
+bool cholesky(const small_mat &A, small_mat &R)
+{
+	size_t n = A.get_num_rows();
+	assert(n == A.get_num_cols());
+	R = small_mat(n, n);
+	for (size_t j = 0; j < n; j++) {
+		double diag = A(j, j);
+		for (size_t k = 0; k < j; k++)
+			diag -= R(k, j) * R(k, j);
+		if (diag <= 0 || !std::isfinite(diag))
+			return false;
+		R(j, j) = sqrt(diag);
+		for (size_t i = j + 1; i < n; i++) {
+			double val = A(j, i);
+			for (size_t k = 0; k < j; k++)
+				val -= R(k, j) * R(k, i);
+			R(j, i) = val / R(j, j);
+		}
+	}
+	return true;
+}
+
+small_mat inv_upper(const small_mat &R)
+{
+	size_t n = R.get_num_rows();
+	assert(n == R.get_num_cols());
+	small_mat inv(n, n);
+	// Solve R * X = I column by column with back substitution.
+	for (size_t j = 0; j < n; j++) {
+		for (long i = j; i >= 0; i--) {
+			double val = i == (long) j ? 1 : 0;
+			for (size_t k = i + 1; k <= j; k++)
+				val -= R(i, k) * inv(k, j);
+			inv(i, j) = val / R(i, i);
+		}
+	}
+	return inv;
+}
+
+void sym_eigen(const small_mat &A, std::vector<double> &vals, small_mat &vecs)
+{
+	const int MAX_SWEEPS = 100;
+	size_t n = A.get_num_rows();
+	assert(n == A.get_num_cols());
+	small_mat a = A;
+	vecs = small_mat::identity(n);
+	for (int sweep = 0; sweep < MAX_SWEEPS; sweep++) {
+		double off = 0;
+		double tot = 0;
+		for (size_t j = 0; j < n; j++)
+			for (size_t i = 0; i < n; i++) {
+				tot += a(i, j) * a(i, j);
+				if (i != j)
+					off += a(i, j) * a(i, j);
+			}
+		if (off <= 1e-30 * tot || off == 0)
+			break;
+
+		for (size_t p = 0; p < n; p++) {
+			for (size_t q = p + 1; q < n; q++) {
+				double apq = a(p, q);
+				if (apq == 0)
+					continue;
+				// Choose the rotation that zeroes a(p, q).
+				double theta = (a(q, q) - a(p, p)) / (2 * apq);
+				double t = (theta >= 0 ? 1 : -1)
+					/ (fabs(theta) + sqrt(theta * theta + 1));
+				double c = 1 / sqrt(t * t + 1);
+				double s = t * c;
+				for (size_t k = 0; k < n; k++) {
+					double akp = a(k, p);
+					double akq = a(k, q);
+					a(k, p) = c * akp - s * akq;
+					a(k, q) = s * akp + c * akq;
+				}
+				for (size_t k = 0; k < n; k++) {
+					double apk = a(p, k);
+					double aqk = a(q, k);
+					a(p, k) = c * apk - s * aqk;
+					a(q, k) = s * apk + c * aqk;
+				}
+				for (size_t k = 0; k < n; k++) {
+					double vkp = vecs(k, p);
+					double vkq = vecs(k, q);
+					vecs(k, p) = c * vkp - s * vkq;
+					vecs(k, q) = s * vkp + c * vkq;
+				}
+			}
+		}
+	}
+	vals.resize(n);
+	for (size_t i = 0; i < n; i++)
+		vals[i] = a(i, i);
+}
+
+}
+
+}
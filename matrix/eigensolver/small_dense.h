@@ -0,0 +1,123 @@
+#ifndef __SMALL_DENSE_H__
+#define __SMALL_DENSE_H__
+
+/*
+ * Copyright 2015 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of FlashMatrix.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+
+#include <vector>
+
+#include "dense_matrix.h"
+#include "mem_matrix_store.h"
+
+namespace fm
+{
+
+namespace eigen
+{
+
+/*
+ * A small dense matrix of doubles in column-major order. The eigensolvers
+ * project the problem onto a subspace with a few hundred dimensions at most,
+ * so the computation on the projected problem is done in this matrix
+ * by a single thread.
+ */
+class small_mat
+{
+	size_t nrow;
+	size_t ncol;
+	std::vector<double> data;
+public:
+	small_mat() {
+		nrow = 0;
+		ncol = 0;
+	}
+
+	small_mat(size_t nrow, size_t ncol): data(nrow * ncol) {
+		this->nrow = nrow;
+		this->ncol = ncol;
+	}
+
+	/*
+	 * Copy a small in-memory dense matrix.
+	 */
+	static small_mat create(const dense_matrix &mat);
+	static small_mat identity(size_t n);
+
+	size_t get_num_rows() const {
+		return nrow;
+	}
+
+	size_t get_num_cols() const {
+		return ncol;
+	}
+
+	double &operator()(size_t row, size_t col) {
+		assert(row < nrow && col < ncol);
+		return data[col * nrow + row];
+	}
+
+	double operator()(size_t row, size_t col) const {
+		assert(row < nrow && col < ncol);
+		return data[col * nrow + row];
+	}
+
+	const double *get_raw_arr() const {
+		return data.data();
+	}
+
+	small_mat multiply(const small_mat &m) const;
+	small_mat transpose() const;
+	small_mat add(const small_mat &m) const;
+	small_mat minus(const small_mat &m) const;
+	small_mat get_block(size_t start_row, size_t start_col, size_t num_rows,
+			size_t num_cols) const;
+	void set_block(size_t start_row, size_t start_col, const small_mat &m);
+	small_mat get_cols(const std::vector<size_t> &idxs) const;
+
+	/*
+	 * Convert the matrix to the store that can be used by gemm in
+	 * block_multi_vector.
+	 */
+	detail::mem_col_matrix_store::ptr conv2store() const;
+};
+
+/*
+ * Compute the upper triangular matrix R in A = R^T * R.
+ * It returns false if A isn't positive definite.
+ */
+bool cholesky(const small_mat &A, small_mat &R);
+
+/*
+ * Invert an upper triangular matrix.
+ */
+small_mat inv_upper(const small_mat &R);
+
+/*
+ * Compute the eigenvalues and eigenvectors of a symmetric matrix with
+ * the cyclic Jacobi method. The eigenvalues aren't sorted.
+ */
+void sym_eigen(const small_mat &A, std::vector<double> &vals, small_mat &vecs);
+
+}
+
+}
+
+#endif
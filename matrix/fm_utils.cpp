@@ -27,6 +27,7 @@
 #include "local_vv_store.h"
 #include "mem_vv_store.h"
 #include "EM_vector.h"
+#include "matrix_config.h"
 
 namespace fm
 {
@@ -908,6 +909,8 @@ void part_2d_apply_operate::run(const void *key, const local_vv_store &val,
 			data.append(single_nz_data.get_data(), single_nz_data.get_size());
 		// After we finish adding rows to a block, we need to finalize it.
 		block->finalize(data.get_data(), data.get_size() * nz_size);
+		if (matrix_conf.is_pack_sparse_blocks())
+			block->pack(nz_size);
 		if (!block->is_empty()) {
 			curr_size += block->get_size(nz_size);
 			block->verify(block_size);
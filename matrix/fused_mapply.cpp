@@ -0,0 +1,370 @@
+/*
+ * Copyright 2014 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of FlashMatrix.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unordered_map>
+
+#include <boost/format.hpp>
+
+#include "log.h"
+
+#include "fused_mapply.h"
+#include "mapply_matrix_store.h"
+#include "local_matrix_store.h"
+#include "matrix_stats.h"
+
+namespace fm
+{
+
+namespace detail
+{
+
+namespace
+{
+
+/*
+ * The number of elements in a tile. The intermediate results of a tile
+ * should stay in the L1/L2 cache.
+ */
+const size_t FUSE_TILE_LEN = 1024;
+
+/*
+ * This constructs the instructions of the fused operation by walking
+ * the tree of virtual matrices from the root.
+ */
+class fusion_builder
+{
+	matrix_layout_t layout;
+	size_t num_rows;
+	size_t num_cols;
+	std::vector<matrix_store::const_ptr> inputs;
+	std::unordered_map<const matrix_store *, size_t> input_idxs;
+	std::unordered_map<const matrix_store *, size_t> node_idxs;
+	std::vector<fused_instr> instrs;
+	bool valid;
+
+	fused_operand add_input(matrix_store::const_ptr mat);
+	fused_operand add_mat(matrix_store::const_ptr mat,
+			const scalar_type &expected_type);
+public:
+	fusion_builder(matrix_layout_t layout, size_t num_rows, size_t num_cols) {
+		this->layout = layout;
+		this->num_rows = num_rows;
+		this->num_cols = num_cols;
+		valid = true;
+	}
+
+	bool add_op(const std::vector<matrix_store::const_ptr> &in_mats,
+			const portion_mapply_op &op, size_t &idx);
+
+	bool is_valid() const {
+		return valid;
+	}
+
+	const std::vector<fused_instr> &get_instrs() const {
+		return instrs;
+	}
+
+	const std::vector<matrix_store::const_ptr> &get_inputs() const {
+		return inputs;
+	}
+};
+
+fused_operand fusion_builder::add_input(matrix_store::const_ptr mat)
+{
+	fused_operand operand;
+	operand.is_input = true;
+	auto it = input_idxs.find(mat.get());
+	if (it != input_idxs.end()) {
+		operand.idx = it->second;
+		return operand;
+	}
+
+	// All inputs are accessed with the same layout as the output.
+	if (mat->store_layout() != layout || mat->get_num_rows() != num_rows
+			|| mat->get_num_cols() != num_cols)
+		valid = false;
+	operand.idx = inputs.size();
+	input_idxs.insert(std::pair<const matrix_store *, size_t>(mat.get(),
+				operand.idx));
+	inputs.push_back(mat);
+	return operand;
+}
+
+fused_operand fusion_builder::add_mat(matrix_store::const_ptr mat,
+		const scalar_type &expected_type)
+{
+	auto it = node_idxs.find(mat.get());
+	if (it != node_idxs.end()) {
+		fused_operand operand;
+		operand.is_input = false;
+		operand.idx = it->second;
+		return operand;
+	}
+
+	mapply_matrix_store::const_ptr mapply_mat
+		= std::dynamic_pointer_cast<const mapply_matrix_store>(mat);
+	if (mapply_mat == NULL || mapply_mat->is_materialized()
+			|| mat->store_layout() != layout
+			|| mat->get_num_rows() != num_rows
+			|| mat->get_num_cols() != num_cols
+			|| mat->get_type() != expected_type)
+		return add_input(mat);
+
+	size_t idx;
+	if (!add_op(mapply_mat->get_input_mats(), *mapply_mat->get_portion_op(),
+				idx))
+		return add_input(mat);
+
+	node_idxs.insert(std::pair<const matrix_store *, size_t>(mat.get(), idx));
+	fused_operand operand;
+	operand.is_input = false;
+	operand.idx = idx;
+	return operand;
+}
+
+bool fusion_builder::add_op(const std::vector<matrix_store::const_ptr> &in_mats,
+		const portion_mapply_op &op, size_t &idx)
+{
+	fused_instr instr;
+	if (!op.get_elem_op(instr.desc))
+		return false;
+
+	instr.out_type = &op.get_output_type();
+	switch (instr.desc.type) {
+		case elem_op_desc::UNARY:
+			assert(in_mats.size() == 1);
+			instr.args[0] = add_mat(in_mats[0],
+					instr.desc.uop->get_input_type());
+			break;
+		case elem_op_desc::SCALAR:
+			assert(in_mats.size() == 1);
+			instr.args[0] = add_mat(in_mats[0],
+					instr.desc.bop->get_left_type());
+			break;
+		case elem_op_desc::BINARY:
+			assert(in_mats.size() == 2);
+			instr.args[0] = add_mat(in_mats[0],
+					instr.desc.bop->get_left_type());
+			instr.args[1] = add_mat(in_mats[1],
+					instr.desc.bop->get_right_type());
+			break;
+	}
+	// The instructions are in topological order, so an instruction
+	// always runs after the instructions it depends on.
+	idx = instrs.size();
+	instrs.push_back(instr);
+	return true;
+}
+
+/*
+ * This runs the instructions on a contiguous range of elements.
+ */
+class fused_runner
+{
+	const std::vector<fused_instr> &instrs;
+	// The intermediate result of each instruction in a tile.
+	std::vector<std::unique_ptr<char[]> > regs;
+	std::vector<size_t> in_entry_sizes;
+	size_t out_entry_size;
+
+	const char *get_arg(const fused_operand &arg,
+			const std::vector<const char *> &in_arrs, size_t off) const {
+		if (arg.is_input)
+			return in_arrs[arg.idx] + off * in_entry_sizes[arg.idx];
+		else
+			return regs[arg.idx].get();
+	}
+public:
+	fused_runner(const std::vector<fused_instr> &_instrs,
+			const std::vector<std::shared_ptr<const local_matrix_store> > &ins,
+			const local_matrix_store &out): instrs(_instrs) {
+		regs.resize(instrs.size());
+		// The last instruction writes to the output directly.
+		for (size_t i = 0; i < instrs.size() - 1; i++)
+			regs[i] = std::unique_ptr<char[]>(
+					new char[FUSE_TILE_LEN * instrs[i].out_type->get_size()]);
+		in_entry_sizes.resize(ins.size());
+		for (size_t i = 0; i < ins.size(); i++)
+			in_entry_sizes[i] = ins[i]->get_entry_size();
+		out_entry_size = out.get_entry_size();
+	}
+
+	void run(const std::vector<const char *> &in_arrs, char *out_arr,
+			size_t num_eles);
+};
+
+void fused_runner::run(const std::vector<const char *> &in_arrs,
+		char *out_arr, size_t num_eles)
+{
+	for (size_t off = 0; off < num_eles; off += FUSE_TILE_LEN) {
+		size_t len = std::min(FUSE_TILE_LEN, num_eles - off);
+		for (size_t i = 0; i < instrs.size(); i++) {
+			const fused_instr &instr = instrs[i];
+			char *res;
+			if (i == instrs.size() - 1)
+				res = out_arr + off * out_entry_size;
+			else
+				res = regs[i].get();
+			switch (instr.desc.type) {
+				case elem_op_desc::UNARY:
+					instr.desc.uop->runA(len,
+							get_arg(instr.args[0], in_arrs, off), res);
+					break;
+				case elem_op_desc::SCALAR:
+					instr.desc.bop->runAE(len,
+							get_arg(instr.args[0], in_arrs, off),
+							instr.desc.scalar->get_raw(), res);
+					break;
+				case elem_op_desc::BINARY:
+					instr.desc.bop->runAA(len,
+							get_arg(instr.args[0], in_arrs, off),
+							get_arg(instr.args[1], in_arrs, off), res);
+					break;
+			}
+		}
+	}
+}
+
+}
+
+fused_mapply_op::fused_mapply_op(size_t num_inputs,
+		const std::vector<fused_instr> &instrs, size_t out_num_rows,
+		size_t out_num_cols): portion_mapply_op(out_num_rows, out_num_cols,
+			*instrs.back().out_type)
+{
+	this->num_inputs = num_inputs;
+	this->instrs = instrs;
+}
+
+portion_mapply_op::const_ptr fused_mapply_op::transpose() const
+{
+	// Element-wise operations don't depend on the shape of the matrix.
+	return portion_mapply_op::const_ptr(new fused_mapply_op(num_inputs,
+				instrs, get_out_num_cols(), get_out_num_rows()));
+}
+
+void fused_mapply_op::run(
+		const std::vector<std::shared_ptr<const local_matrix_store> > &ins,
+		local_matrix_store &out) const
+{
+	assert(ins.size() == num_inputs);
+	size_t num_eles = out.get_num_rows() * out.get_num_cols();
+	for (size_t i = 0; i < instrs.size(); i++)
+		if (instrs[i].desc.type == elem_op_desc::SCALAR)
+			detail::matrix_stats.inc_multiplies(num_eles);
+
+	fused_runner runner(instrs, ins, out);
+	std::vector<const char *> in_arrs(ins.size());
+	bool all_raw = out.get_raw_arr() != NULL;
+	for (size_t i = 0; i < ins.size(); i++) {
+		assert(ins[i]->store_layout() == out.store_layout());
+		assert(ins[i]->get_num_rows() == out.get_num_rows());
+		assert(ins[i]->get_num_cols() == out.get_num_cols());
+		in_arrs[i] = ins[i]->get_raw_arr();
+		all_raw = all_raw && in_arrs[i];
+	}
+
+	// If all stores have data stored contiguously.
+	if (all_raw)
+		runner.run(in_arrs, out.get_raw_arr(), num_eles);
+	else if (out.store_layout() == matrix_layout_t::L_COL) {
+		local_col_matrix_store &col_out
+			= static_cast<local_col_matrix_store &>(out);
+		for (size_t j = 0; j < out.get_num_cols(); j++) {
+			for (size_t i = 0; i < ins.size(); i++)
+				in_arrs[i] = static_cast<const local_col_matrix_store &>(
+						*ins[i]).get_col(j);
+			runner.run(in_arrs, col_out.get_col(j), out.get_num_rows());
+		}
+	}
+	else {
+		assert(out.store_layout() == matrix_layout_t::L_ROW);
+		local_row_matrix_store &row_out
+			= static_cast<local_row_matrix_store &>(out);
+		for (size_t j = 0; j < out.get_num_rows(); j++) {
+			for (size_t i = 0; i < ins.size(); i++)
+				in_arrs[i] = static_cast<const local_row_matrix_store &>(
+						*ins[i]).get_row(j);
+			runner.run(in_arrs, row_out.get_row(j), out.get_num_cols());
+		}
+	}
+}
+
+std::string fused_mapply_op::to_string(
+		const std::vector<matrix_store::const_ptr> &mats) const
+{
+	assert(mats.size() == num_inputs);
+	std::vector<std::string> exprs(instrs.size());
+	for (size_t i = 0; i < instrs.size(); i++) {
+		const fused_instr &instr = instrs[i];
+		std::string args[2];
+		for (size_t k = 0; k < 2; k++) {
+			if (k == 1 && instr.desc.type != elem_op_desc::BINARY)
+				break;
+			if (instr.args[k].is_input)
+				args[k] = mats[instr.args[k].idx]->get_name();
+			else
+				args[k] = exprs[instr.args[k].idx];
+		}
+		switch (instr.desc.type) {
+			case elem_op_desc::UNARY:
+				exprs[i] = (boost::format("%1%(%2%)")
+						% instr.desc.uop->get_name() % args[0]).str();
+				break;
+			case elem_op_desc::SCALAR:
+				exprs[i] = (boost::format("%1%(%2%, %3%)")
+						% instr.desc.bop->get_name() % args[0]
+						% instr.desc.scalar->get_name()).str();
+				break;
+			case elem_op_desc::BINARY:
+				exprs[i] = (boost::format("%1%(%2%, %3%)")
+						% instr.desc.bop->get_name() % args[0] % args[1]).str();
+				break;
+		}
+	}
+	return std::string("fused(") + exprs.back() + ")";
+}
+
+portion_mapply_op::const_ptr fuse_mapply(
+		const std::vector<matrix_store::const_ptr> &in_mats,
+		portion_mapply_op::const_ptr op, matrix_layout_t layout,
+		std::vector<matrix_store::const_ptr> &fused_ins)
+{
+	fusion_builder builder(layout, op->get_out_num_rows(),
+			op->get_out_num_cols());
+	size_t idx;
+	if (!builder.add_op(in_mats, *op, idx) || !builder.is_valid())
+		return portion_mapply_op::const_ptr();
+	// There is nothing to fuse if the root operation runs on its
+	// input matrices directly.
+	if (builder.get_instrs().size() < 2)
+		return portion_mapply_op::const_ptr();
+
+	fused_ins = builder.get_inputs();
+	BOOST_LOG_TRIVIAL(debug) << boost::format(
+			"fuse %1% element-wise operations on %2% matrices")
+		% builder.get_instrs().size() % fused_ins.size();
+	return portion_mapply_op::const_ptr(new fused_mapply_op(fused_ins.size(),
+				builder.get_instrs(), op->get_out_num_rows(),
+				op->get_out_num_cols()));
+}
+
+}
+
+}
@@ -0,0 +1,92 @@
+#ifndef __FUSED_MAPPLY_H__
+#define __FUSED_MAPPLY_H__
+
+/*
+ * Copyright 2014 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of FlashMatrix.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <vector>
+
+#include "dense_matrix.h"
+
+namespace fm
+{
+
+namespace detail
+{
+
+/*
+ * An operand of a fused instruction. It's either an input matrix of
+ * the fused operation or the output of a previous instruction.
+ */
+struct fused_operand
+{
+	bool is_input;
+	size_t idx;
+};
+
+struct fused_instr
+{
+	elem_op_desc desc;
+	fused_operand args[2];
+	const scalar_type *out_type;
+};
+
+/*
+ * This operation runs a chain of element-wise operations in one pass.
+ * The instructions are interpreted on tiles that fit in CPU cache,
+ * so each element of the input matrices is read from memory once and
+ * the intermediate results never leave CPU cache.
+ */
+class fused_mapply_op: public portion_mapply_op
+{
+	size_t num_inputs;
+	std::vector<fused_instr> instrs;
+public:
+	fused_mapply_op(size_t num_inputs, const std::vector<fused_instr> &instrs,
+			size_t out_num_rows, size_t out_num_cols);
+
+	virtual portion_mapply_op::const_ptr transpose() const;
+
+	virtual void run(
+			const std::vector<std::shared_ptr<const local_matrix_store> > &ins,
+			local_matrix_store &out) const;
+
+	virtual std::string to_string(
+			const std::vector<matrix_store::const_ptr> &mats) const;
+
+	size_t get_num_instrs() const {
+		return instrs.size();
+	}
+};
+
+/*
+ * Flatten the element-wise operations that compute a mapply matrix into
+ * a single fused operation. The fused operation runs directly on
+ * `fused_ins'. It returns NULL if there is nothing to fuse.
+ */
+portion_mapply_op::const_ptr fuse_mapply(
+		const std::vector<matrix_store::const_ptr> &in_mats,
+		portion_mapply_op::const_ptr op, matrix_layout_t layout,
+		std::vector<matrix_store::const_ptr> &fused_ins);
+
+}
+
+}
+
+#endif
@@ -20,7 +20,11 @@
  * limitations under the License.
  */
 
-#include<unordered_map>
+#include <string.h>
+#include <stdint.h>
+
+#include <vector>
+#include <algorithm>
 
 #include "data_frame.h"
 #include "mem_vec_store.h"
@@ -48,15 +52,47 @@ public:
 	 * with the provided operator.
 	 */
 	virtual void merge(const generic_hashtable &table, const agg_operate &op) = 0;
+	/*
+	 * A hashtable is partitioned by the hash values of the keys, and
+	 * all hashtables of the same type are partitioned in the same way.
+	 * Therefore, different partitions can be merged by different threads.
+	 */
+	virtual size_t get_num_parts() const = 0;
+	virtual void merge_part(size_t part_id, const generic_hashtable &table,
+			const agg_operate &op) = 0;
+	virtual size_t get_size() const = 0;
 	/*
 	 * Convert the hashtable to a data frame.
 	 */
 	virtual data_frame::ptr conv2df() const = 0;
 };
 
+/*
+ * This is a hashtable with open addressing and linear probing.
+ * Keys and values are stored in flat arrays, so a lookup usually touches
+ * one or two cache lines. The table is partitioned by the high bits of
+ * the hash values, so each partition is small enough to stay in the CPU
+ * cache for a moderate number of groups, and the tables built by
+ * different threads can be merged partition by partition in parallel.
+ */
 template<class KeyType, int ValSize>
 class generic_hashtable_impl: public generic_hashtable
 {
+	// The number of bits used to choose a partition.
+	static const int PART_BITS = 6;
+	static const size_t NUM_PARTS = 1UL << PART_BITS;
+	static const size_t INIT_PART_SIZE = 64;
+	// The values that need to be combined with existing values are
+	// collected and combined in a batch.
+	static const size_t COMBINE_BATCH = 256;
+
+	enum slot_state {
+		EMPTY,
+		FULL,
+		// The value in the slot is waiting for combining in a batch.
+		PENDING,
+	};
+
 	const scalar_type &real_val_type;
 
 	/*
@@ -66,9 +102,142 @@ class generic_hashtable_impl: public generic_hashtable
 	typedef struct {
 		char data[ValSize];
 	} ValType;
-	std::unordered_map<KeyType, ValType> table;
+
+	struct partition
+	{
+		std::vector<KeyType> keys;
+		std::vector<ValType> vals;
+		std::vector<char> states;
+		size_t num_entries;
+
+		partition() {
+			num_entries = 0;
+		}
+	};
+	std::vector<partition> parts;
+
+	/*
+	 * The values to be combined with the existing values in a partition.
+	 */
+	struct combine_buf
+	{
+		std::vector<ValType> in_vals;
+		std::vector<ValType> orig_vals;
+		std::vector<size_t> slots;
+	};
+
+	static uint64_t hash(KeyType key) {
+		// 0.0 and -0.0 are equal but have different bits.
+		if (key == 0)
+			key = 0;
+		uint64_t bits = 0;
+		memcpy(&bits, &key, std::min(sizeof(key), sizeof(bits)));
+		// The finalizer of MurmurHash3 mixes all bits of the key.
+		bits ^= bits >> 33;
+		bits *= 0xff51afd7ed558ccdUL;
+		bits ^= bits >> 33;
+		bits *= 0xc4ceb9fe1a85ec53UL;
+		bits ^= bits >> 33;
+		return bits;
+	}
+
+	static size_t get_part_id(uint64_t hash_val) {
+		return hash_val >> (64 - PART_BITS);
+	}
+
+	void flush(partition &part, combine_buf &buf, const agg_operate &op) {
+		size_t num = buf.slots.size();
+		if (num == 0)
+			return;
+		for (size_t i = 0; i < num; i++)
+			buf.orig_vals[i] = part.vals[buf.slots[i]];
+		// runCombine aggregates all values into one, so we combine
+		// the values element-wise with the combine operator directly.
+		// It computes combine(in, orig) like runCombine.
+		op.get_combine().runAA(num, buf.in_vals.data(), buf.orig_vals.data(),
+				buf.orig_vals.data());
+		for (size_t i = 0; i < num; i++) {
+			part.vals[buf.slots[i]] = buf.orig_vals[i];
+			part.states[buf.slots[i]] = FULL;
+		}
+		buf.in_vals.clear();
+		buf.orig_vals.clear();
+		buf.slots.clear();
+	}
+
+	void resize(partition &part) {
+		size_t new_size = std::max(part.states.size() * 2, INIT_PART_SIZE);
+		std::vector<KeyType> old_keys;
+		std::vector<ValType> old_vals;
+		std::vector<char> old_states;
+		old_keys.swap(part.keys);
+		old_vals.swap(part.vals);
+		old_states.swap(part.states);
+		part.keys.resize(new_size);
+		part.vals.resize(new_size);
+		part.states.resize(new_size, EMPTY);
+		size_t mask = new_size - 1;
+		for (size_t i = 0; i < old_states.size(); i++) {
+			if (old_states[i] == EMPTY)
+				continue;
+			assert(old_states[i] == FULL);
+			size_t slot = hash(old_keys[i]) & mask;
+			while (part.states[slot] != EMPTY)
+				slot = (slot + 1) & mask;
+			part.keys[slot] = old_keys[i];
+			part.vals[slot] = old_vals[i];
+			part.states[slot] = FULL;
+		}
+	}
+
+	void insert(partition &part, uint64_t hash_val, KeyType key,
+			const ValType &val, combine_buf &buf, const agg_operate &op) {
+		// Keep the load factor under 0.5, so probe sequences are short.
+		if ((part.num_entries + 1) * 2 > part.states.size()) {
+			// The pending values refer to the slots in the partition.
+			flush(part, buf, op);
+			resize(part);
+		}
+		size_t mask = part.states.size() - 1;
+		size_t slot = hash_val & mask;
+		while (true) {
+			char state = part.states[slot];
+			if (state == EMPTY) {
+				part.keys[slot] = key;
+				part.vals[slot] = val;
+				part.states[slot] = FULL;
+				part.num_entries++;
+				return;
+			}
+			if (part.keys[slot] == key) {
+				// The slot has a pending value, so we have to combine it first.
+				if (state == PENDING)
+					flush(part, buf, op);
+				part.states[slot] = PENDING;
+				buf.in_vals.push_back(val);
+				buf.orig_vals.push_back(ValType());
+				buf.slots.push_back(slot);
+				if (buf.slots.size() >= COMBINE_BATCH)
+					flush(part, buf, op);
+				return;
+			}
+			slot = (slot + 1) & mask;
+		}
+	}
+
+	void merge_part(partition &part, const partition &from,
+			const agg_operate &op) {
+		combine_buf buf;
+		for (size_t i = 0; i < from.states.size(); i++) {
+			if (from.states[i] == EMPTY)
+				continue;
+			insert(part, hash(from.keys[i]), from.keys[i], from.vals[i], buf, op);
+		}
+		flush(part, buf, op);
+	}
 public:
 	generic_hashtable_impl(const scalar_type &type): real_val_type(type) {
+		parts.resize(NUM_PARTS);
 	}
 
 	void insert(size_t num, const void *pkeys, const void *pvals,
@@ -76,40 +245,67 @@ public:
 		const KeyType *keys = (const KeyType *) pkeys;
 		const ValType *vals = (const ValType *) pvals;
 		assert(op.has_combine());
+		// Partition the keys first, so we insert keys to a partition
+		// while the partition is in the CPU cache.
+		std::vector<std::vector<size_t> > part_idxs(NUM_PARTS);
+		std::vector<uint64_t> hash_vals(num);
 		for (size_t i = 0; i < num; i++) {
-			auto ret = table.insert(std::pair<KeyType, ValType>(keys[i],
-						vals[i]));
-			// TODO this is going to be slow.
-			if (!ret.second)
-				op.runCombine(1, &vals[i], &ret.first->second, &ret.first->second);
+			hash_vals[i] = hash(keys[i]);
+			part_idxs[get_part_id(hash_vals[i])].push_back(i);
+		}
+		combine_buf buf;
+		for (size_t part_id = 0; part_id < NUM_PARTS; part_id++) {
+			const std::vector<size_t> &idxs = part_idxs[part_id];
+			for (size_t j = 0; j < idxs.size(); j++)
+				insert(parts[part_id], hash_vals[idxs[j]], keys[idxs[j]],
+						vals[idxs[j]], buf, op);
+			flush(parts[part_id], buf, op);
 		}
 	}
 
 	virtual void merge(const generic_hashtable &gtable, const agg_operate &op) {
+		for (size_t i = 0; i < NUM_PARTS; i++)
+			merge_part(i, gtable, op);
+	}
+
+	virtual size_t get_num_parts() const {
+		return NUM_PARTS;
+	}
+
+	virtual void merge_part(size_t part_id, const generic_hashtable &gtable,
+			const agg_operate &op) {
 		const generic_hashtable_impl<KeyType, ValSize> &gtable1
 			= dynamic_cast<const generic_hashtable_impl<KeyType, ValSize> &>(
 					gtable);
 		assert(op.has_combine());
-		for (auto it = gtable1.table.begin(); it != gtable1.table.end(); it++) {
-			auto ret = table.insert(std::pair<KeyType, ValType>(it->first,
-						it->second));
-			if (!ret.second)
-				op.runCombine(1, &it->second, &ret.first->second,
-						&ret.first->second);
-		}
+		merge_part(parts[part_id], gtable1.parts[part_id], op);
+	}
+
+	virtual size_t get_size() const {
+		size_t size = 0;
+		for (size_t i = 0; i < NUM_PARTS; i++)
+			size += parts[i].num_entries;
+		return size;
 	}
 
 	virtual data_frame::ptr conv2df() const {
-		detail::smp_vec_store::ptr keys = detail::smp_vec_store::create(table.size(),
+		size_t size = get_size();
+		detail::smp_vec_store::ptr keys = detail::smp_vec_store::create(size,
 				get_scalar_type<KeyType>());
-		detail::smp_vec_store::ptr vals = detail::smp_vec_store::create(table.size(),
+		detail::smp_vec_store::ptr vals = detail::smp_vec_store::create(size,
 				real_val_type);
 		size_t vec_idx = 0;
-		for (auto it = table.begin(); it != table.end(); it++) {
-			keys->set<KeyType>(vec_idx, it->first);
-			vals->set<ValType>(vec_idx, it->second);
-			vec_idx++;
+		for (size_t i = 0; i < NUM_PARTS; i++) {
+			const partition &part = parts[i];
+			for (size_t j = 0; j < part.states.size(); j++) {
+				if (part.states[j] == EMPTY)
+					continue;
+				keys->set<KeyType>(vec_idx, part.keys[j]);
+				vals->set<ValType>(vec_idx, part.vals[j]);
+				vec_idx++;
+			}
 		}
+		assert(vec_idx == size);
 		data_frame::ptr ret = data_frame::create();
 		ret->add_vec("key", keys);
 		ret->add_vec("val", vals);
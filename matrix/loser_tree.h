@@ -0,0 +1,163 @@
+#ifndef __LOSER_TREE_H__
+#define __LOSER_TREE_H__
+
+/*
+ * Copyright 2014 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of FlashMatrix.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+
+#include <vector>
+#include <algorithm>
+
+namespace fm
+{
+
+namespace detail
+{
+
+/*
+ * A loser tree selects the smallest head among k sorted sources.
+ * An internal node keeps the loser of the match played in the node and
+ * the overall winner is kept in node 0. When the winner advances to its
+ * next element, only the matches on the path from its leaf to the root
+ * are replayed, so it takes log(k) comparisons, while a binary heap needs
+ * up to 2 * log(k) comparisons for the same operation.
+ *
+ * `Less' compares the current heads of two sources, identified by their
+ * indexes. Ties go to the source with the smaller index, so merging with
+ * the tree is stable.
+ */
+template<class Less>
+class loser_tree
+{
+	Less less;
+	// The number of leaves is rounded up to a power of two. The extra
+	// leaves are always exhausted.
+	size_t num_leaves;
+	size_t num_srcs;
+	std::vector<int> nodes;
+	std::vector<bool> active;
+
+	// Test if source `s1' wins the match against source `s2'.
+	bool wins(int s1, int s2) const {
+		if (!active[s2])
+			return true;
+		if (!active[s1])
+			return false;
+		if (less(s1, s2))
+			return true;
+		else if (less(s2, s1))
+			return false;
+		else
+			return s1 < s2;
+	}
+
+	void replay_winner() {
+		int winner = nodes[0];
+		for (size_t node = (winner + num_leaves) / 2; node > 0; node /= 2) {
+			if (!wins(winner, nodes[node]))
+				std::swap(winner, nodes[node]);
+		}
+		nodes[0] = winner;
+	}
+
+	int build(size_t node) {
+		if (node >= num_leaves)
+			return node - num_leaves;
+		int left = build(node * 2);
+		int right = build(node * 2 + 1);
+		if (wins(left, right)) {
+			nodes[node] = right;
+			return left;
+		}
+		else {
+			nodes[node] = left;
+			return right;
+		}
+	}
+public:
+	loser_tree(size_t num_srcs, const Less &_less): less(_less) {
+		this->num_srcs = num_srcs;
+		num_leaves = 1;
+		while (num_leaves < num_srcs)
+			num_leaves *= 2;
+		nodes.resize(num_leaves);
+		// All sources are exhausted at the beginning. The caller activates
+		// the sources with elements and builds the tree.
+		active.resize(num_leaves, false);
+		rebuild();
+	}
+
+	size_t get_num_srcs() const {
+		return num_srcs;
+	}
+
+	bool empty() const {
+		return nodes.empty() || !active[nodes[0]];
+	}
+
+	/*
+	 * The source with the smallest head. It's -1 if all sources are
+	 * exhausted.
+	 */
+	int top() const {
+		return empty() ? -1 : nodes[0];
+	}
+
+	/*
+	 * The winner has moved to its next element. The matches on its path
+	 * are replayed.
+	 */
+	void replay() {
+		assert(!empty());
+		replay_winner();
+	}
+
+	/*
+	 * The winner doesn't have any more elements.
+	 */
+	void pop() {
+		assert(!empty());
+		active[nodes[0]] = false;
+		replay_winner();
+	}
+
+	/*
+	 * Set whether a source has elements. The tree has to be rebuilt
+	 * after the sources are changed this way.
+	 */
+	void set_active(int src, bool val) {
+		assert((size_t) src < num_srcs);
+		active[src] = val;
+	}
+
+	/*
+	 * Replay all matches. This is used when the heads of multiple sources
+	 * have changed.
+	 */
+	void rebuild() {
+		nodes[0] = build(1);
+	}
+};
+
+}
+
+}
+
+#endif
@@ -22,6 +22,9 @@
 #include "vec_store.h"
 #include "local_mem_buffer.h"
 #include "dense_matrix.h"
+#include "fused_mapply.h"
+#include "matrix_config.h"
+#include "matrix_stats.h"
 
 namespace fm
 {
@@ -527,6 +530,7 @@ mapply_matrix_store::mapply_matrix_store(
 {
 	this->par_access = true;
 	this->cache_portion = true;
+	this->num_shared_refs = 0;
 	this->layout = layout;
 	this->op = op;
 }
@@ -553,9 +557,18 @@ matrix_store::const_ptr mapply_matrix_store::materialize(bool in_mem,
 			return matrix_store::const_ptr();
 		}
 	}
-	else
-		return __mapply_portion(in_mats, op, layout, in_mem, num_nodes,
-				par_access);
+	else if (matrix_conf.is_fuse_mapply()) {
+		// Run the chain of element-wise operations in one pass, so
+		// the intermediate virtual matrices aren't materialized.
+		std::vector<matrix_store::const_ptr> fused_ins;
+		portion_mapply_op::const_ptr fused_op = fuse_mapply(in_mats, op,
+				layout, fused_ins);
+		if (fused_op)
+			return __mapply_portion(fused_ins, fused_op, layout, in_mem,
+					num_nodes, par_access);
+	}
+	return __mapply_portion(in_mats, op, layout, in_mem, num_nodes,
+			par_access);
 }
 
 vec_store::const_ptr mapply_matrix_store::get_col_vec(off_t idx) const
@@ -588,6 +601,16 @@ matrix_store::const_ptr mapply_matrix_store::get_rows(
 	return res->get_rows(idxs);
 }
 
+materialize_level mapply_matrix_store::get_portion_mater_level() const
+{
+	// If the matrix is used by multiple operations, we keep the whole
+	// portion, so the operations can share the materialized data.
+	if (is_shared() && get_materialize_level() == materialize_level::MATER_CPU)
+		return materialize_level::MATER_MEM;
+	else
+		return get_materialize_level();
+}
+
 local_matrix_store::const_ptr mapply_matrix_store::get_portion(
 			size_t start_row, size_t start_col, size_t num_rows,
 			size_t num_cols) const
@@ -608,6 +631,8 @@ local_matrix_store::const_ptr mapply_matrix_store::get_portion(
 					&& ret->get_num_cols() == num_rows))) {
 		assert(ret->get_local_start_row() == 0);
 		assert(ret->get_local_start_col() == 0);
+		if (is_shared())
+			detail::matrix_stats.inc_shared_portion_hits(1);
 		return ret;
 	}
 
@@ -636,15 +661,15 @@ local_matrix_store::const_ptr mapply_matrix_store::get_portion(
 
 	if (store_layout() == matrix_layout_t::L_ROW)
 		ret = local_matrix_store::const_ptr(new lmapply_row_matrix_store(
-					get_materialize_level(), parts, *op, NULL, start_row,
+					get_portion_mater_level(), parts, *op, NULL, start_row,
 					start_col, num_rows, num_cols, get_type(),
 					parts.front()->get_node_id()));
 	else
 		ret = local_matrix_store::const_ptr(new lmapply_col_matrix_store(
-					get_materialize_level(), parts, *op, NULL, start_row,
+					get_portion_mater_level(), parts, *op, NULL, start_row,
 					start_col, num_rows, num_cols, get_type(),
 					parts.front()->get_node_id()));
-	if (cache_portion)
+	if (cache_portion || is_shared())
 		local_mem_buffer::cache_portion(data_id, ret);
 	return ret;
 }
@@ -716,6 +741,8 @@ async_cres_t mapply_matrix_store::get_portion_async(
 					&& ret1->get_num_cols() == num_rows))) {
 		assert(ret1->get_local_start_row() == 0);
 		assert(ret1->get_local_start_col() == 0);
+		if (is_shared())
+			detail::matrix_stats.inc_shared_portion_hits(1);
 		// In the asynchronous version, data in the portion isn't ready when
 		// the method is called. We should add the user's portion computation
 		// to the queue. When the data is ready, all user's portion computations
@@ -777,17 +804,17 @@ async_cres_t mapply_matrix_store::get_portion_async(
 	local_matrix_store::ptr ret;
 	if (store_layout() == matrix_layout_t::L_ROW)
 		ret = local_matrix_store::ptr(new lmapply_row_matrix_store(
-					get_materialize_level(), parts, *op, collect_compute,
+					get_portion_mater_level(), parts, *op, collect_compute,
 					start_row, start_col, num_rows, num_cols, get_type(),
 					parts.front()->get_node_id()));
 	else
 		ret = local_matrix_store::ptr(new lmapply_col_matrix_store(
-					get_materialize_level(), parts, *op, collect_compute,
+					get_portion_mater_level(), parts, *op, collect_compute,
 					start_row, start_col, num_rows, num_cols, get_type(),
 					parts.front()->get_node_id()));
 	if (collect_compute)
 		collect_compute->set_res_part(ret);
-	if (cache_portion)
+	if (cache_portion || is_shared())
 		local_mem_buffer::cache_portion(data_id, ret);
 	// If all parts are from the in-mem matrix store or have been cached by
 	// the underlying matrices, the data in the returned portion is immediately
@@ -872,6 +899,91 @@ void mapply_matrix_store::set_cache_portion(bool cache_portion)
 		const_cast<matrix_store &>(*in_mats[i]).set_cache_portion(cache_portion);
 }
 
+namespace
+{
+
+/*
+ * This counts the operations that use each virtual matrix in the DAG of
+ * a materialization. A matrix and its transpose share the same data,
+ * so they are identified by the data Id.
+ */
+class consumer_counter
+{
+	std::unordered_map<size_t, size_t> num_consumers;
+	std::unordered_map<size_t, std::vector<mapply_matrix_store::const_ptr> > mats;
+public:
+	void add_consumer(matrix_store::const_ptr mat);
+
+	void get_shared(std::vector<mapply_matrix_store::const_ptr> &shared) const;
+};
+
+void consumer_counter::add_consumer(matrix_store::const_ptr mat)
+{
+	mapply_matrix_store::const_ptr mapply_mat
+		= std::dynamic_pointer_cast<const mapply_matrix_store>(mat);
+	// We don't need to cache the portions of materialized matrices.
+	if (mapply_mat == NULL || mapply_mat->is_materialized())
+		return;
+
+	size_t data_id = mapply_mat->get_data_id();
+	auto it = num_consumers.find(data_id);
+	if (it != num_consumers.end()) {
+		it->second++;
+		// The same data may be accessed through its transpose.
+		std::vector<mapply_matrix_store::const_ptr> &vec = mats[data_id];
+		bool found = false;
+		for (size_t i = 0; i < vec.size(); i++)
+			found = found || vec[i] == mapply_mat;
+		if (!found)
+			vec.push_back(mapply_mat);
+		// We have visited the underlying matrices of the matrix.
+		return;
+	}
+
+	num_consumers.insert(std::pair<size_t, size_t>(data_id, 1));
+	mats[data_id].push_back(mapply_mat);
+	const std::vector<matrix_store::const_ptr> &in_mats
+		= mapply_mat->get_input_mats();
+	for (size_t i = 0; i < in_mats.size(); i++)
+		add_consumer(in_mats[i]);
+}
+
+void consumer_counter::get_shared(
+		std::vector<mapply_matrix_store::const_ptr> &shared) const
+{
+	for (auto it = num_consumers.begin(); it != num_consumers.end(); it++) {
+		if (it->second < 2)
+			continue;
+		auto mat_it = mats.find(it->first);
+		assert(mat_it != mats.end());
+		shared.insert(shared.end(), mat_it->second.begin(),
+				mat_it->second.end());
+	}
+}
+
+}
+
+shared_mapply_scope::shared_mapply_scope(
+		const std::vector<matrix_store::const_ptr> &in_mats)
+{
+	consumer_counter counter;
+	for (size_t i = 0; i < in_mats.size(); i++)
+		counter.add_consumer(in_mats[i]);
+	counter.get_shared(shared_mats);
+	for (size_t i = 0; i < shared_mats.size(); i++)
+		const_cast<mapply_matrix_store &>(*shared_mats[i]).inc_shared_refs();
+	if (!shared_mats.empty())
+		BOOST_LOG_TRIVIAL(debug) << boost::format(
+				"%1% virtual matrices are used by multiple operations")
+			% shared_mats.size();
+}
+
+shared_mapply_scope::~shared_mapply_scope()
+{
+	for (size_t i = 0; i < shared_mats.size(); i++)
+		const_cast<mapply_matrix_store &>(*shared_mats[i]).dec_shared_refs();
+}
+
 }
 
 }
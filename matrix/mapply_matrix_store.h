@@ -20,6 +20,8 @@
  * limitations under the License.
  */
 
+#include <atomic>
+
 #include "virtual_matrix_store.h"
 #include "dense_matrix.h"
 #include "mem_matrix_store.h"
@@ -63,6 +65,18 @@ class mapply_matrix_store: public virtual_matrix_store, public EM_object
 	portion_mapply_op::const_ptr op;
 	// The materialized result matrix.
 	matrix_store::const_ptr res;
+	/*
+	 * The number of materializations in which this matrix is used by
+	 * multiple operations. When it's positive, we materialize
+	 * the entire portion and keep it in the local memory buffer,
+	 * so the other operations don't compute it again.
+	 */
+	std::atomic<size_t> num_shared_refs;
+
+	bool is_shared() const {
+		return num_shared_refs > 0;
+	}
+	materialize_level get_portion_mater_level() const;
 public:
 	typedef std::shared_ptr<const mapply_matrix_store> const_ptr;
 
@@ -78,6 +92,31 @@ public:
 		this->par_access = par_access;
 	}
 
+	const std::vector<matrix_store::const_ptr> &get_input_mats() const {
+		return in_mats;
+	}
+
+	portion_mapply_op::const_ptr get_portion_op() const {
+		return op;
+	}
+
+	bool is_materialized() const {
+		return res != NULL;
+	}
+
+	size_t get_data_id() const {
+		return data_id;
+	}
+
+	void inc_shared_refs() {
+		num_shared_refs++;
+	}
+
+	void dec_shared_refs() {
+		assert(num_shared_refs > 0);
+		num_shared_refs--;
+	}
+
 	virtual void materialize_self() const;
 
 	virtual matrix_store::const_ptr materialize(bool in_mem,
@@ -115,6 +154,25 @@ public:
 	virtual std::unordered_map<size_t, size_t> get_underlying_mats() const;
 };
 
+/*
+ * This finds the virtual matrices used by multiple operations in
+ * a materialization. While the object is alive, their portions are
+ * materialized entirely and cached in the local memory buffer, so each of
+ * them is computed once in a portion regardless of the number of consumers.
+ * The cached portions are cleared when the materialization completes.
+ */
+class shared_mapply_scope
+{
+	std::vector<mapply_matrix_store::const_ptr> shared_mats;
+public:
+	shared_mapply_scope(const std::vector<matrix_store::const_ptr> &in_mats);
+	~shared_mapply_scope();
+
+	size_t get_num_shared() const {
+		return shared_mats.size();
+	}
+};
+
 }
 
 }
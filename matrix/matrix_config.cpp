@@ -47,8 +47,11 @@ void matrix_config::print_help()
 	printf("\tgroupby_buf_size: the buffer size for EM groupby on vectors\n");
 	printf("\tvv_groupby_buf_size: the buffer size for EM groupby on vector vectors\n");
 	printf("\twrite_io_buf_size: the I/O buffer size for writing merge results\n");
+	printf("\tsort_pipeline_depth: the number of sort buffers in flight in EM sorting\n");
 	printf("\tstream_io_size: the I/O size used for streaming\n");
 	printf("\tkeep_mem_buf: indicate whether to keep memory buffer for I/O in dense matrix operation\n");
+	printf("\tfuse_mapply: indicate whether to fuse element-wise operations in materialization\n");
+	printf("\tpack_sparse_blocks: indicate whether to pack col idxs in 2D sparse blocks\n");
 }
 
 void matrix_config::print()
@@ -68,8 +71,11 @@ void matrix_config::print()
 	BOOST_LOG_TRIVIAL(info) << "\tgroupby_buf_size: " << groupby_buf_size;
 	BOOST_LOG_TRIVIAL(info) << "\tvv_groupby_buf_size: " << vv_groupby_buf_size;
 	BOOST_LOG_TRIVIAL(info) << "\twrite_io_buf_size: " << write_io_buf_size;
+	BOOST_LOG_TRIVIAL(info) << "\tsort_pipeline_depth: " << sort_pipeline_depth;
 	BOOST_LOG_TRIVIAL(info) << "\tstream_io_size: " << stream_io_size;
 	BOOST_LOG_TRIVIAL(info) << "\tkeep_mem_buf: " << keep_mem_buf;
+	BOOST_LOG_TRIVIAL(info) << "\tfuse_mapply: " << fuse_mapply;
+	BOOST_LOG_TRIVIAL(info) << "\tpack_sparse_blocks: " << pack_sparse_blocks;
 }
 
 void matrix_config::init(config_map::ptr map)
@@ -93,12 +99,10 @@ void matrix_config::init(config_map::ptr map)
 		map->read_option_int("DM_threads", num_DM_threads);
 		init_DMT = true;
 	}
-#ifdef USE_HWLOC
 	if (!init_SpMT)
 		num_SpM_threads = cpus.get_num_cores();
 	if (!init_DMT)
 		num_DM_threads = cpus.get_num_cores();
-#endif
 
 	if (map->has_option("FM_prof_file"))
 		map->read_option("FM_prof_file", prof_file);
@@ -116,10 +120,8 @@ void matrix_config::init(config_map::ptr map)
 		map->read_option_bool("hilbert_order", hilbert_order);
 	if (map->has_option("num_nodes"))
 		map->read_option_int("num_nodes", num_nodes);
-#ifdef USE_HWLOC
 	else
 		num_nodes = cpus.get_num_nodes();
-#endif
 	BOOST_LOG_TRIVIAL(info) << boost::format(
 			"FlashMatrix runs on %1% threads and %2% NUMA nodes")
 		% num_DM_threads % num_nodes;
@@ -143,6 +145,8 @@ void matrix_config::init(config_map::ptr map)
 		map->read_option_long("write_io_buf_size", tmp);
 		write_io_buf_size = tmp;
 	}
+	if (map->has_option("sort_pipeline_depth"))
+		map->read_option_int("sort_pipeline_depth", sort_pipeline_depth);
 	if (map->has_option("stream_io_size")) {
 		long tmp = 0;
 		map->read_option_long("stream_io_size", tmp);
@@ -150,5 +154,9 @@ void matrix_config::init(config_map::ptr map)
 	}
 	if (map->has_option("keep_mem_buf"))
 		map->read_option_bool("keep_mem_buf", keep_mem_buf);
+	if (map->has_option("fuse_mapply"))
+		map->read_option_bool("fuse_mapply", fuse_mapply);
+	if (map->has_option("pack_sparse_blocks"))
+		map->read_option_bool("pack_sparse_blocks", pack_sparse_blocks);
 }
 }
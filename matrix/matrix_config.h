@@ -66,12 +66,21 @@ class matrix_config
 	// The I/O buffer size for writing merge results in sorting a vector.
 	// The number of bytes.
 	size_t write_io_buf_size;
+	// The number of sort buffers in flight in external-memory sorting.
+	// It determines how much reading, sorting/merging and writing overlap.
+	int sort_pipeline_depth;
 	// The I/O size used for streaming.
 	size_t stream_io_size;
 	// Indicate whether we keep the memory buffer for I/O in dense matrix
 	// operations. Allocating the memory buffer for every dense matrix operation
 	// is expensive.
 	bool keep_mem_buf;
+	// Indicate whether we fuse a chain of element-wise operations when
+	// a virtual matrix is materialized.
+	bool fuse_mapply;
+	// Indicate whether we pack the col idxs of the row parts in sparse
+	// blocks when a sparse matrix is constructed in the 2D format.
+	bool pack_sparse_blocks;
 public:
 	/**
 	 * \brief The default constructor that set all configurations to
@@ -91,8 +100,11 @@ public:
 		groupby_buf_size = 128 * 1024 * 1024;
 		vv_groupby_buf_size = 1024 * 1024;
 		write_io_buf_size = 128 * 1024 * 1024;
+		sort_pipeline_depth = 2;
 		stream_io_size = 128 * 1024 * 1024;
 		keep_mem_buf = false;
+		fuse_mapply = true;
+		pack_sparse_blocks = false;
 	}
 
 	/**
@@ -229,6 +241,14 @@ public:
 		return write_io_buf_size;
 	}
 
+	int get_sort_pipeline_depth() const {
+		return sort_pipeline_depth;
+	}
+
+	void set_sort_pipeline_depth(int depth) {
+		this->sort_pipeline_depth = depth;
+	}
+
 	size_t get_stream_io_size() const {
 		return stream_io_size;
 	}
@@ -236,6 +256,22 @@ public:
 	bool is_keep_mem_buf() const {
 		return keep_mem_buf;
 	}
+
+	bool is_fuse_mapply() const {
+		return fuse_mapply;
+	}
+
+	void set_fuse_mapply(bool fuse) {
+		fuse_mapply = fuse;
+	}
+
+	bool is_pack_sparse_blocks() const {
+		return pack_sparse_blocks;
+	}
+
+	void set_pack_sparse_blocks(bool pack) {
+		pack_sparse_blocks = pack;
+	}
 };
 
 extern matrix_config matrix_conf;
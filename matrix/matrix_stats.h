@@ -37,6 +37,15 @@ class matrix_stats_t
 	std::atomic<size_t> EM_read_bytes;
 	std::atomic<size_t> EM_write_bytes;
 	std::atomic<size_t> double_multiplies;
+	// The number of times that a cached portion of a virtual matrix used
+	// by multiple operations is reused instead of being computed again.
+	std::atomic<size_t> shared_portion_hits;
+	// The size of the row-part regions in the sparse blocks that are
+	// considered for packing, before and after packing. They are updated
+	// once per block when a sparse matrix is constructed, so they are
+	// maintained even without MATRIX_DEBUG.
+	std::atomic<size_t> rpart_bytes;
+	std::atomic<size_t> packed_rpart_bytes;
 public:
 	matrix_stats_t() {
 		mem_read_bytes = 0;
@@ -44,6 +53,9 @@ public:
 		EM_read_bytes = 0;
 		EM_write_bytes = 0;
 		double_multiplies = 0;
+		shared_portion_hits = 0;
+		rpart_bytes = 0;
+		packed_rpart_bytes = 0;
 	}
 
 	matrix_stats_t(const matrix_stats_t &stats) {
@@ -52,6 +64,9 @@ public:
 		EM_read_bytes = stats.EM_read_bytes.load();
 		EM_write_bytes = stats.EM_write_bytes.load();
 		double_multiplies = stats.double_multiplies.load();
+		shared_portion_hits = stats.shared_portion_hits.load();
+		rpart_bytes = stats.rpart_bytes.load();
+		packed_rpart_bytes = stats.packed_rpart_bytes.load();
 	}
 
 	size_t inc_read_bytes(size_t bytes, bool in_mem) {
@@ -123,6 +138,38 @@ public:
 #endif
 	}
 
+	size_t inc_shared_portion_hits(size_t hits) {
+#ifdef MATRIX_DEBUG
+		this->shared_portion_hits += hits;
+		return shared_portion_hits;
+#else
+		return 0;
+#endif
+	}
+
+	size_t get_shared_portion_hits() const {
+#ifdef MATRIX_DEBUG
+		return shared_portion_hits;
+#else
+		return 0;
+#endif
+	}
+
+	void inc_rpart_bytes(size_t orig_bytes, size_t packed_bytes) {
+		rpart_bytes += orig_bytes;
+		packed_rpart_bytes += packed_bytes;
+	}
+
+	/*
+	 * The compression ratio of the row-part regions in sparse blocks.
+	 */
+	double get_rpart_compress_ratio() const {
+		if (packed_rpart_bytes == 0)
+			return 1;
+		else
+			return ((double) rpart_bytes) / packed_rpart_bytes;
+	}
+
 	void print_diff(const matrix_stats_t &orig) const;
 };
 
@@ -19,6 +19,9 @@
 
 #include <unordered_map>
 
+#include <boost/format.hpp>
+
+#include "log.h"
 #include "io_interface.h"
 
 #include "matrix_config.h"
@@ -32,44 +35,28 @@ namespace fm
 namespace detail
 {
 
-#ifdef USE_HWLOC
-std::vector<int> get_cpus(int node_id)
-{
-	std::vector<int> io_cpus = safs::get_io_cpus();
-	std::vector<int> logical_units = cpus.get_node(node_id).get_logical_units();
-	std::set<int> cpu_set(logical_units.begin(), logical_units.end());
-	// Remove the logical units where I/O threads run.
-	for (size_t j = 0; j < io_cpus.size(); j++)
-		cpu_set.erase(io_cpus[j]);
-	return std::vector<int>(cpu_set.begin(), cpu_set.end());
-}
-#endif
-
 mem_thread_pool::mem_thread_pool(int num_nodes, int nthreads_per_node)
 {
 	tot_num_tasks = 0;
 	threads.resize(num_nodes);
 	for (int i = 0; i < num_nodes; i++) {
-		// Get the CPU cores that are in node i.
-#ifdef USE_HWLOC
-		std::vector<int> cpus = get_cpus(i);
-#endif
+		// Get the CPU cores in node i that aren't used by I/O threads.
+		std::vector<int> cpus = safs::get_worker_cpus(i);
+		if (!cpus.empty())
+			BOOST_LOG_TRIVIAL(info) << boost::format(
+					"%1% mem workers on node %2% run on %3% CPUs")
+				% nthreads_per_node % i % cpus.size();
 		threads[i].resize(nthreads_per_node);
 		for (int j = 0; j < nthreads_per_node; j++) {
 			std::string name
 				= std::string("mem-worker-") + itoa(i) + "-" + itoa(j);
-#ifdef USE_HWLOC
-			if (safs::get_io_cpus().empty())
+			if (cpus.empty())
 				threads[i][j] = std::shared_ptr<pool_task_thread>(
 						new pool_task_thread(i * nthreads_per_node + j, name, i));
 			else
 				threads[i][j] = std::shared_ptr<pool_task_thread>(
 						new pool_task_thread(i * nthreads_per_node + j, name,
 							cpus, i));
-#else
-			threads[i][j] = std::shared_ptr<pool_task_thread>(
-					new pool_task_thread(i * nthreads_per_node + j, name, i));
-#endif
 			threads[i][j]->start();
 		}
 	}
@@ -196,8 +183,11 @@ void io_worker_task::run()
 	safs::io_select::ptr select = safs::create_io_select(ios);
 
 	// The task runs until there are no tasks left in the queue.
-	while (dispatch->issue_task())
+	while (dispatch->issue_task()) {
 		wait4ios(select, max_pending_ios);
+		while (!dispatch->can_issue() && select->num_pending_ios() > 0)
+			select->wait4complete(1);
+	}
 	// Test if all I/O instances have processed all requests.
 	size_t num_pending = wait4ios(select, 0);
 	assert(num_pending == 0);
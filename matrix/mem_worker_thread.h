@@ -116,6 +116,13 @@ public:
 	 * This method must be thread-safe.
 	 */
 	virtual bool issue_task() = 0;
+	/*
+	 * A dispatcher may limit the number of tasks in flight. The worker
+	 * waits for I/O to complete until the dispatcher can issue more tasks.
+	 */
+	virtual bool can_issue() const {
+		return true;
+	}
 };
 
 class EM_object;
@@ -0,0 +1,311 @@
+#ifndef __RADIX_SORT_H__
+#define __RADIX_SORT_H__
+
+/*
+ * Copyright 2014 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of FlashMatrix.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+namespace fm
+{
+
+/*
+ * An LSD radix sort for primitive types. A value is transformed to
+ * an unsigned integer whose order is the same as the order of the values,
+ * and the integers are sorted by 8 bits in each pass. The sort is stable.
+ */
+namespace radix
+{
+
+// The arrays smaller than this are sorted with comparison sort.
+const size_t MIN_RADIX_SORT_LEN = 4096;
+const int RADIX_BITS = 8;
+const size_t NUM_BUCKETS = 1 << RADIX_BITS;
+
+/*
+ * This describes how to transform a value to an unsigned integer.
+ * Radix sort isn't used for the types not listed here.
+ */
+template<class T>
+struct key_traits
+{
+	static const bool supported = false;
+	typedef T key_t;
+};
+
+template<class T, class U>
+struct unsigned_traits
+{
+	static const bool supported = true;
+	typedef U key_t;
+	static key_t encode(T v) {
+		return v;
+	}
+	static T decode(key_t k) {
+		return k;
+	}
+};
+
+template<class T, class U>
+struct signed_traits
+{
+	static const bool supported = true;
+	typedef U key_t;
+	static const key_t SIGN_BIT = ((key_t) 1) << (sizeof(key_t) * 8 - 1);
+	// Flipping the sign bit moves negative values before positive ones.
+	static key_t encode(T v) {
+		return ((key_t) v) ^ SIGN_BIT;
+	}
+	static T decode(key_t k) {
+		return (T) (k ^ SIGN_BIT);
+	}
+};
+
+template<class T, class U>
+struct float_traits
+{
+	static const bool supported = true;
+	typedef U key_t;
+	static const key_t SIGN_BIT = ((key_t) 1) << (sizeof(key_t) * 8 - 1);
+	/*
+	 * Positive values only need to flip the sign bit. For negative values,
+	 * a larger magnitude means a smaller value, so all bits are flipped.
+	 */
+	static key_t encode(T v) {
+		key_t k;
+		memcpy(&k, &v, sizeof(k));
+		return (k & SIGN_BIT) ? ~k : (k | SIGN_BIT);
+	}
+	static T decode(key_t k) {
+		k = (k & SIGN_BIT) ? (k & ~SIGN_BIT) : ~k;
+		T v;
+		memcpy(&v, &k, sizeof(k));
+		return v;
+	}
+};
+
+template<> struct key_traits<char>: public signed_traits<char, uint8_t> {};
+template<> struct key_traits<short>: public signed_traits<short, uint16_t> {};
+template<> struct key_traits<int>: public signed_traits<int, uint32_t> {};
+template<> struct key_traits<long>: public signed_traits<long, uint64_t> {};
+template<> struct key_traits<unsigned char>
+	: public unsigned_traits<unsigned char, uint8_t> {};
+template<> struct key_traits<unsigned short>
+	: public unsigned_traits<unsigned short, uint16_t> {};
+template<> struct key_traits<unsigned int>
+	: public unsigned_traits<unsigned int, uint32_t> {};
+template<> struct key_traits<unsigned long>
+	: public unsigned_traits<unsigned long, uint64_t> {};
+template<> struct key_traits<float>: public float_traits<float, uint32_t> {};
+template<> struct key_traits<double>: public float_traits<double, uint64_t> {};
+
+inline size_t get_num_parts(bool parallel)
+{
+#if defined(_OPENMP)
+	if (parallel)
+		return omp_get_max_threads();
+#endif
+	return 1;
+}
+
+/*
+ * Sort the keys and optionally move the indexes with the keys.
+ * The sorted result is always written back to `keys' and `idxs'.
+ * Each pass splits the array into a part for each thread. A thread counts
+ * the digits in its part, and then scatters its part to the locations
+ * computed from the counts of all threads.
+ */
+template<class U>
+void sort_keys(U *keys, off_t *idxs, size_t num, bool parallel)
+{
+	const size_t num_passes = sizeof(U) * 8 / RADIX_BITS;
+	const size_t num_parts = get_num_parts(parallel);
+	const size_t part_len = (num + num_parts - 1) / num_parts;
+
+	std::unique_ptr<U[]> key_buf(new U[num]);
+	std::unique_ptr<off_t[]> idx_buf;
+	if (idxs)
+		idx_buf = std::unique_ptr<off_t[]>(new off_t[num]);
+	U *src = keys;
+	U *dst = key_buf.get();
+	off_t *idx_src = idxs;
+	off_t *idx_dst = idx_buf.get();
+	std::vector<size_t> counts(num_parts * NUM_BUCKETS);
+	// With a single part, the counts of all passes are computed in
+	// a single scan of the keys because the part always covers the whole
+	// array.
+	std::vector<size_t> pass_counts;
+	if (num_parts == 1) {
+		pass_counts.resize(num_passes * NUM_BUCKETS);
+		for (size_t i = 0; i < num; i++) {
+			U key = keys[i];
+			for (size_t pass = 0; pass < num_passes; pass++)
+				pass_counts[pass * NUM_BUCKETS
+					+ ((key >> (pass * RADIX_BITS)) & (NUM_BUCKETS - 1))]++;
+		}
+	}
+
+	for (size_t pass = 0; pass < num_passes; pass++) {
+		const int shift = pass * RADIX_BITS;
+		if (num_parts == 1)
+			memcpy(counts.data(), &pass_counts[pass * NUM_BUCKETS],
+					NUM_BUCKETS * sizeof(size_t));
+		else {
+#pragma omp parallel for if (parallel)
+			for (size_t part = 0; part < num_parts; part++) {
+				size_t start = part * part_len;
+				size_t end = std::min(start + part_len, num);
+				size_t part_counts[NUM_BUCKETS];
+				memset(part_counts, 0, sizeof(part_counts));
+				for (size_t i = start; i < end; i++)
+					part_counts[(src[i] >> shift) & (NUM_BUCKETS - 1)]++;
+				memcpy(&counts[part * NUM_BUCKETS], part_counts,
+						sizeof(part_counts));
+			}
+		}
+
+		// Compute where each part writes each digit. The digits are in
+		// the order of the buckets and then the order of the parts, so
+		// the sort is stable.
+		size_t off = 0;
+		bool one_bucket = false;
+		for (size_t bucket = 0; bucket < NUM_BUCKETS; bucket++) {
+			size_t bucket_size = 0;
+			for (size_t part = 0; part < num_parts; part++) {
+				size_t count = counts[part * NUM_BUCKETS + bucket];
+				counts[part * NUM_BUCKETS + bucket] = off;
+				off += count;
+				bucket_size += count;
+			}
+			one_bucket = one_bucket || bucket_size == num;
+		}
+		assert(off == num);
+		// All keys have the same digit, so this pass doesn't change
+		// the order.
+		if (one_bucket)
+			continue;
+
+#pragma omp parallel for if (parallel)
+		for (size_t part = 0; part < num_parts; part++) {
+			size_t start = part * part_len;
+			size_t end = std::min(start + part_len, num);
+			// A local copy of the offsets can't be aliased by the output.
+			size_t part_offs[NUM_BUCKETS];
+			memcpy(part_offs, &counts[part * NUM_BUCKETS], sizeof(part_offs));
+			if (idx_src) {
+				for (size_t i = start; i < end; i++) {
+					size_t loc = part_offs[(src[i] >> shift) & (NUM_BUCKETS - 1)]++;
+					dst[loc] = src[i];
+					idx_dst[loc] = idx_src[i];
+				}
+			}
+			else {
+				for (size_t i = start; i < end; i++) {
+					size_t loc = part_offs[(src[i] >> shift) & (NUM_BUCKETS - 1)]++;
+					dst[loc] = src[i];
+				}
+			}
+		}
+		std::swap(src, dst);
+		std::swap(idx_src, idx_dst);
+	}
+
+	if (src != keys) {
+		memcpy(keys, src, num * sizeof(U));
+		if (idxs)
+			memcpy(idxs, idx_src, num * sizeof(off_t));
+	}
+}
+
+/*
+ * Sort the values in place. If `idxs' isn't NULL, it's filled with
+ * the original locations of the sorted values.
+ */
+template<class T>
+void sort(T *data, off_t *idxs, size_t num, bool decreasing, bool parallel)
+{
+	typedef key_traits<T> traits;
+	typedef typename traits::key_t key_t;
+	static_assert(sizeof(key_t) == sizeof(T),
+			"the key has to have the same size as the value");
+	// The keys are stored in the space of the values.
+	key_t *keys = (key_t *) data;
+#pragma omp parallel for if (parallel)
+	for (size_t i = 0; i < num; i++) {
+		key_t k = traits::encode(data[i]);
+		// Reversing the order of the keys sorts values in decreasing order.
+		keys[i] = decreasing ? ~k : k;
+		if (idxs)
+			idxs[i] = i;
+	}
+	sort_keys(keys, idxs, num, parallel);
+#pragma omp parallel for if (parallel)
+	for (size_t i = 0; i < num; i++) {
+		key_t k = decreasing ? ~keys[i] : keys[i];
+		data[i] = traits::decode(k);
+	}
+}
+
+template<class T, bool supported = key_traits<T>::supported>
+struct dispatcher
+{
+	static bool sort(T *data, off_t *idxs, size_t num, bool decreasing,
+			bool parallel) {
+		return false;
+	}
+};
+
+template<class T>
+struct dispatcher<T, true>
+{
+	static bool sort(T *data, off_t *idxs, size_t num, bool decreasing,
+			bool parallel) {
+		if (num < MIN_RADIX_SORT_LEN)
+			return false;
+		radix::sort(data, idxs, num, decreasing, parallel);
+		return true;
+	}
+};
+
+/*
+ * This sorts the values with radix sort if the type is supported and
+ * the array is large enough. It returns false if the values aren't sorted.
+ */
+template<class T>
+bool try_sort(T *data, off_t *idxs, size_t num, bool decreasing,
+		bool parallel)
+{
+	return dispatcher<T>::sort(data, idxs, num, decreasing, parallel);
+}
+
+}
+
+}
+
+#endif
@@ -0,0 +1,115 @@
+/*
+ * Copyright 2014 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of FlashMatrix.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "simd_kernels.h"
+
+namespace fm
+{
+
+namespace simd
+{
+
+namespace
+{
+
+isa_t detect_isa()
+{
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+		return AVX512;
+	else if (__builtin_cpu_supports("avx2"))
+		return AVX2;
+	else
+		return SCALAR;
+}
+
+const isa_t cpu_isa = detect_isa();
+bool enabled = true;
+
+template<class T>
+class kernel_table
+{
+	kernels<T> ks;
+	bool valid;
+public:
+	kernel_table() {
+		memset(&ks, 0, sizeof(ks));
+		valid = true;
+		if (cpu_isa == AVX512)
+			avx512::init_kernels<T>(ks);
+		else if (cpu_isa == AVX2)
+			avx2::init_kernels<T>(ks);
+		else
+			valid = false;
+	}
+
+	const kernels<T> *get() const {
+		return valid ? &ks : NULL;
+	}
+};
+
+}
+
+template<class T>
+const kernels<T> *get_kernels()
+{
+	static kernel_table<T> table;
+	if (!enabled)
+		return NULL;
+	return table.get();
+}
+
+template const kernels<int> *get_kernels<int>();
+template const kernels<long> *get_kernels<long>();
+template const kernels<size_t> *get_kernels<size_t>();
+template const kernels<float> *get_kernels<float>();
+template const kernels<double> *get_kernels<double>();
+
+isa_t get_isa()
+{
+	return enabled ? cpu_isa : SCALAR;
+}
+
+const char *get_isa_name(isa_t isa)
+{
+	switch (isa) {
+		case AVX512:
+			return "AVX-512";
+		case AVX2:
+			return "AVX2";
+		default:
+			return "scalar";
+	}
+}
+
+void set_enabled(bool enabled)
+{
+	simd::enabled = enabled;
+}
+
+bool is_enabled()
+{
+	return enabled;
+}
+
+}
+
+}
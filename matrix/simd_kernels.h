@@ -0,0 +1,120 @@
+#ifndef __SIMD_KERNELS_H__
+#define __SIMD_KERNELS_H__
+
+/*
+ * Copyright 2014 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of FlashMatrix.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stddef.h>
+
+namespace fm
+{
+
+/*
+ * The vectorized kernels of the basic operators. The kernels are compiled
+ * for AVX2 and AVX-512 in separate source files, and the ones for the best
+ * instruction set supported by the CPU are chosen at runtime.
+ */
+namespace simd
+{
+
+enum op_kind
+{
+	ADD,
+	SUB,
+	MUL,
+	MIN,
+	MAX,
+	NUM_OPS,
+	// The operator doesn't have a vectorized kernel.
+	NONE,
+};
+
+enum uop_kind
+{
+	NEG,
+	ABS,
+	SQ,
+	NUM_UOPS,
+	UNONE,
+};
+
+enum isa_t
+{
+	SCALAR,
+	AVX2,
+	AVX512,
+};
+
+/*
+ * The kernels of a type. A kernel is NULL if it isn't supported.
+ */
+template<class T>
+struct kernels
+{
+	void (*runAA[NUM_OPS])(size_t num_eles, const T *left, const T *right,
+			T *out);
+	void (*runAE[NUM_OPS])(size_t num_eles, const T *left, T right, T *out);
+	void (*runEA[NUM_OPS])(size_t num_eles, T left, const T *right, T *out);
+	/*
+	 * Aggregate the array with `init'. The reduction uses multiple
+	 * independent accumulators, so the order of the operations is different
+	 * from aggregating the elements one by one.
+	 */
+	T (*agg[NUM_OPS])(size_t num_eles, const T *arr, T init);
+	void (*uop[NUM_UOPS])(size_t num_eles, const T *in, T *out);
+};
+
+/*
+ * Get the kernels of a type for the instruction set of the CPU.
+ * It returns NULL if there aren't kernels for the type or vectorized
+ * kernels are disabled.
+ */
+template<class T>
+const kernels<T> *get_kernels();
+
+isa_t get_isa();
+const char *get_isa_name(isa_t isa);
+
+/*
+ * Vectorized kernels are enabled by default if the CPU supports AVX2.
+ * This is mainly used for comparing the performance.
+ */
+void set_enabled(bool enabled);
+bool is_enabled();
+
+/*
+ * Each instruction set fills the kernels it supports.
+ */
+namespace avx2
+{
+template<class T>
+void init_kernels(kernels<T> &ks);
+}
+
+namespace avx512
+{
+template<class T>
+void init_kernels(kernels<T> &ks);
+}
+
+}
+
+}
+
+#endif
@@ -0,0 +1,334 @@
+/*
+ * Copyright 2014 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of FlashMatrix.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * This file is included by the source file of an instruction set, which
+ * defines SIMD_NS and SIMD_VEC_BYTES and is compiled with the flags of
+ * the instruction set.
+ *
+ * The file intentionally doesn't include any headers other than
+ * simd_kernels.h and only uses compiler builtins. Any inline function
+ * from another header would be compiled with the instruction set and
+ * the linker might pick that copy for the code that runs on all CPUs.
+ */
+
+#include "simd_kernels.h"
+
+#if !defined(SIMD_NS) || !defined(SIMD_VEC_BYTES)
+#error "SIMD_NS and SIMD_VEC_BYTES have to be defined"
+#endif
+
+namespace fm
+{
+
+namespace simd
+{
+
+namespace SIMD_NS
+{
+
+namespace
+{
+
+template<class T>
+struct vec
+{
+	typedef T type __attribute__((vector_size(SIMD_VEC_BYTES)));
+	static const size_t NUM_LANES = SIMD_VEC_BYTES / sizeof(T);
+};
+
+// The number of vectors processed in an iteration. The reduction keeps
+// an accumulator for each of them to hide the latency of the operations.
+const size_t NUM_ACCS = 4;
+
+template<class T>
+typename vec<T>::type load(const T *arr)
+{
+	typename vec<T>::type v;
+	__builtin_memcpy(&v, arr, sizeof(v));
+	return v;
+}
+
+template<class T>
+void store(T *arr, typename vec<T>::type v)
+{
+	__builtin_memcpy(arr, &v, sizeof(v));
+}
+
+template<class T>
+typename vec<T>::type broadcast(T val)
+{
+	typename vec<T>::type v;
+	for (size_t i = 0; i < vec<T>::NUM_LANES; i++)
+		v[i] = val;
+	return v;
+}
+
+/*
+ * The operators work on both scalars and vectors, so the same code
+ * processes the vectors and the remaining elements.
+ * MIN and MAX follow the scalar operators: they return the second
+ * argument if the comparison fails.
+ */
+struct add_op
+{
+	template<class V>
+	V operator()(V e1, V e2) const {
+		return e1 + e2;
+	}
+};
+
+struct sub_op
+{
+	template<class V>
+	V operator()(V e1, V e2) const {
+		return e1 - e2;
+	}
+};
+
+struct mul_op
+{
+	template<class V>
+	V operator()(V e1, V e2) const {
+		return e1 * e2;
+	}
+};
+
+struct min_op
+{
+	template<class V>
+	V operator()(V e1, V e2) const {
+		return e1 < e2 ? e1 : e2;
+	}
+};
+
+struct max_op
+{
+	template<class V>
+	V operator()(V e1, V e2) const {
+		return e1 > e2 ? e1 : e2;
+	}
+};
+
+struct neg_uop
+{
+	template<class V>
+	V operator()(V e) const {
+		return -e;
+	}
+};
+
+struct abs_uop
+{
+	template<class V>
+	V operator()(V e) const {
+		// 0 - e turns -0.0 to 0.0 as std::abs does.
+		V zero = e - e;
+		return e <= zero ? zero - e : e;
+	}
+};
+
+struct sq_uop
+{
+	template<class V>
+	V operator()(V e) const {
+		return e * e;
+	}
+};
+
+template<class T, class Op>
+void runAA(size_t num_eles, const T *left, const T *right, T *out)
+{
+	typedef typename vec<T>::type vec_t;
+	const size_t lanes = vec<T>::NUM_LANES;
+	Op op;
+	size_t i = 0;
+	for (; i + 2 * lanes <= num_eles; i += 2 * lanes) {
+		vec_t r0 = op(load(left + i), load(right + i));
+		vec_t r1 = op(load(left + i + lanes), load(right + i + lanes));
+		store(out + i, r0);
+		store(out + i + lanes, r1);
+	}
+	for (; i < num_eles; i++)
+		out[i] = op(left[i], right[i]);
+}
+
+template<class T, class Op>
+void runAE(size_t num_eles, const T *left, T right, T *out)
+{
+	typedef typename vec<T>::type vec_t;
+	const size_t lanes = vec<T>::NUM_LANES;
+	Op op;
+	vec_t vright = broadcast(right);
+	size_t i = 0;
+	for (; i + 2 * lanes <= num_eles; i += 2 * lanes) {
+		vec_t r0 = op(load(left + i), vright);
+		vec_t r1 = op(load(left + i + lanes), vright);
+		store(out + i, r0);
+		store(out + i + lanes, r1);
+	}
+	for (; i < num_eles; i++)
+		out[i] = op(left[i], right);
+}
+
+template<class T, class Op>
+void runEA(size_t num_eles, T left, const T *right, T *out)
+{
+	typedef typename vec<T>::type vec_t;
+	const size_t lanes = vec<T>::NUM_LANES;
+	Op op;
+	vec_t vleft = broadcast(left);
+	size_t i = 0;
+	for (; i + 2 * lanes <= num_eles; i += 2 * lanes) {
+		vec_t r0 = op(vleft, load(right + i));
+		vec_t r1 = op(vleft, load(right + i + lanes));
+		store(out + i, r0);
+		store(out + i + lanes, r1);
+	}
+	for (; i < num_eles; i++)
+		out[i] = op(left, right[i]);
+}
+
+template<class T, class Op>
+T agg(size_t num_eles, const T *arr, T init)
+{
+	typedef typename vec<T>::type vec_t;
+	const size_t lanes = vec<T>::NUM_LANES;
+	const size_t step = NUM_ACCS * lanes;
+	Op op;
+	if (num_eles < step) {
+		T res = init;
+		for (size_t i = 0; i < num_eles; i++)
+			res = op(arr[i], res);
+		return res;
+	}
+
+	vec_t accs[NUM_ACCS];
+	for (size_t k = 0; k < NUM_ACCS; k++)
+		accs[k] = load(arr + k * lanes);
+	size_t i = step;
+	for (; i + step <= num_eles; i += step) {
+		for (size_t k = 0; k < NUM_ACCS; k++)
+			accs[k] = op(load(arr + i + k * lanes), accs[k]);
+	}
+	for (size_t k = 1; k < NUM_ACCS; k++)
+		accs[0] = op(accs[k], accs[0]);
+	T res = init;
+	for (size_t k = 0; k < lanes; k++)
+		res = op((T) accs[0][k], res);
+	for (; i < num_eles; i++)
+		res = op(arr[i], res);
+	return res;
+}
+
+template<class T, class Op>
+void uop(size_t num_eles, const T *in, T *out)
+{
+	typedef typename vec<T>::type vec_t;
+	const size_t lanes = vec<T>::NUM_LANES;
+	Op op;
+	size_t i = 0;
+	for (; i + 2 * lanes <= num_eles; i += 2 * lanes) {
+		vec_t r0 = op(load(in + i));
+		vec_t r1 = op(load(in + i + lanes));
+		store(out + i, r0);
+		store(out + i + lanes, r1);
+	}
+	for (; i < num_eles; i++)
+		out[i] = op(in[i]);
+}
+
+template<class T, class Op>
+void set_op(kernels<T> &ks, op_kind kind)
+{
+	ks.runAA[kind] = runAA<T, Op>;
+	ks.runAE[kind] = runAE<T, Op>;
+	ks.runEA[kind] = runEA<T, Op>;
+	ks.agg[kind] = kind == SUB ? NULL : agg<T, Op>;
+}
+
+template<class T>
+void init_all(kernels<T> &ks)
+{
+	set_op<T, add_op>(ks, ADD);
+	set_op<T, sub_op>(ks, SUB);
+	set_op<T, mul_op>(ks, MUL);
+	set_op<T, min_op>(ks, MIN);
+	set_op<T, max_op>(ks, MAX);
+	ks.uop[NEG] = uop<T, neg_uop>;
+	ks.uop[ABS] = uop<T, abs_uop>;
+	ks.uop[SQ] = uop<T, sq_uop>;
+}
+
+}
+
+template<>
+void init_kernels<int>(kernels<int> &ks)
+{
+	init_all(ks);
+}
+
+template<>
+void init_kernels<long>(kernels<long> &ks)
+{
+	init_all(ks);
+	// There isn't a vectorized multiplication of 64-bit integers in AVX2.
+	ks.runAA[MUL] = NULL;
+	ks.runAE[MUL] = NULL;
+	ks.runEA[MUL] = NULL;
+	ks.agg[MUL] = NULL;
+	ks.uop[SQ] = NULL;
+}
+
+template<>
+void init_kernels<size_t>(kernels<size_t> &ks)
+{
+	init_all(ks);
+	ks.runAA[MUL] = NULL;
+	ks.runAE[MUL] = NULL;
+	ks.runEA[MUL] = NULL;
+	ks.agg[MUL] = NULL;
+	ks.uop[SQ] = NULL;
+	// Negation and abs aren't used on unsigned integers.
+	ks.uop[NEG] = NULL;
+	ks.uop[ABS] = NULL;
+}
+
+template<>
+void init_kernels<float>(kernels<float> &ks)
+{
+	init_all(ks);
+}
+
+template<>
+void init_kernels<double>(kernels<double> &ks)
+{
+	init_all(ks);
+	// The multiplication of doubles is computed in long double.
+	ks.runAA[MUL] = NULL;
+	ks.runAE[MUL] = NULL;
+	ks.runEA[MUL] = NULL;
+	ks.agg[MUL] = NULL;
+}
+
+}
+
+}
+
+}
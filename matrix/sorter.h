@@ -22,6 +22,9 @@
 
 #include <assert.h>
 #include <memory>
+
+#include "radix_sort.h"
+
 #if defined(_OPENMP)
 #include <parallel/algorithm>
 #else
@@ -100,6 +103,9 @@ void type_sorter<T>::sort_with_index(char *data1, off_t *offs, size_t num,
 		bool decreasing) const
 {
 	T *data = (T *) data1;
+	if (radix::try_sort(data, offs, num, decreasing, true))
+		return;
+
 	struct indexed_entry {
 		T val;
 		off_t idx;
@@ -148,6 +154,9 @@ template<class T>
 void type_sorter<T>::sort(char *data1, size_t num, bool decreasing) const
 {
 	T *data = (T *) data1;
+	if (radix::try_sort(data, (off_t *) NULL, num, decreasing, true))
+		return;
+
 	T *start = (T *) data;
 	T *end = start + num;
 #if defined(_OPENMP)
@@ -167,6 +176,9 @@ template<class T>
 void type_sorter<T>::serial_sort(char *data1, size_t num, bool decreasing) const
 {
 	T *data = (T *) data1;
+	if (radix::try_sort(data, (off_t *) NULL, num, decreasing, false))
+		return;
+
 	T *start = (T *) data;
 	T *end = start + num;
 	if (decreasing)
@@ -391,6 +391,19 @@ public:
 		size_t row_idx = it.get_rel_row_idx();
 		DenseType *dest_row = out_rows + ROW_WIDTH * row_idx;
 		bool has_val = it.get_entry_size() > 0;
+		// The col idxs of a packed row part are decoded as we go.
+		if (it.is_packed()) {
+			while (it.has_next()) {
+				SparseType data = 1;
+				if (has_val)
+					data = it.get_curr_data<SparseType>();
+				size_t col_idx = it.next_packed();
+				const DenseType *src_row = in_rows + ROW_WIDTH * col_idx;
+				for (size_t j = 0; j < ROW_WIDTH; j++)
+					dest_row[j] += src_row[j] * data;
+			}
+			return it;
+		}
 		while (it.has_next()) {
 			SparseType data = 1;
 			if (has_val)
@@ -420,6 +433,19 @@ public:
 		size_t row_idx = it.get_rel_row_idx();
 		DenseType *dest_row = out_rows + row_width * row_idx;
 		bool has_val = it.get_entry_size() > 0;
+		// The col idxs of a packed row part are decoded as we go.
+		if (it.is_packed()) {
+			while (it.has_next()) {
+				SparseType data = 1;
+				if (has_val)
+					data = it.get_curr_data<SparseType>();
+				size_t col_idx = it.next_packed();
+				const DenseType *src_row = in_rows + row_width * col_idx;
+				for (size_t j = 0; j < row_width; j++)
+					dest_row[j] += src_row[j] * data;
+			}
+			return it;
+		}
 		while (it.has_next()) {
 			SparseType data = 1;
 			if (has_val)
@@ -27,6 +27,7 @@
 #include "sparse_matrix_format.h"
 #include "matrix_config.h"
 #include "local_vec_store.h"
+#include "matrix_stats.h"
 
 namespace fm
 {
@@ -63,7 +64,7 @@ std::vector<coo_nz_t> sparse_block_2d::get_non_zeros(
 		const block_2d_size &block_size) const
 {
 	size_t row_begin = block_row_idx * block_size.get_num_rows();
-	size_t col_begin = block_col_idx * block_size.get_num_cols();
+	size_t col_begin = get_block_col_idx() * block_size.get_num_cols();
 	std::vector<coo_nz_t> ret;
 	if (has_rparts()) {
 		rp_edge_iterator it = get_first_edge_iterator();
@@ -130,6 +131,79 @@ void sparse_block_2d::finalize(const char *data, size_t num_bytes)
 		memcpy(get_nz_data(), data, num_bytes);
 }
 
+namespace
+{
+
+void append_uint16(std::vector<uint8_t> &buf, uint16_t val)
+{
+	size_t off = buf.size();
+	buf.resize(off + sizeof(val));
+	memcpy(buf.data() + off, &val, sizeof(val));
+}
+
+}
+
+bool sparse_block_2d::pack(size_t entry_size)
+{
+	if (is_packed() || !has_rparts())
+		return false;
+
+	const uint8_t escape = rp_edge_iterator::PACKED_ESCAPE;
+	std::vector<uint8_t> buf;
+	std::vector<uint16_t> cols;
+	rp_edge_iterator it = get_first_edge_iterator();
+	while (!is_rparts_end(it)) {
+		uint16_t rel_row_idx = it.get_rel_row_idx();
+		cols.clear();
+		while (it.has_next())
+			cols.push_back(it.next());
+		it = get_next_edge_iterator(it);
+		if (cols.empty())
+			continue;
+
+		append_uint16(buf, rel_row_idx | (1 << 15));
+		append_uint16(buf, cols.size());
+		append_uint16(buf, cols[0]);
+		size_t delta_start = buf.size();
+		for (size_t i = 1; i < cols.size(); i++) {
+			assert(cols[i] > cols[i - 1]);
+			uint16_t delta = cols[i] - cols[i - 1] - 1;
+			if (delta < escape)
+				buf.push_back(delta);
+			else {
+				buf.push_back(escape);
+				append_uint16(buf, delta);
+			}
+		}
+		// Keep the next row part aligned to uint16_t.
+		if ((buf.size() - delta_start) % 2)
+			buf.push_back(0);
+	}
+	// The empty row part that indicates the end of the row-part region.
+	append_uint16(buf, std::numeric_limits<uint16_t>::max());
+
+	size_t orig_rheader_size = get_rheader_size();
+	size_t packed_rheader_size = sizeof(uint32_t) + buf.size();
+	if (packed_rheader_size >= orig_rheader_size) {
+		detail::matrix_stats.inc_rpart_bytes(orig_rheader_size,
+				orig_rheader_size);
+		return false;
+	}
+
+	// Move the COO region and the non-zero values forward. Both of them
+	// are located after the row-part region.
+	size_t tail_size = num_coo_vals * sizeof(local_coo_t) + nnz * entry_size;
+	memmove(row_parts + packed_rheader_size, row_parts + orig_rheader_size,
+			tail_size);
+	uint32_t packed_size = buf.size();
+	memcpy(row_parts, &packed_size, sizeof(packed_size));
+	memcpy(row_parts + sizeof(packed_size), buf.data(), buf.size());
+	block_col_idx |= PACKED_FLAG;
+	detail::matrix_stats.inc_rpart_bytes(orig_rheader_size,
+			packed_rheader_size);
+	return true;
+}
+
 void SpM_2d_index::verify() const
 {
 	header.verify();
@@ -339,6 +413,23 @@ SpM_2d_storage::ptr SpM_2d_storage::create(const matrix_header &header,
 	return ptr(new SpM_2d_storage(data, index, "anonymous"));
 }
 
+SpM_2d_storage::ptr SpM_2d_storage::create(safs::NUMA_buffer::ptr data,
+		SpM_2d_index::ptr index)
+{
+	safs::NUMA_buffer::cdata_info header_data = data->get_data(0, PAGE_SIZE);
+	assert(header_data.first);
+	matrix_header *header = (matrix_header *) header_data.first;
+	header->verify();
+	return ptr(new SpM_2d_storage(data, index, "anonymous"));
+}
+
+safs::NUMA_buffer::ptr SpM_2d_storage::create_buf(size_t size)
+{
+	// The sparse matrix multiplication accesses data in pages.
+	NUMA_mapper mapper(safs::params.get_num_nodes(), MAT_CHUNK_SIZE_LOG);
+	return safs::NUMA_buffer::create(ROUNDUP(size, PAGE_SIZE), mapper);
+}
+
 safs::file_io_factory::shared_ptr SpM_2d_storage::create_io_factory() const
 {
 	return safs::file_io_factory::shared_ptr(new safs::in_mem_io_factory(
@@ -20,6 +20,8 @@
  * limitations under the License.
  */
 
+#include <string.h>
+
 #include "in_mem_io.h"
 #include "io_interface.h"
 
@@ -43,13 +45,37 @@ class rp_edge_iterator
 	// This points to the first non-zero entry in the row part.
 	const char *data_start;
 	size_t entry_size;
+
+	/*
+	 * The fields below are used only when the row part is packed.
+	 * A packed row part stores the number of entries and the first col idx
+	 * in uint16_t, followed by the deltas between adjacent col idxs.
+	 * A delta is stored as (delta - 1) in a byte. If it doesn't fit in
+	 * a byte, a byte of 0xFF is followed by (delta - 1) in uint16_t.
+	 * The delta bytes are padded to an even number of bytes.
+	 */
+	// This always points to the first delta byte of the row part.
+	const uint8_t *packed_start;
+	// This points to the delta byte of the next entry.
+	const uint8_t *packed_p;
+	uint16_t curr_col;
+	uint16_t num_remain;
+	// The number of entries that have been iterated.
+	uint16_t idx;
 public:
+	static const uint8_t PACKED_ESCAPE = 0xFF;
+
 	rp_edge_iterator() {
 		rel_row_idx = 0;
 		rel_col_idx_start = NULL;
 		rel_col_idx_p = NULL;
 		data_start = NULL;
 		entry_size = 0;
+		packed_start = NULL;
+		packed_p = NULL;
+		curr_col = 0;
+		num_remain = 0;
+		idx = 0;
 	}
 
 	rp_edge_iterator(uint16_t rel_row_idx, uint16_t *rel_col_idx_start) {
@@ -58,6 +84,11 @@ public:
 		this->rel_col_idx_p = rel_col_idx_start;
 		this->data_start = NULL;
 		this->entry_size = 0;
+		packed_start = NULL;
+		packed_p = NULL;
+		curr_col = 0;
+		num_remain = 0;
+		idx = 0;
 	}
 
 	rp_edge_iterator(uint16_t rel_row_idx, uint16_t *rel_col_idx_start,
@@ -67,10 +98,38 @@ public:
 		this->rel_col_idx_p = rel_col_idx_start;
 		this->data_start = data_start;
 		this->entry_size = entry_size;
+		packed_start = NULL;
+		packed_p = NULL;
+		curr_col = 0;
+		num_remain = 0;
+		idx = 0;
+	}
+
+	/*
+	 * This iterates a packed row part. `packed' points to the number of
+	 * entries in the row part.
+	 */
+	rp_edge_iterator(uint16_t rel_row_idx, const uint8_t *packed,
+			const char *data_start, size_t entry_size) {
+		this->rel_row_idx = rel_row_idx;
+		this->rel_col_idx_start = NULL;
+		this->rel_col_idx_p = NULL;
+		this->data_start = data_start;
+		this->entry_size = entry_size;
+		const uint16_t *header = (const uint16_t *) packed;
+		num_remain = header[0];
+		curr_col = header[1];
+		packed_start = packed + 2 * sizeof(uint16_t);
+		packed_p = packed_start;
+		idx = 0;
 	}
 
 	bool is_valid() const {
-		return rel_col_idx_start != NULL;
+		return rel_col_idx_start != NULL || packed_start != NULL;
+	}
+
+	bool is_packed() const {
+		return packed_start != NULL;
 	}
 
 	size_t get_rel_row_idx() const {
@@ -78,7 +137,10 @@ public:
 	}
 
 	off_t get_offset() const {
-		return rel_col_idx_p - rel_col_idx_start;
+		if (packed_start)
+			return idx;
+		else
+			return rel_col_idx_p - rel_col_idx_start;
 	}
 
 	size_t get_entry_size() const {
@@ -86,40 +148,72 @@ public:
 	}
 
 	bool has_next() const {
+		if (packed_start)
+			return num_remain > 0;
 		// The highest bit of the relative col idx has to be 0.
 		return *rel_col_idx_p <= (size_t) std::numeric_limits<int16_t>::max();
 	};
 
 	// This returns the relative column index.
 	size_t get_curr() const {
+		if (packed_start)
+			return curr_col;
 		return *rel_col_idx_p;
 	}
 
 	template<class T>
 	T get_curr_data() const {
 		assert(data_start && entry_size == sizeof(T));
-		return *(((const T *) data_start) + (rel_col_idx_p - rel_col_idx_start));
+		return *(((const T *) data_start) + get_offset());
 	}
 
 	// This returns the relative column index.
 	size_t next() {
+		if (packed_start)
+			return next_packed();
 		size_t ret = *rel_col_idx_p;
 		rel_col_idx_p++;
 		return ret;
 	}
 
+	size_t next_packed() {
+		size_t ret = curr_col;
+		idx++;
+		num_remain--;
+		if (num_remain > 0) {
+			uint8_t delta = *packed_p++;
+			if (delta == PACKED_ESCAPE) {
+				uint16_t long_delta;
+				memcpy(&long_delta, packed_p, sizeof(long_delta));
+				packed_p += sizeof(long_delta);
+				curr_col += long_delta + 1;
+			}
+			else
+				curr_col += delta + 1;
+		}
+		return ret;
+	}
+
 	void append(const block_2d_size &block_size, size_t col_idx) {
 		*rel_col_idx_p = col_idx & block_size.get_ncol_mask();
 		assert(*rel_col_idx_p <= (size_t) std::numeric_limits<int16_t>::max());
 		rel_col_idx_p++;
 	}
 
+	/*
+	 * For a packed row part, this is valid only after all entries
+	 * have been iterated.
+	 */
 	const char *get_curr_addr() const {
+		if (packed_start) {
+			size_t consumed = packed_p - packed_start;
+			return (const char *) (packed_start + consumed + (consumed & 1));
+		}
 		return (const char *) rel_col_idx_p;
 	}
 
 	const char *get_curr_data() const {
-		return data_start + (rel_col_idx_p - rel_col_idx_start) * entry_size;
+		return data_start + get_offset() * entry_size;
 	}
 };
 
@@ -178,6 +272,12 @@ public:
 		return rp_edge_iterator(get_rel_row_idx(), rel_col_idxs, data,
 				entry_size);
 	}
+
+	rp_edge_iterator get_packed_edge_iterator(const char *data,
+			size_t entry_size) const {
+		return rp_edge_iterator(get_rel_row_idx(),
+				(const uint8_t *) rel_col_idxs, data, entry_size);
+	}
 };
 
 /*
@@ -224,6 +324,10 @@ class sparse_block_2d
 	// This is where the row parts are serialized.
 	char row_parts[0];
 
+	// The highest bit of the block col idx indicates that the row parts
+	// in the block are packed.
+	static const uint32_t PACKED_FLAG = 1U << 31;
+
 	// The 2D-partitioned block has to be allowed in the heap. The copy
 	// constructor doesn't make sense for it.
 	sparse_block_2d(const sparse_block_2d &block) = delete;
@@ -232,12 +336,8 @@ class sparse_block_2d
 	 * Row header size including the COO region.
 	 */
 	size_t get_rindex_size() const {
-		// The space used by row ids.
-		return nrow * sparse_row_part::get_row_id_size()
-			// The space used by col index entries in the row part.
-			+ nnz * sparse_row_part::get_col_entry_size()
-			// The empty row part that indicates the end of row-part region.
-			+ sparse_row_part::get_row_id_size();
+		// The COO region follows the row-part region.
+		return get_rheader_size() + num_coo_vals * sizeof(local_coo_t);
 		// TODO should I align to the size of non-zero entry type?
 	}
 
@@ -245,6 +345,9 @@ class sparse_block_2d
 	 * The row header size excluding the COO region.
 	 */
 	size_t get_rheader_size() const {
+		// The packed row-part region starts with its size in bytes.
+		if (is_packed())
+			return sizeof(uint32_t) + *(const uint32_t *) row_parts;
 		// The space used by row ids. The empty row part is also included.
 		return (nrow - num_coo_vals) * sparse_row_part::get_row_id_size()
 			// The space used by col index entries in the row part.
@@ -253,6 +356,10 @@ class sparse_block_2d
 			+ sparse_row_part::get_row_id_size();
 	}
 
+	const char *get_rparts_start() const {
+		return is_packed() ? row_parts + sizeof(uint32_t) : row_parts;
+	}
+
 	sparse_row_part *get_rpart_end() {
 		return (sparse_row_part *) (row_parts + get_rheader_size()
 				// Let's exclude the last empty row part.
@@ -289,7 +396,11 @@ public:
 	}
 
 	size_t get_block_col_idx() const {
-		return block_col_idx;
+		return block_col_idx & ~PACKED_FLAG;
+	}
+
+	bool is_packed() const {
+		return block_col_idx & PACKED_FLAG;
 	}
 
 	bool is_empty() const {
@@ -312,29 +423,25 @@ public:
 	}
 
 	rp_edge_iterator get_first_edge_iterator() const {
-		assert(has_rparts());
-		// Discard the const qualifier
-		// TODO I should make a const edge iterator
-		sparse_row_part *rp = (sparse_row_part *) row_parts;
-		return rp->get_edge_iterator();
+		return get_first_edge_iterator(0);
 	}
 
 	rp_edge_iterator get_first_edge_iterator(size_t entry_size) const {
 		assert(has_rparts());
 		// Discard the const qualifier
 		// TODO I should make a const edge iterator
-		sparse_row_part *rp = (sparse_row_part *) row_parts;
-		if (entry_size == 0)
+		sparse_row_part *rp = (sparse_row_part *) get_rparts_start();
+		const char *data = entry_size == 0 ? NULL : get_nz_data();
+		if (is_packed())
+			return rp->get_packed_edge_iterator(data, entry_size);
+		else if (entry_size == 0)
 			return rp->get_edge_iterator();
 		else
-			return rp->get_edge_iterator(get_nz_data(), entry_size);
+			return rp->get_edge_iterator(data, entry_size);
 	}
 
 	rp_edge_iterator get_next_edge_iterator(const rp_edge_iterator &it) const {
-		assert(!it.has_next());
-		// TODO I should make a const edge iterator
-		sparse_row_part *rp = (sparse_row_part *) it.get_curr_addr();
-		return rp->get_edge_iterator();
+		return get_next_edge_iterator(it, 0);
 	}
 
 	rp_edge_iterator get_next_edge_iterator(const rp_edge_iterator &it,
@@ -342,10 +449,15 @@ public:
 		assert(!it.has_next());
 		// TODO I should make a const edge iterator
 		sparse_row_part *rp = (sparse_row_part *) it.get_curr_addr();
-		if (entry_size == 0)
+		const char *data = entry_size == 0 ? NULL : it.get_curr_data();
+		// The end of the packed row-part region is a regular empty row part,
+		// so is_rparts_end() works on the iterator of the empty row part.
+		if (is_packed() && rp != get_rpart_end())
+			return rp->get_packed_edge_iterator(data, entry_size);
+		else if (entry_size == 0)
 			return rp->get_edge_iterator();
 		else
-			return rp->get_edge_iterator(it.get_curr_data(), entry_size);
+			return rp->get_edge_iterator(data, entry_size);
 	}
 
 	bool is_rparts_end(const rp_edge_iterator &it) const {
@@ -381,6 +493,14 @@ public:
 	 */
 	void finalize(const char *data, size_t num_bytes);
 
+	/*
+	 * Pack the col idxs of the row parts with delta encoding after
+	 * the block is finalized. The COO region and the non-zero values
+	 * are kept as they are. The block is only packed if it saves space,
+	 * so the block never grows. It returns true if the block is packed.
+	 */
+	bool pack(size_t entry_size);
+
 	/*
 	 * Get all non-zero entries in the block.
 	 * This is used for testing only.
@@ -508,6 +628,15 @@ public:
 			SpM_2d_index::ptr index);
 	static ptr create(const matrix_header &header, const vector_vector &vv,
 			SpM_2d_index::ptr index);
+	/*
+	 * The matrix has been constructed in the buffer in the 2D format and
+	 * the matrix header is at the beginning of the buffer.
+	 */
+	static ptr create(safs::NUMA_buffer::ptr data, SpM_2d_index::ptr index);
+	/*
+	 * Allocate a buffer for a sparse matrix of `size' bytes in memory.
+	 */
+	static safs::NUMA_buffer::ptr create_buf(size_t size);
 
 	static void verify(SpM_2d_index::ptr index, const std::string &mat_file);
 
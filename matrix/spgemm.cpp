@@ -0,0 +1,1157 @@
+/*
+ * Copyright 2014 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of FlashMatrix.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+
+#include <atomic>
+#include <limits>
+#include <unordered_map>
+#include <deque>
+#include <algorithm>
+
+#include "in_mem_storage.h"
+
+#include "spgemm.h"
+#include "mem_worker_thread.h"
+#include "local_vec_store.h"
+#include "EM_vector.h"
+#include "matrix_config.h"
+
+namespace fm
+{
+
+namespace
+{
+
+// A row in the left matrix with at most this many non-zero entries is
+// accumulated with a heap in SPGEMM_ACC_AUTO.
+const size_t HEAP_MAX_ROW_NNZ = 8;
+// The number of output block rows that each thread computes in a window
+// in the external-memory mode.
+const size_t EM_BROWS_PER_THREAD = 4;
+// The maximal number of block rows of the right matrix that a thread
+// reads at the same time.
+const size_t MAX_BROW_READS = 16;
+// An empty slot in the hash table.
+const size_t EMPTY = std::numeric_limits<size_t>::max();
+
+/*
+ * A block row in the CSR format. The row indexes are relative to
+ * the beginning of the block row and the column indexes are global.
+ * The binary matrices don't have values.
+ */
+template<class T>
+struct csr_block_row
+{
+	typedef std::shared_ptr<csr_block_row<T> > ptr;
+
+	std::vector<size_t> row_ptrs;
+	std::vector<size_t> cols;
+	std::vector<T> vals;
+
+	csr_block_row() {
+		row_ptrs.push_back(0);
+	}
+
+	size_t get_num_rows() const {
+		return row_ptrs.size() - 1;
+	}
+
+	size_t get_row_nnz(size_t row) const {
+		return row_ptrs[row + 1] - row_ptrs[row];
+	}
+
+	void clear() {
+		row_ptrs.resize(1);
+		cols.clear();
+		vals.clear();
+	}
+
+	void finish_row() {
+		row_ptrs.push_back(cols.size());
+	}
+};
+
+/*
+ * Decode a block row in the 2D format to the CSR format.
+ */
+template<class T>
+void decode_block_row(const char *data, size_t size, size_t num_rows,
+		size_t entry_size, const block_2d_size &block_size,
+		csr_block_row<T> &rows)
+{
+	std::vector<size_t> &row_ptrs = rows.row_ptrs;
+	row_ptrs.clear();
+	row_ptrs.resize(num_rows + 1);
+	const sparse_block_2d *first = (const sparse_block_2d *) data;
+	const sparse_block_2d *end = (const sparse_block_2d *) (data + size);
+
+	// Count the non-zero entries in each row first.
+	block_row_iterator count_it(first, end);
+	while (count_it.has_next()) {
+		const sparse_block_2d &block = count_it.next(entry_size);
+		if (block.is_empty())
+			continue;
+		if (block.has_rparts()) {
+			rp_edge_iterator it = block.get_first_edge_iterator(entry_size);
+			while (!block.is_rparts_end(it)) {
+				size_t row_idx = it.get_rel_row_idx();
+				assert(row_idx < num_rows);
+				while (it.has_next()) {
+					it.next();
+					row_ptrs[row_idx + 1]++;
+				}
+				it = block.get_next_edge_iterator(it, entry_size);
+			}
+		}
+		const local_coo_t *coos = block.get_coo_start();
+		for (size_t i = 0; i < block.get_num_coo_vals(); i++)
+			row_ptrs[coos[i].get_row_idx() + 1]++;
+	}
+	for (size_t i = 0; i < num_rows; i++)
+		row_ptrs[i + 1] += row_ptrs[i];
+
+	size_t nnz = row_ptrs[num_rows];
+	rows.cols.resize(nnz);
+	rows.vals.resize(entry_size > 0 ? nnz : 0);
+	// The blocks are ordered by the block column index and the entries in
+	// a row part are sorted, so the columns of a row are sorted.
+	std::vector<size_t> locs(row_ptrs.begin(), row_ptrs.end() - 1);
+	block_row_iterator fill_it(first, end);
+	while (fill_it.has_next()) {
+		const sparse_block_2d &block = fill_it.next(entry_size);
+		if (block.is_empty())
+			continue;
+		size_t col_start = block.get_block_col_idx() * block_size.get_num_cols();
+		if (block.has_rparts()) {
+			rp_edge_iterator it = block.get_first_edge_iterator(entry_size);
+			while (!block.is_rparts_end(it)) {
+				size_t row_idx = it.get_rel_row_idx();
+				while (it.has_next()) {
+					size_t loc = locs[row_idx]++;
+					if (entry_size > 0)
+						rows.vals[loc] = it.get_curr_data<T>();
+					rows.cols[loc] = col_start + it.next();
+				}
+				it = block.get_next_edge_iterator(it, entry_size);
+			}
+		}
+		const local_coo_t *coos = block.get_coo_start();
+		const T *coo_vals = NULL;
+		if (entry_size > 0)
+			coo_vals = (const T *) block.get_coo_val_start(entry_size);
+		for (size_t i = 0; i < block.get_num_coo_vals(); i++) {
+			size_t loc = locs[coos[i].get_row_idx()]++;
+			rows.cols[loc] = col_start + coos[i].get_col_idx();
+			if (coo_vals)
+				rows.vals[loc] = coo_vals[i];
+		}
+	}
+}
+
+/*
+ * A hash table with open addressing that accumulates a row of
+ * the output matrix.
+ */
+template<class T>
+class hash_accumulator
+{
+	std::vector<size_t> keys;
+	std::vector<T> vals;
+	// The slots that have been used.
+	std::vector<size_t> used;
+	size_t mask;
+	int shift;
+
+	size_t get_slot(size_t col) const {
+		size_t slot = (col * 0x9E3779B97F4A7C15UL) >> shift;
+		while (keys[slot] != EMPTY && keys[slot] != col)
+			slot = (slot + 1) & mask;
+		return slot;
+	}
+public:
+	hash_accumulator() {
+		mask = 0;
+		shift = 64;
+	}
+
+	/*
+	 * Prepare the hash table for a row with at most `max_nnz' entries.
+	 */
+	void reset(size_t max_nnz) {
+		for (size_t i = 0; i < used.size(); i++)
+			keys[used[i]] = EMPTY;
+		used.clear();
+
+		// Keep the load factor under 0.5.
+		int bits = 4;
+		while ((1UL << bits) < max_nnz * 2)
+			bits++;
+		size_t size = 1UL << bits;
+		if (keys.size() < size) {
+			keys.resize(size, EMPTY);
+			vals.resize(size);
+		}
+		mask = size - 1;
+		shift = 64 - bits;
+	}
+
+	void insert(size_t col) {
+		size_t slot = get_slot(col);
+		if (keys[slot] == EMPTY) {
+			keys[slot] = col;
+			used.push_back(slot);
+		}
+	}
+
+	void add(size_t col, T val) {
+		size_t slot = get_slot(col);
+		if (keys[slot] == EMPTY) {
+			keys[slot] = col;
+			vals[slot] = val;
+			used.push_back(slot);
+		}
+		else
+			vals[slot] += val;
+	}
+
+	/*
+	 * Append the columns in the table to the output. The columns aren't
+	 * sorted. This is enough for the symbolic phase.
+	 */
+	void get_cols(std::vector<size_t> &cols) const {
+		for (size_t i = 0; i < used.size(); i++)
+			cols.push_back(keys[used[i]]);
+	}
+
+	/*
+	 * Append the sorted entries in the table to the output.
+	 */
+	void get_sorted(csr_block_row<T> &out, bool has_val) {
+		size_t start = out.cols.size();
+		get_cols(out.cols);
+		std::sort(out.cols.begin() + start, out.cols.end());
+		if (has_val) {
+			for (size_t i = start; i < out.cols.size(); i++)
+				out.vals.push_back(vals[get_slot(out.cols[i])]);
+		}
+	}
+};
+
+/*
+ * A cursor on a row of the right matrix, scaled by an entry in
+ * the left matrix.
+ */
+template<class T>
+struct row_cursor
+{
+	const size_t *col;
+	const size_t *col_end;
+	const T *val;
+	T scale;
+};
+
+struct heap_entry
+{
+	size_t col;
+	size_t src;
+
+	heap_entry(size_t col, size_t src) {
+		this->col = col;
+		this->src = src;
+	}
+};
+
+// std::make_heap builds a max heap, so we reverse the order.
+struct heap_greater
+{
+	bool operator()(const heap_entry &e1, const heap_entry &e2) const {
+		if (e1.col == e2.col)
+			return e1.src > e2.src;
+		return e1.col > e2.col;
+	}
+};
+
+/*
+ * Merge the rows of the right matrix with a heap. The output row is
+ * produced in sorted order.
+ */
+template<class T>
+class heap_accumulator
+{
+	std::vector<row_cursor<T> > cursors;
+	std::vector<heap_entry> heap;
+public:
+	void clear() {
+		cursors.clear();
+	}
+
+	void add_row(const size_t *cols, const size_t *cols_end, const T *vals,
+			T scale) {
+		if (cols == cols_end)
+			return;
+		row_cursor<T> cursor;
+		cursor.col = cols;
+		cursor.col_end = cols_end;
+		cursor.val = vals;
+		cursor.scale = scale;
+		cursors.push_back(cursor);
+	}
+
+	void merge(csr_block_row<T> &out, bool has_val) {
+		heap.clear();
+		for (size_t i = 0; i < cursors.size(); i++)
+			heap.push_back(heap_entry(*cursors[i].col, i));
+		std::make_heap(heap.begin(), heap.end(), heap_greater());
+		while (!heap.empty()) {
+			std::pop_heap(heap.begin(), heap.end(), heap_greater());
+			heap_entry top = heap.back();
+			heap.pop_back();
+			row_cursor<T> &cursor = cursors[top.src];
+			T val = 0;
+			if (has_val)
+				val = cursor.scale * *cursor.val;
+			// The entries of the current row start at the end of the previous
+			// row.
+			if (out.cols.size() > out.row_ptrs.back()
+					&& out.cols.back() == top.col) {
+				if (has_val)
+					out.vals.back() += val;
+			}
+			else {
+				out.cols.push_back(top.col);
+				if (has_val)
+					out.vals.push_back(val);
+			}
+			cursor.col++;
+			if (has_val)
+				cursor.val++;
+			if (cursor.col < cursor.col_end) {
+				heap.push_back(heap_entry(*cursor.col, top.src));
+				std::push_heap(heap.begin(), heap.end(), heap_greater());
+			}
+		}
+	}
+};
+
+/*
+ * This writes block rows in the 2D format. A block row is first described
+ * in the CSR format.
+ */
+class block_row_writer
+{
+	block_2d_size block_size;
+	size_t entry_size;
+	// The rows with non-zero entries in each block.
+	std::vector<std::vector<uint32_t> > block_rows;
+	// The number of non-zero entries in each block.
+	std::vector<size_t> block_nnzs;
+	std::vector<size_t> touched;
+	std::vector<size_t> row_locs;
+	std::unique_ptr<char[]> part_buf;
+	std::vector<char> data;
+	std::vector<char> coo_data;
+
+	template<class ColIter>
+	void collect_row(uint32_t row_idx, ColIter start, ColIter end) {
+		for (ColIter it = start; it != end; it++) {
+			size_t block_col_idx = *it / block_size.get_num_cols();
+			if (block_nnzs[block_col_idx] == 0)
+				touched.push_back(block_col_idx);
+			block_nnzs[block_col_idx]++;
+			std::vector<uint32_t> &rows = block_rows[block_col_idx];
+			if (rows.empty() || rows.back() != row_idx)
+				rows.push_back(row_idx);
+		}
+	}
+
+	void reset() {
+		for (size_t i = 0; i < touched.size(); i++) {
+			block_rows[touched[i]].clear();
+			block_nnzs[touched[i]] = 0;
+		}
+		touched.clear();
+	}
+
+	size_t cal_size() const {
+		size_t size = 0;
+		for (size_t i = 0; i < touched.size(); i++) {
+			size_t nnz = block_nnzs[touched[i]];
+			size_t nrow = block_rows[touched[i]].size();
+			size += sizeof(sparse_block_2d)
+				+ nrow * sparse_row_part::get_row_id_size()
+				+ nnz * sparse_row_part::get_col_entry_size()
+				// The empty row part in the end of the row-part region.
+				+ sparse_row_part::get_row_id_size()
+				+ nnz * entry_size;
+		}
+		// An empty block row still has a block header.
+		if (size == 0)
+			size = sizeof(sparse_block_2d);
+		return size;
+	}
+public:
+	block_row_writer(const block_2d_size &_block_size, size_t entry_size,
+			size_t num_cols): block_size(_block_size) {
+		this->entry_size = entry_size;
+		size_t num_block_cols = ceil(((double) num_cols)
+				/ block_size.get_num_cols());
+		block_rows.resize(num_block_cols);
+		block_nnzs.resize(num_block_cols);
+		part_buf = std::unique_ptr<char[]>(new char[sparse_row_part::get_size(
+					block_size.get_num_cols())]);
+	}
+
+	/*
+	 * Compute the size of a block row in the 2D format. The columns in
+	 * the rows don't need to be sorted.
+	 */
+	template<class T>
+	size_t get_size(const csr_block_row<T> &rows) {
+		for (size_t i = 0; i < rows.get_num_rows(); i++)
+			collect_row(i, rows.cols.begin() + rows.row_ptrs[i],
+					rows.cols.begin() + rows.row_ptrs[i + 1]);
+		size_t size = cal_size();
+		reset();
+		return size;
+	}
+
+	/*
+	 * Write a block row to the buffer. The columns in each row have to be
+	 * sorted. The buffer needs to have at least the size of the block row.
+	 * It returns the size of the block row.
+	 */
+	template<class T>
+	size_t write(size_t block_row_idx, const csr_block_row<T> &rows,
+			char *buf, size_t buf_size);
+};
+
+template<class T>
+size_t block_row_writer::write(size_t block_row_idx,
+		const csr_block_row<T> &rows, char *buf, size_t buf_size)
+{
+	for (size_t i = 0; i < rows.get_num_rows(); i++)
+		collect_row(i, rows.cols.begin() + rows.row_ptrs[i],
+				rows.cols.begin() + rows.row_ptrs[i + 1]);
+	size_t size = cal_size();
+	assert(size <= buf_size);
+	if (size == sizeof(sparse_block_2d) && touched.empty()) {
+		new (buf) sparse_block_2d(block_row_idx, 0);
+		return size;
+	}
+
+	std::sort(touched.begin(), touched.end());
+	row_locs.assign(rows.row_ptrs.begin(), rows.row_ptrs.end() - 1);
+	std::vector<coo_nz_t> single_nnz;
+	size_t off = 0;
+	for (size_t i = 0; i < touched.size(); i++) {
+		size_t block_col_idx = touched[i];
+		size_t col_end = (block_col_idx + 1) * block_size.get_num_cols();
+		sparse_block_2d *block = new (buf + off) sparse_block_2d(
+				block_row_idx, block_col_idx);
+		data.clear();
+		coo_data.clear();
+		single_nnz.clear();
+		const std::vector<uint32_t> &brows = block_rows[block_col_idx];
+		for (size_t j = 0; j < brows.size(); j++) {
+			size_t row_idx = brows[j];
+			size_t start = row_locs[row_idx];
+			size_t end = start;
+			while (end < rows.row_ptrs[row_idx + 1] && rows.cols[end] < col_end)
+				end++;
+			assert(end > start);
+			const char *vals = NULL;
+			if (entry_size > 0)
+				vals = (const char *) (rows.vals.data() + start);
+			if (end - start > 1) {
+				sparse_row_part *part = new (part_buf.get()) sparse_row_part(
+						row_idx);
+				rp_edge_iterator edge_it = part->get_edge_iterator();
+				for (size_t k = start; k < end; k++)
+					edge_it.append(block_size, rows.cols[k]);
+				block->append(*part, sparse_row_part::get_size(end - start));
+				if (entry_size > 0)
+					data.insert(data.end(), vals, vals + (end - start) * entry_size);
+			}
+			else {
+				single_nnz.push_back(coo_nz_t(row_idx, rows.cols[start]));
+				if (entry_size > 0)
+					coo_data.insert(coo_data.end(), vals, vals + entry_size);
+			}
+			row_locs[row_idx] = end;
+		}
+		if (!single_nnz.empty())
+			block->add_coo(single_nnz, block_size);
+		data.insert(data.end(), coo_data.begin(), coo_data.end());
+		block->finalize(data.empty() ? NULL : data.data(), data.size());
+		assert(block->get_nnz() == block_nnzs[block_col_idx]);
+		off += block->get_size(entry_size);
+	}
+	assert(off == size);
+	reset();
+	return size;
+}
+
+/*
+ * The data shared by all threads in SpGEMM.
+ */
+template<class T>
+struct spgemm_job
+{
+	const sparse_matrix &A;
+	const sparse_matrix &B;
+	spgemm_options opts;
+	block_2d_size out_block_size;
+	size_t entry_size;
+
+	// The block rows processed in the current pass: [start, end).
+	size_t start_brow;
+	size_t end_brow;
+	std::atomic<size_t> next_brow;
+	bool symbolic;
+
+	// The sizes of the output block rows computed in the symbolic phase.
+	std::vector<size_t> brow_sizes;
+	// If the output is written to a single buffer, the offsets of the block
+	// rows in the buffer are known before the numeric phase.
+	safs::NUMA_buffer::ptr out_data;
+	std::vector<off_t> out_offs;
+	// Otherwise, each block row in the current pass is kept in its own
+	// buffer.
+	std::vector<local_buf_vec_store::ptr> brow_bufs;
+
+	spgemm_job(const sparse_matrix &_A, const sparse_matrix &_B,
+			const spgemm_options &_opts): A(_A), B(_B), opts(_opts),
+			out_block_size(A.get_block_size().get_num_rows(),
+					B.get_block_size().get_num_cols()) {
+		entry_size = A.get_entry_size();
+		start_brow = 0;
+		end_brow = 0;
+		symbolic = false;
+	}
+
+	size_t get_num_brows() const {
+		return A.get_block_size().cal_num_block_rows(A.get_num_rows());
+	}
+
+	void set_range(size_t start, size_t end) {
+		start_brow = start;
+		end_brow = end;
+		next_brow = start;
+	}
+};
+
+/*
+ * The buffer for reading a block row asynchronously.
+ */
+struct brow_read
+{
+	typedef std::shared_ptr<brow_read> ptr;
+
+	char *buf;
+	size_t buf_size;
+	// The location of the block row in the buffer.
+	off_t data_off;
+	size_t size;
+	bool ready;
+
+	brow_read() {
+		buf = NULL;
+		buf_size = 0;
+		data_off = 0;
+		size = 0;
+		ready = false;
+	}
+
+	~brow_read() {
+		free(buf);
+	}
+
+	const char *get_data() const {
+		return buf + data_off;
+	}
+};
+
+/*
+ * Mark the block rows as ready when their reads complete.
+ */
+class brow_read_callback: public safs::callback
+{
+public:
+	virtual int invoke(safs::io_request *reqs[], int num) {
+		for (int i = 0; i < num; i++)
+			((brow_read *) reqs[i]->get_user_data())->ready = true;
+		return 0;
+	}
+};
+
+/*
+ * The data that each thread keeps across the passes. The block rows of
+ * the right matrix are decoded and cached here.
+ */
+template<class T>
+class spgemm_thread_state
+{
+	typedef typename csr_block_row<T>::ptr brow_ptr;
+	std::unordered_map<size_t, brow_ptr> cache;
+	// The order in which the block rows were cached.
+	std::deque<size_t> cache_order;
+public:
+	typedef std::shared_ptr<spgemm_thread_state<T> > ptr;
+
+	csr_block_row<T> a_rows;
+	csr_block_row<T> out_rows;
+	hash_accumulator<T> hash_acc;
+	heap_accumulator<T> heap_acc;
+	block_row_writer writer;
+	std::vector<char> out_buf;
+	// We read the next block row of the left matrix while computing
+	// on the current one.
+	brow_read a_reads[2];
+	std::vector<brow_read::ptr> b_reads;
+
+	// The block rows of the right matrix used by the current block row
+	// of the left matrix.
+	std::vector<const csr_block_row<T> *> b_brows;
+	std::vector<size_t> brow_stamps;
+	size_t curr_stamp;
+
+	spgemm_thread_state(const spgemm_job<T> &job): writer(job.out_block_size,
+			job.entry_size, job.B.get_num_cols()) {
+		size_t num_b_brows = job.B.get_block_size().cal_num_block_rows(
+				job.B.get_num_rows());
+		b_brows.resize(num_b_brows);
+		brow_stamps.resize(num_b_brows);
+		curr_stamp = 0;
+	}
+
+	const csr_block_row<T> *get_cached(size_t brow_idx) const {
+		auto it = cache.find(brow_idx);
+		if (it == cache.end())
+			return NULL;
+		else
+			return it->second.get();
+	}
+
+	void add_cache(size_t brow_idx, brow_ptr rows) {
+		cache.insert(std::pair<size_t, brow_ptr>(brow_idx, rows));
+		cache_order.push_back(brow_idx);
+	}
+
+	/*
+	 * Evict the block rows that aren't used by the current block row of
+	 * the left matrix.
+	 */
+	void evict(size_t max_cached) {
+		size_t num_checked = 0;
+		size_t num = cache_order.size();
+		while (cache.size() > max_cached && num_checked < num) {
+			size_t brow_idx = cache_order.front();
+			cache_order.pop_front();
+			num_checked++;
+			if (brow_stamps[brow_idx] == curr_stamp)
+				cache_order.push_back(brow_idx);
+			else
+				cache.erase(brow_idx);
+		}
+	}
+};
+
+/*
+ * Create the request that reads a block row of a sparse matrix into
+ * the buffer. The caller issues the request and the callback of
+ * the I/O instance marks the buffer as ready.
+ */
+safs::io_request prep_brow_read(const sparse_matrix &mat, size_t brow_idx,
+		safs::io_interface &io, brow_read &read)
+{
+	std::vector<off_t> brow_idxs(2);
+	brow_idxs[0] = brow_idx;
+	brow_idxs[1] = brow_idx + 1;
+	std::vector<off_t> offs;
+	mat.get_block_row_offs(brow_idxs, offs);
+	// The I/O is aligned to pages, so it works for direct I/O as well.
+	off_t start = ROUND_PAGE(offs[0]);
+	size_t io_size = ROUNDUP_PAGE(offs[1]) - start;
+	if (read.buf_size < io_size) {
+		free(read.buf);
+		read.buf = (char *) valloc(io_size);
+		read.buf_size = io_size;
+	}
+	read.data_off = offs[0] - start;
+	read.size = offs[1] - offs[0];
+	read.ready = false;
+	safs::io_request req(read.buf, safs::data_loc_t(io.get_file_id(),
+				start), io_size, READ);
+	req.set_user_data(&read);
+	return req;
+}
+
+void wait4read(safs::io_interface &io, const brow_read &read)
+{
+	while (!read.ready)
+		io.wait4complete(1);
+}
+
+template<class T>
+class spgemm_task: public thread_task
+{
+	spgemm_job<T> &job;
+	spgemm_thread_state<T> &state;
+	safs::io_interface::ptr a_io;
+	safs::io_interface::ptr b_io;
+
+	void issue_a_read(size_t brow_idx, brow_read &read);
+	void load_b_brows();
+	void multiply_row(size_t row_idx, bool has_val);
+	void run_on_brow(size_t brow_idx, const brow_read &read);
+public:
+	spgemm_task(spgemm_job<T> &_job,
+			spgemm_thread_state<T> &_state): job(_job), state(_state) {
+	}
+
+	void run();
+};
+
+template<class T>
+void spgemm_task<T>::load_b_brows()
+{
+	const block_2d_size &b_block_size = job.B.get_block_size();
+	size_t b_nrow_log = b_block_size.get_nrow_log();
+	state.curr_stamp++;
+	std::vector<size_t> needed;
+	for (size_t i = 0; i < state.a_rows.cols.size(); i++) {
+		size_t brow_idx = state.a_rows.cols[i] >> b_nrow_log;
+		if (state.brow_stamps[brow_idx] != state.curr_stamp) {
+			state.brow_stamps[brow_idx] = state.curr_stamp;
+			needed.push_back(brow_idx);
+		}
+	}
+	std::vector<size_t> missed;
+	for (size_t i = 0; i < needed.size(); i++) {
+		const csr_block_row<T> *rows = state.get_cached(needed[i]);
+		if (rows)
+			state.b_brows[needed[i]] = rows;
+		else
+			missed.push_back(needed[i]);
+	}
+
+	// We issue the reads of the missing block rows together and decode
+	// a block row as soon as its read completes, so the reads overlap with
+	// each other and with decoding.
+	size_t max_reads = std::min<size_t>(MAX_BROW_READS,
+			std::max(1, b_io->get_remaining_io_slots()));
+	while (state.b_reads.size() < std::min(max_reads, missed.size()))
+		state.b_reads.push_back(brow_read::ptr(new brow_read()));
+	for (size_t start = 0; start < missed.size(); start += max_reads) {
+		size_t num = std::min(max_reads, missed.size() - start);
+		std::vector<safs::io_request> reqs;
+		for (size_t i = 0; i < num; i++)
+			reqs.push_back(prep_brow_read(job.B, missed[start + i], *b_io,
+						*state.b_reads[i]));
+		b_io->access(reqs.data(), reqs.size());
+		for (size_t i = 0; i < num; i++) {
+			size_t brow_idx = missed[start + i];
+			const brow_read &read = *state.b_reads[i];
+			wait4read(*b_io, read);
+			typename csr_block_row<T>::ptr new_rows(new csr_block_row<T>());
+			size_t num_rows = std::min(b_block_size.get_num_rows(),
+					job.B.get_num_rows() - brow_idx * b_block_size.get_num_rows());
+			decode_block_row(read.get_data(), read.size, num_rows,
+					job.entry_size, b_block_size, *new_rows);
+			state.add_cache(brow_idx, new_rows);
+			state.b_brows[brow_idx] = new_rows.get();
+		}
+	}
+	state.evict(job.opts.max_cached_brows);
+}
+
+template<class T>
+void spgemm_task<T>::multiply_row(size_t row_idx, bool has_val)
+{
+	const csr_block_row<T> &a_rows = state.a_rows;
+	csr_block_row<T> &out = state.out_rows;
+	const block_2d_size &b_block_size = job.B.get_block_size();
+	size_t b_nrow_log = b_block_size.get_nrow_log();
+	size_t b_nrow_mask = b_block_size.get_nrow_mask();
+	size_t a_start = a_rows.row_ptrs[row_idx];
+	size_t a_end = a_rows.row_ptrs[row_idx + 1];
+
+	bool use_heap = !job.symbolic && (job.opts.acc == SPGEMM_ACC_HEAP
+			|| (job.opts.acc == SPGEMM_ACC_AUTO
+				&& a_end - a_start <= HEAP_MAX_ROW_NNZ));
+	if (use_heap) {
+		state.heap_acc.clear();
+		for (size_t i = a_start; i < a_end; i++) {
+			size_t col = a_rows.cols[i];
+			const csr_block_row<T> &b_rows = *state.b_brows[col >> b_nrow_log];
+			size_t b_row = col & b_nrow_mask;
+			size_t b_start = b_rows.row_ptrs[b_row];
+			size_t b_end = b_rows.row_ptrs[b_row + 1];
+			state.heap_acc.add_row(b_rows.cols.data() + b_start,
+					b_rows.cols.data() + b_end,
+					has_val ? b_rows.vals.data() + b_start : NULL,
+					has_val ? a_rows.vals[i] : 0);
+		}
+		state.heap_acc.merge(out, has_val);
+		out.finish_row();
+		return;
+	}
+
+	// The number of non-zero entries in the output row is bounded by
+	// the number of multiplications and the number of columns.
+	size_t max_nnz = 0;
+	for (size_t i = a_start; i < a_end; i++) {
+		size_t col = a_rows.cols[i];
+		max_nnz += state.b_brows[col >> b_nrow_log]->get_row_nnz(
+				col & b_nrow_mask);
+	}
+	max_nnz = std::min(max_nnz, job.B.get_num_cols());
+	state.hash_acc.reset(max_nnz);
+	for (size_t i = a_start; i < a_end; i++) {
+		size_t col = a_rows.cols[i];
+		const csr_block_row<T> &b_rows = *state.b_brows[col >> b_nrow_log];
+		size_t b_row = col & b_nrow_mask;
+		size_t b_start = b_rows.row_ptrs[b_row];
+		size_t b_end = b_rows.row_ptrs[b_row + 1];
+		if (job.symbolic || !has_val) {
+			for (size_t j = b_start; j < b_end; j++)
+				state.hash_acc.insert(b_rows.cols[j]);
+		}
+		else {
+			T a_val = a_rows.vals[i];
+			for (size_t j = b_start; j < b_end; j++)
+				state.hash_acc.add(b_rows.cols[j], a_val * b_rows.vals[j]);
+		}
+	}
+	if (job.symbolic)
+		state.hash_acc.get_cols(out.cols);
+	else
+		state.hash_acc.get_sorted(out, has_val);
+	out.finish_row();
+}
+
+template<class T>
+void spgemm_task<T>::run_on_brow(size_t brow_idx, const brow_read &read)
+{
+	const block_2d_size &a_block_size = job.A.get_block_size();
+	size_t num_rows = std::min(a_block_size.get_num_rows(),
+			job.A.get_num_rows() - brow_idx * a_block_size.get_num_rows());
+	decode_block_row(read.get_data(), read.size, num_rows, job.entry_size,
+			a_block_size, state.a_rows);
+	load_b_brows();
+
+	bool has_val = job.entry_size > 0;
+	state.out_rows.clear();
+	for (size_t i = 0; i < num_rows; i++)
+		multiply_row(i, has_val);
+
+	if (job.symbolic) {
+		job.brow_sizes[brow_idx] = state.writer.get_size(state.out_rows);
+		return;
+	}
+
+	size_t brow_size;
+	if (!job.brow_sizes.empty())
+		brow_size = job.brow_sizes[brow_idx];
+	else
+		brow_size = state.writer.get_size(state.out_rows);
+	if (job.out_data) {
+		// The output buffer is partitioned across NUMA nodes, so we write
+		// the block row to a local buffer first.
+		if (state.out_buf.size() < brow_size)
+			state.out_buf.resize(brow_size);
+		size_t ret = state.writer.write(brow_idx, state.out_rows,
+				state.out_buf.data(), brow_size);
+		assert(ret == brow_size);
+		job.out_data->copy_from(state.out_buf.data(), brow_size,
+				job.out_offs[brow_idx]);
+	}
+	else {
+		local_buf_vec_store::ptr buf(new local_buf_vec_store(0, brow_size,
+					get_scalar_type<char>(), -1));
+		size_t ret = state.writer.write(brow_idx, state.out_rows,
+				buf->get_raw_arr(), brow_size);
+		assert(ret == brow_size);
+		job.brow_bufs[brow_idx - job.start_brow] = buf;
+	}
+}
+
+template<class T>
+void spgemm_task<T>::issue_a_read(size_t brow_idx, brow_read &read)
+{
+	safs::io_request req = prep_brow_read(job.A, brow_idx, *a_io, read);
+	a_io->access(&req, 1);
+}
+
+template<class T>
+void spgemm_task<T>::run()
+{
+	a_io = create_io(job.A.get_io_factory(), thread::get_curr_thread());
+	b_io = create_io(job.B.get_io_factory(), thread::get_curr_thread());
+	a_io->set_callback(safs::callback::ptr(new brow_read_callback()));
+	b_io->set_callback(safs::callback::ptr(new brow_read_callback()));
+
+	// We claim the next block row of the left matrix before computing on
+	// the current one, so that its read overlaps with the computation.
+	size_t brow_idx = job.next_brow.fetch_add(1);
+	if (brow_idx < job.end_brow)
+		issue_a_read(brow_idx, state.a_reads[0]);
+	for (size_t i = 0; brow_idx < job.end_brow; i++) {
+		brow_read &curr = state.a_reads[i % 2];
+		size_t next_idx = job.next_brow.fetch_add(1);
+		if (next_idx < job.end_brow)
+			issue_a_read(next_idx, state.a_reads[(i + 1) % 2]);
+		wait4read(*a_io, curr);
+		run_on_brow(brow_idx, curr);
+		brow_idx = next_idx;
+	}
+}
+
+template<class T>
+void run_pass(spgemm_job<T> &job,
+		std::vector<typename spgemm_thread_state<T>::ptr> &states,
+		size_t start, size_t end, bool symbolic)
+{
+	detail::mem_thread_pool::ptr threads
+		= detail::mem_thread_pool::get_global_mem_threads();
+	job.symbolic = symbolic;
+	job.set_range(start, end);
+	if (!symbolic && !job.out_data) {
+		job.brow_bufs.clear();
+		job.brow_bufs.resize(end - start);
+	}
+	for (size_t i = 0; i < states.size(); i++)
+		threads->process_task(i % threads->get_num_nodes(),
+				new spgemm_task<T>(job, *states[i]));
+	threads->wait4complete();
+}
+
+template<class T>
+std::vector<typename spgemm_thread_state<T>::ptr> create_states(
+		const spgemm_job<T> &job)
+{
+	size_t num_threads
+		= detail::mem_thread_pool::get_global_mem_threads()->get_num_threads();
+	std::vector<typename spgemm_thread_state<T>::ptr> states(num_threads);
+	for (size_t i = 0; i < num_threads; i++)
+		states[i] = typename spgemm_thread_state<T>::ptr(
+				new spgemm_thread_state<T>(job));
+	return states;
+}
+
+matrix_header create_out_header(const sparse_matrix &A, const sparse_matrix &B,
+		const scalar_type &type)
+{
+	block_2d_size block_size(A.get_block_size().get_num_rows(),
+			B.get_block_size().get_num_cols());
+	prim_type ptype = prim_type::P_BOOL;
+	if (A.get_entry_size() > 0)
+		ptype = type.get_type();
+	return matrix_header(matrix_type::SPARSE, A.get_entry_size(),
+			A.get_num_rows(), B.get_num_cols(), matrix_layout_t::L_ROW_2D,
+			ptype, block_size);
+}
+
+std::vector<off_t> cal_brow_offs(const std::vector<size_t> &brow_sizes)
+{
+	std::vector<off_t> offs(brow_sizes.size() + 1);
+	off_t off = sizeof(matrix_header);
+	for (size_t i = 0; i < brow_sizes.size(); i++) {
+		offs[i] = off;
+		off += brow_sizes[i];
+	}
+	offs[brow_sizes.size()] = off;
+	return offs;
+}
+
+template<class T>
+std::pair<SpM_2d_index::ptr, SpM_2d_storage::ptr> spgemm_mem(
+		const sparse_matrix &A, const sparse_matrix &B,
+		const spgemm_options &opts)
+{
+	spgemm_job<T> job(A, B, opts);
+	std::vector<typename spgemm_thread_state<T>::ptr> states = create_states(job);
+	matrix_header mheader = create_out_header(A, B, get_scalar_type<T>());
+	size_t num_brows = job.get_num_brows();
+
+	SpM_2d_index::ptr idx;
+	safs::NUMA_buffer::ptr data;
+	if (opts.two_phase) {
+		job.brow_sizes.resize(num_brows);
+		run_pass(job, states, 0, num_brows, true);
+		job.out_offs = cal_brow_offs(job.brow_sizes);
+		idx = SpM_2d_index::create(mheader, job.out_offs);
+		// The output is allocated once and each thread writes its block
+		// rows to their final location.
+		data = SpM_2d_storage::create_buf(job.out_offs.back());
+		job.out_data = data;
+		run_pass(job, states, 0, num_brows, false);
+	}
+	else {
+		run_pass(job, states, 0, num_brows, false);
+		std::vector<size_t> brow_sizes(num_brows);
+		for (size_t i = 0; i < num_brows; i++)
+			brow_sizes[i] = job.brow_bufs[i]->get_length();
+		std::vector<off_t> offs = cal_brow_offs(brow_sizes);
+		idx = SpM_2d_index::create(mheader, offs);
+		data = SpM_2d_storage::create_buf(offs.back());
+		for (size_t i = 0; i < num_brows; i++) {
+			data->copy_from(job.brow_bufs[i]->get_raw_arr(), brow_sizes[i],
+					offs[i]);
+			job.brow_bufs[i].reset();
+		}
+	}
+	mheader.verify();
+	data->copy_from((const char *) &mheader, sizeof(mheader), 0);
+	return std::pair<SpM_2d_index::ptr, SpM_2d_storage::ptr>(idx,
+			SpM_2d_storage::create(data, idx));
+}
+
+template<class T>
+bool spgemm_EM(const sparse_matrix &A, const sparse_matrix &B,
+		const std::string &mat_file, const std::string &mat_idx_file,
+		const spgemm_options &opts)
+{
+	spgemm_job<T> job(A, B, opts);
+	std::vector<typename spgemm_thread_state<T>::ptr> states = create_states(job);
+	matrix_header mheader = create_out_header(A, B, get_scalar_type<T>());
+	mheader.verify();
+	size_t num_brows = job.get_num_brows();
+
+	// With the symbolic phase, the index is written before computing
+	// the output matrix.
+	if (opts.two_phase) {
+		job.brow_sizes.resize(num_brows);
+		run_pass(job, states, 0, num_brows, true);
+		SpM_2d_index::ptr idx = SpM_2d_index::create(mheader,
+				cal_brow_offs(job.brow_sizes));
+		if (idx == NULL)
+			return false;
+		idx->safs_dump(mat_idx_file);
+	}
+
+	detail::EM_vec_store::ptr vec = detail::EM_vec_store::create(0,
+			get_scalar_type<char>());
+	local_cref_vec_store header_store((const char *) &mheader,
+			0, sizeof(mheader), get_scalar_type<char>(), -1);
+	vec->append(header_store);
+	// Only a window of block rows is kept in memory. The block rows in
+	// a window are appended to the file in order.
+	size_t window_size = states.size() * EM_BROWS_PER_THREAD;
+	std::vector<size_t> brow_sizes(num_brows);
+	for (size_t start = 0; start < num_brows; start += window_size) {
+		size_t end = std::min(start + window_size, num_brows);
+		run_pass(job, states, start, end, false);
+		std::vector<detail::vec_store::const_ptr> bufs(end - start);
+		for (size_t i = start; i < end; i++) {
+			bufs[i - start] = job.brow_bufs[i - start];
+			brow_sizes[i] = job.brow_bufs[i - start]->get_length();
+		}
+		if (!vec->append(bufs.begin(), bufs.end())) {
+			BOOST_LOG_TRIVIAL(error) << "can't write the output of SpGEMM";
+			return false;
+		}
+	}
+	if (!vec->set_persistent(mat_file))
+		return false;
+
+	if (!opts.two_phase) {
+		SpM_2d_index::ptr idx = SpM_2d_index::create(mheader,
+				cal_brow_offs(brow_sizes));
+		if (idx == NULL)
+			return false;
+		idx->safs_dump(mat_idx_file);
+	}
+	return true;
+}
+
+bool check_spgemm(const sparse_matrix &A, const sparse_matrix &B)
+{
+	if (A.is_fg_matrix() || B.is_fg_matrix()) {
+		BOOST_LOG_TRIVIAL(error)
+			<< "SpGEMM only works on matrices partitioned in 2D dimensions";
+		return false;
+	}
+	if (A.get_num_cols() != B.get_num_rows()) {
+		BOOST_LOG_TRIVIAL(error) << boost::format(
+				"SpGEMM: can't multiply a %1%x%2% matrix with a %3%x%4% matrix")
+			% A.get_num_rows() % A.get_num_cols() % B.get_num_rows()
+			% B.get_num_cols();
+		return false;
+	}
+	if (A.get_entry_size() != B.get_entry_size()) {
+		BOOST_LOG_TRIVIAL(error)
+			<< "SpGEMM: the matrices have different non-zero entry types";
+		return false;
+	}
+	return true;
+}
+
+}
+
+std::pair<SpM_2d_index::ptr, SpM_2d_storage::ptr> spgemm(
+		const sparse_matrix &A, const sparse_matrix &B,
+		const spgemm_options &opts)
+{
+	if (!check_spgemm(A, B))
+		return std::pair<SpM_2d_index::ptr, SpM_2d_storage::ptr>();
+
+	// A binary matrix doesn't store the non-zero entries, so the type
+	// is only used for accumulating values.
+	if (A.get_entry_size() == 0)
+		return spgemm_mem<int>(A, B, opts);
+	else if (A.is_type<int>() && B.is_type<int>())
+		return spgemm_mem<int>(A, B, opts);
+	else if (A.is_type<long>() && B.is_type<long>())
+		return spgemm_mem<long>(A, B, opts);
+	else if (A.is_type<float>() && B.is_type<float>())
+		return spgemm_mem<float>(A, B, opts);
+	else if (A.is_type<double>() && B.is_type<double>())
+		return spgemm_mem<double>(A, B, opts);
+	else {
+		BOOST_LOG_TRIVIAL(error) << "SpGEMM: unsupported non-zero entry type";
+		return std::pair<SpM_2d_index::ptr, SpM_2d_storage::ptr>();
+	}
+}
+
+bool spgemm_export(const sparse_matrix &A, const sparse_matrix &B,
+		const std::string &mat_file, const std::string &mat_idx_file,
+		const spgemm_options &opts)
+{
+	if (!check_spgemm(A, B))
+		return false;
+
+	if (A.get_entry_size() == 0)
+		return spgemm_EM<int>(A, B, mat_file, mat_idx_file, opts);
+	else if (A.is_type<int>() && B.is_type<int>())
+		return spgemm_EM<int>(A, B, mat_file, mat_idx_file, opts);
+	else if (A.is_type<long>() && B.is_type<long>())
+		return spgemm_EM<long>(A, B, mat_file, mat_idx_file, opts);
+	else if (A.is_type<float>() && B.is_type<float>())
+		return spgemm_EM<float>(A, B, mat_file, mat_idx_file, opts);
+	else if (A.is_type<double>() && B.is_type<double>())
+		return spgemm_EM<double>(A, B, mat_file, mat_idx_file, opts);
+	else {
+		BOOST_LOG_TRIVIAL(error) << "SpGEMM: unsupported non-zero entry type";
+		return false;
+	}
+}
+
+}
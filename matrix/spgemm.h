@@ -0,0 +1,94 @@
+#ifndef __SPGEMM_H__
+#define __SPGEMM_H__
+
+/*
+ * Copyright 2014 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of FlashMatrix.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+
+#include "sparse_matrix.h"
+#include "sparse_matrix_format.h"
+
+namespace fm
+{
+
+/*
+ * How a row of the output matrix is accumulated from the rows of
+ * the right matrix.
+ */
+enum spgemm_acc_t
+{
+	// A hash table is used by default. A heap is used for the rows in
+	// the left matrix with a few non-zero entries.
+	SPGEMM_ACC_AUTO,
+	// Accumulate a row in a hash table and sort it in the end.
+	SPGEMM_ACC_HASH,
+	// Merge the rows of the right matrix with a heap. The output row is
+	// sorted, so this is cheap when a row of the left matrix has
+	// a few non-zero entries.
+	SPGEMM_ACC_HEAP,
+};
+
+struct spgemm_options
+{
+	spgemm_acc_t acc;
+	/*
+	 * If this is true, a symbolic phase first computes the structure of
+	 * the output matrix to get the exact size of each output block row.
+	 * The index of the output matrix is known before the numeric phase and
+	 * the output is allocated only once. Otherwise, each block row is
+	 * computed into its own buffer and the buffers are concatenated.
+	 */
+	bool two_phase;
+	/*
+	 * The max number of decoded block rows of the right matrix cached in
+	 * each thread.
+	 */
+	size_t max_cached_brows;
+
+	spgemm_options() {
+		acc = SPGEMM_ACC_AUTO;
+		two_phase = false;
+		max_cached_brows = 64;
+	}
+};
+
+/*
+ * Multiply two sparse matrices partitioned in 2D dimensions. The output
+ * is stored in memory in the 2D format. The block height of the output
+ * is the same as the left matrix and the block width is the same as
+ * the right matrix. Both matrices need to have the same type of non-zero
+ * entries. If they are binary matrices, so is the output.
+ */
+std::pair<SpM_2d_index::ptr, SpM_2d_storage::ptr> spgemm(
+		const sparse_matrix &A, const sparse_matrix &B,
+		const spgemm_options &opts = spgemm_options());
+
+/*
+ * This is the external-memory version of SpGEMM. The output matrix is
+ * written to SAFS in the format that SpM_2d_storage and SpM_2d_index load.
+ * Only a window of output block rows is kept in memory.
+ */
+bool spgemm_export(const sparse_matrix &A, const sparse_matrix &B,
+		const std::string &mat_file, const std::string &mat_idx_file,
+		const spgemm_options &opts = spgemm_options());
+
+}
+
+#endif
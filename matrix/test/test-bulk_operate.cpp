@@ -0,0 +1,391 @@
+/*
+ * Copyright 2014 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of FlashMatrix.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <vector>
+#include <limits>
+#include <type_traits>
+
+#include "common.h"
+
+#include "bulk_operate.h"
+#include "simd_kernels.h"
+
+/*
+ * This checks the vectorized kernels of the basic operators against
+ * the scalar operators and measures the throughput of the operators on
+ * a block of elements that fits in the L2 cache, with and without
+ * the vectorized kernels.
+ */
+
+using namespace fm;
+
+size_t block_size = 8192;
+size_t num_repeats = 100000;
+
+template<class T>
+void init_arr(std::vector<T> &arr)
+{
+	for (size_t i = 0; i < arr.size(); i++)
+		arr[i] = random() % 1000 + 1;
+}
+
+/*
+ * Run the operation on the block many times and return the number of
+ * elements processed in a second.
+ */
+template<class T, class Func>
+double measure(Func func)
+{
+	struct timeval start, end;
+	gettimeofday(&start, NULL);
+	for (size_t i = 0; i < num_repeats; i++)
+		func();
+	gettimeofday(&end, NULL);
+	return block_size * num_repeats / time_diff(start, end);
+}
+
+template<class T>
+class run_aa
+{
+	const bulk_operate &op;
+	const std::vector<T> &left;
+	const std::vector<T> &right;
+	std::vector<char> &out;
+public:
+	run_aa(const bulk_operate &_op, const std::vector<T> &_left,
+			const std::vector<T> &_right, std::vector<char> &_out): op(_op),
+			left(_left), right(_right), out(_out) {
+	}
+
+	void operator()() {
+		op.runAA(left.size(), left.data(), right.data(), out.data());
+	}
+};
+
+template<class T>
+class run_agg
+{
+	const bulk_operate &op;
+	const std::vector<T> &arr;
+	std::vector<char> &out;
+public:
+	run_agg(const bulk_operate &_op, const std::vector<T> &_arr,
+			std::vector<char> &_out): op(_op), arr(_arr), out(_out) {
+	}
+
+	void operator()() {
+		op.runAgg(arr.size(), arr.data(), NULL, out.data());
+	}
+};
+
+template<class T>
+class run_uop
+{
+	const bulk_uoperate &op;
+	const std::vector<T> &arr;
+	std::vector<char> &out;
+public:
+	run_uop(const bulk_uoperate &_op, const std::vector<T> &_arr,
+			std::vector<char> &_out): op(_op), arr(_arr), out(_out) {
+	}
+
+	void operator()() {
+		op.runA(arr.size(), arr.data(), out.data());
+	}
+};
+
+/*
+ * We check all lengths up to a few times the vector width, so the tails
+ * that aren't a multiple of the vector width are covered.
+ */
+const size_t max_check_len = 300;
+
+template<class T>
+T rand_val()
+{
+	// The values aren't 0 and can be negative, so neg and abs are tested.
+	if (std::is_floating_point<T>::value)
+		return ((T) (random() % 2000) - 1000) / 8 + 0.0625;
+	else if (std::is_signed<T>::value)
+		return random() % 2001 - 1000;
+	else
+		return random() % 1000 + 1;
+}
+
+/*
+ * The arrays start at an unaligned location.
+ */
+template<class T>
+std::vector<T> rand_arr(size_t len)
+{
+	std::vector<T> arr(len + 1);
+	for (size_t i = 0; i < arr.size(); i++)
+		arr[i] = rand_val<T>();
+	return arr;
+}
+
+template<class T>
+void check_same(const std::vector<T> &expected, const std::vector<T> &res,
+		size_t len)
+{
+	for (size_t i = 0; i < len; i++)
+		assert(expected[i] == res[i]);
+}
+
+template<class T>
+void check_bop(const bulk_operate &op, size_t len)
+{
+	std::vector<T> left = rand_arr<T>(len);
+	std::vector<T> right = rand_arr<T>(len);
+	std::vector<T> expected(len);
+	std::vector<T> res(len);
+
+	simd::set_enabled(false);
+	op.runAA(len, left.data() + 1, right.data() + 1, expected.data());
+	simd::set_enabled(true);
+	op.runAA(len, left.data() + 1, right.data() + 1, res.data());
+	check_same(expected, res, len);
+
+	simd::set_enabled(false);
+	op.runAE(len, left.data() + 1, &right[0], expected.data());
+	simd::set_enabled(true);
+	op.runAE(len, left.data() + 1, &right[0], res.data());
+	check_same(expected, res, len);
+
+	simd::set_enabled(false);
+	op.runEA(len, &left[0], right.data() + 1, expected.data());
+	simd::set_enabled(true);
+	op.runEA(len, &left[0], right.data() + 1, res.data());
+	check_same(expected, res, len);
+}
+
+template<class T>
+void check_agg(const bulk_operate &op, basic_ops::op_idx idx, size_t len)
+{
+	if (len == 0)
+		return;
+	std::vector<T> arr = rand_arr<T>(len);
+	// The product of the elements is exact in all types.
+	if (idx == basic_ops::MUL) {
+		for (size_t i = 0; i < arr.size(); i++)
+			arr[i] = i % 37 == 1 ? 2 : 1;
+	}
+	T expected;
+	T res;
+	simd::set_enabled(false);
+	op.runAgg(len, arr.data() + 1, NULL, &expected);
+	simd::set_enabled(true);
+	op.runAgg(len, arr.data() + 1, NULL, &res);
+	// The vectorized sum adds the floating-point values in a different
+	// order, so the rounding errors are different.
+	if (idx == basic_ops::ADD && std::is_floating_point<T>::value) {
+		double abs_sum = 0;
+		for (size_t i = 1; i <= len; i++)
+			abs_sum += fabs(arr[i]);
+		double eps = std::numeric_limits<T>::epsilon();
+		assert(fabs(expected - res) <= abs_sum * eps * len);
+	}
+	else
+		assert(expected == res);
+}
+
+template<class T>
+void check_uop(const bulk_uoperate &op, size_t len)
+{
+	std::vector<T> arr = rand_arr<T>(len);
+	std::vector<T> expected(len);
+	std::vector<T> res(len);
+	simd::set_enabled(false);
+	op.runA(len, arr.data() + 1, expected.data());
+	simd::set_enabled(true);
+	op.runA(len, arr.data() + 1, res.data());
+	check_same(expected, res, len);
+}
+
+template<class T>
+void check_type(const std::string &type_name)
+{
+	const basic_ops &ops = get_scalar_type<T>().get_basic_ops();
+	basic_ops::op_idx bops[] = {basic_ops::ADD, basic_ops::SUB,
+		basic_ops::MUL, basic_ops::MIN, basic_ops::MAX};
+	const basic_uops &uops = get_scalar_type<T>().get_basic_uops();
+	basic_uops::op_idx uop_idxs[] = {basic_uops::NEG, basic_uops::ABS,
+		basic_uops::SQ};
+	for (size_t len = 0; len <= max_check_len; len++) {
+		for (size_t i = 0; i < sizeof(bops) / sizeof(bops[0]); i++) {
+			const bulk_operate &op = *ops.get_op(bops[i]);
+			check_bop<T>(op, len);
+			if (bops[i] != basic_ops::SUB)
+				check_agg<T>(op, bops[i], len);
+		}
+		for (size_t i = 0; i < sizeof(uop_idxs) / sizeof(uop_idxs[0]); i++)
+			check_uop<T>(*uops.get_op(uop_idxs[i]), len);
+	}
+	printf("check the vectorized kernels of %s: OK\n", type_name.c_str());
+}
+
+/*
+ * The operators only use the kernels of the best instruction set,
+ * so we check the AVX2 kernels directly on a CPU with AVX-512.
+ */
+template<class T>
+void check_avx2(const std::string &type_name)
+{
+	if (simd::get_isa() != simd::AVX512)
+		return;
+
+	simd::kernels<T> ks;
+	memset(&ks, 0, sizeof(ks));
+	simd::avx2::init_kernels<T>(ks);
+	simd::set_enabled(false);
+	const basic_ops &ops = get_scalar_type<T>().get_basic_ops();
+	basic_ops::op_idx bops[] = {basic_ops::ADD, basic_ops::SUB,
+		basic_ops::MUL, basic_ops::MIN, basic_ops::MAX};
+	simd::op_kind kinds[] = {simd::ADD, simd::SUB, simd::MUL, simd::MIN,
+		simd::MAX};
+	const basic_uops &uops = get_scalar_type<T>().get_basic_uops();
+	basic_uops::op_idx uop_idxs[] = {basic_uops::NEG, basic_uops::ABS,
+		basic_uops::SQ};
+	simd::uop_kind ukinds[] = {simd::NEG, simd::ABS, simd::SQ};
+	for (size_t len = 0; len <= max_check_len; len++) {
+		std::vector<T> left = rand_arr<T>(len);
+		std::vector<T> right = rand_arr<T>(len);
+		std::vector<T> expected(len);
+		std::vector<T> res(len);
+		for (size_t i = 0; i < sizeof(bops) / sizeof(bops[0]); i++) {
+			const bulk_operate &op = *ops.get_op(bops[i]);
+			if (ks.runAA[kinds[i]]) {
+				op.runAA(len, left.data() + 1, right.data() + 1,
+						expected.data());
+				ks.runAA[kinds[i]](len, left.data() + 1, right.data() + 1,
+						res.data());
+				check_same(expected, res, len);
+			}
+			if (ks.runAE[kinds[i]]) {
+				op.runAE(len, left.data() + 1, &right[0], expected.data());
+				ks.runAE[kinds[i]](len, left.data() + 1, right[0], res.data());
+				check_same(expected, res, len);
+			}
+			if (ks.runEA[kinds[i]]) {
+				op.runEA(len, &left[0], right.data() + 1, expected.data());
+				ks.runEA[kinds[i]](len, left[0], right.data() + 1, res.data());
+				check_same(expected, res, len);
+			}
+			// The sum of floating-point values is checked with the operators.
+			if (ks.agg[kinds[i]] && len > 0 && (kinds[i] == simd::MIN
+						|| kinds[i] == simd::MAX
+						|| !std::is_floating_point<T>::value)) {
+				std::vector<T> arr = left;
+				if (kinds[i] == simd::MUL) {
+					for (size_t j = 0; j < arr.size(); j++)
+						arr[j] = j % 37 == 1 ? 2 : 1;
+				}
+				T agg_expected;
+				op.runAgg(len, arr.data() + 1, NULL, &agg_expected);
+				assert(ks.agg[kinds[i]](len - 1, arr.data() + 2, arr[1])
+						== agg_expected);
+			}
+		}
+		for (size_t i = 0; i < sizeof(uop_idxs) / sizeof(uop_idxs[0]); i++) {
+			if (ks.uop[ukinds[i]] == NULL)
+				continue;
+			uops.get_op(uop_idxs[i])->runA(len, left.data() + 1,
+					expected.data());
+			ks.uop[ukinds[i]](len, left.data() + 1, res.data());
+			check_same(expected, res, len);
+		}
+	}
+	simd::set_enabled(true);
+	printf("check the AVX2 kernels of %s: OK\n", type_name.c_str());
+}
+
+template<class T, class Func>
+void report(const std::string &type_name, const std::string &name, Func func)
+{
+	simd::set_enabled(false);
+	double scalar_rate = measure<T>(func);
+	simd::set_enabled(true);
+	double simd_rate = measure<T>(func);
+	printf("%s\t%s\t%.1f M/s\t%.1f M/s\t%.2fx\n", type_name.c_str(),
+			name.c_str(), scalar_rate / 1000000, simd_rate / 1000000,
+			simd_rate / scalar_rate);
+}
+
+template<class T>
+void test_type(const std::string &type_name)
+{
+	std::vector<T> left(block_size);
+	std::vector<T> right(block_size);
+	std::vector<char> out(block_size * sizeof(double));
+	init_arr(left);
+	init_arr(right);
+
+	const basic_ops &ops = get_scalar_type<T>().get_basic_ops();
+	basic_ops::op_idx bops[] = {basic_ops::ADD, basic_ops::SUB,
+		basic_ops::MUL, basic_ops::MIN, basic_ops::MAX};
+	for (size_t i = 0; i < sizeof(bops) / sizeof(bops[0]); i++) {
+		const bulk_operate &op = *ops.get_op(bops[i]);
+		report<T>(type_name, "AA " + op.get_name(),
+				run_aa<T>(op, left, right, out));
+		if (bops[i] != basic_ops::SUB)
+			report<T>(type_name, "agg " + op.get_name(),
+					run_agg<T>(op, left, out));
+	}
+
+	const basic_uops &uops = get_scalar_type<T>().get_basic_uops();
+	basic_uops::op_idx uop_idxs[] = {basic_uops::NEG, basic_uops::ABS,
+		basic_uops::SQ};
+	for (size_t i = 0; i < sizeof(uop_idxs) / sizeof(uop_idxs[0]); i++) {
+		const bulk_uoperate &op = *uops.get_op(uop_idxs[i]);
+		report<T>(type_name, op.get_name(), run_uop<T>(op, left, out));
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc >= 3) {
+		block_size = atol(argv[1]);
+		num_repeats = atol(argv[2]);
+	}
+
+	printf("vectorized kernels: %s\n", simd::get_isa_name(simd::get_isa()));
+	check_type<int>("int");
+	check_type<long>("long");
+	check_type<size_t>("size_t");
+	check_type<float>("float");
+	check_type<double>("double");
+	check_avx2<int>("int");
+	check_avx2<long>("long");
+	check_avx2<size_t>("size_t");
+	check_avx2<float>("float");
+	check_avx2<double>("double");
+
+	printf("type\top\tscalar\tvectorized\tspeedup\n");
+	test_type<int>("int");
+	test_type<long>("long");
+	test_type<float>("float");
+	test_type<double>("double");
+}
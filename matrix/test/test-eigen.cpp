@@ -169,7 +169,7 @@ void print_usage()
 	fprintf(stderr, "eigensolver conf_file matrix_file index_file nev [options]\n");
 	fprintf(stderr, "-b block_size\n");
 	fprintf(stderr, "-n num_blocks\n");
-	fprintf(stderr, "-s solver: Davidson, KrylovSchur, LOBPCG\n");
+	fprintf(stderr, "-s solver: Davidson, KrylovSchur, LOBPCG, Lanczos, RandSVD\n");
 	fprintf(stderr, "-t tolerance\n");
 	fprintf(stderr, "-e: the external memory mode.\n");
 	fprintf(stderr, "-o file: output eigenvectors\n");
@@ -0,0 +1,266 @@
+/*
+ * Copyright 2015 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of FlashMatrix.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+
+#include "matrix_config.h"
+#include "sparse_matrix.h"
+#include "dense_matrix.h"
+#include "vector.h"
+#include "mem_matrix_store.h"
+#include "mapply_matrix_store.h"
+#include "fused_mapply.h"
+
+using namespace fm;
+
+// The portions of a tall matrix have 64K rows, so a tall column-major
+// matrix has multiple portions that aren't stored contiguously.
+// The number of rows isn't a multiple of the tile size either.
+const size_t long_dim = 3 * 64 * 1024 + 1001;
+const size_t short_dim = 5;
+
+typedef std::vector<dense_matrix::ptr> mat_vec_t;
+typedef dense_matrix::ptr (*expr_func)(const mat_vec_t &ins);
+
+/*
+ * ((a * b + c) / d) * 2
+ */
+dense_matrix::ptr expr_chain(const mat_vec_t &ins)
+{
+	dense_matrix::ptr res = ins[0]->multiply_ele(*ins[1]);
+	res = res->add(*ins[2]);
+	res = res->div(*ins[3]);
+	return res->multiply_scalar<double>(2);
+}
+
+/*
+ * abs(a * b - a) + (a * b) * c
+ * The subexpression a * b and the input a are shared.
+ */
+dense_matrix::ptr expr_shared(const mat_vec_t &ins)
+{
+	dense_matrix::ptr prod = ins[0]->multiply_ele(*ins[1]);
+	dense_matrix::ptr res = prod->minus(*ins[0])->abs();
+	return res->add(*prod->multiply_ele(*ins[2]));
+}
+
+/*
+ * scale_rows(a + b) * c + d, where d is stored in the other layout.
+ * Scaling rows and converting the layout aren't element-wise, so
+ * the fused operation reads their results as inputs.
+ */
+dense_matrix::ptr expr_mixed(const mat_vec_t &ins)
+{
+	size_t len = ins[0]->get_num_rows();
+	vector::ptr vals = create_seq_vector<double>(1, len, 1);
+	dense_matrix::ptr res = ins[0]->add(*ins[1])->scale_rows(vals);
+	res = res->multiply_ele(*ins[2]);
+	return res->add(*ins[4]);
+}
+
+dense_matrix::ptr run_expr(expr_func func, const mat_vec_t &ins, bool fuse)
+{
+	matrix_conf.set_fuse_mapply(fuse);
+	dense_matrix::ptr res = func(ins);
+	assert(res->is_virtual());
+	res->materialize_self();
+	assert(!res->is_virtual());
+	matrix_conf.set_fuse_mapply(true);
+	return res;
+}
+
+/*
+ * Get the number of instructions in the fused operation of the virtual
+ * matrix. It returns 0 if the operations can't be fused.
+ */
+size_t get_num_fused(dense_matrix::ptr mat, size_t &num_inputs)
+{
+	detail::mapply_matrix_store::const_ptr store
+		= std::dynamic_pointer_cast<const detail::mapply_matrix_store>(
+				mat->get_raw_store());
+	assert(store);
+	std::vector<detail::matrix_store::const_ptr> fused_ins;
+	detail::portion_mapply_op::const_ptr op = detail::fuse_mapply(
+			store->get_input_mats(), store->get_portion_op(),
+			mat->store_layout(), fused_ins);
+	if (op == NULL)
+		return 0;
+	num_inputs = fused_ins.size();
+	return std::dynamic_pointer_cast<const detail::fused_mapply_op>(
+			op)->get_num_instrs();
+}
+
+double get_ele(dense_matrix::ptr mat, size_t row, size_t col)
+{
+	detail::mem_matrix_store::const_ptr store
+		= detail::mem_matrix_store::cast(mat->get_raw_store());
+	return store->get<double>(row, col);
+}
+
+void check_same(dense_matrix::ptr m1, dense_matrix::ptr m2)
+{
+	assert(m1->get_num_rows() == m2->get_num_rows());
+	assert(m1->get_num_cols() == m2->get_num_cols());
+	assert(m1->store_layout() == m2->store_layout());
+	// Both run the same operators on each element in the same order.
+	for (size_t i = 0; i < m1->get_num_rows(); i++)
+		for (size_t j = 0; j < m1->get_num_cols(); j++)
+			assert(get_ele(m1, i, j) == get_ele(m2, i, j));
+}
+
+void test_expr(const std::string &name, expr_func func, const mat_vec_t &ins,
+		size_t num_instrs, size_t num_inputs)
+{
+	size_t num_fused_ins = 0;
+	assert(get_num_fused(func(ins), num_fused_ins) == num_instrs);
+	assert(num_fused_ins == num_inputs);
+	dense_matrix::ptr fused = run_expr(func, ins, true);
+	dense_matrix::ptr unfused = run_expr(func, ins, false);
+	check_same(fused, unfused);
+	printf("test %s on a %s-major %ldx%ld matrix: OK\n", name.c_str(),
+			fused->store_layout() == matrix_layout_t::L_ROW ? "row" : "col",
+			fused->get_num_rows(), fused->get_num_cols());
+}
+
+void test_exprs(const mat_vec_t &ins)
+{
+	test_expr("chain", expr_chain, ins, 4, 4);
+	dense_matrix::ptr res = run_expr(expr_chain, ins, true);
+	for (size_t i = 0; i < res->get_num_rows(); i++)
+		for (size_t j = 0; j < res->get_num_cols(); j++) {
+			double expected = (get_ele(ins[0], i, j) * get_ele(ins[1], i, j)
+					+ get_ele(ins[2], i, j)) / get_ele(ins[3], i, j) * 2;
+			assert(get_ele(res, i, j) == expected);
+		}
+
+	test_expr("shared", expr_shared, ins, 5, 3);
+	test_expr("mixed", expr_mixed, ins, 2, 3);
+}
+
+mat_vec_t create_inputs(size_t nrow, size_t ncol, matrix_layout_t layout)
+{
+	matrix_layout_t other = layout == matrix_layout_t::L_COL
+		? matrix_layout_t::L_ROW : matrix_layout_t::L_COL;
+	mat_vec_t ins(5);
+	ins[0] = dense_matrix::create_randu<double>(-1, 1, nrow, ncol, layout);
+	ins[1] = dense_matrix::create_randu<double>(-1, 1, nrow, ncol, layout);
+	ins[2] = dense_matrix::create_randu<double>(-1, 1, nrow, ncol, layout);
+	// The divisor isn't 0.
+	ins[3] = dense_matrix::create_randu<double>(1, 2, nrow, ncol, layout);
+	ins[4] = dense_matrix::create_randu<double>(-1, 1, nrow, ncol, other);
+	return ins;
+}
+
+void test_layouts()
+{
+	test_exprs(create_inputs(long_dim, short_dim, matrix_layout_t::L_COL));
+	test_exprs(create_inputs(long_dim, short_dim, matrix_layout_t::L_ROW));
+
+	// Wide matrices.
+	mat_vec_t ins = create_inputs(long_dim, short_dim, matrix_layout_t::L_COL);
+	for (size_t i = 0; i < ins.size(); i++)
+		ins[i] = ins[i]->transpose();
+	test_exprs(ins);
+
+	// The inputs are a subset of columns of larger matrices.
+	// We can't get columns from a row-major matrix.
+	std::vector<off_t> idxs;
+	idxs.push_back(0);
+	idxs.push_back(2);
+	idxs.push_back(3);
+	idxs.push_back(7);
+	idxs.push_back(9);
+	ins = create_inputs(long_dim, 10, matrix_layout_t::L_COL);
+	for (size_t i = 0; i < 4; i++)
+		ins[i] = ins[i]->get_cols(idxs);
+	ins[4] = dense_matrix::create_randu<double>(-1, 1, long_dim, idxs.size(),
+			matrix_layout_t::L_ROW);
+	test_exprs(ins);
+}
+
+/*
+ * The operations aren't fused if the inputs are accessed with a different
+ * layout or have a different shape from the output.
+ */
+void test_fallback()
+{
+	dense_matrix::ptr a = dense_matrix::create_randu<double>(-1, 1,
+			long_dim, short_dim, matrix_layout_t::L_COL);
+	dense_matrix::ptr b = dense_matrix::create_randu<double>(-1, 1,
+			long_dim, short_dim, matrix_layout_t::L_COL);
+	dense_matrix::ptr prod = a->multiply_ele(*b);
+	dense_matrix::ptr sum = prod->add(*a);
+	size_t num_inputs = 0;
+	assert(get_num_fused(sum, num_inputs) == 2);
+	assert(num_inputs == 2);
+
+	detail::mapply_matrix_store::const_ptr store
+		= std::dynamic_pointer_cast<const detail::mapply_matrix_store>(
+				sum->get_raw_store());
+	std::vector<detail::matrix_store::const_ptr> ins = store->get_input_mats();
+	std::vector<detail::matrix_store::const_ptr> fused_ins;
+	dense_matrix::ptr row = dense_matrix::create_randu<double>(-1, 1,
+			long_dim, short_dim, matrix_layout_t::L_ROW);
+	ins[1] = row->get_raw_store();
+	assert(detail::fuse_mapply(ins, store->get_portion_op(),
+				matrix_layout_t::L_COL, fused_ins) == NULL);
+	dense_matrix::ptr large = dense_matrix::create_randu<double>(-1, 1,
+			long_dim + 1, short_dim, matrix_layout_t::L_COL);
+	ins[1] = large->get_raw_store();
+	assert(detail::fuse_mapply(ins, store->get_portion_op(),
+				matrix_layout_t::L_COL, fused_ins) == NULL);
+
+	// There is nothing to fuse on the inputs directly.
+	assert(get_num_fused(a->add(*b), num_inputs) == 0);
+
+	// A materialized matrix is an input of the fused operation.
+	detail::mapply_matrix_store::const_ptr prod_store
+		= std::dynamic_pointer_cast<const detail::mapply_matrix_store>(
+				prod->get_raw_store());
+	prod_store->materialize_self();
+	assert(get_num_fused(sum, num_inputs) == 0);
+	assert(get_num_fused(sum->multiply_scalar<double>(2), num_inputs) == 2);
+	assert(num_inputs == 2);
+
+	dense_matrix::ptr unfused = dense_matrix::create(
+			store->materialize(true, -1));
+	matrix_conf.set_fuse_mapply(false);
+	dense_matrix::ptr ref = a->multiply_ele(*b)->add(*a);
+	ref->materialize_self();
+	matrix_conf.set_fuse_mapply(true);
+	check_same(unfused, ref);
+	printf("test fallback: OK\n");
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		fprintf(stderr, "test conf_file\n");
+		exit(1);
+	}
+
+	std::string conf_file = argv[1];
+	config_map::ptr configs = config_map::create(conf_file);
+	init_flash_matrix(configs);
+
+	test_layouts();
+	test_fallback();
+
+	destroy_flash_matrix();
+}
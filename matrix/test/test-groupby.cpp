@@ -0,0 +1,239 @@
+/*
+ * Copyright 2014 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of FlashMatrix.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include <map>
+
+#include "common.h"
+
+#include "matrix_config.h"
+#include "sparse_matrix.h"
+#include "vector.h"
+#include "data_frame.h"
+#include "bulk_operate_ext.h"
+#include "generic_hashtable.h"
+#include "mem_vec_store.h"
+
+/*
+ * This checks the groupby hashtable against a reference groupby on small
+ * inputs and measures groupby with aggregation on a vector of keys with
+ * low and high cardinality.
+ */
+
+using namespace fm;
+
+size_t num_eles = 1024L * 1024 * 1024;
+
+class rand_set: public type_set_vec_operate<long>
+{
+	long num_keys;
+public:
+	rand_set(long num_keys) {
+		this->num_keys = num_keys;
+	}
+
+	void set(long *arr, size_t num_eles, off_t start_idx) const {
+		for (size_t i = 0; i < num_eles; i++)
+			arr[i] = random() % num_keys;
+	}
+};
+
+agg_operate::const_ptr get_add_op()
+{
+	return agg_operate::create(bulk_operate::conv2ptr(
+				get_scalar_type<long>().get_basic_ops().get_add()));
+}
+
+/*
+ * Compare the groups in the hashtable with the reference groups.
+ */
+template<class KeyType>
+void check_groups(const generic_hashtable &table,
+		const std::map<KeyType, long> &ref)
+{
+	assert(table.get_size() == ref.size());
+	data_frame::ptr df = table.conv2df();
+	detail::smp_vec_store::const_ptr keys = detail::smp_vec_store::cast(
+			df->get_vec(0));
+	detail::smp_vec_store::const_ptr vals = detail::smp_vec_store::cast(
+			df->get_vec(1));
+	assert(keys->get_length() == ref.size());
+	std::map<KeyType, long> res;
+	for (size_t i = 0; i < keys->get_length(); i++) {
+		// Each key appears once.
+		assert(res.find(keys->get<KeyType>(i)) == res.end());
+		res[keys->get<KeyType>(i)] = vals->get<long>(i);
+	}
+	assert(res == ref);
+}
+
+void insert(generic_hashtable &table, std::map<long, long> &ref,
+		const std::vector<long> &keys, const std::vector<long> &vals,
+		const agg_operate &op)
+{
+	table.insert(keys.size(), keys.data(), vals.data(), op);
+	for (size_t i = 0; i < keys.size(); i++)
+		ref[keys[i]] += vals[i];
+}
+
+void rand_insert(generic_hashtable &table, std::map<long, long> &ref,
+		size_t num, long min_key, long max_key, const agg_operate &op)
+{
+	std::vector<long> keys(num);
+	std::vector<long> vals(num);
+	for (size_t i = 0; i < num; i++) {
+		keys[i] = min_key + random() % (max_key - min_key);
+		vals[i] = random() % 100;
+	}
+	insert(table, ref, keys, vals, op);
+}
+
+void check_hashtable()
+{
+	agg_operate::const_ptr op = get_add_op();
+	generic_hashtable::ptr table = get_scalar_type<long>().create_hashtable(
+			get_scalar_type<long>());
+	std::map<long, long> ref;
+
+	// The same key is inserted many times in a batch, so a pending value
+	// is combined before the key is inserted again and the batch of
+	// pending values is combined when it's full.
+	std::vector<long> keys(1000, 7);
+	std::vector<long> vals(1000);
+	for (size_t i = 0; i < vals.size(); i++)
+		vals[i] = i + 1;
+	insert(*table, ref, keys, vals, *op);
+	check_groups(*table, ref);
+	assert(ref[7] == 500500);
+
+	// The partitions are resized while there are pending values.
+	size_t batch_sizes[] = {1, 10, 1000, 100000, 200000};
+	for (size_t i = 0; i < sizeof(batch_sizes) / sizeof(batch_sizes[0]); i++)
+		rand_insert(*table, ref, batch_sizes[i], 0, 50000, *op);
+	check_groups(*table, ref);
+
+	// Merge a table whose keys partially overlap.
+	generic_hashtable::ptr table2 = get_scalar_type<long>().create_hashtable(
+			get_scalar_type<long>());
+	std::map<long, long> ref2;
+	rand_insert(*table2, ref2, 100000, 25000, 100000, *op);
+	check_groups(*table2, ref2);
+	table->merge(*table2, *op);
+	for (auto it = ref2.begin(); it != ref2.end(); it++)
+		ref[it->first] += it->second;
+	check_groups(*table, ref);
+	printf("check the groupby hashtable: OK\n");
+}
+
+/*
+ * 0.0 and -0.0 are the same key.
+ */
+void check_float_keys()
+{
+	agg_operate::const_ptr op = get_add_op();
+	generic_hashtable::ptr table = get_scalar_type<double>().create_hashtable(
+			get_scalar_type<long>());
+	std::vector<double> keys;
+	std::vector<long> vals;
+	for (size_t i = 0; i < 1000; i++) {
+		keys.push_back(i % 3 == 0 ? 0.0 : (i % 3 == 1 ? -0.0 : 1.5));
+		vals.push_back(1);
+	}
+	table->insert(keys.size(), keys.data(), vals.data(), *op);
+	std::map<double, long> ref;
+	ref[0] = 667;
+	ref[1.5] = 333;
+	check_groups(*table, ref);
+	printf("check float keys: OK\n");
+}
+
+/*
+ * The tables of the threads are merged partition by partition.
+ */
+void check_groupby(size_t num, long num_keys)
+{
+	vector::ptr vec = vector::create(num, get_scalar_type<long>(), -1,
+			true, rand_set(num_keys));
+	data_frame::ptr res = vec->groupby(get_add_op(), true);
+
+	detail::smp_vec_store::const_ptr store = detail::smp_vec_store::cast(
+			vec->get_raw_store());
+	std::map<long, long> ref;
+	for (size_t i = 0; i < num; i++)
+		ref[store->get<long>(i)] += store->get<long>(i);
+
+	detail::smp_vec_store::const_ptr keys = detail::smp_vec_store::cast(
+			res->get_vec("val"));
+	detail::smp_vec_store::const_ptr aggs = detail::smp_vec_store::cast(
+			res->get_vec("agg"));
+	assert(keys->get_length() == ref.size());
+	assert(aggs->get_length() == ref.size());
+	size_t i = 0;
+	for (auto it = ref.begin(); it != ref.end(); it++, i++) {
+		assert(keys->get<long>(i) == it->first);
+		assert(aggs->get<long>(i) == it->second);
+	}
+	printf("check groupby on %ld elements with %ld keys: OK\n", num,
+			num_keys);
+}
+
+void test_groupby(long num_keys)
+{
+	vector::ptr vec = vector::create(num_eles, get_scalar_type<long>(), -1,
+			true, rand_set(num_keys));
+	bulk_operate::const_ptr add = bulk_operate::conv2ptr(
+			get_scalar_type<long>().get_basic_ops().get_add());
+	agg_operate::const_ptr op = agg_operate::create(add);
+
+	struct timeval start, end;
+	gettimeofday(&start, NULL);
+	data_frame::ptr res = vec->groupby(op, true);
+	gettimeofday(&end, NULL);
+	printf("groupby %ld elements with %ld keys (%ld groups) takes %.3f seconds\n",
+			vec->get_length(), num_keys, res->get_num_entries(),
+			time_diff(start, end));
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		fprintf(stderr, "test-groupby conf_file [num_eles]\n");
+		return -1;
+	}
+	std::string conf_file = argv[1];
+	if (argc >= 3)
+		num_eles = atol(argv[2]);
+	config_map::ptr configs = config_map::create(conf_file);
+	init_flash_matrix(configs);
+
+	check_hashtable();
+	check_float_keys();
+	check_groupby(1000000, 1000);
+	check_groupby(1000000, 100000);
+
+	// Low cardinality.
+	test_groupby(1000);
+	// High cardinality.
+	test_groupby(num_eles / 10);
+
+	destroy_flash_matrix();
+}
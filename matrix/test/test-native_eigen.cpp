@@ -0,0 +1,215 @@
+/*
+ * Copyright 2015 Open Connectome Project (http://openconnecto.me)
+ * Written by Da Zheng (zhengda1936@gmail.com)
+ *
+ * This file is part of FlashMatrix.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+#include <stdio.h>
+
+#include "sparse_matrix.h"
+#include "vector.h"
+#include "dense_matrix.h"
+
+#include "eigensolver.h"
+#include "small_dense.h"
+
+using namespace fm;
+using namespace fm::eigen;
+
+static small_mat rand_mat(size_t nrow, size_t ncol)
+{
+	small_mat m(nrow, ncol);
+	for (size_t j = 0; j < ncol; j++)
+		for (size_t i = 0; i < nrow; i++)
+			m(i, j) = ((double) random()) / RAND_MAX * 2 - 1;
+	return m;
+}
+
+static double max_diff(const small_mat &m1, const small_mat &m2)
+{
+	assert(m1.get_num_rows() == m2.get_num_rows());
+	assert(m1.get_num_cols() == m2.get_num_cols());
+	double ret = 0;
+	for (size_t j = 0; j < m1.get_num_cols(); j++)
+		for (size_t i = 0; i < m1.get_num_rows(); i++)
+			ret = std::max(ret, fabs(m1(i, j) - m2(i, j)));
+	return ret;
+}
+
+static void check_eigen(const small_mat &A, const std::vector<double> &vals,
+		const small_mat &V)
+{
+	size_t n = A.get_num_rows();
+	assert(vals.size() == n);
+	assert(V.get_num_rows() == n && V.get_num_cols() == n);
+	// A * V = V * diag(vals) and V is orthogonal.
+	small_mat D(n, n);
+	for (size_t i = 0; i < n; i++)
+		D(i, i) = vals[i];
+	assert(max_diff(A.multiply(V), V.multiply(D)) < 1e-10 * n);
+	assert(max_diff(V.transpose().multiply(V), small_mat::identity(n))
+			< 1e-12 * n);
+}
+
+void test_jacobi(size_t n)
+{
+	small_mat M = rand_mat(n, n);
+	small_mat A = M.add(M.transpose());
+	std::vector<double> vals;
+	small_mat V;
+	sym_eigen(A, vals, V);
+	check_eigen(A, vals, V);
+
+	// All eigenvalues are the same.
+	small_mat I = small_mat::identity(n);
+	sym_eigen(I, vals, V);
+	check_eigen(I, vals, V);
+	for (size_t i = 0; i < n; i++)
+		assert(vals[i] == 1);
+
+	// A matrix with a zero eigenvalue.
+	small_mat B = A;
+	for (size_t i = 0; i < n; i++) {
+		B(0, i) = 0;
+		B(i, 0) = 0;
+	}
+	sym_eigen(B, vals, V);
+	check_eigen(B, vals, V);
+	double min_abs = fabs(vals[0]);
+	for (size_t i = 1; i < n; i++)
+		min_abs = std::min(min_abs, fabs(vals[i]));
+	assert(min_abs < 1e-12);
+	printf("test Jacobi on a %ldx%ld matrix: OK\n", n, n);
+}
+
+void test_cholesky(size_t n)
+{
+	small_mat M = rand_mat(n, n);
+	small_mat A = M.transpose().multiply(M);
+	for (size_t i = 0; i < n; i++)
+		A(i, i) += n;
+	small_mat R;
+	assert(cholesky(A, R));
+	for (size_t j = 0; j < n; j++)
+		for (size_t i = j + 1; i < n; i++)
+			assert(R(i, j) == 0);
+	assert(max_diff(R.transpose().multiply(R), A) < 1e-10 * n);
+	small_mat Rinv = inv_upper(R);
+	assert(max_diff(R.multiply(Rinv), small_mat::identity(n)) < 1e-12 * n);
+
+	// A matrix with a negative diagonal element isn't positive definite.
+	small_mat B = A;
+	B(n - 1, n - 1) = -1;
+	assert(!cholesky(B, R));
+	printf("test Cholesky on a %ldx%ld matrix: OK\n", n, n);
+}
+
+/*
+ * A diagonal matrix whose eigenvalues are 1^p, 2^p, ..., n^p.
+ * A larger power makes the gaps between the largest eigenvalues larger.
+ */
+class diag_function: public spm_function
+{
+	vector::ptr diag;
+	int power;
+public:
+	diag_function(size_t n, int power) {
+		diag = create_seq_vector<double>(1, n, 1);
+		this->power = power;
+	}
+
+	virtual dense_matrix::ptr run(dense_matrix::ptr &x) const {
+		dense_matrix::ptr res = x;
+		for (int i = 0; i < power; i++) {
+			res = res->scale_rows(diag);
+			res->materialize_self();
+		}
+		return res;
+	}
+
+	virtual size_t get_num_cols() const {
+		return diag->get_length();
+	}
+
+	virtual size_t get_num_rows() const {
+		return diag->get_length();
+	}
+};
+
+static void check_res(const eigen_res &res, size_t n, int power, int nev)
+{
+	assert(res.vals.size() == (size_t) nev);
+	assert(res.vecs && res.vecs->get_num_cols() == (size_t) nev);
+	small_mat vecs = small_mat::create(*res.vecs);
+	for (int i = 0; i < nev; i++) {
+		// The eigenvalues of the largest magnitude come first and
+		// the eigenvectors are the unit vectors.
+		double expected = pow(n - i, power);
+		assert(fabs(res.vals[i] - expected) < 1e-6 * expected);
+		assert(fabs(fabs(vecs(n - 1 - i, i)) - 1) < 1e-6);
+	}
+}
+
+void test_native(const std::string &solver, size_t n, int power, int nev)
+{
+	eigen_options opts;
+	assert(opts.init(nev, solver));
+	eigen_res res = compute_eigen_native(new diag_function(n, power), true,
+			opts);
+	check_res(res, n, power, nev);
+	printf("test %s for %d eigenvalues of a %ldx%ld matrix: OK\n",
+			solver.c_str(), nev, n, n);
+}
+
+/*
+ * The default solver runs in Anasazi with Trilinos and runs natively
+ * without Trilinos.
+ */
+void test_default(size_t n, int nev)
+{
+	eigen_options opts;
+	assert(opts.init(nev));
+	eigen_res res = compute_eigen(new diag_function(n, 4), true, opts);
+	check_res(res, n, 4, nev);
+	printf("test the default solver (%s) for %d eigenvalues: OK\n",
+			opts.solver.c_str(), nev);
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		fprintf(stderr, "test conf_file\n");
+		exit(1);
+	}
+
+	std::string conf_file = argv[1];
+	config_map::ptr configs = config_map::create(conf_file);
+	init_flash_matrix(configs);
+
+	test_jacobi(1);
+	test_jacobi(30);
+	test_cholesky(1);
+	test_cholesky(30);
+
+	test_native("Lanczos", 200, 4, 1);
+	test_native("Lanczos", 200, 4, 6);
+	test_native("RandSVD", 100, 8, 1);
+	test_native("RandSVD", 100, 8, 4);
+	test_default(200, 4);
+
+	destroy_flash_matrix();
+}
@@ -1,3 +1,5 @@
+#include <parallel/algorithm>
+
 #include "NUMA_vector.h"
 #include "matrix_config.h"
 #include "vector.h"
@@ -37,6 +39,17 @@ void test_sort()
 	printf("sort %ld elements in NUMA vector takes %.3f\n", numa_vec->get_length(),
 			time_diff(start, end));
 
+	// The comparison sort used for the types that radix sort doesn't support.
+	std::vector<long> copy(len);
+	memcpy(copy.data(),
+			dynamic_cast<const detail::mem_vec_store &>(mem_vec->get_data()).get_raw_arr(),
+			len * sizeof(long));
+	gettimeofday(&start, NULL);
+	__gnu_parallel::sort(copy.begin(), copy.end());
+	gettimeofday(&end, NULL);
+	printf("comparison sort of %ld elements takes %.3f\n", len,
+			time_diff(start, end));
+
 	gettimeofday(&start, NULL);
 	mem_vec->sort();
 	gettimeofday(&end, NULL);
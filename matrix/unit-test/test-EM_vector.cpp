@@ -80,6 +80,34 @@ public:
 	}
 };
 
+/*
+ * The first `num_sorted' elements are sorted and are larger than the rest,
+ * which are random. The runs with the sorted elements are only merged
+ * at the end, so the merges take data from the runs unevenly.
+ */
+class set_skew_operate: public set_vec_operate
+{
+	size_t num_sorted;
+public:
+	set_skew_operate(size_t num_sorted) {
+		this->num_sorted = num_sorted;
+	}
+
+	virtual void set(void *tmp, size_t num_eles, off_t start_idx) const {
+		int *arr = (int *) tmp;
+		for (size_t i = 0; i < num_eles; i++) {
+			size_t idx = start_idx + i;
+			if (idx < num_sorted)
+				arr[i] = 1000 + idx;
+			else
+				arr[i] = random() % 1000;
+		}
+	}
+	virtual const scalar_type &get_type() const {
+		return get_scalar_type<int>();
+	}
+};
+
 void test_setdata()
 {
 	printf("test set data in EM vector\n");
@@ -183,6 +211,54 @@ void test_sort_mult1()
 				copy->get_length() * copy->get_type().get_size()) == 0);
 }
 
+static void check_sorted(vec_store::const_ptr vec, std::vector<int> expected)
+{
+	assert(vec->get_length() == expected.size());
+	local_vec_store::const_ptr res = EM_vec_store::cast(vec)->get_portion(0,
+			vec->get_length());
+	std::sort(expected.begin(), expected.end());
+	assert(memcmp(res->get_raw_arr(), expected.data(),
+				expected.size() * sizeof(int)) == 0);
+}
+
+/*
+ * A small sort buffer forces the vector to be sorted in many runs and
+ * the last run is shorter than the others. The result has to be the same
+ * as std::sort.
+ */
+void test_sort_uneven_runs()
+{
+	printf("test sort with uneven runs\n");
+	size_t orig_buf_size = matrix_conf.get_sort_buf_size();
+	int orig_depth = matrix_conf.get_sort_pipeline_depth();
+	matrix_conf.set_sort_buf_size(256 * 1024);
+	size_t run_len = EM_sort_detail::cal_sort_buf_size(get_scalar_type<int>(),
+			matrix_conf.get_sort_buf_size() / sizeof(int)).first;
+	for (int depth = 1; depth <= 3; depth++) {
+		matrix_conf.set_sort_pipeline_depth(depth);
+		size_t len = run_len * (8 + random() % 8) + random() % run_len + 1;
+		EM_vec_store::ptr vec = EM_vec_store::create(len,
+				get_scalar_type<int>());
+		vec->set_data(set_skew_operate(len / 3));
+		local_vec_store::ptr copy = vec->get_portion(0, len);
+		std::vector<int> expected((int *) copy->get_raw_arr(),
+				(int *) copy->get_raw_arr() + len);
+		printf("sort %ld elements in %ld runs with pipeline depth %d\n",
+				len, (len + run_len - 1) / run_len, depth);
+
+		// Sort multiple vectors to a new vector.
+		std::vector<EM_vec_store::const_ptr> vecs(1, vec);
+		std::vector<EM_vec_store::ptr> sorted_vecs = sort(vecs);
+		check_sorted(sorted_vecs[0], expected);
+
+		// Sort the vector in place.
+		vec->sort();
+		check_sorted(vec, expected);
+	}
+	matrix_conf.set_sort_buf_size(orig_buf_size);
+	matrix_conf.set_sort_pipeline_depth(orig_depth);
+}
+
 void test_sort_mult()
 {
 	printf("test sort multiple vectors\n");
@@ -252,6 +328,7 @@ int main(int argc, char *argv[])
 	test_sort();
 	test_sort_mult();
 	test_sort_mult1();
+	test_sort_uneven_runs();
 
 	destroy_flash_matrix();
 }
@@ -1,5 +1,7 @@
 #include <stdio.h>
+#include <math.h>
 #include <cblas.h>
+#include <atomic>
 
 #include "vector.h"
 #include "mem_worker_thread.h"
@@ -1123,6 +1125,71 @@ void test_mapply_chain(int num_nodes, const scalar_type &type)
 		verify_result(*res, *res1, approx_equal_func());
 }
 
+/*
+ * This counts the number of elements it computes.
+ */
+class count_double_operate: public bulk_uoperate
+{
+public:
+	static std::atomic<size_t> num_computed;
+
+	virtual void runA(size_t num_eles, const void *in_arr,
+			void *out_arr) const {
+		const double *t_in = (const double *) in_arr;
+		double *t_out = (double *) out_arr;
+		for (size_t i = 0; i < num_eles; i++)
+			t_out[i] = t_in[i] * 2 + 1;
+		num_computed += num_eles;
+	}
+	virtual const scalar_type &get_input_type() const {
+		return get_scalar_type<double>();
+	}
+	virtual const scalar_type &get_output_type() const {
+		return get_scalar_type<double>();
+	}
+};
+
+std::atomic<size_t> count_double_operate::num_computed;
+
+void test_shared_mapply(int num_nodes)
+{
+	printf("test a virtual matrix shared by multiple operations\n");
+	// Fusing the element-wise operations also avoids computing the shared
+	// matrix twice, so we turn it off to test the shared portions.
+	bool fuse = matrix_conf.is_fuse_mapply();
+	matrix_conf.set_fuse_mapply(false);
+
+	dense_matrix::ptr mat = dense_matrix::create_randu<double>(0, 1,
+			long_dim, 10, matrix_layout_t::L_COL, num_nodes, true);
+	size_t num_eles = mat->get_num_rows() * mat->get_num_cols();
+	bulk_uoperate::const_ptr op(new count_double_operate());
+
+	// Both inputs of the addition are the same virtual matrix.
+	detail::matrix_stats_t orig_stats = detail::matrix_stats;
+	count_double_operate::num_computed = 0;
+	dense_matrix::ptr vmat = mat->sapply(op);
+	dense_matrix::ptr res = vmat->add(*vmat);
+	res->materialize_self();
+	detail::matrix_stats.print_diff(orig_stats);
+	assert(count_double_operate::num_computed == num_eles);
+#ifdef MATRIX_DEBUG
+	assert(detail::matrix_stats.get_shared_portion_hits()
+			> orig_stats.get_shared_portion_hits());
+#endif
+
+	// The inputs of the addition are different virtual matrices that
+	// compute the same values.
+	count_double_operate::num_computed = 0;
+	dense_matrix::ptr vmat1 = mat->sapply(op);
+	dense_matrix::ptr vmat2 = mat->sapply(op);
+	dense_matrix::ptr res1 = vmat1->add(*vmat2);
+	res1->materialize_self();
+	assert(count_double_operate::num_computed == num_eles * 2);
+
+	verify_result(*res, *res1, equal_func<double>());
+	matrix_conf.set_fuse_mapply(fuse);
+}
+
 class split_op: public detail::portion_mapply_op
 {
 public:
@@ -1675,6 +1742,103 @@ void test_EM_persistent()
 	}
 }
 
+void test_qr(int num_nodes)
+{
+	printf("Test TSQR on a tall matrix (%d nodes)\n", num_nodes);
+	dense_matrix::ptr A = dense_matrix::create_randu<double>(0, 1, long_dim, 10,
+			matrix_layout_t::L_ROW, num_nodes, in_mem);
+	dense_matrix::ptr Q;
+	dense_matrix::ptr R = A->qr(&Q);
+	assert(R->get_num_rows() == 10 && R->get_num_cols() == 10);
+	// Q is represented implicitly.
+	assert(Q->is_virtual());
+	dense_matrix::ptr QR = Q->multiply(*R, matrix_layout_t::L_NONE, true);
+	verify_result(*QR, *A, approx_equal_func());
+
+	dense_matrix::ptr QtQ = Q->transpose()->multiply(*Q,
+			matrix_layout_t::L_NONE, true);
+	QtQ->materialize_self();
+	detail::mem_matrix_store::const_ptr mem_QtQ
+		= detail::mem_matrix_store::cast(QtQ->get_raw_store());
+	detail::mem_matrix_store::const_ptr mem_R
+		= detail::mem_matrix_store::cast(R->get_raw_store());
+	for (size_t i = 0; i < 10; i++) {
+		assert(mem_R->get<double>(i, i) > 0);
+		for (size_t j = 0; j < 10; j++) {
+			double expected = i == j ? 1 : 0;
+			assert(fabs(mem_QtQ->get<double>(i, j) - expected) < 1e-10);
+		}
+	}
+}
+
+/*
+ * Create a tall matrix A = X * M, where the singular values of M span
+ * about 7 orders of magnitude. Column scaling doesn't reduce the condition
+ * number because M mixes the columns. If `dup' is true, the last column
+ * of M is the same as the first one, so A is rank deficient.
+ */
+dense_matrix::ptr create_ill_cond(int num_nodes, bool dup)
+{
+	size_t ncol = 10;
+	detail::mem_col_matrix_store::ptr M = detail::mem_col_matrix_store::create(
+			ncol, ncol, get_scalar_type<double>());
+	for (size_t j = 0; j < ncol; j++)
+		for (size_t i = 0; i < ncol; i++)
+			M->set<double>(i, j, pow(10, -0.8 * i)
+					* (((double) random()) / RAND_MAX + (i == j ? 1 : 0)));
+	if (dup)
+		for (size_t i = 0; i < ncol; i++)
+			M->set<double>(i, ncol - 1, *(const double *) M->get(i, 0));
+	dense_matrix::ptr X = dense_matrix::create_randu<double>(0, 1, long_dim,
+			ncol, matrix_layout_t::L_ROW, num_nodes, in_mem);
+	dense_matrix::ptr A = X->multiply(*dense_matrix::create(M),
+			matrix_layout_t::L_NONE, true);
+	A->materialize_self();
+	return A;
+}
+
+double max_abs(dense_matrix::ptr mat)
+{
+	scalar_variable::ptr res = mat->abs()->max();
+	return *(const double *) res->get_raw();
+}
+
+void test_qr_ill_cond(int num_nodes)
+{
+	printf("Test TSQR on an ill-conditioned tall matrix (%d nodes)\n",
+			num_nodes);
+	dense_matrix::ptr A = create_ill_cond(num_nodes, false);
+	dense_matrix::ptr Q;
+	dense_matrix::ptr R = A->qr(&Q);
+	assert(R && Q);
+	dense_matrix::ptr QR = Q->multiply(*R, matrix_layout_t::L_NONE, true);
+	assert(max_abs(QR->minus(*A)) < 1e-12 * max_abs(A));
+
+	// Without orthogonalizing Q again, the error would be well above 1e-10.
+	dense_matrix::ptr QtQ = Q->transpose()->multiply(*Q,
+			matrix_layout_t::L_NONE, true);
+	QtQ->materialize_self();
+	detail::mem_matrix_store::const_ptr mem_QtQ
+		= detail::mem_matrix_store::cast(QtQ->get_raw_store());
+	detail::mem_matrix_store::const_ptr mem_R
+		= detail::mem_matrix_store::cast(R->get_raw_store());
+	for (size_t i = 0; i < 10; i++) {
+		assert(mem_R->get<double>(i, i) > 0);
+		for (size_t j = 0; j < i; j++)
+			assert(mem_R->get<double>(i, j) == 0);
+		for (size_t j = 0; j < 10; j++) {
+			double expected = i == j ? 1 : 0;
+			assert(fabs(mem_QtQ->get<double>(i, j) - expected) < 1e-10);
+		}
+	}
+
+	// Q can't be computed from a singular R.
+	A = create_ill_cond(num_nodes, true);
+	R = A->qr(&Q);
+	assert(R);
+	assert(Q == NULL);
+}
+
 void test_EM_matrix(int num_nodes)
 {
 	printf("test EM matrix\n");
@@ -1703,6 +1867,8 @@ void test_EM_matrix(int num_nodes)
 	test_agg_sub_col(-1);
 	test_agg_sub_row(-1);
 	test_sum_row_col(-1);
+	test_qr(-1);
+	test_qr_ill_cond(-1);
 #if 0
 	test_rand_init();
 	test_conv_row_col();
@@ -1724,6 +1890,8 @@ void test_mem_matrix(int num_nodes)
 	test_mapply_chain(-1, get_scalar_type<double>());
 	test_mapply_chain(-1, get_scalar_type<int>());
 	test_mapply_chain(num_nodes, get_scalar_type<int>());
+	test_shared_mapply(-1);
+	test_shared_mapply(num_nodes);
 	test_multiply_double(-1);
 	test_cast();
 	test_write2file();
@@ -1731,6 +1899,9 @@ void test_mem_matrix(int num_nodes)
 	test_conv_vec2mat();
 	test_sum_row_col(-1);
 	test_sum_row_col(num_nodes);
+	test_qr(-1);
+	test_qr(num_nodes);
+	test_qr_ill_cond(-1);
 
 	matrix_val = matrix_val_t::SEQ;
 	test_conv2(-1);
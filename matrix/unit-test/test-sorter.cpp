@@ -2,6 +2,7 @@
 
 #include "sorter.h"
 #include "generic_type.h"
+#include "loser_tree.h"
 
 using namespace fm;
 
@@ -67,8 +68,101 @@ void test_merge_with_index()
 		assert(merge_res[i] == merge_res1[i]);
 }
 
+template<class T>
+void test_radix_sort(bool decreasing)
+{
+	printf("test radix sort on type %d, decreasing: %d\n",
+			get_scalar_type<T>().get_type(), decreasing);
+	std::vector<T> vals(vec_len + random() % vec_len);
+	for (size_t i = 0; i < vals.size(); i++)
+		// Include negative values for the signed types.
+		vals[i] = (T) ((long) random() - RAND_MAX / 2) / 3;
+	std::vector<T> copy = vals;
+	std::vector<off_t> idxs(vals.size());
+	get_scalar_type<T>().get_sorter().sort_with_index((char *) vals.data(),
+			idxs.data(), vals.size(), decreasing);
+	std::vector<T> expected = copy;
+	if (decreasing)
+		std::sort(expected.begin(), expected.end(), std::greater<T>());
+	else
+		std::sort(expected.begin(), expected.end());
+	for (size_t i = 0; i < vals.size(); i++) {
+		assert(vals[i] == expected[i]);
+		assert(copy[idxs[i]] == vals[i]);
+	}
+
+	get_scalar_type<T>().get_sorter().sort((char *) copy.data(), copy.size(),
+			decreasing);
+	assert(copy == expected);
+}
+
+class run_less
+{
+	const std::vector<std::vector<long> > *runs;
+	const std::vector<size_t> *offs;
+public:
+	run_less(const std::vector<std::vector<long> > &runs,
+			const std::vector<size_t> &offs) {
+		this->runs = &runs;
+		this->offs = &offs;
+	}
+
+	bool operator()(int run1, int run2) const {
+		return (*runs)[run1][(*offs)[run1]] < (*runs)[run2][(*offs)[run2]];
+	}
+};
+
+void test_loser_tree(size_t num_runs)
+{
+	printf("test loser tree with %ld runs\n", num_runs);
+	std::vector<std::vector<long> > runs(num_runs);
+	std::vector<long> expected;
+	for (size_t i = 0; i < runs.size(); i++) {
+		// Some runs are empty.
+		runs[i].resize(random() % 1000);
+		for (size_t j = 0; j < runs[i].size(); j++)
+			// Use a small range of values to get many duplicates.
+			runs[i][j] = random() % 100;
+		std::sort(runs[i].begin(), runs[i].end());
+		expected.insert(expected.end(), runs[i].begin(), runs[i].end());
+	}
+	std::sort(expected.begin(), expected.end());
+
+	std::vector<size_t> offs(runs.size());
+	detail::loser_tree<run_less> tree(runs.size(), run_less(runs, offs));
+	for (size_t i = 0; i < runs.size(); i++)
+		tree.set_active(i, !runs[i].empty());
+	tree.rebuild();
+	std::vector<long> res;
+	int prev_run = -1;
+	while (!tree.empty()) {
+		int run = tree.top();
+		// Ties go to the run with the smaller index.
+		if (!res.empty() && res.back() == runs[run][offs[run]])
+			assert(prev_run <= run || offs[prev_run] == runs[prev_run].size());
+		res.push_back(runs[run][offs[run]]);
+		prev_run = run;
+		offs[run]++;
+		if (offs[run] < runs[run].size())
+			tree.replay();
+		else
+			tree.pop();
+	}
+	assert(tree.top() == -1);
+	assert(res == expected);
+}
+
 int main()
 {
+	test_loser_tree(1);
+	test_loser_tree(7);
+	test_loser_tree(64);
 	test_merge_with_index();
 	test_sort();
+	for (int i = 0; i < 2; i++) {
+		test_radix_sort<int>(i);
+		test_radix_sort<long>(i);
+		test_radix_sort<float>(i);
+		test_radix_sort<double>(i);
+	}
 }
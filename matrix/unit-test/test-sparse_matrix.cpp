@@ -1,9 +1,13 @@
 #include <unordered_set>
 
+#include "safs_file.h"
+
 #include "in_mem_storage.h"
 
 #include "fm_utils.h"
 #include "sparse_matrix.h"
+#include "spgemm.h"
+#include "matrix_config.h"
 #include "data_frame.h"
 
 using namespace fm;
@@ -99,6 +103,96 @@ void test_spmm_block(SpM_2d_index::ptr idx, SpM_2d_storage::ptr mat,
 	print_cols(out);
 }
 
+detail::mem_matrix_store::ptr spmm(sparse_matrix::ptr spm,
+		detail::mem_matrix_store::ptr in)
+{
+	detail::mem_matrix_store::ptr out
+		= detail::NUMA_row_tall_matrix_store::create(spm->get_num_rows(),
+				in->get_num_cols(), num_nodes, get_scalar_type<float>());
+	out->reset_data();
+	spm->multiply<float, float>(in, out);
+	return out;
+}
+
+/*
+ * (A * A) * X has to be the same as A * (A * X).
+ */
+void check_spgemm(sparse_matrix::ptr spm, sparse_matrix::ptr prod)
+{
+	assert(prod->get_num_rows() == spm->get_num_rows());
+	assert(prod->get_num_cols() == spm->get_num_cols());
+	detail::mem_matrix_store::ptr in_mat
+		= detail::NUMA_row_tall_matrix_store::create(spm->get_num_cols(), 10,
+				num_nodes, get_scalar_type<float>());
+	for (size_t i = 0; i < in_mat->get_num_rows(); i++)
+		for (size_t j = 0; j < in_mat->get_num_cols(); j++)
+			in_mat->set<float>(i, j, random() % 10);
+	detail::mem_matrix_store::ptr out1 = spmm(prod, in_mat);
+	detail::mem_matrix_store::ptr out2 = spmm(spm, spmm(spm, in_mat));
+	for (size_t i = 0; i < out1->get_num_rows(); i++)
+		for (size_t j = 0; j < out1->get_num_cols(); j++) {
+			float v1 = out1->get<float>(i, j);
+			float v2 = out2->get<float>(i, j);
+			assert(fabs(v1 - v2) <= 1e-4 * std::max(fabs(v1), fabs(v2)));
+		}
+}
+
+void test_spgemm_block(SpM_2d_index::ptr idx, SpM_2d_storage::ptr mat,
+		bool two_phase, spgemm_acc_t acc)
+{
+	printf("test SpGEMM on 2D-partitioned matrix (two phases: %d, acc: %d)\n",
+			two_phase, acc);
+	sparse_matrix::ptr spm = sparse_matrix::create(idx, mat);
+	spgemm_options opts;
+	opts.two_phase = two_phase;
+	opts.acc = acc;
+	std::pair<SpM_2d_index::ptr, SpM_2d_storage::ptr> res
+		= spgemm(*spm, *spm, opts);
+	assert(res.first);
+	assert(res.second);
+	res.second->verify();
+	check_spgemm(spm, sparse_matrix::create(res.first, res.second));
+}
+
+/*
+ * The external-memory SpGEMM writes the output to SAFS. We also multiply
+ * the output stored in SAFS, so the block rows are read from SAFS
+ * asynchronously.
+ */
+void test_spgemm_export(SpM_2d_index::ptr idx, SpM_2d_storage::ptr mat,
+		bool two_phase)
+{
+	printf("test SpGEMM to SAFS (two phases: %d)\n", two_phase);
+	const std::string mat_file = "test-spgemm.mat";
+	const std::string mat_idx_file = "test-spgemm.mat_idx";
+	sparse_matrix::ptr spm = sparse_matrix::create(idx, mat);
+	spgemm_options opts;
+	opts.two_phase = two_phase;
+	// The cache is smaller than the number of block rows, so some block
+	// rows are read more than once.
+	opts.max_cached_brows = 4;
+	bool ret = spgemm_export(*spm, *spm, mat_file, mat_idx_file, opts);
+	assert(ret);
+
+	SpM_2d_index::ptr res_idx = SpM_2d_index::safs_load(mat_idx_file);
+	SpM_2d_storage::ptr res_mat = SpM_2d_storage::safs_load(mat_file, res_idx);
+	res_mat->verify();
+	sparse_matrix::ptr prod = sparse_matrix::create(res_idx, res_mat);
+	check_spgemm(spm, prod);
+
+	sparse_matrix::ptr em_prod = sparse_matrix::create(res_idx,
+			safs::create_io_factory(mat_file, safs::REMOTE_ACCESS));
+	std::pair<SpM_2d_index::ptr, SpM_2d_storage::ptr> res
+		= spgemm(*em_prod, *em_prod, opts);
+	assert(res.first);
+	assert(res.second);
+	res.second->verify();
+	check_spgemm(prod, sparse_matrix::create(res.first, res.second));
+
+	safs::safs_file(safs::get_sys_RAID_conf(), mat_file).delete_file();
+	safs::safs_file(safs::get_sys_RAID_conf(), mat_idx_file).delete_file();
+}
+
 void test_multiply_block(edge_list::ptr el)
 {
 	printf("Multiply on 2D-partitioned matrix\n");
@@ -121,6 +215,154 @@ void test_multiply_block(edge_list::ptr el)
 				adj->get_length(i), entry_size);
 
 	test_spmm_block(mat.first, mat.second, degrees);
+	test_spgemm_block(mat.first, mat.second, false, SPGEMM_ACC_AUTO);
+	test_spgemm_block(mat.first, mat.second, true, SPGEMM_ACC_AUTO);
+	test_spgemm_block(mat.first, mat.second, false, SPGEMM_ACC_HASH);
+	test_spgemm_block(mat.first, mat.second, true, SPGEMM_ACC_HEAP);
+	test_spgemm_export(mat.first, mat.second, false);
+	test_spgemm_export(mat.first, mat.second, true);
+
+	printf("Multiply on 2D-partitioned matrix with packed row parts\n");
+	matrix_conf.set_pack_sparse_blocks(true);
+	mat = create_2d_matrix(adj, oned_mat.second, block_size, entry_type);
+	matrix_conf.set_pack_sparse_blocks(false);
+	assert(mat.first);
+	assert(mat.second);
+	mat.second->verify();
+	test_spmm_block(mat.first, mat.second, degrees);
+	test_spgemm_block(mat.first, mat.second, false, SPGEMM_ACC_AUTO);
+	test_spgemm_block(mat.first, mat.second, false, SPGEMM_ACC_HEAP);
+}
+
+typedef std::pair<uint16_t, std::vector<uint16_t> > local_row_t;
+
+/*
+ * Build a 2D block in `buf' from the rows in the block. The rows with
+ * a single non-zero entry are stored in the COO region. The value of
+ * a non-zero entry is its position in the block.
+ */
+sparse_block_2d *build_block(char *buf, const std::vector<local_row_t> &rows,
+		const block_2d_size &block_size)
+{
+	sparse_block_2d *block = new (buf) sparse_block_2d(0, 0);
+	std::unique_ptr<char[]> part_buf(new char[sparse_row_part::get_size(
+				block_size.get_num_cols())]);
+	std::vector<coo_nz_t> single_nnz;
+	for (size_t i = 0; i < rows.size(); i++) {
+		const std::vector<uint16_t> &cols = rows[i].second;
+		if (cols.size() == 1) {
+			single_nnz.push_back(coo_nz_t(rows[i].first, cols[0]));
+			continue;
+		}
+		sparse_row_part *part = new (part_buf.get()) sparse_row_part(
+				rows[i].first);
+		rp_edge_iterator edge_it = part->get_edge_iterator();
+		for (size_t k = 0; k < cols.size(); k++)
+			edge_it.append(block_size, cols[k]);
+		block->append(*part, sparse_row_part::get_size(cols.size()));
+	}
+	if (!single_nnz.empty())
+		block->add_coo(single_nnz, block_size);
+	std::vector<int> vals(block->get_nnz());
+	for (size_t i = 0; i < vals.size(); i++)
+		vals[i] = i;
+	block->finalize((const char *) vals.data(), vals.size() * sizeof(int));
+	return block;
+}
+
+const char *get_coo_addr(const sparse_block_2d *block)
+{
+	return (const char *) block->get_coo_start();
+}
+
+void check_block_vals(const sparse_block_2d *block)
+{
+	int val = 0;
+	rp_edge_iterator it = block->get_first_edge_iterator(sizeof(int));
+	while (!block->is_rparts_end(it)) {
+		while (it.has_next()) {
+			assert(it.get_curr_data<int>() == val);
+			it.next();
+			val++;
+		}
+		it = block->get_next_edge_iterator(it, sizeof(int));
+	}
+	const int *coo_vals = (const int *) block->get_coo_val_start(sizeof(int));
+	for (size_t i = 0; i < block->get_num_coo_vals(); i++, val++)
+		assert(coo_vals[i] == val);
+	assert((size_t) val == block->get_nnz());
+}
+
+void test_pack_block()
+{
+	printf("Pack the row parts of a 2D block\n");
+	const block_2d_size block_size(1024, 1024);
+	std::unique_ptr<char[]> buf(new char[safs::PAGE_SIZE]);
+
+	std::vector<local_row_t> rows(4);
+	// 64 consecutive col idxs. The deltas take 63 bytes plus a byte
+	// of padding, so the row part is packed in 70 bytes instead of 130.
+	rows[0].first = 0;
+	for (uint16_t i = 0; i < 64; i++)
+		rows[0].second.push_back(i);
+	// The first delta is the largest one stored in a byte. The last one
+	// is the smallest one that needs the escape byte. The row part is
+	// packed in 12 bytes instead of 10.
+	rows[1].first = 3;
+	rows[1].second = {10, 265, 266, 522};
+	// The delta needs the escape byte. 10 bytes instead of 6.
+	rows[2].first = 7;
+	rows[2].second = {0, 1023};
+	// This is stored in the COO region.
+	rows[3].first = 9;
+	rows[3].second = {5};
+
+	sparse_block_2d *block = build_block(buf.get(), rows, block_size);
+	assert(!block->is_packed());
+	assert(block->get_num_coo_vals() == 1);
+	assert(block->get_nnz() == 71);
+	// The row-part region including the empty row part at the end.
+	const size_t orig_rheader_size = 130 + 10 + 6 + 2;
+	const size_t packed_rheader_size = sizeof(uint32_t) + 70 + 12 + 10 + 2;
+	const char *rparts = get_coo_addr(block) - orig_rheader_size;
+	size_t orig_size = block->get_size(sizeof(int));
+	std::vector<coo_nz_t> orig_nnz = block->get_non_zeros(block_size);
+
+	assert(block->pack(sizeof(int)));
+	assert(block->is_packed());
+	assert(block->get_block_col_idx() == 0);
+	assert(block->get_size(sizeof(int))
+			== orig_size - orig_rheader_size + packed_rheader_size);
+	// The encoded length of the row parts is stored in front of them.
+	uint32_t encoded_len;
+	memcpy(&encoded_len, rparts, sizeof(encoded_len));
+	assert(encoded_len == packed_rheader_size - sizeof(uint32_t));
+	assert(get_coo_addr(block) == rparts + packed_rheader_size);
+	// The deltas of the second row part: 254, 0 and 255 after the escape.
+	const uint8_t *deltas = (const uint8_t *) rparts + sizeof(uint32_t) + 70
+		+ 3 * sizeof(uint16_t);
+	assert(deltas[0] == 254);
+	assert(deltas[1] == 0);
+	assert(deltas[2] == rp_edge_iterator::PACKED_ESCAPE);
+	uint16_t long_delta;
+	memcpy(&long_delta, deltas + 3, sizeof(long_delta));
+	assert(long_delta == 255);
+
+	block->verify(block_size);
+	assert(block->get_non_zeros(block_size) == orig_nnz);
+	check_block_vals(block);
+	// A block can only be packed once.
+	assert(!block->pack(sizeof(int)));
+
+	// Packing a block with only large deltas doesn't save space,
+	// so the block is kept as it is.
+	rows.erase(rows.begin(), rows.begin() + 2);
+	block = build_block(buf.get(), rows, block_size);
+	orig_size = block->get_size(sizeof(int));
+	assert(!block->pack(sizeof(int)));
+	assert(!block->is_packed());
+	assert(block->get_size(sizeof(int)) == orig_size);
+	check_block_vals(block);
 }
 
 void test_spmm_fg(fg::FG_graph::ptr fg)
@@ -159,9 +401,19 @@ void test_multiply_fg(edge_list::ptr el)
 	test_spmm_fg(fg);
 }
 
-int main()
+int main(int argc, char *argv[])
 {
-	init_flash_matrix(NULL);
+	if (argc < 2) {
+		fprintf(stderr, "test conf_file\n");
+		exit(1);
+	}
+
+	// The external-memory SpGEMM needs SAFS.
+	std::string conf_file = argv[1];
+	config_map::ptr configs = config_map::create(conf_file);
+	init_flash_matrix(configs);
+	test_pack_block();
+
 	edge_list::ptr el = create_rand_el(false);
 	test_multiply_fg(el);
 	test_multiply_block(el);
@@ -261,24 +261,46 @@ void agg_vec_portion_op::run(
 	ltable->insert(key_idx, lkeys->get_raw_arr(), laggs->get_raw_arr(), *agg_op);
 }
 
-generic_hashtable::ptr agg_vec_portion_op::get_agg() const
+/*
+ * This merges a partition of the local tables to the first table.
+ */
+class merge_part_task: public thread_task
 {
-	generic_hashtable::ptr ret;
-	size_t i;
-	// Find a local table.
-	for (i = 0; i < tables.size(); i++) {
-		if (tables[i]) {
-			ret = tables[i];
-			break;
-		}
+	std::vector<generic_hashtable::ptr> tables;
+	size_t part_id;
+	agg_operate::const_ptr agg_op;
+public:
+	merge_part_task(const std::vector<generic_hashtable::ptr> &tables,
+			size_t part_id, agg_operate::const_ptr agg_op) {
+		this->tables = tables;
+		this->part_id = part_id;
+		this->agg_op = agg_op;
+	}
+
+	void run() {
+		for (size_t i = 1; i < tables.size(); i++)
+			tables[0]->merge_part(part_id, *tables[i], *agg_op);
 	}
-	// We need to move to the next local table.
-	i++;
-	// Merge with other local tables if they exist.
-	for (; i < tables.size(); i++)
+};
+
+generic_hashtable::ptr agg_vec_portion_op::get_agg() const
+{
+	std::vector<generic_hashtable::ptr> local_tables;
+	for (size_t i = 0; i < tables.size(); i++)
 		if (tables[i])
-			ret->merge(*tables[i], *agg_op);
-	return ret;
+			local_tables.push_back(tables[i]);
+	if (local_tables.size() <= 1)
+		return local_tables.empty() ? generic_hashtable::ptr() : local_tables[0];
+
+	// The partitions of the local tables are independent, so they are
+	// merged in parallel.
+	detail::mem_thread_pool::ptr mem_threads
+		= detail::mem_thread_pool::get_global_mem_threads();
+	for (size_t i = 0; i < local_tables[0]->get_num_parts(); i++)
+		mem_threads->process_task(i % mem_threads->get_num_nodes(),
+				new merge_part_task(local_tables, i, agg_op));
+	mem_threads->wait4complete();
+	return local_tables[0];
 }
 
 }